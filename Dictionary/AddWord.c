@@ -20,6 +20,8 @@ BOOLEAN
 AddWordEntry(
     PDICTIONARY Dictionary,
     PCBYTE Word,
+    ULONG Length,
+    LONGLONG Increment,
     PCWORD_ENTRY *WordEntryPointer,
     PLONGLONG EntryCountPointer
     )
@@ -40,10 +42,19 @@ Arguments:
     Dictionary - Supplies a pointer to a DICTIONARY structure to which the
         word is to be added.
 
-    Word - Supplies a NULL-terminated array of bytes to add to the dictionary.
-        The length of the array must be between the minimum and maximum lengths
-        configured for the dictionary, otherwise the word will be rejected and
-        this routine will return FALSE.
+    Word - Supplies an array of bytes to add to the dictionary.  The length
+        of the array must be between the minimum and maximum lengths configured
+        for the dictionary, otherwise the word will be rejected and this
+        routine will return FALSE.
+
+    Length - Supplies the length of the word, in bytes, or zero if the array
+        of bytes is NULL-terminated.  If a non-zero length is supplied, the
+        array does not need to be NULL-terminated.
+
+    Increment - Supplies the number of occurrences of the word being added.
+        Must be greater than zero.  (This is 1 for everything except word
+        counter flushes, which add the number of occurrences of the word that
+        were counted locally.)
 
     WordEntryPointer - Supplies an address to a variable that receives the
         address of the WORD_ENTRY structure representing the word added if
@@ -63,9 +74,9 @@ Return Value:
     BOOL Success;
     PVOID Entry;
     PBYTE Buffer;
-    ULONG Length;
     ULONG EntrySize;
     ULONGLONG StringBytesUsed = 0;
+    LONGLONG ClockCount;
     PULONG BitmapHash;
     PULONG HistogramHash;
     BOOLEAN NewWordEntry;
@@ -77,6 +88,7 @@ Return Value:
     PRTL_AVL_TABLE Avl;
     PALLOCATOR WordAllocator;
     PLONG_STRING String;
+    PPREFIX_NODE PrefixNode;
     PWORD_TABLE WordTable;
     PWORD_ENTRY WordEntry;
     PWORD_STATS WordStats;
@@ -89,6 +101,7 @@ Return Value:
     PCLONG_STRING CurrentLongestWord;
     PCLONG_STRING LongestWordAllTime;
     PTABLE_ENTRY_HEADER TableEntryHeader;
+    PTABLE_ENTRY_HEADER OwnerHeader;
     ULARGE_INTEGER TotalStringBufferAllocSize;
     PRTL_INITIALIZE_GENERIC_TABLE_AVL RtlInitializeGenericTableAvl;
     PRTL_INSERT_ELEMENT_GENERIC_TABLE_AVL RtlInsertElementGenericTableAvl;
@@ -96,6 +109,7 @@ Return Value:
     PWORD_TABLE_ENTRY WordTableEntry;
     PLENGTH_TABLE_ENTRY LengthTableEntry;
     PBITMAP_TABLE_ENTRY BitmapTableEntry;
+    PWORD_TABLE_ENTRY InlineWordTableEntry;
     PHISTOGRAM_TABLE_ENTRY HistogramTableEntry;
 
     TABLE_ENTRY_HEADER WordTableEntryHeader;
@@ -119,6 +133,10 @@ Return Value:
         return FALSE;
     }
 
+    if (Increment <= 0) {
+        return FALSE;
+    }
+
     //
     // Clear the caller's word entry and entry count pointers up-front.
     //
@@ -160,14 +178,26 @@ Return Value:
     // then use these as part of the AVL table insertion.
     //
 
-    Success = InitializeWord(Word,
-                             Dictionary->MinimumWordLength,
-                             Dictionary->MaximumWordLength,
-                             String,
-                             &Bitmap,
-                             &Histogram,
-                             BitmapHash,
-                             HistogramHash);
+    if (Length) {
+        Success = InitializeWordWithLength(Word,
+                                           Length,
+                                           Dictionary->MinimumWordLength,
+                                           Dictionary->MaximumWordLength,
+                                           String,
+                                           &Bitmap,
+                                           &Histogram,
+                                           BitmapHash,
+                                           HistogramHash);
+    } else {
+        Success = InitializeWord(Word,
+                                 Dictionary->MinimumWordLength,
+                                 Dictionary->MaximumWordLength,
+                                 String,
+                                 &Bitmap,
+                                 &Histogram,
+                                 BitmapHash,
+                                 HistogramHash);
+    }
 
     if (!Success) {
         return FALSE;
@@ -181,6 +211,20 @@ Return Value:
     WordTableEntryHeader.Hash = String->Hash;
     LengthTableEntryHeader.Length = String->Length;
 
+    //
+    // If the dictionary is maintaining a prefix index, ensure a node exists
+    // for the word.  This is done prior to touching any of the tables, such
+    // that a failure here leaves the dictionary untouched.
+    //
+
+    PrefixNode = NULL;
+
+    if (Dictionary->PrefixIndex) {
+        if (!InsertPrefixIndexWord(Dictionary, String, &PrefixNode)) {
+            return FALSE;
+        }
+    }
+
     //
     // Initialize the dictionary context and register it with TLS.
     //
@@ -264,93 +308,135 @@ Return Value:
     }
 
     //
-    // Update the TLS context and initialize the word table alias.
+    // Update the TLS context and resolve the histogram table entry's header.
     //
 
     Context.HistogramTableEntry = HistogramTableEntry;
-    WordTable = &HistogramTableEntry->WordTable;
+    TableEntryHeader = TABLE_ENTRY_TO_HEADER(HistogramTableEntry);
+    WordTable = NULL;
 
     if (NewHistogramEntry) {
 
         //
-        // A new histogram entry was created; initialize the underlying word
-        // entry AVL table.
+        // A new histogram entry was created.  Copy the hash back over, then
+        // store the word inline within the entry.  We don't initialize a word
+        // table until a second word with the same histogram hash is added.
         //
 
-        RtlInitializeGenericTableAvl(&WordTable->Avl,
-                                     WordTableCompareRoutine,
-                                     WordTableAllocateRoutine,
-                                     WordTableFreeRoutine,
-                                     Dictionary);
+        TableEntryHeader->Hash = *HistogramHash;
+        TableEntryHeader->HasInlineWord = TRUE;
+
+        CopyMemory(&HistogramTableEntry->InlineWordTableEntry,
+                   WordTableEntry,
+                   sizeof(*WordTableEntry));
+
+        WordTableEntry = &HistogramTableEntry->InlineWordTableEntry;
+        NewWordEntry = TRUE;
+
+    } else if (TableEntryHeader->HasInlineWord) {
 
         //
-        // Copy the hash back over.
+        // The histogram entry already exists and has an inline word.  If it's
+        // the same word as the one being added, we can use it directly.  If
+        // not, convert the inline word into a word table entry and fall back
+        // to the normal word table insertion logic below.
         //
 
-        TableEntryHeader = TABLE_ENTRY_TO_HEADER(HistogramTableEntry);
-        TableEntryHeader->Hash = *HistogramHash;
-    }
+        InlineWordTableEntry = &HistogramTableEntry->InlineWordTableEntry;
 
-    //
-    // Prepare a word table entry for potential insertion into the histogram's
-    // word table.
-    //
+        if (IsSameWord(&InlineWordTableEntry->WordEntry.String, String)) {
 
-    Context.String = String;
-    Context.WordTable = WordTable;
-    Context.WordEntry = &WordTableEntry->WordEntry;
-    Context.WordTableEntry = WordTableEntry;
-    Context.TableEntryHeader = &WordTableEntryHeader;
+            WordTableEntry = InlineWordTableEntry;
+            NewWordEntry = FALSE;
 
-    Entry = WordTableEntry;
-    EntrySize = sizeof(*WordTableEntry);
-    WordTableEntry = RtlInsertElementGenericTableAvl(&WordTable->Avl,
-                                                     Entry,
-                                                     EntrySize,
-                                                     &NewWordEntry);
+        } else {
 
-    if (!WordTableEntry) {
+            if (!ConvertInlineWordToWordTable(Dictionary,
+                                              HistogramTableEntry)) {
+                goto Error;
+            }
+
+            WordTable = &HistogramTableEntry->WordTable;
+        }
+
+    } else {
 
         //
-        // See explanation above in comment regarding failed histogram table
-        // entry.  TL;DR ignore for now.
+        // The histogram entry already has a word table.
         //
 
-        goto Error;
+        WordTable = &HistogramTableEntry->WordTable;
+    }
+
+    if (WordTable) {
+
+        //
+        // Prepare a word table entry for potential insertion into the
+        // histogram's word table.
+        //
+
+        Context.String = String;
+        Context.WordTable = WordTable;
+        Context.WordEntry = &WordTableEntry->WordEntry;
+        Context.WordTableEntry = WordTableEntry;
+        Context.TableEntryHeader = &WordTableEntryHeader;
+
+        Entry = WordTableEntry;
+        EntrySize = sizeof(*WordTableEntry);
+        WordTableEntry = RtlInsertElementGenericTableAvl(&WordTable->Avl,
+                                                         Entry,
+                                                         EntrySize,
+                                                         &NewWordEntry);
+
+        if (!WordTableEntry) {
+
+            //
+            // See explanation above in comment regarding failed histogram
+            // table entry.  TL;DR ignore for now.
+            //
+
+            goto Error;
+        }
     }
 
     WordEntry = &WordTableEntry->WordEntry;
     String = &WordEntry->String;
 
+    if (WordTable) {
+        OwnerHeader = TABLE_ENTRY_TO_HEADER(WordTableEntry);
+    } else {
+        OwnerHeader = TABLE_ENTRY_TO_HEADER(HistogramTableEntry);
+    }
+
     if (NewWordEntry) {
 
         //
-        // Allocate new space for the underlying string buffer and then copy
-        // the input string over such that we're not reliant on the memory
-        // provided by the caller.  We add 1 to the length to account for the
-        // trailing NULL.
+        // Copy the input string into storage owned by the dictionary such
+        // that we're not reliant on the memory provided by the caller.  Short
+        // strings are stored inline within the word table entry; otherwise,
+        // allocate new space for the string buffer.  We add 1 to the length
+        // to account for the trailing NULL.
         //
 
         Length = WordEntry->String.Length;
 
-        Buffer = (PBYTE)WordAllocator->Calloc(WordAllocator, 1, Length + 1);
+        if (IsInlineStringLength(Length)) {
 
-        if (!Buffer) {
-            goto Error;
-        }
+            Buffer = WordTableEntry->InlineString;
+            OwnerHeader->IsInlineString = TRUE;
 
-        //
-        // Update the number of bytes allocated to string buffers in the
-        // current word table.  Because the high and low parts of the count
-        // are split, we need to do some LARGE_INTEGER juggling.
-        //
+        } else {
+
+            Buffer = (PBYTE)(
+                WordAllocator->Calloc(WordAllocator, 1, Length + 1)
+            );
 
-        Avl = &WordTable->Avl;
-        TotalStringBufferAllocSize.LowPart = Avl->BytesAllocatedLowPart;
-        TotalStringBufferAllocSize.HighPart = Avl->BytesAllocatedHighPart;
-        TotalStringBufferAllocSize.QuadPart += (Length + 1);
-        Avl->BytesAllocatedLowPart = TotalStringBufferAllocSize.LowPart;
-        Avl->BytesAllocatedHighPart = TotalStringBufferAllocSize.HighPart;
+            if (!Buffer) {
+                goto Error;
+            }
+
+            OwnerHeader->IsInlineString = FALSE;
+        }
 
         //
         // Copy the buffer, add the trailing NULL, switch the underlying word
@@ -361,12 +447,31 @@ Return Value:
         Buffer[Length] = '\0';
         WordEntry->String.Buffer = Buffer;
 
-        //
-        // Copy the hash back over.
-        //
+        if (WordTable) {
+
+            //
+            // Update the number of bytes allocated to string buffers in the
+            // current word table.  Because the high and low parts of the count
+            // are split, we need to do some LARGE_INTEGER juggling.  (Inline
+            // strings are included, as the count is used to size copies of
+            // the table's strings.)
+            //
+
+            Avl = &WordTable->Avl;
+            TotalStringBufferAllocSize.LowPart = Avl->BytesAllocatedLowPart;
+            TotalStringBufferAllocSize.HighPart = Avl->BytesAllocatedHighPart;
+            TotalStringBufferAllocSize.QuadPart += (Length + 1);
+            Avl->BytesAllocatedLowPart = TotalStringBufferAllocSize.LowPart;
+            Avl->BytesAllocatedHighPart = TotalStringBufferAllocSize.HighPart;
+
+            //
+            // Copy the hash back over.  (Inline words don't have their own
+            // table entry header; the histogram's header precedes them.)
+            //
 
-        TableEntryHeader = TABLE_ENTRY_TO_HEADER(WordTableEntry);
-        TableEntryHeader->Hash = WordEntry->String.Hash;
+            TableEntryHeader = TABLE_ENTRY_TO_HEADER(WordTableEntry);
+            TableEntryHeader->Hash = WordEntry->String.Hash;
+        }
 
         //
         // As this is a new word, insert the length into the dictionary's
@@ -476,6 +581,9 @@ Return Value:
         InsertTailList(&LengthTableEntry->LengthListHead,
                        &WordTableEntry->LengthListEntry);
 
+        LengthTableEntry->NumberOfWords++;
+        Dictionary->NumberOfWords++;
+
     } else {
 
         //
@@ -489,11 +597,13 @@ Return Value:
 
     //
     // Increment the word's entry count and capture the current value.  Update
-    // the maximum entry count if applicable.
+    // the maximum entry count if applicable.  (As counts only increase here,
+    // applying an increment greater than one yields the same maximum as the
+    // equivalent number of single increments.)
     //
 
     WordStats = &WordEntry->Stats;
-    WordStats->EntryCount++;
+    WordStats->EntryCount += Increment;
 
     if (WordStats->EntryCount > WordStats->MaximumEntryCount) {
 
@@ -504,6 +614,61 @@ Return Value:
         WordStats->MaximumEntryCount = WordStats->EntryCount;
     }
 
+    //
+    // Update the word's saturating CLOCK counter, which is used to select
+    // eviction victims if the dictionary has a budget.  The first occurrence
+    // of a new word isn't counted; a word seen once is the first candidate
+    // for eviction.
+    //
+
+    if (NewWordEntry) {
+        ClockCount = Increment - 1;
+    } else {
+        ClockCount = OwnerHeader->ClockCount + Increment;
+    }
+
+    if (ClockCount > DICTIONARY_MAXIMUM_CLOCK_COUNT) {
+        ClockCount = DICTIONARY_MAXIMUM_CLOCK_COUNT;
+    }
+
+    OwnerHeader->ClockCount = (ULONG)ClockCount;
+
+    //
+    // Update the word's prefix index node, if applicable.
+    //
+
+    if (PrefixNode) {
+        UpdatePrefixIndexEntryCount(Dictionary,
+                                    PrefixNode,
+                                    WordStats->EntryCount);
+    }
+
+    //
+    // Append the addition to the write-ahead log, if applicable.  This is
+    // done here, rather than by AddWord(), such that every routine that adds
+    // words is logged, and before any evictions below, such that they're
+    // replayed in the same order.  (The routine that acquired the lock waits
+    // for the record to become durable.)
+    //
+
+    if (Dictionary->Log) {
+        AppendDictionaryLogRecord(Dictionary->Log,
+                                  DictionaryLogAddWordOperation,
+                                  WordEntry->String.Buffer,
+                                  WordEntry->String.Length,
+                                  Increment);
+    }
+
+    //
+    // If eviction is enabled, evict words until the dictionary is back within
+    // its budget.  The word we've just added is protected from eviction.  A
+    // failure to evict doesn't affect the outcome of the addition.
+    //
+
+    if (Dictionary->Flags.IsEvictionEnabled) {
+        EvictWords(Dictionary, WordTableEntry);
+    }
+
     //
     // Update the caller's pointers.
     //
@@ -526,6 +691,14 @@ Return Value:
 
     Success = FALSE;
 
+    //
+    // Remove the word's prefix index node if it was created for this call.
+    //
+
+    if (PrefixNode) {
+        PrunePrefixIndexNode(Dictionary, PrefixNode);
+    }
+
     //
     // Intentional follow-on to End.
     //
@@ -535,6 +708,242 @@ End:
     return Success;
 }
 
+_Use_decl_annotations_
+BOOLEAN
+ConvertInlineWordToWordTable(
+    PDICTIONARY Dictionary,
+    PHISTOGRAM_TABLE_ENTRY HistogramTableEntry
+    )
+/*++
+
+Routine Description:
+
+    Converts a histogram table entry's inline word into a word table entry.
+    The word table is initialized in place (overwriting the inline word), the
+    word is inserted into it, and all references to the old inline address
+    (the length list linkage and the dictionary's longest word pointers) are
+    updated to point to the new word table entry.
+
+    This routine is called by AddWordEntry() when a second word with the same
+    histogram hash is added to the dictionary.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure that owns the
+        histogram table entry.
+
+    HistogramTableEntry - Supplies a pointer to the histogram table entry with
+        an inline word to convert.  The HasInlineWord bit will be cleared upon
+        successful conversion.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  If FALSE is returned, the histogram
+    table entry is left unchanged (i.e. it still has its inline word).
+
+--*/
+{
+    PRTL Rtl;
+    PBYTE Buffer;
+    PBYTE ArenaBuffer;
+    BOOLEAN NewWordEntry;
+    BOOLEAN IsInlineString;
+    PLIST_ENTRY ListEntry;
+    PRTL_AVL_TABLE Avl;
+    PLONG_STRING String;
+    PWORD_TABLE WordTable;
+    PCLONG_STRING OldString;
+    PLONG_STRING NewString;
+    PALLOCATOR WordAllocator;
+    PDICTIONARY_ARENA_CHUNK StringChunk;
+    PTABLE_ENTRY_HEADER HistogramTableEntryHeader;
+    PTABLE_ENTRY_HEADER TableEntryHeader;
+    PWORD_TABLE_ENTRY WordTableEntry;
+    PWORD_TABLE_ENTRY InlineWordTableEntry;
+    ULARGE_INTEGER TotalStringBufferAllocSize;
+    TABLE_ENTRY_HEADER WordTableEntryHeader;
+
+    //
+    // Initialize aliases.
+    //
+
+    Rtl = Dictionary->Rtl;
+    WordAllocator = Dictionary->WordAllocator;
+    WordTable = &HistogramTableEntry->WordTable;
+    InlineWordTableEntry = &HistogramTableEntry->InlineWordTableEntry;
+    OldString = &InlineWordTableEntry->WordEntry.String;
+
+    ASSERT(HistogramTableEntryHasInlineWord(HistogramTableEntry));
+
+    //
+    // Take a copy of the inline word into a local table entry header, as it's
+    // about to be overwritten by the word table initialization.
+    //
+
+    ZeroStruct(WordTableEntryHeader);
+
+    CopyMemory(&WordTableEntryHeader.WordTableEntry,
+               InlineWordTableEntry,
+               sizeof(*InlineWordTableEntry));
+
+    WordTableEntryHeader.Hash = OldString->Hash;
+
+    //
+    // If the inline word's string buffer lives in the histogram entry's
+    // compaction arena chunk, copy it to a new buffer allocated by the word
+    // allocator, as the new word table entry won't reside in the chunk.
+    //
+
+    HistogramTableEntryHeader = TABLE_ENTRY_TO_HEADER(HistogramTableEntry);
+    StringChunk = WordStringArenaChunk(HistogramTableEntryHeader);
+    String = &WordTableEntryHeader.WordTableEntry.WordEntry.String;
+    ArenaBuffer = String->Buffer;
+
+    //
+    // If the string is stored inline, point it at the local copy for now; it
+    // will be pointed at the new word table entry once inserted.
+    //
+
+    IsInlineString = (BOOLEAN)HistogramTableEntryHeader->IsInlineString;
+
+    if (IsInlineString) {
+        ASSERT(!StringChunk);
+        String->Buffer = WordTableEntryHeader.WordTableEntry.InlineString;
+    }
+
+    if (StringChunk) {
+
+        Buffer = (PBYTE)(
+            WordAllocator->Calloc(WordAllocator, 1, String->Length + 1)
+        );
+
+        if (!Buffer) {
+            return FALSE;
+        }
+
+        CopyMemory(Buffer, ArenaBuffer, String->Length);
+        String->Buffer = Buffer;
+    }
+
+    //
+    // Initialize the word table in place and insert the word.
+    //
+
+    Rtl->RtlInitializeGenericTableAvl(&WordTable->Avl,
+                                      WordTableCompareRoutine,
+                                      WordTableAllocateRoutine,
+                                      WordTableFreeRoutine,
+                                      Dictionary);
+
+    WordTableEntry = Rtl->RtlInsertElementGenericTableAvl(
+        &WordTable->Avl,
+        &WordTableEntryHeader.WordTableEntry,
+        sizeof(WORD_TABLE_ENTRY),
+        &NewWordEntry
+    );
+
+    if (!WordTableEntry) {
+
+        //
+        // Restore the inline word and return failure.  The word table is
+        // empty at this point, so there's nothing else to clean up.
+        //
+
+        if (StringChunk) {
+            WordAllocator->FreePointer(WordAllocator, (PPVOID)&String->Buffer);
+            String->Buffer = ArenaBuffer;
+        }
+
+        CopyMemory(InlineWordTableEntry,
+                   &WordTableEntryHeader.WordTableEntry,
+                   sizeof(*InlineWordTableEntry));
+
+        if (IsInlineString) {
+            InlineWordTableEntry->WordEntry.String.Buffer =
+                InlineWordTableEntry->InlineString;
+        }
+
+        return FALSE;
+    }
+
+    ASSERT(NewWordEntry);
+
+    //
+    // Copy the hash back over.  (Note that OldString can't be dereferenced
+    // at this point as the word table initialization has overwritten it.)
+    //
+
+    TableEntryHeader = TABLE_ENTRY_TO_HEADER(WordTableEntry);
+    TableEntryHeader->Hash = WordTableEntryHeader.Hash;
+
+    //
+    // Transfer the CLOCK counter and ownership of an inline string to the new
+    // word table entry.
+    //
+
+    TableEntryHeader->ClockCount = HistogramTableEntryHeader->ClockCount;
+    HistogramTableEntryHeader->ClockCount = 0;
+
+    TableEntryHeader->IsInlineString = IsInlineString;
+
+    if (IsInlineString) {
+        WordTableEntry->WordEntry.String.Buffer = WordTableEntry->InlineString;
+        HistogramTableEntryHeader->IsInlineString = FALSE;
+    }
+
+    //
+    // The length list entry was copied verbatim, so our neighbors still point
+    // to the old inline address.  Point them at the new entry.
+    //
+
+    ListEntry = &WordTableEntry->LengthListEntry;
+    ListEntry->Flink->Blink = ListEntry;
+    ListEntry->Blink->Flink = ListEntry;
+
+    //
+    // Update the dictionary's longest word pointers if they referred to the
+    // inline word.  (We only compare addresses here; OldString's contents are
+    // no longer valid.)
+    //
+
+    NewString = &WordTableEntry->WordEntry.String;
+
+    if (Dictionary->Stats.CurrentLongestWord == OldString) {
+        Dictionary->Stats.CurrentLongestWord = NewString;
+    }
+
+    if (Dictionary->Stats.LongestWordAllTime == OldString) {
+        Dictionary->Stats.LongestWordAllTime = NewString;
+    }
+
+    //
+    // Account for the word's string buffer in the new word table.
+    //
+
+    Avl = &WordTable->Avl;
+    TotalStringBufferAllocSize.QuadPart = NewString->Length + 1;
+    Avl->BytesAllocatedLowPart = TotalStringBufferAllocSize.LowPart;
+    Avl->BytesAllocatedHighPart = TotalStringBufferAllocSize.HighPart;
+
+    //
+    // Release the arena chunk's reference to the old string buffer, if
+    // applicable.
+    //
+
+    if (StringChunk) {
+        HistogramTableEntryHeader->IsArenaString = FALSE;
+        ReleaseArenaChunk(Dictionary, StringChunk);
+    }
+
+    //
+    // Clear the inline bit and return success.
+    //
+
+    HistogramTableEntryHeader->HasInlineWord = FALSE;
+
+    return TRUE;
+}
+
 _Use_decl_annotations_
 BOOLEAN
 AddWord(
@@ -568,11 +977,16 @@ Arguments:
 
 Return Value:
 
-    TRUE on success, FALSE on failure.
+    TRUE on success, FALSE on failure.  FALSE will be returned if the
+    dictionary has been frozen, or if a write-ahead log is open and the
+    addition could not be written to it (in which case the addition will
+    still have been applied in memory).
 
 --*/
 {
     BOOLEAN Success;
+    ULONGLONG Sequence;
+    PDICTIONARY_LOG Log;
     PWORD_ENTRY WordEntry;
 
     //
@@ -588,19 +1002,63 @@ Return Value:
     }
 
     //
-    // Obtain an exclusive lock on the dictionary.
+    // Obtain an exclusive lock on the dictionary, and capture the write-ahead
+    // log, if any.
     //
 
     AcquireDictionaryLockExclusive(&Dictionary->Lock);
 
-    Success = AddWordEntry(Dictionary, Word, &WordEntry, EntryCountPointer);
+    Log = BeginDictionaryLogOperation(Dictionary, &Sequence);
+
+    //
+    // Record the call if applicable.
+    //
+
+    if (Dictionary->Recorder) {
+        RecordDictionaryOperation(Dictionary,
+                                  DictionaryRecordAddWordOperation,
+                                  Word);
+    }
+
+    //
+    // Frozen dictionaries can't be modified.
+    //
+
+    if (Dictionary->Flags.IsFrozen) {
+
+        if (ARGUMENT_PRESENT(EntryCountPointer)) {
+            *EntryCountPointer = 0;
+        }
+
+        Success = FALSE;
+
+    } else {
+
+        Success = AddWordEntry(Dictionary,
+                               Word,
+                               0,
+                               1,
+                               &WordEntry,
+                               EntryCountPointer);
+    }
 
     //
-    // Release the lock and return.
+    // Capture the end of the records appended by the addition, then release
+    // the lock.
     //
 
+    Sequence = EndDictionaryLogOperation(Log, Sequence);
+
     ReleaseDictionaryLockExclusive(&Dictionary->Lock);
 
+    //
+    // If a write-ahead log is open, wait for the addition to become durable.
+    //
+
+    if (Log && !WaitForDictionaryLog(Log, Sequence)) {
+        Success = FALSE;
+    }
+
     return Success;
 }
 
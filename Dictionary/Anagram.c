@@ -16,6 +16,50 @@ Abstract:
 
 #include "stdafx.h"
 
+//
+// Define a simple iterator for enumerating the words sharing a histogram,
+// which abstracts over the word table of a mutable dictionary and the word
+// segment of a frozen one.
+//
+
+typedef struct _ANAGRAM_CANDIDATE_ITERATOR {
+    PRTL_ENUMERATE_GENERIC_TABLE_AVL EnumerateTable;
+    PWORD_TABLE WordTable;
+    PWORD_ENTRY FrozenWordEntries;
+    ULONG NumberOfFrozenWords;
+    ULONG FrozenIndex;
+} ANAGRAM_CANDIDATE_ITERATOR;
+typedef ANAGRAM_CANDIDATE_ITERATOR *PANAGRAM_CANDIDATE_ITERATOR;
+
+FORCEINLINE
+PWORD_ENTRY
+NextAnagramCandidate(
+    _Inout_ PANAGRAM_CANDIDATE_ITERATOR Iterator,
+    _In_ BOOLEAN Restart
+    )
+{
+    PWORD_TABLE_ENTRY WordTableEntry;
+
+    if (Iterator->FrozenWordEntries) {
+
+        if (Restart) {
+            Iterator->FrozenIndex = 0;
+        }
+
+        if (Iterator->FrozenIndex == Iterator->NumberOfFrozenWords) {
+            return NULL;
+        }
+
+        return &Iterator->FrozenWordEntries[Iterator->FrozenIndex++];
+    }
+
+    WordTableEntry = (PWORD_TABLE_ENTRY)(
+        Iterator->EnumerateTable(&Iterator->WordTable->Avl, Restart)
+    );
+
+    return (WordTableEntry ? &WordTableEntry->WordEntry : NULL);
+}
+
 _Use_decl_annotations_
 BOOLEAN
 NTAPI
@@ -85,12 +129,24 @@ Return Value:
     PWORD_ENTRY NewWordEntry;
     PCLONG_STRING SourceString;
     PWORD_ENTRY SourceWordEntry;
-    PWORD_TABLE_ENTRY WordTableEntry;
     PWORD_TABLE_ENTRY SourceWordTableEntry;
+    PFROZEN_DICTIONARY Frozen;
+    PCFROZEN_HISTOGRAM_ENTRY FrozenHistogramEntry;
+    ANAGRAM_CANDIDATE_ITERATOR Iterator;
     PLINKED_WORD_ENTRY LinkedWordEntry;
     CHARACTER_BITMAP SourceBitmap;
     CHARACTER_HISTOGRAM Histogram;
     CHARACTER_HISTOGRAM SourceHistogram;
+#if DICTIONARY_PACKED_HISTOGRAMS
+    BOOLEAN IsSourceHistogramPacked;
+    PACKED_CHARACTER_HISTOGRAM PackedHistogram;
+    PACKED_CHARACTER_HISTOGRAM SourcePackedHistogram;
+#endif
+#if DICTIONARY_UTF8_HISTOGRAMS
+    BOOLEAN IsSourceHistogramSparse;
+    SPARSE_CHARACTER_HISTOGRAM SparseHistogram;
+    SPARSE_CHARACTER_HISTOGRAM SourceSparseHistogram;
+#endif
     RTL_GENERIC_COMPARE_RESULTS Comparison;
     PRTL_ENUMERATE_GENERIC_TABLE_AVL EnumerateTable;
 
@@ -121,12 +177,12 @@ Return Value:
     *LinkedWordListPointer = NULL;
 
     //
-    // Zero the context, source bitmap and histogram structures.
+    // Zero the context, iterator and source bitmap structures.
     //
 
     ZeroStruct(Context);
+    ZeroStruct(Iterator);
     ZeroStruct(SourceBitmap);
-    ZeroStruct(SourceHistogram);
 
     //
     // Initialize aliases.
@@ -134,6 +190,7 @@ Return Value:
 
     Rtl = Dictionary->Rtl;
     EnumerateTable = Rtl->RtlEnumerateGenericTableAvl;
+    Iterator.EnumerateTable = EnumerateTable;
 
     //
     // Initialize the dictionary context and register it with TLS.
@@ -148,6 +205,64 @@ Return Value:
 
     AcquireDictionaryLockShared(&Dictionary->Lock);
 
+    if (Dictionary->Recorder) {
+        RecordDictionaryOperation(Dictionary,
+                                  DictionaryRecordGetWordAnagramsOperation,
+                                  Word);
+    }
+
+    if (Dictionary->Flags.IsFrozen) {
+
+        //
+        // Find the frozen word entry for the given word.
+        //
+
+        Frozen = GetLocalFrozenDictionary(Dictionary);
+
+        Success = FindFrozenWordEntry(Dictionary,
+                                      Frozen,
+                                      Word,
+                                      &SourceBitmap,
+                                      &SourceHistogram,
+                                      &FrozenHistogramEntry,
+                                      &SourceWordEntry);
+
+        if (!Success || !SourceWordEntry) {
+            goto Error;
+        }
+
+        //
+        // All of the words sharing this histogram are stored contiguously.
+        //
+
+        Total = FrozenHistogramEntry->NumberOfWords;
+
+        if (Total <= 1) {
+            Success = TRUE;
+            goto End;
+        }
+
+        Iterator.NumberOfFrozenWords = Total;
+        Iterator.FrozenWordEntries = (
+            Frozen->WordEntries +
+            FrozenHistogramEntry->FirstWord
+        );
+
+        //
+        // Frozen dictionaries don't track the string buffer bytes of each
+        // histogram, so sum them up now.
+        //
+
+        AllocSize.QuadPart = 0;
+
+        for (Index = 0; Index < Total; Index++) {
+            String = &Iterator.FrozenWordEntries[Index].String;
+            AllocSize.QuadPart += String->Length + 1;
+        }
+
+        goto CalculateAllocSize;
+    }
+
     //
     // Find the word table entry for the given word.
     //
@@ -169,6 +284,18 @@ Return Value:
 
     WordTable = Context.WordTable;
 
+    if (!WordTable) {
+
+        //
+        // The word is being stored inline within its histogram table entry,
+        // which means it's the only word with this histogram; there are no
+        // anagrams present.  Return success.
+        //
+
+        Success = TRUE;
+        goto End;
+    }
+
     //
     // Get the number of words (i.e. potential anagrams) from this word table.
     //
@@ -206,6 +333,11 @@ Return Value:
     AllocSize.LowPart = WordTable->Avl.BytesAllocatedLowPart;
     AllocSize.HighPart = WordTable->Avl.BytesAllocatedHighPart;
 
+    SourceWordEntry = &SourceWordTableEntry->WordEntry;
+    Iterator.WordTable = WordTable;
+
+CalculateAllocSize:
+
     //
     // Take a copy of this value for some sanity checks later.
     //
@@ -216,9 +348,42 @@ Return Value:
     // Initialize additional aliases.
     //
 
-    SourceWordEntry = &SourceWordTableEntry->WordEntry;
     SourceString = &SourceWordEntry->String;
 
+#if DICTIONARY_PACKED_HISTOGRAMS
+
+    //
+    // If the source word has a packed histogram, candidates are compared via
+    // packed histograms too (as InitializeWord() won't have filled out the
+    // full source histogram).  A candidate with the same length and histogram
+    // as the source will necessarily have a packed histogram itself.
+    //
+
+    IsSourceHistogramPacked = (
+        CreatePackedHistogramInline(SourceString->Buffer,
+                                    SourceString->Length,
+                                    &SourcePackedHistogram)
+    );
+
+#endif
+
+#if DICTIONARY_UTF8_HISTOGRAMS
+
+    //
+    // Likewise for sparse (UTF-8 codepoint) histograms.  Note that a word with
+    // a packed histogram never contains non-ASCII bytes.
+    //
+
+    IsSourceHistogramSparse = (
+        ContainsNonAsciiBytesInline(SourceString->Buffer,
+                                    SourceString->Length) &&
+        CreateSparseHistogramInline(SourceString->Buffer,
+                                    SourceString->Length,
+                                    &SourceSparseHistogram)
+    );
+
+#endif
+
     //
     // Now factor in the overhead for all the supporting structures.
     //
@@ -274,14 +439,15 @@ Return Value:
     // an anagram, so add it to the list.
     //
 
-    FOR_EACH_ENTRY_IN_TABLE(Word, PWORD_TABLE_ENTRY) {
+    for (WordEntry = NextAnagramCandidate(&Iterator, TRUE);
+         WordEntry != NULL;
+         WordEntry = NextAnagramCandidate(&Iterator, FALSE)) {
 
         //
-        // Resolve the word entry, underlying string and stats from the word
-        // table entry that was just resolved.
+        // Resolve the underlying string and stats from the word entry that
+        // was just resolved.
         //
 
-        WordEntry = &WordTableEntry->WordEntry;
         String = &WordEntry->String;
         Length = String->Length;
         Stats = &WordEntry->Stats;
@@ -311,6 +477,57 @@ Return Value:
 
         Count++;
 
+#if DICTIONARY_PACKED_HISTOGRAMS
+
+        if (IsSourceHistogramPacked) {
+
+            //
+            // Create the candidate's packed histogram and compare it with a
+            // single AVX2 comparison.
+            //
+
+            if (!CreatePackedHistogramInline(String->Buffer,
+                                             Length,
+                                             &PackedHistogram) ||
+                ComparePackedHistogramsInline(&PackedHistogram,
+                                              &SourcePackedHistogram) !=
+                GenericEqual) {
+
+                Dictionary->HistogramCollisions++;
+                continue;
+            }
+
+            goto AddAnagram;
+        }
+
+#endif
+
+#if DICTIONARY_UTF8_HISTOGRAMS
+
+        if (IsSourceHistogramSparse) {
+
+            //
+            // Decode the candidate and compare its codepoint histogram.  (A
+            // candidate whose bytes are a permutation of the source's bytes,
+            // but whose characters aren't, is rejected here.)
+            //
+
+            if (!CreateSparseHistogramInline(String->Buffer,
+                                             Length,
+                                             &SparseHistogram) ||
+                CompareSparseHistogramsInline(&SparseHistogram,
+                                              &SourceSparseHistogram) !=
+                GenericEqual) {
+
+                Dictionary->HistogramCollisions++;
+                continue;
+            }
+
+            goto AddAnagram;
+        }
+
+#endif
+
         //
         // Clear our local histogram buffer, then loop over the word and create
         // a new histogram.
@@ -340,6 +557,10 @@ Return Value:
             continue;
         }
 
+#if DICTIONARY_PACKED_HISTOGRAMS || DICTIONARY_UTF8_HISTOGRAMS
+AddAnagram:
+#endif
+
         //
         // The histogram matches, therefore this is a valid anagram.  Carve
         // out the relevant structures from our buffer and wire everything
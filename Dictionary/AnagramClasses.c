@@ -0,0 +1,909 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    AnagramClasses.c
+
+Abstract:
+
+    This module implements anagram class enumeration.  The public routine
+    EnumerateAnagramClasses() visits every histogram in the dictionary exactly
+    once, splits the words associated with each histogram into anagram classes
+    (i.e. sets of words that are permutations of one another), and yields each
+    class to a caller-supplied callback.
+
+    Words are grouped by the 32-bit hash of their character histogram, so a
+    histogram table entry (or a frozen histogram entry) may contain words from
+    more than one anagram class if their histogram hashes collide.  Such
+    entries are split into their constituent classes by comparing character
+    counts directly.  The vast majority of entries only contain a single word,
+    so this is cheap in practice.
+
+    The enumeration can optionally be performed in parallel.  The dictionary
+    is divided into partitions of contiguous bitmap table entries (or ranges
+    of frozen histogram entries), and threadpool workers claim partitions one
+    at a time until they have all been processed.
+
+--*/
+
+#include "stdafx.h"
+
+//
+// Number of bitmap table entries (or frozen histogram entries) processed by
+// a worker each time it claims a partition.
+//
+
+#define ANAGRAM_CLASS_BITMAP_ENTRIES_PER_PARTITION 64
+#define ANAGRAM_CLASS_FROZEN_HISTOGRAMS_PER_PARTITION 1024
+
+//
+// Initial number of word entry pointers allocated for each worker's array of
+// candidate words.  The array is grown on demand.
+//
+
+#define ANAGRAM_CLASS_INITIAL_CAPACITY 64
+
+//
+// Define the enumeration state shared by all workers.
+//
+
+typedef struct _ANAGRAM_CLASS_ENUMERATION {
+
+    PDICTIONARY Dictionary;
+    PALLOCATOR Allocator;
+
+    PANAGRAM_CLASS_CALLBACK Callback;
+    PVOID CallbackContext;
+
+    ULONG MinimumNumberOfWords;
+
+    //
+    // Number of bitmap table entries (or frozen histogram entries) to be
+    // processed, and the number of partitions they've been divided into.
+    //
+
+    ULONG NumberOfItems;
+    ULONG NumberOfPartitions;
+
+    //
+    // Index of the next partition to be claimed by a worker.
+    //
+
+    volatile LONG NextPartition;
+
+    //
+    // Set when the callback requests the enumeration be stopped, or when a
+    // worker fails to allocate memory.
+    //
+
+    volatile LONG Stop;
+    volatile LONG Failed;
+
+    //
+    // Total number of classes yielded to the callback.
+    //
+
+    volatile LONGLONG NumberOfClasses;
+
+    //
+    // Array of bitmap table entries to be processed, or NULL if the dictionary
+    // is frozen.
+    //
+
+    PBITMAP_TABLE_ENTRY *BitmapTableEntries;
+
+    //
+    // The dictionary's allocator isn't necessarily safe to call from multiple
+    // threads, so workers serialize their allocations via this lock.
+    //
+
+    DICTIONARY_LOCK AllocatorLock;
+
+} ANAGRAM_CLASS_ENUMERATION;
+typedef ANAGRAM_CLASS_ENUMERATION *PANAGRAM_CLASS_ENUMERATION;
+
+//
+// Define the per-worker state.
+//
+
+typedef struct _ANAGRAM_CLASS_WORKER {
+
+    //
+    // Number of elements the Words array can hold.
+    //
+
+    ULONG Capacity;
+
+    ULONG Padding;
+
+    //
+    // Number of classes yielded to the callback by this worker.
+    //
+
+    LONGLONG NumberOfClasses;
+
+    //
+    // Array of candidate words for the histogram currently being processed.
+    // The words are partitioned in place such that each class occupies a
+    // contiguous run of the array.
+    //
+
+    PCWORD_ENTRY *Words;
+
+    //
+    // Character counts used to compare candidate words.  All counts are zero
+    // between comparisons.
+    //
+
+    ULONG Counts[NUMBER_OF_CHARACTER_BITS];
+
+} ANAGRAM_CLASS_WORKER;
+typedef ANAGRAM_CLASS_WORKER *PANAGRAM_CLASS_WORKER;
+
+FORCEINLINE
+BOOLEAN
+IsAnagramOf(
+    _In_ PCLONG_STRING Left,
+    _In_ PCLONG_STRING Right,
+    _Inout_ PULONG Counts
+    )
+/*++
+
+Routine Description:
+
+    Determines whether or not two strings are permutations of one another.
+    The bytes of the strings are compared first.  If they're permutations of
+    one another and contain non-ASCII bytes, their UTF-8 codepoints are then
+    compared via sparse histograms, consistent with GetWordAnagrams() (a byte
+    permutation of a multi-byte character isn't the same character).
+
+Arguments:
+
+    Left - Supplies a pointer to the first string.
+
+    Right - Supplies a pointer to the second string.
+
+    Counts - Supplies a pointer to an array of 256 character counts, all of
+        which must be zero.  The counts are returned to zero before this
+        routine returns.
+
+Return Value:
+
+    TRUE if the strings are anagrams, FALSE otherwise.
+
+--*/
+{
+    BYTE Byte;
+    ULONG Index;
+    ULONG Length;
+    PCBYTE LeftBuffer;
+    PCBYTE RightBuffer;
+#if DICTIONARY_UTF8_HISTOGRAMS
+    BOOLEAN IsLeftSparse;
+    BOOLEAN IsRightSparse;
+    SPARSE_CHARACTER_HISTOGRAM LeftHistogram;
+    SPARSE_CHARACTER_HISTOGRAM RightHistogram;
+#endif
+
+    if (Left->Length != Right->Length) {
+        return FALSE;
+    }
+
+    Length = Left->Length;
+    LeftBuffer = (PCBYTE)Left->Buffer;
+    RightBuffer = (PCBYTE)Right->Buffer;
+
+    for (Index = 0; Index < Length; Index++) {
+        Counts[LeftBuffer[Index]]++;
+    }
+
+    for (Index = 0; Index < Length; Index++) {
+        Byte = RightBuffer[Index];
+        if (Counts[Byte] == 0) {
+            break;
+        }
+        Counts[Byte]--;
+    }
+
+    if (Index == Length) {
+
+        //
+        // Every byte was consumed, so all counts are back at zero.
+        //
+
+#if DICTIONARY_UTF8_HISTOGRAMS
+
+        //
+        // The bytes are permutations of one another, so either both strings
+        // contain non-ASCII bytes or neither does.  If they do, compare their
+        // codepoints.  Strings that can't be represented by a sparse histogram
+        // (e.g. invalid UTF-8) are compared by their bytes alone, as they are
+        // by GetWordAnagrams(); one such string is never an anagram of one
+        // that can be.
+        //
+
+        if (ContainsNonAsciiBytesInline(LeftBuffer, Length)) {
+
+            IsLeftSparse = CreateSparseHistogramInline(LeftBuffer,
+                                                       Length,
+                                                       &LeftHistogram);
+
+            IsRightSparse = CreateSparseHistogramInline(RightBuffer,
+                                                        Length,
+                                                        &RightHistogram);
+
+            if (IsLeftSparse != IsRightSparse) {
+                return FALSE;
+            }
+
+            if (IsLeftSparse) {
+                return (
+                    CompareSparseHistogramsInline(&LeftHistogram,
+                                                  &RightHistogram) ==
+                    GenericEqual
+                );
+            }
+        }
+
+#endif
+
+        return TRUE;
+    }
+
+    //
+    // The strings differ.  Any nonzero counts belong to characters of the
+    // left string, so clear those.
+    //
+
+    for (Index = 0; Index < Length; Index++) {
+        Counts[LeftBuffer[Index]] = 0;
+    }
+
+    return FALSE;
+}
+
+FORCEINLINE
+BOOLEAN
+ReserveAnagramClassWorkerCapacity(
+    _In_ PANAGRAM_CLASS_ENUMERATION Enumeration,
+    _Inout_ PANAGRAM_CLASS_WORKER Worker,
+    _In_ ULONG NumberOfWords
+    )
+/*++
+
+Routine Description:
+
+    Ensures a worker's Words array can hold at least the given number of
+    word entry pointers, growing the array if necessary.
+
+Arguments:
+
+    Enumeration - Supplies a pointer to the enumeration state.
+
+    Worker - Supplies a pointer to the worker state.
+
+    NumberOfWords - Supplies the number of elements required.
+
+Return Value:
+
+    TRUE on success, FALSE if the array could not be grown.
+
+--*/
+{
+    ULONG Capacity;
+    PALLOCATOR Allocator;
+    PCWORD_ENTRY *Words;
+
+    if (NumberOfWords <= Worker->Capacity) {
+        return TRUE;
+    }
+
+    Capacity = max(Worker->Capacity, ANAGRAM_CLASS_INITIAL_CAPACITY);
+
+    while (Capacity < NumberOfWords) {
+        Capacity <<= 1;
+    }
+
+    Allocator = Enumeration->Allocator;
+
+    AcquireDictionaryLockExclusive(&Enumeration->AllocatorLock);
+
+    if (!Worker->Words) {
+        Words = (PCWORD_ENTRY *)(
+            Allocator->Calloc(Allocator, Capacity, sizeof(Worker->Words[0]))
+        );
+    } else {
+        Words = (PCWORD_ENTRY *)(
+            Allocator->Realloc(Allocator,
+                               (PVOID)Worker->Words,
+                               sizeof(Worker->Words[0]) * (SIZE_T)Capacity)
+        );
+    }
+
+    ReleaseDictionaryLockExclusive(&Enumeration->AllocatorLock);
+
+    if (!Words) {
+        return FALSE;
+    }
+
+    Worker->Words = Words;
+    Worker->Capacity = Capacity;
+
+    return TRUE;
+}
+
+FORCEINLINE
+BOOLEAN
+YieldAnagramClasses(
+    _In_ PANAGRAM_CLASS_ENUMERATION Enumeration,
+    _Inout_ PANAGRAM_CLASS_WORKER Worker,
+    _In_ ULONG NumberOfWords
+    )
+/*++
+
+Routine Description:
+
+    Splits the candidate words of a single histogram into anagram classes and
+    yields each class meeting the minimum size to the callback.
+
+Arguments:
+
+    Enumeration - Supplies a pointer to the enumeration state.
+
+    Worker - Supplies a pointer to the worker state.  The first NumberOfWords
+        elements of its Words array contain the candidate words.
+
+    NumberOfWords - Supplies the number of candidate words.
+
+Return Value:
+
+    TRUE if the enumeration should continue, FALSE if it should stop.
+
+--*/
+{
+    ULONG End;
+    ULONG Start;
+    ULONG Index;
+    PCWORD_ENTRY Swap;
+    PCWORD_ENTRY *Words;
+    PCLONG_STRING Leader;
+    ANAGRAM_CLASS AnagramClass;
+
+    Words = Worker->Words;
+
+    for (Start = 0; Start < NumberOfWords; Start = End) {
+
+        //
+        // Move every remaining anagram of the first unclassified word (the
+        // class leader) up next to it.
+        //
+
+        Leader = &Words[Start]->String;
+        End = Start + 1;
+
+        for (Index = End; Index < NumberOfWords; Index++) {
+            if (IsAnagramOf(Leader, &Words[Index]->String, Worker->Counts)) {
+                Swap = Words[Index];
+                Words[Index] = Words[End];
+                Words[End] = Swap;
+                End++;
+            }
+        }
+
+        if (End - Start < Enumeration->MinimumNumberOfWords) {
+            continue;
+        }
+
+        AnagramClass.NumberOfWords = End - Start;
+        AnagramClass.Length = Leader->Length;
+        AnagramClass.TotalEntryCount = 0;
+        AnagramClass.Words = &Words[Start];
+
+        for (Index = Start; Index < End; Index++) {
+            AnagramClass.TotalEntryCount += Words[Index]->Stats.EntryCount;
+        }
+
+        Worker->NumberOfClasses++;
+
+        if (!Enumeration->Callback(Enumeration->CallbackContext,
+                                   &AnagramClass)) {
+            InterlockedExchange(&Enumeration->Stop, TRUE);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+FORCEINLINE
+BOOLEAN
+ProcessAnagramClassPartition(
+    _In_ PANAGRAM_CLASS_ENUMERATION Enumeration,
+    _Inout_ PANAGRAM_CLASS_WORKER Worker,
+    _In_ ULONG Partition
+    )
+/*++
+
+Routine Description:
+
+    Yields the anagram classes of every histogram within a partition.
+
+Arguments:
+
+    Enumeration - Supplies a pointer to the enumeration state.
+
+    Worker - Supplies a pointer to the worker state.
+
+    Partition - Supplies the index of the partition to process.
+
+Return Value:
+
+    TRUE if the enumeration should continue, FALSE if it should stop (either
+    because the callback requested it, or because of an allocation failure).
+
+--*/
+{
+    PRTL Rtl;
+    ULONG Index;
+    ULONG Count;
+    ULONG First;
+    ULONG WordIndex;
+    ULONG Last;
+    ULONG PerPartition;
+    PVOID RestartKey;
+    PVOID WordRestartKey;
+    PWORD_TABLE WordTable;
+    PWORD_ENTRY WordEntries;
+    PFROZEN_DICTIONARY Frozen;
+    PHISTOGRAM_TABLE HistogramTable;
+    PWORD_TABLE_ENTRY WordTableEntry;
+    PBITMAP_TABLE_ENTRY BitmapTableEntry;
+    PHISTOGRAM_TABLE_ENTRY HistogramTableEntry;
+    PFROZEN_HISTOGRAM_ENTRY FrozenHistogramEntry;
+    PRTL_ENUMERATE_GENERIC_TABLE_WITHOUT_SPLAYING_AVL EnumerateTable;
+    PRTL_NUMBER_GENERIC_TABLE_ELEMENTS_AVL NumberOfElements;
+
+    if (Enumeration->BitmapTableEntries) {
+        PerPartition = ANAGRAM_CLASS_BITMAP_ENTRIES_PER_PARTITION;
+    } else {
+        PerPartition = ANAGRAM_CLASS_FROZEN_HISTOGRAMS_PER_PARTITION;
+    }
+
+    First = Partition * PerPartition;
+    Last = min(First + PerPartition, Enumeration->NumberOfItems);
+
+    if (!Enumeration->BitmapTableEntries) {
+
+        //
+        // The dictionary is frozen.  Resolve the replica local to this
+        // worker, then visit each histogram entry in the partition.  (The
+        // entries are 1-based.)
+        //
+
+        Frozen = GetLocalFrozenDictionary(Enumeration->Dictionary);
+
+        for (Index = First + 1; Index <= Last; Index++) {
+
+            if (Enumeration->Stop) {
+                return FALSE;
+            }
+
+            FrozenHistogramEntry = &Frozen->HistogramEntries[Index];
+            Count = FrozenHistogramEntry->NumberOfWords;
+
+            if (Count == 0 || Count < Enumeration->MinimumNumberOfWords) {
+                continue;
+            }
+
+            if (!ReserveAnagramClassWorkerCapacity(Enumeration,
+                                                   Worker,
+                                                   Count)) {
+                InterlockedExchange(&Enumeration->Failed, TRUE);
+                return FALSE;
+            }
+
+            WordEntries = (
+                Frozen->WordEntries +
+                FrozenHistogramEntry->FirstWord
+            );
+
+            for (WordIndex = 0; WordIndex < Count; WordIndex++) {
+                Worker->Words[WordIndex] = &WordEntries[WordIndex];
+            }
+
+            if (!YieldAnagramClasses(Enumeration, Worker, Count)) {
+                return FALSE;
+            }
+        }
+
+        return TRUE;
+    }
+
+    Rtl = Enumeration->Dictionary->Rtl;
+    EnumerateTable = Rtl->RtlEnumerateGenericTableWithoutSplayingAvl;
+    NumberOfElements = Rtl->RtlNumberGenericTableElementsAvl;
+
+    for (Index = First; Index < Last; Index++) {
+
+        BitmapTableEntry = Enumeration->BitmapTableEntries[Index];
+        HistogramTable = &BitmapTableEntry->HistogramTable;
+        RestartKey = NULL;
+
+        while (TRUE) {
+
+            if (Enumeration->Stop) {
+                return FALSE;
+            }
+
+            HistogramTableEntry = (PHISTOGRAM_TABLE_ENTRY)(
+                EnumerateTable(&HistogramTable->Avl, &RestartKey)
+            );
+
+            if (!HistogramTableEntry) {
+                break;
+            }
+
+            if (HistogramTableEntryHasInlineWord(HistogramTableEntry)) {
+
+                //
+                // A single inline word is always a class of one.
+                //
+
+                if (Enumeration->MinimumNumberOfWords > 1) {
+                    continue;
+                }
+
+                Worker->Words[0] =
+                    &HistogramTableEntry->InlineWordTableEntry.WordEntry;
+                Count = 1;
+
+            } else {
+
+                WordTable = &HistogramTableEntry->WordTable;
+                Count = NumberOfElements(&WordTable->Avl);
+
+                if (Count == 0 ||
+                    Count < Enumeration->MinimumNumberOfWords) {
+                    continue;
+                }
+
+                if (!ReserveAnagramClassWorkerCapacity(Enumeration,
+                                                       Worker,
+                                                       Count)) {
+                    InterlockedExchange(&Enumeration->Failed, TRUE);
+                    return FALSE;
+                }
+
+                Count = 0;
+                WordRestartKey = NULL;
+
+                while (TRUE) {
+
+                    WordTableEntry = (PWORD_TABLE_ENTRY)(
+                        EnumerateTable(&WordTable->Avl, &WordRestartKey)
+                    );
+
+                    if (!WordTableEntry) {
+                        break;
+                    }
+
+                    Worker->Words[Count++] = &WordTableEntry->WordEntry;
+                }
+            }
+
+            if (!YieldAnagramClasses(Enumeration, Worker, Count)) {
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+FORCEINLINE
+VOID
+ProcessAnagramClassPartitions(
+    _In_ PANAGRAM_CLASS_ENUMERATION Enumeration
+    )
+/*++
+
+Routine Description:
+
+    Claims and processes partitions until none remain, the callback requests
+    the enumeration be stopped, or an error occurs.  This routine is called
+    directly for serial enumerations, and from each threadpool worker for
+    parallel enumerations.
+
+Arguments:
+
+    Enumeration - Supplies a pointer to the enumeration state.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    LONG Partition;
+    PALLOCATOR Allocator;
+    ANAGRAM_CLASS_WORKER Worker;
+
+    ZeroStruct(Worker);
+
+    if (!ReserveAnagramClassWorkerCapacity(Enumeration,
+                                           &Worker,
+                                           ANAGRAM_CLASS_INITIAL_CAPACITY)) {
+        InterlockedExchange(&Enumeration->Failed, TRUE);
+        return;
+    }
+
+    while (!Enumeration->Stop && !Enumeration->Failed) {
+
+        Partition = InterlockedIncrement(&Enumeration->NextPartition) - 1;
+
+        if ((ULONG)Partition >= Enumeration->NumberOfPartitions) {
+            break;
+        }
+
+        if (!ProcessAnagramClassPartition(Enumeration,
+                                          &Worker,
+                                          (ULONG)Partition)) {
+            break;
+        }
+    }
+
+    InterlockedAdd64(&Enumeration->NumberOfClasses, Worker.NumberOfClasses);
+
+    Allocator = Enumeration->Allocator;
+    AcquireDictionaryLockExclusive(&Enumeration->AllocatorLock);
+    Allocator->FreePointer(Allocator, (PPVOID)&Worker.Words);
+    ReleaseDictionaryLockExclusive(&Enumeration->AllocatorLock);
+}
+
+_Use_decl_annotations_
+VOID
+CALLBACK
+AnagramClassWorkCallback(
+    PTP_CALLBACK_INSTANCE Instance,
+    PVOID Context,
+    PTP_WORK Work
+    )
+{
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(Work);
+
+    ProcessAnagramClassPartitions((PANAGRAM_CLASS_ENUMERATION)Context);
+}
+
+_Use_decl_annotations_
+BOOLEAN
+EnumerateAnagramClasses(
+    PDICTIONARY Dictionary,
+    ULONG MinimumNumberOfWords,
+    DICTIONARY_ANAGRAM_CLASS_FLAGS Flags,
+    PANAGRAM_CLASS_CALLBACK Callback,
+    PVOID CallbackContext,
+    PULONGLONG NumberOfClassesPointer
+    )
+/*++
+
+Routine Description:
+
+    Enumerates every anagram class in a dictionary, invoking a callback once
+    for each class with at least MinimumNumberOfWords words.  Each histogram
+    in the dictionary is visited exactly once.
+
+    The dictionary's lock is held shared for the duration of the enumeration,
+    so the callback must not attempt to modify the dictionary.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to a DICTIONARY structure for which the
+        anagram classes are to be enumerated.
+
+    MinimumNumberOfWords - Supplies the minimum number of words a class must
+        have in order to be yielded to the callback.  0 and 1 both yield every
+        class (including words with no anagrams); 2 yields only words that
+        have at least one anagram, etc.
+
+    Flags - Supplies flags that control the enumeration.  If the Parallel
+        flag is set, the callback may be invoked concurrently from multiple
+        threadpool threads.
+
+    Callback - Supplies a pointer to the routine to invoke for each class.
+        The callback returns FALSE to stop the enumeration.
+
+    CallbackContext - Optionally supplies a context pointer to be passed to
+        the callback.
+
+    NumberOfClassesPointer - Optionally supplies the address of a variable
+        that receives the number of classes yielded to the callback.
+
+Return Value:
+
+    TRUE on success (including when the callback stopped the enumeration),
+    FALSE on failure.
+
+--*/
+{
+    PRTL Rtl;
+    ULONG Index;
+    ULONG PerPartition;
+    ULONG NumberOfWorkers;
+    PTP_WORK Work;
+    PVOID RestartKey;
+    BOOLEAN Success;
+    PALLOCATOR Allocator;
+    PBITMAP_TABLE BitmapTable;
+    PFROZEN_DICTIONARY Frozen;
+    ANAGRAM_CLASS_ENUMERATION Enumeration;
+    PBITMAP_TABLE_ENTRY BitmapTableEntry;
+    PRTL_ENUMERATE_GENERIC_TABLE_WITHOUT_SPLAYING_AVL EnumerateTable;
+
+    //
+    // Validate arguments.
+    //
+
+    if (ARGUMENT_PRESENT(NumberOfClassesPointer)) {
+        *NumberOfClassesPointer = 0;
+    }
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Callback)) {
+        return FALSE;
+    }
+
+    if (Flags.Unused != 0) {
+        return FALSE;
+    }
+
+    //
+    // Initialize aliases.
+    //
+
+    Rtl = Dictionary->Rtl;
+    Allocator = Dictionary->Allocator;
+    BitmapTable = &Dictionary->BitmapTable;
+    EnumerateTable = Rtl->RtlEnumerateGenericTableWithoutSplayingAvl;
+
+    ZeroStruct(Enumeration);
+    Enumeration.Dictionary = Dictionary;
+    Enumeration.Allocator = Allocator;
+    Enumeration.Callback = Callback;
+    Enumeration.CallbackContext = CallbackContext;
+    Enumeration.MinimumNumberOfWords = MinimumNumberOfWords;
+    InitializeDictionaryLock(&Enumeration.AllocatorLock);
+
+    //
+    // Acquire a shared lock for the duration of this routine.  Workers rely
+    // on this lock being held on their behalf.
+    //
+
+    AcquireDictionaryLockShared(&Dictionary->Lock);
+
+    Frozen = Dictionary->Frozen;
+
+    if (Frozen) {
+
+        Enumeration.NumberOfItems = Frozen->NumberOfHistograms;
+        PerPartition = ANAGRAM_CLASS_FROZEN_HISTOGRAMS_PER_PARTITION;
+
+    } else {
+
+        //
+        // Capture the bitmap table entries such that partitions can be
+        // addressed by index.
+        //
+
+        Enumeration.NumberOfItems = (
+            Rtl->RtlNumberGenericTableElementsAvl(&BitmapTable->Avl)
+        );
+        PerPartition = ANAGRAM_CLASS_BITMAP_ENTRIES_PER_PARTITION;
+
+        Enumeration.BitmapTableEntries = (PBITMAP_TABLE_ENTRY *)(
+            Allocator->Calloc(Allocator,
+                              max(Enumeration.NumberOfItems, 1),
+                              sizeof(PBITMAP_TABLE_ENTRY))
+        );
+
+        if (!Enumeration.BitmapTableEntries) {
+            goto Error;
+        }
+
+        Index = 0;
+        RestartKey = NULL;
+
+        while (TRUE) {
+
+            BitmapTableEntry = (PBITMAP_TABLE_ENTRY)(
+                EnumerateTable(&BitmapTable->Avl, &RestartKey)
+            );
+
+            if (!BitmapTableEntry) {
+                break;
+            }
+
+            Enumeration.BitmapTableEntries[Index++] = BitmapTableEntry;
+        }
+
+        ASSERT(Index == Enumeration.NumberOfItems);
+    }
+
+    Enumeration.NumberOfPartitions = (
+        (Enumeration.NumberOfItems + PerPartition - 1) / PerPartition
+    );
+
+    if (Enumeration.NumberOfPartitions == 0) {
+        goto Done;
+    }
+
+    if (!Flags.Parallel || Enumeration.NumberOfPartitions == 1) {
+
+        ProcessAnagramClassPartitions(&Enumeration);
+
+    } else {
+
+        //
+        // Submit one work item per processor (or per partition, if there are
+        // fewer partitions than processors), then wait for them all to
+        // complete.
+        //
+
+        NumberOfWorkers = min(Enumeration.NumberOfPartitions,
+                              GetActiveProcessorCount(ALL_PROCESSOR_GROUPS));
+
+        Work = CreateThreadpoolWork(AnagramClassWorkCallback,
+                                    &Enumeration,
+                                    NULL);
+
+        if (!Work) {
+            goto Error;
+        }
+
+        for (Index = 0; Index < NumberOfWorkers; Index++) {
+            SubmitThreadpoolWork(Work);
+        }
+
+        WaitForThreadpoolWorkCallbacks(Work, FALSE);
+        CloseThreadpoolWork(Work);
+    }
+
+    if (Enumeration.Failed) {
+        goto Error;
+    }
+
+Done:
+
+    if (ARGUMENT_PRESENT(NumberOfClassesPointer)) {
+        *NumberOfClassesPointer = (ULONGLONG)Enumeration.NumberOfClasses;
+    }
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    ReleaseDictionaryLockShared(&Dictionary->Lock);
+
+    if (Enumeration.BitmapTableEntries) {
+        Allocator->FreePointer(Allocator,
+                               (PPVOID)&Enumeration.BitmapTableEntries);
+    }
+
+    return Success;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
@@ -0,0 +1,939 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    Compact.c
+
+Abstract:
+
+    This module implements incremental compaction for the dictionary component.
+    After heavy add/remove churn, the nodes of a dictionary's tables (and the
+    string buffers of its words) end up scattered across the heap.  The public
+    CompactDictionary() routine relocates bitmap table entries, along with
+    their entire histogram and word table cascades, into freshly allocated
+    contiguous arena chunks, one bounded step at a time.
+
+    Within a chunk, nodes are laid out in key order: each bitmap table entry
+    is followed by its histogram table entries (in-order), and each histogram
+    table entry is followed by its word table entries (in-order), with each
+    word's string buffer immediately after its node.  Thus, the nodes visited
+    by a single lookup are typically a handful of cache lines apart.
+
+    Routines are also provided for releasing arena chunk references when arena
+    nodes and strings are subsequently freed.
+
+--*/
+
+#include "stdafx.h"
+
+//
+// Define the compaction context structure used to carve objects out of the
+// current arena chunk.
+//
+
+typedef struct _COMPACTION_CONTEXT {
+    PDICTIONARY Dictionary;
+    PDICTIONARY_ARENA_CHUNK Chunk;
+    PBYTE NextFree;
+    PBYTE End;
+} COMPACTION_CONTEXT;
+typedef COMPACTION_CONTEXT *PCOMPACTION_CONTEXT;
+
+//
+// The subtree relocation and sizing routines are recursive, so they're
+// declared up front rather than inlined.
+//
+
+typedef
+VOID
+(RELOCATE_WORD_SUBTREE)(
+    _In_ PCOMPACTION_CONTEXT Context,
+    _In_ PWORD_TABLE WordTable,
+    _In_opt_ PRTL_BALANCED_LINKS Links
+    );
+typedef RELOCATE_WORD_SUBTREE *PRELOCATE_WORD_SUBTREE;
+
+typedef
+VOID
+(RELOCATE_HISTOGRAM_SUBTREE)(
+    _In_ PCOMPACTION_CONTEXT Context,
+    _In_ PHISTOGRAM_TABLE HistogramTable,
+    _In_opt_ PRTL_BALANCED_LINKS Links
+    );
+typedef RELOCATE_HISTOGRAM_SUBTREE *PRELOCATE_HISTOGRAM_SUBTREE;
+
+typedef
+ULONGLONG
+(GET_COMPACTION_SIZE)(
+    _In_opt_ PRTL_BALANCED_LINKS Links,
+    _In_ BOOLEAN IsHistogramTable
+    );
+typedef GET_COMPACTION_SIZE *PGET_COMPACTION_SIZE;
+
+RELOCATE_WORD_SUBTREE RelocateWordSubtree;
+RELOCATE_HISTOGRAM_SUBTREE RelocateHistogramSubtree;
+GET_COMPACTION_SIZE GetCompactionSize;
+
+#define ARENA_NODE_SIZE(Name) \
+    ALIGN_UP(TABLE_NODE_SIZE(Name), DICTIONARY_ARENA_ALIGNMENT)
+
+#define ARENA_STRING_SIZE(String) \
+    ALIGN_UP((String)->Length + 1, DICTIONARY_ARENA_ALIGNMENT)
+
+//
+// Inline strings are relocated as part of their owning node.
+//
+
+#define ARENA_WORD_STRING_SIZE(OwnerHeader, String) \
+    ((OwnerHeader)->IsInlineString ? 0 : ARENA_STRING_SIZE(String))
+
+//
+// Arena chunk reference routines.
+//
+
+_Use_decl_annotations_
+VOID
+ReleaseArenaChunk(
+    PDICTIONARY Dictionary,
+    PDICTIONARY_ARENA_CHUNK Chunk
+    )
+/*++
+
+Routine Description:
+
+    Releases a reference to an arena chunk.  If this was the last reference,
+    the chunk is freed.
+
+    N.B. The dictionary lock must be held exclusively.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure that owns the
+        chunk.
+
+    Chunk - Supplies a pointer to the arena chunk for which a reference is to
+        be released.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    PALLOCATOR Allocator;
+
+    ASSERT(Chunk->ReferenceCount > 0);
+
+    if (--Chunk->ReferenceCount > 0) {
+        return;
+    }
+
+    ASSERT(Dictionary->NumberOfArenaChunks > 0);
+    ASSERT(Dictionary->NumberOfArenaBytes >= Chunk->SizeInBytes);
+
+    Dictionary->NumberOfArenaChunks--;
+    Dictionary->NumberOfArenaBytes -= Chunk->SizeInBytes;
+
+    Allocator = Dictionary->Allocator;
+    Allocator->Free(Allocator, Chunk);
+}
+
+_Use_decl_annotations_
+VOID
+FreeWordStringBuffer(
+    PDICTIONARY Dictionary,
+    PDICTIONARY_ARENA_CHUNK Chunk,
+    PBYTE Buffer
+    )
+/*++
+
+Routine Description:
+
+    Frees a word's string buffer.  If the buffer resides in an arena chunk,
+    the chunk's reference is released, otherwise, the buffer is freed via the
+    dictionary's word allocator.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure that owns the
+        string buffer.
+
+    Chunk - Optionally supplies a pointer to the arena chunk in which the
+        string buffer resides.  This should be obtained via the routine
+        WordStringArenaChunk() prior to the owning node being freed.
+
+    Buffer - Supplies the address of the string buffer to free.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    PALLOCATOR WordAllocator;
+
+    if (Chunk) {
+        ReleaseArenaChunk(Dictionary, Chunk);
+        return;
+    }
+
+    WordAllocator = Dictionary->WordAllocator;
+    WordAllocator->Free(WordAllocator, Buffer);
+}
+
+//
+// Compaction helpers.
+//
+
+FORCEINLINE
+PVOID
+ArenaAllocate(
+    _In_ PCOMPACTION_CONTEXT Context,
+    _In_ ULONG SizeInBytes
+    )
+{
+    PVOID Buffer;
+
+    ASSERT(!(SizeInBytes & (DICTIONARY_ARENA_ALIGNMENT - 1)));
+    ASSERT(Context->NextFree + SizeInBytes <= Context->End);
+
+    Buffer = Context->NextFree;
+    Context->NextFree += SizeInBytes;
+    Context->Chunk->ReferenceCount++;
+
+    return Buffer;
+}
+
+FORCEINLINE
+VOID
+UpdateTableNodePointers(
+    _In_ PRTL_AVL_TABLE Table,
+    _In_ PTABLE_ENTRY_HEADER OldHeader,
+    _In_ PTABLE_ENTRY_HEADER NewHeader
+    )
+/*++
+
+Routine Description:
+
+    Updates an AVL table's cached node pointers (the enumeration restart key
+    and the ordered element pointer) if they refer to a relocated node.
+
+--*/
+{
+    if (Table->RestartKey == &OldHeader->BalancedLinks) {
+        Table->RestartKey = &NewHeader->BalancedLinks;
+    }
+
+    if (Table->OrderedPointer == (PVOID)OldHeader) {
+        Table->OrderedPointer = (PVOID)NewHeader;
+    } else if (Table->OrderedPointer == (PVOID)&OldHeader->UserData) {
+        Table->OrderedPointer = (PVOID)&NewHeader->UserData;
+    }
+}
+
+FORCEINLINE
+VOID
+FixupRelocatedTable(
+    _In_ PRTL_AVL_TABLE OldTable,
+    _In_ PRTL_AVL_TABLE NewTable
+    )
+/*++
+
+Routine Description:
+
+    Fixes up an AVL table that was embedded in a node that has been relocated.
+    The table's balanced root is self-referential (its Parent field points to
+    itself), and the tree's root node points back to the balanced root.
+
+--*/
+{
+    PRTL_BALANCED_LINKS Root;
+    PRTL_BALANCED_LINKS OldBalancedRoot;
+    PRTL_BALANCED_LINKS NewBalancedRoot;
+
+    OldBalancedRoot = &OldTable->BalancedRoot;
+    NewBalancedRoot = &NewTable->BalancedRoot;
+
+    NewBalancedRoot->Parent = NewBalancedRoot;
+
+    Root = NewBalancedRoot->RightChild;
+    if (Root) {
+        ASSERT(Root->Parent == OldBalancedRoot);
+        Root->Parent = NewBalancedRoot;
+    }
+
+    if (NewTable->RestartKey == OldBalancedRoot) {
+        NewTable->RestartKey = NewBalancedRoot;
+    }
+
+    if (NewTable->OrderedPointer == (PVOID)OldBalancedRoot) {
+        NewTable->OrderedPointer = (PVOID)NewBalancedRoot;
+    }
+}
+
+FORCEINLINE
+VOID
+FixupRelocatedWordTableEntry(
+    _In_ PDICTIONARY Dictionary,
+    _In_ PWORD_TABLE_ENTRY OldEntry,
+    _In_ PWORD_TABLE_ENTRY NewEntry
+    )
+/*++
+
+Routine Description:
+
+    Fixes up all references to a word table entry (or inline word) that has
+    been relocated: the length list linkage and the dictionary's longest word
+    pointers.
+
+--*/
+{
+    PLIST_ENTRY ListEntry;
+    PCLONG_STRING OldString;
+
+    ListEntry = &NewEntry->LengthListEntry;
+    ListEntry->Flink->Blink = ListEntry;
+    ListEntry->Blink->Flink = ListEntry;
+
+    OldString = &OldEntry->WordEntry.String;
+
+    if (Dictionary->Stats.CurrentLongestWord == OldString) {
+        Dictionary->Stats.CurrentLongestWord = &NewEntry->WordEntry.String;
+    }
+
+    if (Dictionary->Stats.LongestWordAllTime == OldString) {
+        Dictionary->Stats.LongestWordAllTime = &NewEntry->WordEntry.String;
+    }
+}
+
+FORCEINLINE
+_Success_(return != 0)
+PTABLE_ENTRY_HEADER
+RelocateNode(
+    _In_ PCOMPACTION_CONTEXT Context,
+    _In_ PRTL_AVL_TABLE Table,
+    _In_ PTABLE_ENTRY_HEADER OldHeader,
+    _In_ ULONG NodeSizeInBytes
+    )
+/*++
+
+Routine Description:
+
+    Relocates an AVL table node into the current arena chunk, and updates the
+    node's parent and children to point to the new location.  The caller is
+    responsible for any entry-specific fixups, and for subsequently freeing
+    the old node via the table's free routine.
+
+Arguments:
+
+    Context - Supplies a pointer to the compaction context.
+
+    Table - Supplies a pointer to the AVL table that owns the node.
+
+    OldHeader - Supplies a pointer to the node to relocate.
+
+    NodeSizeInBytes - Supplies the size of the node (as allocated by the
+        table), in bytes.
+
+Return Value:
+
+    The address of the relocated node.
+
+--*/
+{
+    ULONG_PTR Offset;
+    PRTL_BALANCED_LINKS Parent;
+    PTABLE_ENTRY_HEADER NewHeader;
+
+    NewHeader = (PTABLE_ENTRY_HEADER)(
+        ArenaAllocate(Context,
+                      ALIGN_UP(NodeSizeInBytes, DICTIONARY_ARENA_ALIGNMENT))
+    );
+
+    CopyMemory(NewHeader, OldHeader, NodeSizeInBytes);
+
+    //
+    // Capture the node's chunk offset.  String relocation is handled by the
+    // caller, so clear the string bit for now.
+    //
+
+    Offset = RtlPointerToOffset(Context->Chunk, NewHeader);
+    ASSERT(Offset < DICTIONARY_ARENA_MAXIMUM_CHUNK_SIZE);
+
+    NewHeader->IsArenaNode = TRUE;
+    NewHeader->IsArenaString = FALSE;
+    NewHeader->ArenaOffset = (ULONG)(Offset >> DICTIONARY_ARENA_OFFSET_SHIFT);
+
+    //
+    // Point our parent at our new location.  (If we're the root of the tree,
+    // our parent is the table's balanced root, and we're its right child.)
+    //
+
+    Parent = NewHeader->Parent;
+
+    if (Parent->LeftChild == &OldHeader->BalancedLinks) {
+        Parent->LeftChild = &NewHeader->BalancedLinks;
+    } else {
+        ASSERT(Parent->RightChild == &OldHeader->BalancedLinks);
+        Parent->RightChild = &NewHeader->BalancedLinks;
+    }
+
+    //
+    // Point our children back at us.
+    //
+
+    if (NewHeader->LeftChild) {
+        NewHeader->LeftChild->Parent = &NewHeader->BalancedLinks;
+    }
+
+    if (NewHeader->RightChild) {
+        NewHeader->RightChild->Parent = &NewHeader->BalancedLinks;
+    }
+
+    UpdateTableNodePointers(Table, OldHeader, NewHeader);
+
+    return NewHeader;
+}
+
+FORCEINLINE
+VOID
+RelocateWordString(
+    _In_ PCOMPACTION_CONTEXT Context,
+    _In_ PTABLE_ENTRY_HEADER OldOwnerHeader,
+    _In_ PTABLE_ENTRY_HEADER NewOwnerHeader,
+    _Inout_ PLONG_STRING String
+    )
+/*++
+
+Routine Description:
+
+    Relocates a word's string buffer into the current arena chunk, directly
+    after the word's (relocated) owning node, then frees the old buffer.
+    Inline strings move with their node; their buffer is simply pointed at
+    the new node's InlineString field.
+
+Arguments:
+
+    Context - Supplies a pointer to the compaction context.
+
+    OldOwnerHeader - Supplies a pointer to the header of the node that owned
+        the string prior to relocation.  This is used to determine how the old
+        string buffer should be freed.
+
+    NewOwnerHeader - Supplies a pointer to the header of the relocated node
+        that owns the string.
+
+    String - Supplies a pointer to the string (within the new owning node) to
+        relocate.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    PBYTE Buffer;
+    PBYTE OldBuffer;
+    PWORD_TABLE_ENTRY WordTableEntry;
+    PDICTIONARY_ARENA_CHUNK OldChunk;
+
+    if (NewOwnerHeader->IsInlineString) {
+        WordTableEntry = CONTAINING_RECORD(String,
+                                           WORD_TABLE_ENTRY,
+                                           WordEntry.String);
+        String->Buffer = WordTableEntry->InlineString;
+        return;
+    }
+
+    OldChunk = WordStringArenaChunk(OldOwnerHeader);
+    OldBuffer = String->Buffer;
+
+    Buffer = (PBYTE)ArenaAllocate(Context, ARENA_STRING_SIZE(String));
+
+    //
+    // Copy the string, including the trailing NULL.
+    //
+
+    CopyMemory(Buffer, OldBuffer, String->Length + 1);
+    String->Buffer = Buffer;
+    NewOwnerHeader->IsArenaString = TRUE;
+
+    FreeWordStringBuffer(Context->Dictionary, OldChunk, OldBuffer);
+}
+
+_Use_decl_annotations_
+VOID
+RelocateWordSubtree(
+    PCOMPACTION_CONTEXT Context,
+    PWORD_TABLE WordTable,
+    PRTL_BALANCED_LINKS Links
+    )
+/*++
+
+Routine Description:
+
+    Relocates all nodes (and their strings) of a word table subtree into the
+    current arena chunk, in order.
+
+--*/
+{
+    PRTL_AVL_TABLE Avl;
+    PTABLE_ENTRY_HEADER OldHeader;
+    PTABLE_ENTRY_HEADER NewHeader;
+
+    if (!Links) {
+        return;
+    }
+
+    Avl = &WordTable->Avl;
+
+    RelocateWordSubtree(Context, WordTable, Links->LeftChild);
+
+    OldHeader = (PTABLE_ENTRY_HEADER)Links;
+    NewHeader = RelocateNode(Context, Avl, OldHeader, TABLE_NODE_SIZE(WORD));
+
+    FixupRelocatedWordTableEntry(Context->Dictionary,
+                                 &OldHeader->WordTableEntry,
+                                 &NewHeader->WordTableEntry);
+
+    RelocateWordString(Context,
+                       OldHeader,
+                       NewHeader,
+                       &NewHeader->WordTableEntry.WordEntry.String);
+
+    Avl->FreeRoutine(Avl, OldHeader);
+
+    RelocateWordSubtree(Context, WordTable, NewHeader->RightChild);
+}
+
+_Use_decl_annotations_
+VOID
+RelocateHistogramSubtree(
+    PCOMPACTION_CONTEXT Context,
+    PHISTOGRAM_TABLE HistogramTable,
+    PRTL_BALANCED_LINKS Links
+    )
+/*++
+
+Routine Description:
+
+    Relocates all nodes of a histogram table subtree into the current arena
+    chunk, in order.  Each histogram table entry is immediately followed by
+    its word table cascade (or its inline word's string).
+
+--*/
+{
+    PRTL_AVL_TABLE Avl;
+    PWORD_TABLE WordTable;
+    PTABLE_ENTRY_HEADER OldHeader;
+    PTABLE_ENTRY_HEADER NewHeader;
+    PHISTOGRAM_TABLE_ENTRY OldEntry;
+    PHISTOGRAM_TABLE_ENTRY NewEntry;
+
+    if (!Links) {
+        return;
+    }
+
+    Avl = &HistogramTable->Avl;
+
+    RelocateHistogramSubtree(Context, HistogramTable, Links->LeftChild);
+
+    OldHeader = (PTABLE_ENTRY_HEADER)Links;
+    NewHeader = RelocateNode(Context,
+                             Avl,
+                             OldHeader,
+                             TABLE_NODE_SIZE(HISTOGRAM));
+
+    OldEntry = &OldHeader->HistogramTableEntry;
+    NewEntry = &NewHeader->HistogramTableEntry;
+
+    if (NewHeader->HasInlineWord) {
+
+        FixupRelocatedWordTableEntry(Context->Dictionary,
+                                     &OldEntry->InlineWordTableEntry,
+                                     &NewEntry->InlineWordTableEntry);
+
+        RelocateWordString(
+            Context,
+            OldHeader,
+            NewHeader,
+            &NewEntry->InlineWordTableEntry.WordEntry.String
+        );
+
+        WordTable = NULL;
+
+    } else {
+
+        FixupRelocatedTable(&OldEntry->WordTable.Avl,
+                            &NewEntry->WordTable.Avl);
+
+        WordTable = &NewEntry->WordTable;
+    }
+
+    Avl->FreeRoutine(Avl, OldHeader);
+
+    if (WordTable) {
+        RelocateWordSubtree(Context,
+                            WordTable,
+                            WordTable->Avl.BalancedRoot.RightChild);
+    }
+
+    RelocateHistogramSubtree(Context, HistogramTable, NewHeader->RightChild);
+}
+
+FORCEINLINE
+VOID
+RelocateBitmapTableEntry(
+    _In_ PCOMPACTION_CONTEXT Context,
+    _In_ PTABLE_ENTRY_HEADER OldHeader
+    )
+/*++
+
+Routine Description:
+
+    Relocates a bitmap table entry and its entire cascade (histogram table
+    entries, word table entries and word strings) into the current arena
+    chunk.
+
+--*/
+{
+    PRTL_AVL_TABLE Avl;
+    PHISTOGRAM_TABLE HistogramTable;
+    PTABLE_ENTRY_HEADER NewHeader;
+
+    Avl = &Context->Dictionary->BitmapTable.Avl;
+
+    NewHeader = RelocateNode(Context, Avl, OldHeader, TABLE_NODE_SIZE(BITMAP));
+
+    FixupRelocatedTable(&OldHeader->BitmapTableEntry.HistogramTable.Avl,
+                        &NewHeader->BitmapTableEntry.HistogramTable.Avl);
+
+    Avl->FreeRoutine(Avl, OldHeader);
+
+    HistogramTable = &NewHeader->BitmapTableEntry.HistogramTable;
+
+    RelocateHistogramSubtree(Context,
+                             HistogramTable,
+                             HistogramTable->Avl.BalancedRoot.RightChild);
+}
+
+_Use_decl_annotations_
+ULONGLONG
+GetCompactionSize(
+    PRTL_BALANCED_LINKS Links,
+    BOOLEAN IsHistogramTable
+    )
+/*++
+
+Routine Description:
+
+    Calculates the number of arena bytes required to relocate a histogram or
+    word table subtree, including all word strings.
+
+--*/
+{
+    ULONGLONG Size;
+    PTABLE_ENTRY_HEADER Header;
+    PHISTOGRAM_TABLE_ENTRY HistogramTableEntry;
+
+    if (!Links) {
+        return 0;
+    }
+
+    Header = (PTABLE_ENTRY_HEADER)Links;
+
+    Size = (
+        GetCompactionSize(Links->LeftChild, IsHistogramTable) +
+        GetCompactionSize(Links->RightChild, IsHistogramTable)
+    );
+
+    if (!IsHistogramTable) {
+        return (
+            Size +
+            ARENA_NODE_SIZE(WORD) +
+            ARENA_WORD_STRING_SIZE(Header,
+                                   &Header->WordTableEntry.WordEntry.String)
+        );
+    }
+
+    HistogramTableEntry = &Header->HistogramTableEntry;
+
+    Size += ARENA_NODE_SIZE(HISTOGRAM);
+
+    if (Header->HasInlineWord) {
+        Size += ARENA_WORD_STRING_SIZE(
+            Header,
+            &HistogramTableEntry->InlineWordTableEntry.WordEntry.String
+        );
+    } else {
+        Size += GetCompactionSize(
+            HistogramTableEntry->WordTable.Avl.BalancedRoot.RightChild,
+            FALSE
+        );
+    }
+
+    return Size;
+}
+
+FORCEINLINE
+ULONGLONG
+GetBitmapTableEntryCompactionSize(
+    _In_ PTABLE_ENTRY_HEADER Header
+    )
+{
+    PHISTOGRAM_TABLE HistogramTable;
+
+    HistogramTable = &Header->BitmapTableEntry.HistogramTable;
+
+    return (
+        ARENA_NODE_SIZE(BITMAP) +
+        GetCompactionSize(HistogramTable->Avl.BalancedRoot.RightChild, TRUE)
+    );
+}
+
+FORCEINLINE
+PTABLE_ENTRY_HEADER
+FindNextBitmapTableEntry(
+    _In_ PDICTIONARY Dictionary,
+    _In_ ULONG Cursor
+    )
+/*++
+
+Routine Description:
+
+    Finds the bitmap table entry with the smallest hash greater than the given
+    cursor value.  The tree is not splayed.
+
+--*/
+{
+    PRTL_BALANCED_LINKS Links;
+    PTABLE_ENTRY_HEADER Header;
+    PTABLE_ENTRY_HEADER Next;
+
+    Next = NULL;
+    Links = Dictionary->BitmapTable.Avl.BalancedRoot.RightChild;
+
+    while (Links) {
+        Header = (PTABLE_ENTRY_HEADER)Links;
+        if (Header->Hash > Cursor) {
+            Next = Header;
+            Links = Links->LeftChild;
+        } else {
+            Links = Links->RightChild;
+        }
+    }
+
+    return Next;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CompactDictionary(
+    PDICTIONARY Dictionary,
+    ULONG MaximumNumberOfBitmapEntries,
+    PBOOLEAN IsCompletePointer
+    )
+/*++
+
+Routine Description:
+
+    Performs a single, bounded step of dictionary compaction.  Bitmap table
+    entries are visited in hash order, starting after the entry visited last
+    by the previous step.  Each visited entry, along with all of its histogram
+    and word table entries and word strings, is relocated into a new arena
+    chunk allocated for this step.  The dictionary lock is held exclusively
+    for the duration of the step only.
+
+    Callers wishing to compact the entire dictionary call this routine in a
+    loop (e.g. from a background thread) until IsCompletePointer is set to
+    TRUE.  Words may be added and removed between steps; a step always resumes
+    at the next bitmap hash after the last one relocated.
+
+    N.B. The length table isn't relocated; it only has one entry per distinct
+         word length and isn't visited by word lookups.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure to compact.
+
+    MaximumNumberOfBitmapEntries - Supplies the maximum number of bitmap table
+        entries (and their cascades) to relocate in this step.  If 0, as many
+        as will fit in a single arena chunk are relocated.  A step is also
+        bounded by the maximum arena chunk size (4MB).
+
+    IsCompletePointer - Supplies a pointer to a variable that receives TRUE
+        if the compaction pass has completed (i.e. there were no more bitmap
+        table entries to visit), FALSE otherwise.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  If FALSE is returned, the dictionary
+    is left unchanged and the step may be retried.  FALSE is always returned
+    for frozen dictionaries.
+
+--*/
+{
+    BOOLEAN Success;
+    BOOLEAN IsComplete;
+    ULONG Cursor;
+    ULONG EndCursor;
+    ULONG NumberOfEntries;
+    ULONGLONG Size;
+    ULONGLONG EntrySize;
+    PALLOCATOR Allocator;
+    PTABLE_ENTRY_HEADER Header;
+    PDICTIONARY_ARENA_CHUNK Chunk;
+    COMPACTION_CONTEXT Context;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(IsCompletePointer)) {
+        return FALSE;
+    }
+
+    *IsCompletePointer = FALSE;
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+
+    //
+    // Frozen dictionaries have no tables to compact.
+    //
+
+    if (Dictionary->Flags.IsFrozen) {
+        goto Error;
+    }
+
+    //
+    // Start a new pass if one isn't already in progress.  (Bitmap hashes are
+    // never 0, so a cursor of 0 precedes all entries.)
+    //
+
+    if (!Dictionary->Flags.IsCompactionInProgress) {
+        Dictionary->Flags.IsCompactionInProgress = TRUE;
+        Dictionary->CompactionCursor = 0;
+    }
+
+    //
+    // Determine the range of bitmap table entries that will be relocated in
+    // this step, and the arena chunk size required to accommodate them.
+    //
+
+    Cursor = Dictionary->CompactionCursor;
+    EndCursor = Cursor;
+    IsComplete = FALSE;
+    NumberOfEntries = 0;
+    Size = sizeof(DICTIONARY_ARENA_CHUNK);
+
+    while (MaximumNumberOfBitmapEntries == 0 ||
+           NumberOfEntries < MaximumNumberOfBitmapEntries) {
+
+        Header = FindNextBitmapTableEntry(Dictionary, EndCursor);
+
+        if (!Header) {
+            IsComplete = TRUE;
+            break;
+        }
+
+        EntrySize = GetBitmapTableEntryCompactionSize(Header);
+
+        if (Size + EntrySize > DICTIONARY_ARENA_MAXIMUM_CHUNK_SIZE) {
+
+            if (NumberOfEntries == 0) {
+
+                //
+                // This entry's cascade is too large to fit in a single chunk;
+                // skip it and end the step.
+                //
+
+                Cursor = EndCursor = Header->Hash;
+            }
+
+            break;
+        }
+
+        Size += EntrySize;
+        EndCursor = Header->Hash;
+        NumberOfEntries++;
+    }
+
+    if (NumberOfEntries == 0) {
+        goto UpdateCursor;
+    }
+
+    //
+    // Allocate the arena chunk.
+    //
+
+    Allocator = Dictionary->Allocator;
+    Chunk = (PDICTIONARY_ARENA_CHUNK)Allocator->Malloc(Allocator, Size);
+
+    if (!Chunk) {
+        goto Error;
+    }
+
+    ASSERT(!((ULONG_PTR)Chunk & (DICTIONARY_ARENA_ALIGNMENT - 1)));
+
+    Chunk->SizeInBytes = (ULONG)Size;
+    Chunk->ReferenceCount = 0;
+    Chunk->Unused = 0;
+
+    Dictionary->NumberOfArenaChunks++;
+    Dictionary->NumberOfArenaBytes += Size;
+
+    Context.Dictionary = Dictionary;
+    Context.Chunk = Chunk;
+    Context.NextFree = (PBYTE)(Chunk + 1);
+    Context.End = RtlOffsetToPointer(Chunk, Size);
+
+    //
+    // Relocate each bitmap table entry in the range.
+    //
+
+    while (NumberOfEntries--) {
+        Header = FindNextBitmapTableEntry(Dictionary, Cursor);
+        ASSERT(Header != NULL && Header->Hash <= EndCursor);
+        Cursor = Header->Hash;
+        RelocateBitmapTableEntry(&Context, Header);
+    }
+
+    ASSERT(Cursor == EndCursor);
+    ASSERT(Context.NextFree == Context.End);
+
+UpdateCursor:
+
+    Dictionary->CompactionCursor = EndCursor;
+
+    if (IsComplete) {
+        Dictionary->Flags.IsCompactionInProgress = FALSE;
+        Dictionary->CompactionCursor = 0;
+    }
+
+    *IsCompletePointer = IsComplete;
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    return Success;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
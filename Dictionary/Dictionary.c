@@ -40,7 +40,7 @@ Arguments:
         will be used to allocate memory for the underlying DICTIONARY structure.
 
     CreateFlags - Optionally supplies creation flags that affect the underlying
-        behavior of the dictionary.  Currently unused.
+        behavior of the dictionary.  See DICTIONARY_CREATE_FLAGS.
 
     DictionaryPointer - Supplies the address of a variable that will receive
         the address of the newly created DICTIONARY structure if the routine is
@@ -72,10 +72,10 @@ Return Value:
     }
 
     //
-    // CreateFlags aren't currently used.
+    // Validate create flags.
     //
 
-    if (CreateFlags.AsULong != 0) {
+    if (CreateFlags.Unused != 0) {
         return FALSE;
     }
 
@@ -123,6 +123,42 @@ Return Value:
 
     Dictionary->WordAllocator = Allocator;
 
+    //
+    // Capture whether NUMA replicas should be created when frozen.
+    //
+
+    Dictionary->Flags.UseNumaReplicas = CreateFlags.UseNumaReplicas;
+
+    //
+    // Capture whether words may be evicted once a budget has been set.
+    //
+
+    Dictionary->Flags.IsEvictionEnabled = CreateFlags.EnableEviction;
+
+    //
+    // If memory usage tracking has been requested, wrap the table and word
+    // allocators in tracking allocators.
+    //
+
+    if (CreateFlags.TrackMemoryUsage) {
+        if (!CreateDictionaryTrackingAllocators(Dictionary)) {
+            Allocator->FreePointer(Allocator, (PPVOID)&Dictionary);
+            goto Error;
+        }
+    }
+
+    //
+    // Create the prefix index if requested.
+    //
+
+    if (CreateFlags.MaintainPrefixIndex) {
+        if (!CreatePrefixIndex(Dictionary)) {
+            DestroyDictionaryTrackingAllocators(Dictionary);
+            Allocator->FreePointer(Allocator, (PPVOID)&Dictionary);
+            goto Error;
+        }
+    }
+
     //
     // Initialize the dictionary lock, acquire it exclusively, then initialize
     // the underlying AVL tables.  (We acquire and release it to satisfy the SAL
@@ -263,6 +299,22 @@ Return Value:
 
     ASSERT(Dictionary->SizeOfStruct == sizeof(*Dictionary));
 
+    //
+    // Stop any recording in progress, such that the file is finalized.
+    //
+
+    if (Dictionary->Recorder) {
+        StopDictionaryRecording(Dictionary, NULL);
+    }
+
+    //
+    // Close the write-ahead log, if any, flushing any outstanding records.
+    //
+
+    if (Dictionary->Log) {
+        CloseDictionaryLog(Dictionary, NULL);
+    }
+
     //
     // Acquire the dictionary lock for the duration of the destroy logic.
     //
@@ -280,6 +332,15 @@ Return Value:
 
         FOR_EACH_ENTRY_IN_TABLE(Histogram, PHISTOGRAM_TABLE_ENTRY) {
 
+            //
+            // Skip histogram table entries that are storing their only word
+            // inline, as they have no word table.
+            //
+
+            if (HistogramTableEntryHasInlineWord(HistogramTableEntry)) {
+                continue;
+            }
+
             //
             // Resolve the word table for the current histogram table entry.
             //
@@ -304,9 +365,20 @@ Return Value:
     }
 
     //
-    // Now free the dictionary itself.
+    // Free the frozen representation (if any), the prefix index (if any), the
+    // tracking allocators (if any), then the dictionary itself.
     //
 
+    if (Dictionary->Frozen) {
+        DestroyFrozenDictionaryReplicas(Dictionary);
+        Allocator->FreePointer(Allocator, (PPVOID)&Dictionary->Frozen);
+    }
+
+    DestroyPrefixIndex(Dictionary);
+
+    DestroyDictionaryTrackingAllocators(Dictionary);
+
+
     Allocator->FreePointer(Allocator, DictionaryPointer);
 
     Success = TRUE;
@@ -78,6 +78,30 @@ typedef struct _DICTIONARY DICTIONARY;
 typedef DICTIONARY *PDICTIONARY;
 typedef const DICTIONARY *PCDICTIONARY;
 
+//
+// Define an opaque WORD_COUNTER structure.
+//
+
+typedef struct _WORD_COUNTER WORD_COUNTER;
+typedef WORD_COUNTER *PWORD_COUNTER;
+
+//
+// Define an opaque WORD_SKETCH structure.
+//
+
+typedef struct _WORD_SKETCH WORD_SKETCH;
+typedef WORD_SKETCH *PWORD_SKETCH;
+
+//
+// Define opaque DICTIONARY_SERVICE and DICTIONARY_SERVICE_CLIENT structures.
+//
+
+typedef struct _DICTIONARY_SERVICE DICTIONARY_SERVICE;
+typedef DICTIONARY_SERVICE *PDICTIONARY_SERVICE;
+
+typedef struct _DICTIONARY_SERVICE_CLIENT DICTIONARY_SERVICE_CLIENT;
+typedef DICTIONARY_SERVICE_CLIENT *PDICTIONARY_SERVICE_CLIENT;
+
 //
 // We can't use STRING structures here as the words might be up to 1MB and we
 // can't represent that size via the USHORT Length parameters.  So, use a new
@@ -213,6 +237,92 @@ typedef struct _LINKED_WORD_ENTRY {
 typedef LINKED_WORD_ENTRY *PLINKED_WORD_ENTRY;
 typedef const LINKED_WORD_ENTRY *PCLINKED_WORD_ENTRY;
 
+//
+// Define the WORD_LENGTH_HISTOGRAM structure, which captures the distribution
+// of word lengths in a dictionary.  Each distinct word length present in the
+// dictionary has a count, in ascending order of length.
+//
+
+typedef struct _WORD_LENGTH_COUNT {
+
+    //
+    // Word length, in bytes.
+    //
+
+    ULONG Length;
+
+    ULONG Padding;
+
+    //
+    // Number of unique words with this length.
+    //
+
+    ULONGLONG NumberOfWords;
+
+} WORD_LENGTH_COUNT;
+typedef WORD_LENGTH_COUNT *PWORD_LENGTH_COUNT;
+
+typedef struct _WORD_LENGTH_HISTOGRAM {
+
+    //
+    // Total number of unique words in the dictionary.
+    //
+
+    ULONGLONG NumberOfWords;
+
+    //
+    // Number of elements in the Counts array (i.e. the number of distinct
+    // word lengths).
+    //
+
+    ULONG NumberOfLengths;
+
+    ULONG Padding;
+
+    WORD_LENGTH_COUNT Counts[ANYSIZE_ARRAY];
+
+} WORD_LENGTH_HISTOGRAM;
+typedef WORD_LENGTH_HISTOGRAM *PWORD_LENGTH_HISTOGRAM;
+
+//
+// An anagram class is the set of unique words in a dictionary that are all
+// permutations of one another.  Classes are yielded to the caller via the
+// ANAGRAM_CLASS_CALLBACK passed to EnumerateAnagramClasses().
+//
+
+typedef struct _ANAGRAM_CLASS {
+
+    //
+    // Number of words in the class (i.e. the number of elements in the Words
+    // array).
+    //
+
+    ULONG NumberOfWords;
+
+    //
+    // Length of each word in the class.
+    //
+
+    ULONG Length;
+
+    //
+    // Sum of the entry counts of each word in the class.
+    //
+
+    LONGLONG TotalEntryCount;
+
+    //
+    // Array of pointers to the word entries belonging to the class.  The
+    // array and the entries are owned by the dictionary and are only valid
+    // for the duration of the callback.
+    //
+
+    PCWORD_ENTRY *Words;
+
+} ANAGRAM_CLASS;
+typedef ANAGRAM_CLASS *PANAGRAM_CLASS;
+typedef const ANAGRAM_CLASS *PCANAGRAM_CLASS;
+
 //
 // Define the DICTIONARY_STATS interface.
 //
@@ -234,13 +344,274 @@ typedef struct _DICTIONARY_STATS {
 } DICTIONARY_STATS;
 typedef DICTIONARY_STATS *PDICTIONARY_STATS;
 
+//
+// Define the DICTIONARY_MEMORY_USAGE interface.  Memory usage is reported per
+// underlying structure (bitmap, histogram, word and length tables, and word
+// string buffers).  Table figures are obtained by walking the dictionary; the
+// allocator figures are only available if the dictionary was created with the
+// TrackMemoryUsage create flag set.
+//
+
+typedef struct _DICTIONARY_TABLE_MEMORY_USAGE {
+
+    //
+    // Number of AVL tables of this type present in the dictionary.  (There is
+    // only one bitmap and length table; there is a histogram table for every
+    // bitmap table entry and a word table for every histogram table entry that
+    // has more than one word.)
+    //
+
+    ULONGLONG NumberOfTables;
+
+    //
+    // Total number of nodes in all tables of this type.
+    //
+
+    ULONGLONG NumberOfNodes;
+
+    //
+    // Number of bytes consumed by all nodes of this type (NumberOfNodes *
+    // NodeSizeInBytes).
+    //
+
+    ULONGLONG NumberOfBytes;
+
+    //
+    // Size of an individual node in bytes, including the table entry header.
+    //
+
+    ULONG NodeSizeInBytes;
+
+    //
+    // Maximum depth of any node in any table of this type.  A root node has
+    // a depth of 1.
+    //
+
+    ULONG MaximumDepth;
+
+    //
+    // Average depth of all nodes in all tables of this type.
+    //
+
+    DOUBLE AverageDepth;
+
+} DICTIONARY_TABLE_MEMORY_USAGE;
+typedef DICTIONARY_TABLE_MEMORY_USAGE *PDICTIONARY_TABLE_MEMORY_USAGE;
+
+typedef struct _DICTIONARY_ALLOCATOR_MEMORY_USAGE {
+
+    //
+    // Number of allocations and bytes currently outstanding.
+    //
+
+    ULONGLONG NumberOfAllocations;
+    ULONGLONG NumberOfBytes;
+
+    //
+    // Peak number of bytes outstanding at any one time.
+    //
+
+    ULONGLONG PeakNumberOfBytes;
+
+    //
+    // Cumulative number of allocations and frees serviced by the allocator.
+    //
+
+    ULONGLONG TotalAllocations;
+    ULONGLONG TotalFrees;
+
+} DICTIONARY_ALLOCATOR_MEMORY_USAGE;
+typedef DICTIONARY_ALLOCATOR_MEMORY_USAGE *PDICTIONARY_ALLOCATOR_MEMORY_USAGE;
+
+typedef union _DICTIONARY_MEMORY_USAGE_FLAGS {
+    struct {
+
+        //
+        // When set, indicates the dictionary was created with memory usage
+        // tracking enabled, and the allocator usage fields are valid.
+        //
+
+        ULONG IsTrackingEnabled:1;
+
+        //
+        // When set, indicates the dictionary has been frozen via
+        // FreezeDictionary().  The per-table usage fields will be zero, and
+        // the NumberOfFrozenBytes field will be valid.
+        //
+
+        ULONG IsFrozen:1;
+
+        //
+        // Unused bits.
+        //
+
+        ULONG Unused:30;
+    };
+    LONG AsLong;
+    ULONG AsULong;
+} DICTIONARY_MEMORY_USAGE_FLAGS;
+C_ASSERT(sizeof(DICTIONARY_MEMORY_USAGE_FLAGS) == sizeof(ULONG));
+
+typedef struct _Struct_size_bytes_(SizeOfStruct) _DICTIONARY_MEMORY_USAGE {
+
+    //
+    // Size of the structure, in bytes.
+    //
+
+    _Field_range_(==, sizeof(struct _DICTIONARY_MEMORY_USAGE))
+        ULONG SizeOfStruct;
+
+    //
+    // Flags.
+    //
+
+    DICTIONARY_MEMORY_USAGE_FLAGS Flags;
+
+    //
+    // Number of unique words in the dictionary, and how many of them are
+    // stored inline within their histogram table entry.
+    //
+
+    ULONGLONG NumberOfWords;
+    ULONGLONG NumberOfInlineWords;
+
+    //
+    // Number of words whose strings are stored inline within their table
+    // entry (rather than in a separately allocated buffer).
+    //
+
+    ULONGLONG NumberOfInlineStrings;
+
+    //
+    // Number of bytes consumed by word strings (including terminating NULLs),
+    // whether inline or in separate buffers.  This is the "payload" of the
+    // dictionary.
+    //
+
+    ULONGLONG NumberOfStringBytes;
+
+    //
+    // Total number of bytes consumed by the dictionary: the DICTIONARY
+    // structure itself, all table nodes, and all string buffers.
+    //
+
+    ULONGLONG TotalNumberOfBytes;
+
+    //
+    // Ratio of non-payload bytes to payload bytes, i.e.:
+    //
+    //      (TotalNumberOfBytes - NumberOfStringBytes) / NumberOfStringBytes
+    //
+    // Will be 0.0 if the dictionary is empty.
+    //
+
+    DOUBLE OverheadRatio;
+
+    //
+    // Number of compaction arena chunks currently allocated, and their total
+    // size in bytes.  (Nodes and strings residing in these chunks are already
+    // accounted for above; the difference between these bytes and the live
+    // objects in the chunks is space freed by subsequent removals.)
+    //
+
+    ULONGLONG NumberOfArenaChunks;
+    ULONGLONG NumberOfArenaBytes;
+
+    //
+    // Number of bytes consumed by the read-only representation created by
+    // FreezeDictionary(), including string buffers.  Zero if the dictionary
+    // isn't frozen.
+    //
+
+    ULONGLONG NumberOfFrozenBytes;
+
+    //
+    // Number of per-NUMA node replicas of the frozen dictionary, and their
+    // total size in bytes.  (Replica bytes are included in the total above.)
+    //
+
+    ULONGLONG NumberOfNumaReplicas;
+    ULONGLONG NumberOfNumaReplicaBytes;
+
+    //
+    // Number of nodes in the prefix index, and the number of bytes consumed
+    // by the index.  Zero if the dictionary wasn't created with the flag
+    // MaintainPrefixIndex.  (Index bytes are included in the total above.)
+    //
+
+    ULONGLONG NumberOfPrefixIndexNodes;
+    ULONGLONG NumberOfPrefixIndexBytes;
+
+    //
+    // Per-table usage.
+    //
+
+    DICTIONARY_TABLE_MEMORY_USAGE BitmapTable;
+    DICTIONARY_TABLE_MEMORY_USAGE HistogramTable;
+    DICTIONARY_TABLE_MEMORY_USAGE WordTable;
+    DICTIONARY_TABLE_MEMORY_USAGE LengthTable;
+
+    //
+    // Per-allocator usage.  Only valid if Flags.IsTrackingEnabled is set.
+    //
+
+    DICTIONARY_ALLOCATOR_MEMORY_USAGE BitmapTableAllocator;
+    DICTIONARY_ALLOCATOR_MEMORY_USAGE HistogramTableAllocator;
+    DICTIONARY_ALLOCATOR_MEMORY_USAGE WordTableAllocator;
+    DICTIONARY_ALLOCATOR_MEMORY_USAGE LengthTableAllocator;
+    DICTIONARY_ALLOCATOR_MEMORY_USAGE WordAllocator;
+
+} DICTIONARY_MEMORY_USAGE;
+typedef DICTIONARY_MEMORY_USAGE *PDICTIONARY_MEMORY_USAGE;
+
 //
 // Define the DICTIONARY interface function pointers.
 //
 
 typedef union _DICTIONARY_CREATE_FLAGS {
     struct {
-        ULONG Unused:32;
+
+        //
+        // When set, wraps each of the dictionary's table allocators and the
+        // word allocator in a tracking allocator that records allocation
+        // counts and byte totals, which are then made available via the
+        // GetDictionaryMemoryUsage() routine.  This adds a small header to
+        // every allocation and is therefore off by default.
+        //
+
+        ULONG TrackMemoryUsage:1;
+
+        //
+        // When set, FreezeDictionary() creates a read-only replica of the
+        // frozen dictionary on each NUMA node, and lookups are routed to the
+        // replica local to the calling thread's processor.  Has no effect on
+        // systems with a single NUMA node.
+        //
+
+        ULONG UseNumaReplicas:1;
+
+        //
+        // When set, the dictionary maintains a prefix index of all words,
+        // which is required by GetWordsWithPrefix().  This increases the cost
+        // of adding and removing words, and the memory used by the dictionary.
+        //
+
+        ULONG MaintainPrefixIndex:1;
+
+        //
+        // When set, the dictionary may be given a budget (a maximum number of
+        // words and/or bytes) via SetDictionaryBudget().  Once the budget is
+        // exceeded, infrequently-seen words are evicted by an approximate LFU
+        // (CLOCK) policy as new words are added.
+        //
+
+        ULONG EnableEviction:1;
+
+        //
+        // Unused bits.
+        //
+
+        ULONG Unused:28;
     };
     LONG AsLong;
     ULONG AsULong;
@@ -330,6 +701,743 @@ BOOLEAN
     );
 typedef GET_DICTIONARY_STATS *PGET_DICTIONARY_STATS;
 
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI GET_DICTIONARY_MEMORY_USAGE)(
+    _In_ PDICTIONARY Dictionary,
+    _Out_ PDICTIONARY_MEMORY_USAGE MemoryUsage
+    );
+typedef GET_DICTIONARY_MEMORY_USAGE *PGET_DICTIONARY_MEMORY_USAGE;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI COMPACT_DICTIONARY)(
+    _Inout_ PDICTIONARY Dictionary,
+    _In_ ULONG MaximumNumberOfBitmapEntries,
+    _Out_ PBOOLEAN IsCompletePointer
+    );
+typedef COMPACT_DICTIONARY *PCOMPACT_DICTIONARY;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI FREEZE_DICTIONARY)(
+    _Inout_ PDICTIONARY Dictionary
+    );
+typedef FREEZE_DICTIONARY *PFREEZE_DICTIONARY;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI GET_WORDS_WITH_PREFIX)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ PALLOCATOR Allocator,
+    _In_z_ PCBYTE Prefix,
+    _In_ ULONG MaximumNumberOfWords,
+    _Out_ PLINKED_WORD_LIST *LinkedWordListPointer
+    );
+typedef GET_WORDS_WITH_PREFIX *PGET_WORDS_WITH_PREFIX;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI GET_SIMILAR_WORDS)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ PALLOCATOR Allocator,
+    _In_z_ PCBYTE Word,
+    _In_ ULONG MaximumDistance,
+    _In_ ULONG MaximumNumberOfWords,
+    _Out_ PLINKED_WORD_LIST *LinkedWordListPointer
+    );
+typedef GET_SIMILAR_WORDS *PGET_SIMILAR_WORDS;
+
+typedef union _DICTIONARY_TOKENIZER_FLAGS {
+    struct {
+
+        //
+        // When set, ASCII upper case letters are folded to lower case before
+        // words are added to the dictionary.
+        //
+
+        ULONG FoldCase:1;
+
+        //
+        // When set, ASCII digits are treated as word characters.
+        //
+
+        ULONG IncludeDigits:1;
+
+        //
+        // When set, bytes with the high bit set are treated as word
+        // characters, such that UTF-8 encoded characters remain part of the
+        // word in which they appear.
+        //
+
+        ULONG IncludeHighBytes:1;
+
+        //
+        // Unused bits.
+        //
+
+        ULONG Unused:29;
+    };
+    LONG AsLong;
+    ULONG AsULong;
+} DICTIONARY_TOKENIZER_FLAGS;
+typedef DICTIONARY_TOKENIZER_FLAGS *PDICTIONARY_TOKENIZER_FLAGS;
+C_ASSERT(sizeof(DICTIONARY_TOKENIZER_FLAGS) == sizeof(ULONG));
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI ADD_WORDS_FROM_TEXT)(
+    _In_ PDICTIONARY Dictionary,
+    _In_reads_bytes_(SizeInBytes) PCBYTE Text,
+    _In_ SIZE_T SizeInBytes,
+    _In_ DICTIONARY_TOKENIZER_FLAGS TokenizerFlags,
+    _Out_opt_ PULONGLONG NumberOfWordsPointer
+    );
+typedef ADD_WORDS_FROM_TEXT *PADD_WORDS_FROM_TEXT;
+
+//
+// Word counters allow threads to count words without contending for the
+// dictionary's lock.  A counter must only be used by the thread that created
+// it.  Words are counted locally, and the counts are added to the dictionary
+// (as if AddWord() had been called once per occurrence) when the counter
+// fills up, or when FlushWordCounter() or DestroyWordCounter() is called.
+//
+
+typedef
+_Check_return_
+_Success_(return != 0)
+BOOLEAN
+(NTAPI CREATE_WORD_COUNTER)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ PALLOCATOR Allocator,
+    _In_opt_ ULONG NumberOfSlots,
+    _Outptr_result_nullonfailure_ PWORD_COUNTER *WordCounterPointer
+    );
+typedef CREATE_WORD_COUNTER *PCREATE_WORD_COUNTER;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI COUNT_WORD)(
+    _In_ PWORD_COUNTER WordCounter,
+    _In_z_ PCBYTE Word
+    );
+typedef COUNT_WORD *PCOUNT_WORD;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI FLUSH_WORD_COUNTER)(
+    _In_ PWORD_COUNTER WordCounter
+    );
+typedef FLUSH_WORD_COUNTER *PFLUSH_WORD_COUNTER;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI DESTROY_WORD_COUNTER)(
+    _Inout_ PWORD_COUNTER *WordCounterPointer
+    );
+typedef DESTROY_WORD_COUNTER *PDESTROY_WORD_COUNTER;
+
+//
+// Word sketches count words approximately, in fixed memory, for streams with
+// too many distinct words to count exactly.  A sketch is a count-min sketch
+// keyed by each word's string hash (as calculated by InitializeWord()), paired
+// with a list of the most frequent words seen (the heavy hitters).  Estimates
+// never undercount, but may overcount due to hash collisions.  Any number of
+// threads may count words with the same sketch concurrently; the sketch's
+// counters are updated without locks.
+//
+// If a dictionary and promotion threshold are provided, a word is added to
+// the dictionary once its estimated count reaches the threshold (with an entry
+// count equal to the estimate), and every subsequent occurrence of the word is
+// added to the dictionary as well.  Promotions are applied once per batch of
+// words, under a single acquisition of the dictionary's exclusive lock.
+//
+
+typedef
+_Check_return_
+_Success_(return != 0)
+BOOLEAN
+(NTAPI CREATE_WORD_SKETCH)(
+    _In_opt_ PDICTIONARY Dictionary,
+    _In_ PALLOCATOR Allocator,
+    _In_opt_ ULONG Width,
+    _In_opt_ ULONG NumberOfHeavyHitters,
+    _In_ LONGLONG PromotionThreshold,
+    _Outptr_result_nullonfailure_ PWORD_SKETCH *WordSketchPointer
+    );
+typedef CREATE_WORD_SKETCH *PCREATE_WORD_SKETCH;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI COUNT_WORDS_IN_SKETCH)(
+    _In_ PWORD_SKETCH WordSketch,
+    _In_ ULONG NumberOfWords,
+    _In_reads_(NumberOfWords) PCBYTE *Words,
+    _Out_opt_ PULONG NumberOfWordsCountedPointer
+    );
+typedef COUNT_WORDS_IN_SKETCH *PCOUNT_WORDS_IN_SKETCH;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI ESTIMATE_WORD_COUNT)(
+    _In_ PWORD_SKETCH WordSketch,
+    _In_z_ PCBYTE Word,
+    _Out_ PLONGLONG EstimatePointer
+    );
+typedef ESTIMATE_WORD_COUNT *PESTIMATE_WORD_COUNT;
+
+typedef
+_Check_return_
+_Success_(return != 0)
+BOOLEAN
+(NTAPI GET_WORD_SKETCH_HEAVY_HITTERS)(
+    _In_ PWORD_SKETCH WordSketch,
+    _In_ PALLOCATOR Allocator,
+    _Out_ PLINKED_WORD_LIST *LinkedWordListPointer
+    );
+typedef GET_WORD_SKETCH_HEAVY_HITTERS *PGET_WORD_SKETCH_HEAVY_HITTERS;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI DESTROY_WORD_SKETCH)(
+    _Inout_ PWORD_SKETCH *WordSketchPointer
+    );
+typedef DESTROY_WORD_SKETCH *PDESTROY_WORD_SKETCH;
+
+//
+// Recording and replay.  Once StartDictionaryRecording() has been called, each
+// AddWord(), RemoveWord(), FindWord() and GetWordAnagrams() call against the
+// dictionary appends a compact binary record (the operation, the word, a
+// timestamp and the calling thread's ID) to a memory-mapped file, until
+// StopDictionaryRecording() is called.  ReplayDictionaryRecording() re-executes
+// a recording against a dictionary, either single-threaded as fast as
+// possible, or with the original thread interleaving and/or timing.  The
+// replay may be directed at any implementation of the API (e.g. a different
+// build of this module) by supplying its function table.
+//
+
+typedef union _DICTIONARY_REPLAY_FLAGS {
+    struct {
+
+        //
+        // When set, one replay thread is created for each thread that appears
+        // in the recording, and the calls are started in the order they were
+        // recorded, each on the thread corresponding to the original caller.
+        // Otherwise, all calls are replayed in order on the calling thread.
+        //
+
+        ULONG PreserveThreadInterleaving:1;
+
+        //
+        // When set, each call is delayed until the same amount of time has
+        // elapsed since the start of the replay as had elapsed since the start
+        // of the recording when the call was originally made.
+        //
+
+        ULONG PreserveTiming:1;
+
+        //
+        // Unused bits.
+        //
+
+        ULONG Unused:30;
+    };
+    LONG AsLong;
+    ULONG AsULong;
+} DICTIONARY_REPLAY_FLAGS;
+C_ASSERT(sizeof(DICTIONARY_REPLAY_FLAGS) == sizeof(ULONG));
+typedef DICTIONARY_REPLAY_FLAGS *PDICTIONARY_REPLAY_FLAGS;
+
+typedef struct _DICTIONARY_REPLAY_STATS {
+
+    //
+    // Number of records replayed, broken down by operation.
+    //
+
+    ULONGLONG NumberOfRecords;
+    ULONGLONG NumberOfAddWords;
+    ULONGLONG NumberOfRemoveWords;
+    ULONGLONG NumberOfFindWords;
+    ULONGLONG NumberOfGetWordAnagrams;
+
+    //
+    // Number of replayed calls that returned FALSE.
+    //
+
+    ULONGLONG NumberOfFailedCalls;
+
+    //
+    // Number of calls that weren't recorded because the file was full.
+    //
+
+    ULONGLONG NumberOfDroppedRecords;
+
+    //
+    // Number of threads used for the replay.
+    //
+
+    ULONG NumberOfThreads;
+    ULONG Padding;
+
+    //
+    // Duration of the original recording and of the replay.
+    //
+
+    ULONGLONG RecordedMicroseconds;
+    ULONGLONG ElapsedMicroseconds;
+
+} DICTIONARY_REPLAY_STATS;
+typedef DICTIONARY_REPLAY_STATS *PDICTIONARY_REPLAY_STATS;
+
+typedef
+_Check_return_
+_Success_(return != 0)
+BOOLEAN
+(NTAPI START_DICTIONARY_RECORDING)(
+    _In_ PDICTIONARY Dictionary,
+    _In_z_ PCWSTR Path,
+    _In_opt_ ULONGLONG MaximumSizeInBytes
+    );
+typedef START_DICTIONARY_RECORDING *PSTART_DICTIONARY_RECORDING;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI STOP_DICTIONARY_RECORDING)(
+    _In_ PDICTIONARY Dictionary,
+    _Out_opt_ PULONGLONG NumberOfRecordsPointer
+    );
+typedef STOP_DICTIONARY_RECORDING *PSTOP_DICTIONARY_RECORDING;
+
+struct _DICTIONARY_FUNCTIONS;
+
+typedef
+_Check_return_
+_Success_(return != 0)
+BOOLEAN
+(NTAPI REPLAY_DICTIONARY_RECORDING)(
+    _In_opt_ struct _DICTIONARY_FUNCTIONS *Api,
+    _In_ PDICTIONARY Dictionary,
+    _In_ PALLOCATOR Allocator,
+    _In_z_ PCWSTR Path,
+    _In_ DICTIONARY_REPLAY_FLAGS Flags,
+    _Out_ PDICTIONARY_REPLAY_STATS Stats
+    );
+typedef REPLAY_DICTIONARY_RECORDING *PREPLAY_DICTIONARY_RECORDING;
+
+//
+// Durability.  Once OpenDictionaryLog() has been called, every modification
+// of the dictionary (AddWord(), RemoveWord(), AddWordsFromText(), word counter
+// and word sketch flushes, ImportDictionary(), set operations targeting it,
+// and evictions) is appended to a write-ahead log, and (by default) the
+// call doesn't return until the log has been flushed to disk.  Concurrent
+// callers are committed in groups: a single flusher thread writes and flushes
+// everything logged since its last flush, such that the cost of each flush is
+// shared by every call in the group.
+//
+// CheckpointDictionary() writes a snapshot of the dictionary (in the format
+// produced by ExportDictionary()) along with the log position it reflects.
+// RecoverDictionary() loads the most recent snapshot into an empty dictionary
+// and replays the log records that follow it, after which the log can be
+// reopened with OpenDictionaryLog() to continue appending to it.
+//
+
+typedef union _DICTIONARY_LOG_FLAGS {
+    struct {
+
+        //
+        // When set, routines that modify the dictionary return as soon as
+        // the modification has been logged, without waiting for the log to
+        // be flushed.  A crash may lose the most recent operations, but never
+        // corrupts the log.
+        //
+
+        ULONG AsynchronousCommit:1;
+
+        //
+        // Unused bits.
+        //
+
+        ULONG Unused:31;
+    };
+    LONG AsLong;
+    ULONG AsULong;
+} DICTIONARY_LOG_FLAGS;
+C_ASSERT(sizeof(DICTIONARY_LOG_FLAGS) == sizeof(ULONG));
+typedef DICTIONARY_LOG_FLAGS *PDICTIONARY_LOG_FLAGS;
+
+typedef struct _DICTIONARY_LOG_STATS {
+
+    //
+    // Number of records appended to the log since it was opened.
+    //
+
+    ULONGLONG NumberOfRecords;
+
+    //
+    // Number of times the log was flushed, i.e. the number of groups the
+    // records were committed in.
+    //
+
+    ULONGLONG NumberOfFlushes;
+
+    //
+    // Number of bytes written to the log since it was opened.
+    //
+
+    ULONGLONG NumberOfBytesWritten;
+
+} DICTIONARY_LOG_STATS;
+typedef DICTIONARY_LOG_STATS *PDICTIONARY_LOG_STATS;
+
+typedef
+_Check_return_
+_Success_(return != 0)
+BOOLEAN
+(NTAPI OPEN_DICTIONARY_LOG)(
+    _In_ PDICTIONARY Dictionary,
+    _In_z_ PCWSTR Path,
+    _In_ DICTIONARY_LOG_FLAGS Flags
+    );
+typedef OPEN_DICTIONARY_LOG *POPEN_DICTIONARY_LOG;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI CLOSE_DICTIONARY_LOG)(
+    _In_ PDICTIONARY Dictionary,
+    _Out_opt_ PDICTIONARY_LOG_STATS Stats
+    );
+typedef CLOSE_DICTIONARY_LOG *PCLOSE_DICTIONARY_LOG;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI CHECKPOINT_DICTIONARY)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ PALLOCATOR Allocator,
+    _In_z_ PCWSTR SnapshotPath
+    );
+typedef CHECKPOINT_DICTIONARY *PCHECKPOINT_DICTIONARY;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI RECOVER_DICTIONARY)(
+    _In_ PDICTIONARY Dictionary,
+    _In_opt_z_ PCWSTR SnapshotPath,
+    _In_opt_z_ PCWSTR LogPath,
+    _Out_opt_ PULONGLONG NumberOfLogRecordsPointer
+    );
+typedef RECOVER_DICTIONARY *PRECOVER_DICTIONARY;
+
+//
+// Set operations.  Each routine combines the words of two source dictionaries
+// into a destination dictionary: MergeDictionaries() sums the entry counts of
+// words in either source, IntersectDictionaries() takes the lesser entry count
+// of words in both sources, and DiffDictionaries() subtracts the entry counts
+// of the right source from those of the left, keeping positive results.
+//
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI MERGE_DICTIONARIES)(
+    _In_ PDICTIONARY Destination,
+    _In_ PDICTIONARY Left,
+    _In_ PDICTIONARY Right
+    );
+typedef MERGE_DICTIONARIES *PMERGE_DICTIONARIES;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI INTERSECT_DICTIONARIES)(
+    _In_ PDICTIONARY Destination,
+    _In_ PDICTIONARY Left,
+    _In_ PDICTIONARY Right
+    );
+typedef INTERSECT_DICTIONARIES *PINTERSECT_DICTIONARIES;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI DIFF_DICTIONARIES)(
+    _In_ PDICTIONARY Destination,
+    _In_ PDICTIONARY Left,
+    _In_ PDICTIONARY Right
+    );
+typedef DIFF_DICTIONARIES *PDIFF_DICTIONARIES;
+
+//
+// Export and import.  ExportDictionary() serializes a dictionary's words and
+// their entry counts into a compact, block-based buffer, which can be loaded
+// into another dictionary via ImportDictionary().  Blocks are independently
+// decodable, so ranges of blocks can be imported concurrently.
+//
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI EXPORT_DICTIONARY)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ PALLOCATOR Allocator,
+    _Outptr_result_bytebuffer_(*SizeInBytesPointer) PVOID *BufferPointer,
+    _Out_ PULONGLONG SizeInBytesPointer,
+    _Out_opt_ PULONG NumberOfBlocksPointer
+    );
+typedef EXPORT_DICTIONARY *PEXPORT_DICTIONARY;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI IMPORT_DICTIONARY)(
+    _In_ PDICTIONARY Dictionary,
+    _In_reads_bytes_(SizeInBytes) PCVOID Buffer,
+    _In_ ULONGLONG SizeInBytes,
+    _In_ ULONG FirstBlock,
+    _In_ ULONG NumberOfBlocks,
+    _Out_opt_ PULONGLONG NumberOfWordsPointer
+    );
+typedef IMPORT_DICTIONARY *PIMPORT_DICTIONARY;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI GET_WORD_LENGTH_HISTOGRAM)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ PALLOCATOR Allocator,
+    _Out_ PWORD_LENGTH_HISTOGRAM *HistogramPointer
+    );
+typedef GET_WORD_LENGTH_HISTOGRAM *PGET_WORD_LENGTH_HISTOGRAM;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI ENUMERATE_WORDS_BY_LENGTH_RANGE)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ PALLOCATOR Allocator,
+    _In_ ULONG MinimumLength,
+    _In_ ULONG MaximumLength,
+    _Out_ PLINKED_WORD_LIST *LinkedWordListPointer
+    );
+typedef ENUMERATE_WORDS_BY_LENGTH_RANGE *PENUMERATE_WORDS_BY_LENGTH_RANGE;
+
+//
+// Anagram class enumeration.  The callback returns TRUE to continue the
+// enumeration, or FALSE to stop it.
+//
+
+typedef
+BOOLEAN
+(NTAPI ANAGRAM_CLASS_CALLBACK)(
+    _In_opt_ PVOID Context,
+    _In_ PCANAGRAM_CLASS AnagramClass
+    );
+typedef ANAGRAM_CLASS_CALLBACK *PANAGRAM_CLASS_CALLBACK;
+
+typedef union _DICTIONARY_ANAGRAM_CLASS_FLAGS {
+    struct {
+
+        //
+        // When set, the dictionary is partitioned and the partitions are
+        // processed concurrently by threadpool workers.  The callback will
+        // be invoked concurrently from multiple threads, in no particular
+        // order, and must synchronize access to any shared state itself.
+        //
+
+        ULONG Parallel:1;
+
+        //
+        // Unused bits.
+        //
+
+        ULONG Unused:31;
+    };
+    LONG AsLong;
+    ULONG AsULong;
+} DICTIONARY_ANAGRAM_CLASS_FLAGS;
+typedef DICTIONARY_ANAGRAM_CLASS_FLAGS *PDICTIONARY_ANAGRAM_CLASS_FLAGS;
+C_ASSERT(sizeof(DICTIONARY_ANAGRAM_CLASS_FLAGS) == sizeof(ULONG));
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI ENUMERATE_ANAGRAM_CLASSES)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ ULONG MinimumNumberOfWords,
+    _In_ DICTIONARY_ANAGRAM_CLASS_FLAGS Flags,
+    _In_ PANAGRAM_CLASS_CALLBACK Callback,
+    _In_opt_ PVOID CallbackContext,
+    _Out_opt_ PULONGLONG NumberOfClassesPointer
+    );
+typedef ENUMERATE_ANAGRAM_CLASSES *PENUMERATE_ANAGRAM_CLASSES;
+
+//
+// Dictionary service.  A single owner process hosts the dictionary and
+// serves requests from client processes on the same machine via a named
+// shared memory section.  Each client is given its own ring of request slots;
+// the owner processes outstanding requests in batches whenever it calls
+// ProcessDictionaryServiceRequests(), writing each response back into the
+// request's slot.  Clients may have multiple requests in flight.
+//
+
+#define DICTIONARY_SERVICE_MAXIMUM_WORD_LENGTH 4031
+
+typedef enum _DICTIONARY_SERVICE_REQUEST_TYPE {
+    DictionaryServiceNullRequest = 0,
+    DictionaryServiceFindWordRequest = 1,
+    DictionaryServiceAddWordRequest = 2,
+    DictionaryServiceGetWordAnagramsRequest = 3,
+    DictionaryServiceInvalidRequest = 4
+} DICTIONARY_SERVICE_REQUEST_TYPE;
+
+#define IsValidDictionaryServiceRequestType(Type)          \
+    ((Type) > DictionaryServiceNullRequest &&              \
+     (Type) < DictionaryServiceInvalidRequest)
+
+typedef struct _DICTIONARY_SERVICE_RESPONSE {
+
+    //
+    // TRUE if the owner's call to the underlying routine (i.e. FindWord(),
+    // AddWord() or GetWordAnagrams()) succeeded.
+    //
+
+    BOOLEAN Success;
+
+    //
+    // For find requests, indicates whether or not the word exists.
+    //
+
+    BOOLEAN Exists;
+
+    //
+    // For anagram requests, indicates whether or not the anagrams had to be
+    // truncated to fit within the request's slot.
+    //
+
+    BOOLEAN Truncated;
+
+    BOOLEAN Padding1;
+
+    //
+    // For anagram requests, the number of NULL-terminated strings pointed to
+    // by Words.
+    //
+
+    ULONG NumberOfWords;
+
+    //
+    // For add requests, the word's entry count after the addition.
+    //
+
+    LONGLONG EntryCount;
+
+    //
+    // For anagram requests, points to NumberOfWords consecutive NULL-terminated
+    // strings within the client's ring.  The strings remain valid until the
+    // request's slot is reused by a subsequent request.
+    //
+
+    PCBYTE Words;
+
+} DICTIONARY_SERVICE_RESPONSE;
+typedef DICTIONARY_SERVICE_RESPONSE *PDICTIONARY_SERVICE_RESPONSE;
+
+typedef
+_Check_return_
+_Success_(return != 0)
+BOOLEAN
+(NTAPI CREATE_DICTIONARY_SERVICE)(
+    _In_ PDICTIONARY Dictionary,
+    _In_z_ PCWSTR Name,
+    _In_ ULONG NumberOfClients,
+    _In_opt_ ULONG NumberOfSlots,
+    _Outptr_result_nullonfailure_ PDICTIONARY_SERVICE *ServicePointer
+    );
+typedef CREATE_DICTIONARY_SERVICE *PCREATE_DICTIONARY_SERVICE;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI PROCESS_DICTIONARY_SERVICE_REQUESTS)(
+    _In_ PDICTIONARY_SERVICE Service,
+    _Out_opt_ PULONG NumberOfRequestsPointer
+    );
+typedef PROCESS_DICTIONARY_SERVICE_REQUESTS
+      *PPROCESS_DICTIONARY_SERVICE_REQUESTS;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI DESTROY_DICTIONARY_SERVICE)(
+    _Inout_ PDICTIONARY_SERVICE *ServicePointer
+    );
+typedef DESTROY_DICTIONARY_SERVICE *PDESTROY_DICTIONARY_SERVICE;
+
+typedef
+_Check_return_
+_Success_(return != 0)
+BOOLEAN
+(NTAPI OPEN_DICTIONARY_SERVICE_CLIENT)(
+    _In_ PALLOCATOR Allocator,
+    _In_z_ PCWSTR Name,
+    _Outptr_result_nullonfailure_ PDICTIONARY_SERVICE_CLIENT *ClientPointer
+    );
+typedef OPEN_DICTIONARY_SERVICE_CLIENT *POPEN_DICTIONARY_SERVICE_CLIENT;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI SUBMIT_DICTIONARY_SERVICE_REQUEST)(
+    _In_ PDICTIONARY_SERVICE_CLIENT Client,
+    _In_ DICTIONARY_SERVICE_REQUEST_TYPE RequestType,
+    _In_z_ PCBYTE Word,
+    _Out_ PULONGLONG SequencePointer
+    );
+typedef SUBMIT_DICTIONARY_SERVICE_REQUEST
+      *PSUBMIT_DICTIONARY_SERVICE_REQUEST;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI GET_DICTIONARY_SERVICE_RESPONSE)(
+    _In_ PDICTIONARY_SERVICE_CLIENT Client,
+    _In_ ULONGLONG Sequence,
+    _Out_ PDICTIONARY_SERVICE_RESPONSE Response
+    );
+typedef GET_DICTIONARY_SERVICE_RESPONSE *PGET_DICTIONARY_SERVICE_RESPONSE;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI CLOSE_DICTIONARY_SERVICE_CLIENT)(
+    _Inout_ PDICTIONARY_SERVICE_CLIENT *ClientPointer
+    );
+typedef CLOSE_DICTIONARY_SERVICE_CLIENT *PCLOSE_DICTIONARY_SERVICE_CLIENT;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI SET_DICTIONARY_BUDGET)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ ULONGLONG MaximumNumberOfWords,
+    _In_ ULONGLONG MaximumNumberOfBytes
+    );
+typedef SET_DICTIONARY_BUDGET *PSET_DICTIONARY_BUDGET;
+
 //
 // Helper functions (useful for unit tests).
 //
@@ -446,6 +1554,44 @@ typedef struct _DICTIONARY_FUNCTIONS {
     PGET_WORD_STATS GetWordStats;
     PGET_WORD_ANAGRAMS GetWordAnagrams;
     PGET_DICTIONARY_STATS GetDictionaryStats;
+    PGET_DICTIONARY_MEMORY_USAGE GetDictionaryMemoryUsage;
+    PCOMPACT_DICTIONARY CompactDictionary;
+    PFREEZE_DICTIONARY FreezeDictionary;
+    PGET_WORDS_WITH_PREFIX GetWordsWithPrefix;
+    PGET_SIMILAR_WORDS GetSimilarWords;
+    PADD_WORDS_FROM_TEXT AddWordsFromText;
+    PCREATE_WORD_COUNTER CreateWordCounter;
+    PCOUNT_WORD CountWord;
+    PFLUSH_WORD_COUNTER FlushWordCounter;
+    PDESTROY_WORD_COUNTER DestroyWordCounter;
+    PMERGE_DICTIONARIES MergeDictionaries;
+    PINTERSECT_DICTIONARIES IntersectDictionaries;
+    PDIFF_DICTIONARIES DiffDictionaries;
+    PEXPORT_DICTIONARY ExportDictionary;
+    PIMPORT_DICTIONARY ImportDictionary;
+    PGET_WORD_LENGTH_HISTOGRAM GetWordLengthHistogram;
+    PENUMERATE_WORDS_BY_LENGTH_RANGE EnumerateWordsByLengthRange;
+    PENUMERATE_ANAGRAM_CLASSES EnumerateAnagramClasses;
+    PCREATE_DICTIONARY_SERVICE CreateDictionaryService;
+    PPROCESS_DICTIONARY_SERVICE_REQUESTS ProcessDictionaryServiceRequests;
+    PDESTROY_DICTIONARY_SERVICE DestroyDictionaryService;
+    POPEN_DICTIONARY_SERVICE_CLIENT OpenDictionaryServiceClient;
+    PSUBMIT_DICTIONARY_SERVICE_REQUEST SubmitDictionaryServiceRequest;
+    PGET_DICTIONARY_SERVICE_RESPONSE GetDictionaryServiceResponse;
+    PCLOSE_DICTIONARY_SERVICE_CLIENT CloseDictionaryServiceClient;
+    PSET_DICTIONARY_BUDGET SetDictionaryBudget;
+    PCREATE_WORD_SKETCH CreateWordSketch;
+    PCOUNT_WORDS_IN_SKETCH CountWordsInSketch;
+    PESTIMATE_WORD_COUNT EstimateWordCount;
+    PGET_WORD_SKETCH_HEAVY_HITTERS GetWordSketchHeavyHitters;
+    PDESTROY_WORD_SKETCH DestroyWordSketch;
+    PSTART_DICTIONARY_RECORDING StartDictionaryRecording;
+    PSTOP_DICTIONARY_RECORDING StopDictionaryRecording;
+    PREPLAY_DICTIONARY_RECORDING ReplayDictionaryRecording;
+    POPEN_DICTIONARY_LOG OpenDictionaryLog;
+    PCLOSE_DICTIONARY_LOG CloseDictionaryLog;
+    PCHECKPOINT_DICTIONARY CheckpointDictionary;
+    PRECOVER_DICTIONARY RecoverDictionary;
 
     //
     // Helpers.
@@ -514,6 +1660,44 @@ LoadDictionaryModule(
         "GetWordStats",
         "GetWordAnagrams",
         "GetDictionaryStats",
+        "GetDictionaryMemoryUsage",
+        "CompactDictionary",
+        "FreezeDictionary",
+        "GetWordsWithPrefix",
+        "GetSimilarWords",
+        "AddWordsFromText",
+        "CreateWordCounter",
+        "CountWord",
+        "FlushWordCounter",
+        "DestroyWordCounter",
+        "MergeDictionaries",
+        "IntersectDictionaries",
+        "DiffDictionaries",
+        "ExportDictionary",
+        "ImportDictionary",
+        "GetWordLengthHistogram",
+        "EnumerateWordsByLengthRange",
+        "EnumerateAnagramClasses",
+        "CreateDictionaryService",
+        "ProcessDictionaryServiceRequests",
+        "DestroyDictionaryService",
+        "OpenDictionaryServiceClient",
+        "SubmitDictionaryServiceRequest",
+        "GetDictionaryServiceResponse",
+        "CloseDictionaryServiceClient",
+        "SetDictionaryBudget",
+        "CreateWordSketch",
+        "CountWordsInSketch",
+        "EstimateWordCount",
+        "GetWordSketchHeavyHitters",
+        "DestroyWordSketch",
+        "StartDictionaryRecording",
+        "StopDictionaryRecording",
+        "ReplayDictionaryRecording",
+        "OpenDictionaryLog",
+        "CloseDictionaryLog",
+        "CheckpointDictionary",
+        "RecoverDictionary",
 
         "CompareWords",
         "SetMinimumWordLength",
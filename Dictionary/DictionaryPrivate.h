@@ -69,6 +69,106 @@ C_ASSERT(sizeof(CHARACTER_BITMAP) == 32);
 typedef CHARACTER_BITMAP *PCHARACTER_BITMAP;
 typedef const CHARACTER_BITMAP *PCCHARACTER_BITMAP;
 
+//
+// Define the packed character histogram.  The vast majority of dictionary
+// words consist solely of the lowercase letters a-z, for which a full
+// CHARACTER_HISTOGRAM (256 ULONG counts spanning 16 cache lines) is overkill.
+// Such words are instead represented by 8-bit counts for each letter, packed
+// into a single 32-byte YMM register.  Words containing any other byte, or
+// that are too long for their counts to be guaranteed to fit in 8 bits, fall
+// back to the full histogram.
+//
+// The histogram hash is calculated over the non-zero counts only, in order of
+// character value, such that a word hashes identically regardless of which
+// histogram represents it.  Thus, hashes remain comparable between builds
+// (and dictionaries) with and without packed histograms.
+//
+// Packed histograms may be disabled at compile time (e.g. for benchmarking)
+// by defining DICTIONARY_PACKED_HISTOGRAMS to 0.
+//
+
+#ifndef DICTIONARY_PACKED_HISTOGRAMS
+#define DICTIONARY_PACKED_HISTOGRAMS 1
+#endif
+
+#define PACKED_HISTOGRAM_FIRST_CHARACTER 'a'
+#define PACKED_HISTOGRAM_NUMBER_OF_CHARACTERS 26
+#define PACKED_HISTOGRAM_MAXIMUM_LENGTH 255
+
+//
+// The bitmap bits for the alphabet all reside within a single LONG.
+//
+
+#define PACKED_HISTOGRAM_BITMAP_INDEX (PACKED_HISTOGRAM_FIRST_CHARACTER >> 5)
+#define PACKED_HISTOGRAM_BITMAP_SHIFT (PACKED_HISTOGRAM_FIRST_CHARACTER & 31)
+
+C_ASSERT(PACKED_HISTOGRAM_BITMAP_SHIFT +
+         PACKED_HISTOGRAM_NUMBER_OF_CHARACTERS <= 32);
+
+typedef union DECLSPEC_ALIGN(32) _PACKED_CHARACTER_HISTOGRAM {
+    YMMWORD Ymm;
+    BYTE Counts[32];
+} PACKED_CHARACTER_HISTOGRAM;
+C_ASSERT(sizeof(PACKED_CHARACTER_HISTOGRAM) == 32);
+typedef PACKED_CHARACTER_HISTOGRAM *PPACKED_CHARACTER_HISTOGRAM;
+typedef const PACKED_CHARACTER_HISTOGRAM *PCPACKED_CHARACTER_HISTOGRAM;
+
+//
+// Define the sparse character histogram.  A byte-indexed histogram treats each
+// byte of a multi-byte UTF-8 character as an unrelated character, such that
+// words whose bytes are permutations of each other (but whose characters are
+// not) would be considered anagrams.  Words containing non-ASCII bytes that
+// are valid UTF-8 are instead represented by a histogram of (codepoint, count)
+// pairs, sorted by codepoint.  Each pair is packed into a ULONG with the
+// codepoint in the upper 21 bits, such that the pairs sort identically to
+// their codepoints, and two histograms can be compared 8 pairs at a time with
+// AVX2.  Unused pairs are zero up to the next multiple of 8.
+//
+// Words that aren't valid UTF-8, or that have too many distinct characters or
+// too many occurrences of a single character, fall back to the full (byte)
+// histogram.
+//
+// Sparse histograms may be disabled at compile time by defining the symbol
+// DICTIONARY_UTF8_HISTOGRAMS to 0.
+//
+
+#ifndef DICTIONARY_UTF8_HISTOGRAMS
+#define DICTIONARY_UTF8_HISTOGRAMS 1
+#endif
+
+#define SPARSE_HISTOGRAM_MAXIMUM_NUMBER_OF_ENTRIES 64
+#define SPARSE_HISTOGRAM_MAXIMUM_COUNT ((1 << 11) - 1)
+#define SPARSE_HISTOGRAM_ENTRIES_PER_YMMWORD (sizeof(YMMWORD) / sizeof(ULONG))
+
+#define UNICODE_MAXIMUM_CODEPOINT 0x10FFFF
+#define UNICODE_FIRST_SURROGATE 0xD800
+#define UNICODE_LAST_SURROGATE 0xDFFF
+
+typedef union _SPARSE_HISTOGRAM_ENTRY {
+    struct {
+        ULONG Count:11;
+        ULONG Codepoint:21;
+    };
+    ULONG AsULong;
+} SPARSE_HISTOGRAM_ENTRY;
+C_ASSERT(sizeof(SPARSE_HISTOGRAM_ENTRY) == sizeof(ULONG));
+typedef SPARSE_HISTOGRAM_ENTRY *PSPARSE_HISTOGRAM_ENTRY;
+
+typedef struct DECLSPEC_ALIGN(32) _SPARSE_CHARACTER_HISTOGRAM {
+    union {
+        YMMWORD Ymm[SPARSE_HISTOGRAM_MAXIMUM_NUMBER_OF_ENTRIES /
+                    SPARSE_HISTOGRAM_ENTRIES_PER_YMMWORD];
+        SPARSE_HISTOGRAM_ENTRY Entries[
+            SPARSE_HISTOGRAM_MAXIMUM_NUMBER_OF_ENTRIES
+        ];
+    };
+    ULONG NumberOfEntries;
+    ULONG Padding[7];
+} SPARSE_CHARACTER_HISTOGRAM;
+C_ASSERT(sizeof(SPARSE_CHARACTER_HISTOGRAM) == 288);
+typedef SPARSE_CHARACTER_HISTOGRAM *PSPARSE_CHARACTER_HISTOGRAM;
+typedef const SPARSE_CHARACTER_HISTOGRAM *PCSPARSE_CHARACTER_HISTOGRAM;
+
 typedef
 _Success_(return != 0)
 BOOLEAN
@@ -85,6 +185,23 @@ BOOLEAN
 typedef INITIALIZE_WORD *PINITIALIZE_WORD;
 extern INITIALIZE_WORD InitializeWord;
 
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI INITIALIZE_WORD_WITH_LENGTH)(
+    _In_reads_(Length) PCBYTE Word,
+    _In_ ULONG Length,
+    _In_ ULONG MinimumLength,
+    _In_ ULONG MaximumLength,
+    _Inout_ PLONG_STRING String,
+    _Out_ PCHARACTER_BITMAP Bitmap,
+    _Inout_ PCHARACTER_HISTOGRAM Histogram,
+    _Out_ PULONG BitmapHashPointer,
+    _Out_ PULONG HistogramHashPointer
+    );
+typedef INITIALIZE_WORD_WITH_LENGTH *PINITIALIZE_WORD_WITH_LENGTH;
+extern INITIALIZE_WORD_WITH_LENGTH InitializeWordWithLength;
+
 typedef
 RTL_GENERIC_COMPARE_RESULTS
 (NTAPI COMPARE_WORDS)(
@@ -177,8 +294,15 @@ typedef struct _LENGTH_TABLE {
 } LENGTH_TABLE;
 typedef LENGTH_TABLE *PLENGTH_TABLE;
 
+//
+// Each length table entry links together all of the words of its length, and
+// tracks how many there are, such that length distribution queries can be
+// answered without walking the lists.
+//
+
 typedef struct _LENGTH_TABLE_ENTRY {
     LIST_ENTRY LengthListHead;
+    ULONGLONG NumberOfWords;
 } LENGTH_TABLE_ENTRY;
 typedef LENGTH_TABLE_ENTRY *PLENGTH_TABLE_ENTRY;
 
@@ -194,11 +318,33 @@ typedef struct _WORD_TABLE {
 } WORD_TABLE;
 typedef WORD_TABLE *PWORD_TABLE;
 
+//
+// Short words are stored within the word table entry itself, via the trailing
+// InlineString field, rather than in a separate buffer allocated by the word
+// allocator.  This saves an allocation per word, and means comparing a word
+// against the entry doesn't need to touch a second cache line.  A word is
+// stored inline if it fits in the field along with its trailing NULL; the
+// IsInlineString bit of the owning node's header indicates which storage is
+// in use.  (The owning node is either the word table entry's node, or the
+// histogram table entry's node for an inline word.)
+//
+// N.B. Inline string buffers move with their node; anything that relocates a
+//      node (e.g. ConvertInlineWordToWordTable() or CompactDictionary()) must
+//      point the string's buffer at the new node's InlineString field.
+//
+
+#define WORD_TABLE_ENTRY_INLINE_STRING_SIZE 24
+
 typedef struct _WORD_TABLE_ENTRY {
     WORD_ENTRY WordEntry;
     LIST_ENTRY LengthListEntry;
+    BYTE InlineString[WORD_TABLE_ENTRY_INLINE_STRING_SIZE];
 } WORD_TABLE_ENTRY;
 typedef WORD_TABLE_ENTRY *PWORD_TABLE_ENTRY;
+C_ASSERT(sizeof(WORD_TABLE_ENTRY) == 72);
+
+#define IsInlineStringLength(Length) \
+    ((Length) < WORD_TABLE_ENTRY_INLINE_STRING_SIZE)
 
 //
 // Define the histogram table.  This is the second tier of the dictionary's
@@ -218,14 +364,35 @@ typedef struct _HISTOGRAM_TABLE {
 typedef HISTOGRAM_TABLE *PHISTOGRAM_TABLE;
 
 //
-// Each histogram table entry embeds another AVL table of word entries.
+// Each histogram table entry embeds another AVL table of word entries.  The
+// vast majority of histograms only ever have a single word associated with
+// them (i.e. the word has no anagrams), so, as an optimization, the first word
+// added to a histogram is stored inline within the entry, using the space that
+// would otherwise be occupied by the word table.  This avoids a word table node
+// allocation (and the AVL table initialization) until a second word with the
+// same histogram hash arrives, at which point the inline word is converted to
+// a word table entry by ConvertInlineWordToWordTable().  The HasInlineWord bit
+// of the histogram table entry's header indicates which representation is in
+// use.
+//
+// N.B. Word tables are not collapsed back to an inline word if removals leave
+//      only one word remaining.
 //
 
 typedef struct _HISTOGRAM_TABLE_ENTRY {
-    WORD_TABLE WordTable;
+    union {
+        WORD_TABLE WordTable;
+        WORD_TABLE_ENTRY InlineWordTableEntry;
+    };
 } HISTOGRAM_TABLE_ENTRY;
 typedef HISTOGRAM_TABLE_ENTRY *PHISTOGRAM_TABLE_ENTRY;
 
+//
+// An inline word (and its inline string) must not grow the histogram entry.
+//
+
+C_ASSERT(sizeof(WORD_TABLE_ENTRY) <= sizeof(WORD_TABLE));
+
 //
 // Define the bitmap table.  Each bitmap table entry embeds another AVL table
 // of histogram entries.
@@ -271,7 +438,54 @@ typedef struct _TABLE_ENTRY_HEADER {
 
                 struct {
                     ULONG BalanceBits:8;
-                    ULONG ReservedBits:24;
+
+                    //
+                    // When set, indicates the histogram table entry is storing
+                    // its only word inline via the InlineWordTableEntry field
+                    // instead of a word table.  Only applicable to histogram
+                    // table entries.
+                    //
+
+                    ULONG HasInlineWord:1;
+
+                    //
+                    // When set, indicates this node was relocated into a
+                    // compaction arena chunk by CompactDictionary(), rather
+                    // than being allocated by the table's allocator.  The
+                    // ArenaOffset field captures the offset of the node from
+                    // the start of the owning chunk in 16-byte units.
+                    //
+
+                    ULONG IsArenaNode:1;
+
+                    //
+                    // When set, indicates the string buffer of the word owned
+                    // by this node (either the word table entry itself, or the
+                    // inline word of a histogram table entry) also lives in
+                    // the node's arena chunk.  Only valid if IsArenaNode is
+                    // set.
+                    //
+
+                    ULONG IsArenaString:1;
+
+                    ULONG ArenaOffset:18;
+
+                    //
+                    // When set, indicates the string buffer of the word owned
+                    // by this node lives in the InlineString field of the
+                    // node's word table entry.  Mutually exclusive with the
+                    // IsArenaString bit.
+                    //
+
+                    ULONG IsInlineString:1;
+
+                    //
+                    // Saturating CLOCK reference counter for the word owned
+                    // by this node, used to select eviction victims when the
+                    // dictionary has a budget.  See Evict.c.
+                    //
+
+                    ULONG ClockCount:2;
                 };
 
             };
@@ -335,259 +549,1720 @@ C_ASSERT(FIELD_OFFSET(TABLE_ENTRY_HEADER, UserData) == 32);
     ))
 
 //
-// Define the anagram word list structure used to link anagrams together.
-// This is identical to the LINKED_WORD_LIST public structure with the addition
-// of a bitmap and histogram plus respective hashes at the end of the structure.
+// Helper macro for determining the size of an AVL node for a given table
+// entry type.  The AVL routines allocate the RTL_BALANCED_LINKS structure
+// (which our TABLE_ENTRY_HEADER overlays) followed by the user data.
 //
 
+#define TABLE_NODE_SIZE(Name) (                           \
+    (ULONG)(FIELD_OFFSET(TABLE_ENTRY_HEADER, UserData) +  \
+            sizeof(Name##_TABLE_ENTRY))                   \
+)
 
-typedef struct _ANAGRAM_LIST {
+//
+// Helper macro for determining whether or not a histogram table entry has an
+// inline word.
+//
 
-    union {
+#define HistogramTableEntryHasInlineWord(Entry) \
+    (TABLE_ENTRY_TO_HEADER(Entry)->HasInlineWord)
 
-        //
-        // Inline LINKED_WORD_LIST structure.
-        //
+//
+// Helper macro for obtaining the header of the node that owns a word table
+// entry.  Inline words live at the start of their histogram table entry, so
+// the header preceding an inline word is the histogram entry's header, which
+// means this is the same calculation for both kinds of word.
+//
 
-        struct {
-            LONGLONG NumberOfEntries;
-            LIST_ENTRY ListHead;
-        };
+C_ASSERT(FIELD_OFFSET(HISTOGRAM_TABLE_ENTRY, InlineWordTableEntry) == 0);
 
-        LINKED_WORD_LIST LinkedWordList;
-    };
+#define WORD_TABLE_ENTRY_TO_OWNER_HEADER(Entry) TABLE_ENTRY_TO_HEADER(Entry)
 
-    //
-    // Pointer to the word table entry for which anagrams are being collected.
-    //
+//
+// Maximum value of the saturating ClockCount field of TABLE_ENTRY_HEADER.
+//
 
-    PWORD_TABLE_ENTRY WordTableEntry;
+#define DICTIONARY_MAXIMUM_CLOCK_COUNT 3
+
+//
+// Define the compaction arena chunk structure.  CompactDictionary() relocates
+// table nodes and their string buffers into chunks that are allocated from
+// the dictionary's allocator.  Each chunk tracks the number of live objects
+// (nodes and strings) it contains; when that count reaches zero (i.e. all of
+// the nodes have been removed or relocated again), the chunk is freed.
+//
+// The owning chunk of an arena node is located via the ArenaOffset field of
+// the node's TABLE_ENTRY_HEADER, which limits chunks to 4MB.
+//
+
+typedef struct DECLSPEC_ALIGN(16) _DICTIONARY_ARENA_CHUNK {
 
     //
-    // Hashes for the bitmap and histogram.
+    // Size of the chunk, in bytes, including this header.
     //
 
-    ULONG BitmapHash;
-    ULONG HistogramHash;
+    ULONG SizeInBytes;
 
     //
-    // The actual bitmap and histogram for this word table entry.
+    // Number of live objects (nodes and string buffers) within the chunk.
     //
 
-    CHARACTER_BITMAP Bitmap;
+    LONG ReferenceCount;
 
-    CHARACTER_HISTOGRAM Histogram;
+    ULONGLONG Unused;
 
-} ANAGRAM_LIST;
-typedef ANAGRAM_LIST *PANAGRAM_LIST;
+} DICTIONARY_ARENA_CHUNK;
+C_ASSERT(sizeof(DICTIONARY_ARENA_CHUNK) == 16);
+typedef DICTIONARY_ARENA_CHUNK *PDICTIONARY_ARENA_CHUNK;
 
+#define DICTIONARY_ARENA_OFFSET_SHIFT 4
+#define DICTIONARY_ARENA_ALIGNMENT (1 << DICTIONARY_ARENA_OFFSET_SHIFT)
+#define DICTIONARY_ARENA_MAXIMUM_CHUNK_SIZE (1 << (18 + 4))
+
+#define TABLE_ENTRY_HEADER_TO_ARENA_CHUNK(Header)                      \
+    ((PDICTIONARY_ARENA_CHUNK)(                                        \
+        RtlOffsetFromPointer(                                          \
+            Header,                                                    \
+            (ULONG_PTR)(Header)->ArenaOffset <<                        \
+                DICTIONARY_ARENA_OFFSET_SHIFT                          \
+        )                                                              \
+    ))
 
 //
-// The default dictionary minimum and maximum word lengths are 1 byte and
-// 1MB, respectively.  There's an absolute maximum word length of 16MB, which
-// has to do with the fact that our histogram character count is limited to
-// 24-bits during hashing (as the 8-bit index forms the rest of the ULONG).
-// See comment below regarding the HASH structure for more information.
-//
-// Technically, this could be relaxed, the only impact would be the potential
-// for more hash collisions.
+// Helper routine for obtaining the arena chunk of the string buffer owned by
+// a table entry header, if applicable.
 //
 
-#define MINIMUM_WORD_LENGTH          (1      )  //  1 byte
-#define MAXIMUM_WORD_LENGTH          (1 << 20)  //  1 MB (1048576 bytes)
-#define ABSOLUTE_MAXIMUM_WORD_LENGTH (1 << 24)  // 16 MB (16777216 bytes)
+FORCEINLINE
+PDICTIONARY_ARENA_CHUNK
+WordStringArenaChunk(
+    _In_ PTABLE_ENTRY_HEADER OwnerHeader
+    )
+{
+    if (!OwnerHeader->IsArenaString) {
+        return NULL;
+    }
+
+    ASSERT(OwnerHeader->IsArenaNode);
+    return TABLE_ENTRY_HEADER_TO_ARENA_CHUNK(OwnerHeader);
+}
 
 //
-// Define the helper union used for capturing index and value as a 32-bit
-// representation that can be passed into our hashing function.  As bitmaps
-// and histograms will frequently have values of 0 (because the character has
-// never been seen), including the ordinal of the character in the value being
-// hashed ensures we're not hashing 0 over and over (which in the case of our
-// currently implementation that uses CRC32, would have no effect on the hash).
+// Define the frozen dictionary structures.  FreezeDictionary() converts the
+// AVL table cascade into a single read-only allocation consisting of sorted
+// arrays laid out in Eytzinger (BFS) order, which allows lookups to descend
+// the implicit tree without branching on the comparison result, and to
+// prefetch the cache line holding the great-grandchildren of the current
+// node ahead of time.
+//
+// The bitmap and histogram tiers are collapsed into a single array of 64-bit
+// keys (the bitmap hash in the upper half, the histogram hash in the lower
+// half); as histogram hashes are unique within a bitmap table entry, the key
+// is unique across the dictionary.  Each key has a corresponding histogram
+// entry, which refers to a contiguous segment of the word arrays.  Each word
+// segment is itself laid out in Eytzinger order, keyed by the string hash.
+//
+// The histogram arrays are 1-based (element 0 is unused).  For a word segment,
+// Eytzinger index k (1-based) lives at element FirstWord + k - 1.
 //
 
-typedef union _HASH {
-    struct {
-        ULONG Value:24;
-        ULONG Index:8;
-    };
+typedef struct _FROZEN_HISTOGRAM_ENTRY {
 
-    LONG AsLong;
-    ULONG AsULong;
-} HASH;
-typedef HASH *PHASH;
+    //
+    // Index of the first word in the word arrays belonging to this histogram.
+    //
 
-//
-// Define the main DICTIONARY structure and supporting flags.
-//
+    ULONG FirstWord;
 
-typedef union _DICTIONARY_FLAGS {
-    struct _Struct_size_bytes_(sizeof(ULONG)) {
+    //
+    // Number of words with this histogram (i.e. potential anagrams).
+    //
 
-        //
-        // Unused bits.
-        //
+    ULONG NumberOfWords;
 
-        ULONG Unused:32;
-    };
+} FROZEN_HISTOGRAM_ENTRY;
+typedef FROZEN_HISTOGRAM_ENTRY *PFROZEN_HISTOGRAM_ENTRY;
+typedef const FROZEN_HISTOGRAM_ENTRY *PCFROZEN_HISTOGRAM_ENTRY;
 
-    LONG AsLong;
-    ULONG AsULong;
-} DICTIONARY_FLAGS;
-typedef DICTIONARY_FLAGS *PDICTIONARY_FLAGS;
+#define FROZEN_HISTOGRAM_KEY(BitmapHash, HistogramHash) \
+    (((ULONGLONG)(BitmapHash) << 32) | (ULONGLONG)(HistogramHash))
 
+#define FROZEN_CACHE_LINE_SIZE 64
 
-typedef struct _Struct_size_bytes_(SizeOfStruct) _DICTIONARY {
+//
+// The length table is also released when a dictionary is frozen.  In its
+// place, the frozen dictionary captures an array of word indices ordered by
+// word length, plus an array of the distinct word lengths in ascending order,
+// each of which refers to the contiguous range of the index array holding the
+// words of that length.
+//
+
+typedef struct _FROZEN_LENGTH_ENTRY {
 
     //
-    // Reserve a slot for a vtable.  Currently unused.
+    // Word length, in bytes.
     //
 
-    PPVOID Vtbl;
+    ULONG Length;
 
     //
-    // Size of the structure, in bytes.
+    // Index of the first element in the length-ordered word index array for
+    // this length, and the number of words with this length.
     //
 
-    _Field_range_(==, sizeof(struct _DICTIONARY)) ULONG SizeOfStruct;
+    ULONG FirstWord;
+    ULONG NumberOfWords;
+
+} FROZEN_LENGTH_ENTRY;
+typedef FROZEN_LENGTH_ENTRY *PFROZEN_LENGTH_ENTRY;
+typedef const FROZEN_LENGTH_ENTRY *PCFROZEN_LENGTH_ENTRY;
+
+typedef struct _FROZEN_DICTIONARY {
 
     //
-    // Dictionary flags.
+    // Size of the entire allocation backing the frozen dictionary, in bytes.
+    // This structure lives at the start of the allocation.
     //
 
-    DICTIONARY_FLAGS Flags;
+    ULONGLONG SizeInBytes;
 
     //
-    // Minimum and maximum word lengths, in bytes.
+    // Number of bytes used by word string buffers (including NULLs).
     //
 
-    ULONG MinimumWordLength;
-    ULONG MaximumWordLength;
+    ULONGLONG NumberOfStringBytes;
 
     //
-    // Counters to track any length or histogram collisions.  Currently only
-    // used for information and debugging purposes.  Set by GetWordAnagrams().
+    // Number of histogram entries and words.
     //
 
-    ULONG LengthCollisions;
-    ULONG HistogramCollisions;
+    ULONG NumberOfHistograms;
+    ULONG NumberOfWords;
 
     //
-    // Pointer to an initialized RTL structure.
+    // Eytzinger-ordered histogram keys and their corresponding entries.  The
+    // keys array is aligned on a cache line boundary.
     //
 
-    PRTL Rtl;
+    PULONGLONG HistogramKeys;
+    PFROZEN_HISTOGRAM_ENTRY HistogramEntries;
 
     //
-    // Pointer to an initialized ALLOCATOR structure.
+    // Word string hashes and word entries, ordered by histogram segment, and
+    // then in Eytzinger order within each segment.  The string buffers of the
+    // word entries follow the arrays, in the same order.
     //
 
-    PALLOCATOR Allocator;
+    PULONG WordHashes;
+    PWORD_ENTRY WordEntries;
 
     //
-    // Pointers to individual table allocators.
+    // Distinct word lengths in ascending order and the length-ordered word
+    // index array (see FROZEN_LENGTH_ENTRY).
     //
 
-    PALLOCATOR BitmapTableAllocator;
-    PALLOCATOR HistogramTableAllocator;
-    PALLOCATOR WordTableAllocator;
-    PALLOCATOR LengthTableAllocator;
+    ULONG NumberOfLengths;
+    ULONG Padding;
+
+    PFROZEN_LENGTH_ENTRY LengthEntries;
+    PULONG LengthOrderedWords;
+
+} FROZEN_DICTIONARY;
+typedef FROZEN_DICTIONARY *PFROZEN_DICTIONARY;
+
+//
+// Define the NUMA replica structure.  If a dictionary is created with the
+// UseNumaReplicas flag, FreezeDictionary() copies the frozen representation
+// into memory local to each NUMA node.  As frozen dictionaries are immutable,
+// the replicas never need to be synchronized.  A processor to node map is
+// captured at the same time, allowing readers to resolve their local replica
+// without any system calls.
+//
+
+typedef struct _DICTIONARY_NUMA_REPLICAS {
 
     //
-    // Pointer to word allocator (used for word copy operations).
+    // Highest NUMA node number on the system; the Replicas array has this
+    // many elements plus one.
     //
 
-    PALLOCATOR WordAllocator;
+    ULONG HighestNodeNumber;
 
     //
-    // Capture current longest and all-time longest word entries via the stats
-    // structure.
+    // Number of replicas successfully created.
     //
 
-    DICTIONARY_STATS Stats;
+    ULONG NumberOfReplicas;
 
     //
-    // A slim read/writer lock guarding the dictionary.
+    // Number of elements in the ProcessorNodeNumbers array (i.e. the number
+    // of active processor groups multiplied by MAXIMUM_PROC_PER_GROUP).
     //
 
-    DICTIONARY_LOCK Lock;
+    ULONG NumberOfProcessorSlots;
+
+    ULONG Padding;
 
     //
-    // Top-level bitmap table.
+    // Total number of bytes used by replicas.
     //
 
-    BITMAP_TABLE BitmapTable;
+    ULONGLONG NumberOfReplicaBytes;
 
     //
-    // Top-level word length table.
+    // Array of NUMA node numbers indexed by (Group * MAXIMUM_PROC_PER_GROUP)
+    // plus the processor number within the group.  Unknown processors have a
+    // node number of MAXUSHORT.
     //
 
-    LENGTH_TABLE LengthTable;
+    PUSHORT ProcessorNodeNumbers;
 
-} DICTIONARY;
-typedef DICTIONARY *PDICTIONARY;
+    //
+    // Array of replicas indexed by node number.  If a replica couldn't be
+    // allocated on a node, the corresponding element will be NULL, and
+    // readers on that node will use the primary frozen dictionary.
+    //
+
+    PFROZEN_DICTIONARY *Replicas;
+
+} DICTIONARY_NUMA_REPLICAS;
+typedef DICTIONARY_NUMA_REPLICAS *PDICTIONARY_NUMA_REPLICAS;
 
 //
-// Function typedefs for the AVL table's compare, allocate and free routines.
+// Define the prefix index structures.  If a dictionary is created with the
+// MaintainPrefixIndex flag, every word is also inserted into a byte-wise trie
+// that is kept up-to-date by AddWordEntry() and RemoveWord().  Each node
+// captures the entry count of the word ending at that node (if any), and the
+// maximum entry count of any word in the node's subtree.  The latter allows
+// GetWordsWithPrefix() to perform a best-first search that visits words in
+// descending order of frequency, stopping once the requested number of words
+// have been found, rather than enumerating every word with the prefix.
+//
+// Child nodes are tracked by a sorted array of bytes and a parallel array of
+// pointers, which lives in a single allocation that grows as children are
+// added (4, 8, 16 ... 256 slots).  The pointers come first, followed by the
+// bytes; see PREFIX_NODE_CHILD_BYTES().
+//
+// The trie doesn't reference the dictionary's table entries or string buffers
+// (the path from the root to a node spells out the word), so it's unaffected
+// by compaction, inline word conversion, or freezing.
 //
 
-typedef
-RTL_GENERIC_COMPARE_RESULTS
-(NTAPI AVL_TABLE_COMPARE_ROUTINE)(
-    _In_ struct _RTL_AVL_TABLE *Table,
-    _In_ PVOID FirstStruct,
-    _In_ PVOID SecondStruct
-    );
-typedef AVL_TABLE_COMPARE_ROUTINE *PAVL_TABLE_COMPARE_ROUTINE;
+typedef struct _PREFIX_NODE {
 
-typedef
-PVOID
-(NTAPI AVL_TABLE_ALLOCATE_ROUTINE)(
-    _In_ struct _RTL_AVL_TABLE *Table,
-    _In_ CLONG ByteSize
-    );
-typedef AVL_TABLE_ALLOCATE_ROUTINE *PAVL_TABLE_ALLOCATE_ROUTINE;
+    //
+    // Pointer to the parent node.  NULL for the root.
+    //
 
-typedef
-VOID
-(NTAPI AVL_TABLE_FREE_ROUTINE)(
-    _In_ struct _RTL_AVL_TABLE *Table,
-    _In_ __drv_freesMem(Buffer) _Post_invalid_ PVOID Buffer
-    );
-typedef AVL_TABLE_FREE_ROUTINE *PAVL_TABLE_FREE_ROUTINE;
+    struct _PREFIX_NODE *Parent;
 
-//
-// Forward declarations for the bitmap and histogram AVL table functions.
-//
+    //
+    // Pointer to the child pointer array (followed by the child byte array),
+    // or NULL if the node has never had children.
+    //
 
-AVL_TABLE_COMPARE_ROUTINE BitmapTableCompareRoutine;
-AVL_TABLE_ALLOCATE_ROUTINE BitmapTableAllocateRoutine;
-AVL_TABLE_FREE_ROUTINE BitmapTableFreeRoutine;
+    struct _PREFIX_NODE **Children;
 
-AVL_TABLE_COMPARE_ROUTINE HistogramTableCompareRoutine;
-AVL_TABLE_ALLOCATE_ROUTINE HistogramTableAllocateRoutine;
-AVL_TABLE_FREE_ROUTINE HistogramTableFreeRoutine;
+    //
+    // Statistics of the word ending at this node.  The entry count will be 0
+    // if there is no such word (i.e. this node is only a prefix of others).
+    //
 
-AVL_TABLE_COMPARE_ROUTINE WordTableCompareRoutine;
-AVL_TABLE_ALLOCATE_ROUTINE WordTableAllocateRoutine;
-AVL_TABLE_FREE_ROUTINE WordTableFreeRoutine;
+    WORD_STATS Stats;
 
-AVL_TABLE_COMPARE_ROUTINE LengthTableCompareRoutine;
-AVL_TABLE_ALLOCATE_ROUTINE LengthTableAllocateRoutine;
-AVL_TABLE_FREE_ROUTINE LengthTableFreeRoutine;
+    //
+    // Maximum entry count of any word in this node's subtree, including the
+    // node itself.
+    //
 
-//
-// TLS-related structures and functions.
-//
+    LONGLONG MaximumSubtreeEntryCount;
 
-typedef struct _DICTIONARY_CONTEXT {
-    PDICTIONARY Dictionary;
-    PVOID TableEntry;
-    PTABLE_ENTRY_HEADER TableEntryHeader;
-    PWORD_TABLE WordTable;
-    PWORD_ENTRY WordEntry;
-    PCLONG_STRING String;
-    PWORD_TABLE_ENTRY WordTableEntry;
+    //
+    // Number of bytes from the root to this node; equivalent to the length of
+    // the word (or prefix) represented by the node.
+    //
+
+    ULONG Depth;
+
+    //
+    // Hash of the word ending at this node, if applicable.
+    //
+
+    ULONG Hash;
+
+    //
+    // Number of children, and the number of slots in the child arrays.
+    //
+
+    USHORT NumberOfChildren;
+    USHORT ChildCapacity;
+
+    //
+    // The byte value of the edge from the parent to this node.
+    //
+
+    BYTE Byte;
+
+    BYTE Padding[3];
+
+} PREFIX_NODE;
+typedef PREFIX_NODE *PPREFIX_NODE;
+typedef const PREFIX_NODE *PCPREFIX_NODE;
+C_ASSERT(sizeof(PREFIX_NODE) == 56);
+
+#define PREFIX_NODE_CHILD_BYTES(Node) \
+    ((PBYTE)((Node)->Children + (Node)->ChildCapacity))
+
+#define PREFIX_NODE_MINIMUM_CHILD_CAPACITY 4
+#define PREFIX_NODE_MAXIMUM_CHILD_CAPACITY 256
+
+typedef struct _PREFIX_INDEX {
+
+    //
+    // Number of nodes in the trie (excluding the root), and the total number
+    // of bytes consumed by them and their child arrays.
+    //
+
+    ULONGLONG NumberOfNodes;
+    ULONGLONG NumberOfBytes;
+
+    //
+    // The root node, representing the empty prefix.
+    //
+
+    PREFIX_NODE Root;
+
+} PREFIX_INDEX;
+typedef PREFIX_INDEX *PPREFIX_INDEX;
+
+//
+// Define the word counter structures.  A word counter is owned by a single
+// thread, and counts words locally in an open-addressing hash table (linear
+// probing, at most half full) without acquiring the dictionary's lock.  The
+// local counts are added to the dictionary by FlushWordCounter(), which takes
+// the exclusive lock once per batch, and applies the entries in order of their
+// bitmap and histogram hashes (i.e. the order of the bitmap and histogram
+// tables), such that consecutive insertions traverse neighboring paths.
+//
+// Each entry's word is copied into the counter's string buffer.  A slot is
+// empty if its buffer is NULL.  Entries applied by a flush that subsequently
+// failed have their count set to 0, and are skipped by the next flush.
+//
+
+typedef struct _WORD_COUNTER_ENTRY {
+
+    //
+    // The word.  The buffer points to a NULL-terminated copy of the word in
+    // the counter's string buffer.
+    //
+
+    LONG_STRING String;
+
+    //
+    // Hashes of the word's bitmap and histogram.
+    //
+
+    ULONG BitmapHash;
+    ULONG HistogramHash;
+
+    //
+    // Number of occurrences of the word counted since it was last flushed.
+    //
+
+    LONGLONG Count;
+
+} WORD_COUNTER_ENTRY;
+typedef WORD_COUNTER_ENTRY *PWORD_COUNTER_ENTRY;
+typedef const WORD_COUNTER_ENTRY *PCWORD_COUNTER_ENTRY;
+C_ASSERT(sizeof(WORD_COUNTER_ENTRY) == 32);
+
+#define WORD_COUNTER_DEFAULT_NUMBER_OF_SLOTS 4096
+#define WORD_COUNTER_MINIMUM_NUMBER_OF_SLOTS 16
+#define WORD_COUNTER_STRING_BYTES_PER_ENTRY 16
+
+typedef struct _WORD_COUNTER {
+
+    //
+    // The dictionary to which the counts are flushed, and the allocator used
+    // for the counter.
+    //
+
+    PDICTIONARY Dictionary;
+    PALLOCATOR Allocator;
+
+    //
+    // Number of slots in the table (a power of 2), the number of occupied
+    // slots, and the number of occupied slots that triggers a flush.
+    //
+
+    ULONG NumberOfSlots;
+    ULONG NumberOfEntries;
+    ULONG MaximumNumberOfEntries;
+    ULONG Padding;
+
+    //
+    // Size of the string buffer and the number of bytes used.
+    //
+
+    ULONGLONG StringBufferSize;
+    ULONGLONG StringBytesUsed;
+
+    //
+    // Number of successful flushes.
+    //
+
+    ULONGLONG NumberOfFlushes;
+
+    //
+    // The table, an array of MaximumNumberOfEntries pointers used to sort the
+    // entries for flushing, and the string buffer.  All three live in the same
+    // allocation as this structure.
+    //
+
+    PWORD_COUNTER_ENTRY Entries;
+    PWORD_COUNTER_ENTRY *SortedEntries;
+    PBYTE StringBuffer;
+
+} WORD_COUNTER;
+
+//
+// Define the word sketch structures.  The count-min sketch has a fixed depth
+// of 8 rows, such that the counter indices for a word can be derived from its
+// string hash in a single YMM register: row i uses the multiply-shift hash of
+// (Hash + i * Step), where Step is a second, odd hash derived from the first
+// via CRC32.  Counters are 32-bit, incremented with interlocked operations and
+// saturate at MAXULONG.  A word's estimate is the minimum of its 8 counters,
+// which is obtained via a single AVX2 gather.
+//
+// Heavy hitters are tracked in a small array guarded by a slim read/writer
+// lock.  A word is only considered for the array (and the lock is only
+// acquired) while the array has free entries, or when the word's estimate
+// exceeds the smallest estimate in the array (sampled every 8th occurrence).
+// Only words of up to WORD_SKETCH_MAXIMUM_HEAVY_HITTER_LENGTH bytes are
+// tracked as heavy hitters; longer words are still counted by the sketch.
+//
+
+#define WORD_SKETCH_DEPTH 8
+#define WORD_SKETCH_DEFAULT_WIDTH (1 << 16)
+#define WORD_SKETCH_MINIMUM_WIDTH (1 << 8)
+#define WORD_SKETCH_MAXIMUM_WIDTH (1 << 24)
+#define WORD_SKETCH_DEFAULT_NUMBER_OF_HEAVY_HITTERS 64
+#define WORD_SKETCH_MAXIMUM_NUMBER_OF_HEAVY_HITTERS 4096
+#define WORD_SKETCH_MAXIMUM_HEAVY_HITTER_LENGTH 47
+#define WORD_SKETCH_HEAVY_HITTER_SAMPLE_MASK 7
+#define WORD_SKETCH_BATCH_SIZE 64
+#define WORD_SKETCH_STEP_SEED 0x5bd1e995
+#define WORD_SKETCH_MULTIPLIER 0x9e3779b1
+
+typedef struct _WORD_SKETCH_HEAVY_HITTER {
+
+    //
+    // Length and string hash of the word.
+    //
+
+    ULONG Length;
+    ULONG Hash;
+
+    //
+    // Estimated count of the word when it was last updated.  (Estimates are
+    // refreshed from the sketch when heavy hitters are replaced or queried.)
+    //
+
+    ULONG Estimate;
+    ULONG Padding;
+
+    //
+    // NULL-terminated copy of the word.
+    //
+
+    BYTE Buffer[WORD_SKETCH_MAXIMUM_HEAVY_HITTER_LENGTH + 1];
+
+} WORD_SKETCH_HEAVY_HITTER;
+typedef WORD_SKETCH_HEAVY_HITTER *PWORD_SKETCH_HEAVY_HITTER;
+C_ASSERT(sizeof(WORD_SKETCH_HEAVY_HITTER) == 64);
+
+typedef struct _WORD_SKETCH {
+
+    //
+    // The dictionary to which words are promoted (optional), the promotion
+    // threshold, and the allocator used for the sketch.
+    //
+
+    PDICTIONARY Dictionary;
+    LONGLONG PromotionThreshold;
+    PALLOCATOR Allocator;
+
+    //
+    // Number of counters per row (a power of 2), and its base 2 logarithm.
+    //
+
+    ULONG Width;
+    ULONG WidthShift;
+
+    //
+    // Total number of words counted, and the number of words that have been
+    // promoted to the dictionary.
+    //
+
+    volatile LONGLONG NumberOfWords;
+    volatile LONGLONG NumberOfPromotions;
+
+    //
+    // Heavy hitter state.  The lock guards the array; the number of entries
+    // and minimum estimate are also read without the lock as a filter.
+    //
+
+    DICTIONARY_LOCK HeavyHitterLock;
+    volatile ULONG NumberOfHeavyHitters;
+    volatile ULONG MinimumHeavyHitterEstimate;
+    ULONG MaximumNumberOfHeavyHitters;
+    ULONG Padding;
+
+    //
+    // The heavy hitter array and the counters (WORD_SKETCH_DEPTH rows of
+    // Width counters), which live in the same allocation as this structure.
+    //
+
+    PWORD_SKETCH_HEAVY_HITTER HeavyHitters;
+    PULONG Counters;
+
+} WORD_SKETCH;
+
+//
+// Define the dictionary export format produced by ExportDictionary() and
+// consumed by ImportDictionary().  All fields are little-endian.
+//
+// The export starts with a DICTIONARY_EXPORT_HEADER, followed by an array of
+// ULONGLONG block offsets (relative to the start of the header), followed by
+// the blocks.  Words are stored in lexicographic byte order, at most
+// DICTIONARY_EXPORT_WORDS_PER_BLOCK per block.
+//
+// Each block starts with a DICTIONARY_EXPORT_BLOCK_HEADER, followed by one
+// record per word.  A record consists of the following values, each encoded
+// as an unsigned LEB128 variable-length integer (7 bits per byte, low bits
+// first, high bit set on all but the last byte):
+//
+//      1. The number of leading bytes shared with the previous word in the
+//         block (i.e. front coding).  Always 0 for the first word of a block,
+//         such that every block can be decoded independently.
+//
+//      2. The number of remaining (suffix) bytes.  The suffix bytes follow.
+//
+//      3. The word's entry count.
+//
+//      4. The word's maximum entry count less its entry count.
+//
+
+#define DICTIONARY_EXPORT_SIGNATURE 0x54584944 // 'DIXT'
+#define DICTIONARY_EXPORT_VERSION 1
+#define DICTIONARY_EXPORT_WORDS_PER_BLOCK 1024
+#define DICTIONARY_EXPORT_MAXIMUM_VARINT_SIZE 10
+
+typedef struct _DICTIONARY_EXPORT_HEADER {
+
+    //
+    // DICTIONARY_EXPORT_SIGNATURE and DICTIONARY_EXPORT_VERSION.
+    //
+
+    ULONG Signature;
+    USHORT Version;
+
+    //
+    // Size of this structure, in bytes.
+    //
+
+    USHORT SizeOfHeader;
+
+    //
+    // Total size of the export, in bytes, including this header.
+    //
+
+    ULONGLONG SizeInBytes;
+
+    //
+    // Number of words and blocks.
+    //
+
+    ULONGLONG NumberOfWords;
+    ULONG NumberOfBlocks;
+
+    //
+    // Length of the longest word in the export.
+    //
+
+    ULONG LongestWordLength;
+
+} DICTIONARY_EXPORT_HEADER;
+typedef DICTIONARY_EXPORT_HEADER *PDICTIONARY_EXPORT_HEADER;
+typedef const DICTIONARY_EXPORT_HEADER *PCDICTIONARY_EXPORT_HEADER;
+C_ASSERT(sizeof(DICTIONARY_EXPORT_HEADER) == 32);
+
+typedef struct _DICTIONARY_EXPORT_BLOCK_HEADER {
+
+    //
+    // Size of the block, in bytes, including this header.
+    //
+
+    ULONG SizeInBytes;
+
+    //
+    // Number of words in the block.
+    //
+
+    ULONG NumberOfWords;
+
+    //
+    // CRC32 of the block's records (i.e. the bytes following this header).
+    //
+
+    ULONG Checksum;
+
+    ULONG Padding;
+
+} DICTIONARY_EXPORT_BLOCK_HEADER;
+typedef DICTIONARY_EXPORT_BLOCK_HEADER *PDICTIONARY_EXPORT_BLOCK_HEADER;
+typedef const DICTIONARY_EXPORT_BLOCK_HEADER
+    *PCDICTIONARY_EXPORT_BLOCK_HEADER;
+C_ASSERT(sizeof(DICTIONARY_EXPORT_BLOCK_HEADER) == 16);
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI EXPORT_DICTIONARY_EX)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ PALLOCATOR Allocator,
+    _Outptr_result_bytebuffer_(*SizeInBytesPointer) PVOID *BufferPointer,
+    _Out_ PULONGLONG SizeInBytesPointer,
+    _Out_opt_ PULONG NumberOfBlocksPointer,
+    _Out_opt_ PULONGLONG LogSequencePointer
+    );
+typedef EXPORT_DICTIONARY_EX *PEXPORT_DICTIONARY_EX;
+extern EXPORT_DICTIONARY_EX ExportDictionaryEx;
+extern IMPORT_DICTIONARY ImportDictionary;
+
+//
+// Define the shared memory layout used by the dictionary service.  The owner
+// process creates a named section consisting of a DICTIONARY_SERVICE_HEADER
+// followed by one DICTIONARY_SERVICE_RING per client.  Each ring is a single
+// producer, single consumer queue of fixed-size slots: the client writes a
+// request into the slot at SubmittedIndex and then advances SubmittedIndex;
+// the owner processes every slot between CompletedIndex and SubmittedIndex,
+// writes each result back into the request's slot, and then advances
+// CompletedIndex once for the whole batch.  The two indices live on separate
+// cache lines, and each is only ever written by one side.
+//
+// N.B. The owner treats everything in a ring as untrusted; request types and
+//      lengths are validated before use.
+//
+
+#define DICTIONARY_SERVICE_SIGNATURE 0x56524553 // 'SERV'
+#define DICTIONARY_SERVICE_VERSION 1
+#define DICTIONARY_SERVICE_DEFAULT_NUMBER_OF_SLOTS 64
+#define DICTIONARY_SERVICE_MAXIMUM_NUMBER_OF_SLOTS 4096
+#define DICTIONARY_SERVICE_MAXIMUM_NUMBER_OF_CLIENTS 256
+#define DICTIONARY_SERVICE_SLOT_SIZE 4096
+#define DICTIONARY_SERVICE_SLOT_HEADER_SIZE 64
+#define DICTIONARY_SERVICE_SLOT_DATA_SIZE (   \
+    DICTIONARY_SERVICE_SLOT_SIZE -            \
+    DICTIONARY_SERVICE_SLOT_HEADER_SIZE       \
+)
+
+C_ASSERT(
+    DICTIONARY_SERVICE_MAXIMUM_WORD_LENGTH <
+    DICTIONARY_SERVICE_SLOT_DATA_SIZE
+);
+
+typedef struct _DICTIONARY_SERVICE_HEADER {
+
+    //
+    // DICTIONARY_SERVICE_SIGNATURE and DICTIONARY_SERVICE_VERSION.
+    //
+
+    ULONG Signature;
+    USHORT Version;
+
+    //
+    // Size of this structure, in bytes.
+    //
+
+    USHORT SizeOfHeader;
+
+    //
+    // Number of rings (one per client) and the number of slots per ring (a
+    // power of 2).
+    //
+
+    ULONG NumberOfClients;
+    ULONG NumberOfSlots;
+
+    //
+    // Size of each ring, in bytes, and the size of the entire section.
+    //
+
+    ULONGLONG SizeOfRing;
+    ULONGLONG SizeOfSection;
+
+    //
+    // Process ID of the owner.
+    //
+
+    ULONG OwnerProcessId;
+
+    //
+    // Set by the owner when the service is destroyed.
+    //
+
+    volatile LONG IsShuttingDown;
+
+    BYTE Padding[16];
+
+} DICTIONARY_SERVICE_HEADER;
+typedef DICTIONARY_SERVICE_HEADER *PDICTIONARY_SERVICE_HEADER;
+C_ASSERT(sizeof(DICTIONARY_SERVICE_HEADER) == 64);
+
+typedef struct _DICTIONARY_SERVICE_SLOT {
+
+    //
+    // The request, written by the client.  The word (including its trailing
+    // NULL) is written to Data.
+    //
+
+    ULONG RequestType;
+    ULONG Length;
+
+    //
+    // The response, written by the owner.  For anagram requests, the
+    // anagrams are written to Data as consecutive NULL-terminated strings.
+    //
+
+    BOOLEAN Success;
+    BOOLEAN Exists;
+    BOOLEAN Truncated;
+    BOOLEAN Padding1;
+    ULONG NumberOfWords;
+    LONGLONG EntryCount;
+
+    BYTE Padding2[40];
+
+    BYTE Data[DICTIONARY_SERVICE_SLOT_DATA_SIZE];
+
+} DICTIONARY_SERVICE_SLOT;
+typedef DICTIONARY_SERVICE_SLOT *PDICTIONARY_SERVICE_SLOT;
+C_ASSERT(FIELD_OFFSET(DICTIONARY_SERVICE_SLOT, Data) ==
+         DICTIONARY_SERVICE_SLOT_HEADER_SIZE);
+C_ASSERT(sizeof(DICTIONARY_SERVICE_SLOT) == DICTIONARY_SERVICE_SLOT_SIZE);
+
+typedef struct _DICTIONARY_SERVICE_RING {
+
+    //
+    // Non-zero whilst a client has claimed the ring.
+    //
+
+    volatile LONG IsClaimed;
+    ULONG ClientProcessId;
+    BYTE Padding1[56];
+
+    //
+    // Sequence number of the next request to be submitted.  Only written by
+    // the client.
+    //
+
+    volatile ULONGLONG SubmittedIndex;
+    BYTE Padding2[56];
+
+    //
+    // Sequence number of the next request to be completed.  Only written by
+    // the owner.
+    //
+
+    volatile ULONGLONG CompletedIndex;
+    BYTE Padding3[56];
+
+    //
+    // Slots.  The slot for a given sequence number is (Sequence & (Number of
+    // slots - 1)).
+    //
+
+    DICTIONARY_SERVICE_SLOT Slots[ANYSIZE_ARRAY];
+
+} DICTIONARY_SERVICE_RING;
+typedef DICTIONARY_SERVICE_RING *PDICTIONARY_SERVICE_RING;
+C_ASSERT(FIELD_OFFSET(DICTIONARY_SERVICE_RING, Slots) == 192);
+
+#define DICTIONARY_SERVICE_RING_SIZE(NumberOfSlots) (                     \
+    FIELD_OFFSET(DICTIONARY_SERVICE_RING, Slots) +                        \
+    ((ULONGLONG)(NumberOfSlots) * sizeof(DICTIONARY_SERVICE_SLOT))        \
+)
+
+#define DICTIONARY_SERVICE_SECTION_SIZE(NumberOfClients, NumberOfSlots) ( \
+    sizeof(DICTIONARY_SERVICE_HEADER) +                                   \
+    ((ULONGLONG)(NumberOfClients) *                                       \
+     DICTIONARY_SERVICE_RING_SIZE(NumberOfSlots))                         \
+)
+
+//
+// N.B. The ring size is passed explicitly rather than read from the header,
+//      as the header lives in memory that any client can write to.
+//
+
+#define DICTIONARY_SERVICE_RING_AT(Header, Index, SizeOfRing) (           \
+    (PDICTIONARY_SERVICE_RING)RtlOffsetToPointer(                         \
+        (Header),                                                         \
+        sizeof(DICTIONARY_SERVICE_HEADER) +                               \
+        ((ULONGLONG)(Index) * (SizeOfRing))                               \
+    )                                                                     \
+)
+
+//
+// Define the owner and client structures.  These live in the private memory
+// of their respective processes.
+//
+
+typedef struct _DICTIONARY_SERVICE {
+
+    PDICTIONARY Dictionary;
+    PALLOCATOR Allocator;
+
+    //
+    // Section handle and the base address of the owner's view.
+    //
+
+    HANDLE SectionHandle;
+    PDICTIONARY_SERVICE_HEADER Header;
+
+    //
+    // Section geometry, as validated by CreateDictionaryService().  The copies
+    // in the header are informational only; they're never read back by the
+    // owner, as clients can overwrite them.
+    //
+
+    ULONG NumberOfClients;
+    ULONG NumberOfSlots;
+    ULONGLONG SizeOfRing;
+
+    //
+    // Number of requests processed, and the number of calls to
+    // ProcessDictionaryServiceRequests() that processed at least one.
+    //
+
+    ULONGLONG NumberOfRequests;
+    ULONGLONG NumberOfBatches;
+
+} DICTIONARY_SERVICE;
+
+typedef struct _DICTIONARY_SERVICE_CLIENT {
+
+    PALLOCATOR Allocator;
+
+    //
+    // Section handle and the base address of the client's view.
+    //
+
+    HANDLE SectionHandle;
+    PDICTIONARY_SERVICE_HEADER Header;
+
+    //
+    // The ring claimed by the client, and its index.
+    //
+
+    PDICTIONARY_SERVICE_RING Ring;
+    ULONG RingIndex;
+    ULONG NumberOfSlots;
+
+    //
+    // Sequence number to be assigned to the next request.
+    //
+
+    ULONGLONG NextSequence;
+
+} DICTIONARY_SERVICE_CLIENT;
+
+//
+// Public routines called by the service on behalf of its clients, and by
+// ReplayDictionaryRecording() when no function table is provided.
+//
+
+extern FIND_WORD FindWord;
+extern ADD_WORD AddWord;
+extern REMOVE_WORD RemoveWord;
+extern GET_WORD_ANAGRAMS GetWordAnagrams;
+
+//
+// Define the layout of a dictionary recording.  A recording is a file
+// consisting of a DICTIONARY_RECORDING_HEADER followed by variable-length
+// DICTIONARY_RECORD structures, one per recorded call.  Each record is followed
+// by the word's bytes and a terminating NULL (such that the word can be used
+// in place when replaying), and is padded to an 8-byte boundary.
+//
+// Space for a record is reserved with a single interlocked add to the header's
+// EndOffset, so any number of threads may record calls concurrently.  Records
+// are written whilst the dictionary's lock is held, thus, their order reflects
+// the order in which the calls acquired the lock, and stopping the recording
+// (which acquires the lock exclusively) never races with a record being
+// written.
+//
+// If the file fills up, subsequent records are dropped and counted.  The file
+// is zero-filled beyond the last record written, and a record with an
+// operation of zero terminates the recording.
+//
+
+#define DICTIONARY_RECORDING_SIGNATURE 0x43455244 // 'DREC'
+#define DICTIONARY_RECORDING_VERSION 1
+#define DICTIONARY_RECORDING_DEFAULT_SIZE (64 << 20)   // 64MB
+#define DICTIONARY_RECORDING_MINIMUM_SIZE (1 << 16)    // 64KB
+#define DICTIONARY_RECORD_ALIGNMENT 8
+#define DICTIONARY_REPLAY_MAXIMUM_NUMBER_OF_THREADS 64
+
+typedef enum _DICTIONARY_RECORD_OPERATION {
+    DictionaryRecordNullOperation = 0,
+    DictionaryRecordAddWordOperation,
+    DictionaryRecordRemoveWordOperation,
+    DictionaryRecordFindWordOperation,
+    DictionaryRecordGetWordAnagramsOperation,
+    DictionaryRecordInvalidOperation
+} DICTIONARY_RECORD_OPERATION;
+
+#define IsValidDictionaryRecordOperation(Operation) (      \
+    (Operation) > DictionaryRecordNullOperation &&          \
+    (Operation) < DictionaryRecordInvalidOperation          \
+)
+
+typedef struct _DICTIONARY_RECORDING_HEADER {
+
+    //
+    // DICTIONARY_RECORDING_SIGNATURE and DICTIONARY_RECORDING_VERSION.
+    //
+
+    ULONG Signature;
+    USHORT Version;
+
+    //
+    // Size of this structure, in bytes.
+    //
+
+    USHORT SizeOfHeader;
+
+    //
+    // Process ID of the recording process.
+    //
+
+    ULONG ProcessId;
+
+    //
+    // Set by StopDictionaryRecording() once the recording is complete.
+    //
+
+    volatile LONG IsComplete;
+
+    //
+    // Size of the file whilst recording, in bytes.
+    //
+
+    ULONGLONG SizeOfFile;
+
+    //
+    // Offset of the next record to be written.  This may exceed SizeOfFile if
+    // records have been dropped.
+    //
+
+    volatile LONGLONG EndOffset;
+
+    //
+    // Number of records written and dropped.  The former is only valid once
+    // the recording is complete.
+    //
+
+    ULONGLONG NumberOfRecords;
+    volatile LONGLONG NumberOfDroppedRecords;
+
+    //
+    // The performance counter frequency, and the performance counter and
+    // time stamp counter at the start and end of the recording.  Records are
+    // stamped with the time stamp counter (which is cheaper to read); these
+    // values allow them to be converted to elapsed time.
+    //
+
+    LARGE_INTEGER Frequency;
+    LARGE_INTEGER StartCounter;
+    LARGE_INTEGER EndCounter;
+    ULONGLONG StartTimestamp;
+    ULONGLONG EndTimestamp;
+
+    BYTE Padding[40];
+
+} DICTIONARY_RECORDING_HEADER;
+typedef DICTIONARY_RECORDING_HEADER *PDICTIONARY_RECORDING_HEADER;
+C_ASSERT(sizeof(DICTIONARY_RECORDING_HEADER) == 128);
+
+typedef struct _DICTIONARY_RECORD {
+    ULONGLONG Timestamp;
+    ULONG ThreadId;
+    USHORT Operation;
+    USHORT Padding;
+    ULONG Length;
+    ULONG SizeOfRecord;
+} DICTIONARY_RECORD;
+typedef DICTIONARY_RECORD *PDICTIONARY_RECORD;
+typedef const DICTIONARY_RECORD *PCDICTIONARY_RECORD;
+C_ASSERT(sizeof(DICTIONARY_RECORD) == 24);
+
+#define DICTIONARY_RECORD_WORD(Record) ((PBYTE)((Record) + 1))
+
+#define DICTIONARY_RECORD_SIZE(Length) (                     \
+    ALIGN_UP(sizeof(DICTIONARY_RECORD) + (Length) + 1,       \
+             DICTIONARY_RECORD_ALIGNMENT)                    \
+)
+
+typedef struct _DICTIONARY_RECORDER {
+
+    //
+    // File and section handles, and the base address of the view.
+    //
+
+    HANDLE FileHandle;
+    HANDLE SectionHandle;
+    PDICTIONARY_RECORDING_HEADER Header;
+
+} DICTIONARY_RECORDER;
+typedef DICTIONARY_RECORDER *PDICTIONARY_RECORDER;
+
+typedef
+VOID
+(NTAPI RECORD_DICTIONARY_OPERATION)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ DICTIONARY_RECORD_OPERATION Operation,
+    _In_z_ PCBYTE Word
+    );
+typedef RECORD_DICTIONARY_OPERATION *PRECORD_DICTIONARY_OPERATION;
+extern RECORD_DICTIONARY_OPERATION RecordDictionaryOperation;
+extern STOP_DICTIONARY_RECORDING StopDictionaryRecording;
+
+typedef
+DWORD
+(WINAPI DICTIONARY_REPLAY_THREAD_PROC)(
+    _In_ PVOID Parameter
+    );
+typedef DICTIONARY_REPLAY_THREAD_PROC *PDICTIONARY_REPLAY_THREAD_PROC;
+extern DICTIONARY_REPLAY_THREAD_PROC DictionaryReplayThreadProc;
+
+//
+// Define the layout of the write-ahead log.  The log file consists of a
+// DICTIONARY_LOG_HEADER followed by DICTIONARY_LOG_RECORD structures, each
+// followed by the word's bytes and a terminating NULL, padded to an 8-byte
+// boundary.  A record's sequence number is its offset within the file.
+//
+// Records are appended to an in-memory ring buffer whilst the dictionary's
+// exclusive lock is held: space is reserved with an interlocked add to
+// ReservedOffset, the record is copied in, and WrittenOffset is advanced past
+// it.  The flusher thread writes everything between DurableOffset and
+// WrittenOffset to the file, flushes it, and then advances DurableOffset and
+// wakes any callers waiting on it.  Each record carries a CRC32 of its
+// contents, so a record torn by a crash is detected (and discarded) on
+// recovery.
+//
+// Records are appended by AddWordEntry() (for every addition, including those
+// made by AddWordsFromText(), word counter flushes, ImportDictionary() and set
+// operations), RemoveWord() and EvictWordTableEntry(), such that every path
+// that modifies the dictionary is logged.  Routines that take the exclusive
+// lock to modify the dictionary bracket the modification with
+// BeginDictionaryLogOperation() and EndDictionaryLogOperation(), and call
+// WaitForDictionaryLog() once the lock has been released.
+//
+// A snapshot file written by CheckpointDictionary() consists of a
+// DICTIONARY_SNAPSHOT_HEADER followed by the output of ExportDictionary().
+// The header captures the identity of the log and the sequence number of the
+// first record not reflected in the export.
+//
+
+#define DICTIONARY_LOG_SIGNATURE 0x474f4c44 // 'DLOG'
+#define DICTIONARY_LOG_VERSION 2
+#define DICTIONARY_LOG_RECORD_ALIGNMENT 8
+#define DICTIONARY_SNAPSHOT_SIGNATURE 0x504e5344 // 'DSNP'
+#define DICTIONARY_SNAPSHOT_VERSION 1
+
+//
+// The ring buffer must be able to hold the largest possible record.
+//
+
+#define DICTIONARY_LOG_BUFFER_SIZE (1 << 25) // 32MB
+
+typedef enum _DICTIONARY_LOG_OPERATION {
+    DictionaryLogNullOperation = 0,
+    DictionaryLogAddWordOperation,
+    DictionaryLogRemoveWordOperation,
+    DictionaryLogEvictWordOperation,
+    DictionaryLogInvalidOperation
+} DICTIONARY_LOG_OPERATION;
+
+typedef struct _DICTIONARY_LOG_HEADER {
+    ULONG Signature;
+    USHORT Version;
+    USHORT SizeOfHeader;
+    ULONG Padding1;
+    ULONG Padding2;
+
+    //
+    // Uniquely identifies the log; snapshots are only applied to the log they
+    // were taken against.
+    //
+
+    ULONGLONG LogId;
+
+    BYTE Padding3[40];
+} DICTIONARY_LOG_HEADER;
+typedef DICTIONARY_LOG_HEADER *PDICTIONARY_LOG_HEADER;
+typedef const DICTIONARY_LOG_HEADER *PCDICTIONARY_LOG_HEADER;
+C_ASSERT(sizeof(DICTIONARY_LOG_HEADER) == 64);
+
+typedef struct _DICTIONARY_LOG_RECORD {
+    ULONGLONG Sequence;
+
+    //
+    // The number of occurrences added by an add operation.  This is 1 for
+    // AddWord() and AddWordsFromText(), and the word's count for word counter
+    // flushes, imports and set operations.  Always 1 for removals, which
+    // decrement the word's count, and 0 for evictions, which remove the word
+    // regardless of its count.
+    //
+
+    LONGLONG Increment;
+
+    ULONG Length;
+    USHORT Operation;
+    USHORT Padding;
+    ULONG SizeOfRecord;
+    ULONG Checksum;
+} DICTIONARY_LOG_RECORD;
+typedef DICTIONARY_LOG_RECORD *PDICTIONARY_LOG_RECORD;
+typedef const DICTIONARY_LOG_RECORD *PCDICTIONARY_LOG_RECORD;
+C_ASSERT(sizeof(DICTIONARY_LOG_RECORD) == 32);
+
+#define DICTIONARY_LOG_RECORD_SIZE(Length) (                 \
+    ALIGN_UP(sizeof(DICTIONARY_LOG_RECORD) + (Length) + 1,   \
+             DICTIONARY_LOG_RECORD_ALIGNMENT)                \
+)
+
+typedef struct _DICTIONARY_SNAPSHOT_HEADER {
+    ULONG Signature;
+    USHORT Version;
+    USHORT SizeOfHeader;
+    ULONG Padding1;
+    ULONG Padding2;
+    ULONGLONG LogId;
+    ULONGLONG LogSequence;
+    ULONGLONG SizeOfExport;
+} DICTIONARY_SNAPSHOT_HEADER;
+typedef DICTIONARY_SNAPSHOT_HEADER *PDICTIONARY_SNAPSHOT_HEADER;
+typedef const DICTIONARY_SNAPSHOT_HEADER *PCDICTIONARY_SNAPSHOT_HEADER;
+C_ASSERT(sizeof(DICTIONARY_SNAPSHOT_HEADER) == 40);
+
+typedef struct _DICTIONARY_LOG {
+
+    DICTIONARY_LOG_FLAGS Flags;
+
+    //
+    // Set if a write to the log file fails.  No further records are written,
+    // and callers waiting for durability are failed.
+    //
+
+    volatile LONG Failed;
+
+    HANDLE FileHandle;
+    HANDLE FlusherThreadHandle;
+    ULONGLONG LogId;
+
+    //
+    // Ring buffer of DICTIONARY_LOG_BUFFER_SIZE bytes.  The record at sequence
+    // number N lives at Buffer[N % DICTIONARY_LOG_BUFFER_SIZE].
+    //
+
+    PBYTE Buffer;
+
+    //
+    // Writer state.  Each offset lives on its own cache line, as they're
+    // written by different threads.
+    //
+
+    DECLSPEC_ALIGN(64) volatile LONGLONG ReservedOffset;
+    DECLSPEC_ALIGN(64) volatile LONGLONG WrittenOffset;
+    DECLSPEC_ALIGN(64) volatile LONGLONG DurableOffset;
+
+    //
+    // Number of callers that have captured the log via
+    // BeginDictionaryLogOperation() and not yet finished waiting for it via
+    // WaitForDictionaryLog().  CloseDictionaryLog() waits for this to reach
+    // zero.
+    //
+
+    volatile LONG NumberOfWaiters;
+
+    //
+    // Set by CloseDictionaryLog() once the flusher should exit.
+    //
+
+    volatile LONG Shutdown;
+
+    //
+    // Lock and condition variables used to wake the flusher and the callers
+    // waiting on it.
+    //
+
+    SRWLOCK WaitLock;
+    CONDITION_VARIABLE FlushNeeded;
+    CONDITION_VARIABLE FlushDone;
+
+    //
+    // Statistics.
+    //
+
+    volatile LONGLONG NumberOfRecords;
+    ULONGLONG NumberOfFlushes;
+    ULONGLONG NumberOfBytesWritten;
+
+} DICTIONARY_LOG;
+typedef DICTIONARY_LOG *PDICTIONARY_LOG;
+
+typedef
+ULONGLONG
+(NTAPI APPEND_DICTIONARY_LOG_RECORD)(
+    _In_ PDICTIONARY_LOG Log,
+    _In_ DICTIONARY_LOG_OPERATION Operation,
+    _In_reads_(Length) PCBYTE Word,
+    _In_ ULONG Length,
+    _In_ LONGLONG Increment
+    );
+typedef APPEND_DICTIONARY_LOG_RECORD *PAPPEND_DICTIONARY_LOG_RECORD;
+extern APPEND_DICTIONARY_LOG_RECORD AppendDictionaryLogRecord;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI WAIT_FOR_DICTIONARY_LOG)(
+    _In_ PDICTIONARY_LOG Log,
+    _In_ ULONGLONG Sequence
+    );
+typedef WAIT_FOR_DICTIONARY_LOG *PWAIT_FOR_DICTIONARY_LOG;
+extern WAIT_FOR_DICTIONARY_LOG WaitForDictionaryLog;
+
+typedef
+DWORD
+(WINAPI DICTIONARY_LOG_FLUSHER_THREAD_PROC)(
+    _In_ PVOID Parameter
+    );
+typedef DICTIONARY_LOG_FLUSHER_THREAD_PROC
+      *PDICTIONARY_LOG_FLUSHER_THREAD_PROC;
+extern DICTIONARY_LOG_FLUSHER_THREAD_PROC DictionaryLogFlusherThreadProc;
+
+extern CLOSE_DICTIONARY_LOG CloseDictionaryLog;
+
+//
+// Define the anagram word list structure used to link anagrams together.
+// This is identical to the LINKED_WORD_LIST public structure with the addition
+// of a bitmap and histogram plus respective hashes at the end of the structure.
+//
+
+
+typedef struct _ANAGRAM_LIST {
+
+    union {
+
+        //
+        // Inline LINKED_WORD_LIST structure.
+        //
+
+        struct {
+            LONGLONG NumberOfEntries;
+            LIST_ENTRY ListHead;
+        };
+
+        LINKED_WORD_LIST LinkedWordList;
+    };
+
+    //
+    // Pointer to the word table entry for which anagrams are being collected.
+    //
+
+    PWORD_TABLE_ENTRY WordTableEntry;
+
+    //
+    // Hashes for the bitmap and histogram.
+    //
+
+    ULONG BitmapHash;
+    ULONG HistogramHash;
+
+    //
+    // The actual bitmap and histogram for this word table entry.
+    //
+
+    CHARACTER_BITMAP Bitmap;
+
+    CHARACTER_HISTOGRAM Histogram;
+
+} ANAGRAM_LIST;
+typedef ANAGRAM_LIST *PANAGRAM_LIST;
+
+
+//
+// The default dictionary minimum and maximum word lengths are 1 byte and
+// 1MB, respectively.  There's an absolute maximum word length of 16MB, which
+// has to do with the fact that our histogram character count is limited to
+// 24-bits during hashing (as the 8-bit index forms the rest of the ULONG).
+// See comment below regarding the HASH structure for more information.
+//
+// Technically, this could be relaxed, the only impact would be the potential
+// for more hash collisions.
+//
+
+#define MINIMUM_WORD_LENGTH          (1      )  //  1 byte
+#define MAXIMUM_WORD_LENGTH          (1 << 20)  //  1 MB (1048576 bytes)
+#define ABSOLUTE_MAXIMUM_WORD_LENGTH (1 << 24)  // 16 MB (16777216 bytes)
+
+//
+// Define the helper union used for capturing index and value as a 32-bit
+// representation that can be passed into our hashing function.  As bitmaps
+// and histograms will frequently have values of 0 (because the character has
+// never been seen), including the ordinal of the character in the value being
+// hashed ensures we're not hashing 0 over and over (which in the case of our
+// currently implementation that uses CRC32, would have no effect on the hash).
+//
+
+typedef union _HASH {
+    struct {
+        ULONG Value:24;
+        ULONG Index:8;
+    };
+
+    LONG AsLong;
+    ULONG AsULong;
+} HASH;
+typedef HASH *PHASH;
+
+//
+// Define the tracking allocator structures used when a dictionary has been
+// created with the TrackMemoryUsage create flag.  Each tracking allocator is
+// a complete ALLOCATOR (so it can be used anywhere a PALLOCATOR is expected)
+// whose routines forward to the dictionary's underlying allocator, prefixing
+// each allocation with a small header that captures the allocation size such
+// that it can be accounted for when the memory is freed.
+//
+// N.B. All dictionary allocations occur with the dictionary lock held
+//      exclusively, so the counters aren't updated with interlocked ops.
+//
+
+typedef struct DECLSPEC_ALIGN(16) _DICTIONARY_ALLOCATION_HEADER {
+    ULONGLONG SizeInBytes;
+    ULONGLONG Unused;
+} DICTIONARY_ALLOCATION_HEADER;
+C_ASSERT(sizeof(DICTIONARY_ALLOCATION_HEADER) == 16);
+typedef DICTIONARY_ALLOCATION_HEADER *PDICTIONARY_ALLOCATION_HEADER;
+
+typedef struct _DICTIONARY_TRACKING_ALLOCATOR {
+
+    //
+    // Inline ALLOCATOR structure.  The Context field points back to this
+    // structure.
+    //
+
+    ALLOCATOR Allocator;
+
+    //
+    // Pointer to the underlying allocator that services the requests.
+    //
+
+    PALLOCATOR TargetAllocator;
+
+    //
+    // Usage counters.
+    //
+
+    DICTIONARY_ALLOCATOR_MEMORY_USAGE Usage;
+
+} DICTIONARY_TRACKING_ALLOCATOR;
+typedef DICTIONARY_TRACKING_ALLOCATOR *PDICTIONARY_TRACKING_ALLOCATOR;
+
+typedef struct _DICTIONARY_TRACKING_ALLOCATORS {
+    DICTIONARY_TRACKING_ALLOCATOR BitmapTable;
+    DICTIONARY_TRACKING_ALLOCATOR HistogramTable;
+    DICTIONARY_TRACKING_ALLOCATOR WordTable;
+    DICTIONARY_TRACKING_ALLOCATOR LengthTable;
+    DICTIONARY_TRACKING_ALLOCATOR Word;
+} DICTIONARY_TRACKING_ALLOCATORS;
+typedef DICTIONARY_TRACKING_ALLOCATORS *PDICTIONARY_TRACKING_ALLOCATORS;
+
+//
+// Define the main DICTIONARY structure and supporting flags.
+//
+
+typedef union _DICTIONARY_FLAGS {
+    struct _Struct_size_bytes_(sizeof(ULONG)) {
+
+        //
+        // When set, indicates a compaction pass is in progress; the next
+        // call to CompactDictionary() will resume from the bitmap hash
+        // captured in the dictionary's CompactionCursor field.
+        //
+
+        ULONG IsCompactionInProgress:1;
+
+        //
+        // When set, indicates the dictionary has been frozen by a call to
+        // FreezeDictionary().  The AVL tables will be empty, and all lookups
+        // are serviced by the structure pointed to by the Frozen field.  The
+        // dictionary can no longer be modified.
+        //
+
+        ULONG IsFrozen:1;
+
+        //
+        // When set, indicates the dictionary was created with the create flag
+        // UseNumaReplicas, and FreezeDictionary() should create replicas.
+        //
+
+        ULONG UseNumaReplicas:1;
+
+        //
+        // When set, indicates the dictionary was created with the create flag
+        // EnableEviction, and words may be evicted by EvictWords() when the
+        // budget set by SetDictionaryBudget() is exceeded.
+        //
+
+        ULONG IsEvictionEnabled:1;
+
+        //
+        // Unused bits.
+        //
+
+        ULONG Unused:28;
+    };
+
+    LONG AsLong;
+    ULONG AsULong;
+} DICTIONARY_FLAGS;
+typedef DICTIONARY_FLAGS *PDICTIONARY_FLAGS;
+
+
+typedef struct _Struct_size_bytes_(SizeOfStruct) _DICTIONARY {
+
+    //
+    // Reserve a slot for a vtable.  Currently unused.
+    //
+
+    PPVOID Vtbl;
+
+    //
+    // Size of the structure, in bytes.
+    //
+
+    _Field_range_(==, sizeof(struct _DICTIONARY)) ULONG SizeOfStruct;
+
+    //
+    // Dictionary flags.
+    //
+
+    DICTIONARY_FLAGS Flags;
+
+    //
+    // Minimum and maximum word lengths, in bytes.
+    //
+
+    ULONG MinimumWordLength;
+    ULONG MaximumWordLength;
+
+    //
+    // Counters to track any length or histogram collisions.  Currently only
+    // used for information and debugging purposes.  Set by GetWordAnagrams().
+    //
+
+    ULONG LengthCollisions;
+    ULONG HistogramCollisions;
+
+    //
+    // Pointer to an initialized RTL structure.
+    //
+
+    PRTL Rtl;
+
+    //
+    // Pointer to an initialized ALLOCATOR structure.
+    //
+
+    PALLOCATOR Allocator;
+
+    //
+    // Pointers to individual table allocators.
+    //
+
+    PALLOCATOR BitmapTableAllocator;
+    PALLOCATOR HistogramTableAllocator;
+    PALLOCATOR WordTableAllocator;
+    PALLOCATOR LengthTableAllocator;
+
+    //
+    // Pointer to word allocator (used for word copy operations).
+    //
+
+    PALLOCATOR WordAllocator;
+
+    //
+    // Pointer to the tracking allocators if the dictionary was created with
+    // the TrackMemoryUsage flag, NULL otherwise.  When present, the table and
+    // word allocator pointers above will point into this structure.
+    //
+
+    PDICTIONARY_TRACKING_ALLOCATORS TrackingAllocators;
+
+    //
+    // Compaction state.  The cursor captures the bitmap hash of the last
+    // bitmap table entry relocated by CompactDictionary().  The arena counters
+    // track the number of live compaction chunks and their total size.
+    //
+
+    ULONG CompactionCursor;
+    ULONG NumberOfArenaChunks;
+    ULONGLONG NumberOfArenaBytes;
+
+    //
+    // Pointer to the read-only representation of the dictionary if it has
+    // been frozen, NULL otherwise.
+    //
+
+    PFROZEN_DICTIONARY Frozen;
+
+    //
+    // Pointer to the NUMA replicas of the frozen dictionary, if applicable.
+    //
+
+    PDICTIONARY_NUMA_REPLICAS NumaReplicas;
+
+    //
+    // Pointer to the prefix index if the dictionary was created with the
+    // MaintainPrefixIndex flag, NULL otherwise.
+    //
+
+    PPREFIX_INDEX PrefixIndex;
+
+    //
+    // Eviction state.  NumberOfWords tracks the number of distinct words
+    // currently in the dictionary.  The budget fields are set by
+    // SetDictionaryBudget() (0 indicates no limit), and the clock hand fields
+    // capture the length table entry whose list is currently being swept by
+    // EvictWords() and the number of words in that list left to examine.  The
+    // clock hand entry is advanced by RemoveWordTableEntry() if it deletes
+    // the entry.
+    //
+
+    ULONGLONG NumberOfWords;
+    ULONGLONG MaximumNumberOfWords;
+    ULONGLONG MaximumNumberOfBytes;
+    ULONGLONG NumberOfEvictions;
+    PLENGTH_TABLE_ENTRY ClockHandEntry;
+    ULONG ClockHandRemaining;
+    ULONG Padding1;
+
+    //
+    // Pointer to the recorder if StartDictionaryRecording() has been called,
+    // NULL otherwise.  Only changed whilst the exclusive lock is held.
+    //
+
+    PDICTIONARY_RECORDER Recorder;
+
+    //
+    // Pointer to the write-ahead log if OpenDictionaryLog() has been called,
+    // NULL otherwise.  Only changed whilst the exclusive lock is held.
+    //
+
+    PDICTIONARY_LOG Log;
+
+    //
+    // Capture current longest and all-time longest word entries via the stats
+    // structure.
+    //
+
+    DICTIONARY_STATS Stats;
+
+    //
+    // A slim read/writer lock guarding the dictionary.
+    //
+
+    DICTIONARY_LOCK Lock;
+
+    //
+    // Top-level bitmap table.
+    //
+
+    BITMAP_TABLE BitmapTable;
+
+    //
+    // Top-level word length table.
+    //
+
+    LENGTH_TABLE LengthTable;
+
+} DICTIONARY;
+typedef DICTIONARY *PDICTIONARY;
+
+//
+// Function typedefs for the AVL table's compare, allocate and free routines.
+//
+
+typedef
+RTL_GENERIC_COMPARE_RESULTS
+(NTAPI AVL_TABLE_COMPARE_ROUTINE)(
+    _In_ struct _RTL_AVL_TABLE *Table,
+    _In_ PVOID FirstStruct,
+    _In_ PVOID SecondStruct
+    );
+typedef AVL_TABLE_COMPARE_ROUTINE *PAVL_TABLE_COMPARE_ROUTINE;
+
+typedef
+PVOID
+(NTAPI AVL_TABLE_ALLOCATE_ROUTINE)(
+    _In_ struct _RTL_AVL_TABLE *Table,
+    _In_ CLONG ByteSize
+    );
+typedef AVL_TABLE_ALLOCATE_ROUTINE *PAVL_TABLE_ALLOCATE_ROUTINE;
+
+typedef
+VOID
+(NTAPI AVL_TABLE_FREE_ROUTINE)(
+    _In_ struct _RTL_AVL_TABLE *Table,
+    _In_ __drv_freesMem(Buffer) _Post_invalid_ PVOID Buffer
+    );
+typedef AVL_TABLE_FREE_ROUTINE *PAVL_TABLE_FREE_ROUTINE;
+
+//
+// Forward declarations for the bitmap and histogram AVL table functions.
+//
+
+AVL_TABLE_COMPARE_ROUTINE BitmapTableCompareRoutine;
+AVL_TABLE_ALLOCATE_ROUTINE BitmapTableAllocateRoutine;
+AVL_TABLE_FREE_ROUTINE BitmapTableFreeRoutine;
+
+AVL_TABLE_COMPARE_ROUTINE HistogramTableCompareRoutine;
+AVL_TABLE_ALLOCATE_ROUTINE HistogramTableAllocateRoutine;
+AVL_TABLE_FREE_ROUTINE HistogramTableFreeRoutine;
+
+AVL_TABLE_COMPARE_ROUTINE WordTableCompareRoutine;
+AVL_TABLE_ALLOCATE_ROUTINE WordTableAllocateRoutine;
+AVL_TABLE_FREE_ROUTINE WordTableFreeRoutine;
+
+AVL_TABLE_COMPARE_ROUTINE LengthTableCompareRoutine;
+AVL_TABLE_ALLOCATE_ROUTINE LengthTableAllocateRoutine;
+AVL_TABLE_FREE_ROUTINE LengthTableFreeRoutine;
+
+//
+// TLS-related structures and functions.
+//
+
+typedef struct _DICTIONARY_CONTEXT {
+    PDICTIONARY Dictionary;
+    PVOID TableEntry;
+    PTABLE_ENTRY_HEADER TableEntryHeader;
+    PWORD_TABLE WordTable;
+    PWORD_ENTRY WordEntry;
+    PCLONG_STRING String;
+    PWORD_TABLE_ENTRY WordTableEntry;
     PHISTOGRAM_TABLE HistogramTable;
     PBITMAP_TABLE_ENTRY BitmapTableEntry;
     PHISTOGRAM_TABLE_ENTRY HistogramTableEntry;
@@ -620,13 +2295,455 @@ _Requires_exclusive_lock_held_(Dictionary->Lock)
 BOOLEAN
 (NTAPI ADD_WORD_ENTRY)(
     _Inout_ PDICTIONARY Dictionary,
-    _In_z_ PCBYTE Word,
+    _In_ PCBYTE Word,
+    _In_ ULONG Length,
+    _In_ LONGLONG Increment,
     _Outptr_result_nullonfailure_ PCWORD_ENTRY *WordEntryPointer,
     _Out_ LONGLONG *EntryCountPointer
     );
 typedef ADD_WORD_ENTRY *PADD_WORD_ENTRY;
 extern ADD_WORD_ENTRY AddWordEntry;
 
+typedef
+_Success_(return != 0)
+_Requires_exclusive_lock_held_(Dictionary->Lock)
+BOOLEAN
+(NTAPI CONVERT_INLINE_WORD_TO_WORD_TABLE)(
+    _Inout_ PDICTIONARY Dictionary,
+    _Inout_ PHISTOGRAM_TABLE_ENTRY HistogramTableEntry
+    );
+typedef CONVERT_INLINE_WORD_TO_WORD_TABLE *PCONVERT_INLINE_WORD_TO_WORD_TABLE;
+extern CONVERT_INLINE_WORD_TO_WORD_TABLE ConvertInlineWordToWordTable;
+
+typedef
+_Success_(return != 0)
+_Requires_exclusive_lock_held_(Dictionary->Lock)
+BOOLEAN
+(NTAPI REMOVE_WORD_TABLE_ENTRY)(
+    _Inout_ PDICTIONARY Dictionary,
+    _In_ PDICTIONARY_CONTEXT Context,
+    _Inout_ PWORD_TABLE_ENTRY WordTableEntry
+    );
+typedef REMOVE_WORD_TABLE_ENTRY *PREMOVE_WORD_TABLE_ENTRY;
+extern REMOVE_WORD_TABLE_ENTRY RemoveWordTableEntry;
+
+typedef
+_Success_(return != 0)
+_Requires_exclusive_lock_held_(Dictionary->Lock)
+BOOLEAN
+(NTAPI EVICT_WORDS)(
+    _Inout_ PDICTIONARY Dictionary,
+    _In_opt_ PWORD_TABLE_ENTRY ProtectedWordTableEntry
+    );
+typedef EVICT_WORDS *PEVICT_WORDS;
+extern EVICT_WORDS EvictWords;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI EVICT_WORD)(
+    _Inout_ PDICTIONARY Dictionary,
+    _In_z_ PCBYTE Word
+    );
+typedef EVICT_WORD *PEVICT_WORD;
+extern EVICT_WORD EvictWord;
+
+typedef
+VOID
+(NTAPI RELEASE_ARENA_CHUNK)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ _Post_invalid_ PDICTIONARY_ARENA_CHUNK Chunk
+    );
+typedef RELEASE_ARENA_CHUNK *PRELEASE_ARENA_CHUNK;
+extern RELEASE_ARENA_CHUNK ReleaseArenaChunk;
+
+typedef
+VOID
+(NTAPI FREE_WORD_STRING_BUFFER)(
+    _In_ PDICTIONARY Dictionary,
+    _In_opt_ PDICTIONARY_ARENA_CHUNK Chunk,
+    _In_ _Post_invalid_ PBYTE Buffer
+    );
+typedef FREE_WORD_STRING_BUFFER *PFREE_WORD_STRING_BUFFER;
+extern FREE_WORD_STRING_BUFFER FreeWordStringBuffer;
+
+//
+// Recursive table release routines used by FreezeDictionary().
+//
+
+typedef
+VOID
+(NTAPI FREE_TABLE_NODES)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ PRTL_AVL_TABLE Avl,
+    _In_opt_ _Post_invalid_ PRTL_BALANCED_LINKS Links
+    );
+typedef FREE_TABLE_NODES *PFREE_TABLE_NODES;
+extern FREE_TABLE_NODES FreeWordTableNodes;
+extern FREE_TABLE_NODES FreeHistogramTableNodes;
+extern FREE_TABLE_NODES FreeBitmapTableNodes;
+
+typedef
+VOID
+(NTAPI FREE_LENGTH_TABLE_NODES)(
+    _In_ PRTL_AVL_TABLE Avl,
+    _In_opt_ _Post_invalid_ PRTL_BALANCED_LINKS Links
+    );
+typedef FREE_LENGTH_TABLE_NODES *PFREE_LENGTH_TABLE_NODES;
+extern FREE_LENGTH_TABLE_NODES FreeLengthTableNodes;
+
+typedef
+_Success_(return != 0)
+_Requires_lock_held_(Dictionary->Lock)
+BOOLEAN
+(NTAPI FIND_FROZEN_WORD_ENTRY)(
+    _In_ PDICTIONARY Dictionary,
+    _In_ PFROZEN_DICTIONARY Frozen,
+    _In_z_ PCBYTE Word,
+    _Out_writes_all_(sizeof(*Bitmap)) PCHARACTER_BITMAP Bitmap,
+    _Out_writes_all_(sizeof(*Histogram)) PCHARACTER_HISTOGRAM Histogram,
+    _Out_opt_ PCFROZEN_HISTOGRAM_ENTRY *HistogramEntryPointer,
+    _Outptr_result_nullonfailure_ PWORD_ENTRY *WordEntryPointer
+    );
+typedef FIND_FROZEN_WORD_ENTRY *PFIND_FROZEN_WORD_ENTRY;
+extern FIND_FROZEN_WORD_ENTRY FindFrozenWordEntry;
+
+typedef
+_Success_(return != 0)
+PFROZEN_DICTIONARY
+(NTAPI CREATE_FROZEN_DICTIONARY_REPLICA)(
+    _In_ PFROZEN_DICTIONARY Frozen,
+    _In_ ULONG NodeNumber
+    );
+typedef CREATE_FROZEN_DICTIONARY_REPLICA *PCREATE_FROZEN_DICTIONARY_REPLICA;
+extern CREATE_FROZEN_DICTIONARY_REPLICA CreateFrozenDictionaryReplica;
+
+typedef
+VOID
+(NTAPI DESTROY_FROZEN_DICTIONARY_REPLICA)(
+    _In_ _Post_invalid_ PFROZEN_DICTIONARY Replica
+    );
+typedef DESTROY_FROZEN_DICTIONARY_REPLICA *PDESTROY_FROZEN_DICTIONARY_REPLICA;
+extern DESTROY_FROZEN_DICTIONARY_REPLICA DestroyFrozenDictionaryReplica;
+
+typedef
+_Success_(return != 0)
+_Requires_exclusive_lock_held_(Dictionary->Lock)
+BOOLEAN
+(NTAPI CREATE_FROZEN_DICTIONARY_REPLICAS)(
+    _Inout_ PDICTIONARY Dictionary,
+    _In_ PFROZEN_DICTIONARY Frozen
+    );
+typedef CREATE_FROZEN_DICTIONARY_REPLICAS *PCREATE_FROZEN_DICTIONARY_REPLICAS;
+extern CREATE_FROZEN_DICTIONARY_REPLICAS CreateFrozenDictionaryReplicas;
+
+typedef
+VOID
+(NTAPI DESTROY_FROZEN_DICTIONARY_REPLICAS)(
+    _Inout_ PDICTIONARY Dictionary
+    );
+typedef DESTROY_FROZEN_DICTIONARY_REPLICAS
+      *PDESTROY_FROZEN_DICTIONARY_REPLICAS;
+extern DESTROY_FROZEN_DICTIONARY_REPLICAS DestroyFrozenDictionaryReplicas;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI CREATE_PREFIX_INDEX)(
+    _Inout_ PDICTIONARY Dictionary
+    );
+typedef CREATE_PREFIX_INDEX *PCREATE_PREFIX_INDEX;
+extern CREATE_PREFIX_INDEX CreatePrefixIndex;
+
+typedef
+VOID
+(NTAPI DESTROY_PREFIX_INDEX)(
+    _Inout_ PDICTIONARY Dictionary
+    );
+typedef DESTROY_PREFIX_INDEX *PDESTROY_PREFIX_INDEX;
+extern DESTROY_PREFIX_INDEX DestroyPrefixIndex;
+
+typedef
+_Success_(return != 0)
+_Requires_exclusive_lock_held_(Dictionary->Lock)
+BOOLEAN
+(NTAPI INSERT_PREFIX_INDEX_WORD)(
+    _Inout_ PDICTIONARY Dictionary,
+    _In_ PCLONG_STRING String,
+    _Outptr_result_nullonfailure_ PPREFIX_NODE *PrefixNodePointer
+    );
+typedef INSERT_PREFIX_INDEX_WORD *PINSERT_PREFIX_INDEX_WORD;
+extern INSERT_PREFIX_INDEX_WORD InsertPrefixIndexWord;
+
+typedef
+_Requires_lock_held_(Dictionary->Lock)
+PPREFIX_NODE
+(NTAPI FIND_PREFIX_INDEX_NODE)(
+    _In_ PDICTIONARY Dictionary,
+    _In_reads_bytes_(Length) PCBYTE Bytes,
+    _In_ ULONG Length
+    );
+typedef FIND_PREFIX_INDEX_NODE *PFIND_PREFIX_INDEX_NODE;
+extern FIND_PREFIX_INDEX_NODE FindPrefixIndexNode;
+
+typedef
+_Requires_exclusive_lock_held_(Dictionary->Lock)
+PPREFIX_NODE
+(NTAPI PRUNE_PREFIX_INDEX_NODE)(
+    _Inout_ PDICTIONARY Dictionary,
+    _Inout_ PPREFIX_NODE PrefixNode
+    );
+typedef PRUNE_PREFIX_INDEX_NODE *PPRUNE_PREFIX_INDEX_NODE;
+extern PRUNE_PREFIX_INDEX_NODE PrunePrefixIndexNode;
+
+typedef
+_Requires_exclusive_lock_held_(Dictionary->Lock)
+VOID
+(NTAPI UPDATE_PREFIX_INDEX_ENTRY_COUNT)(
+    _Inout_ PDICTIONARY Dictionary,
+    _Inout_ PPREFIX_NODE PrefixNode,
+    _In_ LONGLONG EntryCount
+    );
+typedef UPDATE_PREFIX_INDEX_ENTRY_COUNT *PUPDATE_PREFIX_INDEX_ENTRY_COUNT;
+extern UPDATE_PREFIX_INDEX_ENTRY_COUNT UpdatePrefixIndexEntryCount;
+
+typedef
+VOID
+(CALLBACK ANAGRAM_CLASS_WORK_CALLBACK)(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _Inout_ PTP_WORK Work
+    );
+typedef ANAGRAM_CLASS_WORK_CALLBACK *PANAGRAM_CLASS_WORK_CALLBACK;
+extern ANAGRAM_CLASS_WORK_CALLBACK AnagramClassWorkCallback;
+
+//
+// Inline helper for resolving the frozen dictionary replica local to the
+// calling thread's current processor.  Falls back to the primary frozen
+// dictionary if there are no replicas (or no replica for the node).
+//
+
+FORCEINLINE
+PFROZEN_DICTIONARY
+GetLocalFrozenDictionary(
+    _In_ PDICTIONARY Dictionary
+    )
+{
+    ULONG Slot;
+    USHORT NodeNumber;
+    PFROZEN_DICTIONARY Replica;
+    PROCESSOR_NUMBER ProcessorNumber;
+    PDICTIONARY_NUMA_REPLICAS NumaReplicas;
+
+    NumaReplicas = Dictionary->NumaReplicas;
+
+    if (!NumaReplicas) {
+        return Dictionary->Frozen;
+    }
+
+    GetCurrentProcessorNumberEx(&ProcessorNumber);
+
+    Slot = (
+        ((ULONG)ProcessorNumber.Group * MAXIMUM_PROC_PER_GROUP) +
+        (ULONG)ProcessorNumber.Number
+    );
+
+    if (Slot >= NumaReplicas->NumberOfProcessorSlots) {
+        return Dictionary->Frozen;
+    }
+
+    NodeNumber = NumaReplicas->ProcessorNodeNumbers[Slot];
+
+    if (NodeNumber > NumaReplicas->HighestNodeNumber) {
+        return Dictionary->Frozen;
+    }
+
+    Replica = NumaReplicas->Replicas[NodeNumber];
+
+    return (Replica ? Replica : Dictionary->Frozen);
+}
+
+//
+// Inline helpers for capturing the write-ahead log around a modification of
+// the dictionary.  BeginDictionaryLogOperation() is called after acquiring
+// the exclusive lock, and returns the log (if any) with a reference held on
+// it, along with the sequence number at that point.  The records appended by
+// the modification (by AddWordEntry(), RemoveWord() or EvictWordTableEntry())
+// all follow that sequence number, so EndDictionaryLogOperation(), called
+// before releasing the lock, returns the sequence number following the last
+// of them, or 0 if none were appended.  After releasing the lock, the caller
+// passes this to WaitForDictionaryLog(), which releases the reference.
+//
+
+FORCEINLINE
+_Requires_exclusive_lock_held_(Dictionary->Lock)
+PDICTIONARY_LOG
+BeginDictionaryLogOperation(
+    _In_ PDICTIONARY Dictionary,
+    _Out_ PULONGLONG SequencePointer
+    )
+{
+    PDICTIONARY_LOG Log;
+
+    Log = Dictionary->Log;
+
+    if (!Log) {
+        *SequencePointer = 0;
+        return NULL;
+    }
+
+    InterlockedIncrement(&Log->NumberOfWaiters);
+    *SequencePointer = (ULONGLONG)Log->ReservedOffset;
+
+    return Log;
+}
+
+FORCEINLINE
+ULONGLONG
+EndDictionaryLogOperation(
+    _In_opt_ PDICTIONARY_LOG Log,
+    _In_ ULONGLONG Sequence
+    )
+{
+    ULONGLONG EndSequence;
+
+    if (!Log) {
+        return 0;
+    }
+
+    EndSequence = (ULONGLONG)Log->ReservedOffset;
+
+    return (EndSequence != Sequence ? EndSequence : 0);
+}
+
+//
+// Inline helper for finding the index of the first frozen length entry with
+// a length greater than or equal to a given length.  Returns the number of
+// length entries if there's no such entry.
+//
+
+FORCEINLINE
+ULONG
+FindFrozenLengthEntryIndex(
+    _In_ PFROZEN_DICTIONARY Frozen,
+    _In_ ULONG Length
+    )
+{
+    ULONG Low;
+    ULONG High;
+    ULONG Middle;
+
+    Low = 0;
+    High = Frozen->NumberOfLengths;
+
+    while (Low < High) {
+        Middle = Low + ((High - Low) >> 1);
+        if (Frozen->LengthEntries[Middle].Length < Length) {
+            Low = Middle + 1;
+        } else {
+            High = Middle;
+        }
+    }
+
+    return Low;
+}
+
+//
+// Inline helper for calculating the 32-bit CRC32 hash of a word's bytes.
+// This is the String->Hash value produced by InitializeWord(), and is also
+// used directly by callers that don't need the bitmap or histogram.
+//
+
+FORCEINLINE
+ULONG
+HashWordString(
+    _In_reads_(Length) PCBYTE Bytes,
+    _In_ ULONG Length
+    )
+{
+    BYTE TrailingBytes;
+    ULONG Index;
+    ULONG Last;
+    ULONG StringHash;
+    ULONG NumberOfDoubleWords;
+    PCBYTE Tail;
+    PULONG DoubleWords;
+
+    StringHash = Length;
+    DoubleWords = (PULONG)Bytes;
+    TrailingBytes = Length % 4;
+    NumberOfDoubleWords = Length >> 2;
+
+    //
+    // Process as many 4 byte chunks as we can.
+    //
+
+    for (Index = 0; Index < NumberOfDoubleWords; Index++) {
+        StringHash = _mm_crc32_u32(StringHash, DoubleWords[Index]);
+    }
+
+    if (TrailingBytes) {
+
+        //
+        // There are between 1 and 3 bytes remaining at the end of the string.
+        // Assemble them into the low bytes of a ULONG (leaving the high bytes
+        // zero) and hash that.  The bytes are loaded individually rather than
+        // loading the final ULONG, as the string isn't necessarily followed by
+        // a NULL (e.g. a token within a larger buffer), and reading past the
+        // end would both affect the hash value and risk faulting.
+        //
+
+        Last = 0;
+        Tail = Bytes + (NumberOfDoubleWords << 2);
+
+        for (Index = 0; Index < TrailingBytes; Index++) {
+            Last |= ((ULONG)Tail[Index]) << (Index << 3);
+        }
+
+        StringHash = _mm_crc32_u32(StringHash, Last);
+    }
+
+    return StringHash;
+}
+
+//
+// Inline helper for determining if two strings represent the same word.
+//
+
+FORCEINLINE
+BOOLEAN
+IsSameWord(
+    _In_ PCLONG_STRING Left,
+    _In_ PCLONG_STRING Right
+    )
+{
+    if (Left->Hash != Right->Hash || Left->Length != Right->Length) {
+        return FALSE;
+    }
+
+    return (CompareWords(Left, Right) == GenericEqual);
+}
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(NTAPI CREATE_DICTIONARY_TRACKING_ALLOCATORS)(
+    _Inout_ PDICTIONARY Dictionary
+    );
+typedef CREATE_DICTIONARY_TRACKING_ALLOCATORS
+      *PCREATE_DICTIONARY_TRACKING_ALLOCATORS;
+extern CREATE_DICTIONARY_TRACKING_ALLOCATORS CreateDictionaryTrackingAllocators;
+
+typedef
+VOID
+(NTAPI DESTROY_DICTIONARY_TRACKING_ALLOCATORS)(
+    _Inout_ PDICTIONARY Dictionary
+    );
+typedef DESTROY_DICTIONARY_TRACKING_ALLOCATORS
+      *PDESTROY_DICTIONARY_TRACKING_ALLOCATORS;
+extern DESTROY_DICTIONARY_TRACKING_ALLOCATORS
+    DestroyDictionaryTrackingAllocators;
+
 //
 // The PROCESS_ATTACH and PROCESS_ATTACH functions share the same signature.
 //
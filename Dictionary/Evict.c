@@ -0,0 +1,668 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    Evict.c
+
+Abstract:
+
+    This module implements bounded-memory dictionaries.  A dictionary created
+    with the EnableEviction flag may be given a budget via the public routine
+    SetDictionaryBudget(), expressed as a maximum number of words and/or a
+    maximum number of bytes (the latter requires TrackMemoryUsage).  When an
+    addition pushes the dictionary over its budget, EvictWords() removes words
+    until it's back within budget.
+
+    Victims are selected by an approximate LFU policy implemented as a CLOCK
+    sweep.  Each word has a saturating 2-bit counter (the ClockCount field of
+    the owning node's TABLE_ENTRY_HEADER), which AddWordEntry() bumps by the
+    increment applied to the word, minus one for the first occurrence of a new
+    word.  The clock hand sweeps the length lists of the length table, which
+    already link every word in the dictionary: a word with a non-zero counter
+    has its counter decremented and is rotated to the tail of its list (a
+    "second chance"); the first word found with a zero counter is evicted.
+    Words seen repeatedly therefore survive several sweeps, and the hot
+    vocabulary stays resident while one-off words are recycled.
+
+    Evicted words are removed via RemoveWordTableEntry(), which is shared with
+    RemoveWord(), so the length table, longest-word stats, prefix index and
+    empty histogram and bitmap table entries are maintained identically.
+
+    Evictions are written to the write-ahead log, if one is open, such that a
+    recovered dictionary doesn't depend on its budget (or CLOCK state) being
+    identical to the original's.  Replaying an eviction whose word has already
+    been evicted by the replay is a no-op.
+
+--*/
+
+#include "stdafx.h"
+
+FORCEINLINE
+ULONGLONG
+GetDictionaryBudgetBytes(
+    _In_ PDICTIONARY Dictionary
+    )
+/*++
+
+Routine Description:
+
+    Returns the number of bytes charged against a dictionary's byte budget:
+    the outstanding bytes of each tracking allocator plus any compaction arena
+    chunks.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to a DICTIONARY structure that was created
+        with the TrackMemoryUsage flag.
+
+Return Value:
+
+    Number of bytes.
+
+--*/
+{
+    PDICTIONARY_TRACKING_ALLOCATORS TrackingAllocators;
+
+    TrackingAllocators = Dictionary->TrackingAllocators;
+
+    return (
+        TrackingAllocators->BitmapTable.Usage.NumberOfBytes +
+        TrackingAllocators->HistogramTable.Usage.NumberOfBytes +
+        TrackingAllocators->WordTable.Usage.NumberOfBytes +
+        TrackingAllocators->LengthTable.Usage.NumberOfBytes +
+        TrackingAllocators->Word.Usage.NumberOfBytes +
+        Dictionary->NumberOfArenaBytes
+    );
+}
+
+FORCEINLINE
+BOOLEAN
+IsDictionaryOverBudget(
+    _In_ PDICTIONARY Dictionary
+    )
+{
+    if (Dictionary->MaximumNumberOfWords != 0 &&
+        Dictionary->NumberOfWords > Dictionary->MaximumNumberOfWords) {
+        return TRUE;
+    }
+
+    if (Dictionary->MaximumNumberOfBytes != 0 &&
+        Dictionary->TrackingAllocators != NULL &&
+        GetDictionaryBudgetBytes(Dictionary) >
+            Dictionary->MaximumNumberOfBytes) {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+FORCEINLINE
+PLENGTH_TABLE_ENTRY
+GetNextClockLengthTableEntry(
+    _In_ PDICTIONARY Dictionary,
+    _In_opt_ PLENGTH_TABLE_ENTRY LengthTableEntry
+    )
+/*++
+
+Routine Description:
+
+    Returns the length table entry for the next longest word length after the
+    given entry, wrapping around to the shortest length in the table if there
+    are no longer lengths (or if no entry was given).
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure.
+
+    LengthTableEntry - Optionally supplies a pointer to the length table entry
+        currently under the clock hand.
+
+Return Value:
+
+    A pointer to the length table entry, or NULL if the table is empty.
+
+--*/
+{
+    PRTL Rtl;
+    PRTL_SPLAY_LINKS Links;
+    PRTL_BALANCED_LINKS BalancedLinks;
+    PTABLE_ENTRY_HEADER TableEntryHeader;
+
+    Rtl = Dictionary->Rtl;
+
+    if (LengthTableEntry) {
+        TableEntryHeader = TABLE_ENTRY_TO_HEADER(LengthTableEntry);
+        Links = Rtl->RtlRealSuccessor(&TableEntryHeader->SplayLinks);
+        if (Links) {
+            TableEntryHeader = (PTABLE_ENTRY_HEADER)Links;
+            return &TableEntryHeader->LengthTableEntry;
+        }
+    }
+
+    BalancedLinks = Dictionary->LengthTable.Avl.BalancedRoot.RightChild;
+
+    if (!BalancedLinks) {
+        return NULL;
+    }
+
+    while (BalancedLinks->LeftChild) {
+        BalancedLinks = BalancedLinks->LeftChild;
+    }
+
+    TableEntryHeader = (PTABLE_ENTRY_HEADER)BalancedLinks;
+    return &TableEntryHeader->LengthTableEntry;
+}
+
+FORCEINLINE
+PRTL_AVL_TABLE
+GetOwningAvlTable(
+    _In_ PTABLE_ENTRY_HEADER TableEntryHeader
+    )
+/*++
+
+Routine Description:
+
+    Returns the AVL table that contains the given node by walking its parent
+    links up to the table's balanced root, which is its own parent.
+
+--*/
+{
+    PRTL_BALANCED_LINKS Links;
+
+    Links = &TableEntryHeader->BalancedLinks;
+
+    while (Links->Parent != Links) {
+        Links = Links->Parent;
+    }
+
+    return CONTAINING_RECORD(Links, RTL_AVL_TABLE, BalancedRoot);
+}
+
+FORCEINLINE
+VOID
+GetWordTableEntryContext(
+    _In_ PWORD_TABLE_ENTRY WordTableEntry,
+    _Out_ PDICTIONARY_CONTEXT Context
+    )
+/*++
+
+Routine Description:
+
+    Derives the owning word table, histogram table entry, histogram table and
+    bitmap table entry of a word table entry from the entry itself, filling
+    out the context required by RemoveWordTableEntry().  Unlike looking the
+    word up again via FindWordTableEntry(), this can't fail (e.g. because the
+    word no longer satisfies the dictionary's word length limits), and doesn't
+    need to rehash the word.
+
+Arguments:
+
+    WordTableEntry - Supplies a pointer to the word table entry.
+
+    Context - Supplies a pointer to the context to fill out.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    PRTL_AVL_TABLE Avl;
+    PWORD_TABLE WordTable;
+    PHISTOGRAM_TABLE HistogramTable;
+    PTABLE_ENTRY_HEADER TableEntryHeader;
+    PHISTOGRAM_TABLE_ENTRY HistogramTableEntry;
+
+    TableEntryHeader = WORD_TABLE_ENTRY_TO_OWNER_HEADER(WordTableEntry);
+
+    if (TableEntryHeader->HasInlineWord) {
+
+        //
+        // Inline words live at the start of their histogram table entry, and
+        // don't have a word table.
+        //
+
+        WordTable = NULL;
+        HistogramTableEntry = (PHISTOGRAM_TABLE_ENTRY)WordTableEntry;
+
+    } else {
+
+        Avl = GetOwningAvlTable(TableEntryHeader);
+        WordTable = CONTAINING_RECORD(Avl, WORD_TABLE, Avl);
+        HistogramTableEntry = CONTAINING_RECORD(WordTable,
+                                                HISTOGRAM_TABLE_ENTRY,
+                                                WordTable);
+    }
+
+    Avl = GetOwningAvlTable(TABLE_ENTRY_TO_HEADER(HistogramTableEntry));
+    HistogramTable = CONTAINING_RECORD(Avl, HISTOGRAM_TABLE, Avl);
+
+    Context->WordTable = WordTable;
+    Context->WordTableEntry = WordTableEntry;
+    Context->WordEntry = &WordTableEntry->WordEntry;
+    Context->HistogramTable = HistogramTable;
+    Context->HistogramTableEntry = HistogramTableEntry;
+    Context->BitmapTableEntry = CONTAINING_RECORD(HistogramTable,
+                                                  BITMAP_TABLE_ENTRY,
+                                                  HistogramTable);
+}
+
+FORCEINLINE
+PWORD_TABLE_ENTRY
+FindEvictionCandidate(
+    _In_ PDICTIONARY Dictionary,
+    _In_opt_ PWORD_TABLE_ENTRY ProtectedWordTableEntry
+    )
+/*++
+
+Routine Description:
+
+    Advances the dictionary's clock hand until a word with a zero CLOCK count
+    is found.  Words with a non-zero count are decremented and rotated to the
+    tail of their length list.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure.
+
+    ProtectedWordTableEntry - Optionally supplies a pointer to a word table
+        entry that must not be selected.
+
+Return Value:
+
+    A pointer to the word table entry to evict, or NULL if no candidate could
+    be found (i.e. the only word remaining is the protected one).
+
+--*/
+{
+    ULONGLONG Iterations;
+    ULONGLONG MaximumIterations;
+    PLIST_ENTRY ListHead;
+    PLIST_ENTRY ListEntry;
+    PWORD_TABLE_ENTRY WordTableEntry;
+    PLENGTH_TABLE_ENTRY LengthTableEntry;
+    PTABLE_ENTRY_HEADER TableEntryHeader;
+
+    //
+    // Each word's counter is at most DICTIONARY_MAXIMUM_CLOCK_COUNT, so after
+    // that many revolutions plus one, every unprotected word will have been
+    // offered with a zero count.  Bound the sweep accordingly.
+    //
+
+    MaximumIterations = (
+        (Dictionary->NumberOfWords + 1) *
+        (DICTIONARY_MAXIMUM_CLOCK_COUNT + 1)
+    );
+
+    Iterations = 0;
+
+    while (Iterations < MaximumIterations) {
+
+        //
+        // If the hand has finished with the length list under it, move on to
+        // the next length, wrapping around as necessary.
+        //
+
+        LengthTableEntry = Dictionary->ClockHandEntry;
+
+        if (!LengthTableEntry || Dictionary->ClockHandRemaining == 0) {
+
+            LengthTableEntry = GetNextClockLengthTableEntry(Dictionary,
+                                                            LengthTableEntry);
+
+            if (!LengthTableEntry) {
+                return NULL;
+            }
+
+            Dictionary->ClockHandEntry = LengthTableEntry;
+            Dictionary->ClockHandRemaining = (ULONG)(
+                min(LengthTableEntry->NumberOfWords, MAXULONG)
+            );
+        }
+
+        ListHead = &LengthTableEntry->LengthListHead;
+        ASSERT(!IsListEmpty(ListHead));
+
+        while (Dictionary->ClockHandRemaining > 0 &&
+               Iterations < MaximumIterations) {
+
+            Iterations++;
+            Dictionary->ClockHandRemaining--;
+
+            ListEntry = ListHead->Flink;
+            WordTableEntry = CONTAINING_RECORD(ListEntry,
+                                               WORD_TABLE_ENTRY,
+                                               LengthListEntry);
+
+            TableEntryHeader = WORD_TABLE_ENTRY_TO_OWNER_HEADER(WordTableEntry);
+
+            if (WordTableEntry != ProtectedWordTableEntry &&
+                TableEntryHeader->ClockCount == 0) {
+                return WordTableEntry;
+            }
+
+            //
+            // Give the word a second chance: decrement its counter and rotate
+            // it to the tail of the length list.
+            //
+
+            if (TableEntryHeader->ClockCount > 0) {
+                TableEntryHeader->ClockCount--;
+            }
+
+            RemoveEntryList(ListEntry);
+            InsertTailList(ListHead, ListEntry);
+        }
+    }
+
+    return NULL;
+}
+
+FORCEINLINE
+BOOLEAN
+EvictWordTableEntry(
+    _In_ PDICTIONARY Dictionary,
+    _In_ PWORD_TABLE_ENTRY WordTableEntry
+    )
+/*++
+
+Routine Description:
+
+    Evicts a single word from the dictionary.  The word's owning tables are
+    derived from the entry, its entry count is zeroed, and it is removed via
+    RemoveWordTableEntry().  The eviction is appended to the write-ahead log,
+    if one is open.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure.
+
+    WordTableEntry - Supplies a pointer to the word table entry to evict.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    PWORD_ENTRY WordEntry;
+    PPREFIX_NODE PrefixNode;
+    DICTIONARY_CONTEXT Context;
+
+    ZeroStruct(Context);
+
+    Context.Dictionary = Dictionary;
+    GetWordTableEntryContext(WordTableEntry, &Context);
+
+    WordEntry = &WordTableEntry->WordEntry;
+
+    //
+    // Append the eviction to the write-ahead log, if applicable.  This must
+    // be done before the word entry is freed below.
+    //
+
+    if (Dictionary->Log) {
+        AppendDictionaryLogRecord(Dictionary->Log,
+                                  DictionaryLogEvictWordOperation,
+                                  WordEntry->String.Buffer,
+                                  WordEntry->String.Length,
+                                  0);
+    }
+
+    //
+    // Zero the entry count and update the prefix index (which removes the
+    // word's node), then remove the word.
+    //
+
+    WordEntry->Stats.EntryCount = 0;
+
+    if (Dictionary->PrefixIndex) {
+
+        PrefixNode = FindPrefixIndexNode(Dictionary,
+                                         WordEntry->String.Buffer,
+                                         WordEntry->String.Length);
+
+        ASSERT(PrefixNode != NULL);
+
+        if (PrefixNode) {
+            UpdatePrefixIndexEntryCount(Dictionary, PrefixNode, 0);
+        }
+    }
+
+    return RemoveWordTableEntry(Dictionary, &Context, WordTableEntry);
+}
+
+_Use_decl_annotations_
+BOOLEAN
+EvictWords(
+    PDICTIONARY Dictionary,
+    PWORD_TABLE_ENTRY ProtectedWordTableEntry
+    )
+/*++
+
+Routine Description:
+
+    Evicts words from the dictionary until it's within its budget.  This is
+    called by AddWordEntry() after adding a word to a dictionary with eviction
+    enabled, and by SetDictionaryBudget().  The caller must hold the exclusive
+    dictionary lock.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure.
+
+    ProtectedWordTableEntry - Optionally supplies a pointer to a word table
+        entry that must not be evicted (e.g. the word that was just added).
+
+Return Value:
+
+    TRUE if the dictionary is within its budget, FALSE otherwise (either an
+    eviction failed, or there were no candidates left to evict).
+
+--*/
+{
+    PWORD_TABLE_ENTRY WordTableEntry;
+
+    while (IsDictionaryOverBudget(Dictionary)) {
+
+        WordTableEntry = FindEvictionCandidate(Dictionary,
+                                               ProtectedWordTableEntry);
+
+        if (!WordTableEntry) {
+            return FALSE;
+        }
+
+        if (!EvictWordTableEntry(Dictionary, WordTableEntry)) {
+            return FALSE;
+        }
+
+        Dictionary->NumberOfEvictions++;
+    }
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+SetDictionaryBudget(
+    PDICTIONARY Dictionary,
+    ULONGLONG MaximumNumberOfWords,
+    ULONGLONG MaximumNumberOfBytes
+    )
+/*++
+
+Routine Description:
+
+    Sets the budget of a dictionary created with the EnableEviction flag.  If
+    the dictionary is already over the new budget, words are evicted before
+    this routine returns.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure.
+
+    MaximumNumberOfWords - Supplies the maximum number of distinct words the
+        dictionary may hold.  If 0, the number of words isn't limited.
+
+    MaximumNumberOfBytes - Supplies the maximum number of bytes the dictionary
+        may use, as reported by the tracking allocators.  If 0, the number of
+        bytes isn't limited.  A non-zero value requires the dictionary to have
+        been created with the TrackMemoryUsage flag.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if the
+    dictionary wasn't created with EnableEviction (or with TrackMemoryUsage
+    when a byte budget is requested), if it has been frozen, or if it could
+    not be brought within the new budget.
+
+--*/
+{
+    BOOLEAN Success;
+    ULONGLONG Sequence;
+    PDICTIONARY_LOG Log;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!Dictionary->Flags.IsEvictionEnabled) {
+        return FALSE;
+    }
+
+    if (MaximumNumberOfBytes != 0 && !Dictionary->TrackingAllocators) {
+        return FALSE;
+    }
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+
+    Log = BeginDictionaryLogOperation(Dictionary, &Sequence);
+
+    //
+    // Frozen dictionaries can't be modified.
+    //
+
+    if (Dictionary->Flags.IsFrozen) {
+        Success = FALSE;
+        goto End;
+    }
+
+    Dictionary->MaximumNumberOfWords = MaximumNumberOfWords;
+    Dictionary->MaximumNumberOfBytes = MaximumNumberOfBytes;
+
+    Success = EvictWords(Dictionary, NULL);
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    Sequence = EndDictionaryLogOperation(Log, Sequence);
+
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    //
+    // If a write-ahead log is open, wait for the evictions to become durable.
+    //
+
+    if (Log && !WaitForDictionaryLog(Log, Sequence)) {
+        Success = FALSE;
+    }
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+EvictWord(
+    PDICTIONARY Dictionary,
+    PCBYTE Word
+    )
+/*++
+
+Routine Description:
+
+    Evicts a word from the dictionary, if present, regardless of its entry
+    count.  This is used by RecoverDictionary() to replay evictions from the
+    write-ahead log.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure.
+
+    Word - Supplies a NULL-terminated array of bytes to evict.
+
+Return Value:
+
+    TRUE on success (including if the word wasn't present), FALSE on failure.
+    FALSE will be returned if the dictionary has been frozen.
+
+--*/
+{
+    BOOLEAN Success;
+    CHARACTER_BITMAP Bitmap;
+    DICTIONARY_CONTEXT Context;
+    CHARACTER_HISTOGRAM Histogram;
+    PWORD_TABLE_ENTRY WordTableEntry;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Word)) {
+        return FALSE;
+    }
+
+    ZeroStruct(Context);
+    ZeroStruct(Bitmap);
+
+    Context.Dictionary = Dictionary;
+    DictionaryTlsSetContext(&Context);
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+
+    //
+    // Frozen dictionaries can't be modified.
+    //
+
+    if (Dictionary->Flags.IsFrozen) {
+        Success = FALSE;
+        goto End;
+    }
+
+    Success = FindWordTableEntry(Dictionary,
+                                 Word,
+                                 &Bitmap,
+                                 &Histogram,
+                                 &WordTableEntry);
+
+    if (Success && WordTableEntry) {
+        Success = EvictWordTableEntry(Dictionary, WordTableEntry);
+        if (Success) {
+            Dictionary->NumberOfEvictions++;
+        }
+    }
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    return Success;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
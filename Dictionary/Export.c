@@ -0,0 +1,1019 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    Export.c
+
+Abstract:
+
+    This module implements the export and import of dictionaries.  The public
+    ExportDictionary() routine serializes the words of a dictionary, along
+    with their entry counts and maximum entry counts, into a single buffer.
+    The public ImportDictionary() routine adds the words of such a buffer to
+    a dictionary.
+
+    Words are exported in lexicographic byte order, in blocks that are front
+    coded (each word only stores the bytes that differ from the word before
+    it) with variable-length integers, which typically reduces the size of a
+    natural language word list to a fraction of its string bytes.  The first
+    word of each block is stored in full, such that blocks can be decoded
+    independently; a range of blocks can be imported into each of several
+    dictionaries in parallel.  See DICTIONARY_EXPORT_HEADER for the format.
+
+--*/
+
+#include "stdafx.h"
+
+//
+// Blocks are closed once they reach DICTIONARY_EXPORT_WORDS_PER_BLOCK words
+// or this many bytes, whichever comes first.
+//
+
+#define DICTIONARY_EXPORT_TARGET_BLOCK_SIZE (1 << 16)
+
+FORCEINLINE
+ULONG
+EncodeVarint(
+    _In_ ULONGLONG Value,
+    _Out_writes_opt_(DICTIONARY_EXPORT_MAXIMUM_VARINT_SIZE) PBYTE Output
+    )
+/*++
+
+Routine Description:
+
+    Encodes a value as an unsigned LEB128 variable-length integer.
+
+Arguments:
+
+    Value - Supplies the value to encode.
+
+    Output - Optionally supplies a pointer to the buffer that receives the
+        encoded bytes.  If NULL, only the encoded size is calculated.
+
+Return Value:
+
+    The number of bytes required to encode the value.
+
+--*/
+{
+    ULONG Size;
+
+    Size = 0;
+
+    do {
+        if (Output) {
+            Output[Size] = (BYTE)((Value & 0x7f) | (Value > 0x7f ? 0x80 : 0));
+        }
+        Size++;
+        Value >>= 7;
+    } while (Value);
+
+    return Size;
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOLEAN
+DecodeVarint(
+    _Inout_ PCBYTE *CursorPointer,
+    _In_ PCBYTE End,
+    _Out_ PULONGLONG ValuePointer
+    )
+/*++
+
+Routine Description:
+
+    Decodes an unsigned LEB128 variable-length integer and advances the
+    cursor past it.
+
+Return Value:
+
+    TRUE on success, FALSE if the integer is truncated or too large.
+
+--*/
+{
+    BYTE Byte;
+    ULONG Shift;
+    PCBYTE Cursor;
+    ULONGLONG Value;
+
+    Value = 0;
+    Cursor = *CursorPointer;
+
+    for (Shift = 0; Shift < 64; Shift += 7) {
+
+        if (Cursor >= End) {
+            return FALSE;
+        }
+
+        Byte = *Cursor++;
+        Value |= ((ULONGLONG)(Byte & 0x7f)) << Shift;
+
+        if (!(Byte & 0x80)) {
+            *CursorPointer = Cursor;
+            *ValuePointer = Value;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+FORCEINLINE
+ULONG
+CalculateExportChecksum(
+    _In_reads_bytes_(SizeInBytes) PCBYTE Bytes,
+    _In_ ULONGLONG SizeInBytes
+    )
+{
+    ULONGLONG Index;
+    ULONGLONG Checksum;
+    ULONGLONG NumberOfQuadWords;
+    ULONGLONG QuadWord;
+
+    Checksum = 0;
+    NumberOfQuadWords = SizeInBytes >> 3;
+
+    for (Index = 0; Index < NumberOfQuadWords; Index++) {
+        CopyMemory(&QuadWord, Bytes + (Index << 3), sizeof(QuadWord));
+        Checksum = _mm_crc32_u64(Checksum, QuadWord);
+    }
+
+    for (Index <<= 3; Index < SizeInBytes; Index++) {
+        Checksum = _mm_crc32_u8((ULONG)Checksum, Bytes[Index]);
+    }
+
+    return (ULONG)Checksum;
+}
+
+FORCEINLINE
+LONG
+CompareWordBytes(
+    _In_ PCLONG_STRING Left,
+    _In_ PCLONG_STRING Right
+    )
+/*++
+
+Routine Description:
+
+    Compares two words in lexicographic byte order.  (CompareWords() is only
+    suitable for words of equal length.)
+
+Return Value:
+
+    A negative value if the left word sorts first, 0 if the words are equal,
+    and a positive value if the right word sorts first.
+
+--*/
+{
+    ULONG Index;
+    ULONG Length;
+
+    Length = min(Left->Length, Right->Length);
+
+    for (Index = 0; Index < Length; Index++) {
+        if (Left->Buffer[Index] != Right->Buffer[Index]) {
+            return (LONG)Left->Buffer[Index] - (LONG)Right->Buffer[Index];
+        }
+    }
+
+    return ((LONG)(Left->Length > Right->Length) -
+            (LONG)(Left->Length < Right->Length));
+}
+
+FORCEINLINE
+PWORD_ENTRY *
+SortWordEntries(
+    _Inout_updates_(NumberOfWords) PWORD_ENTRY *Words,
+    _Inout_updates_(NumberOfWords) PWORD_ENTRY *Temp,
+    _In_ ULONGLONG NumberOfWords
+    )
+/*++
+
+Routine Description:
+
+    Sorts an array of word entry pointers in lexicographic order via a bottom
+    up merge sort.  The two arrays are used alternately as the source and
+    destination of each pass.
+
+Return Value:
+
+    The array holding the sorted pointers; either Words or Temp.
+
+--*/
+{
+    ULONGLONG Low;
+    ULONGLONG Left;
+    ULONGLONG Right;
+    ULONGLONG Width;
+    ULONGLONG Index;
+    ULONGLONG Middle;
+    ULONGLONG High;
+    PWORD_ENTRY *Source;
+    PWORD_ENTRY *Dest;
+    PWORD_ENTRY *Swap;
+
+    Source = Words;
+    Dest = Temp;
+
+    for (Width = 1; Width < NumberOfWords; Width <<= 1) {
+
+        for (Low = 0; Low < NumberOfWords; Low += (Width << 1)) {
+
+            Middle = min(Low + Width, NumberOfWords);
+            High = min(Low + (Width << 1), NumberOfWords);
+
+            Left = Low;
+            Right = Middle;
+
+            for (Index = Low; Index < High; Index++) {
+
+                if (Left < Middle &&
+                    (Right >= High ||
+                     CompareWordBytes(&Source[Left]->String,
+                                      &Source[Right]->String) <= 0)) {
+                    Dest[Index] = Source[Left++];
+                } else {
+                    Dest[Index] = Source[Right++];
+                }
+            }
+        }
+
+        Swap = Source;
+        Source = Dest;
+        Dest = Swap;
+    }
+
+    return Source;
+}
+
+FORCEINLINE
+ULONG
+EncodeExportBlock(
+    _In_reads_(NumberOfWords) PWORD_ENTRY *Words,
+    _In_ ULONGLONG NumberOfWords,
+    _Out_writes_bytes_opt_(return) PBYTE Output,
+    _Out_ PULONG NumberOfBlockWordsPointer
+    )
+/*++
+
+Routine Description:
+
+    Encodes a block of words.  The block is closed once it holds
+    DICTIONARY_EXPORT_WORDS_PER_BLOCK words or reaches the target block size.
+
+Arguments:
+
+    Words - Supplies a pointer to the sorted word entry pointers to encode,
+        starting with the first word of the block.
+
+    NumberOfWords - Supplies the number of words remaining in the array.
+
+    Output - Optionally supplies a pointer to the buffer that receives the
+        block.  If NULL, the block's size is calculated without writing it.
+
+    NumberOfBlockWordsPointer - Supplies the address of a variable that
+        receives the number of words encoded in the block.
+
+Return Value:
+
+    The size of the block, in bytes, including its header.
+
+--*/
+{
+    ULONG Size;
+    ULONG Shared;
+    ULONG Limit;
+    ULONG Index;
+    ULONG Suffix;
+    PWORD_ENTRY WordEntry;
+    PCLONG_STRING String;
+    PCLONG_STRING Previous;
+    PDICTIONARY_EXPORT_BLOCK_HEADER BlockHeader;
+
+#define OUTPUT_AT(Offset) (Output ? Output + (Offset) : NULL)
+
+    Size = sizeof(DICTIONARY_EXPORT_BLOCK_HEADER);
+    Previous = NULL;
+
+    for (Index = 0;
+         Index < NumberOfWords &&
+         Index < DICTIONARY_EXPORT_WORDS_PER_BLOCK &&
+         Size < DICTIONARY_EXPORT_TARGET_BLOCK_SIZE;
+         Index++) {
+
+        WordEntry = Words[Index];
+        String = &WordEntry->String;
+
+        //
+        // Determine the number of leading bytes shared with the previous word.
+        //
+
+        Shared = 0;
+
+        if (Previous) {
+            Limit = min(Previous->Length, String->Length);
+            while (Shared < Limit &&
+                   Previous->Buffer[Shared] == String->Buffer[Shared]) {
+                Shared++;
+            }
+        }
+
+        Suffix = String->Length - Shared;
+
+        Size += EncodeVarint(Shared, OUTPUT_AT(Size));
+        Size += EncodeVarint(Suffix, OUTPUT_AT(Size));
+
+        if (Output) {
+            CopyMemory(Output + Size, String->Buffer + Shared, Suffix);
+        }
+
+        Size += Suffix;
+
+        Size += EncodeVarint(WordEntry->Stats.EntryCount, OUTPUT_AT(Size));
+        Size += EncodeVarint(
+            WordEntry->Stats.MaximumEntryCount - WordEntry->Stats.EntryCount,
+            OUTPUT_AT(Size)
+        );
+
+        Previous = String;
+    }
+
+#undef OUTPUT_AT
+
+    if (Output) {
+        BlockHeader = (PDICTIONARY_EXPORT_BLOCK_HEADER)Output;
+        BlockHeader->SizeInBytes = Size;
+        BlockHeader->NumberOfWords = Index;
+        BlockHeader->Checksum = CalculateExportChecksum(
+            (PCBYTE)(BlockHeader + 1),
+            Size - sizeof(*BlockHeader)
+        );
+        BlockHeader->Padding = 0;
+    }
+
+    *NumberOfBlockWordsPointer = Index;
+
+    return Size;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+ExportDictionaryEx(
+    PDICTIONARY Dictionary,
+    PALLOCATOR Allocator,
+    PVOID *BufferPointer,
+    PULONGLONG SizeInBytesPointer,
+    PULONG NumberOfBlocksPointer,
+    PULONGLONG LogSequencePointer
+    )
+/*++
+
+Routine Description:
+
+    Exports the words of a dictionary, along with their entry counts and
+    maximum entry counts, to a buffer suitable for ImportDictionary().  Both
+    mutable and frozen dictionaries can be exported.  Optionally captures the
+    dictionary's log sequence number as of the export.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure to export.
+
+    Allocator - Supplies a pointer to the allocator used to allocate the
+        buffer, as well as temporary storage for sorting the words.
+
+    BufferPointer - Supplies the address of a variable that receives the
+        address of the buffer.  The caller is responsible for freeing the
+        buffer via Allocator->FreePointer().  Set to NULL on error.
+
+    SizeInBytesPointer - Supplies the address of a variable that receives the
+        size of the buffer, in bytes.
+
+    NumberOfBlocksPointer - Optionally supplies the address of a variable that
+        receives the number of blocks in the export.
+
+    LogSequencePointer - Optionally supplies the address of a variable that
+        receives the sequence number of the dictionary's log (see
+        OpenDictionaryLog()) as of the export, or 0 if no log is open.  Every
+        logged operation before this sequence number is reflected in the
+        export, and none after it are.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    PRTL Rtl;
+    PBYTE Output;
+    PVOID RestartKey;
+    ULONG Count;
+    ULONG BlockSize;
+    ULONG NumberOfBlocks;
+    ULONG LongestWordLength;
+    BOOLEAN Success;
+    ULONGLONG Index;
+    ULONGLONG Offset;
+    ULONGLONG SizeInBytes;
+    ULONGLONG NumberOfWords;
+    PULONGLONG BlockOffsets;
+    PLIST_ENTRY ListHead;
+    PLIST_ENTRY ListEntry;
+    PWORD_ENTRY *Words;
+    PWORD_ENTRY *Temp;
+    PWORD_ENTRY *SortedWords;
+    PLENGTH_TABLE LengthTable;
+    PFROZEN_DICTIONARY Frozen;
+    PWORD_TABLE_ENTRY WordTableEntry;
+    PLENGTH_TABLE_ENTRY LengthTableEntry;
+    PDICTIONARY_EXPORT_HEADER Header;
+    PRTL_ENUMERATE_GENERIC_TABLE_WITHOUT_SPLAYING_AVL EnumerateTable;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(BufferPointer)) {
+        return FALSE;
+    }
+
+    *BufferPointer = NULL;
+
+    if (!ARGUMENT_PRESENT(SizeInBytesPointer)) {
+        return FALSE;
+    }
+
+    *SizeInBytesPointer = 0;
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Allocator)) {
+        return FALSE;
+    }
+
+    //
+    // Initialize locals.
+    //
+
+    Rtl = Dictionary->Rtl;
+    EnumerateTable = Rtl->RtlEnumerateGenericTableWithoutSplayingAvl;
+    LengthTable = &Dictionary->LengthTable;
+    Words = NULL;
+    Output = NULL;
+    NumberOfWords = 0;
+    LongestWordLength = 0;
+
+    AcquireDictionaryLockShared(&Dictionary->Lock);
+
+    //
+    // Log records are appended whilst the exclusive lock is held, so the log
+    // can't advance until we release the lock.
+    //
+
+    if (ARGUMENT_PRESENT(LogSequencePointer)) {
+        *LogSequencePointer = (
+            Dictionary->Log ? (ULONGLONG)Dictionary->Log->WrittenOffset : 0
+        );
+    }
+
+    Frozen = Dictionary->Frozen;
+
+    //
+    // Count the words.  Frozen dictionaries track this directly; otherwise,
+    // walk the length table's word lists.
+    //
+
+    if (Frozen) {
+
+        NumberOfWords = Frozen->NumberOfWords;
+
+    } else {
+
+        RestartKey = NULL;
+
+        while (TRUE) {
+
+            LengthTableEntry = (PLENGTH_TABLE_ENTRY)(
+                EnumerateTable(&LengthTable->Avl, &RestartKey)
+            );
+
+            if (!LengthTableEntry) {
+                break;
+            }
+
+            ListHead = &LengthTableEntry->LengthListHead;
+
+            for (ListEntry = ListHead->Flink;
+                 ListEntry != ListHead;
+                 ListEntry = ListEntry->Flink) {
+                NumberOfWords++;
+            }
+        }
+    }
+
+    //
+    // Allocate the word pointer array and the temporary array used by the
+    // sort, then capture the words.
+    //
+
+    if (NumberOfWords) {
+
+        Words = (PWORD_ENTRY *)(
+            Allocator->Calloc(Allocator,
+                              (SIZE_T)NumberOfWords * 2,
+                              sizeof(PWORD_ENTRY))
+        );
+
+        if (!Words) {
+            goto Error;
+        }
+    }
+
+    Temp = Words + NumberOfWords;
+
+    if (Frozen) {
+
+        for (Index = 0; Index < NumberOfWords; Index++) {
+            Words[Index] = &Frozen->WordEntries[Index];
+        }
+
+    } else {
+
+        Index = 0;
+        RestartKey = NULL;
+
+        while (TRUE) {
+
+            LengthTableEntry = (PLENGTH_TABLE_ENTRY)(
+                EnumerateTable(&LengthTable->Avl, &RestartKey)
+            );
+
+            if (!LengthTableEntry) {
+                break;
+            }
+
+            ListHead = &LengthTableEntry->LengthListHead;
+
+            for (ListEntry = ListHead->Flink;
+                 ListEntry != ListHead;
+                 ListEntry = ListEntry->Flink) {
+
+                WordTableEntry = CONTAINING_RECORD(ListEntry,
+                                                   WORD_TABLE_ENTRY,
+                                                   LengthListEntry);
+
+                Words[Index++] = &WordTableEntry->WordEntry;
+            }
+        }
+
+        ASSERT(Index == NumberOfWords);
+    }
+
+    for (Index = 0; Index < NumberOfWords; Index++) {
+        LongestWordLength = max(LongestWordLength, Words[Index]->String.Length);
+    }
+
+    SortedWords = SortWordEntries(Words, Temp, NumberOfWords);
+
+    //
+    // Make a sizing pass over the blocks, then allocate the buffer.
+    //
+
+    NumberOfBlocks = 0;
+    SizeInBytes = 0;
+
+    for (Index = 0; Index < NumberOfWords; Index += Count) {
+        SizeInBytes += EncodeExportBlock(SortedWords + Index,
+                                         NumberOfWords - Index,
+                                         NULL,
+                                         &Count);
+        NumberOfBlocks++;
+    }
+
+    Offset = (
+        sizeof(DICTIONARY_EXPORT_HEADER) +
+        ((ULONGLONG)NumberOfBlocks * sizeof(ULONGLONG))
+    );
+
+    SizeInBytes += Offset;
+
+    Output = (PBYTE)Allocator->Calloc(Allocator, 1, (SIZE_T)SizeInBytes);
+    if (!Output) {
+        goto Error;
+    }
+
+    Header = (PDICTIONARY_EXPORT_HEADER)Output;
+    Header->Signature = DICTIONARY_EXPORT_SIGNATURE;
+    Header->Version = DICTIONARY_EXPORT_VERSION;
+    Header->SizeOfHeader = sizeof(*Header);
+    Header->SizeInBytes = SizeInBytes;
+    Header->NumberOfWords = NumberOfWords;
+    Header->NumberOfBlocks = NumberOfBlocks;
+    Header->LongestWordLength = LongestWordLength;
+
+    BlockOffsets = (PULONGLONG)(Header + 1);
+
+    //
+    // Write the blocks.
+    //
+
+    NumberOfBlocks = 0;
+
+    for (Index = 0; Index < NumberOfWords; Index += Count) {
+
+        BlockOffsets[NumberOfBlocks++] = Offset;
+
+        BlockSize = EncodeExportBlock(SortedWords + Index,
+                                      NumberOfWords - Index,
+                                      Output + Offset,
+                                      &Count);
+        Offset += BlockSize;
+    }
+
+    ASSERT(Offset == SizeInBytes);
+    ASSERT(NumberOfBlocks == Header->NumberOfBlocks);
+
+    *BufferPointer = Output;
+    *SizeInBytesPointer = SizeInBytes;
+
+    if (ARGUMENT_PRESENT(NumberOfBlocksPointer)) {
+        *NumberOfBlocksPointer = NumberOfBlocks;
+    }
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    if (Output) {
+        Allocator->FreePointer(Allocator, (PPVOID)&Output);
+    }
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    ReleaseDictionaryLockShared(&Dictionary->Lock);
+
+    if (Words) {
+        Allocator->FreePointer(Allocator, (PPVOID)&Words);
+    }
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+ExportDictionary(
+    PDICTIONARY Dictionary,
+    PALLOCATOR Allocator,
+    PVOID *BufferPointer,
+    PULONGLONG SizeInBytesPointer,
+    PULONG NumberOfBlocksPointer
+    )
+/*++
+
+Routine Description:
+
+    Exports the words of a dictionary to a buffer suitable for
+    ImportDictionary().  See ExportDictionaryEx() for details.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure to export.
+
+    Allocator - Supplies a pointer to the allocator used to allocate the
+        buffer.
+
+    BufferPointer - Supplies the address of a variable that receives the
+        address of the buffer.  Set to NULL on error.
+
+    SizeInBytesPointer - Supplies the address of a variable that receives the
+        size of the buffer, in bytes.
+
+    NumberOfBlocksPointer - Optionally supplies the address of a variable that
+        receives the number of blocks in the export.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    return ExportDictionaryEx(Dictionary,
+                              Allocator,
+                              BufferPointer,
+                              SizeInBytesPointer,
+                              NumberOfBlocksPointer,
+                              NULL);
+}
+
+_Use_decl_annotations_
+BOOLEAN
+ImportDictionary(
+    PDICTIONARY Dictionary,
+    PCVOID Buffer,
+    ULONGLONG SizeInBytes,
+    ULONG FirstBlock,
+    ULONG NumberOfBlocks,
+    PULONGLONG NumberOfWordsPointer
+    )
+/*++
+
+Routine Description:
+
+    Adds the words of a buffer produced by ExportDictionary() to a dictionary.
+    Each word is added once with its exported entry count (as if AddWord() had
+    been called that many times), and its maximum entry count is raised to the
+    exported maximum entry count if that is greater.  The dictionary's
+    exclusive lock is acquired once for the entire import.
+
+    Words whose lengths are outside of the dictionary's minimum and maximum
+    word lengths are ignored.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure to which the
+        words are to be added.
+
+    Buffer - Supplies a pointer to the export buffer.
+
+    SizeInBytes - Supplies the size of the buffer, in bytes.
+
+    FirstBlock - Supplies the index of the first block to import.
+
+    NumberOfBlocks - Supplies the number of blocks to import.  If 0, all of
+        the blocks from the first block onward are imported.  (Ranges of blocks
+        can be imported into separate dictionaries in parallel and then
+        combined with MergeDictionaries(); as each word appears in exactly one
+        block, the entry counts are preserved.)
+
+    NumberOfWordsPointer - Optionally supplies the address of a variable that
+        receives the number of words added to the dictionary.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if the buffer
+    is malformed, if the dictionary has been frozen, or if a write-ahead log
+    is open and the additions could not be written to it.  If an error occurs
+    part way through the import, the words preceding the failure will have
+    been added.
+
+--*/
+{
+    ULONG Index;
+    ULONG Length;
+    ULONG WordIndex;
+    ULONG PreviousLength;
+    ULONG LastBlock;
+    BOOLEAN Success;
+    PBYTE WordBuffer;
+    PCBYTE Base;
+    PCBYTE End;
+    PCBYTE Cursor;
+    ULONGLONG Offset;
+    ULONGLONG Shared;
+    ULONGLONG Suffix;
+    ULONGLONG Count;
+    ULONGLONG Extra;
+    ULONGLONG NumberOfWords;
+    ULONGLONG Sequence;
+    LONGLONG EntryCount;
+    LONGLONG MaximumEntryCount;
+    PULONGLONG BlockOffsets;
+    PALLOCATOR Allocator;
+    PDICTIONARY_LOG Log;
+    PWORD_ENTRY WordEntry;
+    PPREFIX_NODE PrefixNode;
+    PCDICTIONARY_EXPORT_HEADER Header;
+    PCDICTIONARY_EXPORT_BLOCK_HEADER BlockHeader;
+
+    //
+    // Validate arguments.
+    //
+
+    if (ARGUMENT_PRESENT(NumberOfWordsPointer)) {
+        *NumberOfWordsPointer = 0;
+    }
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Buffer)) {
+        return FALSE;
+    }
+
+    //
+    // Validate the header and the block range.
+    //
+
+    Base = (PCBYTE)Buffer;
+    Header = (PCDICTIONARY_EXPORT_HEADER)Buffer;
+
+    if (SizeInBytes < sizeof(*Header) ||
+        Header->Signature != DICTIONARY_EXPORT_SIGNATURE ||
+        Header->Version != DICTIONARY_EXPORT_VERSION ||
+        Header->SizeOfHeader != sizeof(*Header) ||
+        Header->SizeInBytes > SizeInBytes ||
+        Header->SizeInBytes < sizeof(*Header) +
+            ((ULONGLONG)Header->NumberOfBlocks * sizeof(ULONGLONG))) {
+        return FALSE;
+    }
+
+    if (FirstBlock > Header->NumberOfBlocks) {
+        return FALSE;
+    }
+
+    if (NumberOfBlocks == 0) {
+        NumberOfBlocks = Header->NumberOfBlocks - FirstBlock;
+    }
+
+    if ((ULONGLONG)FirstBlock + NumberOfBlocks > Header->NumberOfBlocks) {
+        return FALSE;
+    }
+
+    LastBlock = FirstBlock + NumberOfBlocks;
+    BlockOffsets = (PULONGLONG)(Header + 1);
+
+    //
+    // Allocate a buffer for reconstructing words.
+    //
+
+    Allocator = Dictionary->Allocator;
+    WordBuffer = (PBYTE)(
+        Allocator->Calloc(Allocator,
+                          1,
+                          (SIZE_T)Header->LongestWordLength + 1)
+    );
+
+    if (!WordBuffer) {
+        return FALSE;
+    }
+
+    NumberOfWords = 0;
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+
+    Log = BeginDictionaryLogOperation(Dictionary, &Sequence);
+
+    if (Dictionary->Flags.IsFrozen) {
+        goto Error;
+    }
+
+    for (Index = FirstBlock; Index < LastBlock; Index++) {
+
+        //
+        // Validate the block's bounds and checksum.
+        //
+
+        Offset = BlockOffsets[Index];
+
+        if (Offset > Header->SizeInBytes ||
+            Header->SizeInBytes - Offset < sizeof(*BlockHeader)) {
+            goto Error;
+        }
+
+        BlockHeader = (PCDICTIONARY_EXPORT_BLOCK_HEADER)(Base + Offset);
+
+        if (BlockHeader->SizeInBytes < sizeof(*BlockHeader) ||
+            BlockHeader->SizeInBytes > Header->SizeInBytes - Offset) {
+            goto Error;
+        }
+
+        Cursor = (PCBYTE)(BlockHeader + 1);
+        End = Base + Offset + BlockHeader->SizeInBytes;
+
+        if (CalculateExportChecksum(Cursor, End - Cursor) !=
+            BlockHeader->Checksum) {
+            goto Error;
+        }
+
+        //
+        // Decode the block's words.
+        //
+
+        PreviousLength = 0;
+
+        for (WordIndex = 0;
+             WordIndex < BlockHeader->NumberOfWords;
+             WordIndex++) {
+
+            if (!DecodeVarint(&Cursor, End, &Shared) ||
+                !DecodeVarint(&Cursor, End, &Suffix)) {
+                goto Error;
+            }
+
+            if (Shared > PreviousLength ||
+                Suffix > Header->LongestWordLength - Shared ||
+                Suffix > (ULONGLONG)(End - Cursor)) {
+                goto Error;
+            }
+
+            CopyMemory(WordBuffer + Shared, Cursor, (SIZE_T)Suffix);
+            Cursor += Suffix;
+
+            Length = (ULONG)(Shared + Suffix);
+            PreviousLength = Length;
+
+            if (!DecodeVarint(&Cursor, End, &Count) ||
+                !DecodeVarint(&Cursor, End, &Extra)) {
+                goto Error;
+            }
+
+            if (Count == 0 ||
+                Count > MAXLONGLONG ||
+                Extra > (ULONGLONG)MAXLONGLONG - Count) {
+                goto Error;
+            }
+
+            if (Length < Dictionary->MinimumWordLength ||
+                Length > Dictionary->MaximumWordLength) {
+                continue;
+            }
+
+            Success = AddWordEntry(Dictionary,
+                                   WordBuffer,
+                                   Length,
+                                   (LONGLONG)Count,
+                                   (PCWORD_ENTRY *)&WordEntry,
+                                   &EntryCount);
+
+            if (!Success) {
+                goto Error;
+            }
+
+            //
+            // Raise the maximum entry count to the exported value if needed,
+            // in both the word entry and its prefix index node (if any).
+            //
+
+            MaximumEntryCount = (LONGLONG)(Count + Extra);
+
+            if (MaximumEntryCount > WordEntry->Stats.MaximumEntryCount) {
+
+                WordEntry->Stats.MaximumEntryCount = MaximumEntryCount;
+
+                if (Dictionary->PrefixIndex) {
+                    PrefixNode = FindPrefixIndexNode(Dictionary,
+                                                     WordBuffer,
+                                                     Length);
+                    if (PrefixNode) {
+                        PrefixNode->Stats.MaximumEntryCount =
+                            MaximumEntryCount;
+                    }
+                }
+            }
+
+            NumberOfWords++;
+        }
+
+        if (Cursor != End) {
+            goto Error;
+        }
+    }
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    Sequence = EndDictionaryLogOperation(Log, Sequence);
+
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    //
+    // If a write-ahead log is open, wait for the additions to become durable.
+    //
+
+    if (Log && !WaitForDictionaryLog(Log, Sequence)) {
+        Success = FALSE;
+    }
+
+    Allocator->FreePointer(Allocator, (PPVOID)&WordBuffer);
+
+    if (ARGUMENT_PRESENT(NumberOfWordsPointer)) {
+        *NumberOfWordsPointer = NumberOfWords;
+    }
+
+    return Success;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
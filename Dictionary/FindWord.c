@@ -63,7 +63,9 @@ Return Value:
     returned and the caller's WordTableEntryPointer output parameter will
     be set to NULL.
 
-    If TRUE is returned, both the Bitmap and Histogram will be filled out.
+    If TRUE is returned, both the Bitmap and Histogram will be filled out,
+    unless the word has a packed or sparse histogram (see InitializeWord()),
+    in which case only the Bitmap will be.
 
 --*/
 {
@@ -203,10 +205,47 @@ Return Value:
     }
 
     //
-    // Update the TLS context and initialize the word entry alias.
+    // Update the TLS context.
     //
 
     Context->HistogramTableEntry = HistogramTableEntry;
+
+    if (HistogramTableEntryHasInlineWord(HistogramTableEntry)) {
+
+        //
+        // The histogram entry only has a single word, which is stored inline.
+        // Compare it directly; there's no word table to search.
+        //
+
+        WordTableEntry = &HistogramTableEntry->InlineWordTableEntry;
+
+        if (!IsSameWord(&WordTableEntry->WordEntry.String, String)) {
+
+            //
+            // No inline word match.
+            //
+
+            goto End;
+        }
+
+        //
+        // We found the word!  Update the TLS context and the caller's pointer.
+        // The TLS context's word table is set to NULL, which indicates to
+        // callers that the word is being stored inline.
+        //
+
+        Context->WordTable = NULL;
+        Context->WordTableEntry = WordTableEntry;
+
+        *WordTableEntryPointer = WordTableEntry;
+
+        goto End;
+    }
+
+    //
+    // Initialize the word table alias and search for the word.
+    //
+
     WordTable = &HistogramTableEntry->WordTable;
 
     WordTableEntry = RtlLookupElementGenericTableAvl(&WordTable->Avl,
@@ -274,6 +313,8 @@ Return Value:
 --*/
 {
     BOOL Success;
+    BOOLEAN IsLocked;
+    PWORD_ENTRY WordEntry;
     CHARACTER_BITMAP Bitmap;
     DICTIONARY_CONTEXT Context;
     CHARACTER_HISTOGRAM Histogram;
@@ -296,12 +337,12 @@ Return Value:
     }
 
     //
-    // Zero the context, bitmap and histogram structures.
+    // Zero the context and bitmap structures.  (The histogram is zeroed by
+    // InitializeWord() if a full histogram is required.)
     //
 
     ZeroStruct(Context);
     ZeroStruct(Bitmap);
-    ZeroStruct(Histogram);
 
     //
     // Set the TLS context.
@@ -311,18 +352,49 @@ Return Value:
     DictionaryTlsSetContext(&Context);
 
     //
-    // Acquire the dictionary lock and attempt to find the word.
+    // Frozen dictionaries are immutable, so they can be searched without the
+    // lock.  Otherwise, acquire the lock in shared mode, and then check the
+    // frozen flag again, as the dictionary may have been frozen whilst we
+    // were waiting for the lock.  The lock is also acquired if the call is
+    // being recorded, as the recorder may only be dereferenced whilst the lock
+    // is held.
     //
 
-    AcquireDictionaryLockShared(&Dictionary->Lock);
+    IsLocked = FALSE;
+
+    if (!Dictionary->Flags.IsFrozen || Dictionary->Recorder) {
+        AcquireDictionaryLockShared(&Dictionary->Lock);
+        IsLocked = TRUE;
+    }
+
+    if (IsLocked && Dictionary->Recorder) {
+        RecordDictionaryOperation(Dictionary,
+                                  DictionaryRecordFindWordOperation,
+                                  Word);
+    }
 
-    Success = FindWordTableEntry(Dictionary,
-                                 Word,
-                                 &Bitmap,
-                                 &Histogram,
-                                 &WordTableEntry);
+    if (Dictionary->Flags.IsFrozen) {
 
-    if (!Success || WordTableEntry == NULL) {
+        Success = FindFrozenWordEntry(Dictionary,
+                                      GetLocalFrozenDictionary(Dictionary),
+                                      Word,
+                                      &Bitmap,
+                                      &Histogram,
+                                      NULL,
+                                      &WordEntry);
+
+    } else {
+
+        Success = FindWordTableEntry(Dictionary,
+                                     Word,
+                                     &Bitmap,
+                                     &Histogram,
+                                     &WordTableEntry);
+
+        WordEntry = (WordTableEntry ? &WordTableEntry->WordEntry : NULL);
+    }
+
+    if (!Success || WordEntry == NULL) {
 
         //
         // No match found.
@@ -341,10 +413,12 @@ Return Value:
     }
 
     //
-    // Release the lock and indicate success.
+    // Release the lock (if applicable) and indicate success.
     //
 
-    ReleaseDictionaryLockShared(&Dictionary->Lock);
+    if (IsLocked) {
+        ReleaseDictionaryLockShared(&Dictionary->Lock);
+    }
 
     return TRUE;
 }
@@ -0,0 +1,1002 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    Freeze.c
+
+Abstract:
+
+    This module implements frozen (read-only) dictionary support.  The public
+    FreezeDictionary() routine converts a dictionary's AVL table cascade into
+    a single allocation of sorted arrays laid out in Eytzinger order (see the
+    FROZEN_DICTIONARY structure for details), then releases the tables.  The
+    private FindFrozenWordEntry() routine services lookups against the frozen
+    representation; it is used by FindWord() and GetWordAnagrams().
+
+    Once frozen, a dictionary can no longer be modified; AddWord(), RemoveWord()
+    and CompactDictionary() will return FALSE.
+
+--*/
+
+#include "stdafx.h"
+
+//
+// Eytzinger layout helpers.  All indices are 1-based; an index of 0 indicates
+// the end of the sequence (or "not found").
+//
+
+FORCEINLINE
+ULONG
+EytzingerFirst(
+    _In_ ULONG NumberOfElements
+    )
+/*++
+
+Routine Description:
+
+    Returns the index of the smallest element in an Eytzinger array, which is
+    the leftmost node of the implicit tree.
+
+--*/
+{
+    ULONGLONG Index;
+
+    if (NumberOfElements == 0) {
+        return 0;
+    }
+
+    Index = 1;
+    while ((Index << 1) <= NumberOfElements) {
+        Index <<= 1;
+    }
+
+    return (ULONG)Index;
+}
+
+FORCEINLINE
+ULONG
+EytzingerNext(
+    _In_ ULONG Index,
+    _In_ ULONG NumberOfElements
+    )
+/*++
+
+Routine Description:
+
+    Returns the index of the in-order successor of a given element in an
+    Eytzinger array, or 0 if the element is the largest.
+
+--*/
+{
+    ULONGLONG Next;
+
+    Next = ((ULONGLONG)Index << 1) + 1;
+
+    if (Next <= NumberOfElements) {
+
+        //
+        // Descend to the leftmost node of the right subtree.
+        //
+
+        while ((Next << 1) <= NumberOfElements) {
+            Next <<= 1;
+        }
+
+        return (ULONG)Next;
+    }
+
+    //
+    // Ascend past all ancestors of which we're the right child, and then one
+    // more (the first ancestor of which we're in the left subtree).
+    //
+
+    Next = Index;
+    Next >>= TrailingZeros64(~Next) + 1;
+
+    return (ULONG)Next;
+}
+
+FORCEINLINE
+ULONG
+EytzingerLowerBoundKey(
+    _In_reads_(NumberOfElements + 1) PULONGLONG Keys,
+    _In_ ULONG NumberOfElements,
+    _In_ ULONGLONG Key
+    )
+/*++
+
+Routine Description:
+
+    Returns the index of the first element in an Eytzinger array of 64-bit
+    keys that is greater than or equal to the given key, or 0 if all elements
+    are less than the key.
+
+    Each iteration descends one level without branching on the comparison.
+    Eight 64-bit keys fit in a cache line, so the line holding the eight
+    great-grandchildren of the current node (which are contiguous) is
+    prefetched three levels ahead.
+
+--*/
+{
+    ULONGLONG Index;
+
+    Index = 1;
+
+    while (Index <= NumberOfElements) {
+        PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, &Keys[Index << 3]);
+        Index = (Index << 1) + (Keys[Index] < Key);
+    }
+
+    Index >>= TrailingZeros64(~Index) + 1;
+
+    return (ULONG)Index;
+}
+
+FORCEINLINE
+ULONG
+EytzingerLowerBoundHash(
+    _In_reads_(NumberOfElements + 1) PULONG Hashes,
+    _In_ ULONG NumberOfElements,
+    _In_ ULONG Hash
+    )
+/*++
+
+Routine Description:
+
+    32-bit variant of EytzingerLowerBoundKey().  Sixteen hashes fit in a cache
+    line, so the prefetch targets the great-great-grandchildren.
+
+--*/
+{
+    ULONGLONG Index;
+
+    Index = 1;
+
+    while (Index <= NumberOfElements) {
+        PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, &Hashes[Index << 4]);
+        Index = (Index << 1) + (Hashes[Index] < Hash);
+    }
+
+    Index >>= TrailingZeros64(~Index) + 1;
+
+    return (ULONG)Index;
+}
+
+//
+// Table release routines.  These free table nodes (and word strings) in
+// post-order without rebalancing the trees, as the tables are discarded in
+// their entirety.
+//
+
+_Use_decl_annotations_
+VOID
+FreeWordTableNodes(
+    PDICTIONARY Dictionary,
+    PRTL_AVL_TABLE Avl,
+    PRTL_BALANCED_LINKS Links
+    )
+{
+    PLONG_STRING String;
+    PTABLE_ENTRY_HEADER Header;
+
+    if (!Links) {
+        return;
+    }
+
+    FreeWordTableNodes(Dictionary, Avl, Links->LeftChild);
+    FreeWordTableNodes(Dictionary, Avl, Links->RightChild);
+
+    Header = (PTABLE_ENTRY_HEADER)Links;
+    String = &Header->WordTableEntry.WordEntry.String;
+
+    if (!Header->IsInlineString) {
+        FreeWordStringBuffer(Dictionary,
+                             WordStringArenaChunk(Header),
+                             String->Buffer);
+    }
+
+    Avl->FreeRoutine(Avl, Header);
+}
+
+_Use_decl_annotations_
+VOID
+FreeHistogramTableNodes(
+    PDICTIONARY Dictionary,
+    PRTL_AVL_TABLE Avl,
+    PRTL_BALANCED_LINKS Links
+    )
+{
+    PLONG_STRING String;
+    PRTL_AVL_TABLE WordAvl;
+    PTABLE_ENTRY_HEADER Header;
+    PHISTOGRAM_TABLE_ENTRY HistogramTableEntry;
+
+    if (!Links) {
+        return;
+    }
+
+    FreeHistogramTableNodes(Dictionary, Avl, Links->LeftChild);
+    FreeHistogramTableNodes(Dictionary, Avl, Links->RightChild);
+
+    Header = (PTABLE_ENTRY_HEADER)Links;
+    HistogramTableEntry = &Header->HistogramTableEntry;
+
+    if (Header->HasInlineWord) {
+
+        String = &HistogramTableEntry->InlineWordTableEntry.WordEntry.String;
+
+        if (!Header->IsInlineString) {
+            FreeWordStringBuffer(Dictionary,
+                                 WordStringArenaChunk(Header),
+                                 String->Buffer);
+        }
+
+    } else {
+
+        WordAvl = &HistogramTableEntry->WordTable.Avl;
+        FreeWordTableNodes(Dictionary,
+                           WordAvl,
+                           WordAvl->BalancedRoot.RightChild);
+    }
+
+    Avl->FreeRoutine(Avl, Header);
+}
+
+_Use_decl_annotations_
+VOID
+FreeBitmapTableNodes(
+    PDICTIONARY Dictionary,
+    PRTL_AVL_TABLE Avl,
+    PRTL_BALANCED_LINKS Links
+    )
+{
+    PRTL_AVL_TABLE HistogramAvl;
+    PTABLE_ENTRY_HEADER Header;
+
+    if (!Links) {
+        return;
+    }
+
+    FreeBitmapTableNodes(Dictionary, Avl, Links->LeftChild);
+    FreeBitmapTableNodes(Dictionary, Avl, Links->RightChild);
+
+    Header = (PTABLE_ENTRY_HEADER)Links;
+    HistogramAvl = &Header->BitmapTableEntry.HistogramTable.Avl;
+
+    FreeHistogramTableNodes(Dictionary,
+                            HistogramAvl,
+                            HistogramAvl->BalancedRoot.RightChild);
+
+    Avl->FreeRoutine(Avl, Header);
+}
+
+_Use_decl_annotations_
+VOID
+FreeLengthTableNodes(
+    PRTL_AVL_TABLE Avl,
+    PRTL_BALANCED_LINKS Links
+    )
+{
+    if (!Links) {
+        return;
+    }
+
+    FreeLengthTableNodes(Avl, Links->LeftChild);
+    FreeLengthTableNodes(Avl, Links->RightChild);
+
+    Avl->FreeRoutine(Avl, Links);
+}
+
+_Use_decl_annotations_
+BOOLEAN
+FreezeDictionary(
+    PDICTIONARY Dictionary
+    )
+/*++
+
+Routine Description:
+
+    Freezes a dictionary.  The dictionary's AVL table cascade is converted into
+    a single, read-only allocation of Eytzinger-ordered arrays, and all table
+    nodes and word string buffers are then released.  Subsequent lookups via
+    FindWord() are serviced by the frozen representation without acquiring
+    the dictionary lock.
+
+    Once frozen, a dictionary cannot be modified: AddWord(), RemoveWord() and
+    CompactDictionary() will return FALSE.  Word entry counts, anagrams and the
+    dictionary stats are preserved.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure to freeze.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if the
+    dictionary has already been frozen.  If FALSE is returned, the dictionary
+    is left unchanged.
+
+--*/
+{
+    PRTL Rtl;
+    PBYTE Base;
+    PBYTE StringBuffer;
+    PBYTE TempBuffer;
+    ULONG Rank;
+    ULONG Index;
+    ULONG Target;
+    ULONG WordIndex;
+    ULONG LengthIndex;
+    ULONG HistogramIndex;
+    ULONG NumberOfWords;
+    ULONG NumberOfLengths;
+    ULONG NumberOfHistograms;
+    ULONG MaximumNumberOfWords;
+    ULONG NumberOfSegmentWords;
+    BOOLEAN Success;
+    SIZE_T SizeInBytes;
+    SIZE_T TempSizeInBytes;
+    ULONGLONG NumberOfStringBytes;
+    PVOID RestartKey;
+    PVOID HistogramRestartKey;
+    PVOID WordRestartKey;
+    PULONGLONG SortedKeys;
+    PALLOCATOR Allocator;
+    PWORD_ENTRY WordEntry;
+    PWORD_ENTRY *SortedWords;
+    PWORD_TABLE WordTable;
+    PLONG_STRING NewString;
+    PCLONG_STRING String;
+    PBITMAP_TABLE BitmapTable;
+    PLENGTH_TABLE LengthTable;
+    PHISTOGRAM_TABLE HistogramTable;
+    PFROZEN_DICTIONARY Frozen;
+    PFROZEN_LENGTH_ENTRY LengthEntry;
+    PLENGTH_TABLE_ENTRY LengthTableEntry;
+    PTABLE_ENTRY_HEADER BitmapTableEntryHeader;
+    PTABLE_ENTRY_HEADER HistogramTableEntryHeader;
+    PWORD_TABLE_ENTRY WordTableEntry;
+    PBITMAP_TABLE_ENTRY BitmapTableEntry;
+    PHISTOGRAM_TABLE_ENTRY HistogramTableEntry;
+    PFROZEN_HISTOGRAM_ENTRY SortedEntries;
+    PRTL_ENUMERATE_GENERIC_TABLE_WITHOUT_SPLAYING_AVL EnumerateTable;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    //
+    // Initialize aliases.
+    //
+
+    Rtl = Dictionary->Rtl;
+    Allocator = Dictionary->Allocator;
+    EnumerateTable = Rtl->RtlEnumerateGenericTableWithoutSplayingAvl;
+    BitmapTable = &Dictionary->BitmapTable;
+    LengthTable = &Dictionary->LengthTable;
+
+    Frozen = NULL;
+    TempBuffer = NULL;
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+
+    if (Dictionary->Flags.IsFrozen) {
+        goto Error;
+    }
+
+    //
+    // Make an initial pass over the tables to determine the number of
+    // histograms, words and string bytes, plus the maximum number of words
+    // sharing a single histogram.
+    //
+
+    NumberOfWords = 0;
+    NumberOfHistograms = 0;
+    NumberOfStringBytes = 0;
+    MaximumNumberOfWords = 0;
+    NumberOfLengths = Rtl->RtlNumberGenericTableElementsAvl(&LengthTable->Avl);
+
+    RestartKey = NULL;
+
+    while (TRUE) {
+
+        BitmapTableEntry = (PBITMAP_TABLE_ENTRY)(
+            EnumerateTable(&BitmapTable->Avl, &RestartKey)
+        );
+
+        if (!BitmapTableEntry) {
+            break;
+        }
+
+        HistogramTable = &BitmapTableEntry->HistogramTable;
+        HistogramRestartKey = NULL;
+
+        while (TRUE) {
+
+            HistogramTableEntry = (PHISTOGRAM_TABLE_ENTRY)(
+                EnumerateTable(&HistogramTable->Avl, &HistogramRestartKey)
+            );
+
+            if (!HistogramTableEntry) {
+                break;
+            }
+
+            NumberOfHistograms++;
+
+            if (HistogramTableEntryHasInlineWord(HistogramTableEntry)) {
+                WordEntry = &HistogramTableEntry->InlineWordTableEntry.WordEntry;
+                NumberOfWords++;
+                NumberOfStringBytes += WordEntry->String.Length + 1;
+                MaximumNumberOfWords = max(MaximumNumberOfWords, 1);
+                continue;
+            }
+
+            WordTable = &HistogramTableEntry->WordTable;
+            NumberOfSegmentWords = 0;
+            WordRestartKey = NULL;
+
+            while (TRUE) {
+
+                WordTableEntry = (PWORD_TABLE_ENTRY)(
+                    EnumerateTable(&WordTable->Avl, &WordRestartKey)
+                );
+
+                if (!WordTableEntry) {
+                    break;
+                }
+
+                WordEntry = &WordTableEntry->WordEntry;
+                NumberOfSegmentWords++;
+                NumberOfStringBytes += WordEntry->String.Length + 1;
+            }
+
+            NumberOfWords += NumberOfSegmentWords;
+            MaximumNumberOfWords = max(MaximumNumberOfWords,
+                                       NumberOfSegmentWords);
+        }
+    }
+
+    //
+    // Calculate the size of the frozen allocation.  The histogram keys are
+    // aligned to a cache line, which requires up to an additional line's
+    // worth of padding.
+    //
+
+    SizeInBytes = (
+        ALIGN_UP(sizeof(FROZEN_DICTIONARY), 8) +
+        (FROZEN_CACHE_LINE_SIZE - 1) +
+        (sizeof(ULONGLONG) * ((SIZE_T)NumberOfHistograms + 1)) +
+        (sizeof(FROZEN_HISTOGRAM_ENTRY) * ((SIZE_T)NumberOfHistograms + 1)) +
+        ALIGN_UP((sizeof(ULONG) * (SIZE_T)NumberOfWords * 2) +
+                 (sizeof(FROZEN_LENGTH_ENTRY) * (SIZE_T)NumberOfLengths), 8) +
+        (sizeof(WORD_ENTRY) * (SIZE_T)NumberOfWords) +
+        NumberOfStringBytes
+    );
+
+    Base = (PBYTE)Allocator->Calloc(Allocator, 1, SizeInBytes);
+    if (!Base) {
+        goto Error;
+    }
+
+    //
+    // Carve out the arrays.
+    //
+
+    Frozen = (PFROZEN_DICTIONARY)Base;
+    Frozen->SizeInBytes = SizeInBytes;
+    Frozen->NumberOfStringBytes = NumberOfStringBytes;
+    Frozen->NumberOfHistograms = NumberOfHistograms;
+    Frozen->NumberOfWords = NumberOfWords;
+    Frozen->NumberOfLengths = NumberOfLengths;
+
+    Frozen->HistogramKeys = (PULONGLONG)(
+        ALIGN_UP(Base + sizeof(FROZEN_DICTIONARY),
+                 FROZEN_CACHE_LINE_SIZE)
+    );
+
+    Frozen->HistogramEntries = (PFROZEN_HISTOGRAM_ENTRY)(
+        Frozen->HistogramKeys + NumberOfHistograms + 1
+    );
+
+    Frozen->WordHashes = (PULONG)(
+        Frozen->HistogramEntries + NumberOfHistograms + 1
+    );
+
+    Frozen->LengthOrderedWords = Frozen->WordHashes + NumberOfWords;
+
+    Frozen->LengthEntries = (PFROZEN_LENGTH_ENTRY)(
+        Frozen->LengthOrderedWords + NumberOfWords
+    );
+
+    Frozen->WordEntries = (PWORD_ENTRY)(
+        ALIGN_UP(Frozen->LengthEntries + NumberOfLengths, 8)
+    );
+
+    StringBuffer = (PBYTE)(Frozen->WordEntries + NumberOfWords);
+
+    ASSERT(StringBuffer + NumberOfStringBytes <= Base + SizeInBytes);
+
+    //
+    // Allocate a temporary buffer to hold the sorted histogram keys and
+    // entries, as well as the sorted words of a single histogram.
+    //
+
+    TempSizeInBytes = (
+        (sizeof(ULONGLONG) * (SIZE_T)NumberOfHistograms) +
+        (sizeof(FROZEN_HISTOGRAM_ENTRY) * (SIZE_T)NumberOfHistograms) +
+        (sizeof(PWORD_ENTRY) * (SIZE_T)MaximumNumberOfWords)
+    );
+
+    if (TempSizeInBytes > 0) {
+        TempBuffer = (PBYTE)Allocator->Calloc(Allocator, 1, TempSizeInBytes);
+        if (!TempBuffer) {
+            goto Error;
+        }
+    }
+
+    SortedKeys = (PULONGLONG)TempBuffer;
+    SortedEntries = (PFROZEN_HISTOGRAM_ENTRY)(SortedKeys + NumberOfHistograms);
+    SortedWords = (PWORD_ENTRY *)(SortedEntries + NumberOfHistograms);
+
+    //
+    // Make a second pass over the tables.  Enumerating bitmaps in hash order,
+    // then each bitmap's histograms in hash order, yields the histogram keys
+    // in sorted order.  Each histogram's words are captured in sorted order
+    // and then written out to their segment in Eytzinger order.
+    //
+
+    WordIndex = 0;
+    HistogramIndex = 0;
+    RestartKey = NULL;
+
+    while (TRUE) {
+
+        BitmapTableEntry = (PBITMAP_TABLE_ENTRY)(
+            EnumerateTable(&BitmapTable->Avl, &RestartKey)
+        );
+
+        if (!BitmapTableEntry) {
+            break;
+        }
+
+        BitmapTableEntryHeader = TABLE_ENTRY_TO_HEADER(BitmapTableEntry);
+        HistogramTable = &BitmapTableEntry->HistogramTable;
+        HistogramRestartKey = NULL;
+
+        while (TRUE) {
+
+            HistogramTableEntry = (PHISTOGRAM_TABLE_ENTRY)(
+                EnumerateTable(&HistogramTable->Avl, &HistogramRestartKey)
+            );
+
+            if (!HistogramTableEntry) {
+                break;
+            }
+
+            HistogramTableEntryHeader =
+                TABLE_ENTRY_TO_HEADER(HistogramTableEntry);
+
+            //
+            // Capture the histogram's words in sorted order.
+            //
+
+            NumberOfSegmentWords = 0;
+
+            if (HistogramTableEntryHasInlineWord(HistogramTableEntry)) {
+
+                SortedWords[NumberOfSegmentWords++] =
+                    &HistogramTableEntry->InlineWordTableEntry.WordEntry;
+
+            } else {
+
+                WordTable = &HistogramTableEntry->WordTable;
+                WordRestartKey = NULL;
+
+                while (TRUE) {
+
+                    WordTableEntry = (PWORD_TABLE_ENTRY)(
+                        EnumerateTable(&WordTable->Avl, &WordRestartKey)
+                    );
+
+                    if (!WordTableEntry) {
+                        break;
+                    }
+
+                    SortedWords[NumberOfSegmentWords++] =
+                        &WordTableEntry->WordEntry;
+                }
+            }
+
+            ASSERT(NumberOfSegmentWords <= MaximumNumberOfWords);
+
+            SortedKeys[HistogramIndex] = FROZEN_HISTOGRAM_KEY(
+                BitmapTableEntryHeader->Hash,
+                HistogramTableEntryHeader->Hash
+            );
+
+            SortedEntries[HistogramIndex].FirstWord = WordIndex;
+            SortedEntries[HistogramIndex].NumberOfWords = NumberOfSegmentWords;
+            HistogramIndex++;
+
+            //
+            // Write the words out to the segment in Eytzinger order.  The
+            // string buffers are laid out in sorted order.
+            //
+
+            Index = EytzingerFirst(NumberOfSegmentWords);
+
+            for (Rank = 0; Rank < NumberOfSegmentWords; Rank++) {
+
+                ASSERT(Index != 0);
+
+                WordEntry = SortedWords[Rank];
+                String = &WordEntry->String;
+
+                Target = WordIndex + Index - 1;
+                Frozen->WordHashes[Target] = String->Hash;
+                Frozen->WordEntries[Target].Stats = WordEntry->Stats;
+
+                NewString = &Frozen->WordEntries[Target].String;
+                NewString->Length = String->Length;
+                NewString->Hash = String->Hash;
+                NewString->Buffer = StringBuffer;
+
+                CopyMemory(StringBuffer, String->Buffer, String->Length + 1);
+                StringBuffer += String->Length + 1;
+
+                //
+                // Update the dictionary stats if they refer to this word.
+                //
+
+                if (Dictionary->Stats.CurrentLongestWord == String) {
+                    Dictionary->Stats.CurrentLongestWord = NewString;
+                }
+
+                if (Dictionary->Stats.LongestWordAllTime == String) {
+                    Dictionary->Stats.LongestWordAllTime = NewString;
+                }
+
+                Index = EytzingerNext(Index, NumberOfSegmentWords);
+            }
+
+            ASSERT(Index == 0);
+
+            WordIndex += NumberOfSegmentWords;
+        }
+    }
+
+    ASSERT(WordIndex == NumberOfWords);
+    ASSERT(HistogramIndex == NumberOfHistograms);
+    ASSERT(StringBuffer == (
+        (PBYTE)(Frozen->WordEntries + NumberOfWords) + NumberOfStringBytes
+    ));
+
+    //
+    // Write the histogram keys and entries out in Eytzinger order.
+    //
+
+    Index = EytzingerFirst(NumberOfHistograms);
+
+    for (Rank = 0; Rank < NumberOfHistograms; Rank++) {
+        ASSERT(Index != 0);
+        Frozen->HistogramKeys[Index] = SortedKeys[Rank];
+        Frozen->HistogramEntries[Index] = SortedEntries[Rank];
+        Index = EytzingerNext(Index, NumberOfHistograms);
+    }
+
+    ASSERT(Index == 0);
+
+    //
+    // Capture the distinct word lengths from the length table, which are
+    // enumerated in ascending order.
+    //
+
+    LengthIndex = 0;
+    RestartKey = NULL;
+
+    while (TRUE) {
+
+        LengthTableEntry = (PLENGTH_TABLE_ENTRY)(
+            EnumerateTable(&LengthTable->Avl, &RestartKey)
+        );
+
+        if (!LengthTableEntry) {
+            break;
+        }
+
+        ASSERT(LengthIndex < NumberOfLengths);
+        LengthEntry = &Frozen->LengthEntries[LengthIndex++];
+        LengthEntry->Length = TABLE_ENTRY_TO_HEADER(LengthTableEntry)->Length;
+    }
+
+    ASSERT(LengthIndex == NumberOfLengths);
+
+    //
+    // Count the words of each length, assign each length its range of the
+    // length-ordered word index array, then fill in the array.  The number of
+    // words of each length is reset and used as the insertion cursor, and will
+    // be back to its original value once the array has been filled.
+    //
+
+    for (WordIndex = 0; WordIndex < NumberOfWords; WordIndex++) {
+        String = &Frozen->WordEntries[WordIndex].String;
+        LengthIndex = FindFrozenLengthEntryIndex(Frozen, String->Length);
+        ASSERT(LengthIndex < NumberOfLengths);
+        Frozen->LengthEntries[LengthIndex].NumberOfWords++;
+    }
+
+    Target = 0;
+
+    for (LengthIndex = 0; LengthIndex < NumberOfLengths; LengthIndex++) {
+        LengthEntry = &Frozen->LengthEntries[LengthIndex];
+        LengthEntry->FirstWord = Target;
+        Target += LengthEntry->NumberOfWords;
+        LengthEntry->NumberOfWords = 0;
+    }
+
+    ASSERT(Target == NumberOfWords);
+
+    for (WordIndex = 0; WordIndex < NumberOfWords; WordIndex++) {
+        String = &Frozen->WordEntries[WordIndex].String;
+        LengthIndex = FindFrozenLengthEntryIndex(Frozen, String->Length);
+        LengthEntry = &Frozen->LengthEntries[LengthIndex];
+        Target = LengthEntry->FirstWord + LengthEntry->NumberOfWords++;
+        Frozen->LengthOrderedWords[Target] = WordIndex;
+    }
+
+    //
+    // Create the NUMA replicas of the frozen dictionary if requested.
+    //
+
+    if (Dictionary->Flags.UseNumaReplicas) {
+        if (!CreateFrozenDictionaryReplicas(Dictionary, Frozen)) {
+            goto Error;
+        }
+    }
+
+    //
+    // The frozen representation is complete.  Release all table nodes and
+    // string buffers, then reinitialize the (now empty) top-level tables.
+    //
+
+    FreeBitmapTableNodes(Dictionary,
+                         &BitmapTable->Avl,
+                         BitmapTable->Avl.BalancedRoot.RightChild);
+
+    FreeLengthTableNodes(&LengthTable->Avl,
+                         LengthTable->Avl.BalancedRoot.RightChild);
+
+    Rtl->RtlInitializeGenericTableAvl(&BitmapTable->Avl,
+                                      BitmapTableCompareRoutine,
+                                      BitmapTableAllocateRoutine,
+                                      BitmapTableFreeRoutine,
+                                      Dictionary);
+
+    Rtl->RtlInitializeGenericTableAvl(&LengthTable->Avl,
+                                      LengthTableCompareRoutine,
+                                      LengthTableAllocateRoutine,
+                                      LengthTableFreeRoutine,
+                                      Dictionary);
+
+    Dictionary->ClockHandEntry = NULL;
+    Dictionary->ClockHandRemaining = 0;
+
+    ASSERT(Dictionary->NumberOfArenaChunks == 0);
+
+    Dictionary->Flags.IsCompactionInProgress = FALSE;
+    Dictionary->CompactionCursor = 0;
+
+    //
+    // Publish the frozen representation.  FindWord() tests the IsFrozen flag
+    // without acquiring the lock, so ensure the pointer (and the replicas, if
+    // any) are visible first.
+    //
+
+    Dictionary->Frozen = Frozen;
+    MemoryBarrier();
+    Dictionary->Flags.IsFrozen = TRUE;
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    if (Frozen) {
+        Allocator->FreePointer(Allocator, (PPVOID)&Frozen);
+    }
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    if (TempBuffer) {
+        Allocator->FreePointer(Allocator, (PPVOID)&TempBuffer);
+    }
+
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+FindFrozenWordEntry(
+    PDICTIONARY Dictionary,
+    PFROZEN_DICTIONARY Frozen,
+    PCBYTE Word,
+    PCHARACTER_BITMAP Bitmap,
+    PCHARACTER_HISTOGRAM Histogram,
+    PCFROZEN_HISTOGRAM_ENTRY *HistogramEntryPointer,
+    PWORD_ENTRY *WordEntryPointer
+    )
+/*++
+
+Routine Description:
+
+    Finds the word entry for a given word in a frozen dictionary.  This is the
+    frozen counterpart of FindWordTableEntry().  As frozen dictionaries are
+    immutable, the dictionary lock does not need to be held.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to a frozen DICTIONARY structure for which
+        the given word is to be found.
+
+    Frozen - Supplies a pointer to the FROZEN_DICTIONARY structure to search.
+        This will typically be obtained via GetLocalFrozenDictionary(), which
+        returns the NUMA replica local to the caller, if applicable.
+
+    Word - Supplies a NULL-terminated array of bytes representing the word to
+        find in the dictionary.
+
+    Bitmap - Supplies a pointer to a CHARACTER_BITMAP structure that will
+        receive the corresponding bitmap representation of the incoming word.
+
+    Histogram - Supplies a pointer to a CHARACTER_HISTOGRAM structure that
+        will receive the corresponding histogram representation of the incoming
+        word.
+
+    HistogramEntryPointer - Optionally supplies the address of a variable that
+        receives the address of the frozen histogram entry of the word if it
+        was found, NULL otherwise.
+
+    WordEntryPointer - Supplies the address of a variable that receives the
+        address of the WORD_ENTRY structure representing the word if it was
+        found, NULL otherwise.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  If no word is found, TRUE will be
+    returned and the caller's WordEntryPointer will be set to NULL.
+
+--*/
+{
+    ULONG Index;
+    ULONG Count;
+    ULONG BitmapHash;
+    ULONG HistogramHash;
+    PULONG Hashes;
+    ULONGLONG Key;
+    BOOLEAN Success;
+    LONG_STRING String;
+    PWORD_ENTRY WordEntries;
+    PCFROZEN_HISTOGRAM_ENTRY HistogramEntry;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Frozen)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Word)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(WordEntryPointer)) {
+        return FALSE;
+    }
+
+    //
+    // Clear the caller's pointers up-front.
+    //
+
+    *WordEntryPointer = NULL;
+
+    if (ARGUMENT_PRESENT(HistogramEntryPointer)) {
+        *HistogramEntryPointer = NULL;
+    }
+
+    //
+    // Initialize the word, which calculates the hashes used for the lookups.
+    //
+
+    ZeroStruct(String);
+
+    Success = InitializeWord(Word,
+                             Dictionary->MinimumWordLength,
+                             Dictionary->MaximumWordLength,
+                             &String,
+                             Bitmap,
+                             Histogram,
+                             &BitmapHash,
+                             &HistogramHash);
+
+    if (!Success) {
+        return FALSE;
+    }
+
+    //
+    // Find the histogram.  Keys are unique, so we only need to check the
+    // lower bound for an exact match.
+    //
+
+    Key = FROZEN_HISTOGRAM_KEY(BitmapHash, HistogramHash);
+
+    Index = EytzingerLowerBoundKey(Frozen->HistogramKeys,
+                                   Frozen->NumberOfHistograms,
+                                   Key);
+
+    if (Index == 0 || Frozen->HistogramKeys[Index] != Key) {
+
+        //
+        // No histogram match.
+        //
+
+        return TRUE;
+    }
+
+    HistogramEntry = &Frozen->HistogramEntries[Index];
+
+    //
+    // Search the histogram's word segment.  Rebase the arrays such that the
+    // segment's 1-based Eytzinger indices can be used directly.  Multiple
+    // words may share a hash, so visit each in turn (in order) until we find
+    // a match.
+    //
+
+    Count = HistogramEntry->NumberOfWords;
+    Hashes = Frozen->WordHashes + HistogramEntry->FirstWord - 1;
+    WordEntries = Frozen->WordEntries + HistogramEntry->FirstWord - 1;
+
+    Index = EytzingerLowerBoundHash(Hashes, Count, String.Hash);
+
+    while (Index != 0 && Hashes[Index] == String.Hash) {
+
+        if (IsSameWord(&WordEntries[Index].String, &String)) {
+
+            //
+            // We found the word!  Update the caller's pointers.
+            //
+
+            *WordEntryPointer = &WordEntries[Index];
+
+            if (ARGUMENT_PRESENT(HistogramEntryPointer)) {
+                *HistogramEntryPointer = HistogramEntry;
+            }
+
+            break;
+        }
+
+        Index = EytzingerNext(Index, Count);
+    }
+
+    return TRUE;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
@@ -942,4 +942,520 @@ Return Value:
     return Success;
 }
 
+FORCEINLINE
+ULONG
+HashHistogramInline(
+    _In_ ULONG Length,
+    _In_ PCCHARACTER_BITMAP Bitmap,
+    _In_ PCCHARACTER_HISTOGRAM Histogram
+    )
+/*++
+
+Routine Description:
+
+    Calculates the 32-bit hash of a word's histogram.  Only the non-zero counts
+    are hashed; these are identified by the word's bitmap, which has a bit set
+    for each character with a non-zero count.  The hash is equivalent to that
+    returned by HashPackedHistogramInline() for the same word.
+
+Arguments:
+
+    Length - Supplies the length of the word, in bytes.  This seeds the hash.
+
+    Bitmap - Supplies a pointer to the bitmap of the word.
+
+    Histogram - Supplies a pointer to the histogram of the word.
+
+Return Value:
+
+    The histogram hash.
+
+--*/
+{
+    HASH Hash;
+    ULONG Bits;
+    ULONG Index;
+    ULONG Offset;
+    ULONG HistogramHash;
+
+    HistogramHash = Length;
+
+    for (Offset = 0; Offset < ARRAYSIZE(Bitmap->Bits); Offset++) {
+
+        Bits = (ULONG)Bitmap->Bits[Offset];
+
+        while (Bits) {
+            Index = (Offset << 5) + _tzcnt_u32(Bits);
+            Hash.Index = Index;
+            Hash.Value = Histogram->Counts[Index];
+            HistogramHash = _mm_crc32_u32(HistogramHash, Hash.AsULong);
+            Bits = _blsr_u32(Bits);
+        }
+    }
+
+    return HistogramHash;
+}
+
+FORCEINLINE
+BOOLEAN
+CreatePackedHistogramInline(
+    _In_reads_(Length) PCBYTE Bytes,
+    _In_ ULONG Length,
+    _Out_ PPACKED_CHARACTER_HISTOGRAM Histogram
+    )
+/*++
+
+Routine Description:
+
+    Creates a packed histogram for a word, if the word can be represented by
+    one.
+
+Arguments:
+
+    Bytes - Supplies a pointer to the bytes of the word.
+
+    Length - Supplies the length of the word, in bytes.
+
+    Histogram - Supplies a pointer to a PACKED_CHARACTER_HISTOGRAM structure
+        that receives the packed histogram of the word.
+
+Return Value:
+
+    TRUE if the word was represented by a packed histogram, FALSE if it is too
+    long or contains a character outside of the packed alphabet (in which case
+    the word must be represented by a full CHARACTER_HISTOGRAM).
+
+--*/
+{
+    BYTE Offset;
+    ULONG Index;
+
+    if (Length > PACKED_HISTOGRAM_MAXIMUM_LENGTH) {
+        return FALSE;
+    }
+
+    Histogram->Ymm = _mm256_setzero_si256();
+
+    for (Index = 0; Index < Length; Index++) {
+        Offset = (BYTE)(Bytes[Index] - PACKED_HISTOGRAM_FIRST_CHARACTER);
+        if (Offset >= PACKED_HISTOGRAM_NUMBER_OF_CHARACTERS) {
+            return FALSE;
+        }
+        Histogram->Counts[Offset]++;
+    }
+
+    return TRUE;
+}
+
+FORCEINLINE
+ULONG
+GetPackedHistogramMask(
+    _In_ PCPACKED_CHARACTER_HISTOGRAM Histogram
+    )
+/*++
+
+Routine Description:
+
+    Returns a mask with a bit set for each non-zero count of a packed
+    histogram.  (Bit 0 corresponds to PACKED_HISTOGRAM_FIRST_CHARACTER.)
+
+--*/
+{
+    YMMWORD EqualYmm;
+
+    EqualYmm = _mm256_cmpeq_epi8(Histogram->Ymm, _mm256_setzero_si256());
+    return ~((ULONG)_mm256_movemask_epi8(EqualYmm));
+}
+
+FORCEINLINE
+ULONG
+HashPackedHistogramInline(
+    _In_ ULONG Length,
+    _In_ PCPACKED_CHARACTER_HISTOGRAM Histogram,
+    _In_ ULONG Mask
+    )
+/*++
+
+Routine Description:
+
+    Calculates the 32-bit hash of a word's packed histogram.  The hash is
+    equivalent to that returned by HashHistogramInline() for the same word.
+
+Arguments:
+
+    Length - Supplies the length of the word, in bytes.  This seeds the hash.
+
+    Histogram - Supplies a pointer to the packed histogram of the word.
+
+    Mask - Supplies the mask of non-zero counts, as returned by
+        GetPackedHistogramMask().
+
+Return Value:
+
+    The histogram hash.
+
+--*/
+{
+    HASH Hash;
+    ULONG Offset;
+    ULONG HistogramHash;
+
+    HistogramHash = Length;
+
+    while (Mask) {
+        Offset = _tzcnt_u32(Mask);
+        Hash.Index = PACKED_HISTOGRAM_FIRST_CHARACTER + Offset;
+        Hash.Value = Histogram->Counts[Offset];
+        HistogramHash = _mm_crc32_u32(HistogramHash, Hash.AsULong);
+        Mask = _blsr_u32(Mask);
+    }
+
+    return HistogramHash;
+}
+
+FORCEINLINE
+RTL_GENERIC_COMPARE_RESULTS
+ComparePackedHistogramsInline(
+    _In_ PCPACKED_CHARACTER_HISTOGRAM Left,
+    _In_ PCPACKED_CHARACTER_HISTOGRAM Right
+    )
+/*++
+
+Routine Description:
+
+    Compares two packed histograms with a single AVX2 comparison.  Histograms
+    are ordered by the first differing count.
+
+Arguments:
+
+    Left - Supplies the left histogram to compare.
+
+    Right - Supplies the right histogram to compare.
+
+Return Value:
+
+    GenericLessThan, GenericEqual or GenericGreaterThan depending on the result
+    of the comparison.
+
+--*/
+{
+    ULONG Index;
+    ULONG NotEqualMask;
+    YMMWORD EqualYmm;
+
+    EqualYmm = _mm256_cmpeq_epi8(Left->Ymm, Right->Ymm);
+    NotEqualMask = ~((ULONG)_mm256_movemask_epi8(EqualYmm));
+
+    if (!NotEqualMask) {
+        return GenericEqual;
+    }
+
+    Index = _tzcnt_u32(NotEqualMask);
+
+    if (Left->Counts[Index] > Right->Counts[Index]) {
+        return GenericGreaterThan;
+    } else {
+        return GenericLessThan;
+    }
+}
+
+FORCEINLINE
+BOOLEAN
+ContainsNonAsciiBytesInline(
+    _In_reads_(Length) PCBYTE Bytes,
+    _In_ ULONG Length
+    )
+/*++
+
+Routine Description:
+
+    Determines if a word contains any bytes with the high bit set, testing 32
+    bytes at a time with AVX2.  No bytes beyond the given length are accessed.
+
+--*/
+{
+    BYTE Bits;
+    ULONG Index;
+
+    Index = 0;
+
+    while (Index + sizeof(YMMWORD) <= Length) {
+        if (_mm256_movemask_epi8(_mm256_loadu_si256((PYMMWORD)&Bytes[Index]))) {
+            return TRUE;
+        }
+        Index += sizeof(YMMWORD);
+    }
+
+    Bits = 0;
+
+    for (; Index < Length; Index++) {
+        Bits |= Bytes[Index];
+    }
+
+    return ((Bits & 0x80) != 0);
+}
+
+FORCEINLINE
+BOOLEAN
+CreateSparseHistogramInline(
+    _In_reads_(Length) PCBYTE Bytes,
+    _In_ ULONG Length,
+    _Out_ PSPARSE_CHARACTER_HISTOGRAM Histogram
+    )
+/*++
+
+Routine Description:
+
+    Decodes a UTF-8 word and creates a sparse histogram of its codepoints.
+    Overlong encodings, surrogates, codepoints beyond U+10FFFF, truncated
+    sequences and NULL bytes are all considered invalid.
+
+Arguments:
+
+    Bytes - Supplies a pointer to the bytes of the word.
+
+    Length - Supplies the length of the word, in bytes.
+
+    Histogram - Supplies a pointer to a SPARSE_CHARACTER_HISTOGRAM structure
+        that receives the sparse histogram of the word.
+
+Return Value:
+
+    TRUE if the word was represented by a sparse histogram, FALSE if it isn't
+    valid UTF-8, or it has too many distinct characters, or too many of one
+    character (in which case the word must be represented by a full
+    CHARACTER_HISTOGRAM).
+
+--*/
+{
+    BYTE Byte;
+    ULONG Index;
+    ULONG Width;
+    ULONG Codepoint;
+    ULONG Minimum;
+    ULONG Offset;
+    ULONG NumberOfEntries;
+    ULONG AlignedNumberOfEntries;
+    PSPARSE_HISTOGRAM_ENTRY Entries;
+    SPARSE_HISTOGRAM_ENTRY Entry;
+
+    Index = 0;
+    NumberOfEntries = 0;
+    Entries = Histogram->Entries;
+
+    while (Index < Length) {
+
+        //
+        // Decode the next character.
+        //
+
+        Byte = Bytes[Index];
+
+        if (Byte < 0x80) {
+            if (Byte == '\0') {
+                return FALSE;
+            }
+            Width = 1;
+            Minimum = 0;
+            Codepoint = Byte;
+        } else if ((Byte & 0xE0) == 0xC0) {
+            Width = 2;
+            Minimum = 0x80;
+            Codepoint = Byte & 0x1F;
+        } else if ((Byte & 0xF0) == 0xE0) {
+            Width = 3;
+            Minimum = 0x800;
+            Codepoint = Byte & 0x0F;
+        } else if ((Byte & 0xF8) == 0xF0) {
+            Width = 4;
+            Minimum = 0x10000;
+            Codepoint = Byte & 0x07;
+        } else {
+            return FALSE;
+        }
+
+        if (Width > Length - Index) {
+            return FALSE;
+        }
+
+        for (Offset = 1; Offset < Width; Offset++) {
+            Byte = Bytes[Index + Offset];
+            if ((Byte & 0xC0) != 0x80) {
+                return FALSE;
+            }
+            Codepoint = (Codepoint << 6) | (Byte & 0x3F);
+        }
+
+        if (Codepoint < Minimum ||
+            Codepoint > UNICODE_MAXIMUM_CODEPOINT ||
+            (Codepoint >= UNICODE_FIRST_SURROGATE &&
+             Codepoint <= UNICODE_LAST_SURROGATE)) {
+            return FALSE;
+        }
+
+        Index += Width;
+
+        //
+        // Find the character's position in the sorted entries.
+        //
+
+        for (Offset = 0; Offset < NumberOfEntries; Offset++) {
+            if (Entries[Offset].Codepoint >= Codepoint) {
+                break;
+            }
+        }
+
+        if (Offset < NumberOfEntries &&
+            Entries[Offset].Codepoint == Codepoint) {
+
+            if (Entries[Offset].Count == SPARSE_HISTOGRAM_MAXIMUM_COUNT) {
+                return FALSE;
+            }
+
+            Entries[Offset].Count++;
+            continue;
+        }
+
+        if (NumberOfEntries == SPARSE_HISTOGRAM_MAXIMUM_NUMBER_OF_ENTRIES) {
+            return FALSE;
+        }
+
+        //
+        // Shift the larger entries up and insert the new character.
+        //
+
+        MoveMemory(&Entries[Offset + 1],
+                   &Entries[Offset],
+                   (NumberOfEntries - Offset) * sizeof(*Entries));
+
+        Entry.AsULong = 0;
+        Entry.Codepoint = Codepoint;
+        Entry.Count = 1;
+        Entries[Offset] = Entry;
+        NumberOfEntries++;
+    }
+
+    //
+    // Zero the unused entries up to the next YMM boundary, such that whole YMM
+    // registers can be compared.
+    //
+
+    AlignedNumberOfEntries = ALIGN_UP(NumberOfEntries,
+                                      SPARSE_HISTOGRAM_ENTRIES_PER_YMMWORD);
+
+    for (Offset = NumberOfEntries; Offset < AlignedNumberOfEntries; Offset++) {
+        Entries[Offset].AsULong = 0;
+    }
+
+    Histogram->NumberOfEntries = NumberOfEntries;
+
+    return TRUE;
+}
+
+FORCEINLINE
+ULONG
+HashSparseHistogramInline(
+    _In_ ULONG Length,
+    _In_ PCSPARSE_CHARACTER_HISTOGRAM Histogram
+    )
+/*++
+
+Routine Description:
+
+    Calculates the 32-bit hash of a word's sparse histogram.
+
+Arguments:
+
+    Length - Supplies the length of the word, in bytes.  This seeds the hash.
+
+    Histogram - Supplies a pointer to the sparse histogram of the word.
+
+Return Value:
+
+    The histogram hash.
+
+--*/
+{
+    ULONG Index;
+    ULONG HistogramHash;
+
+    HistogramHash = Length;
+
+    for (Index = 0; Index < Histogram->NumberOfEntries; Index++) {
+        HistogramHash = _mm_crc32_u32(HistogramHash,
+                                      Histogram->Entries[Index].AsULong);
+    }
+
+    return HistogramHash;
+}
+
+FORCEINLINE
+RTL_GENERIC_COMPARE_RESULTS
+CompareSparseHistogramsInline(
+    _In_ PCSPARSE_CHARACTER_HISTOGRAM Left,
+    _In_ PCSPARSE_CHARACTER_HISTOGRAM Right
+    )
+/*++
+
+Routine Description:
+
+    Compares two sparse histograms, 8 entries at a time with AVX2.  Histograms
+    are ordered by their number of entries, then by the first differing entry.
+
+Arguments:
+
+    Left - Supplies the left histogram to compare.
+
+    Right - Supplies the right histogram to compare.
+
+Return Value:
+
+    GenericLessThan, GenericEqual or GenericGreaterThan depending on the result
+    of the comparison.
+
+--*/
+{
+    ULONG Index;
+    ULONG Offset;
+    ULONG NumberOfYmmWords;
+    ULONG NotEqualMask;
+    YMMWORD EqualYmm;
+
+    if (Left->NumberOfEntries != Right->NumberOfEntries) {
+        return (Left->NumberOfEntries < Right->NumberOfEntries ?
+                GenericLessThan : GenericGreaterThan);
+    }
+
+    NumberOfYmmWords = ALIGN_UP(Left->NumberOfEntries,
+                                SPARSE_HISTOGRAM_ENTRIES_PER_YMMWORD) /
+                       SPARSE_HISTOGRAM_ENTRIES_PER_YMMWORD;
+
+    for (Index = 0; Index < NumberOfYmmWords; Index++) {
+
+        EqualYmm = _mm256_cmpeq_epi32(Left->Ymm[Index], Right->Ymm[Index]);
+        NotEqualMask = ~((ULONG)_mm256_movemask_epi8(EqualYmm));
+
+        if (!NotEqualMask) {
+            continue;
+        }
+
+        //
+        // Each entry accounts for 4 bits of the mask.
+        //
+
+        Offset = (
+            (Index * SPARSE_HISTOGRAM_ENTRIES_PER_YMMWORD) +
+            (_tzcnt_u32(NotEqualMask) >> 2)
+        );
+
+        if (Left->Entries[Offset].AsULong > Right->Entries[Offset].AsULong) {
+            return GenericGreaterThan;
+        } else {
+            return GenericLessThan;
+        }
+    }
+
+    return GenericEqual;
+}
+
 // vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
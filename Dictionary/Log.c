@@ -0,0 +1,1404 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    Log.c
+
+Abstract:
+
+    This module implements the dictionary's write-ahead log, which makes
+    modifications of the dictionary durable.  Every addition (via AddWord(),
+    AddWordsFromText(), word counters, ImportDictionary() or a set operation),
+    removal and eviction is logged.  Routines are provided for
+    opening and closing the log, appending a record and waiting for it to be
+    flushed, writing a snapshot of the dictionary (a checkpoint), and
+    recovering a dictionary from a snapshot and the log.
+
+    Records are appended to a ring buffer by the thread performing the
+    operation, whilst it holds the dictionary's exclusive lock; appending a
+    record takes no other lock.  A dedicated flusher thread writes the buffer
+    to the file and flushes it, then wakes every caller whose record was
+    included.  Callers that log whilst a flush is in progress are all covered
+    by the next flush, so at high write rates a single flush commits many
+    operations (group commit), and the cost of the flush is amortized over
+    all of them.
+
+    See DICTIONARY_LOG_HEADER for the layout of the log file.
+
+--*/
+
+#include "stdafx.h"
+
+C_ASSERT(DICTIONARY_LOG_BUFFER_SIZE >=
+         DICTIONARY_LOG_RECORD_SIZE(ABSOLUTE_MAXIMUM_WORD_LENGTH));
+
+//
+// Writes to files are issued in chunks of at most this many bytes.
+//
+
+#define DICTIONARY_LOG_MAXIMUM_WRITE_SIZE (1 << 30)
+
+static const BYTE DictionaryLogZeroes[DICTIONARY_LOG_RECORD_ALIGNMENT] = { 0 };
+
+FORCEINLINE
+ULONG
+CalculateLogRecordChecksum(
+    _In_ PCDICTIONARY_LOG_RECORD Record,
+    _In_reads_(Record->Length) PCBYTE Word
+    )
+{
+    ULONG Checksum;
+
+    Checksum = HashWordString(Word, Record->Length);
+    Checksum = (ULONG)_mm_crc32_u64(Checksum, Record->Sequence);
+    Checksum = (ULONG)_mm_crc32_u64(Checksum, (ULONGLONG)Record->Increment);
+    Checksum = _mm_crc32_u32(Checksum, Record->SizeOfRecord);
+    Checksum = _mm_crc32_u32(Checksum, Record->Operation);
+
+    return Checksum;
+}
+
+FORCEINLINE
+VOID
+CopyToDictionaryLogBuffer(
+    _In_ PDICTIONARY_LOG Log,
+    _In_ ULONGLONG Sequence,
+    _In_reads_bytes_(SizeInBytes) LPCVOID Source,
+    _In_ ULONG SizeInBytes
+    )
+/*++
+
+Routine Description:
+
+    Copies bytes into the ring buffer at the position corresponding to the
+    given sequence number, wrapping around the end of the buffer if necessary.
+
+--*/
+{
+    ULONG Offset;
+    ULONG FirstSize;
+
+    Offset = (ULONG)(Sequence & (DICTIONARY_LOG_BUFFER_SIZE - 1));
+    FirstSize = min(SizeInBytes, DICTIONARY_LOG_BUFFER_SIZE - Offset);
+
+    CopyMemory(Log->Buffer + Offset, Source, FirstSize);
+
+    if (SizeInBytes > FirstSize) {
+        CopyMemory(Log->Buffer,
+                   (PCBYTE)Source + FirstSize,
+                   SizeInBytes - FirstSize);
+    }
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOLEAN
+WriteDictionaryFile(
+    _In_ HANDLE FileHandle,
+    _In_reads_bytes_(SizeInBytes) LPCVOID Buffer,
+    _In_ ULONGLONG SizeInBytes
+    )
+/*++
+
+Routine Description:
+
+    Writes a buffer to a file at the file's current position.
+
+--*/
+{
+    ULONG ChunkSize;
+    ULONG BytesWritten;
+    PCBYTE Bytes;
+
+    Bytes = (PCBYTE)Buffer;
+
+    while (SizeInBytes) {
+
+        ChunkSize = (ULONG)min(SizeInBytes, DICTIONARY_LOG_MAXIMUM_WRITE_SIZE);
+
+        if (!WriteFile(FileHandle, Bytes, ChunkSize, &BytesWritten, NULL) ||
+            BytesWritten != ChunkSize) {
+            return FALSE;
+        }
+
+        Bytes += ChunkSize;
+        SizeInBytes -= ChunkSize;
+    }
+
+    return TRUE;
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOLEAN
+MapDictionaryFile(
+    _In_z_ PCWSTR Path,
+    _Out_ PHANDLE FileHandlePointer,
+    _Out_ PHANDLE SectionHandlePointer,
+    _Out_ PCBYTE *BasePointer,
+    _Out_ PULONGLONG SizeInBytesPointer
+    )
+/*++
+
+Routine Description:
+
+    Opens an existing, non-empty file and maps a read-only view of it.  On
+    success, the caller is responsible for calling UnmapDictionaryFile().
+
+--*/
+{
+    HANDLE FileHandle;
+    HANDLE SectionHandle;
+    PCBYTE Base;
+    LARGE_INTEGER FileSize;
+
+    *FileHandlePointer = INVALID_HANDLE_VALUE;
+    *SectionHandlePointer = NULL;
+    *BasePointer = NULL;
+    *SizeInBytesPointer = 0;
+
+    FileHandle = CreateFileW(Path,
+                             GENERIC_READ,
+                             FILE_SHARE_READ,
+                             NULL,
+                             OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL,
+                             NULL);
+
+    if (FileHandle == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    if (!GetFileSizeEx(FileHandle, &FileSize) || FileSize.QuadPart == 0) {
+        CloseHandle(FileHandle);
+        return FALSE;
+    }
+
+    SectionHandle = CreateFileMappingW(FileHandle,
+                                       NULL,
+                                       PAGE_READONLY,
+                                       0,
+                                       0,
+                                       NULL);
+
+    if (!SectionHandle) {
+        CloseHandle(FileHandle);
+        return FALSE;
+    }
+
+    Base = (PCBYTE)MapViewOfFile(SectionHandle, FILE_MAP_READ, 0, 0, 0);
+
+    if (!Base) {
+        CloseHandle(SectionHandle);
+        CloseHandle(FileHandle);
+        return FALSE;
+    }
+
+    *FileHandlePointer = FileHandle;
+    *SectionHandlePointer = SectionHandle;
+    *BasePointer = Base;
+    *SizeInBytesPointer = (ULONGLONG)FileSize.QuadPart;
+
+    return TRUE;
+}
+
+FORCEINLINE
+VOID
+UnmapDictionaryFile(
+    _In_ HANDLE FileHandle,
+    _In_ HANDLE SectionHandle,
+    _In_ PCBYTE Base
+    )
+{
+    UnmapViewOfFile(Base);
+    CloseHandle(SectionHandle);
+    CloseHandle(FileHandle);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOLEAN
+IsValidDictionaryLogHeader(
+    _In_reads_bytes_(SizeInBytes) PCBYTE Base,
+    _In_ ULONGLONG SizeInBytes
+    )
+{
+    PCDICTIONARY_LOG_HEADER Header;
+
+    Header = (PCDICTIONARY_LOG_HEADER)Base;
+
+    return (
+        SizeInBytes >= sizeof(*Header) &&
+        Header->Signature == DICTIONARY_LOG_SIGNATURE &&
+        Header->Version == DICTIONARY_LOG_VERSION &&
+        Header->SizeOfHeader == sizeof(*Header)
+    );
+}
+
+FORCEINLINE
+BOOLEAN
+IsValidDictionaryLogIncrement(
+    _In_ PCDICTIONARY_LOG_RECORD Record
+    )
+{
+    switch (Record->Operation) {
+        case DictionaryLogAddWordOperation:
+            return (Record->Increment > 0);
+        case DictionaryLogRemoveWordOperation:
+            return (Record->Increment == 1);
+        default:
+            return (Record->Increment == 0);
+    }
+}
+
+FORCEINLINE
+PCDICTIONARY_LOG_RECORD
+GetValidDictionaryLogRecord(
+    _In_reads_bytes_(SizeInBytes) PCBYTE Base,
+    _In_ ULONGLONG SizeInBytes,
+    _In_ ULONGLONG Sequence
+    )
+/*++
+
+Routine Description:
+
+    Returns the log record at the given sequence number if it is complete and
+    intact, NULL otherwise.  A NULL return indicates the end of the log.
+
+--*/
+{
+    PCBYTE Word;
+    PCDICTIONARY_LOG_RECORD Record;
+
+    if (Sequence + sizeof(*Record) > SizeInBytes) {
+        return NULL;
+    }
+
+    Record = (PCDICTIONARY_LOG_RECORD)(Base + Sequence);
+    Word = (PCBYTE)(Record + 1);
+
+    if (Record->Sequence != Sequence ||
+        Record->Operation == DictionaryLogNullOperation ||
+        Record->Operation >= DictionaryLogInvalidOperation ||
+        !IsValidDictionaryLogIncrement(Record) ||
+        Record->Length > ABSOLUTE_MAXIMUM_WORD_LENGTH ||
+        Record->SizeOfRecord != DICTIONARY_LOG_RECORD_SIZE(Record->Length) ||
+        Sequence + Record->SizeOfRecord > SizeInBytes ||
+        Word[Record->Length] != '\0' ||
+        Record->Checksum != CalculateLogRecordChecksum(Record, Word)) {
+        return NULL;
+    }
+
+    return Record;
+}
+
+_Use_decl_annotations_
+ULONGLONG
+AppendDictionaryLogRecord(
+    PDICTIONARY_LOG Log,
+    DICTIONARY_LOG_OPERATION Operation,
+    PCBYTE Word,
+    ULONG Length,
+    LONGLONG Increment
+    )
+/*++
+
+Routine Description:
+
+    Appends a record to the log.  The caller must hold the dictionary's
+    exclusive lock, and Log must be Dictionary->Log.  The routine that
+    acquired the lock is responsible for waiting for the record to become
+    durable; see BeginDictionaryLogOperation().
+
+Arguments:
+
+    Log - Supplies a pointer to the log.
+
+    Operation - Supplies the operation to log.
+
+    Word - Supplies a pointer to the word's bytes.
+
+    Length - Supplies the length of the word, in bytes.
+
+    Increment - Supplies the number of occurrences added by an add operation,
+        1 for a removal, or 0 for an eviction.
+
+Return Value:
+
+    The sequence number immediately following the record, or 0 if the log
+    has failed.
+
+--*/
+{
+    ULONG SizeOfPadding;
+    ULONGLONG Sequence;
+    ULONGLONG EndSequence;
+    DICTIONARY_LOG_RECORD Record;
+
+    if (Log->Failed) {
+        return 0;
+    }
+
+    //
+    // Reserve space for the record.
+    //
+
+    Record.Sequence = 0;
+    Record.Increment = Increment;
+    Record.Length = Length;
+    Record.Operation = (USHORT)Operation;
+    Record.Padding = 0;
+    Record.SizeOfRecord = (ULONG)DICTIONARY_LOG_RECORD_SIZE(Length);
+
+    Sequence = (ULONGLONG)(
+        InterlockedExchangeAdd64(&Log->ReservedOffset, Record.SizeOfRecord)
+    );
+
+    EndSequence = Sequence + Record.SizeOfRecord;
+
+    //
+    // If the ring buffer doesn't have room for the record, wait for the
+    // flusher to make some.
+    //
+
+    if (EndSequence - (ULONGLONG)Log->DurableOffset >
+        DICTIONARY_LOG_BUFFER_SIZE) {
+
+        AcquireSRWLockShared(&Log->WaitLock);
+
+        while (EndSequence - (ULONGLONG)Log->DurableOffset >
+               DICTIONARY_LOG_BUFFER_SIZE) {
+
+            SleepConditionVariableSRW(&Log->FlushDone,
+                                      &Log->WaitLock,
+                                      INFINITE,
+                                      CONDITION_VARIABLE_LOCKMODE_SHARED);
+        }
+
+        ReleaseSRWLockShared(&Log->WaitLock);
+    }
+
+    //
+    // Copy the record, the word, and the word's terminating NULL and padding
+    // into the buffer.
+    //
+
+    Record.Sequence = Sequence;
+    Record.Checksum = CalculateLogRecordChecksum(&Record, Word);
+    SizeOfPadding = Record.SizeOfRecord - sizeof(Record) - Length;
+
+    CopyToDictionaryLogBuffer(Log, Sequence, &Record, sizeof(Record));
+    CopyToDictionaryLogBuffer(Log, Sequence + sizeof(Record), Word, Length);
+    CopyToDictionaryLogBuffer(Log,
+                              Sequence + sizeof(Record) + Length,
+                              DictionaryLogZeroes,
+                              SizeOfPadding);
+
+    //
+    // Publish the record.  Records are published in sequence order; as
+    // callers hold the exclusive lock, the record preceding ours has always
+    // been published already.
+    //
+
+    while ((ULONGLONG)Log->WrittenOffset != Sequence) {
+        YieldProcessor();
+    }
+
+    InterlockedExchange64(&Log->WrittenOffset, (LONGLONG)EndSequence);
+    InterlockedIncrement64(&Log->NumberOfRecords);
+
+    //
+    // Wake the flusher.  The flusher checks WrittenOffset whilst holding the
+    // wait lock exclusively, so acquiring it here (even briefly) ensures the
+    // flusher has either seen our record, or is waiting on the condition
+    // variable and will receive the wake.
+    //
+
+    AcquireSRWLockShared(&Log->WaitLock);
+    ReleaseSRWLockShared(&Log->WaitLock);
+    WakeConditionVariable(&Log->FlushNeeded);
+
+    return EndSequence;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+WaitForDictionaryLog(
+    PDICTIONARY_LOG Log,
+    ULONGLONG Sequence
+    )
+/*++
+
+Routine Description:
+
+    Waits until the log has been flushed up to the given sequence number,
+    unless the log was opened with AsynchronousCommit, and releases the
+    reference acquired by BeginDictionaryLogOperation().  Must be called once
+    for every BeginDictionaryLogOperation() call that returned a log, without
+    holding the dictionary lock.
+
+Arguments:
+
+    Log - Supplies a pointer to the log.
+
+    Sequence - Supplies the sequence number returned by
+        EndDictionaryLogOperation(), or 0 if no records were appended.
+
+Return Value:
+
+    TRUE if the records are durable (or the log is asynchronous), FALSE if
+    the log has failed.
+
+--*/
+{
+    BOOLEAN Success;
+
+    if (!Log->Flags.AsynchronousCommit &&
+        (ULONGLONG)Log->DurableOffset < Sequence) {
+
+        AcquireSRWLockShared(&Log->WaitLock);
+
+        while ((ULONGLONG)Log->DurableOffset < Sequence) {
+            SleepConditionVariableSRW(&Log->FlushDone,
+                                      &Log->WaitLock,
+                                      INFINITE,
+                                      CONDITION_VARIABLE_LOCKMODE_SHARED);
+        }
+
+        ReleaseSRWLockShared(&Log->WaitLock);
+    }
+
+    Success = (Log->Failed == FALSE);
+
+    //
+    // This must be the last access to the log; CloseDictionaryLog() may free
+    // it as soon as the count reaches zero.
+    //
+
+    InterlockedDecrement(&Log->NumberOfWaiters);
+
+    return Success;
+}
+
+_Use_decl_annotations_
+DWORD
+WINAPI
+DictionaryLogFlusherThreadProc(
+    PVOID Parameter
+    )
+/*++
+
+Routine Description:
+
+    Writes and flushes batches of log records until the log is closed.  Each
+    iteration writes every record published since the previous iteration, and
+    issues a single flush for all of them.
+
+--*/
+{
+    BOOLEAN Success;
+    ULONG Offset;
+    ULONGLONG Start;
+    ULONGLONG End;
+    ULONGLONG Size;
+    ULONGLONG FirstSize;
+    PDICTIONARY_LOG Log;
+
+    Log = (PDICTIONARY_LOG)Parameter;
+
+    while (TRUE) {
+
+        AcquireSRWLockExclusive(&Log->WaitLock);
+
+        while (Log->WrittenOffset == Log->DurableOffset && !Log->Shutdown) {
+            SleepConditionVariableSRW(&Log->FlushNeeded,
+                                      &Log->WaitLock,
+                                      INFINITE,
+                                      0);
+        }
+
+        Start = (ULONGLONG)Log->DurableOffset;
+        End = (ULONGLONG)Log->WrittenOffset;
+
+        ReleaseSRWLockExclusive(&Log->WaitLock);
+
+        if (Start == End) {
+
+            //
+            // The log is being closed and every record has been flushed.
+            //
+
+            break;
+        }
+
+        //
+        // Write the batch (in two pieces if it wraps around the end of the
+        // ring buffer) and flush it.  Once the log has failed, batches are
+        // discarded, but DurableOffset is still advanced such that waiters
+        // are released.
+        //
+
+        if (!Log->Failed) {
+
+            Size = End - Start;
+            Offset = (ULONG)(Start & (DICTIONARY_LOG_BUFFER_SIZE - 1));
+            FirstSize = min(Size, DICTIONARY_LOG_BUFFER_SIZE - Offset);
+
+            Success = WriteDictionaryFile(Log->FileHandle,
+                                          Log->Buffer + Offset,
+                                          FirstSize);
+
+            if (Success && Size > FirstSize) {
+                Success = WriteDictionaryFile(Log->FileHandle,
+                                              Log->Buffer,
+                                              Size - FirstSize);
+            }
+
+            if (Success) {
+                Success = (BOOLEAN)FlushFileBuffers(Log->FileHandle);
+            }
+
+            if (Success) {
+                Log->NumberOfBytesWritten += Size;
+                Log->NumberOfFlushes++;
+            } else {
+                InterlockedExchange(&Log->Failed, TRUE);
+            }
+        }
+
+        AcquireSRWLockExclusive(&Log->WaitLock);
+        InterlockedExchange64(&Log->DurableOffset, (LONGLONG)End);
+        ReleaseSRWLockExclusive(&Log->WaitLock);
+
+        WakeAllConditionVariable(&Log->FlushDone);
+    }
+
+    return 0;
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOLEAN
+PrepareDictionaryLogFile(
+    _In_ PDICTIONARY_LOG Log,
+    _Out_ PULONGLONG EndSequencePointer
+    )
+/*++
+
+Routine Description:
+
+    Prepares a newly opened log file for appending.  An empty file has a new
+    header written to it.  Otherwise, the header is validated, the intact
+    records are skipped, and anything following them (i.e. a record torn by
+    a crash) is truncated.
+
+--*/
+{
+    BOOLEAN Success;
+    HANDLE SectionHandle;
+    PCBYTE Base;
+    ULONGLONG Sequence;
+    LARGE_INTEGER FileSize;
+    LARGE_INTEGER EndOfFile;
+    FILETIME FileTime;
+    DICTIONARY_LOG_HEADER Header;
+    PCDICTIONARY_LOG_RECORD Record;
+
+    if (!GetFileSizeEx(Log->FileHandle, &FileSize)) {
+        return FALSE;
+    }
+
+    if (FileSize.QuadPart == 0) {
+
+        //
+        // New log.  Write the header and flush it.
+        //
+
+        GetSystemTimeAsFileTime(&FileTime);
+
+        ZeroStruct(Header);
+        Header.Signature = DICTIONARY_LOG_SIGNATURE;
+        Header.Version = DICTIONARY_LOG_VERSION;
+        Header.SizeOfHeader = sizeof(Header);
+        Header.LogId = (
+            (((ULONGLONG)FileTime.dwHighDateTime << 32) |
+             FileTime.dwLowDateTime) ^ __rdtsc()
+        );
+
+        if (!WriteDictionaryFile(Log->FileHandle, &Header, sizeof(Header)) ||
+            !FlushFileBuffers(Log->FileHandle)) {
+            return FALSE;
+        }
+
+        Log->LogId = Header.LogId;
+        *EndSequencePointer = sizeof(Header);
+        return TRUE;
+    }
+
+    //
+    // Existing log.  Map it and find the end of the intact records.
+    //
+
+    SectionHandle = CreateFileMappingW(Log->FileHandle,
+                                       NULL,
+                                       PAGE_READONLY,
+                                       0,
+                                       0,
+                                       NULL);
+
+    if (!SectionHandle) {
+        return FALSE;
+    }
+
+    Base = (PCBYTE)MapViewOfFile(SectionHandle, FILE_MAP_READ, 0, 0, 0);
+
+    if (!Base) {
+        CloseHandle(SectionHandle);
+        return FALSE;
+    }
+
+    Success = IsValidDictionaryLogHeader(Base, FileSize.QuadPart);
+
+    if (Success) {
+
+        Log->LogId = ((PCDICTIONARY_LOG_HEADER)Base)->LogId;
+        Sequence = sizeof(DICTIONARY_LOG_HEADER);
+
+        while (TRUE) {
+            Record = GetValidDictionaryLogRecord(Base,
+                                                 FileSize.QuadPart,
+                                                 Sequence);
+            if (!Record) {
+                break;
+            }
+            Sequence += Record->SizeOfRecord;
+        }
+    }
+
+    UnmapViewOfFile(Base);
+    CloseHandle(SectionHandle);
+
+    if (!Success) {
+        return FALSE;
+    }
+
+    //
+    // Truncate anything following the last intact record, and position the
+    // file pointer at the end.
+    //
+
+    EndOfFile.QuadPart = (LONGLONG)Sequence;
+
+    if (!SetFilePointerEx(Log->FileHandle, EndOfFile, NULL, FILE_BEGIN) ||
+        !SetEndOfFile(Log->FileHandle)) {
+        return FALSE;
+    }
+
+    *EndSequencePointer = Sequence;
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+OpenDictionaryLog(
+    PDICTIONARY Dictionary,
+    PCWSTR Path,
+    DICTIONARY_LOG_FLAGS Flags
+    )
+/*++
+
+Routine Description:
+
+    Opens a write-ahead log for a dictionary.  Once opened, every successful
+    modification of the dictionary is logged, and the routine that made it
+    doesn't return until the log has been flushed to disk (unless
+    AsynchronousCommit is set).
+
+    If the file already exists, records are appended to it (after discarding
+    any incomplete record at its end).  The dictionary should first be brought
+    up-to-date with the log via RecoverDictionary().
+
+    If the log subsequently fails to be written, routines that modify the
+    dictionary return FALSE, even though the modification has been applied in
+    memory.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the dictionary.
+
+    Path - Supplies the path of the log file.
+
+    Flags - Supplies flags that control the log's behavior.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if a log is
+    already open for the dictionary.
+
+--*/
+{
+    BOOLEAN Success;
+    PALLOCATOR Allocator;
+    PDICTIONARY_LOG Log;
+    ULONGLONG EndSequence;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Path)) {
+        return FALSE;
+    }
+
+    if (Flags.Unused != 0) {
+        return FALSE;
+    }
+
+    if (Dictionary->Log) {
+        return FALSE;
+    }
+
+    //
+    // Allocate the log structure and its ring buffer.
+    //
+
+    Allocator = Dictionary->Allocator;
+
+    Log = (PDICTIONARY_LOG)Allocator->Calloc(Allocator, 1, sizeof(*Log));
+
+    if (!Log) {
+        return FALSE;
+    }
+
+    Log->Flags = Flags;
+    Log->FileHandle = INVALID_HANDLE_VALUE;
+
+    InitializeSRWLock(&Log->WaitLock);
+    InitializeConditionVariable(&Log->FlushNeeded);
+    InitializeConditionVariable(&Log->FlushDone);
+
+    Log->Buffer = (PBYTE)(
+        Allocator->Calloc(Allocator, 1, DICTIONARY_LOG_BUFFER_SIZE)
+    );
+
+    if (!Log->Buffer) {
+        goto Error;
+    }
+
+    //
+    // Open the file and prepare it for appending.
+    //
+
+    Log->FileHandle = CreateFileW(Path,
+                                  GENERIC_READ | GENERIC_WRITE,
+                                  FILE_SHARE_READ,
+                                  NULL,
+                                  OPEN_ALWAYS,
+                                  FILE_ATTRIBUTE_NORMAL,
+                                  NULL);
+
+    if (Log->FileHandle == INVALID_HANDLE_VALUE) {
+        goto Error;
+    }
+
+    if (!PrepareDictionaryLogFile(Log, &EndSequence)) {
+        goto Error;
+    }
+
+    Log->ReservedOffset = (LONGLONG)EndSequence;
+    Log->WrittenOffset = (LONGLONG)EndSequence;
+    Log->DurableOffset = (LONGLONG)EndSequence;
+
+    //
+    // Start the flusher.
+    //
+
+    Log->FlusherThreadHandle = CreateThread(NULL,
+                                            0,
+                                            DictionaryLogFlusherThreadProc,
+                                            Log,
+                                            0,
+                                            NULL);
+
+    if (!Log->FlusherThreadHandle) {
+        goto Error;
+    }
+
+    //
+    // Publish the log.  Check again that no other log was opened whilst we
+    // were setting up ours.
+    //
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+
+    if (Dictionary->Log) {
+        ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+        goto Error;
+    }
+
+    Dictionary->Log = Log;
+
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    if (Log->FlusherThreadHandle) {
+        InterlockedExchange(&Log->Shutdown, TRUE);
+        WakeConditionVariable(&Log->FlushNeeded);
+        WaitForSingleObject(Log->FlusherThreadHandle, INFINITE);
+        CloseHandle(Log->FlusherThreadHandle);
+    }
+
+    if (Log->FileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(Log->FileHandle);
+    }
+
+    if (Log->Buffer) {
+        Allocator->FreePointer(Allocator, (PPVOID)&Log->Buffer);
+    }
+
+    Allocator->FreePointer(Allocator, (PPVOID)&Log);
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CloseDictionaryLog(
+    PDICTIONARY Dictionary,
+    PDICTIONARY_LOG_STATS Stats
+    )
+/*++
+
+Routine Description:
+
+    Closes a dictionary's write-ahead log, after flushing every record
+    appended to it.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the dictionary.
+
+    Stats - Optionally supplies the address of a structure that receives
+        statistics about the log.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if no log is
+    open for the dictionary, or if writing the log failed at any point.
+
+--*/
+{
+    BOOLEAN Success;
+    PALLOCATOR Allocator;
+    PDICTIONARY_LOG Log;
+
+    if (ARGUMENT_PRESENT(Stats)) {
+        ZeroStructPointer(Stats);
+    }
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    //
+    // Detach the log.  Records are only appended whilst the exclusive lock is
+    // held, so none will be appended once we release it.
+    //
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+    Log = Dictionary->Log;
+    Dictionary->Log = NULL;
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    if (!Log) {
+        return FALSE;
+    }
+
+    //
+    // Stop the flusher once it has flushed everything, then wait for any
+    // callers still waiting on it to return.
+    //
+
+    AcquireSRWLockExclusive(&Log->WaitLock);
+    InterlockedExchange(&Log->Shutdown, TRUE);
+    ReleaseSRWLockExclusive(&Log->WaitLock);
+    WakeConditionVariable(&Log->FlushNeeded);
+
+    WaitForSingleObject(Log->FlusherThreadHandle, INFINITE);
+    CloseHandle(Log->FlusherThreadHandle);
+
+    while (Log->NumberOfWaiters != 0) {
+        SwitchToThread();
+    }
+
+    Success = (Log->Failed == FALSE);
+
+    if (ARGUMENT_PRESENT(Stats)) {
+        Stats->NumberOfRecords = (ULONGLONG)Log->NumberOfRecords;
+        Stats->NumberOfFlushes = Log->NumberOfFlushes;
+        Stats->NumberOfBytesWritten = Log->NumberOfBytesWritten;
+    }
+
+    CloseHandle(Log->FileHandle);
+
+    Allocator = Dictionary->Allocator;
+    Allocator->FreePointer(Allocator, (PPVOID)&Log->Buffer);
+    Allocator->FreePointer(Allocator, (PPVOID)&Log);
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CheckpointDictionary(
+    PDICTIONARY Dictionary,
+    PALLOCATOR Allocator,
+    PCWSTR SnapshotPath
+    )
+/*++
+
+Routine Description:
+
+    Writes a snapshot of a dictionary to a file, along with the position in
+    the dictionary's log (if one is open) that the snapshot reflects.  The
+    snapshot is written to a temporary file (the path with ".tmp" appended),
+    flushed, and then renamed over the path, such that an existing snapshot
+    is only replaced once the new one is complete.
+
+    This routine must not be called concurrently with OpenDictionaryLog() or
+    CloseDictionaryLog() for the same dictionary.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the dictionary.
+
+    Allocator - Supplies a pointer to the allocator used for the export
+        buffer and the temporary path.
+
+    SnapshotPath - Supplies the path of the snapshot file.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    ULONG Index;
+    ULONG Length;
+    BOOLEAN Success;
+    HANDLE FileHandle;
+    PWSTR TemporaryPath;
+    PVOID Export;
+    ULONGLONG SizeOfExport;
+    ULONGLONG LogSequence;
+    DICTIONARY_SNAPSHOT_HEADER Header;
+    static const WCHAR Suffix[] = L".tmp";
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Allocator)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(SnapshotPath)) {
+        return FALSE;
+    }
+
+    Export = NULL;
+    FileHandle = INVALID_HANDLE_VALUE;
+
+    //
+    // Construct the temporary path.
+    //
+
+    for (Length = 0; SnapshotPath[Length]; Length++);
+
+    TemporaryPath = (PWSTR)(
+        Allocator->Calloc(Allocator,
+                          Length + ARRAYSIZE(Suffix),
+                          sizeof(WCHAR))
+    );
+
+    if (!TemporaryPath) {
+        return FALSE;
+    }
+
+    CopyMemory(TemporaryPath, SnapshotPath, Length * sizeof(WCHAR));
+    for (Index = 0; Index < ARRAYSIZE(Suffix); Index++) {
+        TemporaryPath[Length + Index] = Suffix[Index];
+    }
+
+    //
+    // Export the dictionary, capturing the log position it reflects.
+    //
+
+    ZeroStruct(Header);
+    Header.Signature = DICTIONARY_SNAPSHOT_SIGNATURE;
+    Header.Version = DICTIONARY_SNAPSHOT_VERSION;
+    Header.SizeOfHeader = sizeof(Header);
+
+    AcquireDictionaryLockShared(&Dictionary->Lock);
+    Header.LogId = (Dictionary->Log ? Dictionary->Log->LogId : 0);
+    ReleaseDictionaryLockShared(&Dictionary->Lock);
+
+    if (!ExportDictionaryEx(Dictionary,
+                            Allocator,
+                            &Export,
+                            &SizeOfExport,
+                            NULL,
+                            &LogSequence)) {
+        goto Error;
+    }
+
+    Header.LogSequence = LogSequence;
+    Header.SizeOfExport = SizeOfExport;
+
+    //
+    // Write and flush the temporary file, then rename it over the snapshot.
+    //
+
+    FileHandle = CreateFileW(TemporaryPath,
+                             GENERIC_WRITE,
+                             0,
+                             NULL,
+                             CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL,
+                             NULL);
+
+    if (FileHandle == INVALID_HANDLE_VALUE) {
+        goto Error;
+    }
+
+    if (!WriteDictionaryFile(FileHandle, &Header, sizeof(Header)) ||
+        !WriteDictionaryFile(FileHandle, Export, SizeOfExport) ||
+        !FlushFileBuffers(FileHandle)) {
+        goto Error;
+    }
+
+    CloseHandle(FileHandle);
+    FileHandle = INVALID_HANDLE_VALUE;
+
+    if (!MoveFileExW(TemporaryPath,
+                     SnapshotPath,
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        goto Error;
+    }
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    if (FileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(FileHandle);
+        FileHandle = INVALID_HANDLE_VALUE;
+    }
+
+    DeleteFileW(TemporaryPath);
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    if (Export) {
+        Allocator->FreePointer(Allocator, &Export);
+    }
+
+    Allocator->FreePointer(Allocator, (PPVOID)&TemporaryPath);
+
+    return Success;
+}
+
+FORCEINLINE
+BOOLEAN
+ReplayDictionaryLogRecord(
+    _In_ PDICTIONARY Dictionary,
+    _In_ PCDICTIONARY_LOG_RECORD Record
+    )
+/*++
+
+Routine Description:
+
+    Applies a single log record to a dictionary.  An addition is applied with
+    the record's increment, a removal decrements the word's count, and an
+    eviction removes the word (if the dictionary still contains it).
+
+--*/
+{
+    PCBYTE Word;
+    BOOLEAN Success;
+    LONGLONG EntryCount;
+    PCWORD_ENTRY WordEntry;
+
+    Word = (PCBYTE)(Record + 1);
+
+    switch (Record->Operation) {
+
+        case DictionaryLogAddWordOperation:
+
+            AcquireDictionaryLockExclusive(&Dictionary->Lock);
+
+            Success = FALSE;
+
+            if (!Dictionary->Flags.IsFrozen) {
+                Success = AddWordEntry(Dictionary,
+                                       Word,
+                                       Record->Length,
+                                       Record->Increment,
+                                       &WordEntry,
+                                       &EntryCount);
+            }
+
+            ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+            break;
+
+        case DictionaryLogRemoveWordOperation:
+            Success = RemoveWord(Dictionary, Word, &EntryCount);
+            break;
+
+        default:
+            Success = EvictWord(Dictionary, Word);
+            break;
+    }
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+RecoverDictionary(
+    PDICTIONARY Dictionary,
+    PCWSTR SnapshotPath,
+    PCWSTR LogPath,
+    PULONGLONG NumberOfLogRecordsPointer
+    )
+/*++
+
+Routine Description:
+
+    Recovers a dictionary from a snapshot written by CheckpointDictionary()
+    and/or a write-ahead log.  The snapshot (if any) is imported, and then
+    every intact log record following the position captured by the snapshot
+    is replayed.  Replay stops at the first incomplete or corrupt record,
+    which is expected if the process terminated whilst the log was being
+    written.
+
+    The dictionary should be empty, and must not have a log open.
+
+    If the dictionary was created with EnableEviction, eviction is disabled
+    for the duration of recovery, such that the only words evicted are those
+    recorded by the log's eviction records.  (Otherwise, replayed additions
+    would evict words of their own, as the CLOCK state rebuilt by the snapshot
+    import differs from that of the original dictionary.)
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the dictionary to recover into.
+
+    SnapshotPath - Optionally supplies the path of the snapshot file.
+
+    LogPath - Optionally supplies the path of the log file.
+
+    NumberOfLogRecordsPointer - Optionally supplies the address of a variable
+        that receives the number of log records replayed.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if the snapshot
+    was taken against a different log.
+
+--*/
+{
+    BOOLEAN Success;
+    BOOLEAN IsEvictionEnabled;
+    HANDLE FileHandle;
+    HANDLE SectionHandle;
+    PCBYTE Base;
+    ULONGLONG LogId;
+    ULONGLONG Sequence;
+    ULONGLONG SizeInBytes;
+    ULONGLONG NumberOfRecords;
+    PCDICTIONARY_LOG_RECORD Record;
+    PCDICTIONARY_SNAPSHOT_HEADER Header;
+
+    //
+    // Validate arguments.
+    //
+
+    if (ARGUMENT_PRESENT(NumberOfLogRecordsPointer)) {
+        *NumberOfLogRecordsPointer = 0;
+    }
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(SnapshotPath) && !ARGUMENT_PRESENT(LogPath)) {
+        return FALSE;
+    }
+
+    if (Dictionary->Log) {
+        return FALSE;
+    }
+
+    LogId = 0;
+    Sequence = 0;
+
+    //
+    // Disable eviction until recovery is complete.
+    //
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+    IsEvictionEnabled = (BOOLEAN)Dictionary->Flags.IsEvictionEnabled;
+    Dictionary->Flags.IsEvictionEnabled = FALSE;
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    //
+    // Import the snapshot.
+    //
+
+    if (ARGUMENT_PRESENT(SnapshotPath)) {
+
+        if (!MapDictionaryFile(SnapshotPath,
+                               &FileHandle,
+                               &SectionHandle,
+                               &Base,
+                               &SizeInBytes)) {
+            Success = FALSE;
+            goto RestoreEviction;
+        }
+
+        Header = (PCDICTIONARY_SNAPSHOT_HEADER)Base;
+
+        Success = (
+            SizeInBytes >= sizeof(*Header) &&
+            Header->Signature == DICTIONARY_SNAPSHOT_SIGNATURE &&
+            Header->Version == DICTIONARY_SNAPSHOT_VERSION &&
+            Header->SizeOfHeader == sizeof(*Header) &&
+            Header->SizeOfExport == SizeInBytes - sizeof(*Header)
+        );
+
+        if (Success) {
+            LogId = Header->LogId;
+            Sequence = Header->LogSequence;
+            Success = ImportDictionary(Dictionary,
+                                       Header + 1,
+                                       Header->SizeOfExport,
+                                       0,
+                                       0,
+                                       NULL);
+        }
+
+        UnmapDictionaryFile(FileHandle, SectionHandle, Base);
+
+        if (!Success) {
+            goto RestoreEviction;
+        }
+    }
+
+    //
+    // Replay the log records following the snapshot.
+    //
+
+    if (!ARGUMENT_PRESENT(LogPath)) {
+        Success = TRUE;
+        goto RestoreEviction;
+    }
+
+    if (!MapDictionaryFile(LogPath,
+                           &FileHandle,
+                           &SectionHandle,
+                           &Base,
+                           &SizeInBytes)) {
+        Success = FALSE;
+        goto RestoreEviction;
+    }
+
+    if (!IsValidDictionaryLogHeader(Base, SizeInBytes)) {
+        goto Error;
+    }
+
+    if (LogId != 0 && ((PCDICTIONARY_LOG_HEADER)Base)->LogId != LogId) {
+        goto Error;
+    }
+
+    NumberOfRecords = 0;
+    Sequence = max(Sequence, sizeof(DICTIONARY_LOG_HEADER));
+
+    while (TRUE) {
+
+        Record = GetValidDictionaryLogRecord(Base, SizeInBytes, Sequence);
+
+        if (!Record) {
+            break;
+        }
+
+        if (!ReplayDictionaryLogRecord(Dictionary, Record)) {
+            goto Error;
+        }
+
+        NumberOfRecords++;
+        Sequence += Record->SizeOfRecord;
+    }
+
+    if (ARGUMENT_PRESENT(NumberOfLogRecordsPointer)) {
+        *NumberOfLogRecordsPointer = NumberOfRecords;
+    }
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    UnmapDictionaryFile(FileHandle, SectionHandle, Base);
+
+    //
+    // Intentional follow-on to RestoreEviction.
+    //
+
+RestoreEviction:
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+    Dictionary->Flags.IsEvictionEnabled = IsEvictionEnabled;
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    return Success;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
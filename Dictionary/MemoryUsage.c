@@ -0,0 +1,795 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    MemoryUsage.c
+
+Abstract:
+
+    This module implements memory accounting for the dictionary component.
+    Routines are provided for creating and destroying the tracking allocators
+    used when a dictionary is created with the TrackMemoryUsage flag, and for
+    the public GetDictionaryMemoryUsage() routine, which reports bytes, node
+    counts and tree depths for each of the dictionary's underlying structures.
+
+--*/
+
+#include "stdafx.h"
+
+//
+// Tracking allocator routines.
+//
+
+#define CONTEXT_TO_TRACKING_ALLOCATOR(Context) \
+    ((PDICTIONARY_TRACKING_ALLOCATOR)(Context))
+
+#define BUFFER_TO_ALLOCATION_HEADER(Buffer) \
+    (((PDICTIONARY_ALLOCATION_HEADER)(Buffer)) - 1)
+
+FORCEINLINE
+VOID
+TrackAllocation(
+    _In_ PDICTIONARY_TRACKING_ALLOCATOR TrackingAllocator,
+    _In_ ULONGLONG SizeInBytes
+    )
+{
+    PDICTIONARY_ALLOCATOR_MEMORY_USAGE Usage;
+
+    Usage = &TrackingAllocator->Usage;
+
+    Usage->TotalAllocations++;
+    Usage->NumberOfAllocations++;
+    Usage->NumberOfBytes += SizeInBytes;
+
+    if (Usage->NumberOfBytes > Usage->PeakNumberOfBytes) {
+        Usage->PeakNumberOfBytes = Usage->NumberOfBytes;
+    }
+}
+
+FORCEINLINE
+VOID
+TrackFree(
+    _In_ PDICTIONARY_TRACKING_ALLOCATOR TrackingAllocator,
+    _In_ ULONGLONG SizeInBytes
+    )
+{
+    PDICTIONARY_ALLOCATOR_MEMORY_USAGE Usage;
+
+    Usage = &TrackingAllocator->Usage;
+
+    ASSERT(Usage->NumberOfAllocations > 0);
+    ASSERT(Usage->NumberOfBytes >= SizeInBytes);
+
+    Usage->TotalFrees++;
+    Usage->NumberOfAllocations--;
+    Usage->NumberOfBytes -= SizeInBytes;
+}
+
+MALLOC TrackingAllocatorMalloc;
+
+_Use_decl_annotations_
+PVOID
+TrackingAllocatorMalloc(
+    PVOID Context,
+    SIZE_T Size
+    )
+{
+    PALLOCATOR Target;
+    PDICTIONARY_ALLOCATION_HEADER Header;
+    PDICTIONARY_TRACKING_ALLOCATOR TrackingAllocator;
+
+    TrackingAllocator = CONTEXT_TO_TRACKING_ALLOCATOR(Context);
+    Target = TrackingAllocator->TargetAllocator;
+
+    Header = (PDICTIONARY_ALLOCATION_HEADER)(
+        Target->Malloc(Target, sizeof(*Header) + Size)
+    );
+
+    if (!Header) {
+        return NULL;
+    }
+
+    Header->SizeInBytes = Size;
+    TrackAllocation(TrackingAllocator, Size);
+
+    return (Header + 1);
+}
+
+CALLOC TrackingAllocatorCalloc;
+
+_Use_decl_annotations_
+PVOID
+TrackingAllocatorCalloc(
+    PVOID Context,
+    SIZE_T NumberOfElements,
+    SIZE_T ElementSize
+    )
+{
+    SIZE_T Size;
+    PALLOCATOR Target;
+    PDICTIONARY_ALLOCATION_HEADER Header;
+    PDICTIONARY_TRACKING_ALLOCATOR TrackingAllocator;
+
+    TrackingAllocator = CONTEXT_TO_TRACKING_ALLOCATOR(Context);
+    Target = TrackingAllocator->TargetAllocator;
+
+    Size = NumberOfElements * ElementSize;
+
+    Header = (PDICTIONARY_ALLOCATION_HEADER)(
+        Target->Calloc(Target, 1, sizeof(*Header) + Size)
+    );
+
+    if (!Header) {
+        return NULL;
+    }
+
+    Header->SizeInBytes = Size;
+    TrackAllocation(TrackingAllocator, Size);
+
+    return (Header + 1);
+}
+
+REALLOC TrackingAllocatorRealloc;
+
+_Use_decl_annotations_
+PVOID
+TrackingAllocatorRealloc(
+    PVOID Context,
+    PVOID Buffer,
+    SIZE_T NewSize
+    )
+{
+    PALLOCATOR Target;
+    ULONGLONG OldSize;
+    PDICTIONARY_ALLOCATION_HEADER Header;
+    PDICTIONARY_ALLOCATION_HEADER NewHeader;
+    PDICTIONARY_TRACKING_ALLOCATOR TrackingAllocator;
+
+    if (!Buffer) {
+        return TrackingAllocatorMalloc(Context, NewSize);
+    }
+
+    TrackingAllocator = CONTEXT_TO_TRACKING_ALLOCATOR(Context);
+    Target = TrackingAllocator->TargetAllocator;
+
+    Header = BUFFER_TO_ALLOCATION_HEADER(Buffer);
+    OldSize = Header->SizeInBytes;
+
+    NewHeader = (PDICTIONARY_ALLOCATION_HEADER)(
+        Target->Realloc(Target, Header, sizeof(*Header) + NewSize)
+    );
+
+    if (!NewHeader) {
+        return NULL;
+    }
+
+    NewHeader->SizeInBytes = NewSize;
+    TrackFree(TrackingAllocator, OldSize);
+    TrackAllocation(TrackingAllocator, NewSize);
+
+    return (NewHeader + 1);
+}
+
+FREE TrackingAllocatorFree;
+
+_Use_decl_annotations_
+VOID
+TrackingAllocatorFree(
+    PVOID Context,
+    PVOID Buffer
+    )
+{
+    PALLOCATOR Target;
+    PDICTIONARY_ALLOCATION_HEADER Header;
+    PDICTIONARY_TRACKING_ALLOCATOR TrackingAllocator;
+
+    if (!Buffer) {
+        return;
+    }
+
+    TrackingAllocator = CONTEXT_TO_TRACKING_ALLOCATOR(Context);
+    Target = TrackingAllocator->TargetAllocator;
+
+    Header = BUFFER_TO_ALLOCATION_HEADER(Buffer);
+    TrackFree(TrackingAllocator, Header->SizeInBytes);
+
+    Target->Free(Target, Header);
+}
+
+FREE_POINTER TrackingAllocatorFreePointer;
+
+_Use_decl_annotations_
+VOID
+TrackingAllocatorFreePointer(
+    PVOID Context,
+    PPVOID BufferPointer
+    )
+{
+    if (!ARGUMENT_PRESENT(BufferPointer)) {
+        return;
+    }
+
+    if (!ARGUMENT_PRESENT(*BufferPointer)) {
+        return;
+    }
+
+    TrackingAllocatorFree(Context, *BufferPointer);
+    *BufferPointer = NULL;
+}
+
+FORCEINLINE
+VOID
+InitializeTrackingAllocator(
+    _Out_ PDICTIONARY_TRACKING_ALLOCATOR TrackingAllocator,
+    _In_ PALLOCATOR TargetAllocator
+    )
+{
+    InitializeAllocator(&TrackingAllocator->Allocator,
+                        TrackingAllocator,
+                        TrackingAllocatorMalloc,
+                        TrackingAllocatorCalloc,
+                        TrackingAllocatorRealloc,
+                        TrackingAllocatorFree,
+                        TrackingAllocatorFreePointer,
+                        NULL,
+                        NULL,
+                        NULL,
+                        NULL,
+                        NULL,
+                        NULL,
+                        NULL,
+                        NULL,
+                        NULL);
+
+    TrackingAllocator->Allocator.Parent = TargetAllocator;
+    TrackingAllocator->TargetAllocator = TargetAllocator;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CreateDictionaryTrackingAllocators(
+    PDICTIONARY Dictionary
+    )
+/*++
+
+Routine Description:
+
+    Creates tracking allocators for each of the dictionary's table allocators
+    and the word allocator, and wires them up to the dictionary.  This routine
+    must be called before any of the dictionary's tables are populated.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure for which the
+        tracking allocators are to be created.  The current table and word
+        allocators are used as the target allocators.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    PALLOCATOR Allocator;
+    PDICTIONARY_TRACKING_ALLOCATORS TrackingAllocators;
+
+    ASSERT(Dictionary->TrackingAllocators == NULL);
+
+    Allocator = Dictionary->Allocator;
+
+    TrackingAllocators = (PDICTIONARY_TRACKING_ALLOCATORS)(
+        Allocator->Calloc(Allocator, 1, sizeof(*TrackingAllocators))
+    );
+
+    if (!TrackingAllocators) {
+        return FALSE;
+    }
+
+#define INIT_TRACKING_ALLOCATOR(Name)                                   \
+    InitializeTrackingAllocator(&TrackingAllocators->Name,              \
+                                Dictionary->Name##Allocator);           \
+    Dictionary->Name##Allocator = &TrackingAllocators->Name.Allocator
+
+    INIT_TRACKING_ALLOCATOR(BitmapTable);
+    INIT_TRACKING_ALLOCATOR(HistogramTable);
+    INIT_TRACKING_ALLOCATOR(WordTable);
+    INIT_TRACKING_ALLOCATOR(LengthTable);
+    INIT_TRACKING_ALLOCATOR(Word);
+
+#undef INIT_TRACKING_ALLOCATOR
+
+    Dictionary->TrackingAllocators = TrackingAllocators;
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+VOID
+DestroyDictionaryTrackingAllocators(
+    PDICTIONARY Dictionary
+    )
+/*++
+
+Routine Description:
+
+    Destroys a dictionary's tracking allocators, if any, restoring the table
+    and word allocator pointers to their original target allocators.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure for which the
+        tracking allocators are to be destroyed.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    PALLOCATOR Allocator;
+    PDICTIONARY_TRACKING_ALLOCATORS TrackingAllocators;
+
+    TrackingAllocators = Dictionary->TrackingAllocators;
+
+    if (!TrackingAllocators) {
+        return;
+    }
+
+    Dictionary->BitmapTableAllocator =
+        TrackingAllocators->BitmapTable.TargetAllocator;
+    Dictionary->HistogramTableAllocator =
+        TrackingAllocators->HistogramTable.TargetAllocator;
+    Dictionary->WordTableAllocator =
+        TrackingAllocators->WordTable.TargetAllocator;
+    Dictionary->LengthTableAllocator =
+        TrackingAllocators->LengthTable.TargetAllocator;
+    Dictionary->WordAllocator =
+        TrackingAllocators->Word.TargetAllocator;
+
+    Allocator = Dictionary->Allocator;
+    Allocator->FreePointer(Allocator, (PPVOID)&Dictionary->TrackingAllocators);
+}
+
+//
+// Table walking routines.
+//
+
+typedef struct _TABLE_DEPTH_STATS {
+    ULONGLONG NumberOfNodes;
+    ULONGLONG SumOfDepths;
+    ULONG MaximumDepth;
+    ULONG Padding;
+} TABLE_DEPTH_STATS;
+typedef TABLE_DEPTH_STATS *PTABLE_DEPTH_STATS;
+
+typedef
+VOID
+(NTAPI ACCUMULATE_TABLE_DEPTH_STATS)(
+    _In_opt_ PRTL_BALANCED_LINKS Links,
+    _In_ ULONG Depth,
+    _Inout_ PTABLE_DEPTH_STATS Stats
+    );
+typedef ACCUMULATE_TABLE_DEPTH_STATS *PACCUMULATE_TABLE_DEPTH_STATS;
+ACCUMULATE_TABLE_DEPTH_STATS AccumulateTableDepthStats;
+
+_Use_decl_annotations_
+VOID
+AccumulateTableDepthStats(
+    PRTL_BALANCED_LINKS Links,
+    ULONG Depth,
+    PTABLE_DEPTH_STATS Stats
+    )
+/*++
+
+Routine Description:
+
+    Recursively walks an AVL subtree, accumulating node counts and depths.
+    This routine does not modify the tree (unlike RtlEnumerateGenericTableAvl,
+    which splays), so it is safe to call with the dictionary lock held shared.
+    Recursion depth is bounded by the AVL tree height (~1.44 log2 N).
+
+Arguments:
+
+    Links - Supplies a pointer to the root of the subtree to walk.  May be
+        NULL, in which case the routine returns immediately.
+
+    Depth - Supplies the depth of Links within the tree (the root is 1).
+
+    Stats - Supplies a pointer to a TABLE_DEPTH_STATS structure to update.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    if (!Links) {
+        return;
+    }
+
+    Stats->NumberOfNodes++;
+    Stats->SumOfDepths += Depth;
+
+    if (Depth > Stats->MaximumDepth) {
+        Stats->MaximumDepth = Depth;
+    }
+
+    AccumulateTableDepthStats(Links->LeftChild, Depth + 1, Stats);
+    AccumulateTableDepthStats(Links->RightChild, Depth + 1, Stats);
+}
+
+FORCEINLINE
+VOID
+AccumulateTable(
+    _In_ PRTL_AVL_TABLE Avl,
+    _Inout_ PTABLE_DEPTH_STATS Stats,
+    _Inout_ PDICTIONARY_TABLE_MEMORY_USAGE Usage
+    )
+{
+    Usage->NumberOfTables++;
+    AccumulateTableDepthStats(Avl->BalancedRoot.RightChild, 1, Stats);
+}
+
+FORCEINLINE
+VOID
+FinalizeTableUsage(
+    _In_ PTABLE_DEPTH_STATS Stats,
+    _In_ ULONG NodeSizeInBytes,
+    _Inout_ PDICTIONARY_TABLE_MEMORY_USAGE Usage
+    )
+{
+    Usage->NumberOfNodes = Stats->NumberOfNodes;
+    Usage->NodeSizeInBytes = NodeSizeInBytes;
+    Usage->NumberOfBytes = Stats->NumberOfNodes * NodeSizeInBytes;
+    Usage->MaximumDepth = Stats->MaximumDepth;
+
+    if (Stats->NumberOfNodes > 0) {
+        Usage->AverageDepth = (
+            (DOUBLE)Stats->SumOfDepths /
+            (DOUBLE)Stats->NumberOfNodes
+        );
+    }
+}
+
+_Use_decl_annotations_
+BOOLEAN
+GetDictionaryMemoryUsage(
+    PDICTIONARY Dictionary,
+    PDICTIONARY_MEMORY_USAGE MemoryUsage
+    )
+/*++
+
+Routine Description:
+
+    Gets memory usage information for a dictionary.  Every table in the
+    dictionary is walked (without splaying) in order to determine node counts,
+    tree depths and string buffer sizes.  If the dictionary was created with
+    the TrackMemoryUsage flag, the counters of each tracking allocator are
+    also captured.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure for which the
+        memory usage is to be obtained.
+
+    MemoryUsage - Supplies a pointer to a DICTIONARY_MEMORY_USAGE structure
+        that receives the memory usage information.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    PRTL Rtl;
+    PVOID RestartKey;
+    PVOID HistogramRestartKey;
+    PVOID WordRestartKey;
+    PCLONG_STRING String;
+    PWORD_TABLE WordTable;
+    PBITMAP_TABLE BitmapTable;
+    PLENGTH_TABLE LengthTable;
+    PHISTOGRAM_TABLE HistogramTable;
+    PWORD_TABLE_ENTRY WordTableEntry;
+    PBITMAP_TABLE_ENTRY BitmapTableEntry;
+    PHISTOGRAM_TABLE_ENTRY HistogramTableEntry;
+    PTABLE_ENTRY_HEADER TableEntryHeader;
+    PCLONG_STRING LongestWordAllTime;
+    PFROZEN_DICTIONARY Frozen;
+    PDICTIONARY_NUMA_REPLICAS NumaReplicas;
+    PPREFIX_INDEX PrefixIndex;
+    TABLE_DEPTH_STATS BitmapStats;
+    TABLE_DEPTH_STATS HistogramStats;
+    TABLE_DEPTH_STATS WordStats;
+    TABLE_DEPTH_STATS LengthStats;
+    ULONGLONG NumberOfNonStringBytes;
+    ULONGLONG NumberOfInlineStringBytes;
+    PDICTIONARY_TRACKING_ALLOCATORS TrackingAllocators;
+    PRTL_ENUMERATE_GENERIC_TABLE_WITHOUT_SPLAYING_AVL EnumerateTable;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(MemoryUsage)) {
+        return FALSE;
+    }
+
+    //
+    // Zero the caller's structure and local stats.
+    //
+
+    ZeroStructPointer(MemoryUsage);
+    MemoryUsage->SizeOfStruct = sizeof(*MemoryUsage);
+
+    ZeroStruct(BitmapStats);
+    ZeroStruct(HistogramStats);
+    ZeroStruct(WordStats);
+    ZeroStruct(LengthStats);
+    NumberOfInlineStringBytes = 0;
+
+    //
+    // Initialize aliases.
+    //
+
+    Rtl = Dictionary->Rtl;
+    EnumerateTable = Rtl->RtlEnumerateGenericTableWithoutSplayingAvl;
+    BitmapTable = &Dictionary->BitmapTable;
+    LengthTable = &Dictionary->LengthTable;
+
+    //
+    // Acquire the dictionary lock in shared mode; we don't modify any of the
+    // tables (including their splay state) whilst walking them.
+    //
+
+    AcquireDictionaryLockShared(&Dictionary->Lock);
+
+    //
+    // Walk the top-level tables.
+    //
+
+    AccumulateTable(&BitmapTable->Avl, &BitmapStats, &MemoryUsage->BitmapTable);
+    AccumulateTable(&LengthTable->Avl, &LengthStats, &MemoryUsage->LengthTable);
+
+    //
+    // Enumerate each bitmap table entry's histogram table, and then each
+    // histogram table entry's words.
+    //
+
+    RestartKey = NULL;
+
+    while (TRUE) {
+
+        BitmapTableEntry = (PBITMAP_TABLE_ENTRY)(
+            EnumerateTable(&BitmapTable->Avl, &RestartKey)
+        );
+
+        if (!BitmapTableEntry) {
+            break;
+        }
+
+        HistogramTable = &BitmapTableEntry->HistogramTable;
+
+        AccumulateTable(&HistogramTable->Avl,
+                        &HistogramStats,
+                        &MemoryUsage->HistogramTable);
+
+        HistogramRestartKey = NULL;
+
+        while (TRUE) {
+
+            HistogramTableEntry = (PHISTOGRAM_TABLE_ENTRY)(
+                EnumerateTable(&HistogramTable->Avl, &HistogramRestartKey)
+            );
+
+            if (!HistogramTableEntry) {
+                break;
+            }
+
+            if (HistogramTableEntryHasInlineWord(HistogramTableEntry)) {
+
+                //
+                // The word is stored inline; it doesn't have a node of its
+                // own, so only the string buffer is accounted for.
+                //
+
+                WordTableEntry = &HistogramTableEntry->InlineWordTableEntry;
+                String = &WordTableEntry->WordEntry.String;
+
+                MemoryUsage->NumberOfWords++;
+                MemoryUsage->NumberOfInlineWords++;
+                MemoryUsage->NumberOfStringBytes += String->Length + 1;
+
+                TableEntryHeader = TABLE_ENTRY_TO_HEADER(HistogramTableEntry);
+
+                if (TableEntryHeader->IsInlineString) {
+                    MemoryUsage->NumberOfInlineStrings++;
+                    NumberOfInlineStringBytes += String->Length + 1;
+                }
+
+                continue;
+            }
+
+            WordTable = &HistogramTableEntry->WordTable;
+
+            AccumulateTable(&WordTable->Avl,
+                            &WordStats,
+                            &MemoryUsage->WordTable);
+
+            WordRestartKey = NULL;
+
+            while (TRUE) {
+
+                WordTableEntry = (PWORD_TABLE_ENTRY)(
+                    EnumerateTable(&WordTable->Avl, &WordRestartKey)
+                );
+
+                if (!WordTableEntry) {
+                    break;
+                }
+
+                String = &WordTableEntry->WordEntry.String;
+
+                MemoryUsage->NumberOfWords++;
+                MemoryUsage->NumberOfStringBytes += String->Length + 1;
+
+                TableEntryHeader = TABLE_ENTRY_TO_HEADER(WordTableEntry);
+
+                if (TableEntryHeader->IsInlineString) {
+                    MemoryUsage->NumberOfInlineStrings++;
+                    NumberOfInlineStringBytes += String->Length + 1;
+                }
+            }
+        }
+    }
+
+    //
+    // Finalize the per-table usage.
+    //
+
+    FinalizeTableUsage(&BitmapStats,
+                       TABLE_NODE_SIZE(BITMAP),
+                       &MemoryUsage->BitmapTable);
+
+    FinalizeTableUsage(&HistogramStats,
+                       TABLE_NODE_SIZE(HISTOGRAM),
+                       &MemoryUsage->HistogramTable);
+
+    FinalizeTableUsage(&WordStats,
+                       TABLE_NODE_SIZE(WORD),
+                       &MemoryUsage->WordTable);
+
+    FinalizeTableUsage(&LengthStats,
+                       TABLE_NODE_SIZE(LENGTH),
+                       &MemoryUsage->LengthTable);
+
+    //
+    // Calculate the total number of bytes used.  If the longest word of all
+    // time has been removed from the dictionary, a separate copy of it will
+    // have been allocated (indicated by a hash of 0); account for that, too.
+    // Inline strings are already included in the table node sizes, so they
+    // are excluded here to avoid counting them twice.
+    //
+
+    NumberOfNonStringBytes = (
+        sizeof(*Dictionary) +
+        MemoryUsage->BitmapTable.NumberOfBytes +
+        MemoryUsage->HistogramTable.NumberOfBytes +
+        MemoryUsage->WordTable.NumberOfBytes +
+        MemoryUsage->LengthTable.NumberOfBytes -
+        NumberOfInlineStringBytes
+    );
+
+    LongestWordAllTime = Dictionary->Stats.LongestWordAllTime;
+
+    if (LongestWordAllTime && LongestWordAllTime->Hash == 0) {
+        NumberOfNonStringBytes += (
+            sizeof(LONG_STRING) + LongestWordAllTime->Length + 1
+        );
+    }
+
+    //
+    // Capture the compaction arena counters.
+    //
+
+    MemoryUsage->NumberOfArenaChunks = Dictionary->NumberOfArenaChunks;
+    MemoryUsage->NumberOfArenaBytes = Dictionary->NumberOfArenaBytes;
+
+    //
+    // If the dictionary has been frozen, its tables will be empty; account for
+    // the words and bytes of the frozen representation instead.
+    //
+
+    Frozen = Dictionary->Frozen;
+
+    if (Frozen) {
+
+        MemoryUsage->Flags.IsFrozen = TRUE;
+        MemoryUsage->NumberOfWords = Frozen->NumberOfWords;
+        MemoryUsage->NumberOfStringBytes = Frozen->NumberOfStringBytes;
+        MemoryUsage->NumberOfFrozenBytes = Frozen->SizeInBytes;
+
+        NumberOfNonStringBytes += (
+            Frozen->SizeInBytes -
+            Frozen->NumberOfStringBytes
+        );
+    }
+
+    //
+    // Account for any NUMA replicas of the frozen dictionary.
+    //
+
+    NumaReplicas = Dictionary->NumaReplicas;
+
+    if (NumaReplicas) {
+
+        MemoryUsage->NumberOfNumaReplicas = NumaReplicas->NumberOfReplicas;
+        MemoryUsage->NumberOfNumaReplicaBytes =
+            NumaReplicas->NumberOfReplicaBytes;
+
+        NumberOfNonStringBytes += (
+            sizeof(*NumaReplicas) +
+            NumaReplicas->NumberOfReplicaBytes
+        );
+    }
+
+    //
+    // Account for the prefix index, if applicable.
+    //
+
+    PrefixIndex = Dictionary->PrefixIndex;
+
+    if (PrefixIndex) {
+        MemoryUsage->NumberOfPrefixIndexNodes = PrefixIndex->NumberOfNodes;
+        MemoryUsage->NumberOfPrefixIndexBytes = PrefixIndex->NumberOfBytes;
+        NumberOfNonStringBytes += PrefixIndex->NumberOfBytes;
+    }
+
+    TrackingAllocators = Dictionary->TrackingAllocators;
+
+    if (TrackingAllocators) {
+
+        NumberOfNonStringBytes += sizeof(*TrackingAllocators);
+
+        //
+        // Capture the tracking allocator counters.
+        //
+
+        MemoryUsage->Flags.IsTrackingEnabled = TRUE;
+
+        MemoryUsage->BitmapTableAllocator =
+            TrackingAllocators->BitmapTable.Usage;
+        MemoryUsage->HistogramTableAllocator =
+            TrackingAllocators->HistogramTable.Usage;
+        MemoryUsage->WordTableAllocator =
+            TrackingAllocators->WordTable.Usage;
+        MemoryUsage->LengthTableAllocator =
+            TrackingAllocators->LengthTable.Usage;
+        MemoryUsage->WordAllocator =
+            TrackingAllocators->Word.Usage;
+    }
+
+    ReleaseDictionaryLockShared(&Dictionary->Lock);
+
+    MemoryUsage->TotalNumberOfBytes = (
+        NumberOfNonStringBytes +
+        MemoryUsage->NumberOfStringBytes
+    );
+
+    if (MemoryUsage->NumberOfStringBytes > 0) {
+        MemoryUsage->OverheadRatio = (
+            (DOUBLE)NumberOfNonStringBytes /
+            (DOUBLE)MemoryUsage->NumberOfStringBytes
+        );
+    }
+
+    return TRUE;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
@@ -0,0 +1,332 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    NumaReplica.c
+
+Abstract:
+
+    This module implements per-NUMA node read replicas of frozen dictionaries.
+    Routines are provided for creating and destroying the replicas.  Readers
+    resolve their local replica via the GetLocalFrozenDictionary() inline
+    routine.
+
+    Replicas are only created for frozen dictionaries: a frozen dictionary is
+    immutable and lives in a single allocation, so a replica is simply a copy
+    of that allocation (with its internal pointers rebased) residing in memory
+    local to the given node, and no write replay or versioning is required to
+    keep replicas consistent.
+
+--*/
+
+#include "stdafx.h"
+
+_Use_decl_annotations_
+PFROZEN_DICTIONARY
+CreateFrozenDictionaryReplica(
+    PFROZEN_DICTIONARY Frozen,
+    ULONG NodeNumber
+    )
+/*++
+
+Routine Description:
+
+    Creates a replica of a frozen dictionary in memory local to the given
+    NUMA node.
+
+    The replica is positioned at the same offset from a cache line boundary
+    as the source, such that the cache line alignment of the histogram keys
+    array is preserved.  Once the copy is complete, the pages are made read
+    only.
+
+Arguments:
+
+    Frozen - Supplies a pointer to the source FROZEN_DICTIONARY structure.
+
+    NodeNumber - Supplies the NUMA node number on which to allocate the
+        replica.
+
+Return Value:
+
+    Address of the replica if successful, NULL otherwise.
+
+--*/
+{
+    ULONG Index;
+    ULONG OldProtection;
+    PBYTE BaseAddress;
+    LONG_PTR Delta;
+    SIZE_T SizeInBytes;
+    ULONG_PTR Offset;
+    PLONG_STRING String;
+    PFROZEN_DICTIONARY Replica;
+
+    Offset = (ULONG_PTR)Frozen & (FROZEN_CACHE_LINE_SIZE - 1);
+    SizeInBytes = (SIZE_T)Frozen->SizeInBytes + Offset;
+
+    BaseAddress = (PBYTE)VirtualAllocExNuma(GetCurrentProcess(),
+                                            NULL,
+                                            SizeInBytes,
+                                            MEM_RESERVE | MEM_COMMIT,
+                                            PAGE_READWRITE,
+                                            NodeNumber);
+
+    if (!BaseAddress) {
+        return NULL;
+    }
+
+    Replica = (PFROZEN_DICTIONARY)(BaseAddress + Offset);
+
+    CopyMemory(Replica, Frozen, Frozen->SizeInBytes);
+
+    //
+    // Rebase the array pointers and the string buffer of each word entry.
+    //
+
+    Delta = (LONG_PTR)Replica - (LONG_PTR)Frozen;
+
+#define REBASE(Pointer) Pointer = RtlOffsetToPointer(Pointer, Delta)
+
+    REBASE(Replica->HistogramKeys);
+    REBASE(Replica->HistogramEntries);
+    REBASE(Replica->WordHashes);
+    REBASE(Replica->WordEntries);
+    REBASE(Replica->LengthEntries);
+    REBASE(Replica->LengthOrderedWords);
+
+    for (Index = 0; Index < Replica->NumberOfWords; Index++) {
+        String = &Replica->WordEntries[Index].String;
+        REBASE(String->Buffer);
+    }
+
+#undef REBASE
+
+    ASSERT(IsAligned64(Replica->HistogramKeys) ||
+           Replica->NumberOfHistograms == 0);
+
+    //
+    // Make the replica read-only.  This is purely a safeguard; failure isn't
+    // considered fatal.
+    //
+
+    VirtualProtect(BaseAddress, SizeInBytes, PAGE_READONLY, &OldProtection);
+
+    return Replica;
+}
+
+_Use_decl_annotations_
+VOID
+DestroyFrozenDictionaryReplica(
+    PFROZEN_DICTIONARY Replica
+    )
+{
+    PVOID BaseAddress;
+
+    //
+    // Replicas are positioned less than a cache line into the page-aligned
+    // allocation, so aligning down to a page yields the allocation base.
+    //
+
+    BaseAddress = (PVOID)ALIGN_DOWN(Replica, PAGE_SIZE);
+    VirtualFree(BaseAddress, 0, MEM_RELEASE);
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CreateFrozenDictionaryReplicas(
+    PDICTIONARY Dictionary,
+    PFROZEN_DICTIONARY Frozen
+    )
+/*++
+
+Routine Description:
+
+    Creates a replica of a frozen dictionary on each NUMA node that has at
+    least one active processor, and captures a processor to node map used by
+    GetLocalFrozenDictionary() to route readers to their local replica.
+
+    If the system only has a single NUMA node, no replicas are created and
+    the routine returns success.  If a replica can't be allocated on a given
+    node, readers on that node will use the primary frozen dictionary.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure for which the
+        replicas are to be created.  The NumaReplicas field will be updated on
+        success.
+
+    Frozen - Supplies a pointer to the primary FROZEN_DICTIONARY structure to
+        replicate.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    ULONG Slot;
+    ULONG Index;
+    ULONG NodeNumber;
+    ULONG HighestNodeNumber;
+    ULONG NumberOfSlots;
+    ULONG NumberOfProcessors;
+    USHORT Group;
+    USHORT NumberOfGroups;
+    USHORT ProcessorNodeNumber;
+    BOOLEAN Success;
+    SIZE_T SizeInBytes;
+    PALLOCATOR Allocator;
+    PROCESSOR_NUMBER ProcessorNumber;
+    PDICTIONARY_NUMA_REPLICAS NumaReplicas;
+
+    ASSERT(Dictionary->NumaReplicas == NULL);
+
+    if (!GetNumaHighestNodeNumber(&HighestNodeNumber)) {
+        return FALSE;
+    }
+
+    if (HighestNodeNumber == 0) {
+
+        //
+        // There's only one NUMA node; replicas would provide no benefit.
+        //
+
+        return TRUE;
+    }
+
+    //
+    // Allocate the replicas structure along with the replica and processor
+    // node number arrays.
+    //
+
+    NumberOfGroups = GetActiveProcessorGroupCount();
+    NumberOfSlots = (ULONG)NumberOfGroups * MAXIMUM_PROC_PER_GROUP;
+
+    SizeInBytes = (
+        sizeof(DICTIONARY_NUMA_REPLICAS) +
+        (sizeof(PFROZEN_DICTIONARY) * ((SIZE_T)HighestNodeNumber + 1)) +
+        (sizeof(USHORT) * (SIZE_T)NumberOfSlots)
+    );
+
+    Allocator = Dictionary->Allocator;
+    NumaReplicas = (PDICTIONARY_NUMA_REPLICAS)(
+        Allocator->Calloc(Allocator, 1, SizeInBytes)
+    );
+
+    if (!NumaReplicas) {
+        return FALSE;
+    }
+
+    NumaReplicas->HighestNodeNumber = HighestNodeNumber;
+    NumaReplicas->NumberOfProcessorSlots = NumberOfSlots;
+    NumaReplicas->Replicas = (PFROZEN_DICTIONARY *)(NumaReplicas + 1);
+    NumaReplicas->ProcessorNodeNumbers = (PUSHORT)(
+        NumaReplicas->Replicas + HighestNodeNumber + 1
+    );
+
+    //
+    // Capture the node number of each active processor.
+    //
+
+    for (Slot = 0; Slot < NumberOfSlots; Slot++) {
+        NumaReplicas->ProcessorNodeNumbers[Slot] = MAXUSHORT;
+    }
+
+    for (Group = 0; Group < NumberOfGroups; Group++) {
+
+        NumberOfProcessors = GetActiveProcessorCount(Group);
+
+        for (Index = 0; Index < NumberOfProcessors; Index++) {
+
+            ZeroStruct(ProcessorNumber);
+            ProcessorNumber.Group = Group;
+            ProcessorNumber.Number = (BYTE)Index;
+
+            Success = GetNumaProcessorNodeEx(&ProcessorNumber,
+                                             &ProcessorNodeNumber);
+
+            if (!Success) {
+                continue;
+            }
+
+            Slot = ((ULONG)Group * MAXIMUM_PROC_PER_GROUP) + Index;
+            NumaReplicas->ProcessorNodeNumbers[Slot] = ProcessorNodeNumber;
+
+            //
+            // Create a replica on this node if we haven't already.
+            //
+
+            NodeNumber = ProcessorNodeNumber;
+
+            if (NodeNumber > HighestNodeNumber ||
+                NumaReplicas->Replicas[NodeNumber] != NULL) {
+                continue;
+            }
+
+            NumaReplicas->Replicas[NodeNumber] = (
+                CreateFrozenDictionaryReplica(Frozen, NodeNumber)
+            );
+
+            if (NumaReplicas->Replicas[NodeNumber]) {
+                NumaReplicas->NumberOfReplicas++;
+                NumaReplicas->NumberOfReplicaBytes += Frozen->SizeInBytes;
+            }
+        }
+    }
+
+    Dictionary->NumaReplicas = NumaReplicas;
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+VOID
+DestroyFrozenDictionaryReplicas(
+    PDICTIONARY Dictionary
+    )
+/*++
+
+Routine Description:
+
+    Destroys a dictionary's NUMA replicas, if any.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure for which the
+        replicas are to be destroyed.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ULONG NodeNumber;
+    PALLOCATOR Allocator;
+    PFROZEN_DICTIONARY Replica;
+    PDICTIONARY_NUMA_REPLICAS NumaReplicas;
+
+    NumaReplicas = Dictionary->NumaReplicas;
+
+    if (!NumaReplicas) {
+        return;
+    }
+
+    for (NodeNumber = 0;
+         NodeNumber <= NumaReplicas->HighestNodeNumber;
+         NodeNumber++) {
+
+        Replica = NumaReplicas->Replicas[NodeNumber];
+
+        if (Replica) {
+            DestroyFrozenDictionaryReplica(Replica);
+        }
+    }
+
+    Allocator = Dictionary->Allocator;
+    Allocator->FreePointer(Allocator, (PPVOID)&Dictionary->NumaReplicas);
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
@@ -0,0 +1,1074 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    PrefixIndex.c
+
+Abstract:
+
+    This module implements the optional prefix index of the dictionary
+    component.  The index is a byte-wise trie of all words in the dictionary,
+    maintained by AddWordEntry() and RemoveWord(), which services the public
+    GetWordsWithPrefix() routine.
+
+    Each node tracks the maximum entry count of any word in its subtree, which
+    allows the top-K most frequent completions of a prefix to be found with a
+    best-first search: nodes are expanded in descending order of their subtree
+    maximum, so words are discovered in descending order of entry count, and
+    the search stops as soon as K words have been found.
+
+--*/
+
+#include "stdafx.h"
+
+//
+// Define the search item structure and helper routines for the binary max
+// heap used by GetWordsWithPrefix().  An item either refers to a node's
+// subtree (prioritized by the subtree's maximum entry count), or to the word
+// ending at a node (prioritized by the word's entry count).
+//
+
+typedef struct _PREFIX_SEARCH_ITEM {
+    LONGLONG Priority;
+    PPREFIX_NODE Node;
+    ULONG IsWord;
+    ULONG Padding;
+} PREFIX_SEARCH_ITEM;
+typedef PREFIX_SEARCH_ITEM *PPREFIX_SEARCH_ITEM;
+
+#define PREFIX_SEARCH_INITIAL_HEAP_CAPACITY 64
+
+FORCEINLINE
+BOOLEAN
+IsPrefixSearchItemGreater(
+    _In_ PPREFIX_SEARCH_ITEM Left,
+    _In_ PPREFIX_SEARCH_ITEM Right
+    )
+{
+    //
+    // Words are preferred over subtrees of equal priority, such that they're
+    // returned as soon as possible.
+    //
+
+    if (Left->Priority != Right->Priority) {
+        return (Left->Priority > Right->Priority);
+    }
+
+    return (Left->IsWord > Right->IsWord);
+}
+
+FORCEINLINE
+VOID
+PushPrefixSearchItem(
+    _Inout_updates_(*NumberOfItems + 1) PPREFIX_SEARCH_ITEM Heap,
+    _Inout_ PULONG NumberOfItems,
+    _In_ PPREFIX_SEARCH_ITEM Item
+    )
+{
+    ULONG Index;
+    ULONG ParentIndex;
+
+    Index = (*NumberOfItems)++;
+
+    while (Index > 0) {
+        ParentIndex = (Index - 1) >> 1;
+        if (!IsPrefixSearchItemGreater(Item, &Heap[ParentIndex])) {
+            break;
+        }
+        Heap[Index] = Heap[ParentIndex];
+        Index = ParentIndex;
+    }
+
+    Heap[Index] = *Item;
+}
+
+FORCEINLINE
+VOID
+PopPrefixSearchItem(
+    _Inout_updates_(*NumberOfItems) PPREFIX_SEARCH_ITEM Heap,
+    _Inout_ PULONG NumberOfItems,
+    _Out_ PPREFIX_SEARCH_ITEM Item
+    )
+{
+    ULONG Index;
+    ULONG ChildIndex;
+    ULONG Count;
+    PREFIX_SEARCH_ITEM Last;
+
+    ASSERT(*NumberOfItems > 0);
+
+    *Item = Heap[0];
+    Count = --(*NumberOfItems);
+
+    if (Count == 0) {
+        return;
+    }
+
+    Last = Heap[Count];
+    Index = 0;
+
+    for (;;) {
+        ChildIndex = (Index << 1) + 1;
+        if (ChildIndex >= Count) {
+            break;
+        }
+        if (ChildIndex + 1 < Count &&
+            IsPrefixSearchItemGreater(&Heap[ChildIndex + 1],
+                                      &Heap[ChildIndex])) {
+            ChildIndex++;
+        }
+        if (!IsPrefixSearchItemGreater(&Heap[ChildIndex], &Last)) {
+            break;
+        }
+        Heap[Index] = Heap[ChildIndex];
+        Index = ChildIndex;
+    }
+
+    Heap[Index] = Last;
+}
+
+//
+// Child array helpers.
+//
+
+FORCEINLINE
+BOOLEAN
+FindPrefixNodeChildIndex(
+    _In_ PCPREFIX_NODE Node,
+    _In_ BYTE Byte,
+    _Out_ PULONG IndexPointer
+    )
+/*++
+
+Routine Description:
+
+    Performs a binary search of a node's sorted child byte array for the given
+    byte.  If found, returns TRUE and the index of the child.  If not found,
+    returns FALSE and the index at which the child would be inserted.
+
+--*/
+{
+    ULONG Low;
+    ULONG High;
+    ULONG Middle;
+    PBYTE Bytes;
+
+    Low = 0;
+    High = Node->NumberOfChildren;
+
+    if (High == 0) {
+        *IndexPointer = 0;
+        return FALSE;
+    }
+
+    Bytes = PREFIX_NODE_CHILD_BYTES(Node);
+
+    while (Low < High) {
+        Middle = (Low + High) >> 1;
+        if (Bytes[Middle] < Byte) {
+            Low = Middle + 1;
+        } else {
+            High = Middle;
+        }
+    }
+
+    *IndexPointer = Low;
+
+    return (Low < Node->NumberOfChildren && Bytes[Low] == Byte);
+}
+
+FORCEINLINE
+SIZE_T
+PrefixNodeChildArraySize(
+    _In_ ULONG Capacity
+    )
+{
+    return (SIZE_T)Capacity * (sizeof(PPREFIX_NODE) + sizeof(BYTE));
+}
+
+FORCEINLINE
+BOOLEAN
+AddPrefixNodeChild(
+    _In_ PDICTIONARY Dictionary,
+    _Inout_ PPREFIX_NODE Node,
+    _In_ BYTE Byte,
+    _In_ ULONG Index,
+    _Outptr_result_nullonfailure_ PPREFIX_NODE *ChildPointer
+    )
+/*++
+
+Routine Description:
+
+    Allocates a new child node for the given byte and inserts it into the
+    node's child arrays at the given index (obtained from a prior call to
+    FindPrefixNodeChildIndex()).  The child arrays are grown if necessary.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure that owns the
+        prefix index.
+
+    Node - Supplies a pointer to the parent node.
+
+    Byte - Supplies the byte value of the edge to the new child.
+
+    Index - Supplies the index at which the child is to be inserted.
+
+    ChildPointer - Supplies the address of a variable that receives the address
+        of the new child node.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    ULONG Count;
+    ULONG Capacity;
+    ULONG NewCapacity;
+    PBYTE Bytes;
+    PBYTE NewBytes;
+    PPREFIX_NODE Child;
+    PPREFIX_NODE *Children;
+    PPREFIX_NODE *NewChildren;
+    PALLOCATOR Allocator;
+    PPREFIX_INDEX PrefixIndex;
+
+    *ChildPointer = NULL;
+
+    Allocator = Dictionary->Allocator;
+    PrefixIndex = Dictionary->PrefixIndex;
+    Count = Node->NumberOfChildren;
+    Capacity = Node->ChildCapacity;
+
+    Child = (PPREFIX_NODE)Allocator->Calloc(Allocator, 1, sizeof(*Child));
+    if (!Child) {
+        return FALSE;
+    }
+
+    if (Count == Capacity) {
+
+        //
+        // Grow the child arrays.  The pointers and bytes need to be copied
+        // separately as the bytes follow the pointer array.
+        //
+
+        ASSERT(Capacity < PREFIX_NODE_MAXIMUM_CHILD_CAPACITY);
+
+        if (Capacity == 0) {
+            NewCapacity = PREFIX_NODE_MINIMUM_CHILD_CAPACITY;
+        } else {
+            NewCapacity = Capacity << 1;
+        }
+
+        NewChildren = (PPREFIX_NODE *)(
+            Allocator->Calloc(Allocator,
+                              1,
+                              PrefixNodeChildArraySize(NewCapacity))
+        );
+
+        if (!NewChildren) {
+            Allocator->FreePointer(Allocator, (PPVOID)&Child);
+            return FALSE;
+        }
+
+        NewBytes = (PBYTE)(NewChildren + NewCapacity);
+
+        if (Node->Children) {
+            CopyMemory(NewChildren, Node->Children, Count * sizeof(Child));
+            CopyMemory(NewBytes, PREFIX_NODE_CHILD_BYTES(Node), Count);
+            Allocator->FreePointer(Allocator, (PPVOID)&Node->Children);
+            PrefixIndex->NumberOfBytes -= PrefixNodeChildArraySize(Capacity);
+        }
+
+        Node->Children = NewChildren;
+        Node->ChildCapacity = (USHORT)NewCapacity;
+        PrefixIndex->NumberOfBytes += PrefixNodeChildArraySize(NewCapacity);
+    }
+
+    //
+    // Shift subsequent children up by one and insert the new child.
+    //
+
+    Children = Node->Children;
+    Bytes = PREFIX_NODE_CHILD_BYTES(Node);
+
+    if (Index < Count) {
+        MoveMemory(&Children[Index + 1],
+                   &Children[Index],
+                   (Count - Index) * sizeof(Child));
+        MoveMemory(&Bytes[Index + 1], &Bytes[Index], Count - Index);
+    }
+
+    Children[Index] = Child;
+    Bytes[Index] = Byte;
+    Node->NumberOfChildren++;
+
+    Child->Parent = Node;
+    Child->Byte = Byte;
+    Child->Depth = Node->Depth + 1;
+
+    PrefixIndex->NumberOfNodes++;
+    PrefixIndex->NumberOfBytes += sizeof(*Child);
+
+    *ChildPointer = Child;
+
+    return TRUE;
+}
+
+FORCEINLINE
+VOID
+RemovePrefixNode(
+    _In_ PDICTIONARY Dictionary,
+    _In_ _Post_invalid_ PPREFIX_NODE Node
+    )
+/*++
+
+Routine Description:
+
+    Removes a node with no children from its parent's child arrays and frees
+    it.  The parent's child arrays are freed if this was its last child.
+
+--*/
+{
+    ULONG Index;
+    ULONG Count;
+    BOOLEAN Found;
+    PBYTE Bytes;
+    PPREFIX_NODE Parent;
+    PALLOCATOR Allocator;
+    PPREFIX_INDEX PrefixIndex;
+
+    ASSERT(Node->NumberOfChildren == 0);
+    ASSERT(Node->Children == NULL);
+
+    Allocator = Dictionary->Allocator;
+    PrefixIndex = Dictionary->PrefixIndex;
+    Parent = Node->Parent;
+
+    Found = FindPrefixNodeChildIndex(Parent, Node->Byte, &Index);
+    ASSERT(Found);
+    ASSERT(Parent->Children[Index] == Node);
+
+    Count = --Parent->NumberOfChildren;
+
+    if (Count == 0) {
+
+        Allocator->FreePointer(Allocator, (PPVOID)&Parent->Children);
+        PrefixIndex->NumberOfBytes -= (
+            PrefixNodeChildArraySize(Parent->ChildCapacity)
+        );
+        Parent->ChildCapacity = 0;
+
+    } else if (Index < Count) {
+
+        Bytes = PREFIX_NODE_CHILD_BYTES(Parent);
+        MoveMemory(&Parent->Children[Index],
+                   &Parent->Children[Index + 1],
+                   (Count - Index) * sizeof(Node));
+        MoveMemory(&Bytes[Index], &Bytes[Index + 1], Count - Index);
+    }
+
+    Allocator->FreePointer(Allocator, (PPVOID)&Node);
+
+    PrefixIndex->NumberOfNodes--;
+    PrefixIndex->NumberOfBytes -= sizeof(PREFIX_NODE);
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CreatePrefixIndex(
+    PDICTIONARY Dictionary
+    )
+/*++
+
+Routine Description:
+
+    Creates an empty prefix index for a dictionary.  This is called by
+    CreateDictionary() if the MaintainPrefixIndex create flag is set.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure for which the
+        prefix index is to be created.  The PrefixIndex field will be updated
+        on success.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    PALLOCATOR Allocator;
+    PPREFIX_INDEX PrefixIndex;
+
+    Allocator = Dictionary->Allocator;
+
+    PrefixIndex = (PPREFIX_INDEX)(
+        Allocator->Calloc(Allocator, 1, sizeof(*PrefixIndex))
+    );
+
+    if (!PrefixIndex) {
+        return FALSE;
+    }
+
+    PrefixIndex->NumberOfBytes = sizeof(*PrefixIndex);
+    Dictionary->PrefixIndex = PrefixIndex;
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+VOID
+DestroyPrefixIndex(
+    PDICTIONARY Dictionary
+    )
+/*++
+
+Routine Description:
+
+    Destroys a dictionary's prefix index, if any, freeing all nodes.
+
+    N.B. Nodes are freed iteratively (by following parent pointers back up the
+         trie) rather than recursively, as the trie's depth is bounded only by
+         the maximum word length.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure for which the
+        prefix index is to be destroyed.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    PPREFIX_NODE Node;
+    PPREFIX_NODE Parent;
+    PALLOCATOR Allocator;
+    PPREFIX_INDEX PrefixIndex;
+
+    PrefixIndex = Dictionary->PrefixIndex;
+
+    if (!PrefixIndex) {
+        return;
+    }
+
+    Allocator = Dictionary->Allocator;
+    Node = &PrefixIndex->Root;
+
+    while (Node) {
+
+        if (Node->NumberOfChildren > 0) {
+            Node = Node->Children[--Node->NumberOfChildren];
+            continue;
+        }
+
+        if (Node->Children) {
+            Allocator->FreePointer(Allocator, (PPVOID)&Node->Children);
+        }
+
+        Parent = Node->Parent;
+
+        if (Parent) {
+            Allocator->FreePointer(Allocator, (PPVOID)&Node);
+        }
+
+        Node = Parent;
+    }
+
+    Allocator->FreePointer(Allocator, (PPVOID)&Dictionary->PrefixIndex);
+}
+
+_Use_decl_annotations_
+BOOLEAN
+InsertPrefixIndexWord(
+    PDICTIONARY Dictionary,
+    PCLONG_STRING String,
+    PPREFIX_NODE *PrefixNodePointer
+    )
+/*++
+
+Routine Description:
+
+    Ensures a path exists in the prefix index for the given word, creating
+    nodes as necessary, and returns the node representing the word.  The
+    entry count of the node is not altered; the caller is expected to call
+    UpdatePrefixIndexEntryCount() once the word has been added.
+
+    N.B. If the word is subsequently not added to the dictionary (e.g. due to
+         an allocation failure), the caller should call the update routine
+         with an entry count of 0 in order to prune any nodes created here.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to a DICTIONARY structure with a prefix
+        index.
+
+    String - Supplies a pointer to an initialized LONG_STRING structure for
+        the word.
+
+    PrefixNodePointer - Supplies the address of a variable that receives the
+        address of the node representing the word.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    BYTE Byte;
+    ULONG Index;
+    ULONG ChildIndex;
+    PCBYTE Bytes;
+    PPREFIX_NODE Node;
+    PPREFIX_NODE Child;
+
+    *PrefixNodePointer = NULL;
+
+    Bytes = String->Buffer;
+    Node = &Dictionary->PrefixIndex->Root;
+
+    for (Index = 0; Index < String->Length; Index++) {
+
+        Byte = Bytes[Index];
+
+        if (FindPrefixNodeChildIndex(Node, Byte, &ChildIndex)) {
+            Node = Node->Children[ChildIndex];
+            continue;
+        }
+
+        if (!AddPrefixNodeChild(Dictionary, Node, Byte, ChildIndex, &Child)) {
+
+            //
+            // Prune any nodes we've created so far.
+            //
+
+            PrunePrefixIndexNode(Dictionary, Node);
+            return FALSE;
+        }
+
+        Node = Child;
+    }
+
+    Node->Hash = String->Hash;
+    *PrefixNodePointer = Node;
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+PPREFIX_NODE
+FindPrefixIndexNode(
+    PDICTIONARY Dictionary,
+    PCBYTE Bytes,
+    ULONG Length
+    )
+/*++
+
+Routine Description:
+
+    Finds the prefix index node for the given array of bytes.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to a DICTIONARY structure with a prefix
+        index.
+
+    Bytes - Supplies a pointer to the array of bytes to find.
+
+    Length - Supplies the number of bytes in the array.  May be 0, in which
+        case the root node is returned.
+
+Return Value:
+
+    The address of the node if found, NULL otherwise.  Note that the node
+    may only represent a prefix of other words (i.e. its entry count is 0).
+
+--*/
+{
+    ULONG Index;
+    ULONG ChildIndex;
+    PPREFIX_NODE Node;
+
+    Node = &Dictionary->PrefixIndex->Root;
+
+    for (Index = 0; Index < Length; Index++) {
+        if (!FindPrefixNodeChildIndex(Node, Bytes[Index], &ChildIndex)) {
+            return NULL;
+        }
+        Node = Node->Children[ChildIndex];
+    }
+
+    return Node;
+}
+
+_Use_decl_annotations_
+PPREFIX_NODE
+PrunePrefixIndexNode(
+    PDICTIONARY Dictionary,
+    PPREFIX_NODE PrefixNode
+    )
+/*++
+
+Routine Description:
+
+    Removes a prefix index node if it has no word (i.e. an entry count of 0)
+    and no children, then repeats the process for its ancestors.
+
+    N.B. The subtree maximums of the remaining nodes are not updated; this is
+         the responsibility of the caller if the removed node previously had
+         a non-zero entry count (see UpdatePrefixIndexEntryCount()).
+
+Arguments:
+
+    Dictionary - Supplies a pointer to a DICTIONARY structure with a prefix
+        index.
+
+    PrefixNode - Supplies a pointer to the node to prune.
+
+Return Value:
+
+    The address of the deepest node that was not removed.  This will be the
+    PrefixNode parameter if it wasn't removed, or the root node if all nodes
+    on the path were removed.
+
+--*/
+{
+    PPREFIX_NODE Node;
+    PPREFIX_NODE Root;
+    PPREFIX_NODE Parent;
+
+    Node = PrefixNode;
+    Root = &Dictionary->PrefixIndex->Root;
+
+    while (Node != Root &&
+           Node->Stats.EntryCount == 0 &&
+           Node->NumberOfChildren == 0) {
+
+        Parent = Node->Parent;
+        RemovePrefixNode(Dictionary, Node);
+        Node = Parent;
+    }
+
+    return Node;
+}
+
+_Use_decl_annotations_
+VOID
+UpdatePrefixIndexEntryCount(
+    PDICTIONARY Dictionary,
+    PPREFIX_NODE PrefixNode,
+    LONGLONG EntryCount
+    )
+/*++
+
+Routine Description:
+
+    Updates the entry count of the word represented by a prefix index node,
+    and then updates the subtree maximum entry count of the node and its
+    ancestors.  If the entry count is 0, the node (and any ancestors that are
+    no longer a prefix of any word) are removed.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to a DICTIONARY structure with a prefix
+        index.
+
+    PrefixNode - Supplies a pointer to the node to update.  This pointer
+        should be considered invalid after this call if EntryCount is 0.
+
+    EntryCount - Supplies the word's new entry count.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ULONG Index;
+    LONGLONG Maximum;
+    LONGLONG OldEntryCount;
+    PPREFIX_NODE Node;
+
+    Node = PrefixNode;
+    OldEntryCount = Node->Stats.EntryCount;
+
+    Node->Stats.EntryCount = EntryCount;
+
+    if (EntryCount > Node->Stats.MaximumEntryCount) {
+        Node->Stats.MaximumEntryCount = EntryCount;
+    }
+
+    if (EntryCount > OldEntryCount) {
+
+        //
+        // Fast-path: the entry count increased, so subtree maximums can only
+        // increase.  Propagate the new count until we hit an ancestor with an
+        // equal or larger maximum.
+        //
+
+        while (Node && Node->MaximumSubtreeEntryCount < EntryCount) {
+            Node->MaximumSubtreeEntryCount = EntryCount;
+            Node = Node->Parent;
+        }
+
+        return;
+    }
+
+    if (EntryCount == 0) {
+
+        //
+        // The word has been removed; reset its maximum entry count (to match
+        // the dictionary, which will create a new word entry if the word is
+        // added again), then prune the node and any ancestors that are no
+        // longer a prefix of any word.
+        //
+
+        Node->Stats.MaximumEntryCount = 0;
+        Node = PrunePrefixIndexNode(Dictionary, Node);
+    }
+
+    //
+    // Recalculate the subtree maximums from the bottom up.  Once we reach a
+    // node whose maximum doesn't change, none of its ancestors will change
+    // either.
+    //
+
+    while (Node) {
+
+        Maximum = Node->Stats.EntryCount;
+
+        for (Index = 0; Index < Node->NumberOfChildren; Index++) {
+            Maximum = max(Maximum,
+                          Node->Children[Index]->MaximumSubtreeEntryCount);
+        }
+
+        if (Maximum == Node->MaximumSubtreeEntryCount) {
+            break;
+        }
+
+        Node->MaximumSubtreeEntryCount = Maximum;
+        Node = Node->Parent;
+    }
+}
+
+_Use_decl_annotations_
+BOOLEAN
+GetWordsWithPrefix(
+    PDICTIONARY Dictionary,
+    PALLOCATOR Allocator,
+    PCBYTE Prefix,
+    ULONG MaximumNumberOfWords,
+    PLINKED_WORD_LIST *LinkedWordListPointer
+    )
+/*++
+
+Routine Description:
+
+    Constructs a list of the most frequent words in the dictionary starting
+    with a given prefix, ordered by descending entry count.  The dictionary
+    must have been created with the MaintainPrefixIndex create flag.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to a DICTIONARY structure for which the
+        words are to be retrieved.
+
+    Allocator - Supplies a pointer to an ALLOCATOR structure that will be used
+        to allocate the memory that backs the address returned via the param
+        LinkedWordListPointer and all associated LINKED_WORD_ENTRY items, as
+        well as any temporary memory required by the search.
+
+    Prefix - Supplies a NULL-terminated array of bytes representing the prefix
+        to search for.  An empty string matches all words.  A word is
+        considered to start with itself.
+
+    MaximumNumberOfWords - Supplies the maximum number of words to return.
+        Must be greater than zero.
+
+    LinkedWordListPointer - Supplies the address of a variable that receives
+        the address of a LINKED_WORD_LIST structure (allocated via Allocator)
+        if at least one word starts with the prefix.  If there are no such
+        words, a NULL pointer is returned.  The pointer must be freed via the
+        Allocator once the user has finished with the structure.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if the
+    dictionary doesn't have a prefix index.
+
+--*/
+{
+    PBYTE Buffer;
+    PBYTE StructBuffer;
+    PBYTE StringBuffer;
+    ULONG Index;
+    ULONG Length;
+    ULONG NumberOfWords;
+    ULONG NumberOfItems;
+    ULONG HeapCapacity;
+    ULONG MaximumNumberOfItems;
+    BOOLEAN Success;
+    PPREFIX_NODE Node;
+    PPREFIX_NODE Child;
+    PPREFIX_NODE PrefixNode;
+    PPREFIX_NODE *Words;
+    PPREFIX_INDEX PrefixIndex;
+    PPREFIX_SEARCH_ITEM Heap;
+    PPREFIX_SEARCH_ITEM NewHeap;
+    PREFIX_SEARCH_ITEM Item;
+    PLINKED_WORD_LIST LinkedWordList;
+    PLINKED_WORD_ENTRY LinkedWordEntry;
+    PWORD_ENTRY WordEntry;
+    LARGE_INTEGER AllocSize;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Allocator)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Prefix)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(LinkedWordListPointer)) {
+        return FALSE;
+    }
+
+    if (MaximumNumberOfWords == 0) {
+        return FALSE;
+    }
+
+    //
+    // Clear the caller's pointer up-front and initialize locals.
+    //
+
+    *LinkedWordListPointer = NULL;
+
+    Heap = NULL;
+    Words = NULL;
+    NumberOfWords = 0;
+    NumberOfItems = 0;
+
+    //
+    // Determine the prefix length.
+    //
+
+    for (Length = 0; Prefix[Length] != '\0'; Length++) {
+        if (Length == Dictionary->MaximumWordLength) {
+            return FALSE;
+        }
+    }
+
+    //
+    // Acquire a shared lock for the duration of this routine.
+    //
+
+    AcquireDictionaryLockShared(&Dictionary->Lock);
+
+    PrefixIndex = Dictionary->PrefixIndex;
+
+    if (!PrefixIndex) {
+        goto Error;
+    }
+
+    //
+    // Find the node for the prefix.  If there's no such node (or no words
+    // beneath it), we're done.
+    //
+
+    PrefixNode = FindPrefixIndexNode(Dictionary, Prefix, Length);
+
+    if (!PrefixNode || PrefixNode->MaximumSubtreeEntryCount == 0) {
+        Success = TRUE;
+        goto End;
+    }
+
+    //
+    // There can't be more words than there are nodes in the trie.
+    //
+
+    if (MaximumNumberOfWords > PrefixIndex->NumberOfNodes) {
+        MaximumNumberOfWords = (ULONG)PrefixIndex->NumberOfNodes;
+    }
+
+    //
+    // Allocate the array of words and the initial search heap.
+    //
+
+    Words = (PPREFIX_NODE *)(
+        Allocator->Calloc(Allocator, MaximumNumberOfWords, sizeof(*Words))
+    );
+
+    if (!Words) {
+        goto Error;
+    }
+
+    HeapCapacity = PREFIX_SEARCH_INITIAL_HEAP_CAPACITY;
+    Heap = (PPREFIX_SEARCH_ITEM)(
+        Allocator->Calloc(Allocator, HeapCapacity, sizeof(*Heap))
+    );
+
+    if (!Heap) {
+        goto Error;
+    }
+
+    //
+    // Perform the best-first search.  Pushing a node's children (plus its own
+    // word) adds at most 257 items, so ensure there's room for that before
+    // each expansion.
+    //
+
+    Item.Priority = PrefixNode->MaximumSubtreeEntryCount;
+    Item.Node = PrefixNode;
+    Item.IsWord = FALSE;
+    Item.Padding = 0;
+    PushPrefixSearchItem(Heap, &NumberOfItems, &Item);
+
+    while (NumberOfItems > 0 && NumberOfWords < MaximumNumberOfWords) {
+
+        PopPrefixSearchItem(Heap, &NumberOfItems, &Item);
+        Node = Item.Node;
+
+        if (Item.IsWord) {
+            Words[NumberOfWords++] = Node;
+            continue;
+        }
+
+        MaximumNumberOfItems = (
+            NumberOfItems + Node->NumberOfChildren + 1
+        );
+
+        if (MaximumNumberOfItems > HeapCapacity) {
+
+            while (HeapCapacity < MaximumNumberOfItems) {
+                HeapCapacity <<= 1;
+            }
+
+            NewHeap = (PPREFIX_SEARCH_ITEM)(
+                Allocator->Realloc(Allocator,
+                                   Heap,
+                                   HeapCapacity * sizeof(*Heap))
+            );
+
+            if (!NewHeap) {
+                goto Error;
+            }
+
+            Heap = NewHeap;
+        }
+
+        if (Node->Stats.EntryCount > 0) {
+            Item.Priority = Node->Stats.EntryCount;
+            Item.IsWord = TRUE;
+            PushPrefixSearchItem(Heap, &NumberOfItems, &Item);
+        }
+
+        Item.IsWord = FALSE;
+
+        for (Index = 0; Index < Node->NumberOfChildren; Index++) {
+            Child = Node->Children[Index];
+            Item.Priority = Child->MaximumSubtreeEntryCount;
+            Item.Node = Child;
+            PushPrefixSearchItem(Heap, &NumberOfItems, &Item);
+        }
+    }
+
+    ASSERT(NumberOfWords > 0);
+
+    //
+    // Calculate the allocation size required for the list, entries and
+    // string buffers, then allocate it.
+    //
+
+    AllocSize.QuadPart = (
+        sizeof(LINKED_WORD_LIST) +
+        (sizeof(LINKED_WORD_ENTRY) * NumberOfWords)
+    );
+
+    for (Index = 0; Index < NumberOfWords; Index++) {
+        AllocSize.QuadPart += Words[Index]->Depth + 1;
+    }
+
+    Buffer = (PBYTE)Allocator->Calloc(Allocator, 1, AllocSize.QuadPart);
+    if (!Buffer) {
+        goto Error;
+    }
+
+    LinkedWordList = (PLINKED_WORD_LIST)Buffer;
+    InitializeListHead(&LinkedWordList->ListHead);
+
+    StructBuffer = Buffer + sizeof(LINKED_WORD_LIST);
+    StringBuffer = StructBuffer + (sizeof(LINKED_WORD_ENTRY) * NumberOfWords);
+
+    for (Index = 0; Index < NumberOfWords; Index++) {
+
+        Node = Words[Index];
+
+        LinkedWordEntry = (PLINKED_WORD_ENTRY)StructBuffer;
+        StructBuffer += sizeof(LINKED_WORD_ENTRY);
+
+        WordEntry = &LinkedWordEntry->WordEntry;
+        WordEntry->Stats.EntryCount = Node->Stats.EntryCount;
+        WordEntry->Stats.MaximumEntryCount = Node->Stats.MaximumEntryCount;
+        WordEntry->String.Length = Node->Depth;
+        WordEntry->String.Hash = Node->Hash;
+        WordEntry->String.Buffer = StringBuffer;
+
+        //
+        // Reconstruct the word by walking back up to the root.  (The trailing
+        // NULL is already present courtesy of Calloc.)
+        //
+
+        for (Child = Node; Child->Parent != NULL; Child = Child->Parent) {
+            StringBuffer[Child->Depth - 1] = Child->Byte;
+        }
+
+        StringBuffer += Node->Depth + 1;
+
+        InsertTailList(&LinkedWordList->ListHead, &LinkedWordEntry->ListEntry);
+        LinkedWordList->NumberOfEntries++;
+    }
+
+    ASSERT(StringBuffer == Buffer + AllocSize.QuadPart);
+
+    *LinkedWordListPointer = LinkedWordList;
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    ReleaseDictionaryLockShared(&Dictionary->Lock);
+
+    if (Heap) {
+        Allocator->FreePointer(Allocator, (PPVOID)&Heap);
+    }
+
+    if (Words) {
+        Allocator->FreePointer(Allocator, (PPVOID)&Words);
+    }
+
+    return Success;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
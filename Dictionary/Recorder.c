@@ -0,0 +1,1089 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    Recorder.c
+
+Abstract:
+
+    This module implements dictionary call recording and replay.  Routines are
+    provided for starting and stopping a recording, recording a single call,
+    and replaying a recording against a dictionary.
+
+    A recording is a memory-mapped file; see DICTIONARY_RECORDING_HEADER for
+    its layout.  Recording a call costs one interlocked add to reserve space
+    for the record, a copy of the word, and a read of the time stamp counter;
+    no lock is taken beyond the dictionary lock already held by the caller.
+
+    Replay resolves the AddWord(), RemoveWord(), FindWord() and
+    GetWordAnagrams() routines via a caller-supplied function table, such that
+    the same recording can be replayed against different implementations of
+    the dictionary in order to compare them.
+
+--*/
+
+#include "stdafx.h"
+
+//
+// Number of spins a replay thread performs whilst waiting for its turn before
+// it yields its processor.
+//
+
+#define DICTIONARY_REPLAY_SPIN_COUNT 1024
+
+//
+// Delays longer than this many microseconds are waited on by sleeping rather
+// than spinning when replaying with timing preserved.
+//
+
+#define DICTIONARY_REPLAY_SLEEP_THRESHOLD_IN_MICROSECONDS 2000
+
+//
+// Define the replay context shared by all replay threads, and the structure
+// used to capture the state of each thread.
+//
+
+typedef struct _DICTIONARY_REPLAY_CONTEXT {
+
+    PDICTIONARY Dictionary;
+    PALLOCATOR Allocator;
+    PDICTIONARY_REPLAY_STATS Stats;
+    DICTIONARY_REPLAY_FLAGS Flags;
+
+    //
+    // Index of the next record to be started when thread interleaving is
+    // being preserved.
+    //
+
+    volatile LONGLONG NextRecord;
+
+    //
+    // Routines to call for each operation.
+    //
+
+    PADD_WORD AddWord;
+    PREMOVE_WORD RemoveWord;
+    PFIND_WORD FindWord;
+    PGET_WORD_ANAGRAMS GetWordAnagrams;
+
+    //
+    // Base address of the view, and the offset of each record relative to it.
+    // ThreadIndexes captures the index of the replay thread each record is
+    // assigned to when thread interleaving is being preserved.
+    //
+
+    PDICTIONARY_RECORDING_HEADER Header;
+    ULONGLONG NumberOfRecords;
+    PULONGLONG RecordOffsets;
+    PBYTE ThreadIndexes;
+
+    //
+    // Timing state.  MicrosecondsPerTimestamp converts a record's time stamp
+    // counter delta into elapsed microseconds; StartCounter and Frequency are
+    // the performance counter values for this replay.
+    //
+
+    DOUBLE MicrosecondsPerTimestamp;
+    LARGE_INTEGER StartCounter;
+    LARGE_INTEGER Frequency;
+
+} DICTIONARY_REPLAY_CONTEXT;
+typedef DICTIONARY_REPLAY_CONTEXT *PDICTIONARY_REPLAY_CONTEXT;
+
+typedef struct _DICTIONARY_REPLAY_THREAD {
+    PDICTIONARY_REPLAY_CONTEXT Context;
+    HANDLE ThreadHandle;
+    ULONG RecordedThreadId;
+    ULONG ThreadIndex;
+} DICTIONARY_REPLAY_THREAD;
+typedef DICTIONARY_REPLAY_THREAD *PDICTIONARY_REPLAY_THREAD;
+
+FORCEINLINE
+PCDICTIONARY_RECORD
+GetDictionaryRecord(
+    _In_ PDICTIONARY_REPLAY_CONTEXT Context,
+    _In_ ULONGLONG Index
+    )
+{
+    return (PCDICTIONARY_RECORD)(
+        RtlOffsetToPointer(Context->Header, Context->RecordOffsets[Index])
+    );
+}
+
+_Use_decl_annotations_
+VOID
+RecordDictionaryOperation(
+    PDICTIONARY Dictionary,
+    DICTIONARY_RECORD_OPERATION Operation,
+    PCBYTE Word
+    )
+/*++
+
+Routine Description:
+
+    Appends a record of a call to the dictionary's recording.  The caller must
+    hold the dictionary lock (in either mode), and Dictionary->Recorder must be
+    non-NULL.  If there is insufficient space left in the file, the record is
+    dropped and counted.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the dictionary being recorded.
+
+    Operation - Supplies the operation being performed.
+
+    Word - Supplies the NULL-terminated word passed to the call.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ULONG Length;
+    ULONG SizeOfRecord;
+    LONGLONG Offset;
+    ULONGLONG Timestamp;
+    PDICTIONARY_RECORD Record;
+    PDICTIONARY_RECORDING_HEADER Header;
+
+    Timestamp = __rdtsc();
+    Header = Dictionary->Recorder->Header;
+
+    //
+    // Determine the length of the word.  Words longer than the absolute
+    // maximum can never be added to a dictionary; they're dropped rather than
+    // scanned any further.
+    //
+
+    for (Length = 0; Word[Length] != '\0'; Length++) {
+        if (Length == ABSOLUTE_MAXIMUM_WORD_LENGTH) {
+            goto Drop;
+        }
+    }
+
+    //
+    // Reserve space for the record.
+    //
+
+    SizeOfRecord = (ULONG)DICTIONARY_RECORD_SIZE(Length);
+    Offset = InterlockedExchangeAdd64(&Header->EndOffset, SizeOfRecord);
+
+    if ((ULONGLONG)Offset + SizeOfRecord > Header->SizeOfFile) {
+        goto Drop;
+    }
+
+    //
+    // Fill out the record.  The view is zero-filled, so the word's terminating
+    // NULL and any alignment padding are already present.
+    //
+
+    Record = (PDICTIONARY_RECORD)RtlOffsetToPointer(Header, Offset);
+    Record->Timestamp = Timestamp;
+    Record->ThreadId = GetCurrentThreadId();
+    Record->Length = Length;
+    Record->SizeOfRecord = SizeOfRecord;
+    CopyMemory(DICTIONARY_RECORD_WORD(Record), Word, Length);
+
+    //
+    // Write the operation last; a non-zero operation indicates the record is
+    // complete.
+    //
+
+    InterlockedExchange16((volatile SHORT *)&Record->Operation,
+                          (SHORT)Operation);
+
+    return;
+
+Drop:
+
+    InterlockedIncrement64(&Header->NumberOfDroppedRecords);
+    return;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+StartDictionaryRecording(
+    PDICTIONARY Dictionary,
+    PCWSTR Path,
+    ULONGLONG MaximumSizeInBytes
+    )
+/*++
+
+Routine Description:
+
+    Starts recording AddWord(), RemoveWord(), FindWord() and GetWordAnagrams()
+    calls against a dictionary to a file.  The file is created (replacing any
+    existing file) and mapped with the given maximum size; calls made once the
+    file is full are not recorded.
+
+    Whilst recording, FindWord() acquires the dictionary lock in shared mode
+    even if the dictionary is frozen.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the dictionary to record.
+
+    Path - Supplies the path of the file to record to.
+
+    MaximumSizeInBytes - Optionally supplies the maximum size of the file, in
+        bytes.  If 0, a default of 64MB is used.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if the
+    dictionary is already being recorded.
+
+--*/
+{
+    BOOLEAN Success;
+    PALLOCATOR Allocator;
+    ULARGE_INTEGER FileSize;
+    PDICTIONARY_RECORDER Recorder;
+    PDICTIONARY_RECORDING_HEADER Header;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Path)) {
+        return FALSE;
+    }
+
+    if (MaximumSizeInBytes == 0) {
+        MaximumSizeInBytes = DICTIONARY_RECORDING_DEFAULT_SIZE;
+    }
+
+    if (MaximumSizeInBytes < DICTIONARY_RECORDING_MINIMUM_SIZE) {
+        return FALSE;
+    }
+
+    if (Dictionary->Recorder) {
+        return FALSE;
+    }
+
+    //
+    // Allocate the recorder structure.
+    //
+
+    Allocator = Dictionary->Allocator;
+
+    Recorder = (PDICTIONARY_RECORDER)(
+        Allocator->Calloc(Allocator, 1, sizeof(*Recorder))
+    );
+
+    if (!Recorder) {
+        return FALSE;
+    }
+
+    Recorder->FileHandle = INVALID_HANDLE_VALUE;
+
+    //
+    // Create the file and map it.  The section extends the file to its
+    // maximum size, and the pages are zero-filled by the system.
+    //
+
+    Recorder->FileHandle = CreateFileW(Path,
+                                       GENERIC_READ | GENERIC_WRITE,
+                                       FILE_SHARE_READ,
+                                       NULL,
+                                       CREATE_ALWAYS,
+                                       FILE_ATTRIBUTE_NORMAL,
+                                       NULL);
+
+    if (Recorder->FileHandle == INVALID_HANDLE_VALUE) {
+        goto Error;
+    }
+
+    FileSize.QuadPart = ALIGN_UP(MaximumSizeInBytes,
+                                 DICTIONARY_RECORD_ALIGNMENT);
+
+    Recorder->SectionHandle = CreateFileMappingW(Recorder->FileHandle,
+                                                 NULL,
+                                                 PAGE_READWRITE,
+                                                 FileSize.HighPart,
+                                                 FileSize.LowPart,
+                                                 NULL);
+
+    if (!Recorder->SectionHandle) {
+        goto Error;
+    }
+
+    Header = (PDICTIONARY_RECORDING_HEADER)(
+        MapViewOfFile(Recorder->SectionHandle,
+                      FILE_MAP_READ | FILE_MAP_WRITE,
+                      0,
+                      0,
+                      (SIZE_T)FileSize.QuadPart)
+    );
+
+    if (!Header) {
+        goto Error;
+    }
+
+    Recorder->Header = Header;
+
+    Header->Signature = DICTIONARY_RECORDING_SIGNATURE;
+    Header->Version = DICTIONARY_RECORDING_VERSION;
+    Header->SizeOfHeader = sizeof(*Header);
+    Header->ProcessId = GetCurrentProcessId();
+    Header->SizeOfFile = FileSize.QuadPart;
+    Header->EndOffset = sizeof(*Header);
+    QueryPerformanceFrequency(&Header->Frequency);
+    QueryPerformanceCounter(&Header->StartCounter);
+    Header->StartTimestamp = __rdtsc();
+
+    //
+    // Publish the recorder.  Check again that no other recorder was started
+    // whilst we were setting up ours.
+    //
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+
+    if (Dictionary->Recorder) {
+        ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+        goto Error;
+    }
+
+    Dictionary->Recorder = Recorder;
+
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    if (Recorder->Header) {
+        UnmapViewOfFile(Recorder->Header);
+        Recorder->Header = NULL;
+    }
+
+    if (Recorder->SectionHandle) {
+        CloseHandle(Recorder->SectionHandle);
+        Recorder->SectionHandle = NULL;
+    }
+
+    if (Recorder->FileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(Recorder->FileHandle);
+        Recorder->FileHandle = INVALID_HANDLE_VALUE;
+        DeleteFileW(Path);
+    }
+
+    Allocator->FreePointer(Allocator, (PPVOID)&Recorder);
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+StopDictionaryRecording(
+    PDICTIONARY Dictionary,
+    PULONGLONG NumberOfRecordsPointer
+    )
+/*++
+
+Routine Description:
+
+    Stops recording calls against a dictionary.  The recording's header is
+    finalized, and the file is truncated to the end of the last record.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the dictionary being recorded.
+
+    NumberOfRecordsPointer - Optionally supplies the address of a variable that
+        receives the number of records in the recording.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if the
+    dictionary isn't being recorded.
+
+--*/
+{
+    BOOLEAN Success;
+    ULONGLONG Offset;
+    ULONGLONG NumberOfRecords;
+    PALLOCATOR Allocator;
+    LARGE_INTEGER EndOfFile;
+    PDICTIONARY_RECORD Record;
+    PDICTIONARY_RECORDER Recorder;
+    PDICTIONARY_RECORDING_HEADER Header;
+
+    //
+    // Validate arguments.
+    //
+
+    if (ARGUMENT_PRESENT(NumberOfRecordsPointer)) {
+        *NumberOfRecordsPointer = 0;
+    }
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    //
+    // Detach the recorder.  Records are only written whilst the dictionary
+    // lock is held, so once we've acquired it exclusively, no record is in
+    // the process of being written, and none will be written after we
+    // release it.
+    //
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+    Recorder = Dictionary->Recorder;
+    Dictionary->Recorder = NULL;
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    if (!Recorder) {
+        return FALSE;
+    }
+
+    Header = Recorder->Header;
+    Header->EndTimestamp = __rdtsc();
+    QueryPerformanceCounter(&Header->EndCounter);
+
+    //
+    // Count the records.  EndOffset may run past the last record if records
+    // were dropped, so the records are walked rather than trusting it.
+    //
+
+    NumberOfRecords = 0;
+    Offset = sizeof(*Header);
+
+    while (Offset + sizeof(*Record) <= Header->SizeOfFile) {
+        Record = (PDICTIONARY_RECORD)RtlOffsetToPointer(Header, Offset);
+        if (Record->Operation == DictionaryRecordNullOperation) {
+            break;
+        }
+        NumberOfRecords++;
+        Offset += Record->SizeOfRecord;
+    }
+
+    Header->NumberOfRecords = NumberOfRecords;
+    Header->SizeOfFile = Offset;
+    Header->IsComplete = TRUE;
+
+    //
+    // Unmap the view and close the section, then truncate the file.
+    //
+
+    Success = TRUE;
+
+    if (!FlushViewOfFile(Header, 0)) {
+        Success = FALSE;
+    }
+
+    UnmapViewOfFile(Header);
+    CloseHandle(Recorder->SectionHandle);
+
+    EndOfFile.QuadPart = (LONGLONG)Offset;
+
+    if (!SetFilePointerEx(Recorder->FileHandle, EndOfFile, NULL, FILE_BEGIN)) {
+        Success = FALSE;
+    } else if (!SetEndOfFile(Recorder->FileHandle)) {
+        Success = FALSE;
+    }
+
+    CloseHandle(Recorder->FileHandle);
+
+    Allocator = Dictionary->Allocator;
+    Allocator->FreePointer(Allocator, (PPVOID)&Recorder);
+
+    if (Success && ARGUMENT_PRESENT(NumberOfRecordsPointer)) {
+        *NumberOfRecordsPointer = NumberOfRecords;
+    }
+
+    return Success;
+}
+
+FORCEINLINE
+VOID
+WaitForDictionaryRecord(
+    _In_ PDICTIONARY_REPLAY_CONTEXT Context,
+    _In_ PCDICTIONARY_RECORD Record
+    )
+/*++
+
+Routine Description:
+
+    Waits until the same amount of time has elapsed since the start of the
+    replay as had elapsed since the start of the recording when the given
+    record was written.
+
+--*/
+{
+    DOUBLE Microseconds;
+    LONGLONG Remaining;
+    LONGLONG SleepThreshold;
+    LARGE_INTEGER Target;
+    LARGE_INTEGER Counter;
+    PDICTIONARY_RECORDING_HEADER Header;
+
+    Header = Context->Header;
+
+    if (Record->Timestamp <= Header->StartTimestamp) {
+        return;
+    }
+
+    Microseconds = (
+        (DOUBLE)(Record->Timestamp - Header->StartTimestamp) *
+        Context->MicrosecondsPerTimestamp
+    );
+
+    Target.QuadPart = Context->StartCounter.QuadPart + (LONGLONG)(
+        (Microseconds * (DOUBLE)Context->Frequency.QuadPart) / 1e6
+    );
+
+    SleepThreshold = (
+        (Context->Frequency.QuadPart *
+         DICTIONARY_REPLAY_SLEEP_THRESHOLD_IN_MICROSECONDS) / 1000000
+    );
+
+    while (TRUE) {
+        QueryPerformanceCounter(&Counter);
+        Remaining = Target.QuadPart - Counter.QuadPart;
+        if (Remaining <= 0) {
+            break;
+        }
+        if (Remaining > SleepThreshold) {
+            Sleep(1);
+        } else {
+            YieldProcessor();
+        }
+    }
+}
+
+FORCEINLINE
+VOID
+ExecuteDictionaryRecord(
+    _In_ PDICTIONARY_REPLAY_CONTEXT Context,
+    _In_ PCDICTIONARY_RECORD Record
+    )
+/*++
+
+Routine Description:
+
+    Replays a single record and updates the replay statistics.  The caller is
+    responsible for waiting for the record to be due if timing is being
+    preserved.
+
+--*/
+{
+    BOOLEAN Exists;
+    BOOLEAN Success;
+    LONGLONG EntryCount;
+    PCBYTE Word;
+    PALLOCATOR Allocator;
+    PDICTIONARY Dictionary;
+    PDICTIONARY_REPLAY_STATS Stats;
+    PLINKED_WORD_LIST LinkedWordList;
+    volatile LONGLONG *Counter;
+
+    Stats = Context->Stats;
+    Allocator = Context->Allocator;
+    Dictionary = Context->Dictionary;
+    Word = DICTIONARY_RECORD_WORD(Record);
+
+    switch (Record->Operation) {
+
+        case DictionaryRecordAddWordOperation:
+            Success = Context->AddWord(Dictionary, Word, &EntryCount);
+            Counter = (volatile LONGLONG *)&Stats->NumberOfAddWords;
+            break;
+
+        case DictionaryRecordRemoveWordOperation:
+            Success = Context->RemoveWord(Dictionary, Word, &EntryCount);
+            Counter = (volatile LONGLONG *)&Stats->NumberOfRemoveWords;
+            break;
+
+        case DictionaryRecordFindWordOperation:
+            Success = Context->FindWord(Dictionary, Word, &Exists);
+            Counter = (volatile LONGLONG *)&Stats->NumberOfFindWords;
+            break;
+
+        case DictionaryRecordGetWordAnagramsOperation:
+            LinkedWordList = NULL;
+            Success = Context->GetWordAnagrams(Dictionary,
+                                               Allocator,
+                                               Word,
+                                               &LinkedWordList);
+            if (Success && LinkedWordList) {
+                Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+            }
+            Counter = (volatile LONGLONG *)&Stats->NumberOfGetWordAnagrams;
+            break;
+
+        default:
+            ASSERT(FALSE);
+            return;
+    }
+
+    InterlockedIncrement64(Counter);
+    InterlockedIncrement64((volatile LONGLONG *)&Stats->NumberOfRecords);
+
+    if (!Success) {
+        Counter = (volatile LONGLONG *)&Stats->NumberOfFailedCalls;
+        InterlockedIncrement64(Counter);
+    }
+}
+
+_Use_decl_annotations_
+DWORD
+WINAPI
+DictionaryReplayThreadProc(
+    PVOID Parameter
+    )
+/*++
+
+Routine Description:
+
+    Replays the records written by one recorded thread.  Each record is only
+    started once every record preceding it in the recording has been started
+    (by whichever thread it's assigned to), which preserves the order in which
+    the original calls acquired the dictionary lock.
+
+--*/
+{
+    ULONG Spins;
+    ULONGLONG Index;
+    PCDICTIONARY_RECORD Record;
+    PDICTIONARY_REPLAY_THREAD Thread;
+    PDICTIONARY_REPLAY_CONTEXT Context;
+
+    Thread = (PDICTIONARY_REPLAY_THREAD)Parameter;
+    Context = Thread->Context;
+
+    for (Index = 0; Index < Context->NumberOfRecords; Index++) {
+
+        if (Context->ThreadIndexes[Index] != Thread->ThreadIndex) {
+            continue;
+        }
+
+        Spins = 0;
+
+        while ((ULONGLONG)Context->NextRecord != Index) {
+            YieldProcessor();
+            if (++Spins == DICTIONARY_REPLAY_SPIN_COUNT) {
+                Spins = 0;
+                SwitchToThread();
+            }
+        }
+
+        //
+        // Release the next record before executing this one, such that calls
+        // may overlap as they did originally.  The timing wait (if any) is
+        // done first, though, as the next record can't be due any earlier.
+        //
+
+        Record = GetDictionaryRecord(Context, Index);
+
+        if (Context->Flags.PreserveTiming) {
+            WaitForDictionaryRecord(Context, Record);
+        }
+
+        InterlockedIncrement64(&Context->NextRecord);
+
+        ExecuteDictionaryRecord(Context, Record);
+    }
+
+    return 0;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+ReplayDictionaryRecording(
+    PDICTIONARY_FUNCTIONS Api,
+    PDICTIONARY Dictionary,
+    PALLOCATOR Allocator,
+    PCWSTR Path,
+    DICTIONARY_REPLAY_FLAGS Flags,
+    PDICTIONARY_REPLAY_STATS Stats
+    )
+/*++
+
+Routine Description:
+
+    Replays a recording against a dictionary.
+
+Arguments:
+
+    Api - Optionally supplies a pointer to the function table whose AddWord(),
+        RemoveWord(), FindWord() and GetWordAnagrams() routines are to be
+        called.  If NULL, this module's routines are called.
+
+    Dictionary - Supplies a pointer to the dictionary to replay the recording
+        against.  This must have been created by the same implementation as
+        Api.
+
+    Allocator - Supplies a pointer to the allocator used for the replay's
+        temporary state and for anagram lists.
+
+    Path - Supplies the path of a recording created by
+        StartDictionaryRecording() and StopDictionaryRecording().
+
+    Flags - Supplies flags that control how the recording is replayed.
+
+    Stats - Supplies the address of a structure that receives statistics
+        about the replay.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  A replayed call returning FALSE
+    doesn't constitute failure; such calls are counted in the statistics.
+
+--*/
+{
+    BYTE ThreadIndex;
+    ULONG Index;
+    ULONG NumberOfThreads;
+    ULONG ThreadIds[DICTIONARY_REPLAY_MAXIMUM_NUMBER_OF_THREADS];
+    BOOLEAN Success;
+    HANDLE FileHandle;
+    HANDLE SectionHandle;
+    ULONGLONG Offset;
+    ULONGLONG RecordIndex;
+    ULONGLONG Timestamps;
+    LARGE_INTEGER FileSize;
+    LARGE_INTEGER EndCounter;
+    PCDICTIONARY_RECORD Record;
+    PDICTIONARY_RECORDING_HEADER Header;
+    DICTIONARY_REPLAY_CONTEXT Context;
+    PDICTIONARY_REPLAY_THREAD Threads;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Stats)) {
+        return FALSE;
+    }
+
+    ZeroStructPointer(Stats);
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Allocator)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Path)) {
+        return FALSE;
+    }
+
+    if (Flags.Unused != 0) {
+        return FALSE;
+    }
+
+    ZeroStruct(Context);
+    Context.Dictionary = Dictionary;
+    Context.Allocator = Allocator;
+    Context.Stats = Stats;
+    Context.Flags = Flags;
+
+    if (ARGUMENT_PRESENT(Api)) {
+        Context.AddWord = Api->AddWord;
+        Context.RemoveWord = Api->RemoveWord;
+        Context.FindWord = Api->FindWord;
+        Context.GetWordAnagrams = Api->GetWordAnagrams;
+    } else {
+        Context.AddWord = AddWord;
+        Context.RemoveWord = RemoveWord;
+        Context.FindWord = FindWord;
+        Context.GetWordAnagrams = GetWordAnagrams;
+    }
+
+    Threads = NULL;
+    Header = NULL;
+    SectionHandle = NULL;
+
+    //
+    // Open and map the recording.
+    //
+
+    FileHandle = CreateFileW(Path,
+                             GENERIC_READ,
+                             FILE_SHARE_READ,
+                             NULL,
+                             OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL,
+                             NULL);
+
+    if (FileHandle == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    if (!GetFileSizeEx(FileHandle, &FileSize)) {
+        goto Error;
+    }
+
+    if ((ULONGLONG)FileSize.QuadPart < sizeof(*Header)) {
+        goto Error;
+    }
+
+    SectionHandle = CreateFileMappingW(FileHandle,
+                                       NULL,
+                                       PAGE_READONLY,
+                                       0,
+                                       0,
+                                       NULL);
+
+    if (!SectionHandle) {
+        goto Error;
+    }
+
+    Header = (PDICTIONARY_RECORDING_HEADER)(
+        MapViewOfFile(SectionHandle, FILE_MAP_READ, 0, 0, 0)
+    );
+
+    if (!Header) {
+        goto Error;
+    }
+
+    Context.Header = Header;
+
+    //
+    // Validate the header.
+    //
+
+    if (Header->Signature != DICTIONARY_RECORDING_SIGNATURE ||
+        Header->Version != DICTIONARY_RECORDING_VERSION ||
+        Header->SizeOfHeader != sizeof(*Header) ||
+        !Header->IsComplete ||
+        Header->SizeOfFile != (ULONGLONG)FileSize.QuadPart) {
+        goto Error;
+    }
+
+    Context.NumberOfRecords = Header->NumberOfRecords;
+    Stats->NumberOfDroppedRecords = Header->NumberOfDroppedRecords;
+
+    if (Header->Frequency.QuadPart != 0) {
+        Stats->RecordedMicroseconds = (ULONGLONG)(
+            ((Header->EndCounter.QuadPart - Header->StartCounter.QuadPart) *
+             1000000) / Header->Frequency.QuadPart
+        );
+    }
+
+    Timestamps = Header->EndTimestamp - Header->StartTimestamp;
+
+    if (Timestamps != 0) {
+        Context.MicrosecondsPerTimestamp = (
+            (DOUBLE)Stats->RecordedMicroseconds / (DOUBLE)Timestamps
+        );
+    }
+
+    //
+    // Capture the offset of each record and validate it, and assign each
+    // record to a replay thread if thread interleaving is being preserved.
+    //
+
+    Context.RecordOffsets = (PULONGLONG)(
+        Allocator->Calloc(Allocator,
+                          max(Context.NumberOfRecords, 1),
+                          sizeof(ULONGLONG))
+    );
+
+    if (!Context.RecordOffsets) {
+        goto Error;
+    }
+
+    Context.ThreadIndexes = (PBYTE)(
+        Allocator->Calloc(Allocator, max(Context.NumberOfRecords, 1), 1)
+    );
+
+    if (!Context.ThreadIndexes) {
+        goto Error;
+    }
+
+    NumberOfThreads = 0;
+    Offset = sizeof(*Header);
+
+    for (RecordIndex = 0;
+         RecordIndex < Context.NumberOfRecords;
+         RecordIndex++) {
+
+        if (Offset + sizeof(*Record) > Header->SizeOfFile) {
+            goto Error;
+        }
+
+        Record = (PCDICTIONARY_RECORD)RtlOffsetToPointer(Header, Offset);
+
+        if (!IsValidDictionaryRecordOperation(Record->Operation) ||
+            Record->SizeOfRecord != DICTIONARY_RECORD_SIZE(Record->Length) ||
+            Offset + Record->SizeOfRecord > Header->SizeOfFile ||
+            DICTIONARY_RECORD_WORD(Record)[Record->Length] != '\0') {
+            goto Error;
+        }
+
+        Context.RecordOffsets[RecordIndex] = Offset;
+        Offset += Record->SizeOfRecord;
+
+        if (!Flags.PreserveThreadInterleaving) {
+            continue;
+        }
+
+        for (Index = 0; Index < NumberOfThreads; Index++) {
+            if (ThreadIds[Index] == Record->ThreadId) {
+                break;
+            }
+        }
+
+        if (Index == NumberOfThreads) {
+            if (Index == DICTIONARY_REPLAY_MAXIMUM_NUMBER_OF_THREADS) {
+                goto Error;
+            }
+            ThreadIds[NumberOfThreads++] = Record->ThreadId;
+        }
+
+        Context.ThreadIndexes[RecordIndex] = (BYTE)Index;
+    }
+
+    //
+    // Replay the records.
+    //
+
+    QueryPerformanceFrequency(&Context.Frequency);
+    QueryPerformanceCounter(&Context.StartCounter);
+
+    if (!Flags.PreserveThreadInterleaving || NumberOfThreads <= 1) {
+
+        Stats->NumberOfThreads = 1;
+
+        for (RecordIndex = 0;
+             RecordIndex < Context.NumberOfRecords;
+             RecordIndex++) {
+
+            Record = GetDictionaryRecord(&Context, RecordIndex);
+
+            if (Flags.PreserveTiming) {
+                WaitForDictionaryRecord(&Context, Record);
+            }
+
+            ExecuteDictionaryRecord(&Context, Record);
+        }
+
+    } else {
+
+        //
+        // Dedicated threads are used rather than the thread pool, as each
+        // thread waits on the others, so they must all be able to run at once.
+        //
+
+        Threads = (PDICTIONARY_REPLAY_THREAD)(
+            Allocator->Calloc(Allocator, NumberOfThreads, sizeof(*Threads))
+        );
+
+        if (!Threads) {
+            goto Error;
+        }
+
+        for (ThreadIndex = 0; ThreadIndex < NumberOfThreads; ThreadIndex++) {
+
+            Threads[ThreadIndex].Context = &Context;
+            Threads[ThreadIndex].ThreadIndex = ThreadIndex;
+            Threads[ThreadIndex].RecordedThreadId = ThreadIds[ThreadIndex];
+            Threads[ThreadIndex].ThreadHandle = (
+                CreateThread(NULL,
+                             0,
+                             DictionaryReplayThreadProc,
+                             &Threads[ThreadIndex],
+                             CREATE_SUSPENDED,
+                             NULL)
+            );
+
+            if (!Threads[ThreadIndex].ThreadHandle) {
+                goto Error;
+            }
+        }
+
+        Stats->NumberOfThreads = NumberOfThreads;
+
+        for (Index = 0; Index < NumberOfThreads; Index++) {
+            ResumeThread(Threads[Index].ThreadHandle);
+        }
+
+        for (Index = 0; Index < NumberOfThreads; Index++) {
+            WaitForSingleObject(Threads[Index].ThreadHandle, INFINITE);
+        }
+    }
+
+    QueryPerformanceCounter(&EndCounter);
+
+    Stats->ElapsedMicroseconds = (ULONGLONG)(
+        ((EndCounter.QuadPart - Context.StartCounter.QuadPart) * 1000000) /
+        Context.Frequency.QuadPart
+    );
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    //
+    // Threads are created suspended, so any that were created before a
+    // failure haven't started; terminate them.
+    //
+
+    if (Threads) {
+        for (Index = 0; Index < NumberOfThreads; Index++) {
+            if (Threads[Index].ThreadHandle) {
+                TerminateThread(Threads[Index].ThreadHandle, 1);
+            }
+        }
+    }
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    if (Threads) {
+        for (Index = 0; Index < NumberOfThreads; Index++) {
+            if (Threads[Index].ThreadHandle) {
+                CloseHandle(Threads[Index].ThreadHandle);
+            }
+        }
+        Allocator->FreePointer(Allocator, (PPVOID)&Threads);
+    }
+
+    if (Context.ThreadIndexes) {
+        Allocator->FreePointer(Allocator, (PPVOID)&Context.ThreadIndexes);
+    }
+
+    if (Context.RecordOffsets) {
+        Allocator->FreePointer(Allocator, (PPVOID)&Context.RecordOffsets);
+    }
+
+    if (Header) {
+        UnmapViewOfFile(Header);
+    }
+
+    if (SectionHandle) {
+        CloseHandle(SectionHandle);
+    }
+
+    CloseHandle(FileHandle);
+
+    return Success;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
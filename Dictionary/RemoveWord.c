@@ -67,70 +67,23 @@ Return Value:
     word is not found; the caller must test the EntryCountPointer to inspect
     the removal results.
 
-    (FALSE will be returned on parameter validation failure or memory
-     allocation failure.)
+    (FALSE will be returned on parameter validation failure, memory
+     allocation failure, or if the dictionary has been frozen.  FALSE is also
+     returned if a write-ahead log is open and the removal could not be
+     written to it; the removal will still have been applied in memory.)
 
 --*/
 {
-    PRTL Rtl;
     BOOL Success;
-    PBYTE Buffer;
-    ULONG AllocSize;
-    PLIST_ENTRY Flink;
-    PLIST_ENTRY Blink;
-    PRTL_AVL_TABLE Avl;
-    BOOLEAN ParentIsRoot;
-    PCLONG_STRING String;
-    PLIST_ENTRY ListHead;
-    PLIST_ENTRY ListEntry;
-    PWORD_TABLE WordTable;
+    ULONGLONG Sequence;
+    PDICTIONARY_LOG Log;
+    PPREFIX_NODE PrefixNode;
     PWORD_ENTRY WordEntry;
     PWORD_STATS WordStats;
-    PLONG_STRING NewString;
     CHARACTER_BITMAP Bitmap;
-    PALLOCATOR WordAllocator;
-    PBITMAP_TABLE BitmapTable;
-    PLENGTH_TABLE LengthTable;
     DICTIONARY_CONTEXT Context;
-    PTABLE_ENTRY_HEADER Parent;
-    BOOLEAN IsLengthListEmpty;
-    BOOLEAN IsCurrentLongestWord;
-    BOOLEAN IsLongestWordAllTime;
     CHARACTER_HISTOGRAM Histogram;
-    PCLONG_STRING NextLongestString;
-    PHISTOGRAM_TABLE HistogramTable;
     PWORD_TABLE_ENTRY WordTableEntry;
-    PWORD_ENTRY NextLongestWordEntry;
-    PCLONG_STRING CurrentLongestWord;
-    PCLONG_STRING LongestWordAllTime;
-    PLENGTH_TABLE_ENTRY LengthTableEntry;
-    PBITMAP_TABLE_ENTRY BitmapTableEntry;
-    ULARGE_INTEGER TotalStringBufferAllocSize;
-    PTABLE_ENTRY_HEADER LengthTableEntryHeader;
-    PHISTOGRAM_TABLE_ENTRY HistogramTableEntry;
-    PWORD_TABLE_ENTRY NextLongestWordTableEntry;
-    PLENGTH_TABLE_ENTRY NextLongestLengthTableEntry;
-    PRTL_DELETE_ELEMENT_GENERIC_TABLE_AVL DeleteElement;
-    PTABLE_ENTRY_HEADER NextLongestLengthTableEntryHeader;
-    PRTL_NUMBER_GENERIC_TABLE_ELEMENTS_AVL NumberOfElements;
-    PTABLE_ENTRY_HEADER NextLongestLengthWordTableEntryHeader;
-
-    //
-    // N.B. The splay links and header variables could do with a cleanup.
-    //      (They were mostly used for debugging purposes.)
-    //
-
-    PRTL_SPLAY_LINKS LengthSplay;
-    PRTL_SPLAY_LINKS ParentSplay;
-    PRTL_SPLAY_LINKS SubtreeSuccessorSplay;
-    PRTL_SPLAY_LINKS SubtreePredecessorSplay;
-    PRTL_SPLAY_LINKS RealSuccessorSplay;
-    PRTL_SPLAY_LINKS RealPredecessorSplay;
-
-    PTABLE_ENTRY_HEADER SubtreeSuccessorHeader;
-    PTABLE_ENTRY_HEADER SubtreePredecessorHeader;
-    PTABLE_ENTRY_HEADER RealSuccessorHeader;
-    PTABLE_ENTRY_HEADER RealPredecessorHeader;
 
     //
     // Validate arguments.
@@ -149,21 +102,12 @@ Return Value:
     }
 
     //
-    // Zero the context, bitmap and histogram structures.
+    // Zero the context and bitmap structures.  (The histogram is zeroed by
+    // InitializeWord() if a full histogram is required.)
     //
 
     ZeroStruct(Context);
     ZeroStruct(Bitmap);
-    ZeroStruct(Histogram);
-
-    //
-    // Initialize aliases.
-    //
-
-    Rtl = Dictionary->Rtl;
-    WordAllocator = Dictionary->WordAllocator;
-    DeleteElement = Rtl->RtlDeleteElementGenericTableAvl;
-    NumberOfElements = Rtl->RtlNumberGenericTableElementsAvl;
 
     //
     // Write the error indicator (-1) to the caller's pointer up-front.
@@ -180,11 +124,32 @@ Return Value:
     DictionaryTlsSetContext(&Context);
 
     //
-    // Acquire an exclusive dictionary lock for the duration of this routine.
+    // Acquire an exclusive dictionary lock for the duration of this routine,
+    // and capture the write-ahead log, if any.
     //
 
     AcquireDictionaryLockExclusive(&Dictionary->Lock);
 
+    Log = BeginDictionaryLogOperation(Dictionary, &Sequence);
+
+    //
+    // Record the call if applicable.
+    //
+
+    if (Dictionary->Recorder) {
+        RecordDictionaryOperation(Dictionary,
+                                  DictionaryRecordRemoveWordOperation,
+                                  Word);
+    }
+
+    //
+    // Frozen dictionaries can't be modified.
+    //
+
+    if (Dictionary->Flags.IsFrozen) {
+        goto Error;
+    }
+
     //
     // Lookup the given word.
     //
@@ -227,6 +192,39 @@ Return Value:
 
     *EntryCountPointer = --WordStats->EntryCount;
 
+    //
+    // Append the removal to the write-ahead log, if applicable.  This must be
+    // done before the word entry is potentially freed below.
+    //
+
+    if (Dictionary->Log) {
+        AppendDictionaryLogRecord(Dictionary->Log,
+                                  DictionaryLogRemoveWordOperation,
+                                  WordEntry->String.Buffer,
+                                  WordEntry->String.Length,
+                                  1);
+    }
+
+    //
+    // Update the word's prefix index node, if applicable.  (This will remove
+    // the node if the entry count has reached zero.)
+    //
+
+    if (Dictionary->PrefixIndex) {
+
+        PrefixNode = FindPrefixIndexNode(Dictionary,
+                                         WordEntry->String.Buffer,
+                                         WordEntry->String.Length);
+
+        ASSERT(PrefixNode != NULL);
+
+        if (PrefixNode) {
+            UpdatePrefixIndexEntryCount(Dictionary,
+                                        PrefixNode,
+                                        WordStats->EntryCount);
+        }
+    }
+
     if (WordStats->EntryCount > 0) {
 
         //
@@ -243,6 +241,162 @@ Return Value:
     // removed from the dictionary.
     //
 
+    Success = RemoveWordTableEntry(Dictionary, &Context, WordTableEntry);
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    //
+    // Capture the end of the record appended by the removal (if any), then
+    // release our exclusive lock.
+    //
+
+    Sequence = EndDictionaryLogOperation(Log, Sequence);
+
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    //
+    // If a write-ahead log is open, wait for the removal to become durable.
+    //
+
+    if (Log && !WaitForDictionaryLog(Log, Sequence)) {
+        Success = FALSE;
+    }
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+RemoveWordTableEntry(
+    PDICTIONARY Dictionary,
+    PDICTIONARY_CONTEXT Context,
+    PWORD_TABLE_ENTRY WordTableEntry
+    )
+/*++
+
+Routine Description:
+
+    This routine completely removes a word table entry from the dictionary and
+    releases all associated memory.  The word is unlinked from its length list,
+    the current longest and all-time longest word stats are updated (copying
+    the underlying string if necessary), and the owning histogram and bitmap
+    table entries are deleted if they become empty.
+
+    This routine is used by RemoveWord() once a word's entry count reaches
+    zero, and by EvictWords() when a bounded dictionary exceeds its budget.
+    The exclusive dictionary lock must be held by the caller.
+
+    N.B. This routine doesn't append to the write-ahead log; its callers log
+         the operation that led to the removal (a decrement by RemoveWord(),
+         or an eviction by EvictWordTableEntry()).
+
+Arguments:
+
+    Dictionary - Supplies a pointer to a DICTIONARY structure from which the
+        word table entry is to be removed.
+
+    Context - Supplies a pointer to the DICTIONARY_CONTEXT structure that was
+        populated by FindWordTableEntry() when the word table entry was looked
+        up.  The bitmap and histogram table entries captured in the context
+        are used to locate the entry's owning tables.
+
+    WordTableEntry - Supplies a pointer to the word table entry to remove.  The
+        word's entry count must be zero.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  (FALSE will be returned on memory
+    allocation failure or if an underlying table deletion failed.)
+
+--*/
+{
+    PRTL Rtl;
+    BOOL Success;
+    PBYTE Buffer;
+    ULONG Length;
+    ULONG AllocSize;
+    PBYTE StringBuffer;
+    PDICTIONARY_ARENA_CHUNK StringChunk;
+    PLIST_ENTRY Flink;
+    PLIST_ENTRY Blink;
+    PRTL_AVL_TABLE Avl;
+    BOOLEAN ParentIsRoot;
+    PCLONG_STRING String;
+    PLIST_ENTRY ListHead;
+    PLIST_ENTRY ListEntry;
+    PWORD_TABLE WordTable;
+    PWORD_ENTRY WordEntry;
+    PLONG_STRING NewString;
+    PALLOCATOR WordAllocator;
+    PBITMAP_TABLE BitmapTable;
+    PLENGTH_TABLE LengthTable;
+    PTABLE_ENTRY_HEADER Parent;
+    PTABLE_ENTRY_HEADER TableEntryHeader;
+    TABLE_ENTRY_HEADER LengthTableEntryKey;
+    BOOLEAN IsLengthListEmpty;
+    BOOLEAN IsCurrentLongestWord;
+    BOOLEAN IsLongestWordAllTime;
+    BOOLEAN IsInlineString;
+    PCLONG_STRING NextLongestString;
+    PHISTOGRAM_TABLE HistogramTable;
+    PWORD_ENTRY NextLongestWordEntry;
+    PCLONG_STRING CurrentLongestWord;
+    PCLONG_STRING LongestWordAllTime;
+    PLENGTH_TABLE_ENTRY LengthTableEntry;
+    PBITMAP_TABLE_ENTRY BitmapTableEntry;
+    ULARGE_INTEGER TotalStringBufferAllocSize;
+    PTABLE_ENTRY_HEADER LengthTableEntryHeader;
+    PHISTOGRAM_TABLE_ENTRY HistogramTableEntry;
+    PWORD_TABLE_ENTRY NextLongestWordTableEntry;
+    PLENGTH_TABLE_ENTRY NextLongestLengthTableEntry;
+    PRTL_DELETE_ELEMENT_GENERIC_TABLE_AVL DeleteElement;
+    PTABLE_ENTRY_HEADER NextLongestLengthTableEntryHeader;
+    PRTL_NUMBER_GENERIC_TABLE_ELEMENTS_AVL NumberOfElements;
+    PTABLE_ENTRY_HEADER NextLongestLengthWordTableEntryHeader;
+
+    //
+    // N.B. The splay links and header variables could do with a cleanup.
+    //      (They were mostly used for debugging purposes.)
+    //
+
+    PRTL_SPLAY_LINKS LengthSplay;
+    PRTL_SPLAY_LINKS ParentSplay;
+    PRTL_SPLAY_LINKS SubtreeSuccessorSplay;
+    PRTL_SPLAY_LINKS SubtreePredecessorSplay;
+    PRTL_SPLAY_LINKS RealSuccessorSplay;
+    PRTL_SPLAY_LINKS RealPredecessorSplay;
+
+    PTABLE_ENTRY_HEADER SubtreeSuccessorHeader;
+    PTABLE_ENTRY_HEADER SubtreePredecessorHeader;
+    PTABLE_ENTRY_HEADER RealSuccessorHeader;
+    PTABLE_ENTRY_HEADER RealPredecessorHeader;
+
+    //
+    // Initialize aliases.
+    //
+
+    Rtl = Dictionary->Rtl;
+    WordAllocator = Dictionary->WordAllocator;
+    DeleteElement = Rtl->RtlDeleteElementGenericTableAvl;
+    NumberOfElements = Rtl->RtlNumberGenericTableElementsAvl;
+    WordEntry = &WordTableEntry->WordEntry;
+
+    ASSERT(WordEntry->Stats.EntryCount == 0);
+
+    //
+    // Unlink the word from its length list and decrement the dictionary's
+    // word count.
+    //
+
     String = &WordEntry->String;
     CurrentLongestWord = Dictionary->Stats.CurrentLongestWord;
     LongestWordAllTime = Dictionary->Stats.LongestWordAllTime;
@@ -253,11 +407,39 @@ Return Value:
 
     IsLengthListEmpty = RemoveEntryList(ListEntry);
 
+    ASSERT(Dictionary->NumberOfWords > 0);
+    Dictionary->NumberOfWords--;
+
     IsCurrentLongestWord = (String == CurrentLongestWord);
     IsLongestWordAllTime = (String == LongestWordAllTime);
 
     LengthTable = &Dictionary->LengthTable;
 
+    //
+    // If there are words of this length remaining, look up the length table
+    // entry and decrement its word count.  (Otherwise, the entry is deleted
+    // below.)
+    //
+
+    if (!IsLengthListEmpty) {
+
+        ZeroStruct(LengthTableEntryKey);
+        LengthTableEntryKey.Length = String->Length;
+
+        LengthTableEntry = (PLENGTH_TABLE_ENTRY)(
+            Rtl->RtlLookupElementGenericTableAvl(
+                &LengthTable->Avl,
+                &LengthTableEntryKey.LengthTableEntry
+            )
+        );
+
+        ASSERT(LengthTableEntry);
+        ASSERT(LengthTableEntry->NumberOfWords > 1);
+
+        LengthTableEntry->NumberOfWords--;
+        LengthTableEntry = NULL;
+    }
+
     //
     // Invariant check: if we're the longest word of all time, we must be the
     // current longest word, too.
@@ -398,6 +580,26 @@ Return Value:
             Dictionary->Stats.CurrentLongestWord = NextLongestString;
         }
 
+        //
+        // If the eviction clock hand is on our length table entry, move it on
+        // to the next longest length (or clear it, such that it wraps around
+        // to the shortest length), with no words left to examine.
+        //
+
+        if (Dictionary->ClockHandEntry == LengthTableEntry) {
+            if (RealSuccessorHeader) {
+                Dictionary->ClockHandEntry = (
+                    &RealSuccessorHeader->LengthTableEntry
+                );
+                Dictionary->ClockHandRemaining = (ULONG)(
+                    min(Dictionary->ClockHandEntry->NumberOfWords, MAXULONG)
+                );
+            } else {
+                Dictionary->ClockHandEntry = NULL;
+                Dictionary->ClockHandRemaining = 0;
+            }
+        }
+
         //
         // Now that we've obtained the next longest entry to promote (if
         // applicable), we can delete our length table entry.
@@ -508,11 +710,48 @@ Return Value:
     // Initialize table and entry aliases.
     //
 
-    WordTable = Context.WordTable;
+    WordTable = Context->WordTable;
     BitmapTable = &Dictionary->BitmapTable;
-    HistogramTable = Context.HistogramTable;
-    BitmapTableEntry = Context.BitmapTableEntry;
-    HistogramTableEntry = Context.HistogramTableEntry;
+    HistogramTable = Context->HistogramTable;
+    BitmapTableEntry = Context->BitmapTableEntry;
+    HistogramTableEntry = Context->HistogramTableEntry;
+
+    if (!WordTable) {
+
+        //
+        // The word is being stored inline within the histogram table entry,
+        // which means it was the only word for the histogram.  Free the string
+        // buffer and then delete the histogram table entry directly.
+        //
+
+        ASSERT(HistogramTableEntryHasInlineWord(HistogramTableEntry));
+        ASSERT(WordTableEntry == &HistogramTableEntry->InlineWordTableEntry);
+
+        TableEntryHeader = TABLE_ENTRY_TO_HEADER(HistogramTableEntry);
+
+        if (!TableEntryHeader->IsInlineString) {
+            StringChunk = WordStringArenaChunk(TableEntryHeader);
+            FreeWordStringBuffer(Dictionary, StringChunk, String->Buffer);
+        }
+
+        String = NULL;
+
+        goto DeleteHistogramTableEntry;
+    }
+
+    //
+    // Capture the string's length and buffer prior to deleting the word table
+    // entry, as the string structure lives within the entry being deleted.
+    // (The buffer must remain valid until the deletion has completed, as the
+    // word table's comparison routine may need to inspect it.)
+    //
+
+    TableEntryHeader = TABLE_ENTRY_TO_HEADER(WordTableEntry);
+    Length = String->Length;
+    StringBuffer = String->Buffer;
+    StringChunk = WordStringArenaChunk(TableEntryHeader);
+    IsInlineString = (BOOLEAN)TableEntryHeader->IsInlineString;
+    String = NULL;
 
     //
     // Delete the word table entry.
@@ -523,10 +762,15 @@ Return Value:
     }
 
     //
-    // Free the underlying string buffer.
+    // Free the underlying string buffer, unless it was stored inline (in
+    // which case it was released along with the entry).
     //
 
-    WordAllocator->FreePointer(WordAllocator, (PPVOID)&String->Buffer);
+    if (!IsInlineString) {
+        FreeWordStringBuffer(Dictionary, StringChunk, StringBuffer);
+    }
+
+    StringBuffer = NULL;
 
     //
     // Update the number of bytes allocated to string buffers in the
@@ -537,7 +781,7 @@ Return Value:
     Avl = &WordTable->Avl;
     TotalStringBufferAllocSize.LowPart = Avl->BytesAllocatedLowPart;
     TotalStringBufferAllocSize.HighPart = Avl->BytesAllocatedHighPart;
-    TotalStringBufferAllocSize.QuadPart -= (String->Length + 1);
+    TotalStringBufferAllocSize.QuadPart -= (Length + 1);
     Avl->BytesAllocatedLowPart = TotalStringBufferAllocSize.LowPart;
     Avl->BytesAllocatedHighPart = TotalStringBufferAllocSize.HighPart;
 
@@ -550,33 +794,36 @@ Return Value:
 
         ASSERT(TotalStringBufferAllocSize.QuadPart > 0);
 
-    } else {
+        Success = TRUE;
+        goto End;
+    }
 
-        //
-        // Likewise, if there are no more elements, the buffer size should
-        // also indicate 0 bytes.
-        //
+    //
+    // Likewise, if there are no more elements, the buffer size should
+    // also indicate 0 bytes.
+    //
 
-        ASSERT(TotalStringBufferAllocSize.QuadPart == 0);
+    ASSERT(TotalStringBufferAllocSize.QuadPart == 0);
 
-        //
-        // The histogram table entry has no more words, so it can be deleted.
-        //
+DeleteHistogramTableEntry:
 
-        if (!DeleteElement(&HistogramTable->Avl, HistogramTableEntry)) {
-            goto Error;
-        }
+    //
+    // The histogram table entry has no more words, so it can be deleted.
+    //
 
-        //
-        // If the histogram table has no more entries, the bitmap entry can
-        // be deleted.
-        //
+    if (!DeleteElement(&HistogramTable->Avl, HistogramTableEntry)) {
+        goto Error;
+    }
+
+    //
+    // If the histogram table has no more entries, the bitmap entry can
+    // be deleted.
+    //
 
-        if (NumberOfElements(&HistogramTable->Avl) == 0) {
+    if (NumberOfElements(&HistogramTable->Avl) == 0) {
 
-            if (!DeleteElement(&BitmapTable->Avl, BitmapTableEntry)) {
-                goto Error;
-            }
+        if (!DeleteElement(&BitmapTable->Avl, BitmapTableEntry)) {
+            goto Error;
         }
     }
 
@@ -597,12 +844,6 @@ Error:
 
 End:
 
-    //
-    // Release our exclusive lock and return the success indicator.
-    //
-
-    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
-
     return Success;
 }
 
@@ -0,0 +1,1022 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    Service.c
+
+Abstract:
+
+    This module implements the dictionary service, which allows a single owner
+    process to serve FindWord(), AddWord() and GetWordAnagrams() requests from
+    other processes on the same machine, such that only one copy of the
+    dictionary needs to be kept in memory.
+
+    Requests are exchanged via a named shared memory section.  Each client
+    claims a ring of fixed-size slots within the section, and is the sole
+    producer for that ring; the owner is the sole consumer of every ring.
+    Neither side takes a lock: each ring's SubmittedIndex is only written by
+    the client, and its CompletedIndex is only written by the owner.  The
+    owner drains every ring in one pass and publishes completions once per
+    ring per pass, such that busy clients are served in batches.
+
+    The owner routines are CreateDictionaryService(),
+    ProcessDictionaryServiceRequests() and DestroyDictionaryService().  The
+    client routines are OpenDictionaryServiceClient(),
+    SubmitDictionaryServiceRequest(), GetDictionaryServiceResponse() and
+    CloseDictionaryServiceClient().
+
+--*/
+
+#include "stdafx.h"
+
+//
+// Number of spins a client performs whilst waiting on the owner before it
+// checks whether the service is shutting down and yields its processor.
+//
+
+#define DICTIONARY_SERVICE_SPIN_COUNT 1024
+
+FORCEINLINE
+BOOLEAN
+IsPowerOfTwoULong(
+    _In_ ULONG Value
+    )
+{
+    return (Value != 0 && (Value & (Value - 1)) == 0);
+}
+
+FORCEINLINE
+PDICTIONARY_SERVICE_SLOT
+GetDictionaryServiceSlot(
+    _In_ PDICTIONARY_SERVICE_RING Ring,
+    _In_ ULONG NumberOfSlots,
+    _In_ ULONGLONG Sequence
+    )
+{
+    return &Ring->Slots[Sequence & (NumberOfSlots - 1)];
+}
+
+FORCEINLINE
+VOID
+PublishDictionaryServiceIndex(
+    _Out_ volatile ULONGLONG *Index,
+    _In_ ULONGLONG Value
+    )
+/*++
+
+Routine Description:
+
+    Publishes a new ring index.  The interlocked exchange ensures all prior
+    writes to the ring's slots are visible to the other process before the
+    new index is.
+
+--*/
+{
+    InterlockedExchange64((volatile LONGLONG *)Index, (LONGLONG)Value);
+}
+
+FORCEINLINE
+BOOLEAN
+WaitForDictionaryServiceCompletion(
+    _In_ PDICTIONARY_SERVICE_CLIENT Client,
+    _In_ ULONGLONG CompletedIndex
+    )
+/*++
+
+Routine Description:
+
+    Waits until the owner has completed every request prior to the given
+    sequence number.  The wait spins (the owner is expected to respond within
+    a few microseconds), periodically yielding the processor.
+
+Arguments:
+
+    Client - Supplies a pointer to the client.
+
+    CompletedIndex - Supplies the completed index to wait for.
+
+Return Value:
+
+    TRUE once the index has been reached, FALSE if the service is shutting
+    down.
+
+--*/
+{
+    ULONG Spins;
+    PDICTIONARY_SERVICE_RING Ring;
+    PDICTIONARY_SERVICE_HEADER Header;
+
+    Ring = Client->Ring;
+    Header = Client->Header;
+    Spins = 0;
+
+    while (Ring->CompletedIndex < CompletedIndex) {
+
+        if (++Spins < DICTIONARY_SERVICE_SPIN_COUNT) {
+            YieldProcessor();
+            continue;
+        }
+
+        if (Header->IsShuttingDown) {
+            return FALSE;
+        }
+
+        Spins = 0;
+        SwitchToThread();
+    }
+
+    return TRUE;
+}
+
+FORCEINLINE
+VOID
+ProcessDictionaryServiceSlot(
+    _In_ PDICTIONARY_SERVICE Service,
+    _Inout_ PDICTIONARY_SERVICE_SLOT Slot
+    )
+/*++
+
+Routine Description:
+
+    Processes a single request and writes the response back into its slot.
+    The word is copied out of the slot before it is used, as the client can
+    continue to write to the slot whilst the request is being processed.
+
+Arguments:
+
+    Service - Supplies a pointer to the service.
+
+    Slot - Supplies a pointer to the slot containing the request.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ULONG Length;
+    ULONG RequestType;
+    ULONG BytesRemaining;
+    PBYTE Buffer;
+    BOOLEAN Exists;
+    BYTE Word[DICTIONARY_SERVICE_MAXIMUM_WORD_LENGTH + 1];
+    PALLOCATOR Allocator;
+    PDICTIONARY Dictionary;
+    PLIST_ENTRY ListEntry;
+    PCLONG_STRING String;
+    LONGLONG EntryCount;
+    PLINKED_WORD_LIST LinkedWordList;
+    PLINKED_WORD_ENTRY LinkedWordEntry;
+
+    Dictionary = Service->Dictionary;
+    Allocator = Service->Allocator;
+
+    //
+    // Capture the request type and length, then validate them.
+    //
+
+    RequestType = Slot->RequestType;
+    Length = Slot->Length;
+
+    Slot->Success = FALSE;
+    Slot->Exists = FALSE;
+    Slot->Truncated = FALSE;
+    Slot->NumberOfWords = 0;
+    Slot->EntryCount = 0;
+
+    if (!IsValidDictionaryServiceRequestType(RequestType) ||
+        Length == 0 ||
+        Length > DICTIONARY_SERVICE_MAXIMUM_WORD_LENGTH) {
+        return;
+    }
+
+    //
+    // Capture the word into private memory and terminate it.  Only the copy is
+    // used from here on.
+    //
+
+    CopyMemory(Word, (PCBYTE)Slot->Data, Length);
+    Word[Length] = '\0';
+
+    switch (RequestType) {
+
+        case DictionaryServiceFindWordRequest:
+
+            Slot->Success = FindWord(Dictionary, Word, &Exists);
+            Slot->Exists = (Slot->Success && Exists);
+            break;
+
+        case DictionaryServiceAddWordRequest:
+
+            Slot->Success = AddWord(Dictionary, Word, &EntryCount);
+            if (Slot->Success) {
+                Slot->EntryCount = EntryCount;
+            }
+            break;
+
+        case DictionaryServiceGetWordAnagramsRequest:
+
+            Slot->Success = GetWordAnagrams(Dictionary,
+                                            Allocator,
+                                            Word,
+                                            &LinkedWordList);
+
+            if (!Slot->Success || !LinkedWordList) {
+                break;
+            }
+
+            //
+            // Overwrite the request's word with as many anagrams as will fit.
+            //
+
+            Buffer = Slot->Data;
+            BytesRemaining = DICTIONARY_SERVICE_SLOT_DATA_SIZE;
+
+            for (ListEntry = LinkedWordList->ListHead.Flink;
+                 ListEntry != &LinkedWordList->ListHead;
+                 ListEntry = ListEntry->Flink) {
+
+                LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                    LINKED_WORD_ENTRY,
+                                                    ListEntry);
+                String = &LinkedWordEntry->WordEntry.String;
+
+                if (String->Length + 1 > BytesRemaining) {
+                    Slot->Truncated = TRUE;
+                    break;
+                }
+
+                CopyMemory(Buffer, String->Buffer, String->Length + 1);
+                Buffer += String->Length + 1;
+                BytesRemaining -= String->Length + 1;
+                Slot->NumberOfWords++;
+            }
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+            break;
+
+        default:
+            ASSERT(FALSE);
+            break;
+    }
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CreateDictionaryService(
+    PDICTIONARY Dictionary,
+    PCWSTR Name,
+    ULONG NumberOfClients,
+    ULONG NumberOfSlots,
+    PDICTIONARY_SERVICE *ServicePointer
+    )
+/*++
+
+Routine Description:
+
+    Creates a dictionary service, backed by a named shared memory section, for
+    a dictionary owned by the calling process.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure to be served.
+
+    Name - Supplies the name of the shared memory section (e.g.
+        L"Local\\MyDictionary").  Clients open the service by this name.
+
+    NumberOfClients - Supplies the maximum number of concurrent clients.
+
+    NumberOfSlots - Optionally supplies the number of request slots per client
+        (a power of 2).  If 0, a default is used.  This bounds the number of
+        requests a client can have in flight.
+
+    ServicePointer - Supplies the address of a variable that receives the
+        address of the service.  Set to NULL on error.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    ULONG Index;
+    BOOLEAN Success;
+    HANDLE SectionHandle;
+    ULARGE_INTEGER SectionSize;
+    PALLOCATOR Allocator;
+    PDICTIONARY_SERVICE Service;
+    PDICTIONARY_SERVICE_RING Ring;
+    PDICTIONARY_SERVICE_HEADER Header;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(ServicePointer)) {
+        return FALSE;
+    }
+
+    *ServicePointer = NULL;
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Name)) {
+        return FALSE;
+    }
+
+    if (NumberOfClients == 0 ||
+        NumberOfClients > DICTIONARY_SERVICE_MAXIMUM_NUMBER_OF_CLIENTS) {
+        return FALSE;
+    }
+
+    if (NumberOfSlots == 0) {
+        NumberOfSlots = DICTIONARY_SERVICE_DEFAULT_NUMBER_OF_SLOTS;
+    }
+
+    if (!IsPowerOfTwoULong(NumberOfSlots) ||
+        NumberOfSlots > DICTIONARY_SERVICE_MAXIMUM_NUMBER_OF_SLOTS) {
+        return FALSE;
+    }
+
+    //
+    // Allocate the service structure.
+    //
+
+    Allocator = Dictionary->Allocator;
+
+    Service = (PDICTIONARY_SERVICE)(
+        Allocator->Calloc(Allocator, 1, sizeof(*Service))
+    );
+
+    if (!Service) {
+        return FALSE;
+    }
+
+    Service->Dictionary = Dictionary;
+    Service->Allocator = Allocator;
+    Service->NumberOfClients = NumberOfClients;
+    Service->NumberOfSlots = NumberOfSlots;
+    Service->SizeOfRing = DICTIONARY_SERVICE_RING_SIZE(NumberOfSlots);
+
+    //
+    // Create and map the section.  Pages are zeroed by the system, so every
+    // ring starts out unclaimed with both indices at zero.
+    //
+
+    SectionSize.QuadPart = (
+        DICTIONARY_SERVICE_SECTION_SIZE(NumberOfClients, NumberOfSlots)
+    );
+
+    SectionHandle = CreateFileMappingW(INVALID_HANDLE_VALUE,
+                                       NULL,
+                                       PAGE_READWRITE,
+                                       SectionSize.HighPart,
+                                       SectionSize.LowPart,
+                                       Name);
+
+    if (!SectionHandle) {
+        goto Error;
+    }
+
+    Service->SectionHandle = SectionHandle;
+
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+
+        //
+        // Another service is already using this name.
+        //
+
+        goto Error;
+    }
+
+    Header = (PDICTIONARY_SERVICE_HEADER)(
+        MapViewOfFile(SectionHandle,
+                      FILE_MAP_READ | FILE_MAP_WRITE,
+                      0,
+                      0,
+                      (SIZE_T)SectionSize.QuadPart)
+    );
+
+    if (!Header) {
+        goto Error;
+    }
+
+    Service->Header = Header;
+
+    Header->SizeOfHeader = sizeof(*Header);
+    Header->Version = DICTIONARY_SERVICE_VERSION;
+    Header->NumberOfClients = NumberOfClients;
+    Header->NumberOfSlots = NumberOfSlots;
+    Header->SizeOfRing = Service->SizeOfRing;
+    Header->SizeOfSection = SectionSize.QuadPart;
+    Header->OwnerProcessId = GetCurrentProcessId();
+
+    for (Index = 0; Index < NumberOfClients; Index++) {
+        Ring = DICTIONARY_SERVICE_RING_AT(Header, Index, Service->SizeOfRing);
+        ASSERT(!Ring->IsClaimed);
+        ASSERT(Ring->SubmittedIndex == 0);
+        ASSERT(Ring->CompletedIndex == 0);
+    }
+
+    //
+    // Publish the signature last; clients won't open the section until it's
+    // present.
+    //
+
+    InterlockedExchange((volatile LONG *)&Header->Signature,
+                        DICTIONARY_SERVICE_SIGNATURE);
+
+    *ServicePointer = Service;
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    if (Service->Header) {
+        UnmapViewOfFile(Service->Header);
+        Service->Header = NULL;
+    }
+
+    if (Service->SectionHandle) {
+        CloseHandle(Service->SectionHandle);
+        Service->SectionHandle = NULL;
+    }
+
+    Allocator->FreePointer(Allocator, (PPVOID)&Service);
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+ProcessDictionaryServiceRequests(
+    PDICTIONARY_SERVICE Service,
+    PULONG NumberOfRequestsPointer
+    )
+/*++
+
+Routine Description:
+
+    Processes every outstanding request from every client.  The owner calls
+    this routine repeatedly (typically in a loop on a dedicated thread) for
+    as long as it wishes to serve requests.
+
+    Each ring's outstanding requests are processed in order, and then the
+    ring's completed index is advanced once for the entire batch.
+
+Arguments:
+
+    Service - Supplies a pointer to the service.
+
+    NumberOfRequestsPointer - Optionally supplies the address of a variable
+        that receives the number of requests processed.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    ULONG Index;
+    ULONG NumberOfSlots;
+    ULONG NumberOfRequests;
+    ULONGLONG Sequence;
+    ULONGLONG Submitted;
+    ULONGLONG Completed;
+    PDICTIONARY_SERVICE_RING Ring;
+    PDICTIONARY_SERVICE_HEADER Header;
+
+    if (ARGUMENT_PRESENT(NumberOfRequestsPointer)) {
+        *NumberOfRequestsPointer = 0;
+    }
+
+    if (!ARGUMENT_PRESENT(Service)) {
+        return FALSE;
+    }
+
+    //
+    // Use the geometry captured at creation time; the header's copy can be
+    // overwritten by any client.
+    //
+
+    Header = Service->Header;
+    NumberOfSlots = Service->NumberOfSlots;
+    NumberOfRequests = 0;
+
+    for (Index = 0; Index < Service->NumberOfClients; Index++) {
+
+        Ring = DICTIONARY_SERVICE_RING_AT(Header, Index, Service->SizeOfRing);
+
+        Completed = Ring->CompletedIndex;
+        Submitted = Ring->SubmittedIndex;
+
+        if (Submitted <= Completed) {
+            continue;
+        }
+
+        //
+        // A well-behaved client never has more than NumberOfSlots requests
+        // outstanding.  Don't trust that.
+        //
+
+        if (Submitted - Completed > NumberOfSlots) {
+            Submitted = Completed + NumberOfSlots;
+        }
+
+        for (Sequence = Completed; Sequence < Submitted; Sequence++) {
+            ProcessDictionaryServiceSlot(
+                Service,
+                GetDictionaryServiceSlot(Ring, NumberOfSlots, Sequence)
+            );
+        }
+
+        PublishDictionaryServiceIndex(&Ring->CompletedIndex, Submitted);
+
+        NumberOfRequests += (ULONG)(Submitted - Completed);
+    }
+
+    if (NumberOfRequests > 0) {
+        Service->NumberOfRequests += NumberOfRequests;
+        Service->NumberOfBatches++;
+    }
+
+    if (ARGUMENT_PRESENT(NumberOfRequestsPointer)) {
+        *NumberOfRequestsPointer = NumberOfRequests;
+    }
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+DestroyDictionaryService(
+    PDICTIONARY_SERVICE *ServicePointer
+    )
+/*++
+
+Routine Description:
+
+    Destroys a dictionary service.  Connected clients observe the service is
+    shutting down and fail any outstanding waits; the section itself persists
+    until the last client closes it.
+
+Arguments:
+
+    ServicePointer - Supplies the address of a variable that contains the
+        address of the service.  The variable is cleared on success.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    PALLOCATOR Allocator;
+    PDICTIONARY_SERVICE Service;
+
+    if (!ARGUMENT_PRESENT(ServicePointer)) {
+        return FALSE;
+    }
+
+    Service = *ServicePointer;
+
+    if (!ARGUMENT_PRESENT(Service)) {
+        return FALSE;
+    }
+
+    InterlockedExchange(&Service->Header->IsShuttingDown, TRUE);
+
+    UnmapViewOfFile(Service->Header);
+    CloseHandle(Service->SectionHandle);
+
+    Allocator = Service->Allocator;
+    Allocator->FreePointer(Allocator, (PPVOID)ServicePointer);
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+OpenDictionaryServiceClient(
+    PALLOCATOR Allocator,
+    PCWSTR Name,
+    PDICTIONARY_SERVICE_CLIENT *ClientPointer
+    )
+/*++
+
+Routine Description:
+
+    Opens a dictionary service by name and claims a ring for the calling
+    client.
+
+Arguments:
+
+    Allocator - Supplies a pointer to the allocator used for the client.
+
+    Name - Supplies the name passed to CreateDictionaryService() by the
+        owner.
+
+    ClientPointer - Supplies the address of a variable that receives the
+        address of the client.  Set to NULL on error.
+
+Return Value:
+
+    TRUE on success, FALSE on failure (including when every ring has already
+    been claimed).
+
+--*/
+{
+    ULONG Index;
+    BOOLEAN Success;
+    HANDLE SectionHandle;
+    MEMORY_BASIC_INFORMATION MemoryInfo;
+    PDICTIONARY_SERVICE_RING Ring;
+    PDICTIONARY_SERVICE_CLIENT Client;
+    PDICTIONARY_SERVICE_HEADER Header;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(ClientPointer)) {
+        return FALSE;
+    }
+
+    *ClientPointer = NULL;
+
+    if (!ARGUMENT_PRESENT(Allocator)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Name)) {
+        return FALSE;
+    }
+
+    Client = (PDICTIONARY_SERVICE_CLIENT)(
+        Allocator->Calloc(Allocator, 1, sizeof(*Client))
+    );
+
+    if (!Client) {
+        return FALSE;
+    }
+
+    Client->Allocator = Allocator;
+
+    //
+    // Open and map the entire section.
+    //
+
+    SectionHandle = OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE,
+                                     FALSE,
+                                     Name);
+
+    if (!SectionHandle) {
+        goto Error;
+    }
+
+    Client->SectionHandle = SectionHandle;
+
+    Header = (PDICTIONARY_SERVICE_HEADER)(
+        MapViewOfFile(SectionHandle,
+                      FILE_MAP_READ | FILE_MAP_WRITE,
+                      0,
+                      0,
+                      0)
+    );
+
+    if (!Header) {
+        goto Error;
+    }
+
+    Client->Header = Header;
+
+    //
+    // Validate the header against the size of the view.
+    //
+
+    if (!VirtualQuery(Header, &MemoryInfo, sizeof(MemoryInfo))) {
+        goto Error;
+    }
+
+    if (Header->Signature != DICTIONARY_SERVICE_SIGNATURE ||
+        Header->Version != DICTIONARY_SERVICE_VERSION ||
+        Header->SizeOfHeader != sizeof(*Header) ||
+        Header->IsShuttingDown ||
+        !IsPowerOfTwoULong(Header->NumberOfSlots) ||
+        Header->NumberOfSlots > DICTIONARY_SERVICE_MAXIMUM_NUMBER_OF_SLOTS ||
+        Header->NumberOfClients == 0 ||
+        Header->NumberOfClients >
+            DICTIONARY_SERVICE_MAXIMUM_NUMBER_OF_CLIENTS ||
+        Header->SizeOfRing !=
+            DICTIONARY_SERVICE_RING_SIZE(Header->NumberOfSlots) ||
+        Header->SizeOfSection != DICTIONARY_SERVICE_SECTION_SIZE(
+            Header->NumberOfClients,
+            Header->NumberOfSlots
+        ) ||
+        Header->SizeOfSection > MemoryInfo.RegionSize) {
+        goto Error;
+    }
+
+    Client->NumberOfSlots = Header->NumberOfSlots;
+
+    //
+    // Claim the first free ring.
+    //
+
+    for (Index = 0; Index < Header->NumberOfClients; Index++) {
+        Ring = DICTIONARY_SERVICE_RING_AT(Header, Index, Header->SizeOfRing);
+        if (!InterlockedCompareExchange(&Ring->IsClaimed, TRUE, FALSE)) {
+            break;
+        }
+    }
+
+    if (Index == Header->NumberOfClients) {
+        goto Error;
+    }
+
+    Ring->ClientProcessId = GetCurrentProcessId();
+
+    Client->Ring = Ring;
+    Client->RingIndex = Index;
+
+    //
+    // A previous client may have left requests outstanding; carry on from
+    // where it left off.  (The first submission waits for any outstanding
+    // requests to complete if the ring is full.)
+    //
+
+    Client->NextSequence = Ring->SubmittedIndex;
+
+    *ClientPointer = Client;
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    if (Client->Header) {
+        UnmapViewOfFile(Client->Header);
+        Client->Header = NULL;
+    }
+
+    if (Client->SectionHandle) {
+        CloseHandle(Client->SectionHandle);
+        Client->SectionHandle = NULL;
+    }
+
+    Allocator->FreePointer(Allocator, (PPVOID)&Client);
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+SubmitDictionaryServiceRequest(
+    PDICTIONARY_SERVICE_CLIENT Client,
+    DICTIONARY_SERVICE_REQUEST_TYPE RequestType,
+    PCBYTE Word,
+    PULONGLONG SequencePointer
+    )
+/*++
+
+Routine Description:
+
+    Submits a request to the owner.  If the client's ring is full, this
+    routine waits for the owner to complete the oldest request.
+
+Arguments:
+
+    Client - Supplies a pointer to the client.
+
+    RequestType - Supplies the type of request.
+
+    Word - Supplies a NULL-terminated array of bytes representing the word
+        for which the request is being made.  The word must not exceed
+        DICTIONARY_SERVICE_MAXIMUM_WORD_LENGTH bytes.
+
+    SequencePointer - Supplies the address of a variable that receives the
+        request's sequence number, which is passed to
+        GetDictionaryServiceResponse() to obtain the response.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    ULONG Length;
+    ULONGLONG Sequence;
+    PDICTIONARY_SERVICE_SLOT Slot;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(SequencePointer)) {
+        return FALSE;
+    }
+
+    *SequencePointer = 0;
+
+    if (!ARGUMENT_PRESENT(Client)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Word)) {
+        return FALSE;
+    }
+
+    if (!IsValidDictionaryServiceRequestType(RequestType)) {
+        return FALSE;
+    }
+
+    for (Length = 0; Word[Length] != '\0'; Length++) {
+        if (Length == DICTIONARY_SERVICE_MAXIMUM_WORD_LENGTH) {
+            return FALSE;
+        }
+    }
+
+    if (Length == 0) {
+        return FALSE;
+    }
+
+    //
+    // Wait for a free slot if the ring is full.
+    //
+
+    Sequence = Client->NextSequence;
+
+    if (Sequence >= Client->NumberOfSlots) {
+        if (!WaitForDictionaryServiceCompletion(
+                Client,
+                Sequence - Client->NumberOfSlots + 1)) {
+            return FALSE;
+        }
+    }
+
+    //
+    // Write the request, then publish it.
+    //
+
+    Slot = GetDictionaryServiceSlot(Client->Ring,
+                                    Client->NumberOfSlots,
+                                    Sequence);
+
+    Slot->RequestType = (ULONG)RequestType;
+    Slot->Length = Length;
+    CopyMemory(Slot->Data, Word, Length + 1);
+
+    PublishDictionaryServiceIndex(&Client->Ring->SubmittedIndex,
+                                  Sequence + 1);
+
+    Client->NextSequence = Sequence + 1;
+    *SequencePointer = Sequence;
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+GetDictionaryServiceResponse(
+    PDICTIONARY_SERVICE_CLIENT Client,
+    ULONGLONG Sequence,
+    PDICTIONARY_SERVICE_RESPONSE Response
+    )
+/*++
+
+Routine Description:
+
+    Waits for the owner to complete a request, then returns its response.
+
+Arguments:
+
+    Client - Supplies a pointer to the client.
+
+    Sequence - Supplies the sequence number of the request, as returned by
+        SubmitDictionaryServiceRequest().  The request's slot must not have
+        been reused (i.e. fewer than the number of slots per ring requests
+        may have been submitted since).
+
+    Response - Supplies a pointer to a structure that receives the response.
+
+Return Value:
+
+    TRUE on success, FALSE on failure (including if the service is shutting
+    down).  Note that the response's Success field indicates whether the
+    owner's processing of the request succeeded.
+
+--*/
+{
+    PDICTIONARY_SERVICE_SLOT Slot;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Response)) {
+        return FALSE;
+    }
+
+    ZeroStructPointer(Response);
+
+    if (!ARGUMENT_PRESENT(Client)) {
+        return FALSE;
+    }
+
+    if (Sequence >= Client->NextSequence ||
+        Client->NextSequence - Sequence > Client->NumberOfSlots) {
+        return FALSE;
+    }
+
+    if (!WaitForDictionaryServiceCompletion(Client, Sequence + 1)) {
+        return FALSE;
+    }
+
+    Slot = GetDictionaryServiceSlot(Client->Ring,
+                                    Client->NumberOfSlots,
+                                    Sequence);
+
+    Response->Success = Slot->Success;
+    Response->Exists = Slot->Exists;
+    Response->Truncated = Slot->Truncated;
+    Response->NumberOfWords = Slot->NumberOfWords;
+    Response->EntryCount = Slot->EntryCount;
+
+    if (Response->NumberOfWords > 0) {
+        Response->Words = Slot->Data;
+    }
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CloseDictionaryServiceClient(
+    PDICTIONARY_SERVICE_CLIENT *ClientPointer
+    )
+/*++
+
+Routine Description:
+
+    Releases a client's ring and closes its view of the service.  Requests
+    still in flight are processed by the owner, but their responses are
+    discarded.
+
+Arguments:
+
+    ClientPointer - Supplies the address of a variable that contains the
+        address of the client.  The variable is cleared on success.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    PALLOCATOR Allocator;
+    PDICTIONARY_SERVICE_CLIENT Client;
+
+    if (!ARGUMENT_PRESENT(ClientPointer)) {
+        return FALSE;
+    }
+
+    Client = *ClientPointer;
+
+    if (!ARGUMENT_PRESENT(Client)) {
+        return FALSE;
+    }
+
+    Client->Ring->ClientProcessId = 0;
+    InterlockedExchange(&Client->Ring->IsClaimed, FALSE);
+
+    UnmapViewOfFile(Client->Header);
+    CloseHandle(Client->SectionHandle);
+
+    Allocator = Client->Allocator;
+    Allocator->FreePointer(Allocator, (PPVOID)ClientPointer);
+
+    return TRUE;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
@@ -0,0 +1,742 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    SetOperations.c
+
+Abstract:
+
+    This module implements set operations over dictionaries.  The public
+    MergeDictionaries(), IntersectDictionaries() and DiffDictionaries()
+    routines combine the words of two source dictionaries (and their entry
+    counts) into a destination dictionary.
+
+    Every tier of the dictionary is ordered: bitmap and histogram tables by
+    hash, and word tables by hash, length, then bytes.  The source cascades
+    are therefore walked in lockstep, in a single in-order pass over each,
+    like the merge step of a merge sort.  Subtrees present in only one source
+    are skipped entirely when the operation can't produce words from them
+    (i.e. either side for intersection, and the right side for difference).
+    The combined words are produced in table order, and are added to the
+    destination with their final entry counts under a single acquisition of
+    its exclusive lock.
+
+--*/
+
+#include "stdafx.h"
+
+//
+// Define the set operation types and context structure.
+//
+
+typedef enum _SET_OPERATION {
+    SetOperationMerge = 0,
+    SetOperationIntersect,
+    SetOperationDifference,
+} SET_OPERATION;
+
+typedef struct _SET_OPERATION_CONTEXT {
+    SET_OPERATION Operation;
+    PDICTIONARY Destination;
+    PRTL_ENUMERATE_GENERIC_TABLE_WITHOUT_SPLAYING_AVL EnumerateTable;
+} SET_OPERATION_CONTEXT;
+typedef SET_OPERATION_CONTEXT *PSET_OPERATION_CONTEXT;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(COMBINE_TABLE_ENTRIES)(
+    _In_ PSET_OPERATION_CONTEXT Context,
+    _In_opt_ PVOID LeftEntry,
+    _In_opt_ PVOID RightEntry
+    );
+typedef COMBINE_TABLE_ENTRIES *PCOMBINE_TABLE_ENTRIES;
+
+COMBINE_TABLE_ENTRIES CombineBitmapTableEntries;
+COMBINE_TABLE_ENTRIES CombineHistogramTableEntries;
+
+typedef
+_Success_(return != 0)
+BOOLEAN
+(COMBINE_TABLES)(
+    _In_ PSET_OPERATION_CONTEXT Context,
+    _In_opt_ PRTL_AVL_TABLE LeftTable,
+    _In_opt_ PRTL_AVL_TABLE RightTable,
+    _In_ PCOMBINE_TABLE_ENTRIES CombineEntries
+    );
+typedef COMBINE_TABLES *PCOMBINE_TABLES;
+
+COMBINE_TABLES CombineTables;
+
+//
+// Define a cursor for enumerating the words of a histogram table entry, which
+// either has a single inline word or a word table.
+//
+
+typedef struct _WORD_CURSOR {
+    PRTL_AVL_TABLE Avl;
+    PVOID RestartKey;
+    PWORD_ENTRY InlineWordEntry;
+} WORD_CURSOR;
+typedef WORD_CURSOR *PWORD_CURSOR;
+
+FORCEINLINE
+BOOLEAN
+ShouldCombine(
+    _In_ PSET_OPERATION_CONTEXT Context,
+    _In_ BOOLEAN HasLeft,
+    _In_ BOOLEAN HasRight
+    )
+/*++
+
+Routine Description:
+
+    Determines whether the operation can produce any words from a subtree
+    that is present in the left source, the right source, or both.
+
+--*/
+{
+    switch (Context->Operation) {
+        case SetOperationIntersect:
+            return (HasLeft && HasRight);
+        case SetOperationDifference:
+            return HasLeft;
+        default:
+            return TRUE;
+    }
+}
+
+FORCEINLINE
+VOID
+InitializeWordCursor(
+    _Out_ PWORD_CURSOR Cursor,
+    _In_opt_ PHISTOGRAM_TABLE_ENTRY HistogramTableEntry
+    )
+{
+    ZeroStructPointer(Cursor);
+
+    if (!HistogramTableEntry) {
+        return;
+    }
+
+    if (HistogramTableEntryHasInlineWord(HistogramTableEntry)) {
+        Cursor->InlineWordEntry =
+            &HistogramTableEntry->InlineWordTableEntry.WordEntry;
+    } else {
+        Cursor->Avl = &HistogramTableEntry->WordTable.Avl;
+    }
+}
+
+FORCEINLINE
+PWORD_ENTRY
+NextWordEntry(
+    _In_ PSET_OPERATION_CONTEXT Context,
+    _Inout_ PWORD_CURSOR Cursor
+    )
+{
+    PWORD_ENTRY WordEntry;
+    PWORD_TABLE_ENTRY WordTableEntry;
+
+    if (Cursor->InlineWordEntry) {
+        WordEntry = Cursor->InlineWordEntry;
+        Cursor->InlineWordEntry = NULL;
+        return WordEntry;
+    }
+
+    if (!Cursor->Avl) {
+        return NULL;
+    }
+
+    WordTableEntry = (PWORD_TABLE_ENTRY)(
+        Context->EnumerateTable(Cursor->Avl, &Cursor->RestartKey)
+    );
+
+    return (WordTableEntry ? &WordTableEntry->WordEntry : NULL);
+}
+
+FORCEINLINE
+RTL_GENERIC_COMPARE_RESULTS
+CompareWordEntries(
+    _In_opt_ PWORD_ENTRY Left,
+    _In_opt_ PWORD_ENTRY Right
+    )
+/*++
+
+Routine Description:
+
+    Compares two word entries in word table order (hash, length, then bytes).
+    An exhausted (NULL) side compares greater than any word, such that the
+    remaining words of the other side are visited first.
+
+--*/
+{
+    PCLONG_STRING LeftString;
+    PCLONG_STRING RightString;
+
+    if (!Right) {
+        return GenericLessThan;
+    } else if (!Left) {
+        return GenericGreaterThan;
+    }
+
+    LeftString = &Left->String;
+    RightString = &Right->String;
+
+    if (LeftString->Hash != RightString->Hash) {
+        return (LeftString->Hash < RightString->Hash ?
+                GenericLessThan : GenericGreaterThan);
+    }
+
+    if (LeftString->Length != RightString->Length) {
+        return (LeftString->Length < RightString->Length ?
+                GenericLessThan : GenericGreaterThan);
+    }
+
+    return CompareWords(LeftString, RightString);
+}
+
+FORCEINLINE
+RTL_GENERIC_COMPARE_RESULTS
+CompareTableEntries(
+    _In_opt_ PVOID Left,
+    _In_opt_ PVOID Right
+    )
+/*++
+
+Routine Description:
+
+    Compares two bitmap or histogram table entries by hash.  An exhausted
+    (NULL) side compares greater than any entry.
+
+--*/
+{
+    ULONG LeftHash;
+    ULONG RightHash;
+
+    if (!Right) {
+        return GenericLessThan;
+    } else if (!Left) {
+        return GenericGreaterThan;
+    }
+
+    LeftHash = TABLE_ENTRY_TO_HEADER(Left)->Hash;
+    RightHash = TABLE_ENTRY_TO_HEADER(Right)->Hash;
+
+    if (LeftHash == RightHash) {
+        return GenericEqual;
+    }
+
+    return (LeftHash < RightHash ? GenericLessThan : GenericGreaterThan);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOLEAN
+CombineWord(
+    _In_ PSET_OPERATION_CONTEXT Context,
+    _In_ PWORD_ENTRY WordEntry,
+    _In_ LONGLONG LeftCount,
+    _In_ LONGLONG RightCount
+    )
+/*++
+
+Routine Description:
+
+    Calculates the entry count of a word for the operation, and adds the word
+    to the destination dictionary with that count if it's greater than zero.
+    Words whose lengths are outside of the destination dictionary's minimum
+    and maximum word lengths are ignored.
+
+--*/
+{
+    ULONG Length;
+    LONGLONG Count;
+    LONGLONG EntryCount;
+    PDICTIONARY Destination;
+    PCWORD_ENTRY NewWordEntry;
+
+    switch (Context->Operation) {
+        case SetOperationIntersect:
+            Count = min(LeftCount, RightCount);
+            break;
+        case SetOperationDifference:
+            Count = LeftCount - RightCount;
+            break;
+        default:
+            Count = LeftCount + RightCount;
+            break;
+    }
+
+    if (Count <= 0) {
+        return TRUE;
+    }
+
+    Destination = Context->Destination;
+    Length = WordEntry->String.Length;
+
+    if (Length < Destination->MinimumWordLength ||
+        Length > Destination->MaximumWordLength) {
+        return TRUE;
+    }
+
+    return AddWordEntry(Destination,
+                        WordEntry->String.Buffer,
+                        Length,
+                        Count,
+                        &NewWordEntry,
+                        &EntryCount);
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CombineTables(
+    PSET_OPERATION_CONTEXT Context,
+    PRTL_AVL_TABLE LeftTable,
+    PRTL_AVL_TABLE RightTable,
+    PCOMBINE_TABLE_ENTRIES CombineEntries
+    )
+/*++
+
+Routine Description:
+
+    Walks two bitmap tables, or two histogram tables, in lockstep, invoking
+    the supplied routine for each hash present in either table (with a NULL
+    entry for the side it's absent from).
+
+--*/
+{
+    PVOID LeftEntry;
+    PVOID RightEntry;
+    PVOID LeftRestartKey;
+    PVOID RightRestartKey;
+    RTL_GENERIC_COMPARE_RESULTS Result;
+    PRTL_ENUMERATE_GENERIC_TABLE_WITHOUT_SPLAYING_AVL EnumerateTable;
+
+    if (!ShouldCombine(Context,
+                       (BOOLEAN)(LeftTable != NULL),
+                       (BOOLEAN)(RightTable != NULL))) {
+        return TRUE;
+    }
+
+    EnumerateTable = Context->EnumerateTable;
+    LeftRestartKey = NULL;
+    RightRestartKey = NULL;
+    LeftEntry = NULL;
+    RightEntry = NULL;
+
+    if (LeftTable) {
+        LeftEntry = EnumerateTable(LeftTable, &LeftRestartKey);
+    }
+
+    if (RightTable) {
+        RightEntry = EnumerateTable(RightTable, &RightRestartKey);
+    }
+
+    while (LeftEntry || RightEntry) {
+
+        Result = CompareTableEntries(LeftEntry, RightEntry);
+
+        if (Result == GenericLessThan) {
+
+            if (ShouldCombine(Context, TRUE, FALSE)) {
+                if (!CombineEntries(Context, LeftEntry, NULL)) {
+                    return FALSE;
+                }
+            }
+
+            LeftEntry = EnumerateTable(LeftTable, &LeftRestartKey);
+
+        } else if (Result == GenericGreaterThan) {
+
+            if (ShouldCombine(Context, FALSE, TRUE)) {
+                if (!CombineEntries(Context, NULL, RightEntry)) {
+                    return FALSE;
+                }
+            }
+
+            RightEntry = EnumerateTable(RightTable, &RightRestartKey);
+
+        } else {
+
+            if (!CombineEntries(Context, LeftEntry, RightEntry)) {
+                return FALSE;
+            }
+
+            LeftEntry = EnumerateTable(LeftTable, &LeftRestartKey);
+            RightEntry = EnumerateTable(RightTable, &RightRestartKey);
+        }
+    }
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CombineBitmapTableEntries(
+    PSET_OPERATION_CONTEXT Context,
+    PVOID LeftEntry,
+    PVOID RightEntry
+    )
+{
+    PRTL_AVL_TABLE LeftTable;
+    PRTL_AVL_TABLE RightTable;
+
+    LeftTable = NULL;
+    RightTable = NULL;
+
+    if (LeftEntry) {
+        LeftTable = &((PBITMAP_TABLE_ENTRY)LeftEntry)->HistogramTable.Avl;
+    }
+
+    if (RightEntry) {
+        RightTable = &((PBITMAP_TABLE_ENTRY)RightEntry)->HistogramTable.Avl;
+    }
+
+    return CombineTables(Context,
+                         LeftTable,
+                         RightTable,
+                         CombineHistogramTableEntries);
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CombineHistogramTableEntries(
+    PSET_OPERATION_CONTEXT Context,
+    PVOID LeftEntry,
+    PVOID RightEntry
+    )
+{
+    PWORD_ENTRY LeftWordEntry;
+    PWORD_ENTRY RightWordEntry;
+    WORD_CURSOR LeftCursor;
+    WORD_CURSOR RightCursor;
+    RTL_GENERIC_COMPARE_RESULTS Result;
+
+    InitializeWordCursor(&LeftCursor, (PHISTOGRAM_TABLE_ENTRY)LeftEntry);
+    InitializeWordCursor(&RightCursor, (PHISTOGRAM_TABLE_ENTRY)RightEntry);
+
+    LeftWordEntry = NextWordEntry(Context, &LeftCursor);
+    RightWordEntry = NextWordEntry(Context, &RightCursor);
+
+    while (LeftWordEntry || RightWordEntry) {
+
+        Result = CompareWordEntries(LeftWordEntry, RightWordEntry);
+
+        if (Result == GenericLessThan) {
+
+            if (!CombineWord(Context,
+                             LeftWordEntry,
+                             LeftWordEntry->Stats.EntryCount,
+                             0)) {
+                return FALSE;
+            }
+
+            LeftWordEntry = NextWordEntry(Context, &LeftCursor);
+
+        } else if (Result == GenericGreaterThan) {
+
+            if (!CombineWord(Context,
+                             RightWordEntry,
+                             0,
+                             RightWordEntry->Stats.EntryCount)) {
+                return FALSE;
+            }
+
+            RightWordEntry = NextWordEntry(Context, &RightCursor);
+
+        } else {
+
+            if (!CombineWord(Context,
+                             LeftWordEntry,
+                             LeftWordEntry->Stats.EntryCount,
+                             RightWordEntry->Stats.EntryCount)) {
+                return FALSE;
+            }
+
+            LeftWordEntry = NextWordEntry(Context, &LeftCursor);
+            RightWordEntry = NextWordEntry(Context, &RightCursor);
+        }
+    }
+
+    return TRUE;
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOLEAN
+CombineDictionaries(
+    _In_ SET_OPERATION Operation,
+    _In_ PDICTIONARY Destination,
+    _In_ PDICTIONARY Left,
+    _In_ PDICTIONARY Right
+    )
+/*++
+
+Routine Description:
+
+    Performs a set operation over two source dictionaries, adding the results
+    to the destination dictionary.  The sources are locked shared and the
+    destination is locked exclusive for the duration of the operation.
+
+    The locks are acquired in ascending order of dictionary address,
+    regardless of each dictionary's role, such that concurrent operations
+    over overlapping dictionaries can't deadlock (e.g. a merge into X from Y
+    racing with a merge into Y from X).
+
+Arguments:
+
+    Operation - Supplies the operation to perform.
+
+    Destination - Supplies a pointer to the DICTIONARY structure that receives
+        the results.  Must be distinct from the sources.
+
+    Left - Supplies a pointer to the left source DICTIONARY structure.
+
+    Right - Supplies a pointer to the right source DICTIONARY structure.  May
+        be the same as the left source.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if any of the
+    dictionaries have been frozen, or if a write-ahead log is open for the
+    destination and the results could not be written to it.  If an error
+    occurs part way through, the destination will contain the results produced
+    prior to the failure.
+
+--*/
+{
+    ULONG Slot;
+    ULONG Index;
+    ULONG Count;
+    BOOLEAN Success;
+    ULONGLONG Sequence;
+    PDICTIONARY_LOG Log;
+    PDICTIONARY Dictionary;
+    PDICTIONARY Dictionaries[3];
+    SET_OPERATION_CONTEXT Context;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Destination)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Left)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Right)) {
+        return FALSE;
+    }
+
+    if (Destination == Left || Destination == Right) {
+        return FALSE;
+    }
+
+    //
+    // Sort the distinct dictionaries by address.  (SRW locks can't be
+    // acquired recursively, even when shared, so the right source is only
+    // included if it's distinct.)
+    //
+
+    Count = 0;
+    Dictionaries[Count++] = Destination;
+    Dictionaries[Count++] = Left;
+
+    if (Right != Left) {
+        Dictionaries[Count++] = Right;
+    }
+
+    for (Index = 1; Index < Count; Index++) {
+        Dictionary = Dictionaries[Index];
+        for (Slot = Index; Slot > 0; Slot--) {
+            if (Dictionaries[Slot - 1] < Dictionary) {
+                break;
+            }
+            Dictionaries[Slot] = Dictionaries[Slot - 1];
+        }
+        Dictionaries[Slot] = Dictionary;
+    }
+
+    //
+    // Acquire the locks in that order; the destination exclusive, and the
+    // sources shared.
+    //
+
+    for (Index = 0; Index < Count; Index++) {
+        Dictionary = Dictionaries[Index];
+        if (Dictionary == Destination) {
+            AcquireDictionaryLockExclusive(&Dictionary->Lock);
+        } else {
+            AcquireDictionaryLockShared(&Dictionary->Lock);
+        }
+    }
+
+    Log = BeginDictionaryLogOperation(Destination, &Sequence);
+
+    //
+    // Frozen dictionaries release their tables, so they can't be used as
+    // sources, and can't be modified.
+    //
+
+    if (Left->Flags.IsFrozen ||
+        Right->Flags.IsFrozen ||
+        Destination->Flags.IsFrozen) {
+        Success = FALSE;
+        goto End;
+    }
+
+    Context.Operation = Operation;
+    Context.Destination = Destination;
+    Context.EnumerateTable =
+        Destination->Rtl->RtlEnumerateGenericTableWithoutSplayingAvl;
+
+    Success = CombineTables(&Context,
+                            &Left->BitmapTable.Avl,
+                            &Right->BitmapTable.Avl,
+                            CombineBitmapTableEntries);
+
+End:
+
+    Sequence = EndDictionaryLogOperation(Log, Sequence);
+
+    for (Index = Count; Index > 0; Index--) {
+        Dictionary = Dictionaries[Index - 1];
+        if (Dictionary == Destination) {
+            ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+        } else {
+            ReleaseDictionaryLockShared(&Dictionary->Lock);
+        }
+    }
+
+    //
+    // If a write-ahead log is open for the destination, wait for the results
+    // to become durable.
+    //
+
+    if (Log && !WaitForDictionaryLog(Log, Sequence)) {
+        Success = FALSE;
+    }
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+MergeDictionaries(
+    PDICTIONARY Destination,
+    PDICTIONARY Left,
+    PDICTIONARY Right
+    )
+/*++
+
+Routine Description:
+
+    Adds every word in either of two source dictionaries to a destination
+    dictionary.  The entry count of each word added is the sum of its entry
+    counts in the sources.
+
+Arguments:
+
+    Destination - Supplies a pointer to the DICTIONARY structure that receives
+        the merged words.  If the destination already contains a word, its
+        entry count is increased accordingly.  Must be distinct from the
+        sources.
+
+    Left - Supplies a pointer to the first source DICTIONARY structure.
+
+    Right - Supplies a pointer to the second source DICTIONARY structure.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if any of the
+    dictionaries have been frozen.
+
+--*/
+{
+    return CombineDictionaries(SetOperationMerge, Destination, Left, Right);
+}
+
+_Use_decl_annotations_
+BOOLEAN
+IntersectDictionaries(
+    PDICTIONARY Destination,
+    PDICTIONARY Left,
+    PDICTIONARY Right
+    )
+/*++
+
+Routine Description:
+
+    Adds every word present in both of two source dictionaries to a
+    destination dictionary.  The entry count of each word added is the lesser
+    of its entry counts in the sources.
+
+Arguments:
+
+    Destination - Supplies a pointer to the DICTIONARY structure that receives
+        the common words.  If the destination already contains a word, its
+        entry count is increased accordingly.  Must be distinct from the
+        sources.
+
+    Left - Supplies a pointer to the first source DICTIONARY structure.
+
+    Right - Supplies a pointer to the second source DICTIONARY structure.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if any of the
+    dictionaries have been frozen.
+
+--*/
+{
+    return CombineDictionaries(SetOperationIntersect, Destination, Left, Right);
+}
+
+_Use_decl_annotations_
+BOOLEAN
+DiffDictionaries(
+    PDICTIONARY Destination,
+    PDICTIONARY Left,
+    PDICTIONARY Right
+    )
+/*++
+
+Routine Description:
+
+    Adds every word whose entry count in the left source dictionary exceeds
+    its entry count in the right source dictionary (zero if absent) to a
+    destination dictionary.  The entry count of each word added is the
+    difference between the two.
+
+Arguments:
+
+    Destination - Supplies a pointer to the DICTIONARY structure that receives
+        the difference.  If the destination already contains a word, its
+        entry count is increased accordingly.  Must be distinct from the
+        sources.
+
+    Left - Supplies a pointer to the DICTIONARY structure from which words are
+        taken.
+
+    Right - Supplies a pointer to the DICTIONARY structure whose words are
+        subtracted.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if any of the
+    dictionaries have been frozen.
+
+--*/
+{
+    return CombineDictionaries(SetOperationDifference,
+                               Destination,
+                               Left,
+                               Right);
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
@@ -0,0 +1,972 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    SimilarWords.c
+
+Abstract:
+
+    This module implements the "did you mean" functionality of the dictionary
+    component.  The public GetSimilarWords() routine returns the words within
+    a given Levenshtein (edit) distance of a query word.
+
+    Candidates are drawn from the length table (or the length-ordered word
+    index of a frozen dictionary), as words whose lengths differ by more than
+    the maximum distance can't possibly qualify.  Candidates are then pruned
+    by comparing character bitmaps: every distinct character present in one
+    word but not the other requires at least one edit.  Survivors are verified
+    by Myers' bit-parallel edit distance algorithm, four candidates at a time,
+    one per 64-bit lane of a YMM register.
+
+--*/
+
+#include "stdafx.h"
+
+//
+// Define the number of candidates verified by a single invocation of the
+// bit-parallel edit distance kernel (one per 64-bit lane of a YMM register),
+// and the maximum query length supported by the kernel (the number of bits
+// in a lane).  Longer queries are verified by a banded dynamic programming
+// routine instead.
+//
+
+#define SIMILAR_WORDS_BATCH_SIZE 4
+#define SIMILAR_WORDS_MAXIMUM_BIT_PARALLEL_LENGTH 64
+
+//
+// Define the similar word structure, which captures a word entry that has
+// been verified as being within the maximum distance of the query.
+//
+
+typedef struct _SIMILAR_WORD {
+    PCWORD_ENTRY WordEntry;
+    ULONG Distance;
+    ULONG Padding;
+} SIMILAR_WORD;
+typedef SIMILAR_WORD *PSIMILAR_WORD;
+
+//
+// Define the search structure used to track the state of GetSimilarWords().
+//
+
+typedef struct _SIMILAR_WORDS_SEARCH {
+
+    //
+    // Bitmap of the query word's characters.
+    //
+
+    CHARACTER_BITMAP QueryBitmap;
+
+    //
+    // The query word.
+    //
+
+    PCLONG_STRING Query;
+
+    //
+    // Current maximum distance.  This starts out as the caller's maximum
+    // distance, and is lowered to the distance of the worst word found so
+    // far once MaximumNumberOfWords words have been found.
+    //
+
+    ULONG MaximumDistance;
+
+    //
+    // Capacity and number of elements of the Words array.
+    //
+
+    ULONG MaximumNumberOfWords;
+    ULONG NumberOfWords;
+
+    //
+    // Number of candidates pending verification by the kernel.
+    //
+
+    ULONG NumberOfCandidates;
+
+    //
+    // Words found so far, ordered by ascending distance, then by descending
+    // entry count.
+    //
+
+    PSIMILAR_WORD Words;
+
+    //
+    // Pair of rows used by the banded edit distance routine for queries that
+    // are too long for the bit-parallel kernel.  NULL otherwise.
+    //
+
+    PULONG Rows;
+
+    //
+    // Candidates pending verification by the kernel.
+    //
+
+    PCWORD_ENTRY Candidates[SIMILAR_WORDS_BATCH_SIZE];
+
+    //
+    // Bit-parallel pattern masks of the query word: bit i of the mask for a
+    // given character is set if the query has that character at offset i.
+    //
+
+    ULONGLONG PatternMasks[NUMBER_OF_CHARACTER_BITS];
+
+} SIMILAR_WORDS_SEARCH;
+typedef SIMILAR_WORDS_SEARCH *PSIMILAR_WORDS_SEARCH;
+
+FORCEINLINE
+BOOLEAN
+IsSimilarWordCandidate(
+    _In_ PSIMILAR_WORDS_SEARCH Search,
+    _In_ PCLONG_STRING String
+    )
+/*++
+
+Routine Description:
+
+    Determines whether or not a candidate word could be within the current
+    maximum distance of the query word, based on its length and the distinct
+    characters it contains.  A substitution can remove at most one distinct
+    character and introduce at most one other, so the number of characters
+    missing from either word is a lower bound on the edit distance.
+
+--*/
+{
+    BYTE Byte;
+    LONG Query;
+    LONG Candidate;
+    ULONG Index;
+    ULONG Difference;
+    ULONG Missing;
+    ULONG Extra;
+    PLONG Bits;
+    PCBYTE Buffer;
+    CHARACTER_BITMAP Bitmap;
+
+    if (String->Length > Search->Query->Length) {
+        Difference = String->Length - Search->Query->Length;
+    } else {
+        Difference = Search->Query->Length - String->Length;
+    }
+
+    if (Difference > Search->MaximumDistance) {
+        return FALSE;
+    }
+
+    ZeroStruct(Bitmap);
+
+    Bits = (PLONG)&Bitmap.Bits;
+    Buffer = (PCBYTE)String->Buffer;
+
+    for (Index = 0; Index < String->Length; Index++) {
+        Byte = Buffer[Index];
+        BitTestAndSet(Bits, Byte);
+    }
+
+    Missing = 0;
+    Extra = 0;
+
+    for (Index = 0; Index < ARRAYSIZE(Bitmap.Bits); Index++) {
+        Query = Search->QueryBitmap.Bits[Index];
+        Candidate = Bitmap.Bits[Index];
+        Missing += PopulationCount32((ULONG)(Query & ~Candidate));
+        Extra += PopulationCount32((ULONG)(Candidate & ~Query));
+    }
+
+    return (max(Missing, Extra) <= Search->MaximumDistance);
+}
+
+FORCEINLINE
+VOID
+CalculateEditDistancesAvx2(
+    _In_ PSIMILAR_WORDS_SEARCH Search,
+    _Out_writes_(SIMILAR_WORDS_BATCH_SIZE) PULONGLONG Distances
+    )
+/*++
+
+Routine Description:
+
+    Calculates the edit distance between the query word and each pending
+    candidate using Myers' bit-parallel algorithm, with each candidate being
+    processed in its own 64-bit lane.  Lanes without a candidate (or whose
+    candidate has been exhausted) are masked out of the score updates.
+
+    N.B. The query length must not exceed 64 characters.
+
+--*/
+{
+    ULONG Lane;
+    ULONG Index;
+    ULONG MaximumLength;
+    ULONG Lengths[SIMILAR_WORDS_BATCH_SIZE];
+    PCBYTE Buffers[SIMILAR_WORDS_BATCH_SIZE];
+    PCLONG_STRING String;
+    PULONGLONG PatternMasks;
+    DECLSPEC_ALIGN(32) ULONGLONG Masks[SIMILAR_WORDS_BATCH_SIZE];
+
+    YMMWORD Eq;
+    YMMWORD Pv;
+    YMMWORD Mv;
+    YMMWORD Xv;
+    YMMWORD Xh;
+    YMMWORD Ph;
+    YMMWORD Mh;
+    YMMWORD One;
+    YMMWORD Score;
+    YMMWORD Active;
+    YMMWORD AllOnes;
+    YMMWORD HighBit;
+    YMMWORD Position;
+    YMMWORD LaneLengths;
+
+    ASSERT(Search->Query->Length <= SIMILAR_WORDS_MAXIMUM_BIT_PARALLEL_LENGTH);
+
+    MaximumLength = 0;
+    PatternMasks = Search->PatternMasks;
+
+    for (Lane = 0; Lane < SIMILAR_WORDS_BATCH_SIZE; Lane++) {
+
+        if (Lane < Search->NumberOfCandidates) {
+            String = &Search->Candidates[Lane]->String;
+            Lengths[Lane] = String->Length;
+            Buffers[Lane] = (PCBYTE)String->Buffer;
+        } else {
+            Lengths[Lane] = 0;
+            Buffers[Lane] = NULL;
+        }
+
+        MaximumLength = max(MaximumLength, Lengths[Lane]);
+    }
+
+    //
+    // Initialize the vertical deltas to +1 (i.e. column zero of the dynamic
+    // programming matrix is 0, 1, 2, ..., m), and the scores to the length
+    // of the query.
+    //
+
+    One = _mm256_set1_epi64x(1);
+    AllOnes = _mm256_set1_epi64x(-1);
+    HighBit = _mm256_set1_epi64x(1ULL << (Search->Query->Length - 1));
+    Score = _mm256_set1_epi64x(Search->Query->Length);
+    Position = _mm256_setzero_si256();
+    LaneLengths = _mm256_set_epi64x(Lengths[3],
+                                    Lengths[2],
+                                    Lengths[1],
+                                    Lengths[0]);
+
+    Pv = AllOnes;
+    Mv = _mm256_setzero_si256();
+
+    for (Index = 0; Index < MaximumLength; Index++) {
+
+        //
+        // Gather the pattern mask for each lane's next character.
+        //
+
+        for (Lane = 0; Lane < SIMILAR_WORDS_BATCH_SIZE; Lane++) {
+            Masks[Lane] = (
+                Index < Lengths[Lane] ?
+                PatternMasks[Buffers[Lane][Index]] :
+                0
+            );
+        }
+
+        Eq = _mm256_load_si256((PYMMWORD)Masks);
+        Active = _mm256_cmpgt_epi64(LaneLengths, Position);
+        Position = _mm256_add_epi64(Position, One);
+
+        //
+        // Compute the horizontal deltas of this column.
+        //
+
+        Xv = _mm256_or_si256(Eq, Mv);
+        Xh = _mm256_and_si256(Eq, Pv);
+        Xh = _mm256_add_epi64(Xh, Pv);
+        Xh = _mm256_xor_si256(Xh, Pv);
+        Xh = _mm256_or_si256(Xh, Eq);
+        Ph = _mm256_andnot_si256(_mm256_or_si256(Xh, Pv), AllOnes);
+        Ph = _mm256_or_si256(Ph, Mv);
+        Mh = _mm256_and_si256(Pv, Xh);
+
+        //
+        // Update the score of each active lane based on the horizontal delta
+        // of the last row.  (The comparisons yield -1 where true.)
+        //
+
+        Score = _mm256_sub_epi64(
+            Score,
+            _mm256_and_si256(
+                _mm256_cmpeq_epi64(_mm256_and_si256(Ph, HighBit), HighBit),
+                Active
+            )
+        );
+
+        Score = _mm256_add_epi64(
+            Score,
+            _mm256_and_si256(
+                _mm256_cmpeq_epi64(_mm256_and_si256(Mh, HighBit), HighBit),
+                Active
+            )
+        );
+
+        //
+        // Compute the vertical deltas of the next column.  Row zero of the
+        // matrix is 0, 1, 2, ..., n, so a +1 horizontal delta is shifted in.
+        //
+
+        Ph = _mm256_or_si256(_mm256_slli_epi64(Ph, 1), One);
+        Mh = _mm256_slli_epi64(Mh, 1);
+        Pv = _mm256_andnot_si256(_mm256_or_si256(Xv, Ph), AllOnes);
+        Pv = _mm256_or_si256(Pv, Mh);
+        Mv = _mm256_and_si256(Ph, Xv);
+    }
+
+    _mm256_storeu_si256((PYMMWORD)Distances, Score);
+}
+
+FORCEINLINE
+ULONG
+CalculateEditDistanceBanded(
+    _In_ PSIMILAR_WORDS_SEARCH Search,
+    _In_ PCLONG_STRING String
+    )
+/*++
+
+Routine Description:
+
+    Calculates the edit distance between the query word and a candidate using
+    the classic dynamic programming algorithm, restricted to the diagonal band
+    of cells within the current maximum distance.  This is used for queries
+    that are too long for the bit-parallel kernel.
+
+Return Value:
+
+    The edit distance if it is less than or equal to the current maximum
+    distance, otherwise, the current maximum distance plus one.
+
+--*/
+{
+    ULONG Low;
+    ULONG High;
+    ULONG Cost;
+    ULONG Value;
+    ULONG Index;
+    ULONG Column;
+    ULONG Infinity;
+    ULONG Distance;
+    ULONG RowMinimum;
+    ULONG QueryLength;
+    PULONG Previous;
+    PULONG Current;
+    PULONG Temp;
+    PCBYTE Query;
+    PCBYTE Buffer;
+
+    Distance = Search->MaximumDistance;
+    Infinity = Distance + 1;
+
+    Query = (PCBYTE)Search->Query->Buffer;
+    QueryLength = Search->Query->Length;
+    Buffer = (PCBYTE)String->Buffer;
+
+    //
+    // If the candidate is too short, the last cell of the matrix lies beyond
+    // the band.
+    //
+
+    if (QueryLength > String->Length + Distance) {
+        return Infinity;
+    }
+
+    Previous = Search->Rows;
+    Current = Previous + QueryLength + 1;
+
+    for (Index = 0; Index <= QueryLength; Index++) {
+        Previous[Index] = min(Index, Infinity);
+    }
+
+    for (Column = 1; Column <= String->Length; Column++) {
+
+        Low = (Column > Distance ? Column - Distance : 1);
+        High = min(QueryLength, Column + Distance);
+
+        Current[0] = min(Column, Infinity);
+        RowMinimum = Current[0];
+
+        if (Low > 1) {
+            Current[Low - 1] = Infinity;
+        }
+
+        for (Index = Low; Index <= High; Index++) {
+            Cost = (Query[Index - 1] != Buffer[Column - 1]);
+            Value = Previous[Index - 1] + Cost;
+            Value = min(Value, Previous[Index] + 1);
+            Value = min(Value, Current[Index - 1] + 1);
+            Current[Index] = min(Value, Infinity);
+            RowMinimum = min(RowMinimum, Current[Index]);
+        }
+
+        if (High < QueryLength) {
+            Current[High + 1] = Infinity;
+        }
+
+        if (RowMinimum > Distance) {
+            return Infinity;
+        }
+
+        Temp = Previous;
+        Previous = Current;
+        Current = Temp;
+    }
+
+    return Previous[QueryLength];
+}
+
+FORCEINLINE
+BOOLEAN
+IsBetterSimilarWord(
+    _In_ ULONG Distance,
+    _In_ PCWORD_ENTRY WordEntry,
+    _In_ PSIMILAR_WORD Word
+    )
+{
+    if (Distance != Word->Distance) {
+        return (Distance < Word->Distance);
+    }
+
+    return (WordEntry->Stats.EntryCount > Word->WordEntry->Stats.EntryCount);
+}
+
+FORCEINLINE
+VOID
+AddSimilarWord(
+    _In_ PSIMILAR_WORDS_SEARCH Search,
+    _In_ PCWORD_ENTRY WordEntry,
+    _In_ ULONG Distance
+    )
+/*++
+
+Routine Description:
+
+    Adds a verified word to the search's array of words, which is kept in
+    ascending order of distance, then descending order of entry count.  If
+    the array is full, the word displaces the worst word if it is better, and
+    the current maximum distance is lowered to that of the new worst word.
+
+--*/
+{
+    ULONG Index;
+    PSIMILAR_WORD Word;
+
+    if (Distance > Search->MaximumDistance) {
+        return;
+    }
+
+    Index = Search->NumberOfWords;
+
+    if (Index == Search->MaximumNumberOfWords) {
+
+        Word = &Search->Words[Index - 1];
+
+        if (!IsBetterSimilarWord(Distance, WordEntry, Word)) {
+            return;
+        }
+
+        Index--;
+
+    } else {
+
+        Search->NumberOfWords++;
+    }
+
+    //
+    // Shift worse words along until we find our slot.
+    //
+
+    while (Index > 0) {
+
+        Word = &Search->Words[Index - 1];
+
+        if (!IsBetterSimilarWord(Distance, WordEntry, Word)) {
+            break;
+        }
+
+        Search->Words[Index] = *Word;
+        Index--;
+    }
+
+    Word = &Search->Words[Index];
+    Word->WordEntry = WordEntry;
+    Word->Distance = Distance;
+
+    if (Search->NumberOfWords == Search->MaximumNumberOfWords) {
+        Word = &Search->Words[Search->NumberOfWords - 1];
+        Search->MaximumDistance = Word->Distance;
+    }
+}
+
+FORCEINLINE
+VOID
+FlushSimilarWordCandidates(
+    _In_ PSIMILAR_WORDS_SEARCH Search
+    )
+/*++
+
+Routine Description:
+
+    Verifies all pending candidates and adds those within the current maximum
+    distance to the search's words.
+
+--*/
+{
+    ULONG Lane;
+    DECLSPEC_ALIGN(32) ULONGLONG Distances[SIMILAR_WORDS_BATCH_SIZE];
+
+    if (Search->NumberOfCandidates == 0) {
+        return;
+    }
+
+    CalculateEditDistancesAvx2(Search, Distances);
+
+    for (Lane = 0; Lane < Search->NumberOfCandidates; Lane++) {
+        AddSimilarWord(Search,
+                       Search->Candidates[Lane],
+                       (ULONG)Distances[Lane]);
+    }
+
+    Search->NumberOfCandidates = 0;
+}
+
+FORCEINLINE
+VOID
+ProcessSimilarWordCandidate(
+    _In_ PSIMILAR_WORDS_SEARCH Search,
+    _In_ PCWORD_ENTRY WordEntry
+    )
+{
+    ULONG Distance;
+
+    if (!IsSimilarWordCandidate(Search, &WordEntry->String)) {
+        return;
+    }
+
+    if (Search->Rows) {
+        Distance = CalculateEditDistanceBanded(Search, &WordEntry->String);
+        AddSimilarWord(Search, WordEntry, Distance);
+        return;
+    }
+
+    Search->Candidates[Search->NumberOfCandidates++] = WordEntry;
+
+    if (Search->NumberOfCandidates == SIMILAR_WORDS_BATCH_SIZE) {
+        FlushSimilarWordCandidates(Search);
+    }
+}
+
+_Use_decl_annotations_
+BOOLEAN
+GetSimilarWords(
+    PDICTIONARY Dictionary,
+    PALLOCATOR Allocator,
+    PCBYTE Word,
+    ULONG MaximumDistance,
+    ULONG MaximumNumberOfWords,
+    PLINKED_WORD_LIST *LinkedWordListPointer
+    )
+/*++
+
+Routine Description:
+
+    Constructs a list of the words in the dictionary within a given edit
+    (Levenshtein) distance of a word, ordered by ascending distance, then by
+    descending entry count.  The word itself is included in the list if it
+    is present in the dictionary.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to a DICTIONARY structure for which the
+        similar words are to be retrieved.
+
+    Allocator - Supplies a pointer to an ALLOCATOR structure that will be used
+        to allocate the memory that backs the address returned via the param
+        LinkedWordListPointer and all associated LINKED_WORD_ENTRY items, as
+        well as any temporary memory required by the search.
+
+    Word - Supplies a NULL-terminated array of bytes representing the word for
+        which similar words are to be found.  The word does not need to exist
+        in the dictionary.
+
+    MaximumDistance - Supplies the maximum edit distance (number of single
+        character insertions, deletions or substitutions) between the word
+        and a similar word.
+
+    MaximumNumberOfWords - Supplies the maximum number of words to return.
+        Must be greater than zero.
+
+    LinkedWordListPointer - Supplies the address of a variable that receives
+        the address of a LINKED_WORD_LIST structure (allocated via Allocator)
+        if at least one similar word was found.  If there are no such words,
+        a NULL pointer is returned.  The pointer must be freed via the
+        Allocator once the user has finished with the structure.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    BYTE Byte;
+    PBYTE Buffer;
+    PBYTE StructBuffer;
+    PBYTE StringBuffer;
+    ULONG Index;
+    ULONG Offset;
+    ULONG Length;
+    ULONG Lengths[2];
+    ULONG LengthIndex;
+    ULONG LongestLength;
+    ULONG BitmapHash;
+    ULONG HistogramHash;
+    ULONG NumberOfLengths;
+    BOOLEAN Success;
+    LONG_STRING Query;
+    PLIST_ENTRY ListHead;
+    PLIST_ENTRY ListEntry;
+    PLONG_STRING NewString;
+    PCLONG_STRING String;
+    PWORD_ENTRY NewWordEntry;
+    PCWORD_ENTRY WordEntry;
+    PLENGTH_TABLE LengthTable;
+    PLENGTH_TABLE_ENTRY LengthTableEntry;
+    PWORD_TABLE_ENTRY WordTableEntry;
+    PFROZEN_DICTIONARY Frozen;
+    PCFROZEN_LENGTH_ENTRY FrozenLengthEntry;
+    PLINKED_WORD_LIST LinkedWordList;
+    PLINKED_WORD_ENTRY LinkedWordEntry;
+    SIMILAR_WORDS_SEARCH Search;
+    LARGE_INTEGER AllocSize;
+    CHARACTER_HISTOGRAM Histogram;
+    TABLE_ENTRY_HEADER LengthTableEntryHeader;
+    PRTL_LOOKUP_ELEMENT_GENERIC_TABLE_AVL RtlLookupElementGenericTableAvl;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Allocator)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Word)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(LinkedWordListPointer)) {
+        return FALSE;
+    }
+
+    if (MaximumNumberOfWords == 0) {
+        return FALSE;
+    }
+
+    //
+    // The edit distance between two words can't exceed the length of the
+    // longer word.
+    //
+
+    if (MaximumDistance > Dictionary->MaximumWordLength) {
+        MaximumDistance = Dictionary->MaximumWordLength;
+    }
+
+    //
+    // Clear the caller's pointer up-front and zero local structures.
+    //
+
+    *LinkedWordListPointer = NULL;
+
+    ZeroStruct(Query);
+    ZeroStruct(Search);
+    ZeroStruct(LengthTableEntryHeader);
+
+    //
+    // Initialize the query word, which verifies its length and fills out its
+    // bitmap.
+    //
+
+    Success = InitializeWord(Word,
+                             Dictionary->MinimumWordLength,
+                             Dictionary->MaximumWordLength,
+                             &Query,
+                             &Search.QueryBitmap,
+                             &Histogram,
+                             &BitmapHash,
+                             &HistogramHash);
+
+    if (!Success) {
+        return FALSE;
+    }
+
+    //
+    // Initialize the search.  Queries that fit within a 64-bit lane have
+    // their pattern masks calculated for the bit-parallel kernel; longer
+    // queries require a pair of rows for the banded routine.
+    //
+
+    Search.Query = &Query;
+    Search.MaximumDistance = MaximumDistance;
+    Search.MaximumNumberOfWords = MaximumNumberOfWords;
+
+    if (Query.Length <= SIMILAR_WORDS_MAXIMUM_BIT_PARALLEL_LENGTH) {
+
+        for (Index = 0; Index < Query.Length; Index++) {
+            Byte = Query.Buffer[Index];
+            Search.PatternMasks[Byte] |= (1ULL << Index);
+        }
+
+    } else {
+
+        Search.Rows = (PULONG)(
+            Allocator->Calloc(Allocator,
+                              ((SIZE_T)Query.Length + 1) * 2,
+                              sizeof(ULONG))
+        );
+
+        if (!Search.Rows) {
+            return FALSE;
+        }
+    }
+
+    Search.Words = (PSIMILAR_WORD)(
+        Allocator->Calloc(Allocator,
+                          MaximumNumberOfWords,
+                          sizeof(*Search.Words))
+    );
+
+    if (!Search.Words) {
+        Success = FALSE;
+        goto Free;
+    }
+
+    //
+    // Initialize aliases.
+    //
+
+    RtlLookupElementGenericTableAvl = (
+        Dictionary->Rtl->RtlLookupElementGenericTableAvl
+    );
+
+    LengthTable = &Dictionary->LengthTable;
+
+    //
+    // Acquire a shared lock for the duration of this routine.
+    //
+
+    AcquireDictionaryLockShared(&Dictionary->Lock);
+
+    Frozen = NULL;
+
+    if (Dictionary->Flags.IsFrozen) {
+        Frozen = GetLocalFrozenDictionary(Dictionary);
+    }
+
+    if (Dictionary->Stats.CurrentLongestWord) {
+        LongestLength = Dictionary->Stats.CurrentLongestWord->Length;
+    } else {
+        LongestLength = 0;
+    }
+
+    //
+    // Process candidates of each length within the maximum distance of the
+    // query's length, nearest lengths first.  The difference in length is a
+    // lower bound on the edit distance, so we can stop as soon as it exceeds
+    // the current maximum distance (which drops once the array of words is
+    // full).
+    //
+
+    for (Offset = 0; Offset <= Search.MaximumDistance; Offset++) {
+
+        NumberOfLengths = 0;
+
+        if (Offset < Query.Length) {
+            Lengths[NumberOfLengths++] = Query.Length - Offset;
+        }
+
+        if (Offset > 0 && Query.Length + Offset <= LongestLength) {
+            Lengths[NumberOfLengths++] = Query.Length + Offset;
+        }
+
+        if (NumberOfLengths == 0) {
+
+            //
+            // There are no shorter or longer words left to process.
+            //
+
+            break;
+        }
+
+        for (LengthIndex = 0; LengthIndex < NumberOfLengths; LengthIndex++) {
+
+            Length = Lengths[LengthIndex];
+
+            if (Frozen) {
+
+                Index = FindFrozenLengthEntryIndex(Frozen, Length);
+
+                if (Index == Frozen->NumberOfLengths) {
+                    continue;
+                }
+
+                FrozenLengthEntry = &Frozen->LengthEntries[Index];
+
+                if (FrozenLengthEntry->Length != Length) {
+                    continue;
+                }
+
+                for (Index = 0;
+                     Index < FrozenLengthEntry->NumberOfWords;
+                     Index++) {
+
+                    WordEntry = &Frozen->WordEntries[
+                        Frozen->LengthOrderedWords[
+                            FrozenLengthEntry->FirstWord + Index
+                        ]
+                    ];
+
+                    ProcessSimilarWordCandidate(&Search, WordEntry);
+                }
+
+                continue;
+            }
+
+            LengthTableEntryHeader.Length = Length;
+            LengthTableEntry = (PLENGTH_TABLE_ENTRY)(
+                RtlLookupElementGenericTableAvl(
+                    &LengthTable->Avl,
+                    &LengthTableEntryHeader.LengthTableEntry
+                )
+            );
+
+            if (!LengthTableEntry) {
+                continue;
+            }
+
+            ListHead = &LengthTableEntry->LengthListHead;
+
+            for (ListEntry = ListHead->Flink;
+                 ListEntry != ListHead;
+                 ListEntry = ListEntry->Flink) {
+
+                WordTableEntry = CONTAINING_RECORD(ListEntry,
+                                                   WORD_TABLE_ENTRY,
+                                                   LengthListEntry);
+
+                ProcessSimilarWordCandidate(&Search,
+                                            &WordTableEntry->WordEntry);
+            }
+        }
+
+        //
+        // Verify any candidates still pending before the maximum distance is
+        // checked again.
+        //
+
+        FlushSimilarWordCandidates(&Search);
+    }
+
+    if (Search.NumberOfWords == 0) {
+        Success = TRUE;
+        goto End;
+    }
+
+    //
+    // Calculate the allocation size required for the list, entries and
+    // string buffers, then allocate it.
+    //
+
+    AllocSize.QuadPart = (
+        sizeof(LINKED_WORD_LIST) +
+        (sizeof(LINKED_WORD_ENTRY) * Search.NumberOfWords)
+    );
+
+    for (Index = 0; Index < Search.NumberOfWords; Index++) {
+        AllocSize.QuadPart += Search.Words[Index].WordEntry->String.Length + 1;
+    }
+
+    Buffer = (PBYTE)Allocator->Calloc(Allocator, 1, AllocSize.QuadPart);
+    if (!Buffer) {
+        goto Error;
+    }
+
+    LinkedWordList = (PLINKED_WORD_LIST)Buffer;
+    InitializeListHead(&LinkedWordList->ListHead);
+
+    StructBuffer = Buffer + sizeof(LINKED_WORD_LIST);
+    StringBuffer = (
+        StructBuffer +
+        (sizeof(LINKED_WORD_ENTRY) * Search.NumberOfWords)
+    );
+
+    for (Index = 0; Index < Search.NumberOfWords; Index++) {
+
+        WordEntry = Search.Words[Index].WordEntry;
+        String = &WordEntry->String;
+
+        LinkedWordEntry = (PLINKED_WORD_ENTRY)StructBuffer;
+        StructBuffer += sizeof(LINKED_WORD_ENTRY);
+
+        NewWordEntry = &LinkedWordEntry->WordEntry;
+        NewWordEntry->Stats.EntryCount = WordEntry->Stats.EntryCount;
+        NewWordEntry->Stats.MaximumEntryCount =
+            WordEntry->Stats.MaximumEntryCount;
+
+        NewString = &NewWordEntry->String;
+        NewString->Length = String->Length;
+        NewString->Hash = String->Hash;
+        NewString->Buffer = StringBuffer;
+
+        CopyMemory(StringBuffer, String->Buffer, String->Length);
+        StringBuffer += String->Length + 1;
+
+        InsertTailList(&LinkedWordList->ListHead, &LinkedWordEntry->ListEntry);
+        LinkedWordList->NumberOfEntries++;
+    }
+
+    ASSERT(StringBuffer == Buffer + AllocSize.QuadPart);
+
+    *LinkedWordListPointer = LinkedWordList;
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    ReleaseDictionaryLockShared(&Dictionary->Lock);
+
+Free:
+
+    if (Search.Words) {
+        Allocator->FreePointer(Allocator, (PPVOID)&Search.Words);
+    }
+
+    if (Search.Rows) {
+        Allocator->FreePointer(Allocator, (PPVOID)&Search.Rows);
+    }
+
+    return Success;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
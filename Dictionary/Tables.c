@@ -157,6 +157,21 @@ Return Value:
 
 --*/
 {
+    PTABLE_ENTRY_HEADER Header;
+
+    //
+    // If the node was relocated into a compaction arena chunk, release the
+    // node's reference to the chunk instead of freeing it via the allocator.
+    //
+
+    Header = (PTABLE_ENTRY_HEADER)Buffer;
+
+    if (Header->IsArenaNode) {
+        ReleaseArenaChunk(Table->Dictionary,
+                          TABLE_ENTRY_HEADER_TO_ARENA_CHUNK(Header));
+        return;
+    }
+
     Allocator->Free(Allocator, Buffer);
     return;
 }
@@ -0,0 +1,438 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    Tokenizer.c
+
+Abstract:
+
+    This module implements the text tokenizer of the dictionary component.
+    The public AddWordsFromText() routine splits a buffer of raw text into
+    words and adds each one to the dictionary.
+
+    Word boundaries are located 32 bytes at a time: each block of text is
+    classified with AVX2 byte comparisons into a 32-bit mask of word character
+    positions, and the runs of set bits in the mask (i.e. the words) are then
+    walked with bit scans, such that the cost of the scan is proportional to
+    the number of words rather than the number of bytes.  Words are added via
+    their address and length within the text; they are never copied to NULL-
+    terminated buffers.
+
+--*/
+
+#include "stdafx.h"
+
+//
+// Define the tokenizer block size (the number of bytes classified at once),
+// and the number of bytes, in addition to the dictionary's maximum word
+// length, to allocate for the case folding window.
+//
+
+#define TOKENIZER_BLOCK_SIZE 32
+#define TOKENIZER_WINDOW_SIZE (1 << 16)
+
+FORCEINLINE
+ULONG
+ClassifyTextBlockAvx2(
+    _In_ YMMWORD Block,
+    _In_ DICTIONARY_TOKENIZER_FLAGS Flags,
+    _Out_ PYMMWORD FoldedBlock
+    )
+/*++
+
+Routine Description:
+
+    Classifies a block of 32 bytes of text, returning a mask with a bit set
+    for each byte that is a word character, and folds any ASCII upper case
+    letters in the block to lower case.
+
+--*/
+{
+    ULONG Mask;
+    YMMWORD Lower;
+    YMMWORD Digits;
+    YMMWORD Letters;
+    YMMWORD CaseBit;
+
+    //
+    // Setting the case bit (0x20) of an upper case letter yields the lower
+    // case letter, and has no effect on lower case letters, so a single range
+    // check on the result catches both.  Bytes with the high bit set compare
+    // as negative, and thus never fall within the range.
+    //
+
+    CaseBit = _mm256_set1_epi8(0x20);
+    Lower = _mm256_or_si256(Block, CaseBit);
+
+    Letters = _mm256_and_si256(
+        _mm256_cmpgt_epi8(Lower, _mm256_set1_epi8('a' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), Lower)
+    );
+
+    Mask = (ULONG)_mm256_movemask_epi8(Letters);
+
+    if (Flags.IncludeDigits) {
+
+        Digits = _mm256_and_si256(
+            _mm256_cmpgt_epi8(Block, _mm256_set1_epi8('0' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), Block)
+        );
+
+        Mask |= (ULONG)_mm256_movemask_epi8(Digits);
+    }
+
+    if (Flags.IncludeHighBytes) {
+        Mask |= (ULONG)_mm256_movemask_epi8(Block);
+    }
+
+    //
+    // Fold the letters to lower case by setting their case bit.
+    //
+
+    *FoldedBlock = _mm256_or_si256(Block, _mm256_and_si256(Letters, CaseBit));
+
+    return Mask;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+AddWordsFromText(
+    PDICTIONARY Dictionary,
+    PCBYTE Text,
+    SIZE_T SizeInBytes,
+    DICTIONARY_TOKENIZER_FLAGS TokenizerFlags,
+    PULONGLONG NumberOfWordsPointer
+    )
+/*++
+
+Routine Description:
+
+    Splits a buffer of text into words and adds each word to the dictionary,
+    as if AddWord() had been called for each one.  A word is a maximal run of
+    ASCII letters (plus digits and bytes with the high bit set, depending on
+    the tokenizer flags).  Words whose lengths are outside of the minimum and
+    maximum word lengths of the dictionary are ignored.
+
+    The dictionary's exclusive lock is acquired once, and held for the entire
+    duration of this routine.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to a DICTIONARY structure to which the
+        words are to be added.
+
+    Text - Supplies a pointer to the text to tokenize.  The text does not need
+        to be NULL-terminated.
+
+    SizeInBytes - Supplies the size of the text, in bytes.
+
+    TokenizerFlags - Supplies flags that control how the text is tokenized.
+        If FoldCase is set, words are folded to lower case in a window buffer
+        allocated from the dictionary's allocator, sized to the dictionary's
+        maximum word length plus 64KB.  Otherwise, words are added directly
+        from the text.
+
+    NumberOfWordsPointer - Optionally supplies the address of a variable that
+        receives the number of words added to the dictionary.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if the
+    dictionary has been frozen, or if a write-ahead log is open and the
+    additions could not be written to it.  If an error occurs part way through
+    the text, the words preceding the failure will have been added.
+
+--*/
+{
+    ULONG Mask;
+    ULONG Start;
+    ULONG End;
+    ULONG Position;
+    ULONG MinimumWordLength;
+    ULONG MaximumWordLength;
+    LONGLONG EntryCount;
+    BOOLEAN Success;
+    BOOLEAN InWord;
+    PBYTE Window;
+    PCBYTE Bytes;
+    SIZE_T Offset;
+    SIZE_T Remaining;
+    SIZE_T WordStart;
+    SIZE_T WordEnd;
+    SIZE_T WindowBase;
+    SIZE_T WindowSize;
+    SIZE_T Keep;
+    SIZE_T Length;
+    ULONGLONG Bits;
+    ULONGLONG NumberOfWords;
+    ULONGLONG Sequence;
+    PALLOCATOR Allocator;
+    PDICTIONARY_LOG Log;
+    PCWORD_ENTRY WordEntry;
+    YMMWORD Block;
+    YMMWORD FoldedBlock;
+    DECLSPEC_ALIGN(32) BYTE Tail[TOKENIZER_BLOCK_SIZE];
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Text) && SizeInBytes > 0) {
+        return FALSE;
+    }
+
+    if (ARGUMENT_PRESENT(NumberOfWordsPointer)) {
+        *NumberOfWordsPointer = 0;
+    }
+
+    //
+    // Initialize locals.
+    //
+
+    Window = NULL;
+    WindowBase = 0;
+    WindowSize = 0;
+    WordStart = 0;
+    InWord = FALSE;
+    NumberOfWords = 0;
+    Allocator = Dictionary->Allocator;
+
+    //
+    // Obtain an exclusive lock on the dictionary, and capture the write-ahead
+    // log, if any.  Frozen dictionaries can't be modified.
+    //
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+
+    Log = BeginDictionaryLogOperation(Dictionary, &Sequence);
+
+    if (Dictionary->Flags.IsFrozen) {
+        goto Error;
+    }
+
+    MinimumWordLength = Dictionary->MinimumWordLength;
+    MaximumWordLength = Dictionary->MaximumWordLength;
+
+    //
+    // If we're folding case, allocate the window that will receive the folded
+    // text.  The window is large enough to hold the longest possible word plus
+    // a block, which ensures there's always room to retain the current word
+    // when the window needs to be slid forward.
+    //
+
+    if (TokenizerFlags.FoldCase) {
+
+        WindowSize = (
+            ALIGN_UP((SIZE_T)MaximumWordLength + 1, TOKENIZER_BLOCK_SIZE) +
+            TOKENIZER_WINDOW_SIZE
+        );
+
+        Window = (PBYTE)Allocator->Calloc(Allocator, 1, WindowSize);
+        if (!Window) {
+            goto Error;
+        }
+    }
+
+    //
+    // Process the text a block at a time.
+    //
+
+    for (Offset = 0; Offset < SizeInBytes; Offset += TOKENIZER_BLOCK_SIZE) {
+
+        Remaining = SizeInBytes - Offset;
+
+        if (Remaining >= TOKENIZER_BLOCK_SIZE) {
+
+            Block = _mm256_loadu_si256((PYMMWORD)(Text + Offset));
+            Mask = ClassifyTextBlockAvx2(Block, TokenizerFlags, &FoldedBlock);
+
+        } else {
+
+            //
+            // Copy the final partial block into a zeroed buffer such that we
+            // don't read past the end of the text.  (NULL bytes are never
+            // word characters.)
+            //
+
+            ZeroStruct(Tail);
+            CopyMemory(Tail, Text + Offset, Remaining);
+            Block = _mm256_load_si256((PYMMWORD)Tail);
+            Mask = ClassifyTextBlockAvx2(Block, TokenizerFlags, &FoldedBlock);
+        }
+
+        if (Window) {
+
+            //
+            // Slide the window forward if there's no room for this block,
+            // retaining the current word (unless it's already too long to
+            // be added, in which case it'll be ignored when it ends).
+            //
+
+            if (Offset - WindowBase + TOKENIZER_BLOCK_SIZE > WindowSize) {
+
+                Keep = Offset;
+
+                if (InWord && Offset - WordStart <= MaximumWordLength) {
+                    Keep = WordStart;
+                }
+
+                MoveMemory(Window,
+                           Window + (Keep - WindowBase),
+                           Offset - Keep);
+
+                WindowBase = Keep;
+            }
+
+            _mm256_storeu_si256((PYMMWORD)(Window + (Offset - WindowBase)),
+                                FoldedBlock);
+        }
+
+        //
+        // Walk the runs of word characters in the mask.  A sentinel bit is
+        // set above the block in both the mask and its inverse, such that the
+        // bit scans terminate at the end of the block.
+        //
+
+        Bits = (ULONGLONG)Mask;
+        Position = 0;
+
+        while (Position < TOKENIZER_BLOCK_SIZE) {
+
+            if (!InWord) {
+
+                Start = Position + (ULONG)TrailingZeros64(
+                    (Bits | (1ULL << TOKENIZER_BLOCK_SIZE)) >> Position
+                );
+
+                if (Start >= TOKENIZER_BLOCK_SIZE) {
+                    break;
+                }
+
+                WordStart = Offset + Start;
+                InWord = TRUE;
+                Position = Start;
+            }
+
+            End = Position + (ULONG)TrailingZeros64(
+                (~Bits | (1ULL << TOKENIZER_BLOCK_SIZE)) >> Position
+            );
+
+            if (End >= TOKENIZER_BLOCK_SIZE) {
+
+                //
+                // The word continues into the next block.
+                //
+
+                break;
+            }
+
+            WordEnd = Offset + End;
+            InWord = FALSE;
+            Position = End;
+
+            //
+            // Add the word if its length is acceptable.
+            //
+
+            Length = WordEnd - WordStart;
+
+            if (Length < MinimumWordLength || Length > MaximumWordLength) {
+                continue;
+            }
+
+            if (Window) {
+                Bytes = Window + (WordStart - WindowBase);
+            } else {
+                Bytes = Text + WordStart;
+            }
+
+            Success = AddWordEntry(Dictionary,
+                                   Bytes,
+                                   (ULONG)Length,
+                                   1,
+                                   &WordEntry,
+                                   &EntryCount);
+
+            if (!Success) {
+                goto Error;
+            }
+
+            NumberOfWords++;
+        }
+    }
+
+    //
+    // Add the final word if the text ended within one.
+    //
+
+    if (InWord) {
+
+        Length = SizeInBytes - WordStart;
+
+        if (Length >= MinimumWordLength && Length <= MaximumWordLength) {
+
+            if (Window) {
+                Bytes = Window + (WordStart - WindowBase);
+            } else {
+                Bytes = Text + WordStart;
+            }
+
+            Success = AddWordEntry(Dictionary,
+                                   Bytes,
+                                   (ULONG)Length,
+                                   1,
+                                   &WordEntry,
+                                   &EntryCount);
+
+            if (!Success) {
+                goto Error;
+            }
+
+            NumberOfWords++;
+        }
+    }
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    Sequence = EndDictionaryLogOperation(Log, Sequence);
+
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    //
+    // If a write-ahead log is open, wait for the additions to become durable.
+    // (A single wait covers every word added by this call.)
+    //
+
+    if (Log && !WaitForDictionaryLog(Log, Sequence)) {
+        Success = FALSE;
+    }
+
+    if (Window) {
+        Allocator->FreePointer(Allocator, (PPVOID)&Window);
+    }
+
+    if (ARGUMENT_PRESENT(NumberOfWordsPointer)) {
+        *NumberOfWordsPointer = NumberOfWords;
+    }
+
+    return Success;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
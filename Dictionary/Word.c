@@ -15,6 +15,163 @@ Abstract:
 
 #include "stdafx.h"
 
+FORCEINLINE
+BOOLEAN
+CreateWordHistogram(
+    _In_reads_(Length) PCBYTE Bytes,
+    _In_ ULONG Length,
+    _Out_ PCHARACTER_BITMAP Bitmap,
+    _Out_ PCHARACTER_HISTOGRAM Histogram,
+    _Out_ PULONG HistogramHashPointer
+    )
+/*++
+
+Routine Description:
+
+    Fills out the bitmap of a word and calculates its histogram hash.  If the
+    word can be represented by a packed or sparse histogram, the full histogram
+    is not touched; otherwise, it is zeroed and filled out.  This is the common
+    histogram path of InitializeWord() and InitializeWordWithLength().
+
+Return Value:
+
+    TRUE on success, FALSE if the word contains a NULL byte.
+
+--*/
+{
+    BYTE Byte;
+    ULONG Index;
+    PLONG Bits;
+    PULONG Counts;
+#if DICTIONARY_PACKED_HISTOGRAMS
+    ULONG Mask;
+    PACKED_CHARACTER_HISTOGRAM PackedHistogram;
+#endif
+#if DICTIONARY_UTF8_HISTOGRAMS
+    SPARSE_CHARACTER_HISTOGRAM SparseHistogram;
+#endif
+
+    ZeroStructPointer(Bitmap);
+
+#if DICTIONARY_PACKED_HISTOGRAMS
+
+    if (CreatePackedHistogramInline(Bytes, Length, &PackedHistogram)) {
+
+        //
+        // The word fits in a packed histogram.  Derive the bitmap from the
+        // non-zero counts and hash them.
+        //
+
+        Mask = GetPackedHistogramMask(&PackedHistogram);
+
+        Bitmap->Bits[PACKED_HISTOGRAM_BITMAP_INDEX] = (LONG)(
+            Mask << PACKED_HISTOGRAM_BITMAP_SHIFT
+        );
+
+        *HistogramHashPointer = HashPackedHistogramInline(Length,
+                                                          &PackedHistogram,
+                                                          Mask);
+        return TRUE;
+    }
+
+#endif
+
+#if DICTIONARY_UTF8_HISTOGRAMS
+
+    if (ContainsNonAsciiBytesInline(Bytes, Length) &&
+        CreateSparseHistogramInline(Bytes, Length, &SparseHistogram)) {
+
+        //
+        // The word is valid UTF-8 with at least one multi-byte character.  The
+        // bitmap still reflects the word's bytes; the histogram hash is over
+        // its codepoints.
+        //
+
+        Bits = (PLONG)&Bitmap->Bits;
+
+        for (Index = 0; Index < Length; Index++) {
+            BitTestAndSet(Bits, Bytes[Index]);
+        }
+
+        *HistogramHashPointer = HashSparseHistogramInline(Length,
+                                                          &SparseHistogram);
+        return TRUE;
+    }
+
+#endif
+
+    //
+    // Fall back to the full histogram.
+    //
+
+    ZeroStructPointer(Histogram);
+
+    Bits = (PLONG)&Bitmap->Bits;
+    Counts = (PULONG)&Histogram->Counts;
+
+    for (Index = 0; Index < Length; Index++) {
+        Byte = Bytes[Index];
+        if (Byte == '\0') {
+            return FALSE;
+        }
+        Counts[Byte]++;
+        BitTestAndSet(Bits, Byte);
+    }
+
+    *HistogramHashPointer = HashHistogramInline(Length, Bitmap, Histogram);
+
+    return TRUE;
+}
+
+FORCEINLINE
+VOID
+HashWord(
+    _In_reads_(Length) PCBYTE Bytes,
+    _In_ ULONG Length,
+    _Inout_ PLONG_STRING String,
+    _In_ PCCHARACTER_BITMAP Bitmap,
+    _Out_ PULONG BitmapHashPointer
+    )
+/*++
+
+Routine Description:
+
+    Calculates the bitmap and string hashes of a word whose bitmap has been
+    filled out, and wires up the word's string.  This is the common tail of
+    InitializeWord() and InitializeWordWithLength().
+
+--*/
+{
+    HASH Hash;
+    ULONG Index;
+    ULONG BitmapHash;
+
+    //
+    // Calculate the bitmap hash.
+    //
+
+    BitmapHash = Length;
+    for (Index = 0; Index < ARRAYSIZE(Bitmap->Bits); Index++) {
+        Hash.Index = Index;
+        Hash.Value = Bitmap->Bits[Index];
+        BitmapHash = _mm_crc32_u32(BitmapHash, Hash.AsULong);
+    }
+
+    //
+    // Wire up the string details, including the string hash.
+    //
+
+    String->Hash = HashWordString(Bytes, Length);
+    String->Length = Length;
+    String->Buffer = (PBYTE)Bytes;
+
+    //
+    // Update the caller's bitmap hash pointer.
+    //
+
+    *BitmapHashPointer = BitmapHash;
+}
+
 _Use_decl_annotations_
 BOOLEAN
 InitializeWord(
@@ -68,7 +225,12 @@ Arguments:
 
     Histogram - Supplies a pointer to a CHARACTER_HISTOGRAM structure that
         will receive the corresponding histogram representation of the incoming
-        word.  (This parameter is passed directly to InitializeWord.)
+        word.  (This parameter is passed directly to InitializeWord.)  If the
+        word can be represented by a packed histogram (i.e. it consists solely
+        of the letters a-z) or a sparse histogram (i.e. it is UTF-8 containing
+        multi-byte characters), this structure is not touched; see the comments
+        preceding the PACKED_CHARACTER_HISTOGRAM and SPARSE_CHARACTER_HISTOGRAM
+        structures for more info.
 
     BitmapHashPointer - Supplies the address of a variable that will receive
         the 32-bit hash calculated for the bitmap representation of the word.
@@ -86,18 +248,8 @@ Return Value:
 
 --*/
 {
-    BYTE Byte;
-    BYTE TrailingBytes;
-    HASH Hash;
     ULONG Index;
     ULONG Length;
-    ULONG BitmapHash;
-    ULONG StringHash;
-    ULONG HistogramHash;
-    ULONG NumberOfDoubleWords;
-    PLONG Bits;
-    PULONG Counts;
-    PULONG DoubleWords;
 
     //
     // Verify arguments.
@@ -148,33 +300,16 @@ Return Value:
     *HistogramHashPointer = 0;
 
     //
-    // Zero the bitmap and histogram.
-    //
-
-    ZeroStructPointer(Bitmap);
-    ZeroStructPointer(Histogram);
-
-    //
-    // Initialize aliases.
+    // Find the length of the word.
     //
 
     Length = 0;
-    Bits = (PLONG)&Bitmap->Bits;
-    Counts = (PULONG)&Histogram->Counts;
-
-    //
-    // Iterate over each byte in the string, increment the corresponding count
-    // for the histogram and set the corresponding bit in the bitmap.
-    //
 
     for (Index = 0; Index < MaximumLength; Index++) {
-        Byte = Bytes[Index];
-        if (Byte == '\0') {
+        if (Bytes[Index] == '\0') {
             Length = Index;
             break;
         }
-        Counts[Byte]++;
-        BitTestAndSet(Bits, Byte);
     }
 
     if (!Length) {
@@ -196,108 +331,153 @@ Return Value:
     }
 
     //
-    // Calculate the bitmap hash.
+    // Fill out the bitmap and histogram, then calculate the hashes and wire up
+    // the string.
     //
 
-    BitmapHash = Length;
-    for (Index = 0; Index < ARRAYSIZE(Bitmap->Bits); Index++) {
-        Hash.Index = Index;
-        Hash.Value = Bitmap->Bits[Index];
-        BitmapHash = _mm_crc32_u32(BitmapHash, Hash.AsULong);
+    if (!CreateWordHistogram(Bytes,
+                             Length,
+                             Bitmap,
+                             Histogram,
+                             HistogramHashPointer)) {
+        return FALSE;
     }
 
+    HashWord(Bytes, Length, String, Bitmap, BitmapHashPointer);
+
     //
-    // Calculate the histogram hash after a quick sanity check that our number
-    // of character bits is a multiple 4.
+    // Return success.
     //
 
-    ASSERT(!(NUMBER_OF_CHARACTER_BITS % 4));
+    return TRUE;
+};
 
-    HistogramHash = Length;
-    for (Index = 0; Index < NUMBER_OF_CHARACTER_BITS; Index++) {
-        Hash.Index = Index;
-        Hash.Value = Counts[Index];
-        HistogramHash = _mm_crc32_u32(HistogramHash, Hash.AsULong);
-    }
+_Use_decl_annotations_
+BOOLEAN
+InitializeWordWithLength(
+    PCBYTE Bytes,
+    ULONG Length,
+    ULONG MinimumLength,
+    ULONG MaximumLength,
+    PLONG_STRING String,
+    PCHARACTER_BITMAP Bitmap,
+    PCHARACTER_HISTOGRAM Histogram,
+    PULONG BitmapHashPointer,
+    PULONG HistogramHashPointer
+    )
+/*++
 
-    //
-    // Calculate the string hash.
-    //
+Routine Description:
 
-    StringHash = Length;
-    DoubleWords = (PULONG)Bytes;
-    TrailingBytes = Length % 4;
-    NumberOfDoubleWords = Length >> 2;
+    This routine is equivalent to InitializeWord(), except that the length of
+    the word is supplied by the caller, and the array of bytes does not need
+    to be NULL-terminated.  This allows words to be initialized in place from
+    within a larger buffer (e.g. by AddWordsFromText()), without having to
+    copy each word to a NULL-terminated buffer first.
 
-    if (NumberOfDoubleWords) {
+    No bytes beyond the given length are accessed.
 
-        //
-        // Process as many 4 byte chunks as we can.
-        //
+Arguments:
 
-        for (Index = 0; Index < NumberOfDoubleWords; Index++) {
-            StringHash = _mm_crc32_u32(StringHash, DoubleWords[Index]);
-        }
-    }
+    Bytes - Supplies a pointer to an array of bytes representing the word to
+        initialize.  The array must not contain any NULL bytes.
 
-    if (TrailingBytes) {
+    Length - Supplies the length of the word, in bytes.
 
-        //
-        // There are between 1 and 3 bytes remaining at the end of the string.
-        // We can't use _mm_crc32_u32() here directly on the last ULONG as we
-        // will include the bytes past the end of the string, which will be
-        // random and will affect our hash value.  So, we load the last ULONG
-        // then zero out the high bits that we want to ignore via _bzhi_u32().
-        // This ensures that only the bytes that are part of the input string
-        // participate in the hash value calculation.
-        //
+    MinimumLength - Supplies the minumum length permissible for the word.
 
-        ULONG Last = 0;
-        ULONG HighBits;
+    MaximumLength - Supplies the maximum length permissible for the word.
 
-        //
-        // (Sanity check we can math.)
-        //
+    String - Supplies a pointer to a LONG_STRING structure that will be filled
+        out with the relevant details for the word.  The Buffer field will be
+        initialized to the Bytes parameter.
 
-        ASSERT(TrailingBytes >= 1 && TrailingBytes <= 3);
+    Bitmap - Supplies a pointer to a CHARACTER_BITMAP structure that will
+        receive the corresponding bitmap representation of the word.
 
-        //
-        // Initialize our HighBits to the number of bits in a ULONG (32),
-        // then subtract the number of bits represented by TrailingBytes.
-        //
+    Histogram - Supplies a pointer to a CHARACTER_HISTOGRAM structure that
+        will receive the corresponding histogram representation of the word,
+        unless it can be represented by a packed or sparse histogram (as
+        described in InitializeWord()).
 
-        HighBits = sizeof(ULONG) << 3;
-        HighBits -= (TrailingBytes << 3);
+    BitmapHashPointer - Supplies the address of a variable that will receive
+        the 32-bit hash calculated for the bitmap representation of the word.
 
-        //
-        // Load the last ULONG, zero out the high bits, then hash.
-        //
+    HistogramHashPointer - Supplies the address of a variable that will receive
+        the 32-bit hash calculated for the histogram representation of the word.
 
-        Last = _bzhi_u32(DoubleWords[NumberOfDoubleWords], HighBits);
-        StringHash = _mm_crc32_u32(StringHash, Last);
-    }
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if the length
+    is outside of the given bounds, or the word contains a NULL byte.
 
+--*/
+{
     //
-    // Wire up the string details.
+    // Verify arguments.
     //
 
-    String->Hash = StringHash;
-    String->Length = Length;
-    String->Buffer = (PBYTE)Bytes;
+    if (!ARGUMENT_PRESENT(Bytes)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(String)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Bitmap)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Histogram)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(BitmapHashPointer)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(HistogramHashPointer)) {
+        return FALSE;
+    }
+
+    if (MinimumLength == 0 || MaximumLength == 0 ||
+        MinimumLength > MaximumLength) {
+        return FALSE;
+    }
+
+    if (Length < MinimumLength || Length > MaximumLength) {
+        return FALSE;
+    }
+
+    if (!IsAligned32(Bitmap) || !IsAligned32(Histogram)) {
+        return FALSE;
+    }
 
     //
-    // Update the caller's bitmap and histogram hash pointers.
+    // Clear the caller's pointers to hashes.
     //
 
-    *BitmapHashPointer = BitmapHash;
-    *HistogramHashPointer = HistogramHash;
+    *BitmapHashPointer = 0;
+    *HistogramHashPointer = 0;
 
     //
-    // Return success.
+    // Fill out the bitmap and histogram, then calculate the hashes and wire up
+    // the string.
     //
 
+    if (!CreateWordHistogram(Bytes,
+                             Length,
+                             Bitmap,
+                             Histogram,
+                             HistogramHashPointer)) {
+        return FALSE;
+    }
+
+    HashWord(Bytes, Length, String, Bitmap, BitmapHashPointer);
+
     return TRUE;
-};
+}
 
 
 RTL_GENERIC_COMPARE_RESULTS
@@ -675,6 +855,7 @@ Return Value:
 {
     BOOL Success;
     PWORD_STATS WordStats;
+    PWORD_ENTRY WordEntry;
     CHARACTER_BITMAP Bitmap;
     DICTIONARY_CONTEXT Context;
     CHARACTER_HISTOGRAM Histogram;
@@ -717,13 +898,28 @@ Return Value:
 
     AcquireDictionaryLockShared(&Dictionary->Lock);
 
-    Success = FindWordTableEntry(Dictionary,
-                                 Word,
-                                 &Bitmap,
-                                 &Histogram,
-                                 &WordTableEntry);
+    if (Dictionary->Flags.IsFrozen) {
+
+        Success = FindFrozenWordEntry(Dictionary,
+                                      GetLocalFrozenDictionary(Dictionary),
+                                      Word,
+                                      &Bitmap,
+                                      &Histogram,
+                                      NULL,
+                                      &WordEntry);
+
+    } else {
+
+        Success = FindWordTableEntry(Dictionary,
+                                     Word,
+                                     &Bitmap,
+                                     &Histogram,
+                                     &WordTableEntry);
+
+        WordEntry = (WordTableEntry ? &WordTableEntry->WordEntry : NULL);
+    }
 
-    if (!Success || WordTableEntry == NULL) {
+    if (!Success || WordEntry == NULL) {
 
         Success = FALSE;
 
@@ -733,7 +929,7 @@ Return Value:
         // Match found!  Write the stats.
         //
 
-        WordStats = &WordTableEntry->WordEntry.Stats;
+        WordStats = &WordEntry->Stats;
         Stats->EntryCount = WordStats->EntryCount;
         Stats->MaximumEntryCount = WordStats->MaximumEntryCount;
 
@@ -0,0 +1,610 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    WordCounter.c
+
+Abstract:
+
+    This module implements word counters, which allow multiple threads to
+    count word occurrences without contending for the dictionary's lock on
+    every word.  Routines are provided for creating, counting words with,
+    flushing and destroying word counters.
+
+    Each thread creates its own counter.  Words are counted in the counter's
+    local hash table, such that repeated words only cost a local increment.
+    When the table fills up (or on demand), the local counts are added to the
+    dictionary under a single acquisition of the exclusive lock.  Each word's
+    count is added in one step, which yields the same entry count and maximum
+    entry count as adding each occurrence individually.
+
+--*/
+
+#include "stdafx.h"
+
+FORCEINLINE
+ULONGLONG
+WordCounterEntrySortKey(
+    _In_ PCWORD_COUNTER_ENTRY Entry
+    )
+{
+    return (((ULONGLONG)Entry->BitmapHash) << 32) | Entry->HistogramHash;
+}
+
+FORCEINLINE
+VOID
+SiftDownWordCounterEntries(
+    _Inout_updates_(NumberOfEntries) PWORD_COUNTER_ENTRY *Entries,
+    _In_ ULONG Root,
+    _In_ ULONG NumberOfEntries
+    )
+{
+    ULONG Child;
+    PWORD_COUNTER_ENTRY Entry;
+
+    while ((Child = (Root << 1) + 1) < NumberOfEntries) {
+
+        if (Child + 1 < NumberOfEntries &&
+            WordCounterEntrySortKey(Entries[Child + 1]) >
+            WordCounterEntrySortKey(Entries[Child])) {
+            Child++;
+        }
+
+        if (WordCounterEntrySortKey(Entries[Root]) >=
+            WordCounterEntrySortKey(Entries[Child])) {
+            break;
+        }
+
+        Entry = Entries[Root];
+        Entries[Root] = Entries[Child];
+        Entries[Child] = Entry;
+        Root = Child;
+    }
+}
+
+FORCEINLINE
+VOID
+SortWordCounterEntries(
+    _Inout_updates_(NumberOfEntries) PWORD_COUNTER_ENTRY *Entries,
+    _In_ ULONG NumberOfEntries
+    )
+/*++
+
+Routine Description:
+
+    Sorts an array of word counter entry pointers by bitmap hash, then
+    histogram hash, via heap sort.
+
+--*/
+{
+    ULONG Index;
+    ULONG End;
+    PWORD_COUNTER_ENTRY Entry;
+
+    for (Index = NumberOfEntries >> 1; Index-- > 0; ) {
+        SiftDownWordCounterEntries(Entries, Index, NumberOfEntries);
+    }
+
+    for (End = NumberOfEntries; End-- > 1; ) {
+        Entry = Entries[0];
+        Entries[0] = Entries[End];
+        Entries[End] = Entry;
+        SiftDownWordCounterEntries(Entries, 0, End);
+    }
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CreateWordCounter(
+    PDICTIONARY Dictionary,
+    PALLOCATOR Allocator,
+    ULONG NumberOfSlots,
+    PWORD_COUNTER *WordCounterPointer
+    )
+/*++
+
+Routine Description:
+
+    Creates a word counter for the calling thread.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to the DICTIONARY structure to which the
+        counts will be flushed.
+
+    Allocator - Supplies a pointer to the allocator to use for the counter.
+        The counter (including its table and string buffer) is a single
+        allocation.
+
+    NumberOfSlots - Optionally supplies the number of slots in the counter's
+        hash table.  Must be a power of 2 and at least 16 if non-zero.  If
+        zero, a default of 4096 is used.  The counter is flushed when half of
+        the slots are occupied.
+
+    WordCounterPointer - Supplies the address of a variable that receives the
+        address of the new WORD_COUNTER structure.  Set to NULL on error.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    PBYTE Buffer;
+    ULONG MaximumNumberOfEntries;
+    ULONGLONG StringBufferSize;
+    ULARGE_INTEGER AllocSize;
+    PWORD_COUNTER WordCounter;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(WordCounterPointer)) {
+        return FALSE;
+    }
+
+    *WordCounterPointer = NULL;
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Allocator)) {
+        return FALSE;
+    }
+
+    if (NumberOfSlots == 0) {
+        NumberOfSlots = WORD_COUNTER_DEFAULT_NUMBER_OF_SLOTS;
+    }
+
+    if (!IsPowerOf2(NumberOfSlots) ||
+        NumberOfSlots < WORD_COUNTER_MINIMUM_NUMBER_OF_SLOTS) {
+        return FALSE;
+    }
+
+    //
+    // Calculate the allocation size: the counter structure, followed by the
+    // table, the sort array, then the string buffer.
+    //
+
+    MaximumNumberOfEntries = NumberOfSlots >> 1;
+    StringBufferSize = (
+        (ULONGLONG)MaximumNumberOfEntries *
+        WORD_COUNTER_STRING_BYTES_PER_ENTRY
+    );
+
+    AllocSize.QuadPart = (
+        ALIGN_UP(sizeof(WORD_COUNTER), sizeof(WORD_COUNTER_ENTRY)) +
+        ((ULONGLONG)NumberOfSlots * sizeof(WORD_COUNTER_ENTRY)) +
+        ((ULONGLONG)MaximumNumberOfEntries * sizeof(PWORD_COUNTER_ENTRY)) +
+        StringBufferSize
+    );
+
+    Buffer = (PBYTE)Allocator->Calloc(Allocator, 1, AllocSize.QuadPart);
+    if (!Buffer) {
+        return FALSE;
+    }
+
+    WordCounter = (PWORD_COUNTER)Buffer;
+    WordCounter->Dictionary = Dictionary;
+    WordCounter->Allocator = Allocator;
+    WordCounter->NumberOfSlots = NumberOfSlots;
+    WordCounter->MaximumNumberOfEntries = MaximumNumberOfEntries;
+    WordCounter->StringBufferSize = StringBufferSize;
+
+    Buffer += ALIGN_UP(sizeof(WORD_COUNTER), sizeof(WORD_COUNTER_ENTRY));
+    WordCounter->Entries = (PWORD_COUNTER_ENTRY)Buffer;
+    WordCounter->SortedEntries = (PWORD_COUNTER_ENTRY *)(
+        WordCounter->Entries + NumberOfSlots
+    );
+    WordCounter->StringBuffer = (PBYTE)(
+        WordCounter->SortedEntries + MaximumNumberOfEntries
+    );
+
+    *WordCounterPointer = WordCounter;
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+FlushWordCounter(
+    PWORD_COUNTER WordCounter
+    )
+/*++
+
+Routine Description:
+
+    Adds the counts accumulated by a word counter to its dictionary, then
+    resets the counter.  The dictionary's exclusive lock is acquired once for
+    the entire batch.
+
+    Words whose lengths are no longer within the dictionary's minimum and
+    maximum word lengths (i.e. the lengths were changed after the words were
+    counted) are discarded, consistent with AddWord().
+
+Arguments:
+
+    WordCounter - Supplies a pointer to the WORD_COUNTER structure to flush.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if the
+    dictionary has been frozen, or if a write-ahead log is open and the
+    additions could not be written to it.  On failure, the counts that were
+    not added to the dictionary are retained by the counter, such that a
+    subsequent flush does not add any count twice.
+
+--*/
+{
+    ULONG Index;
+    ULONG Length;
+    ULONG NumberOfEntries;
+    BOOLEAN Success;
+    LONGLONG EntryCount;
+    ULONGLONG Sequence;
+    PDICTIONARY Dictionary;
+    PDICTIONARY_LOG Log;
+    PCWORD_ENTRY WordEntry;
+    PWORD_COUNTER_ENTRY Entry;
+    PWORD_COUNTER_ENTRY *SortedEntries;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(WordCounter)) {
+        return FALSE;
+    }
+
+    if (WordCounter->NumberOfEntries == 0) {
+        return TRUE;
+    }
+
+    //
+    // Collect the occupied slots and sort them into table order.
+    //
+
+    NumberOfEntries = 0;
+    SortedEntries = WordCounter->SortedEntries;
+
+    for (Index = 0; Index < WordCounter->NumberOfSlots; Index++) {
+        Entry = &WordCounter->Entries[Index];
+        if (Entry->String.Buffer && Entry->Count > 0) {
+            SortedEntries[NumberOfEntries++] = Entry;
+        }
+    }
+
+    ASSERT(NumberOfEntries <= WordCounter->MaximumNumberOfEntries);
+
+    SortWordCounterEntries(SortedEntries, NumberOfEntries);
+
+    //
+    // Acquire the exclusive lock, capture the write-ahead log (if any), and
+    // add each word's count.
+    //
+
+    Dictionary = WordCounter->Dictionary;
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+
+    Log = BeginDictionaryLogOperation(Dictionary, &Sequence);
+
+    if (Dictionary->Flags.IsFrozen) {
+        goto Error;
+    }
+
+    for (Index = 0; Index < NumberOfEntries; Index++) {
+
+        Entry = SortedEntries[Index];
+        Length = Entry->String.Length;
+
+        if (Length >= Dictionary->MinimumWordLength &&
+            Length <= Dictionary->MaximumWordLength) {
+
+            Success = AddWordEntry(Dictionary,
+                                   Entry->String.Buffer,
+                                   Length,
+                                   Entry->Count,
+                                   &WordEntry,
+                                   &EntryCount);
+
+            if (!Success) {
+                goto Error;
+            }
+        }
+
+        //
+        // Clear the count such that the entry is skipped if a subsequent
+        // entry fails.
+        //
+
+        Entry->Count = 0;
+    }
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    Sequence = EndDictionaryLogOperation(Log, Sequence);
+
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    if (Success) {
+
+        //
+        // Reset the table and the string buffer.
+        //
+
+        __stosq((PDWORD64)WordCounter->Entries,
+                0,
+                (WordCounter->NumberOfSlots *
+                 sizeof(WORD_COUNTER_ENTRY)) >> 3);
+
+        WordCounter->NumberOfEntries = 0;
+        WordCounter->StringBytesUsed = 0;
+        WordCounter->NumberOfFlushes++;
+    }
+
+    //
+    // If a write-ahead log is open, wait for the additions to become durable.
+    // (This is done after the reset, as the counts have been applied in memory
+    // whether or not they become durable.)
+    //
+
+    if (Log && !WaitForDictionaryLog(Log, Sequence)) {
+        Success = FALSE;
+    }
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CountWord(
+    PWORD_COUNTER WordCounter,
+    PCBYTE Word
+    )
+/*++
+
+Routine Description:
+
+    Counts an occurrence of a word in a word counter.  The dictionary's lock
+    is not acquired unless the counter needs to be flushed.
+
+Arguments:
+
+    WordCounter - Supplies a pointer to a WORD_COUNTER structure created by
+        the calling thread.
+
+    Word - Supplies a NULL-terminated array of bytes to count.  The length of
+        the array must be between the minimum and maximum lengths configured
+        for the dictionary, otherwise the word will be rejected and this
+        routine will return FALSE.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    ULONG Mask;
+    ULONG Index;
+    ULONG Length;
+    ULONG BitmapHash;
+    ULONG HistogramHash;
+    BOOLEAN Success;
+    LONGLONG EntryCount;
+    ULONGLONG Sequence;
+    PBYTE Buffer;
+    LONG_STRING String;
+    PDICTIONARY Dictionary;
+    PDICTIONARY_LOG Log;
+    PCWORD_ENTRY WordEntry;
+    PWORD_COUNTER_ENTRY Entry;
+    CHARACTER_BITMAP Bitmap;
+    CHARACTER_HISTOGRAM Histogram;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(WordCounter)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Word)) {
+        return FALSE;
+    }
+
+    //
+    // Initialize the word.  The word length limits are read without holding
+    // the dictionary's lock; they're checked again when the counts are
+    // flushed.
+    //
+
+    Dictionary = WordCounter->Dictionary;
+
+    Success = InitializeWord(Word,
+                             Dictionary->MinimumWordLength,
+                             Dictionary->MaximumWordLength,
+                             &String,
+                             &Bitmap,
+                             &Histogram,
+                             &BitmapHash,
+                             &HistogramHash);
+
+    if (!Success) {
+        return FALSE;
+    }
+
+    Length = String.Length;
+
+    //
+    // Words that wouldn't fit in an empty string buffer are added to the
+    // dictionary directly.
+    //
+
+    if ((ULONGLONG)Length + 1 > WordCounter->StringBufferSize) {
+
+        AcquireDictionaryLockExclusive(&Dictionary->Lock);
+
+        Log = BeginDictionaryLogOperation(Dictionary, &Sequence);
+
+        Success = FALSE;
+
+        if (!Dictionary->Flags.IsFrozen) {
+            Success = AddWordEntry(Dictionary,
+                                   Word,
+                                   Length,
+                                   1,
+                                   &WordEntry,
+                                   &EntryCount);
+        }
+
+        Sequence = EndDictionaryLogOperation(Log, Sequence);
+
+        ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+        if (Log && !WaitForDictionaryLog(Log, Sequence)) {
+            Success = FALSE;
+        }
+
+        return Success;
+    }
+
+    //
+    // Find the word's slot, or the empty slot that ends its probe sequence.
+    //
+
+    Mask = WordCounter->NumberOfSlots - 1;
+
+Retry:
+
+    Index = String.Hash & Mask;
+
+    while (TRUE) {
+
+        Entry = &WordCounter->Entries[Index];
+
+        if (!Entry->String.Buffer) {
+            break;
+        }
+
+        if (IsSameWord(&Entry->String, &String)) {
+
+            //
+            // The word is already present; increment the local count.  This
+            // is the common case.
+            //
+
+            Entry->Count++;
+            return TRUE;
+        }
+
+        Index = (Index + 1) & Mask;
+    }
+
+    //
+    // This is a new word.  Flush the counter first if the table is at its
+    // maximum occupancy or there's no room for the string, then restart the
+    // probe (the table is empty after a flush).
+    //
+
+    if (WordCounter->NumberOfEntries >= WordCounter->MaximumNumberOfEntries ||
+        WordCounter->StringBytesUsed + Length + 1 >
+        WordCounter->StringBufferSize) {
+
+        if (!FlushWordCounter(WordCounter)) {
+            return FALSE;
+        }
+
+        goto Retry;
+    }
+
+    //
+    // Copy the word into the string buffer and fill out the entry.
+    //
+
+    Buffer = WordCounter->StringBuffer + WordCounter->StringBytesUsed;
+    CopyMemory(Buffer, Word, Length);
+    Buffer[Length] = '\0';
+    WordCounter->StringBytesUsed += (ULONGLONG)Length + 1;
+
+    Entry->String.Length = Length;
+    Entry->String.Hash = String.Hash;
+    Entry->String.Buffer = Buffer;
+    Entry->BitmapHash = BitmapHash;
+    Entry->HistogramHash = HistogramHash;
+    Entry->Count = 1;
+
+    WordCounter->NumberOfEntries++;
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+DestroyWordCounter(
+    PWORD_COUNTER *WordCounterPointer
+    )
+/*++
+
+Routine Description:
+
+    Flushes a word counter, then destroys it.
+
+Arguments:
+
+    WordCounterPointer - Supplies the address of a variable that contains the
+        address of the WORD_COUNTER structure to destroy.  The variable will
+        be cleared.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  The counter is destroyed regardless;
+    FALSE indicates the final flush failed, and the counts that hadn't been
+    flushed were discarded.  Callers requiring the counts to be retained on
+    failure should call FlushWordCounter() first.
+
+--*/
+{
+    BOOLEAN Success;
+    PALLOCATOR Allocator;
+    PWORD_COUNTER WordCounter;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(WordCounterPointer)) {
+        return FALSE;
+    }
+
+    WordCounter = *WordCounterPointer;
+
+    if (!ARGUMENT_PRESENT(WordCounter)) {
+        return FALSE;
+    }
+
+    Success = FlushWordCounter(WordCounter);
+
+    Allocator = WordCounter->Allocator;
+    Allocator->FreePointer(Allocator, (PPVOID)WordCounterPointer);
+
+    return Success;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
@@ -0,0 +1,523 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    WordLengths.c
+
+Abstract:
+
+    This module implements word length queries.  The public routine
+    GetWordLengthHistogram() returns the distribution of word lengths in a
+    dictionary, and EnumerateWordsByLengthRange() returns the words whose
+    lengths fall within a given range.
+
+    Both routines are driven by the length table (or the length entries of a
+    frozen dictionary).  Each length table entry tracks the number of words of
+    its length, so the histogram (and the size of the enumeration's output)
+    is obtained without touching any words, and the enumeration walks the
+    length lists directly, without hashing or looking up any words.
+
+--*/
+
+#include "stdafx.h"
+
+FORCEINLINE
+VOID
+AppendLinkedWordEntry(
+    _In_ PLINKED_WORD_LIST LinkedWordList,
+    _Inout_ PBYTE *StructBufferPointer,
+    _Inout_ PBYTE *StringBufferPointer,
+    _In_ PCWORD_ENTRY SourceWordEntry
+    )
+/*++
+
+Routine Description:
+
+    Carves out a LINKED_WORD_ENTRY and string buffer for a copy of a word
+    entry, and appends it to a linked word list.
+
+--*/
+{
+    PBYTE StringBuffer;
+    PCLONG_STRING SourceString;
+    PWORD_ENTRY WordEntry;
+    PLINKED_WORD_ENTRY LinkedWordEntry;
+
+    LinkedWordEntry = (PLINKED_WORD_ENTRY)*StructBufferPointer;
+    *StructBufferPointer += sizeof(LINKED_WORD_ENTRY);
+
+    StringBuffer = *StringBufferPointer;
+    SourceString = &SourceWordEntry->String;
+
+    //
+    // Copy the string, including the trailing NULL.
+    //
+
+    CopyMemory(StringBuffer, SourceString->Buffer, SourceString->Length + 1);
+    *StringBufferPointer += SourceString->Length + 1;
+
+    WordEntry = &LinkedWordEntry->WordEntry;
+    WordEntry->Stats.EntryCount = SourceWordEntry->Stats.EntryCount;
+    WordEntry->Stats.MaximumEntryCount =
+        SourceWordEntry->Stats.MaximumEntryCount;
+    WordEntry->String.Length = SourceString->Length;
+    WordEntry->String.Hash = SourceString->Hash;
+    WordEntry->String.Buffer = StringBuffer;
+
+    InsertTailList(&LinkedWordList->ListHead, &LinkedWordEntry->ListEntry);
+    LinkedWordList->NumberOfEntries++;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+GetWordLengthHistogram(
+    PDICTIONARY Dictionary,
+    PALLOCATOR Allocator,
+    PWORD_LENGTH_HISTOGRAM *HistogramPointer
+    )
+/*++
+
+Routine Description:
+
+    Obtains the distribution of word lengths in a dictionary: the number of
+    unique words of each distinct length, in ascending order of length.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to a DICTIONARY structure for which the
+        histogram is to be obtained.
+
+    Allocator - Supplies a pointer to an ALLOCATOR structure that will be used
+        to allocate the memory that backs the address returned via the param
+        HistogramPointer.
+
+    HistogramPointer - Supplies the address of a variable that receives the
+        address of a WORD_LENGTH_HISTOGRAM structure (allocated via Allocator).
+        The pointer must be freed via the Allocator once the user has finished
+        with the structure.  Set to NULL on error.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    PRTL Rtl;
+    ULONG Index;
+    ULONG NumberOfLengths;
+    PVOID RestartKey;
+    BOOLEAN Success;
+    ULONGLONG AllocSize;
+    PLENGTH_TABLE LengthTable;
+    PFROZEN_DICTIONARY Frozen;
+    PWORD_LENGTH_COUNT Count;
+    PWORD_LENGTH_HISTOGRAM Histogram;
+    PFROZEN_LENGTH_ENTRY LengthEntry;
+    PLENGTH_TABLE_ENTRY LengthTableEntry;
+    PRTL_ENUMERATE_GENERIC_TABLE_WITHOUT_SPLAYING_AVL EnumerateTable;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(HistogramPointer)) {
+        return FALSE;
+    }
+
+    *HistogramPointer = NULL;
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Allocator)) {
+        return FALSE;
+    }
+
+    //
+    // Initialize aliases.
+    //
+
+    Rtl = Dictionary->Rtl;
+    EnumerateTable = Rtl->RtlEnumerateGenericTableWithoutSplayingAvl;
+    LengthTable = &Dictionary->LengthTable;
+
+    //
+    // Acquire a shared lock for the duration of this routine.
+    //
+
+    AcquireDictionaryLockShared(&Dictionary->Lock);
+
+    Frozen = Dictionary->Frozen;
+
+    if (Frozen) {
+        NumberOfLengths = Frozen->NumberOfLengths;
+    } else {
+        NumberOfLengths = (
+            Rtl->RtlNumberGenericTableElementsAvl(&LengthTable->Avl)
+        );
+    }
+
+    //
+    // Allocate the histogram.
+    //
+
+    AllocSize = (
+        FIELD_OFFSET(WORD_LENGTH_HISTOGRAM, Counts) +
+        ((ULONGLONG)max(NumberOfLengths, 1) * sizeof(WORD_LENGTH_COUNT))
+    );
+
+    Histogram = (PWORD_LENGTH_HISTOGRAM)(
+        Allocator->Calloc(Allocator, 1, (SIZE_T)AllocSize)
+    );
+
+    if (!Histogram) {
+        goto Error;
+    }
+
+    Histogram->NumberOfLengths = NumberOfLengths;
+
+    //
+    // Fill out the counts.
+    //
+
+    Count = Histogram->Counts;
+
+    if (Frozen) {
+
+        for (Index = 0; Index < NumberOfLengths; Index++) {
+            LengthEntry = &Frozen->LengthEntries[Index];
+            Count->Length = LengthEntry->Length;
+            Count->NumberOfWords = LengthEntry->NumberOfWords;
+            Histogram->NumberOfWords += Count->NumberOfWords;
+            Count++;
+        }
+
+    } else {
+
+        RestartKey = NULL;
+
+        while (TRUE) {
+
+            LengthTableEntry = (PLENGTH_TABLE_ENTRY)(
+                EnumerateTable(&LengthTable->Avl, &RestartKey)
+            );
+
+            if (!LengthTableEntry) {
+                break;
+            }
+
+            Count->Length = TABLE_ENTRY_TO_HEADER(LengthTableEntry)->Length;
+            Count->NumberOfWords = LengthTableEntry->NumberOfWords;
+            Histogram->NumberOfWords += Count->NumberOfWords;
+            Count++;
+        }
+    }
+
+    ASSERT(Count == Histogram->Counts + NumberOfLengths);
+
+    *HistogramPointer = Histogram;
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    ReleaseDictionaryLockShared(&Dictionary->Lock);
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+EnumerateWordsByLengthRange(
+    PDICTIONARY Dictionary,
+    PALLOCATOR Allocator,
+    ULONG MinimumLength,
+    ULONG MaximumLength,
+    PLINKED_WORD_LIST *LinkedWordListPointer
+    )
+/*++
+
+Routine Description:
+
+    Constructs a list of the words in the dictionary whose lengths are between
+    a minimum and maximum length (inclusive).  Words are returned in ascending
+    order of length; words of the same length are returned in the order they
+    were added to the dictionary.
+
+Arguments:
+
+    Dictionary - Supplies a pointer to a DICTIONARY structure for which the
+        words are to be retrieved.
+
+    Allocator - Supplies a pointer to an ALLOCATOR structure that will be used
+        to allocate the memory that backs the address returned via the param
+        LinkedWordListPointer and all associated LINKED_WORD_ENTRY items.
+
+    MinimumLength - Supplies the minimum length of words to return, in bytes.
+
+    MaximumLength - Supplies the maximum length of words to return, in bytes.
+        Must be greater than or equal to MinimumLength.
+
+    LinkedWordListPointer - Supplies the address of a variable that receives
+        the address of a LINKED_WORD_LIST structure (allocated via Allocator)
+        if at least one word has a length within the range.  If there are no
+        such words, a NULL pointer is returned.  The pointer must be freed via
+        the Allocator once the user has finished with the structure.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    PRTL Rtl;
+    PBYTE Buffer;
+    PBYTE StructBuffer;
+    PBYTE StringBuffer;
+    ULONG Index;
+    ULONG Length;
+    ULONG WordIndex;
+    ULONG NumberOfLengths;
+    PVOID RestartKey;
+    BOOLEAN Success;
+    ULONGLONG AllocSize;
+    ULONGLONG NumberOfWords;
+    ULONGLONG NumberOfStringBytes;
+    PLIST_ENTRY ListHead;
+    PLIST_ENTRY ListEntry;
+    PLENGTH_TABLE LengthTable;
+    PFROZEN_DICTIONARY Frozen;
+    PLINKED_WORD_LIST LinkedWordList;
+    PWORD_TABLE_ENTRY WordTableEntry;
+    PFROZEN_LENGTH_ENTRY LengthEntry;
+    PLENGTH_TABLE_ENTRY LengthTableEntry;
+    PRTL_ENUMERATE_GENERIC_TABLE_WITHOUT_SPLAYING_AVL EnumerateTable;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(LinkedWordListPointer)) {
+        return FALSE;
+    }
+
+    *LinkedWordListPointer = NULL;
+
+    if (!ARGUMENT_PRESENT(Dictionary)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Allocator)) {
+        return FALSE;
+    }
+
+    if (MinimumLength > MaximumLength) {
+        return FALSE;
+    }
+
+    //
+    // Initialize aliases and locals.
+    //
+
+    Rtl = Dictionary->Rtl;
+    EnumerateTable = Rtl->RtlEnumerateGenericTableWithoutSplayingAvl;
+    LengthTable = &Dictionary->LengthTable;
+    NumberOfWords = 0;
+    NumberOfStringBytes = 0;
+
+    //
+    // Acquire a shared lock for the duration of this routine.
+    //
+
+    AcquireDictionaryLockShared(&Dictionary->Lock);
+
+    Frozen = Dictionary->Frozen;
+
+    //
+    // Determine the number of words in the range, and the number of bytes
+    // required for their strings, from the per-length word counts.
+    //
+
+    if (Frozen) {
+
+        NumberOfLengths = Frozen->NumberOfLengths;
+
+        for (Index = 0; Index < NumberOfLengths; Index++) {
+
+            LengthEntry = &Frozen->LengthEntries[Index];
+            Length = LengthEntry->Length;
+
+            if (Length < MinimumLength) {
+                continue;
+            } else if (Length > MaximumLength) {
+                break;
+            }
+
+            NumberOfWords += LengthEntry->NumberOfWords;
+            NumberOfStringBytes += (
+                (ULONGLONG)LengthEntry->NumberOfWords * (Length + 1)
+            );
+        }
+
+    } else {
+
+        RestartKey = NULL;
+
+        while (TRUE) {
+
+            LengthTableEntry = (PLENGTH_TABLE_ENTRY)(
+                EnumerateTable(&LengthTable->Avl, &RestartKey)
+            );
+
+            if (!LengthTableEntry) {
+                break;
+            }
+
+            Length = TABLE_ENTRY_TO_HEADER(LengthTableEntry)->Length;
+
+            if (Length < MinimumLength) {
+                continue;
+            } else if (Length > MaximumLength) {
+                break;
+            }
+
+            NumberOfWords += LengthTableEntry->NumberOfWords;
+            NumberOfStringBytes += (
+                LengthTableEntry->NumberOfWords * (Length + 1)
+            );
+        }
+    }
+
+    if (NumberOfWords == 0) {
+        Success = TRUE;
+        goto End;
+    }
+
+    //
+    // Allocate the list, entries and string buffers.
+    //
+
+    AllocSize = (
+        sizeof(LINKED_WORD_LIST) +
+        (sizeof(LINKED_WORD_ENTRY) * NumberOfWords) +
+        NumberOfStringBytes
+    );
+
+    Buffer = (PBYTE)Allocator->Calloc(Allocator, 1, (SIZE_T)AllocSize);
+    if (!Buffer) {
+        goto Error;
+    }
+
+    LinkedWordList = (PLINKED_WORD_LIST)Buffer;
+    InitializeListHead(&LinkedWordList->ListHead);
+
+    StructBuffer = Buffer + sizeof(LINKED_WORD_LIST);
+    StringBuffer = StructBuffer + (sizeof(LINKED_WORD_ENTRY) * NumberOfWords);
+
+    //
+    // Copy the words.
+    //
+
+    if (Frozen) {
+
+        for (Index = 0; Index < NumberOfLengths; Index++) {
+
+            LengthEntry = &Frozen->LengthEntries[Index];
+            Length = LengthEntry->Length;
+
+            if (Length < MinimumLength) {
+                continue;
+            } else if (Length > MaximumLength) {
+                break;
+            }
+
+            for (WordIndex = LengthEntry->FirstWord;
+                 WordIndex < LengthEntry->FirstWord +
+                             LengthEntry->NumberOfWords;
+                 WordIndex++) {
+
+                AppendLinkedWordEntry(
+                    LinkedWordList,
+                    &StructBuffer,
+                    &StringBuffer,
+                    &Frozen->WordEntries[Frozen->LengthOrderedWords[WordIndex]]
+                );
+            }
+        }
+
+    } else {
+
+        RestartKey = NULL;
+
+        while (TRUE) {
+
+            LengthTableEntry = (PLENGTH_TABLE_ENTRY)(
+                EnumerateTable(&LengthTable->Avl, &RestartKey)
+            );
+
+            if (!LengthTableEntry) {
+                break;
+            }
+
+            Length = TABLE_ENTRY_TO_HEADER(LengthTableEntry)->Length;
+
+            if (Length < MinimumLength) {
+                continue;
+            } else if (Length > MaximumLength) {
+                break;
+            }
+
+            ListHead = &LengthTableEntry->LengthListHead;
+
+            for (ListEntry = ListHead->Flink;
+                 ListEntry != ListHead;
+                 ListEntry = ListEntry->Flink) {
+
+                WordTableEntry = CONTAINING_RECORD(ListEntry,
+                                                   WORD_TABLE_ENTRY,
+                                                   LengthListEntry);
+
+                AppendLinkedWordEntry(LinkedWordList,
+                                      &StructBuffer,
+                                      &StringBuffer,
+                                      &WordTableEntry->WordEntry);
+            }
+        }
+    }
+
+    ASSERT((ULONGLONG)LinkedWordList->NumberOfEntries == NumberOfWords);
+    ASSERT(StringBuffer == Buffer + AllocSize);
+
+    *LinkedWordListPointer = LinkedWordList;
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    ReleaseDictionaryLockShared(&Dictionary->Lock);
+
+    return Success;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
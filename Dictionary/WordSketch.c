@@ -0,0 +1,951 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    WordSketch.c
+
+Abstract:
+
+    This module implements word sketches, which approximately count the words
+    of high-cardinality streams in fixed memory.  Routines are provided for
+    creating sketches, counting batches of words, estimating the count of a
+    word, obtaining the heavy hitters (the most frequent words seen), and
+    destroying sketches.
+
+    Each word is hashed with the same CRC32 string hash used by the dictionary
+    (see HashWordString()); the counter indices for all 8 rows of the sketch
+    are then derived from the hash with AVX2, and estimates are obtained by
+    gathering the 8 counters and taking their minimum.  Counters are updated
+    with interlocked increments, so any number of threads may count words with
+    the same sketch without acquiring a lock.
+
+    Words whose estimates reach the sketch's promotion threshold are added to
+    the sketch's dictionary (if any).  Promotions are collected per batch of
+    words and applied under a single acquisition of the dictionary's exclusive
+    lock, in the same manner as FlushWordCounter().
+
+--*/
+
+#include "stdafx.h"
+
+//
+// Define the structure used to capture a pending promotion.
+//
+
+typedef struct _WORD_SKETCH_PROMOTION {
+    ULONG WordIndex;
+    ULONG Length;
+    ULONG Estimate;
+} WORD_SKETCH_PROMOTION;
+typedef WORD_SKETCH_PROMOTION *PWORD_SKETCH_PROMOTION;
+
+FORCEINLINE
+YMMWORD
+GetWordSketchIndices(
+    _In_ PWORD_SKETCH WordSketch,
+    _In_ ULONG Hash
+    )
+/*++
+
+Routine Description:
+
+    Calculates the indices of a word's counters (one per row, relative to the
+    start of the counter array) from its string hash.
+
+--*/
+{
+    ULONG Step;
+    YMMWORD Rows;
+    YMMWORD Indices;
+    YMMWORD Offsets;
+
+    Step = _mm_crc32_u32(Hash, WORD_SKETCH_STEP_SEED) | 1;
+    Rows = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    Indices = _mm256_add_epi32(
+        _mm256_set1_epi32((LONG)Hash),
+        _mm256_mullo_epi32(Rows, _mm256_set1_epi32((LONG)Step))
+    );
+
+    Indices = _mm256_mullo_epi32(
+        Indices,
+        _mm256_set1_epi32((LONG)WORD_SKETCH_MULTIPLIER)
+    );
+
+    Indices = _mm256_srl_epi32(
+        Indices,
+        _mm_cvtsi32_si128(32 - WordSketch->WidthShift)
+    );
+
+    Offsets = _mm256_sll_epi32(Rows,
+                               _mm_cvtsi32_si128(WordSketch->WidthShift));
+
+    return _mm256_add_epi32(Indices, Offsets);
+}
+
+FORCEINLINE
+ULONG
+GetWordSketchEstimate(
+    _In_ PWORD_SKETCH WordSketch,
+    _In_ ULONG Hash
+    )
+/*++
+
+Routine Description:
+
+    Returns the estimated count of a word: the minimum of its counters.
+
+--*/
+{
+    XMMWORD Minimum;
+    XMMWORD Shuffled;
+    YMMWORD Counts;
+    YMMWORD Indices;
+
+    Indices = GetWordSketchIndices(WordSketch, Hash);
+    Counts = _mm256_i32gather_epi32((const int *)WordSketch->Counters,
+                                    Indices,
+                                    sizeof(ULONG));
+
+    //
+    // Reduce the 8 counts to their minimum: 8 -> 4 -> 2 -> 1.
+    //
+
+    Minimum = _mm_min_epu32(_mm256_castsi256_si128(Counts),
+                            _mm256_extracti128_si256(Counts, 1));
+
+    Shuffled = _mm_shuffle_epi32(Minimum, _MM_SHUFFLE(1, 0, 3, 2));
+    Minimum = _mm_min_epu32(Minimum, Shuffled);
+
+    Shuffled = _mm_shuffle_epi32(Minimum, _MM_SHUFFLE(2, 3, 0, 1));
+    Minimum = _mm_min_epu32(Minimum, Shuffled);
+
+    return (ULONG)_mm_cvtsi128_si32(Minimum);
+}
+
+FORCEINLINE
+ULONG
+IncrementWordSketchCounters(
+    _In_ PWORD_SKETCH WordSketch,
+    _In_ ULONG Hash
+    )
+/*++
+
+Routine Description:
+
+    Increments a word's counters and returns its new estimated count.  As each
+    counter is incremented atomically, the new estimate is exactly one more
+    than the estimate prior to this occurrence, regardless of any concurrent
+    updates.
+
+--*/
+{
+    ULONG Row;
+    ULONG Value;
+    ULONG Estimate;
+    PLONG Counter;
+    DECLSPEC_ALIGN(32) ULONG Indices[WORD_SKETCH_DEPTH];
+
+    _mm256_store_si256((PYMMWORD)Indices,
+                       GetWordSketchIndices(WordSketch, Hash));
+
+    Estimate = MAXULONG;
+
+    for (Row = 0; Row < WORD_SKETCH_DEPTH; Row++) {
+
+        Counter = (PLONG)&WordSketch->Counters[Indices[Row]];
+        Value = (ULONG)InterlockedIncrement(Counter);
+
+        if (Value == 0) {
+
+            //
+            // The counter wrapped; saturate it.
+            //
+
+            InterlockedExchange(Counter, (LONG)MAXULONG);
+            Value = MAXULONG;
+        }
+
+        if (Value < Estimate) {
+            Estimate = Value;
+        }
+    }
+
+    return Estimate;
+}
+
+FORCEINLINE
+VOID
+UpdateWordSketchHeavyHitters(
+    _In_ PWORD_SKETCH WordSketch,
+    _In_ PCLONG_STRING String,
+    _In_ ULONG Estimate
+    )
+/*++
+
+Routine Description:
+
+    Updates the heavy hitter array with a word and its estimated count.  If
+    the word is already present, its estimate is updated.  Otherwise, it's
+    appended if there's room, or replaces the heavy hitter with the smallest
+    estimate (after refreshing all estimates from the sketch) if the word's
+    estimate is larger.
+
+--*/
+{
+    ULONG Index;
+    ULONG MinimumIndex;
+    ULONG MinimumEstimate;
+    ULONG NumberOfHeavyHitters;
+    LONG_STRING HeavyHitterString;
+    PWORD_SKETCH_HEAVY_HITTER Entry;
+    PWORD_SKETCH_HEAVY_HITTER HeavyHitters;
+
+    AcquireDictionaryLockExclusive(&WordSketch->HeavyHitterLock);
+
+    HeavyHitters = WordSketch->HeavyHitters;
+    NumberOfHeavyHitters = WordSketch->NumberOfHeavyHitters;
+
+    //
+    // Look for the word in the array.
+    //
+
+    for (Index = 0; Index < NumberOfHeavyHitters; Index++) {
+
+        Entry = &HeavyHitters[Index];
+
+        HeavyHitterString.Length = Entry->Length;
+        HeavyHitterString.Hash = Entry->Hash;
+        HeavyHitterString.Buffer = Entry->Buffer;
+
+        if (IsSameWord(&HeavyHitterString, String)) {
+            if (Estimate > Entry->Estimate) {
+                Entry->Estimate = Estimate;
+            }
+            goto UpdateMinimum;
+        }
+    }
+
+    if (NumberOfHeavyHitters < WordSketch->MaximumNumberOfHeavyHitters) {
+
+        //
+        // There's room for the word; append it.
+        //
+
+        Entry = &HeavyHitters[NumberOfHeavyHitters];
+        WordSketch->NumberOfHeavyHitters = ++NumberOfHeavyHitters;
+
+    } else {
+
+        //
+        // The array is full.  Refresh the estimates and find the smallest.
+        //
+
+        MinimumIndex = 0;
+        MinimumEstimate = MAXULONG;
+
+        for (Index = 0; Index < NumberOfHeavyHitters; Index++) {
+
+            Entry = &HeavyHitters[Index];
+            Entry->Estimate = GetWordSketchEstimate(WordSketch, Entry->Hash);
+
+            if (Entry->Estimate < MinimumEstimate) {
+                MinimumEstimate = Entry->Estimate;
+                MinimumIndex = Index;
+            }
+        }
+
+        if (Estimate <= MinimumEstimate) {
+            goto UpdateMinimum;
+        }
+
+        Entry = &HeavyHitters[MinimumIndex];
+    }
+
+    Entry->Length = String->Length;
+    Entry->Hash = String->Hash;
+    Entry->Estimate = Estimate;
+    CopyMemory(Entry->Buffer, String->Buffer, String->Length);
+    Entry->Buffer[String->Length] = '\0';
+
+UpdateMinimum:
+
+    if (NumberOfHeavyHitters == WordSketch->MaximumNumberOfHeavyHitters) {
+
+        MinimumEstimate = MAXULONG;
+
+        for (Index = 0; Index < NumberOfHeavyHitters; Index++) {
+            if (HeavyHitters[Index].Estimate < MinimumEstimate) {
+                MinimumEstimate = HeavyHitters[Index].Estimate;
+            }
+        }
+
+        WordSketch->MinimumHeavyHitterEstimate = MinimumEstimate;
+    }
+
+    ReleaseDictionaryLockExclusive(&WordSketch->HeavyHitterLock);
+}
+
+FORCEINLINE
+BOOLEAN
+PromoteWordSketchWords(
+    _In_ PWORD_SKETCH WordSketch,
+    _In_ PCBYTE *Words,
+    _In_reads_(NumberOfPromotions) PWORD_SKETCH_PROMOTION Promotions,
+    _In_ ULONG NumberOfPromotions
+    )
+/*++
+
+Routine Description:
+
+    Adds a batch of promoted words to the sketch's dictionary under a single
+    acquisition of the exclusive lock.  A word that is new to the dictionary
+    receives its estimated count; subsequent occurrences each add one.
+
+    Words whose lengths aren't within the dictionary's minimum and maximum
+    word lengths are discarded, consistent with AddWord().
+
+--*/
+{
+    ULONG Index;
+    BOOLEAN Success;
+    LONGLONG EntryCount;
+    ULONGLONG Sequence;
+    PDICTIONARY Dictionary;
+    PDICTIONARY_LOG Log;
+    PCWORD_ENTRY WordEntry;
+    PWORD_SKETCH_PROMOTION Promotion;
+
+    Dictionary = WordSketch->Dictionary;
+
+    AcquireDictionaryLockExclusive(&Dictionary->Lock);
+
+    Log = BeginDictionaryLogOperation(Dictionary, &Sequence);
+
+    if (Dictionary->Flags.IsFrozen) {
+        goto Error;
+    }
+
+    for (Index = 0; Index < NumberOfPromotions; Index++) {
+
+        Promotion = &Promotions[Index];
+
+        if (Promotion->Length < Dictionary->MinimumWordLength ||
+            Promotion->Length > Dictionary->MaximumWordLength) {
+            continue;
+        }
+
+        Success = AddWordEntry(Dictionary,
+                               Words[Promotion->WordIndex],
+                               Promotion->Length,
+                               1,
+                               &WordEntry,
+                               &EntryCount);
+
+        if (!Success) {
+            goto Error;
+        }
+
+        if (EntryCount != 1) {
+            continue;
+        }
+
+        //
+        // This is the word's promotion; account for the occurrences that were
+        // counted by the sketch prior to this one.
+        //
+
+        WordSketch->NumberOfPromotions++;
+
+        if (Promotion->Estimate > 1) {
+
+            Success = AddWordEntry(Dictionary,
+                                   Words[Promotion->WordIndex],
+                                   Promotion->Length,
+                                   (LONGLONG)Promotion->Estimate - 1,
+                                   &WordEntry,
+                                   &EntryCount);
+
+            if (!Success) {
+                goto Error;
+            }
+        }
+    }
+
+    Success = TRUE;
+    goto End;
+
+Error:
+
+    Success = FALSE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    Sequence = EndDictionaryLogOperation(Log, Sequence);
+
+    ReleaseDictionaryLockExclusive(&Dictionary->Lock);
+
+    //
+    // If a write-ahead log is open, wait for the promotions to become durable.
+    //
+
+    if (Log && !WaitForDictionaryLog(Log, Sequence)) {
+        Success = FALSE;
+    }
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CreateWordSketch(
+    PDICTIONARY Dictionary,
+    PALLOCATOR Allocator,
+    ULONG Width,
+    ULONG NumberOfHeavyHitters,
+    LONGLONG PromotionThreshold,
+    PWORD_SKETCH *WordSketchPointer
+    )
+/*++
+
+Routine Description:
+
+    Creates a word sketch.
+
+Arguments:
+
+    Dictionary - Optionally supplies a pointer to a DICTIONARY structure to
+        which words are promoted once their estimated counts reach the value
+        of the PromotionThreshold parameter.
+
+    Allocator - Supplies a pointer to the allocator to use for the sketch.
+        The sketch (including its counters and heavy hitters) is a single
+        allocation.
+
+    Width - Optionally supplies the number of counters in each of the sketch's
+        8 rows.  Must be a power of 2 between 256 and 16M if non-zero.  If
+        zero, a default of 64K is used (i.e. 2MB of counters).  Wider sketches
+        yield more accurate estimates for streams with more distinct words.
+
+    NumberOfHeavyHitters - Optionally supplies the maximum number of heavy
+        hitters to track.  Must not exceed 4096.  If zero, a default of 64 is
+        used.
+
+    PromotionThreshold - Supplies the estimated count at which words are
+        promoted to the dictionary.  Must be greater than zero if a dictionary
+        is provided, and is ignored otherwise.
+
+    WordSketchPointer - Supplies the address of a variable that receives the
+        address of the new WORD_SKETCH structure.  Set to NULL on error.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    PBYTE Buffer;
+    ULONG WidthShift;
+    ULARGE_INTEGER AllocSize;
+    PWORD_SKETCH WordSketch;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(WordSketchPointer)) {
+        return FALSE;
+    }
+
+    *WordSketchPointer = NULL;
+
+    if (!ARGUMENT_PRESENT(Allocator)) {
+        return FALSE;
+    }
+
+    if (ARGUMENT_PRESENT(Dictionary) && PromotionThreshold <= 0) {
+        return FALSE;
+    }
+
+    if (Width == 0) {
+        Width = WORD_SKETCH_DEFAULT_WIDTH;
+    }
+
+    if (!IsPowerOf2(Width) ||
+        Width < WORD_SKETCH_MINIMUM_WIDTH ||
+        Width > WORD_SKETCH_MAXIMUM_WIDTH) {
+        return FALSE;
+    }
+
+    if (NumberOfHeavyHitters == 0) {
+        NumberOfHeavyHitters = WORD_SKETCH_DEFAULT_NUMBER_OF_HEAVY_HITTERS;
+    }
+
+    if (NumberOfHeavyHitters > WORD_SKETCH_MAXIMUM_NUMBER_OF_HEAVY_HITTERS) {
+        return FALSE;
+    }
+
+    WidthShift = 0;
+    while ((1UL << WidthShift) < Width) {
+        WidthShift++;
+    }
+
+    //
+    // Calculate the allocation size: the sketch structure, followed by the
+    // heavy hitters, then the counters.
+    //
+
+    AllocSize.QuadPart = (
+        ALIGN_UP(sizeof(WORD_SKETCH), sizeof(WORD_SKETCH_HEAVY_HITTER)) +
+        ((ULONGLONG)NumberOfHeavyHitters * sizeof(WORD_SKETCH_HEAVY_HITTER)) +
+        ((ULONGLONG)WORD_SKETCH_DEPTH * Width * sizeof(ULONG))
+    );
+
+    Buffer = (PBYTE)Allocator->Calloc(Allocator, 1, AllocSize.QuadPart);
+    if (!Buffer) {
+        return FALSE;
+    }
+
+    WordSketch = (PWORD_SKETCH)Buffer;
+    WordSketch->Allocator = Allocator;
+    WordSketch->Width = Width;
+    WordSketch->WidthShift = WidthShift;
+    WordSketch->MaximumNumberOfHeavyHitters = NumberOfHeavyHitters;
+
+    if (ARGUMENT_PRESENT(Dictionary)) {
+        WordSketch->Dictionary = Dictionary;
+        WordSketch->PromotionThreshold = PromotionThreshold;
+    }
+
+    InitializeDictionaryLock(&WordSketch->HeavyHitterLock);
+
+    Buffer += ALIGN_UP(sizeof(WORD_SKETCH), sizeof(WORD_SKETCH_HEAVY_HITTER));
+    WordSketch->HeavyHitters = (PWORD_SKETCH_HEAVY_HITTER)Buffer;
+    WordSketch->Counters = (PULONG)(
+        WordSketch->HeavyHitters + NumberOfHeavyHitters
+    );
+
+    *WordSketchPointer = WordSketch;
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+CountWordsInSketch(
+    PWORD_SKETCH WordSketch,
+    ULONG NumberOfWords,
+    PCBYTE *Words,
+    PULONG NumberOfWordsCountedPointer
+    )
+/*++
+
+Routine Description:
+
+    Counts a batch of words in a word sketch.  The sketch's counters are
+    updated without acquiring any locks.  If the sketch has a dictionary,
+    words whose estimates reach the promotion threshold are added to it once
+    per 64 words.
+
+Arguments:
+
+    WordSketch - Supplies a pointer to a WORD_SKETCH structure.
+
+    NumberOfWords - Supplies the number of words in the Words array.
+
+    Words - Supplies an array of pointers to NULL-terminated words to count.
+        Empty words are invalid.
+
+    NumberOfWordsCountedPointer - Optionally supplies the address of a variable
+        that receives the number of words that were counted.  On failure, this
+        identifies the offending word.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.  FALSE will be returned if a word is
+    invalid, or if promoting words to the dictionary failed (e.g. because the
+    dictionary has been frozen).  The sketch's counts are retained regardless.
+
+--*/
+{
+    ULONG Index;
+    ULONG Length;
+    ULONG Estimate;
+    ULONG BatchEnd;
+    ULONG BatchStart;
+    ULONG NumberOfPromotions;
+    BOOLEAN Success;
+    PCBYTE Word;
+    LONG_STRING String;
+    PWORD_SKETCH_PROMOTION Promotion;
+    WORD_SKETCH_PROMOTION Promotions[WORD_SKETCH_BATCH_SIZE];
+
+    //
+    // Validate arguments.
+    //
+
+    if (ARGUMENT_PRESENT(NumberOfWordsCountedPointer)) {
+        *NumberOfWordsCountedPointer = 0;
+    }
+
+    if (!ARGUMENT_PRESENT(WordSketch)) {
+        return FALSE;
+    }
+
+    if (NumberOfWords > 0 && !ARGUMENT_PRESENT(Words)) {
+        return FALSE;
+    }
+
+    Index = 0;
+    Success = TRUE;
+
+    while (Index < NumberOfWords && Success) {
+
+        BatchStart = Index;
+        BatchEnd = min(Index + WORD_SKETCH_BATCH_SIZE, NumberOfWords);
+        NumberOfPromotions = 0;
+
+        for (; Index < BatchEnd; Index++) {
+
+            Word = Words[Index];
+
+            if (!Word || !*Word) {
+                Success = FALSE;
+                break;
+            }
+
+            //
+            // Determine the length and hash of the word, then update its
+            // counters.
+            //
+
+            for (Length = 0; Word[Length]; Length++) {
+                NOTHING;
+            }
+
+            String.Length = Length;
+            String.Hash = HashWordString(Word, Length);
+            String.Buffer = (PBYTE)Word;
+
+            Estimate = IncrementWordSketchCounters(WordSketch, String.Hash);
+
+            //
+            // Consider the word for the heavy hitter array.
+            //
+
+            if (Length <= WORD_SKETCH_MAXIMUM_HEAVY_HITTER_LENGTH &&
+                (WordSketch->NumberOfHeavyHitters <
+                 WordSketch->MaximumNumberOfHeavyHitters ||
+                 (Estimate > WordSketch->MinimumHeavyHitterEstimate &&
+                  (Estimate & WORD_SKETCH_HEAVY_HITTER_SAMPLE_MASK) == 0))) {
+
+                UpdateWordSketchHeavyHitters(WordSketch, &String, Estimate);
+            }
+
+            //
+            // Capture a promotion if applicable.
+            //
+
+            if (WordSketch->Dictionary &&
+                (LONGLONG)Estimate >= WordSketch->PromotionThreshold) {
+
+                Promotion = &Promotions[NumberOfPromotions++];
+                Promotion->WordIndex = Index;
+                Promotion->Length = Length;
+                Promotion->Estimate = Estimate;
+            }
+        }
+
+        InterlockedAdd64(&WordSketch->NumberOfWords,
+                         (LONGLONG)(Index - BatchStart));
+
+        if (NumberOfPromotions > 0) {
+            if (!PromoteWordSketchWords(WordSketch,
+                                        Words,
+                                        Promotions,
+                                        NumberOfPromotions)) {
+                Success = FALSE;
+            }
+        }
+    }
+
+    if (ARGUMENT_PRESENT(NumberOfWordsCountedPointer)) {
+        *NumberOfWordsCountedPointer = Index;
+    }
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+EstimateWordCount(
+    PWORD_SKETCH WordSketch,
+    PCBYTE Word,
+    PLONGLONG EstimatePointer
+    )
+/*++
+
+Routine Description:
+
+    Estimates the number of times a word has been counted by a word sketch.
+    The estimate is never less than the actual count.
+
+Arguments:
+
+    WordSketch - Supplies a pointer to a WORD_SKETCH structure.
+
+    Word - Supplies a pointer to the NULL-terminated word to estimate.
+
+    EstimatePointer - Supplies the address of a variable that receives the
+        estimated count.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    ULONG Length;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(EstimatePointer)) {
+        return FALSE;
+    }
+
+    *EstimatePointer = 0;
+
+    if (!ARGUMENT_PRESENT(WordSketch)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Word) || !*Word) {
+        return FALSE;
+    }
+
+    for (Length = 0; Word[Length]; Length++) {
+        NOTHING;
+    }
+
+    *EstimatePointer = GetWordSketchEstimate(WordSketch,
+                                             HashWordString(Word, Length));
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+GetWordSketchHeavyHitters(
+    PWORD_SKETCH WordSketch,
+    PALLOCATOR Allocator,
+    PLINKED_WORD_LIST *LinkedWordListPointer
+    )
+/*++
+
+Routine Description:
+
+    Obtains the heavy hitters of a word sketch, in descending order of their
+    estimated counts.  The estimate of each word is reported via the entry
+    count (and maximum entry count) of its word entry.
+
+Arguments:
+
+    WordSketch - Supplies a pointer to a WORD_SKETCH structure.
+
+    Allocator - Supplies a pointer to an ALLOCATOR structure that will be used
+        to allocate the memory that backs the address returned via the param
+        LinkedWordListPointer.
+
+    LinkedWordListPointer - Supplies the address of a variable that receives
+        the address of a LINKED_WORD_LIST structure (allocated via Allocator),
+        or NULL if no words have been counted.  The pointer must be freed via
+        the Allocator once the user has finished with the structure.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    ULONG Index;
+    ULONG Estimate;
+    ULONG NumberOfHeavyHitters;
+    PBYTE Buffer;
+    PBYTE StringBuffer;
+    BOOLEAN Success;
+    ULONGLONG AllocSize;
+    PLIST_ENTRY ListHead;
+    PLIST_ENTRY ListEntry;
+    PWORD_ENTRY WordEntry;
+    PLINKED_WORD_LIST LinkedWordList;
+    PLINKED_WORD_ENTRY LinkedWordEntry;
+    PLINKED_WORD_ENTRY PreviousLinkedWordEntry;
+    PWORD_SKETCH_HEAVY_HITTER Entry;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(LinkedWordListPointer)) {
+        return FALSE;
+    }
+
+    *LinkedWordListPointer = NULL;
+
+    if (!ARGUMENT_PRESENT(WordSketch)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Allocator)) {
+        return FALSE;
+    }
+
+    AcquireDictionaryLockShared(&WordSketch->HeavyHitterLock);
+
+    NumberOfHeavyHitters = WordSketch->NumberOfHeavyHitters;
+
+    if (NumberOfHeavyHitters == 0) {
+        Success = TRUE;
+        goto End;
+    }
+
+    //
+    // Calculate the allocation size: the list, followed by the entries, then
+    // the string buffers.
+    //
+
+    AllocSize = (
+        sizeof(LINKED_WORD_LIST) +
+        ((ULONGLONG)NumberOfHeavyHitters * sizeof(LINKED_WORD_ENTRY))
+    );
+
+    for (Index = 0; Index < NumberOfHeavyHitters; Index++) {
+        AllocSize += WordSketch->HeavyHitters[Index].Length + 1;
+    }
+
+    Buffer = (PBYTE)Allocator->Calloc(Allocator, 1, (SIZE_T)AllocSize);
+    if (!Buffer) {
+        Success = FALSE;
+        goto End;
+    }
+
+    LinkedWordList = (PLINKED_WORD_LIST)Buffer;
+    InitializeListHead(&LinkedWordList->ListHead);
+    ListHead = &LinkedWordList->ListHead;
+
+    LinkedWordEntry = (PLINKED_WORD_ENTRY)(Buffer + sizeof(LINKED_WORD_LIST));
+    StringBuffer = (PBYTE)(LinkedWordEntry + NumberOfHeavyHitters);
+
+    for (Index = 0; Index < NumberOfHeavyHitters; Index++, LinkedWordEntry++) {
+
+        Entry = &WordSketch->HeavyHitters[Index];
+        Estimate = GetWordSketchEstimate(WordSketch, Entry->Hash);
+
+        CopyMemory(StringBuffer, Entry->Buffer, Entry->Length + 1);
+
+        WordEntry = &LinkedWordEntry->WordEntry;
+        WordEntry->String.Length = Entry->Length;
+        WordEntry->String.Hash = Entry->Hash;
+        WordEntry->String.Buffer = StringBuffer;
+        WordEntry->Stats.EntryCount = Estimate;
+        WordEntry->Stats.MaximumEntryCount = Estimate;
+
+        StringBuffer += Entry->Length + 1;
+
+        //
+        // Insert the entry after the last entry with a greater or equal
+        // estimate, such that the list is in descending order.
+        //
+
+        ListEntry = ListHead->Blink;
+
+        while (ListEntry != ListHead) {
+
+            PreviousLinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                        LINKED_WORD_ENTRY,
+                                                        ListEntry);
+
+            if (PreviousLinkedWordEntry->WordEntry.Stats.EntryCount >=
+                (LONGLONG)Estimate) {
+                break;
+            }
+
+            ListEntry = ListEntry->Blink;
+        }
+
+        InsertHeadList(ListEntry, &LinkedWordEntry->ListEntry);
+        LinkedWordList->NumberOfEntries++;
+    }
+
+    ASSERT(StringBuffer == Buffer + AllocSize);
+
+    *LinkedWordListPointer = LinkedWordList;
+    Success = TRUE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    ReleaseDictionaryLockShared(&WordSketch->HeavyHitterLock);
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+DestroyWordSketch(
+    PWORD_SKETCH *WordSketchPointer
+    )
+/*++
+
+Routine Description:
+
+    Destroys a word sketch.  Words that have been promoted remain in the
+    dictionary.
+
+Arguments:
+
+    WordSketchPointer - Supplies the address of a variable that contains the
+        address of the WORD_SKETCH structure to destroy.  The variable will
+        be cleared.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    PALLOCATOR Allocator;
+    PWORD_SKETCH WordSketch;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(WordSketchPointer)) {
+        return FALSE;
+    }
+
+    WordSketch = *WordSketchPointer;
+
+    if (!ARGUMENT_PRESENT(WordSketch)) {
+        return FALSE;
+    }
+
+    Allocator = WordSketch->Allocator;
+    Allocator->FreePointer(Allocator, (PPVOID)WordSketchPointer);
+
+    return TRUE;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
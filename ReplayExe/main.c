@@ -0,0 +1,244 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    main.c
+
+Abstract:
+
+    This module implements the replay tool, which replays a dictionary
+    recording (created via StartDictionaryRecording()) against a new
+    dictionary and prints statistics about the replay.
+
+    Usage: replay.exe <path> [-interleaved] [-timed]
+
+    -interleaved replays the calls on one thread per recorded thread, in the
+    order they were recorded; -timed replays the calls with their original
+    timing.  By default, the calls are replayed in order on a single thread as
+    fast as possible.
+
+--*/
+
+#include "stdafx.h"
+
+RTL GlobalRtl;
+ALLOCATOR GlobalAllocator;
+
+PRTL Rtl;
+PALLOCATOR Allocator;
+
+DICTIONARY_FUNCTIONS GlobalApi;
+PDICTIONARY_FUNCTIONS Api;
+
+HMODULE GlobalModule = 0;
+
+FORCEINLINE
+BOOLEAN
+IsEqualArgument(
+    _In_z_ PCWSTR Argument,
+    _In_z_ PCWSTR Expected
+    )
+{
+    while (*Argument && *Argument == *Expected) {
+        Argument++;
+        Expected++;
+    }
+
+    return (*Argument == *Expected);
+}
+
+VOID
+AppendIntegerToCharBuffer(
+    _Inout_ PPCHAR BufferPointer,
+    _In_ ULONGLONG Integer
+    )
+{
+    PCHAR Buffer;
+    PCHAR Dest;
+    USHORT NumberOfDigits;
+    ULONGLONG Value;
+
+    Buffer = *BufferPointer;
+
+    //
+    // Write the digits back-to-front.
+    //
+
+    NumberOfDigits = CountNumberOfLongLongDigitsInline(Integer);
+    Dest = Buffer + NumberOfDigits - 1;
+    Value = Integer;
+
+    do {
+        *Dest-- = (CHAR)('0' + (Value % 10));
+        Value /= 10;
+    } while (Value != 0);
+
+    *BufferPointer = Buffer + NumberOfDigits;
+}
+
+VOID
+AppendCharBufferToCharBuffer(
+    _Inout_ PPCHAR BufferPointer,
+    _In_ PCHAR String,
+    _In_ ULONG SizeInBytes
+    )
+{
+    PVOID Buffer;
+
+    Buffer = *BufferPointer;
+    CopyMemory(Buffer, String, SizeInBytes);
+    *BufferPointer = RtlOffsetToPointer(Buffer, SizeInBytes);
+}
+
+#define OUTPUT_RAW(String) \
+    AppendCharBufferToCharBuffer(&Output, String, sizeof(String)-1)
+
+#define OUTPUT_INT(Value) AppendIntegerToCharBuffer(&Output, Value)
+
+#define OUTPUT_LF() *Output++ = '\n'
+
+#define OUTPUT_STAT(Name, Value) \
+    OUTPUT_RAW(Name ": ");       \
+    OUTPUT_INT(Value);           \
+    OUTPUT_LF()
+
+BOOLEAN
+Replay(
+    _In_ PRTL Rtl,
+    _In_ PALLOCATOR Allocator,
+    _In_ PDICTIONARY_FUNCTIONS Api,
+    _In_z_ PCWSTR Path,
+    _In_ DICTIONARY_REPLAY_FLAGS Flags
+    )
+{
+    BOOLEAN Success;
+    BOOLEAN IsProcessTerminating;
+    PCHAR Output;
+    CHAR OutputBuffer[1024];
+    ULONG BytesWritten;
+    HANDLE OutputHandle;
+    PDICTIONARY Dictionary;
+    DICTIONARY_REPLAY_STATS Stats;
+    DICTIONARY_CREATE_FLAGS CreateFlags;
+
+    CreateFlags.AsULong = 0;
+    IsProcessTerminating = TRUE;
+
+    if (!Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)) {
+        return FALSE;
+    }
+
+    Success = Api->ReplayDictionaryRecording(Api,
+                                             Dictionary,
+                                             Allocator,
+                                             Path,
+                                             Flags,
+                                             &Stats);
+
+    Api->DestroyDictionary(&Dictionary, &IsProcessTerminating);
+
+    if (!Success) {
+        return FALSE;
+    }
+
+    Output = OutputBuffer;
+
+    OUTPUT_STAT("Records", Stats.NumberOfRecords);
+    OUTPUT_STAT("AddWord", Stats.NumberOfAddWords);
+    OUTPUT_STAT("RemoveWord", Stats.NumberOfRemoveWords);
+    OUTPUT_STAT("FindWord", Stats.NumberOfFindWords);
+    OUTPUT_STAT("GetWordAnagrams", Stats.NumberOfGetWordAnagrams);
+    OUTPUT_STAT("FailedCalls", Stats.NumberOfFailedCalls);
+    OUTPUT_STAT("DroppedRecords", Stats.NumberOfDroppedRecords);
+    OUTPUT_STAT("Threads", Stats.NumberOfThreads);
+    OUTPUT_STAT("RecordedMicroseconds", Stats.RecordedMicroseconds);
+    OUTPUT_STAT("ElapsedMicroseconds", Stats.ElapsedMicroseconds);
+
+    OutputHandle = GetStdHandle(STD_OUTPUT_HANDLE);
+
+    return (BOOLEAN)WriteFile(OutputHandle,
+                              OutputBuffer,
+                              (ULONG)(Output - OutputBuffer),
+                              &BytesWritten,
+                              NULL);
+}
+
+DECLSPEC_NORETURN
+VOID
+WINAPI
+mainCRTStartup()
+{
+    LONG Index;
+    LONG ExitCode = 1;
+    INT NumberOfArguments;
+    LONG SizeOfRtl = sizeof(GlobalRtl);
+    PPWSTR ArgvW;
+    HMODULE RtlModule;
+    RTL_BOOTSTRAP Bootstrap;
+    DICTIONARY_REPLAY_FLAGS Flags;
+
+    if (!BootstrapRtl(&RtlModule, &Bootstrap)) {
+        goto Error;
+    }
+
+    if (!Bootstrap.InitializeHeapAllocator(&GlobalAllocator)) {
+        goto Error;
+    }
+
+    CHECKED_MSG(
+        Bootstrap.InitializeRtl(&GlobalRtl, &SizeOfRtl),
+        "InitializeRtl()"
+    );
+
+    Rtl = &GlobalRtl;
+    Allocator = &GlobalAllocator;
+
+    SetCSpecificHandler(Rtl->__C_specific_handler);
+
+    CHECKED_MSG(
+        LoadDictionaryModule(
+            Rtl,
+            &GlobalModule,
+            &GlobalApi
+        ),
+        "LoadDictionaryModule"
+    );
+
+    Api = &GlobalApi;
+
+    //
+    // Parse the command line.
+    //
+
+    ArgvW = CommandLineToArgvW(GetCommandLineW(), &NumberOfArguments);
+
+    if (!ArgvW || NumberOfArguments < 2) {
+        ExitCode = 2;
+        goto Error;
+    }
+
+    Flags.AsULong = 0;
+
+    for (Index = 2; Index < NumberOfArguments; Index++) {
+        if (IsEqualArgument(ArgvW[Index], L"-interleaved")) {
+            Flags.PreserveThreadInterleaving = TRUE;
+        } else if (IsEqualArgument(ArgvW[Index], L"-timed")) {
+            Flags.PreserveTiming = TRUE;
+        } else {
+            ExitCode = 2;
+            goto Error;
+        }
+    }
+
+    if (Replay(Rtl, Allocator, Api, ArgvW[1], Flags)) {
+        ExitCode = 0;
+    }
+
+Error:
+
+    ExitProcess(ExitCode);
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
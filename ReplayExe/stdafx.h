@@ -0,0 +1,24 @@
+/*++
+
+Copyright (c) 2018 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    stdafx.h
+
+Abstract:
+
+    This is the precompiled header file for the ReplayExe component.
+
+--*/
+
+#pragma once
+
+#include "targetver.h"
+
+#include <Windows.h>
+#include "../Rtl/Rtl.h"
+#include "../Rtl/__C_specific_handler.h"
+#include "../Dictionary/Dictionary.h"
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
@@ -0,0 +1 @@
+#include <SDKDDKVer.h>
@@ -104,6 +104,44 @@ End:
     return Success;
 }
 
+typedef struct _ANAGRAM_CLASS_TEST_CONTEXT {
+    volatile LONG NumberOfClasses;
+    volatile LONG NumberOfWords;
+    volatile LONG LargestClass;
+    LONG MaximumNumberOfClasses;
+    volatile LONGLONG TotalEntryCount;
+} ANAGRAM_CLASS_TEST_CONTEXT;
+typedef ANAGRAM_CLASS_TEST_CONTEXT *PANAGRAM_CLASS_TEST_CONTEXT;
+
+BOOLEAN
+NTAPI
+AnagramClassTestCallback(
+    PVOID Context,
+    PCANAGRAM_CLASS AnagramClass
+    )
+{
+    LONG NumberOfClasses;
+    PANAGRAM_CLASS_TEST_CONTEXT TestContext;
+
+    TestContext = (PANAGRAM_CLASS_TEST_CONTEXT)Context;
+
+    NumberOfClasses = InterlockedIncrement(&TestContext->NumberOfClasses);
+    InterlockedAdd(&TestContext->NumberOfWords,
+                   (LONG)AnagramClass->NumberOfWords);
+    InterlockedAdd64(&TestContext->TotalEntryCount,
+                     AnagramClass->TotalEntryCount);
+
+    if (AnagramClass->NumberOfWords == 3) {
+        InterlockedExchange(&TestContext->LargestClass, 3);
+    }
+
+    if (TestContext->MaximumNumberOfClasses == 0) {
+        return TRUE;
+    }
+
+    return (NumberOfClasses < TestContext->MaximumNumberOfClasses);
+}
+
 
 TEST_MODULE_INITIALIZE(UnitTest1Init)
 {
@@ -1521,6 +1559,3523 @@ namespace TestDictionary
             );
         }
 
+        TEST_METHOD(AddWordInlineConversion1)
+        {
+            BOOLEAN Exists;
+            LONGLONG EntryCount;
+            PDICTIONARY Dictionary;
+            PDICTIONARY_STATS Stats;
+            PLINKED_WORD_LIST LinkedWordList;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            BOOLEAN IsProcessTerminating;
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &Dictionary)
+            );
+
+            //
+            // Add the first word; it will be stored inline within its
+            // histogram table entry and become the longest word.
+            //
+
+            Assert::IsTrue(Api->AddWord(Dictionary, QuickFox, &EntryCount));
+            Assert::IsTrue(EntryCount == 1);
+
+            Assert::IsTrue(Api->AddWord(Dictionary, QuickFox, &EntryCount));
+            Assert::IsTrue(EntryCount == 2);
+
+            //
+            // Add an anagram, which converts the inline word into a word
+            // table entry.  Verify the longest word pointers were updated.
+            //
+
+            Assert::IsTrue(Api->AddWord(Dictionary, LazyDog, &EntryCount));
+            Assert::IsTrue(EntryCount == 1);
+
+            Assert::IsTrue(
+                Api->GetDictionaryStats(Dictionary,
+                                        Allocator,
+                                        &Stats)
+            );
+
+            Assert::AreEqual(
+                (PCSZ)QuickFox,
+                (PCSZ)Stats->CurrentLongestWord->Buffer
+            );
+
+            Assert::AreEqual(
+                (PCSZ)QuickFox,
+                (PCSZ)Stats->LongestWordAllTime->Buffer
+            );
+
+            Allocator->FreePointer(Allocator, (PPVOID)&Stats);
+
+            Assert::IsTrue(Api->FindWord(Dictionary, QuickFox, &Exists));
+            Assert::IsTrue(Exists);
+
+            Assert::IsTrue(Api->FindWord(Dictionary, LazyDog, &Exists));
+            Assert::IsTrue(Exists);
+
+            Assert::IsTrue(Api->AddWord(Dictionary, QuickFox, &EntryCount));
+            Assert::IsTrue(EntryCount == 3);
+
+            //
+            // Verify the anagram relationship survived the conversion.
+            //
+
+            Assert::IsTrue(
+                Api->GetWordAnagrams(Dictionary,
+                                     Allocator,
+                                     QuickFox,
+                                     &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 1);
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            //
+            // Remove an inline word (elbow has no anagrams present).
+            //
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(EntryCount == 1);
+
+            Assert::IsTrue(
+                Api->GetWordAnagrams(Dictionary,
+                                     Allocator,
+                                     Elbow,
+                                     &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList == NULL);
+
+            Assert::IsTrue(Api->FindWord(Dictionary, Below, &Exists));
+            Assert::IsFalse(Exists);
+
+            Assert::IsTrue(Api->RemoveWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(EntryCount == 0);
+
+            Assert::IsTrue(Api->FindWord(Dictionary, Elbow, &Exists));
+            Assert::IsFalse(Exists);
+
+            //
+            // Re-add elbow inline, then remove the converted words.
+            //
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(EntryCount == 1);
+
+            Assert::IsTrue(Api->RemoveWord(Dictionary, LazyDog, &EntryCount));
+            Assert::IsTrue(EntryCount == 0);
+
+            Assert::IsTrue(Api->FindWord(Dictionary, QuickFox, &Exists));
+            Assert::IsTrue(Exists);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(GetDictionaryMemoryUsage1)
+        {
+            LONGLONG EntryCount;
+            PDICTIONARY Dictionary;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_MEMORY_USAGE Usage;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+
+            CreateFlags.AsULong = 0;
+            CreateFlags.TrackMemoryUsage = TRUE;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &Dictionary)
+            );
+
+            Assert::IsFalse(Api->GetDictionaryMemoryUsage(NULL, &Usage));
+            Assert::IsFalse(Api->GetDictionaryMemoryUsage(Dictionary, NULL));
+
+            Assert::IsTrue(Api->GetDictionaryMemoryUsage(Dictionary, &Usage));
+            Assert::IsTrue(Usage.SizeOfStruct == sizeof(Usage));
+            Assert::IsTrue(Usage.Flags.IsTrackingEnabled != FALSE);
+            Assert::IsTrue(Usage.NumberOfWords == 0);
+            Assert::IsTrue(Usage.NumberOfStringBytes == 0);
+            Assert::IsTrue(Usage.BitmapTable.NumberOfTables == 1);
+            Assert::IsTrue(Usage.BitmapTable.NumberOfNodes == 0);
+
+            //
+            // Elbow and below share a histogram (and thus a word table);
+            // the quick fox has its own histogram and is stored inline.
+            //
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Below, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, QuickFox, &EntryCount));
+
+            Assert::IsTrue(Api->GetDictionaryMemoryUsage(Dictionary, &Usage));
+
+            Assert::IsTrue(Usage.NumberOfWords == 3);
+            Assert::IsTrue(Usage.NumberOfInlineWords == 1);
+            Assert::IsTrue(Usage.NumberOfInlineStrings == 2);
+            Assert::IsTrue(
+                Usage.NumberOfStringBytes == (
+                    (ElbowLength + 1) +
+                    (BelowLength + 1) +
+                    (QuickFoxLength + 1)
+                )
+            );
+
+            Assert::IsTrue(Usage.BitmapTable.NumberOfNodes == 2);
+            Assert::IsTrue(Usage.HistogramTable.NumberOfTables == 2);
+            Assert::IsTrue(Usage.HistogramTable.NumberOfNodes == 2);
+            Assert::IsTrue(Usage.WordTable.NumberOfTables == 1);
+            Assert::IsTrue(Usage.WordTable.NumberOfNodes == 2);
+            Assert::IsTrue(Usage.LengthTable.NumberOfNodes == 2);
+
+            Assert::IsTrue(Usage.BitmapTable.MaximumDepth == 2);
+            Assert::IsTrue(Usage.BitmapTable.AverageDepth == 1.5);
+            Assert::IsTrue(Usage.TotalNumberOfBytes > Usage.NumberOfStringBytes);
+            Assert::IsTrue(Usage.OverheadRatio > 0.0);
+
+            //
+            // Verify the tracking allocators agree with the table walk.
+            //
+
+            Assert::IsTrue(
+                Usage.BitmapTableAllocator.NumberOfAllocations ==
+                Usage.BitmapTable.NumberOfNodes
+            );
+
+            Assert::IsTrue(
+                Usage.BitmapTableAllocator.NumberOfBytes ==
+                Usage.BitmapTable.NumberOfBytes
+            );
+
+            Assert::IsTrue(
+                Usage.WordTableAllocator.NumberOfBytes ==
+                Usage.WordTable.NumberOfBytes
+            );
+
+            //
+            // Elbow and below are short enough to be stored inline within
+            // their word table entries; only the quick fox has a string
+            // buffer allocated by the word allocator.
+            //
+
+            Assert::IsTrue(Usage.WordAllocator.NumberOfAllocations == 1);
+            Assert::IsTrue(
+                Usage.WordAllocator.NumberOfBytes == QuickFoxLength + 1
+            );
+
+            //
+            // Remove all the words.  Every table node should be freed; the
+            // word allocator will have one outstanding allocation for the
+            // copy of the longest word of all time.
+            //
+
+            Assert::IsTrue(Api->RemoveWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(Api->RemoveWord(Dictionary, Below, &EntryCount));
+            Assert::IsTrue(Api->RemoveWord(Dictionary, QuickFox, &EntryCount));
+
+            Assert::IsTrue(Api->GetDictionaryMemoryUsage(Dictionary, &Usage));
+
+            Assert::IsTrue(Usage.NumberOfWords == 0);
+            Assert::IsTrue(Usage.BitmapTableAllocator.NumberOfAllocations == 0);
+            Assert::IsTrue(
+                Usage.HistogramTableAllocator.NumberOfAllocations == 0
+            );
+            Assert::IsTrue(Usage.WordTableAllocator.NumberOfAllocations == 0);
+            Assert::IsTrue(Usage.LengthTableAllocator.NumberOfAllocations == 0);
+            Assert::IsTrue(Usage.WordAllocator.NumberOfAllocations == 1);
+            Assert::IsTrue(Usage.WordAllocator.TotalFrees == 1);
+            Assert::IsTrue(
+                Usage.WordAllocator.PeakNumberOfBytes >= QuickFoxLength + 1
+            );
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+
+        TEST_METHOD(CompactDictionary1)
+        {
+            ULONG Steps;
+            BOOLEAN Exists;
+            BOOLEAN IsComplete;
+            LONGLONG EntryCount;
+            PDICTIONARY Dictionary;
+            PLIST_ENTRY ListEntry;
+            PWORD_ENTRY WordEntry;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_MEMORY_USAGE Usage;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            PLINKED_WORD_LIST LinkedWordList;
+            PLINKED_WORD_ENTRY LinkedWordEntry;
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &Dictionary)
+            );
+
+            Assert::IsFalse(Api->CompactDictionary(NULL, 0, &IsComplete));
+            Assert::IsFalse(Api->CompactDictionary(Dictionary, 0, NULL));
+
+            //
+            // Compacting an empty dictionary completes immediately.
+            //
+
+            Assert::IsTrue(Api->CompactDictionary(Dictionary, 0, &IsComplete));
+            Assert::IsTrue(IsComplete != FALSE);
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Below, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, QuickFox, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, LazyDog, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(EntryCount == 2);
+            Assert::IsTrue(Api->RemoveWord(Dictionary, LazyDog, &EntryCount));
+
+            //
+            // Compact one bitmap table entry per step.
+            //
+
+            Steps = 0;
+            do {
+                Assert::IsTrue(
+                    Api->CompactDictionary(Dictionary, 1, &IsComplete)
+                );
+                Steps++;
+            } while (!IsComplete);
+
+            Assert::IsTrue(Steps == 3);
+
+            Assert::IsTrue(Api->GetDictionaryMemoryUsage(Dictionary, &Usage));
+            Assert::IsTrue(Usage.NumberOfWords == 3);
+            Assert::IsTrue(Usage.NumberOfArenaChunks == 2);
+            Assert::IsTrue(Usage.NumberOfArenaBytes > 0);
+
+            //
+            // Verify lookups, anagrams and counts survive relocation.
+            //
+
+            Assert::IsTrue(Api->FindWord(Dictionary, Elbow, &Exists));
+            Assert::IsTrue(Exists != FALSE);
+            Assert::IsTrue(Api->FindWord(Dictionary, QuickFox, &Exists));
+            Assert::IsTrue(Exists != FALSE);
+            Assert::IsTrue(Api->FindWord(Dictionary, LazyDog, &Exists));
+            Assert::IsTrue(Exists == FALSE);
+
+            Assert::IsTrue(
+                Api->GetWordAnagrams(Dictionary,
+                                     Allocator,
+                                     Elbow,
+                                     &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 1);
+
+            ListEntry = RemoveHeadList(&LinkedWordList->ListHead);
+
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual(
+                (PCSZ)Below,
+                (PCSZ)WordEntry->String.Buffer
+            );
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            //
+            // Words added after compaction live alongside relocated ones; a
+            // second pass relocates everything again and frees the old chunks.
+            //
+
+            Assert::IsTrue(Api->AddWord(Dictionary, LazyDog, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(EntryCount == 3);
+
+            Assert::IsTrue(Api->CompactDictionary(Dictionary, 0, &IsComplete));
+            Assert::IsTrue(IsComplete != FALSE);
+
+            Assert::IsTrue(Api->GetDictionaryMemoryUsage(Dictionary, &Usage));
+            Assert::IsTrue(Usage.NumberOfArenaChunks == 1);
+
+            //
+            // Removing every word releases the final chunk.
+            //
+
+            Assert::IsTrue(Api->RemoveWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(EntryCount == 2);
+            Assert::IsTrue(Api->RemoveWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(Api->RemoveWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(Api->RemoveWord(Dictionary, Below, &EntryCount));
+            Assert::IsTrue(Api->RemoveWord(Dictionary, QuickFox, &EntryCount));
+            Assert::IsTrue(Api->RemoveWord(Dictionary, LazyDog, &EntryCount));
+
+            Assert::IsTrue(Api->GetDictionaryMemoryUsage(Dictionary, &Usage));
+            Assert::IsTrue(Usage.NumberOfWords == 0);
+            Assert::IsTrue(Usage.NumberOfArenaChunks == 0);
+            Assert::IsTrue(Usage.NumberOfArenaBytes == 0);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(FreezeDictionary1)
+        {
+            BOOLEAN Exists;
+            BOOLEAN IsComplete;
+            LONGLONG EntryCount;
+            WORD_STATS WordStats;
+            PDICTIONARY Dictionary;
+            PLIST_ENTRY ListEntry;
+            PWORD_ENTRY WordEntry;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_MEMORY_USAGE Usage;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            PLINKED_WORD_LIST LinkedWordList;
+            PLINKED_WORD_ENTRY LinkedWordEntry;
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &Dictionary)
+            );
+
+            Assert::IsFalse(Api->FreezeDictionary(NULL));
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Below, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, QuickFox, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, LazyDog, &EntryCount));
+
+            //
+            // Compact the dictionary first such that some nodes and strings
+            // live in arena chunks; freezing should release all of them.
+            //
+
+            Assert::IsTrue(Api->CompactDictionary(Dictionary, 0, &IsComplete));
+            Assert::IsTrue(IsComplete != FALSE);
+
+            Assert::IsTrue(Api->FreezeDictionary(Dictionary));
+            Assert::IsFalse(Api->FreezeDictionary(Dictionary));
+
+            //
+            // Verify lookups.
+            //
+
+            Assert::IsTrue(Api->FindWord(Dictionary, Elbow, &Exists));
+            Assert::IsTrue(Exists != FALSE);
+            Assert::IsTrue(Api->FindWord(Dictionary, Below, &Exists));
+            Assert::IsTrue(Exists != FALSE);
+            Assert::IsTrue(Api->FindWord(Dictionary, QuickFox, &Exists));
+            Assert::IsTrue(Exists != FALSE);
+            Assert::IsTrue(Api->FindWord(Dictionary, LazyDog, &Exists));
+            Assert::IsTrue(Exists != FALSE);
+            Assert::IsTrue(Api->FindWord(Dictionary, QuickLazy, &Exists));
+            Assert::IsTrue(Exists == FALSE);
+
+            Assert::IsTrue(Api->GetWordStats(Dictionary, Elbow, &WordStats));
+            Assert::IsTrue(WordStats.EntryCount == 2);
+            Assert::IsTrue(WordStats.MaximumEntryCount == 2);
+
+            //
+            // Verify anagrams.
+            //
+
+            Assert::IsTrue(
+                Api->GetWordAnagrams(Dictionary,
+                                     Allocator,
+                                     QuickFox,
+                                     &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 1);
+
+            ListEntry = RemoveHeadList(&LinkedWordList->ListHead);
+
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual(
+                (PCSZ)LazyDog,
+                (PCSZ)WordEntry->String.Buffer
+            );
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            //
+            // Verify the dictionary can't be modified.
+            //
+
+            Assert::IsFalse(Api->AddWord(Dictionary, QuickLazy, &EntryCount));
+            Assert::IsTrue(EntryCount == 0);
+            Assert::IsFalse(Api->RemoveWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(EntryCount == -1);
+            Assert::IsFalse(
+                Api->CompactDictionary(Dictionary, 0, &IsComplete)
+            );
+
+            //
+            // Verify memory usage.
+            //
+
+            Assert::IsTrue(Api->GetDictionaryMemoryUsage(Dictionary, &Usage));
+            Assert::IsTrue(Usage.Flags.IsFrozen != FALSE);
+            Assert::IsTrue(Usage.NumberOfWords == 4);
+            Assert::IsTrue(
+                Usage.NumberOfStringBytes == (
+                    (ElbowLength + 1) +
+                    (BelowLength + 1) +
+                    (QuickFoxLength + 1) +
+                    (LazyDogLength + 1)
+                )
+            );
+            Assert::IsTrue(Usage.NumberOfFrozenBytes > 0);
+            Assert::IsTrue(Usage.NumberOfArenaChunks == 0);
+            Assert::IsTrue(Usage.BitmapTable.NumberOfNodes == 0);
+            Assert::IsTrue(Usage.LengthTable.NumberOfNodes == 0);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(FreezeDictionaryNumaReplicas1)
+        {
+            BOOLEAN Exists;
+            LONGLONG EntryCount;
+            WORD_STATS WordStats;
+            PDICTIONARY Dictionary;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_MEMORY_USAGE Usage;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            PLINKED_WORD_LIST LinkedWordList;
+
+            CreateFlags.AsULong = 0;
+            CreateFlags.UseNumaReplicas = TRUE;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &Dictionary)
+            );
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Below, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, QuickFox, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, LazyDog, &EntryCount));
+
+            Assert::IsTrue(Api->FreezeDictionary(Dictionary));
+
+            //
+            // Lookups are serviced by the replica local to the current node
+            // (or the primary frozen dictionary on single-node systems).
+            //
+
+            Assert::IsTrue(Api->FindWord(Dictionary, Elbow, &Exists));
+            Assert::IsTrue(Exists != FALSE);
+            Assert::IsTrue(Api->FindWord(Dictionary, LazyDog, &Exists));
+            Assert::IsTrue(Exists != FALSE);
+            Assert::IsTrue(Api->FindWord(Dictionary, QuickLazy, &Exists));
+            Assert::IsTrue(Exists == FALSE);
+
+            Assert::IsTrue(Api->GetWordStats(Dictionary, Below, &WordStats));
+            Assert::IsTrue(WordStats.EntryCount == 1);
+
+            Assert::IsTrue(
+                Api->GetWordAnagrams(Dictionary,
+                                     Allocator,
+                                     Elbow,
+                                     &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 1);
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            //
+            // Verify memory usage; each replica is a full copy of the frozen
+            // dictionary.
+            //
+
+            Assert::IsTrue(Api->GetDictionaryMemoryUsage(Dictionary, &Usage));
+            Assert::IsTrue(Usage.Flags.IsFrozen != FALSE);
+            Assert::IsTrue(
+                Usage.NumberOfNumaReplicaBytes == (
+                    Usage.NumberOfNumaReplicas *
+                    Usage.NumberOfFrozenBytes
+                )
+            );
+            Assert::IsTrue(
+                Usage.TotalNumberOfBytes >= (
+                    Usage.NumberOfFrozenBytes +
+                    Usage.NumberOfNumaReplicaBytes
+                )
+            );
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(GetWordsWithPrefix1)
+        {
+            ULONG Index;
+            LONGLONG EntryCount;
+            PDICTIONARY Dictionary;
+            PLIST_ENTRY ListEntry;
+            PWORD_ENTRY WordEntry;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_MEMORY_USAGE Usage;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            PLINKED_WORD_LIST LinkedWordList;
+            PLINKED_WORD_ENTRY LinkedWordEntry;
+            PCBYTE Car = (PCBYTE)"car";
+            PCBYTE Cart = (PCBYTE)"cart";
+            PCBYTE Care = (PCBYTE)"care";
+            PCBYTE Cat = (PCBYTE)"cat";
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            //
+            // Verify dictionaries without a prefix index fail the call.
+            //
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &Dictionary)
+            );
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsFalse(
+                Api->GetWordsWithPrefix(Dictionary,
+                                        Allocator,
+                                        (PCBYTE)"el",
+                                        10,
+                                        &LinkedWordList)
+            );
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+
+            //
+            // Create a dictionary with a prefix index and add some words.
+            //
+
+            CreateFlags.MaintainPrefixIndex = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &Dictionary)
+            );
+
+            for (Index = 0; Index < 3; Index++) {
+                Assert::IsTrue(Api->AddWord(Dictionary, Car, &EntryCount));
+            }
+
+            for (Index = 0; Index < 5; Index++) {
+                Assert::IsTrue(Api->AddWord(Dictionary, Cart, &EntryCount));
+            }
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Care, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Cat, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Cat, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Below, &EntryCount));
+
+            //
+            // Verify the top two completions of "car" are "cart" and "car".
+            //
+
+            Assert::IsTrue(
+                Api->GetWordsWithPrefix(Dictionary,
+                                        Allocator,
+                                        Car,
+                                        2,
+                                        &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 2);
+
+            ListEntry = LinkedWordList->ListHead.Flink;
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual("cart", (PCSZ)WordEntry->String.Buffer);
+            Assert::IsTrue(WordEntry->String.Length == 4);
+            Assert::IsTrue(WordEntry->Stats.EntryCount == 5);
+
+            ListEntry = ListEntry->Flink;
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual("car", (PCSZ)WordEntry->String.Buffer);
+            Assert::IsTrue(WordEntry->Stats.EntryCount == 3);
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            //
+            // Verify all completions of "ca" are returned in descending order
+            // of entry count.
+            //
+
+            Assert::IsTrue(
+                Api->GetWordsWithPrefix(Dictionary,
+                                        Allocator,
+                                        (PCBYTE)"ca",
+                                        100,
+                                        &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 4);
+
+            EntryCount = MAXLONGLONG;
+
+            for (ListEntry = LinkedWordList->ListHead.Flink;
+                 ListEntry != &LinkedWordList->ListHead;
+                 ListEntry = ListEntry->Flink) {
+
+                LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                    LINKED_WORD_ENTRY,
+                                                    ListEntry);
+                WordEntry = &LinkedWordEntry->WordEntry;
+                Assert::IsTrue(WordEntry->Stats.EntryCount <= EntryCount);
+                EntryCount = WordEntry->Stats.EntryCount;
+            }
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            //
+            // Verify prefixes with no words return success and a NULL list.
+            //
+
+            Assert::IsTrue(
+                Api->GetWordsWithPrefix(Dictionary,
+                                        Allocator,
+                                        (PCBYTE)"dog",
+                                        10,
+                                        &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList == NULL);
+
+            //
+            // Remove "cart" entirely and verify "car" is now the top result.
+            //
+
+            for (Index = 0; Index < 5; Index++) {
+                Assert::IsTrue(Api->RemoveWord(Dictionary, Cart, &EntryCount));
+            }
+
+            Assert::IsTrue(EntryCount == 0);
+
+            Assert::IsTrue(
+                Api->GetWordsWithPrefix(Dictionary,
+                                        Allocator,
+                                        Car,
+                                        10,
+                                        &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 2);
+
+            ListEntry = LinkedWordList->ListHead.Flink;
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual("car", (PCSZ)WordEntry->String.Buffer);
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            //
+            // Verify the index is reported by the memory usage.  There are
+            // 10 nodes remaining: c-a-r-e, the t of "cat", and b-e-l-o-w.
+            //
+
+            Assert::IsTrue(Api->GetDictionaryMemoryUsage(Dictionary, &Usage));
+            Assert::IsTrue(Usage.NumberOfPrefixIndexNodes == 10);
+            Assert::IsTrue(Usage.NumberOfPrefixIndexBytes > 0);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(GetSimilarWords1)
+        {
+            ULONG Index;
+            LONGLONG EntryCount;
+            PDICTIONARY Dictionary;
+            PLIST_ENTRY ListEntry;
+            PWORD_ENTRY WordEntry;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            PLINKED_WORD_LIST LinkedWordList;
+            PLINKED_WORD_ENTRY LinkedWordEntry;
+            PCBYTE Car = (PCBYTE)"car";
+            PCBYTE Cart = (PCBYTE)"cart";
+            PCBYTE Care = (PCBYTE)"care";
+            PCBYTE Cat = (PCBYTE)"cat";
+            BYTE Long[71];
+            BYTE LongTypo[71];
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            //
+            // Initialize a word too long for the bit-parallel kernel, plus a
+            // variant with a single substitution.
+            //
+
+            for (Index = 0; Index < 70; Index++) {
+                Long[Index] = (BYTE)('a' + (Index % 26));
+                LongTypo[Index] = Long[Index];
+            }
+
+            Long[70] = '\0';
+            LongTypo[70] = '\0';
+            LongTypo[35] = 'Z';
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &Dictionary)
+            );
+
+            for (Index = 0; Index < 3; Index++) {
+                Assert::IsTrue(Api->AddWord(Dictionary, Car, &EntryCount));
+            }
+
+            for (Index = 0; Index < 5; Index++) {
+                Assert::IsTrue(Api->AddWord(Dictionary, Cart, &EntryCount));
+            }
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Care, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Cat, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Cat, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Long, &EntryCount));
+
+            //
+            // Verify a single substitution finds "car" only.
+            //
+
+            Assert::IsTrue(
+                Api->GetSimilarWords(Dictionary,
+                                     Allocator,
+                                     (PCBYTE)"cqr",
+                                     1,
+                                     10,
+                                     &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 1);
+
+            ListEntry = LinkedWordList->ListHead.Flink;
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual("car", (PCSZ)WordEntry->String.Buffer);
+            Assert::IsTrue(WordEntry->Stats.EntryCount == 3);
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            //
+            // Verify the words at distance 1 of "caat" ("cart" and "cat") are
+            // returned in descending order of entry count, and that the word
+            // count limit is honored.
+            //
+
+            for (Index = 0; Index < 2; Index++) {
+
+                Assert::IsTrue(
+                    Api->GetSimilarWords(Dictionary,
+                                         Allocator,
+                                         (PCBYTE)"caat",
+                                         1,
+                                         10,
+                                         &LinkedWordList)
+                );
+
+                Assert::IsTrue(LinkedWordList != NULL);
+                Assert::IsTrue(LinkedWordList->NumberOfEntries == 2);
+
+                ListEntry = LinkedWordList->ListHead.Flink;
+                LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                    LINKED_WORD_ENTRY,
+                                                    ListEntry);
+                WordEntry = &LinkedWordEntry->WordEntry;
+
+                Assert::AreEqual("cart", (PCSZ)WordEntry->String.Buffer);
+
+                ListEntry = ListEntry->Flink;
+                LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                    LINKED_WORD_ENTRY,
+                                                    ListEntry);
+                WordEntry = &LinkedWordEntry->WordEntry;
+
+                Assert::AreEqual("cat", (PCSZ)WordEntry->String.Buffer);
+
+                Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+                Assert::IsTrue(
+                    Api->GetSimilarWords(Dictionary,
+                                         Allocator,
+                                         (PCBYTE)"caat",
+                                         1,
+                                         1,
+                                         &LinkedWordList)
+                );
+
+                Assert::IsTrue(LinkedWordList != NULL);
+                Assert::IsTrue(LinkedWordList->NumberOfEntries == 1);
+                Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+                //
+                // Verify the long word is found via its typo.
+                //
+
+                Assert::IsTrue(
+                    Api->GetSimilarWords(Dictionary,
+                                         Allocator,
+                                         LongTypo,
+                                         2,
+                                         10,
+                                         &LinkedWordList)
+                );
+
+                Assert::IsTrue(LinkedWordList != NULL);
+                Assert::IsTrue(LinkedWordList->NumberOfEntries == 1);
+
+                ListEntry = LinkedWordList->ListHead.Flink;
+                LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                    LINKED_WORD_ENTRY,
+                                                    ListEntry);
+                WordEntry = &LinkedWordEntry->WordEntry;
+
+                Assert::AreEqual((PCSZ)Long, (PCSZ)WordEntry->String.Buffer);
+
+                Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+                //
+                // Verify words with no similar words return success and a
+                // NULL list.
+                //
+
+                Assert::IsTrue(
+                    Api->GetSimilarWords(Dictionary,
+                                         Allocator,
+                                         (PCBYTE)"zzzz",
+                                         1,
+                                         10,
+                                         &LinkedWordList)
+                );
+
+                Assert::IsTrue(LinkedWordList == NULL);
+
+                //
+                // Freeze the dictionary and repeat the checks against the
+                // frozen representation.
+                //
+
+                if (Index == 0) {
+                    Assert::IsTrue(Api->FreezeDictionary(Dictionary));
+                }
+            }
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(AddWordsFromText1)
+        {
+            BOOLEAN Exists;
+            LONGLONG EntryCount;
+            WORD_STATS Stats;
+            PDICTIONARY Dictionary;
+            BOOLEAN IsProcessTerminating;
+            ULONGLONG NumberOfWords;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            DICTIONARY_TOKENIZER_FLAGS TokenizerFlags;
+            CHAR Text[] = "The cat sat; the CAT ran! Cats, dogs & 42 more cats";
+            CHAR Digits[] = "42 x42y";
+
+            CreateFlags.AsULong = 0;
+            TokenizerFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &Dictionary)
+            );
+
+            //
+            // Verify parameter validation.
+            //
+
+            Assert::IsFalse(
+                Api->AddWordsFromText(NULL,
+                                      (PCBYTE)Text,
+                                      sizeof(Text) - 1,
+                                      TokenizerFlags,
+                                      &NumberOfWords)
+            );
+
+            Assert::IsFalse(
+                Api->AddWordsFromText(Dictionary,
+                                      NULL,
+                                      sizeof(Text) - 1,
+                                      TokenizerFlags,
+                                      &NumberOfWords)
+            );
+
+            //
+            // Tokenize the text with case folding.  The words span more than
+            // one block, and the final word ends at the end of the text.
+            //
+
+            TokenizerFlags.FoldCase = TRUE;
+
+            Assert::IsTrue(
+                Api->AddWordsFromText(Dictionary,
+                                      (PCBYTE)Text,
+                                      sizeof(Text) - 1,
+                                      TokenizerFlags,
+                                      &NumberOfWords)
+            );
+
+            Assert::IsTrue(NumberOfWords == 10);
+
+            Assert::IsTrue(Api->GetWordStats(Dictionary,
+                                             (PCBYTE)"the",
+                                             &Stats));
+            Assert::IsTrue(Stats.EntryCount == 2);
+
+            Assert::IsTrue(Api->GetWordStats(Dictionary,
+                                             (PCBYTE)"cat",
+                                             &Stats));
+            Assert::IsTrue(Stats.EntryCount == 2);
+
+            Assert::IsTrue(Api->GetWordStats(Dictionary,
+                                             (PCBYTE)"cats",
+                                             &Stats));
+            Assert::IsTrue(Stats.EntryCount == 2);
+
+            Assert::IsTrue(Api->FindWord(Dictionary,
+                                         (PCBYTE)"The",
+                                         &Exists));
+            Assert::IsFalse(Exists);
+
+            //
+            // Verify words added from text are found by the NULL-terminated
+            // insert path.
+            //
+
+            Assert::IsTrue(Api->AddWord(Dictionary,
+                                        (PCBYTE)"dogs",
+                                        &EntryCount));
+            Assert::IsTrue(EntryCount == 2);
+
+            //
+            // Verify digits are only treated as word characters when
+            // requested.
+            //
+
+            TokenizerFlags.FoldCase = FALSE;
+
+            Assert::IsTrue(
+                Api->AddWordsFromText(Dictionary,
+                                      (PCBYTE)Digits,
+                                      sizeof(Digits) - 1,
+                                      TokenizerFlags,
+                                      &NumberOfWords)
+            );
+
+            Assert::IsTrue(NumberOfWords == 2);
+
+            Assert::IsTrue(Api->FindWord(Dictionary, (PCBYTE)"42", &Exists));
+            Assert::IsFalse(Exists);
+
+            TokenizerFlags.IncludeDigits = TRUE;
+
+            Assert::IsTrue(
+                Api->AddWordsFromText(Dictionary,
+                                      (PCBYTE)Digits,
+                                      sizeof(Digits) - 1,
+                                      TokenizerFlags,
+                                      &NumberOfWords)
+            );
+
+            Assert::IsTrue(NumberOfWords == 2);
+
+            Assert::IsTrue(Api->FindWord(Dictionary, (PCBYTE)"42", &Exists));
+            Assert::IsTrue(Exists);
+
+            Assert::IsTrue(Api->FindWord(Dictionary,
+                                         (PCBYTE)"x42y",
+                                         &Exists));
+            Assert::IsTrue(Exists);
+
+            //
+            // Verify frozen dictionaries can't be added to.
+            //
+
+            Assert::IsTrue(Api->FreezeDictionary(Dictionary));
+
+            Assert::IsFalse(
+                Api->AddWordsFromText(Dictionary,
+                                      (PCBYTE)Text,
+                                      sizeof(Text) - 1,
+                                      TokenizerFlags,
+                                      &NumberOfWords)
+            );
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(WordCounter1)
+        {
+            ULONG Index;
+            CHAR Word[4];
+            BOOLEAN Exists;
+            LONGLONG EntryCount;
+            WORD_STATS Stats;
+            PDICTIONARY Dictionary;
+            PWORD_COUNTER WordCounter;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            PCBYTE Elbow = (PCBYTE)"elbow";
+            PCBYTE Below = (PCBYTE)"below";
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &Dictionary)
+            );
+
+            //
+            // Verify parameter validation.
+            //
+
+            Assert::IsFalse(
+                Api->CreateWordCounter(NULL, Allocator, 0, &WordCounter)
+            );
+            Assert::IsTrue(WordCounter == NULL);
+
+            Assert::IsFalse(
+                Api->CreateWordCounter(Dictionary, Allocator, 24, &WordCounter)
+            );
+
+            Assert::IsFalse(
+                Api->CreateWordCounter(Dictionary, Allocator, 8, &WordCounter)
+            );
+
+            //
+            // Create the smallest counter possible (16 slots, flushed at 8
+            // words), such that counting more words forces a flush.
+            //
+
+            Assert::IsTrue(
+                Api->CreateWordCounter(Dictionary, Allocator, 16, &WordCounter)
+            );
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(EntryCount == 1);
+
+            for (Index = 0; Index < 5; Index++) {
+                Assert::IsTrue(Api->CountWord(WordCounter, Elbow));
+            }
+
+            Assert::IsTrue(Api->CountWord(WordCounter, Below));
+
+            //
+            // Verify counts aren't visible until flushed.
+            //
+
+            Assert::IsTrue(Api->GetWordStats(Dictionary, Elbow, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 1);
+
+            Assert::IsTrue(Api->FindWord(Dictionary, Below, &Exists));
+            Assert::IsFalse(Exists);
+
+            Assert::IsTrue(Api->FlushWordCounter(WordCounter));
+
+            Assert::IsTrue(Api->GetWordStats(Dictionary, Elbow, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 6);
+            Assert::IsTrue(Stats.MaximumEntryCount == 6);
+
+            Assert::IsTrue(Api->GetWordStats(Dictionary, Below, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 1);
+
+            //
+            // Count 26 distinct words three times each, which overflows the
+            // counter several times.
+            //
+
+            Word[1] = 'x';
+            Word[2] = 'y';
+            Word[3] = '\0';
+
+            for (Index = 0; Index < 26 * 3; Index++) {
+                Word[0] = (CHAR)('a' + (Index % 26));
+                Assert::IsTrue(Api->CountWord(WordCounter, (PCBYTE)Word));
+            }
+
+            Assert::IsTrue(
+                Api->DestroyWordCounter(&WordCounter)
+            );
+            Assert::IsTrue(WordCounter == NULL);
+
+            for (Index = 0; Index < 26; Index++) {
+                Word[0] = (CHAR)('a' + Index);
+                Assert::IsTrue(
+                    Api->GetWordStats(Dictionary, (PCBYTE)Word, &Stats)
+                );
+                Assert::IsTrue(Stats.EntryCount == 3);
+                Assert::IsTrue(Stats.MaximumEntryCount == 3);
+            }
+
+            //
+            // Verify counts can't be flushed to a frozen dictionary, and are
+            // retained by the counter.
+            //
+
+            Assert::IsTrue(
+                Api->CreateWordCounter(Dictionary, Allocator, 0, &WordCounter)
+            );
+
+            Assert::IsTrue(Api->CountWord(WordCounter, Elbow));
+            Assert::IsTrue(Api->FreezeDictionary(Dictionary));
+            Assert::IsFalse(Api->FlushWordCounter(WordCounter));
+            Assert::IsFalse(Api->DestroyWordCounter(&WordCounter));
+            Assert::IsTrue(WordCounter == NULL);
+
+            Assert::IsTrue(Api->GetWordStats(Dictionary, Elbow, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 6);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(SetOperations1)
+        {
+            ULONG Index;
+            BOOLEAN Exists;
+            LONGLONG EntryCount;
+            WORD_STATS Stats;
+            PDICTIONARY Left;
+            PDICTIONARY Right;
+            PDICTIONARY Merged;
+            PDICTIONARY Common;
+            PDICTIONARY Difference;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            PCBYTE Elbow = (PCBYTE)"elbow";
+            PCBYTE Below = (PCBYTE)"below";
+            PCBYTE Cat = (PCBYTE)"cat";
+            PCBYTE Dog = (PCBYTE)"dog";
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Left)
+            );
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Right)
+            );
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Merged)
+            );
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Common)
+            );
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &Difference)
+            );
+
+            //
+            // Left: elbow x 3, below x 1, cat x 2.  ("elbow" and "below" share
+            // a histogram, and thus a word table.)
+            //
+            // Right: elbow x 1, cat x 2, dog x 4.
+            //
+
+            for (Index = 0; Index < 3; Index++) {
+                Assert::IsTrue(Api->AddWord(Left, Elbow, &EntryCount));
+            }
+
+            Assert::IsTrue(Api->AddWord(Left, Below, &EntryCount));
+
+            for (Index = 0; Index < 2; Index++) {
+                Assert::IsTrue(Api->AddWord(Left, Cat, &EntryCount));
+                Assert::IsTrue(Api->AddWord(Right, Cat, &EntryCount));
+            }
+
+            Assert::IsTrue(Api->AddWord(Right, Elbow, &EntryCount));
+
+            for (Index = 0; Index < 4; Index++) {
+                Assert::IsTrue(Api->AddWord(Right, Dog, &EntryCount));
+            }
+
+            //
+            // Verify parameter validation.
+            //
+
+            Assert::IsFalse(Api->MergeDictionaries(NULL, Left, Right));
+            Assert::IsFalse(Api->MergeDictionaries(Left, Left, Right));
+
+            //
+            // Verify the merge.
+            //
+
+            Assert::IsTrue(Api->MergeDictionaries(Merged, Left, Right));
+
+            Assert::IsTrue(Api->GetWordStats(Merged, Elbow, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 4);
+            Assert::IsTrue(Stats.MaximumEntryCount == 4);
+
+            Assert::IsTrue(Api->GetWordStats(Merged, Below, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 1);
+
+            Assert::IsTrue(Api->GetWordStats(Merged, Cat, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 4);
+
+            Assert::IsTrue(Api->GetWordStats(Merged, Dog, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 4);
+
+            //
+            // Verify the intersection.
+            //
+
+            Assert::IsTrue(Api->IntersectDictionaries(Common, Left, Right));
+
+            Assert::IsTrue(Api->GetWordStats(Common, Elbow, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 1);
+
+            Assert::IsTrue(Api->GetWordStats(Common, Cat, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 2);
+
+            Assert::IsTrue(Api->FindWord(Common, Below, &Exists));
+            Assert::IsFalse(Exists);
+
+            Assert::IsTrue(Api->FindWord(Common, Dog, &Exists));
+            Assert::IsFalse(Exists);
+
+            //
+            // Verify the difference.
+            //
+
+            Assert::IsTrue(Api->DiffDictionaries(Difference, Left, Right));
+
+            Assert::IsTrue(Api->GetWordStats(Difference, Elbow, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 2);
+
+            Assert::IsTrue(Api->GetWordStats(Difference, Below, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 1);
+
+            Assert::IsTrue(Api->FindWord(Difference, Cat, &Exists));
+            Assert::IsFalse(Exists);
+
+            Assert::IsTrue(Api->FindWord(Difference, Dog, &Exists));
+            Assert::IsFalse(Exists);
+
+            //
+            // Verify merging into a non-empty dictionary adds to its counts.
+            //
+
+            Assert::IsTrue(Api->MergeDictionaries(Merged, Left, Left));
+
+            Assert::IsTrue(Api->GetWordStats(Merged, Elbow, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 10);
+
+            //
+            // Verify frozen sources are rejected.
+            //
+
+            Assert::IsTrue(Api->FreezeDictionary(Right));
+            Assert::IsFalse(Api->MergeDictionaries(Merged, Left, Right));
+
+            Assert::IsTrue(Api->DestroyDictionary(&Left,
+                                                  &IsProcessTerminating));
+            Assert::IsTrue(Api->DestroyDictionary(&Right,
+                                                  &IsProcessTerminating));
+            Assert::IsTrue(Api->DestroyDictionary(&Merged,
+                                                  &IsProcessTerminating));
+            Assert::IsTrue(Api->DestroyDictionary(&Common,
+                                                  &IsProcessTerminating));
+            Assert::IsTrue(Api->DestroyDictionary(&Difference,
+                                                  &IsProcessTerminating));
+        }
+
+        TEST_METHOD(ExportDictionary1)
+        {
+            ULONG Index;
+            ULONG NumberOfBlocks;
+            PVOID Buffer;
+            BOOLEAN Exists;
+            LONGLONG EntryCount;
+            WORD_STATS Stats;
+            ULONGLONG SizeInBytes;
+            ULONGLONG NumberOfWords;
+            PDICTIONARY Source;
+            PDICTIONARY Copy;
+            PDICTIONARY Partial;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            BYTE Word[5];
+            PCBYTE Elbow = (PCBYTE)"elbow";
+            PCBYTE Below = (PCBYTE)"below";
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Source)
+            );
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Copy)
+            );
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Partial)
+            );
+
+            //
+            // Add enough words to span multiple blocks: "waaa", "waab", etc.
+            //
+
+            Word[0] = 'w';
+            Word[4] = '\0';
+
+            for (Index = 0; Index < 2000; Index++) {
+                Word[1] = (BYTE)('a' + ((Index / 676) % 26));
+                Word[2] = (BYTE)('a' + ((Index / 26) % 26));
+                Word[3] = (BYTE)('a' + (Index % 26));
+                Assert::IsTrue(Api->AddWord(Source, Word, &EntryCount));
+            }
+
+            //
+            // Add elbow x 3 and remove it once, such that its maximum entry
+            // count differs from its entry count.
+            //
+
+            for (Index = 0; Index < 3; Index++) {
+                Assert::IsTrue(Api->AddWord(Source, Elbow, &EntryCount));
+            }
+
+            Assert::IsTrue(Api->RemoveWord(Source, Elbow, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Source, Below, &EntryCount));
+
+            //
+            // Export the dictionary.
+            //
+
+            Assert::IsFalse(Api->ExportDictionary(Source,
+                                                  Allocator,
+                                                  NULL,
+                                                  &SizeInBytes,
+                                                  NULL));
+
+            Assert::IsTrue(Api->ExportDictionary(Source,
+                                                 Allocator,
+                                                 &Buffer,
+                                                 &SizeInBytes,
+                                                 &NumberOfBlocks));
+
+            Assert::IsTrue(NumberOfBlocks > 1);
+
+            //
+            // Import everything into the copy and verify the counts.
+            //
+
+            Assert::IsFalse(Api->ImportDictionary(Copy,
+                                                  Buffer,
+                                                  SizeInBytes - 1,
+                                                  0,
+                                                  0,
+                                                  NULL));
+
+            Assert::IsTrue(Api->ImportDictionary(Copy,
+                                                 Buffer,
+                                                 SizeInBytes,
+                                                 0,
+                                                 0,
+                                                 &NumberOfWords));
+
+            Assert::IsTrue(NumberOfWords == 2002);
+
+            Assert::IsTrue(Api->GetWordStats(Copy, Elbow, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 2);
+            Assert::IsTrue(Stats.MaximumEntryCount == 3);
+
+            Assert::IsTrue(Api->GetWordStats(Copy, Below, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 1);
+
+            Assert::IsTrue(Api->GetWordStats(Copy, Word, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 1);
+
+            //
+            // Import just the first block; the last "w" word sorts after both
+            // "below" and "elbow", so it shouldn't be present.
+            //
+
+            Assert::IsFalse(Api->ImportDictionary(Partial,
+                                                  Buffer,
+                                                  SizeInBytes,
+                                                  NumberOfBlocks,
+                                                  1,
+                                                  NULL));
+
+            Assert::IsTrue(Api->ImportDictionary(Partial,
+                                                 Buffer,
+                                                 SizeInBytes,
+                                                 0,
+                                                 1,
+                                                 &NumberOfWords));
+
+            Assert::IsTrue(NumberOfWords < 2002);
+
+            Assert::IsTrue(Api->FindWord(Partial, Below, &Exists));
+            Assert::IsTrue(Exists);
+
+            Assert::IsTrue(Api->FindWord(Partial, Word, &Exists));
+            Assert::IsFalse(Exists);
+
+            //
+            // Corrupt a byte of the last block and verify the checksum catches
+            // it.
+            //
+
+            ((PBYTE)Buffer)[SizeInBytes - 1] ^= 0xff;
+
+            Assert::IsFalse(Api->ImportDictionary(Partial,
+                                                  Buffer,
+                                                  SizeInBytes,
+                                                  NumberOfBlocks - 1,
+                                                  1,
+                                                  NULL));
+
+            Allocator->FreePointer(Allocator, (PPVOID)&Buffer);
+
+            //
+            // Verify frozen dictionaries can be exported, but not imported
+            // into.
+            //
+
+            Assert::IsTrue(Api->FreezeDictionary(Source));
+
+            Assert::IsTrue(Api->ExportDictionary(Source,
+                                                 Allocator,
+                                                 &Buffer,
+                                                 &SizeInBytes,
+                                                 NULL));
+
+            Assert::IsFalse(Api->ImportDictionary(Source,
+                                                  Buffer,
+                                                  SizeInBytes,
+                                                  0,
+                                                  0,
+                                                  NULL));
+
+            Allocator->FreePointer(Allocator, (PPVOID)&Buffer);
+
+            Assert::IsTrue(Api->DestroyDictionary(&Source,
+                                                  &IsProcessTerminating));
+            Assert::IsTrue(Api->DestroyDictionary(&Copy,
+                                                  &IsProcessTerminating));
+            Assert::IsTrue(Api->DestroyDictionary(&Partial,
+                                                  &IsProcessTerminating));
+        }
+
+        TEST_METHOD(WordLengths1)
+        {
+            ULONG Index;
+            ULONG Length;
+            LONGLONG EntryCount;
+            PDICTIONARY Dictionary;
+            PLIST_ENTRY ListEntry;
+            PWORD_ENTRY WordEntry;
+            BOOLEAN IsProcessTerminating;
+            PLINKED_WORD_LIST LinkedWordList;
+            PLINKED_WORD_ENTRY LinkedWordEntry;
+            PWORD_LENGTH_HISTOGRAM Histogram;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            PCBYTE Words[] = {
+                (PCBYTE)"cat",
+                (PCBYTE)"dog",
+                (PCBYTE)"cart",
+                (PCBYTE)"horse",
+                (PCBYTE)"zebra",
+                (PCBYTE)"elbow",
+            };
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            for (Index = 0; Index < ARRAYSIZE(Words); Index++) {
+                Assert::IsTrue(Api->AddWord(Dictionary,
+                                            Words[Index],
+                                            &EntryCount));
+            }
+
+            //
+            // Adding a duplicate shouldn't affect the length counts, removing
+            // a word should.
+            //
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Words[0], &EntryCount));
+            Assert::IsTrue(Api->RemoveWord(Dictionary, Words[1], &EntryCount));
+
+            //
+            // Verify the histogram: 3 x 1, 4 x 1, 5 x 3.
+            //
+
+            Assert::IsFalse(
+                Api->GetWordLengthHistogram(Dictionary, Allocator, NULL)
+            );
+
+            Assert::IsTrue(
+                Api->GetWordLengthHistogram(Dictionary, Allocator, &Histogram)
+            );
+
+            Assert::IsTrue(Histogram->NumberOfWords == 5);
+            Assert::IsTrue(Histogram->NumberOfLengths == 3);
+            Assert::IsTrue(Histogram->Counts[0].Length == 3);
+            Assert::IsTrue(Histogram->Counts[0].NumberOfWords == 1);
+            Assert::IsTrue(Histogram->Counts[1].Length == 4);
+            Assert::IsTrue(Histogram->Counts[1].NumberOfWords == 1);
+            Assert::IsTrue(Histogram->Counts[2].Length == 5);
+            Assert::IsTrue(Histogram->Counts[2].NumberOfWords == 3);
+
+            Allocator->FreePointer(Allocator, (PPVOID)&Histogram);
+
+            //
+            // Verify range enumeration.
+            //
+
+            Assert::IsFalse(
+                Api->EnumerateWordsByLengthRange(Dictionary,
+                                                 Allocator,
+                                                 5,
+                                                 4,
+                                                 &LinkedWordList)
+            );
+
+            Assert::IsTrue(
+                Api->EnumerateWordsByLengthRange(Dictionary,
+                                                 Allocator,
+                                                 6,
+                                                 10,
+                                                 &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList == NULL);
+
+            Assert::IsTrue(
+                Api->EnumerateWordsByLengthRange(Dictionary,
+                                                 Allocator,
+                                                 4,
+                                                 5,
+                                                 &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 4);
+
+            ListEntry = LinkedWordList->ListHead.Flink;
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual("cart", (PCSZ)WordEntry->String.Buffer);
+
+            Length = 0;
+
+            for (ListEntry = LinkedWordList->ListHead.Flink;
+                 ListEntry != &LinkedWordList->ListHead;
+                 ListEntry = ListEntry->Flink) {
+
+                LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                    LINKED_WORD_ENTRY,
+                                                    ListEntry);
+                WordEntry = &LinkedWordEntry->WordEntry;
+                Assert::IsTrue(WordEntry->String.Length >= Length);
+                Length = WordEntry->String.Length;
+            }
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            //
+            // Verify both queries against the frozen dictionary.
+            //
+
+            Assert::IsTrue(Api->FreezeDictionary(Dictionary));
+
+            Assert::IsTrue(
+                Api->GetWordLengthHistogram(Dictionary, Allocator, &Histogram)
+            );
+
+            Assert::IsTrue(Histogram->NumberOfWords == 5);
+            Assert::IsTrue(Histogram->NumberOfLengths == 3);
+            Assert::IsTrue(Histogram->Counts[2].Length == 5);
+            Assert::IsTrue(Histogram->Counts[2].NumberOfWords == 3);
+
+            Allocator->FreePointer(Allocator, (PPVOID)&Histogram);
+
+            Assert::IsTrue(
+                Api->EnumerateWordsByLengthRange(Dictionary,
+                                                 Allocator,
+                                                 0,
+                                                 3,
+                                                 &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 1);
+
+            ListEntry = LinkedWordList->ListHead.Flink;
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual("cat", (PCSZ)WordEntry->String.Buffer);
+            Assert::IsTrue(WordEntry->Stats.EntryCount == 2);
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(AnagramClasses1)
+        {
+            ULONG Index;
+            LONGLONG EntryCount;
+            ULONGLONG NumberOfClasses;
+            PDICTIONARY Dictionary;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            DICTIONARY_ANAGRAM_CLASS_FLAGS Flags;
+            ANAGRAM_CLASS_TEST_CONTEXT Context;
+            PCBYTE Words[] = {
+                (PCBYTE)"elbow",
+                (PCBYTE)"below",
+                (PCBYTE)"bowel",
+                (PCBYTE)"cat",
+                (PCBYTE)"act",
+                (PCBYTE)"cat",
+                (PCBYTE)"dog",
+                (PCBYTE)"horse",
+            };
+
+            CreateFlags.AsULong = 0;
+            Flags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            for (Index = 0; Index < ARRAYSIZE(Words); Index++) {
+                Assert::IsTrue(Api->AddWord(Dictionary,
+                                            Words[Index],
+                                            &EntryCount));
+            }
+
+            ZeroStruct(Context);
+
+            Assert::IsFalse(
+                Api->EnumerateAnagramClasses(Dictionary,
+                                             0,
+                                             Flags,
+                                             NULL,
+                                             &Context,
+                                             &NumberOfClasses)
+            );
+
+            //
+            // Every class: {elbow, below, bowel}, {cat, act}, {dog}, {horse}.
+            //
+
+            Assert::IsTrue(
+                Api->EnumerateAnagramClasses(Dictionary,
+                                             0,
+                                             Flags,
+                                             AnagramClassTestCallback,
+                                             &Context,
+                                             &NumberOfClasses)
+            );
+
+            Assert::IsTrue(NumberOfClasses == 4);
+            Assert::IsTrue(Context.NumberOfClasses == 4);
+            Assert::IsTrue(Context.NumberOfWords == 7);
+            Assert::IsTrue(Context.LargestClass == 3);
+            Assert::IsTrue(Context.TotalEntryCount == 8);
+
+            //
+            // Only classes with at least two words.
+            //
+
+            ZeroStruct(Context);
+
+            Assert::IsTrue(
+                Api->EnumerateAnagramClasses(Dictionary,
+                                             2,
+                                             Flags,
+                                             AnagramClassTestCallback,
+                                             &Context,
+                                             &NumberOfClasses)
+            );
+
+            Assert::IsTrue(NumberOfClasses == 2);
+            Assert::IsTrue(Context.NumberOfWords == 5);
+            Assert::IsTrue(Context.TotalEntryCount == 6);
+
+            ZeroStruct(Context);
+
+            Assert::IsTrue(
+                Api->EnumerateAnagramClasses(Dictionary,
+                                             3,
+                                             Flags,
+                                             AnagramClassTestCallback,
+                                             &Context,
+                                             &NumberOfClasses)
+            );
+
+            Assert::IsTrue(NumberOfClasses == 1);
+            Assert::IsTrue(Context.LargestClass == 3);
+
+            //
+            // Stop the enumeration after the first class.
+            //
+
+            ZeroStruct(Context);
+            Context.MaximumNumberOfClasses = 1;
+
+            Assert::IsTrue(
+                Api->EnumerateAnagramClasses(Dictionary,
+                                             0,
+                                             Flags,
+                                             AnagramClassTestCallback,
+                                             &Context,
+                                             &NumberOfClasses)
+            );
+
+            Assert::IsTrue(NumberOfClasses == 1);
+            Assert::IsTrue(Context.NumberOfClasses == 1);
+
+            //
+            // Parallel enumeration should yield the same classes.
+            //
+
+            ZeroStruct(Context);
+            Flags.Parallel = TRUE;
+
+            Assert::IsTrue(
+                Api->EnumerateAnagramClasses(Dictionary,
+                                             0,
+                                             Flags,
+                                             AnagramClassTestCallback,
+                                             &Context,
+                                             &NumberOfClasses)
+            );
+
+            Assert::IsTrue(NumberOfClasses == 4);
+            Assert::IsTrue(Context.NumberOfWords == 7);
+
+            //
+            // Verify the frozen dictionary, both serially and in parallel.
+            //
+
+            Assert::IsTrue(Api->FreezeDictionary(Dictionary));
+
+            ZeroStruct(Context);
+
+            Assert::IsTrue(
+                Api->EnumerateAnagramClasses(Dictionary,
+                                             2,
+                                             Flags,
+                                             AnagramClassTestCallback,
+                                             &Context,
+                                             &NumberOfClasses)
+            );
+
+            Assert::IsTrue(NumberOfClasses == 2);
+            Assert::IsTrue(Context.NumberOfWords == 5);
+            Assert::IsTrue(Context.LargestClass == 3);
+
+            ZeroStruct(Context);
+            Flags.Parallel = FALSE;
+
+            Assert::IsTrue(
+                Api->EnumerateAnagramClasses(Dictionary,
+                                             0,
+                                             Flags,
+                                             AnagramClassTestCallback,
+                                             &Context,
+                                             &NumberOfClasses)
+            );
+
+            Assert::IsTrue(NumberOfClasses == 4);
+            Assert::IsTrue(Context.TotalEntryCount == 8);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(DictionaryService1)
+        {
+            ULONG NumberOfRequests;
+            ULONGLONG Sequence;
+            ULONGLONG Sequences[3];
+            PDICTIONARY Dictionary;
+            BOOLEAN IsProcessTerminating;
+            PDICTIONARY_SERVICE Service;
+            PDICTIONARY_SERVICE_CLIENT Client;
+            PDICTIONARY_SERVICE_CLIENT Client2;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            DICTIONARY_SERVICE_RESPONSE Response;
+            PCWSTR Name = L"Local\\DictionaryService1";
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            Assert::IsFalse(
+                Api->CreateDictionaryService(Dictionary, Name, 1, 3, &Service)
+            );
+
+            Assert::IsTrue(
+                Api->CreateDictionaryService(Dictionary, Name, 1, 4, &Service)
+            );
+
+            Assert::IsTrue(
+                Api->OpenDictionaryServiceClient(Allocator, Name, &Client)
+            );
+
+            //
+            // Only one client is permitted.
+            //
+
+            Assert::IsFalse(
+                Api->OpenDictionaryServiceClient(Allocator, Name, &Client2)
+            );
+
+            //
+            // Submit a batch of requests and process them in one pass.
+            //
+
+            Assert::IsTrue(
+                Api->SubmitDictionaryServiceRequest(
+                    Client,
+                    DictionaryServiceAddWordRequest,
+                    Elbow,
+                    &Sequences[0]
+                )
+            );
+
+            Assert::IsTrue(
+                Api->SubmitDictionaryServiceRequest(
+                    Client,
+                    DictionaryServiceAddWordRequest,
+                    Below,
+                    &Sequences[1]
+                )
+            );
+
+            Assert::IsTrue(
+                Api->SubmitDictionaryServiceRequest(
+                    Client,
+                    DictionaryServiceAddWordRequest,
+                    Elbow,
+                    &Sequences[2]
+                )
+            );
+
+            Assert::IsTrue(
+                Api->ProcessDictionaryServiceRequests(Service,
+                                                      &NumberOfRequests)
+            );
+
+            Assert::IsTrue(NumberOfRequests == 3);
+
+            Assert::IsTrue(
+                Api->GetDictionaryServiceResponse(Client,
+                                                  Sequences[2],
+                                                  &Response)
+            );
+
+            Assert::IsTrue(Response.Success);
+            Assert::IsTrue(Response.EntryCount == 2);
+
+            //
+            // Find and anagram requests.
+            //
+
+            Assert::IsTrue(
+                Api->SubmitDictionaryServiceRequest(
+                    Client,
+                    DictionaryServiceFindWordRequest,
+                    Below,
+                    &Sequences[0]
+                )
+            );
+
+            Assert::IsTrue(
+                Api->SubmitDictionaryServiceRequest(
+                    Client,
+                    DictionaryServiceFindWordRequest,
+                    (PCBYTE)"bowel",
+                    &Sequences[1]
+                )
+            );
+
+            Assert::IsTrue(
+                Api->SubmitDictionaryServiceRequest(
+                    Client,
+                    DictionaryServiceGetWordAnagramsRequest,
+                    Elbow,
+                    &Sequences[2]
+                )
+            );
+
+            Assert::IsTrue(
+                Api->ProcessDictionaryServiceRequests(Service,
+                                                      &NumberOfRequests)
+            );
+
+            Assert::IsTrue(NumberOfRequests == 3);
+
+            Assert::IsTrue(
+                Api->GetDictionaryServiceResponse(Client,
+                                                  Sequences[0],
+                                                  &Response)
+            );
+
+            Assert::IsTrue(Response.Success);
+            Assert::IsTrue(Response.Exists);
+
+            Assert::IsTrue(
+                Api->GetDictionaryServiceResponse(Client,
+                                                  Sequences[1],
+                                                  &Response)
+            );
+
+            Assert::IsTrue(Response.Success);
+            Assert::IsFalse(Response.Exists);
+
+            Assert::IsTrue(
+                Api->GetDictionaryServiceResponse(Client,
+                                                  Sequences[2],
+                                                  &Response)
+            );
+
+            Assert::IsTrue(Response.Success);
+            Assert::IsFalse(Response.Truncated);
+            Assert::IsTrue(Response.NumberOfWords == 1);
+            Assert::AreEqual("below", (PCSZ)Response.Words);
+
+            //
+            // The first batch's slots have since been reused.
+            //
+
+            Assert::IsFalse(
+                Api->GetDictionaryServiceResponse(Client, 0, &Response)
+            );
+
+            Assert::IsTrue(
+                Api->ProcessDictionaryServiceRequests(Service,
+                                                      &NumberOfRequests)
+            );
+
+            Assert::IsTrue(NumberOfRequests == 0);
+
+            //
+            // Invalid requests are rejected by the client.
+            //
+
+            Assert::IsFalse(
+                Api->SubmitDictionaryServiceRequest(
+                    Client,
+                    DictionaryServiceInvalidRequest,
+                    Elbow,
+                    &Sequence
+                )
+            );
+
+            Assert::IsTrue(Api->CloseDictionaryServiceClient(&Client));
+            Assert::IsTrue(Client == NULL);
+
+            Assert::IsTrue(Api->DestroyDictionaryService(&Service));
+            Assert::IsTrue(Service == NULL);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(Eviction1)
+        {
+            ULONG Index;
+            ULONG Count;
+            BOOLEAN Exists;
+            LONGLONG EntryCount;
+            PDICTIONARY Dictionary;
+            PDICTIONARY_STATS Stats;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_MEMORY_USAGE Usage;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            ULONGLONG NumberOfBytes;
+            ULONGLONG MaximumNumberOfBytes;
+            BYTE ColdWord[] = "coldaa";
+            PCBYTE Longest = (PCBYTE)"antidisestablishment";
+            PCBYTE HotWords[] = {
+                (PCBYTE)"cat",
+                (PCBYTE)"dog",
+                (PCBYTE)"horse",
+            };
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            //
+            // Budgets require the EnableEviction flag.
+            //
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            Assert::IsFalse(Api->SetDictionaryBudget(Dictionary, 4, 0));
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+
+            CreateFlags.EnableEviction = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            //
+            // Byte budgets additionally require TrackMemoryUsage.
+            //
+
+            Assert::IsFalse(Api->SetDictionaryBudget(Dictionary, 0, 1 << 20));
+
+            //
+            // Add the hot words a few times each, and a long word once.
+            //
+
+            for (Index = 0; Index < ARRAYSIZE(HotWords); Index++) {
+                for (Count = 0; Count < 4; Count++) {
+                    Assert::IsTrue(Api->AddWord(Dictionary,
+                                                HotWords[Index],
+                                                &EntryCount));
+                }
+            }
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Longest, &EntryCount));
+            Assert::IsTrue(Api->SetDictionaryBudget(Dictionary, 4, 0));
+
+            //
+            // Stream one-off words through the dictionary, referencing the
+            // hot words as we go.  The long word and all but the most recent
+            // one-off word should be evicted.
+            //
+
+            for (Index = 0; Index < 64; Index++) {
+
+                ColdWord[4] = (BYTE)('a' + (Index / 26));
+                ColdWord[5] = (BYTE)('a' + (Index % 26));
+
+                Assert::IsTrue(Api->AddWord(Dictionary,
+                                            ColdWord,
+                                            &EntryCount));
+                Assert::IsTrue(EntryCount == 1);
+
+                for (Count = 0; Count < ARRAYSIZE(HotWords); Count++) {
+                    Assert::IsTrue(Api->AddWord(Dictionary,
+                                                HotWords[Count],
+                                                &EntryCount));
+                }
+
+                Assert::IsTrue(
+                    Api->GetDictionaryMemoryUsage(Dictionary, &Usage)
+                );
+                Assert::IsTrue(Usage.NumberOfWords == 4);
+            }
+
+            for (Index = 0; Index < ARRAYSIZE(HotWords); Index++) {
+                Assert::IsTrue(Api->FindWord(Dictionary,
+                                             HotWords[Index],
+                                             &Exists));
+                Assert::IsTrue(Exists);
+            }
+
+            Assert::IsTrue(Api->FindWord(Dictionary, ColdWord, &Exists));
+            Assert::IsTrue(Exists);
+
+            Assert::IsTrue(Api->FindWord(Dictionary, Longest, &Exists));
+            Assert::IsFalse(Exists);
+
+            Assert::IsTrue(
+                Api->FindWord(Dictionary, (PCBYTE)"coldaa", &Exists)
+            );
+            Assert::IsFalse(Exists);
+
+            //
+            // The evicted long word should persist as the longest word of all
+            // time, and the current longest word should be a one-off word.
+            //
+
+            Assert::IsTrue(
+                Api->GetDictionaryStats(Dictionary,
+                                        Allocator,
+                                        &Stats)
+            );
+
+            Assert::AreEqual(
+                (PCSZ)Longest,
+                (PCSZ)Stats->LongestWordAllTime->Buffer
+            );
+
+            Assert::AreEqual(
+                (PCSZ)ColdWord,
+                (PCSZ)Stats->CurrentLongestWord->Buffer
+            );
+
+            Allocator->FreePointer(Allocator, (PPVOID)&Stats);
+
+            //
+            // Tightening the budget evicts immediately; the one-off word goes
+            // before any of the hot words.
+            //
+
+            Assert::IsTrue(Api->SetDictionaryBudget(Dictionary, 3, 0));
+            Assert::IsTrue(Api->FindWord(Dictionary, ColdWord, &Exists));
+            Assert::IsFalse(Exists);
+
+            Assert::IsTrue(Api->SetDictionaryBudget(Dictionary, 1, 0));
+            Assert::IsTrue(Api->GetDictionaryMemoryUsage(Dictionary, &Usage));
+            Assert::IsTrue(Usage.NumberOfWords == 1);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+
+            //
+            // Verify a byte budget keeps memory usage flat.
+            //
+
+            CreateFlags.TrackMemoryUsage = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            for (Index = 0; Index < ARRAYSIZE(HotWords); Index++) {
+                for (Count = 0; Count < 4; Count++) {
+                    Assert::IsTrue(Api->AddWord(Dictionary,
+                                                HotWords[Index],
+                                                &EntryCount));
+                }
+            }
+
+            Assert::IsTrue(Api->GetDictionaryMemoryUsage(Dictionary, &Usage));
+
+            NumberOfBytes = (
+                Usage.BitmapTableAllocator.NumberOfBytes +
+                Usage.HistogramTableAllocator.NumberOfBytes +
+                Usage.WordTableAllocator.NumberOfBytes +
+                Usage.LengthTableAllocator.NumberOfBytes +
+                Usage.WordAllocator.NumberOfBytes
+            );
+
+            MaximumNumberOfBytes = NumberOfBytes * 2;
+
+            Assert::IsTrue(
+                Api->SetDictionaryBudget(Dictionary, 0, MaximumNumberOfBytes)
+            );
+
+            for (Index = 0; Index < 64; Index++) {
+
+                ColdWord[4] = (BYTE)('a' + (Index / 26));
+                ColdWord[5] = (BYTE)('a' + (Index % 26));
+
+                Assert::IsTrue(Api->AddWord(Dictionary,
+                                            ColdWord,
+                                            &EntryCount));
+
+                for (Count = 0; Count < ARRAYSIZE(HotWords); Count++) {
+                    Assert::IsTrue(Api->AddWord(Dictionary,
+                                                HotWords[Count],
+                                                &EntryCount));
+                }
+
+                Assert::IsTrue(
+                    Api->GetDictionaryMemoryUsage(Dictionary, &Usage)
+                );
+
+                NumberOfBytes = (
+                    Usage.BitmapTableAllocator.NumberOfBytes +
+                    Usage.HistogramTableAllocator.NumberOfBytes +
+                    Usage.WordTableAllocator.NumberOfBytes +
+                    Usage.LengthTableAllocator.NumberOfBytes +
+                    Usage.WordAllocator.NumberOfBytes
+                );
+
+                Assert::IsTrue(NumberOfBytes <= MaximumNumberOfBytes);
+            }
+
+            for (Index = 0; Index < ARRAYSIZE(HotWords); Index++) {
+                Assert::IsTrue(Api->FindWord(Dictionary,
+                                             HotWords[Index],
+                                             &Exists));
+                Assert::IsTrue(Exists);
+            }
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(Eviction2)
+        {
+            ULONG Count;
+            BOOLEAN Exists;
+            LONGLONG EntryCount;
+            PDICTIONARY Dictionary;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_MEMORY_USAGE Usage;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            PCBYTE Cat = (PCBYTE)"cat";
+            PCBYTE Longest = (PCBYTE)"antidisestablishment";
+
+            CreateFlags.AsULong = 0;
+            CreateFlags.EnableEviction = TRUE;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            for (Count = 0; Count < 4; Count++) {
+                Assert::IsTrue(Api->AddWord(Dictionary, Cat, &EntryCount));
+            }
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Longest, &EntryCount));
+
+            //
+            // Words outside the current word length limits must still be
+            // evictable.
+            //
+
+            Assert::IsTrue(Api->SetMaximumWordLength(Dictionary, 10));
+            Assert::IsTrue(Api->SetDictionaryBudget(Dictionary, 1, 0));
+
+            Assert::IsTrue(Api->GetDictionaryMemoryUsage(Dictionary, &Usage));
+            Assert::IsTrue(Usage.NumberOfWords == 1);
+
+            Assert::IsTrue(Api->FindWord(Dictionary, Cat, &Exists));
+            Assert::IsTrue(Exists);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(WordSketch1)
+        {
+            ULONG Index;
+            ULONG Round;
+            ULONG NumberOfWords;
+            ULONG NumberOfWordsCounted;
+            LONGLONG Estimate;
+            WORD_STATS Stats;
+            PDICTIONARY Dictionary;
+            PWORD_SKETCH WordSketch;
+            PLIST_ENTRY ListEntry;
+            PWORD_ENTRY WordEntry;
+            BOOLEAN IsProcessTerminating;
+            PLINKED_WORD_LIST LinkedWordList;
+            PLINKED_WORD_ENTRY LinkedWordEntry;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            BYTE ColdWords[200][8];
+            PCBYTE Words[8];
+            PCBYTE The = (PCBYTE)"the";
+            PCBYTE Fox = (PCBYTE)"fox";
+            PCBYTE Cat = (PCBYTE)"cat";
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            //
+            // Verify parameter validation.
+            //
+
+            Assert::IsFalse(
+                Api->CreateWordSketch(Dictionary,
+                                      Allocator,
+                                      0,
+                                      0,
+                                      0,
+                                      &WordSketch)
+            );
+
+            Assert::IsFalse(
+                Api->CreateWordSketch(Dictionary,
+                                      Allocator,
+                                      1000,
+                                      0,
+                                      10,
+                                      &WordSketch)
+            );
+
+            Assert::IsTrue(
+                Api->CreateWordSketch(Dictionary,
+                                      Allocator,
+                                      0,
+                                      4,
+                                      10,
+                                      &WordSketch)
+            );
+
+            //
+            // Count "the" 100 times, "fox" 20 times, "cat" 5 times, and 200
+            // other words once each.
+            //
+
+            for (Round = 0; Round < 100; Round++) {
+
+                NumberOfWords = 0;
+                Words[NumberOfWords++] = The;
+
+                if (Round < 20) {
+                    Words[NumberOfWords++] = Fox;
+                }
+
+                if (Round < 5) {
+                    Words[NumberOfWords++] = Cat;
+                }
+
+                for (Index = Round * 2; Index < (Round + 1) * 2; Index++) {
+                    ColdWords[Index][0] = 'w';
+                    ColdWords[Index][1] = 'o';
+                    ColdWords[Index][2] = 'r';
+                    ColdWords[Index][3] = 'd';
+                    ColdWords[Index][4] = (BYTE)('a' + (Index / 26));
+                    ColdWords[Index][5] = (BYTE)('a' + (Index % 26));
+                    ColdWords[Index][6] = '\0';
+                    Words[NumberOfWords++] = ColdWords[Index];
+                }
+
+                Assert::IsTrue(
+                    Api->CountWordsInSketch(WordSketch,
+                                            NumberOfWords,
+                                            Words,
+                                            &NumberOfWordsCounted)
+                );
+
+                Assert::IsTrue(NumberOfWordsCounted == NumberOfWords);
+            }
+
+            //
+            // Estimates never undercount; with so few distinct words, they
+            // should be exact.
+            //
+
+            Assert::IsTrue(Api->EstimateWordCount(WordSketch, The, &Estimate));
+            Assert::IsTrue(Estimate == 100);
+
+            Assert::IsTrue(Api->EstimateWordCount(WordSketch, Fox, &Estimate));
+            Assert::IsTrue(Estimate == 20);
+
+            Assert::IsTrue(Api->EstimateWordCount(WordSketch, Cat, &Estimate));
+            Assert::IsTrue(Estimate == 5);
+
+            //
+            // Words reaching the threshold were promoted with their full
+            // counts; the others weren't added to the dictionary.
+            //
+
+            Assert::IsTrue(Api->GetWordStats(Dictionary, The, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 100);
+
+            Assert::IsTrue(Api->GetWordStats(Dictionary, Fox, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 20);
+
+            Assert::IsFalse(Api->GetWordStats(Dictionary, Cat, &Stats));
+
+            //
+            // Verify the heavy hitters are in descending order of estimate.
+            //
+
+            Assert::IsTrue(
+                Api->GetWordSketchHeavyHitters(WordSketch,
+                                               Allocator,
+                                               &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 4);
+
+            ListEntry = LinkedWordList->ListHead.Flink;
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual((PCSZ)The, (PCSZ)WordEntry->String.Buffer);
+            Assert::IsTrue(WordEntry->Stats.EntryCount == 100);
+
+            ListEntry = ListEntry->Flink;
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual((PCSZ)Fox, (PCSZ)WordEntry->String.Buffer);
+            Assert::IsTrue(WordEntry->Stats.EntryCount == 20);
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            //
+            // An empty word fails the batch at that word.
+            //
+
+            Words[0] = The;
+            Words[1] = (PCBYTE)"";
+
+            Assert::IsFalse(
+                Api->CountWordsInSketch(WordSketch,
+                                        2,
+                                        Words,
+                                        &NumberOfWordsCounted)
+            );
+
+            Assert::IsTrue(NumberOfWordsCounted == 1);
+
+            Assert::IsTrue(Api->GetWordStats(Dictionary, The, &Stats));
+            Assert::IsTrue(Stats.EntryCount == 101);
+
+            Assert::IsTrue(Api->DestroyWordSketch(&WordSketch));
+            Assert::IsTrue(WordSketch == NULL);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(GetWordAnagramsPackedAndFullHistograms)
+        {
+            ULONG Index;
+            LONGLONG EntryCount;
+            PLIST_ENTRY ListEntry;
+            PDICTIONARY Dictionary;
+            PCWORD_ENTRY WordEntry;
+            PLINKED_WORD_LIST LinkedWordList;
+            PLINKED_WORD_ENTRY LinkedWordEntry;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+
+            //
+            // Lowercase words are represented by packed histograms; the
+            // others fall back to full histograms.
+            //
+
+            PCBYTE Words[] = {
+                (PCBYTE)"elbow",
+                (PCBYTE)"below",
+                (PCBYTE)"Elbow",
+                (PCBYTE)"ab-c",
+                (PCBYTE)"c-ba",
+                (PCBYTE)"abc",
+            };
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            for (Index = 0; Index < ARRAYSIZE(Words); Index++) {
+                Assert::IsTrue(
+                    Api->AddWord(Dictionary, Words[Index], &EntryCount)
+                );
+                Assert::IsTrue(EntryCount == 1);
+            }
+
+            //
+            // "Elbow" differs from "elbow" and "below" by a single character
+            // outside of the packed alphabet; it has no anagrams.
+            //
+
+            Assert::IsTrue(
+                Api->GetWordAnagrams(Dictionary,
+                                     Allocator,
+                                     (PCBYTE)"Elbow",
+                                     &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList == NULL);
+
+            //
+            // Verify anagrams are found for full histograms.
+            //
+
+            Assert::IsTrue(
+                Api->GetWordAnagrams(Dictionary,
+                                     Allocator,
+                                     (PCBYTE)"c-ba",
+                                     &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 1);
+
+            ListEntry = RemoveHeadList(&LinkedWordList->ListHead);
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual("ab-c", (PCSZ)WordEntry->String.Buffer);
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            //
+            // Verify anagrams are found for packed histograms.
+            //
+
+            Assert::IsTrue(
+                Api->GetWordAnagrams(Dictionary,
+                                     Allocator,
+                                     (PCBYTE)"below",
+                                     &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 1);
+
+            ListEntry = RemoveHeadList(&LinkedWordList->ListHead);
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual("elbow", (PCSZ)WordEntry->String.Buffer);
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(GetWordAnagramsUtf8)
+        {
+            ULONG Index;
+            LONGLONG EntryCount;
+            PLIST_ENTRY ListEntry;
+            PDICTIONARY Dictionary;
+            PCWORD_ENTRY WordEntry;
+            PLINKED_WORD_LIST LinkedWordList;
+            PLINKED_WORD_ENTRY LinkedWordEntry;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+
+            //
+            // U+0430 U+044F, its anagram U+044F U+0430, and U+040F U+0470,
+            // which consists of the same bytes as the first two words, but
+            // isn't an anagram of them.  Followed by U+4E2D U+6587 and its
+            // anagram.
+            //
+
+            PCSZ Ya = "\xD0\xB0\xD1\x8F";
+            PCSZ Ay = "\xD1\x8F\xD0\xB0";
+            PCSZ Dzhe = "\xD0\x8F\xD1\xB0";
+            PCSZ Zhongwen = "\xE4\xB8\xAD\xE6\x96\x87";
+            PCSZ Wenzhong = "\xE6\x96\x87\xE4\xB8\xAD";
+            PCSZ Words[] = { Ya, Ay, Dzhe, Zhongwen, Wenzhong };
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            for (Index = 0; Index < ARRAYSIZE(Words); Index++) {
+                Assert::IsTrue(
+                    Api->AddWord(Dictionary, (PCBYTE)Words[Index], &EntryCount)
+                );
+                Assert::IsTrue(EntryCount == 1);
+            }
+
+            Assert::IsTrue(
+                Api->GetWordAnagrams(Dictionary,
+                                     Allocator,
+                                     (PCBYTE)Ya,
+                                     &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 1);
+
+            ListEntry = RemoveHeadList(&LinkedWordList->ListHead);
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual(Ay, (PCSZ)WordEntry->String.Buffer);
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            Assert::IsTrue(
+                Api->GetWordAnagrams(Dictionary,
+                                     Allocator,
+                                     (PCBYTE)Dzhe,
+                                     &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList == NULL);
+
+            Assert::IsTrue(
+                Api->GetWordAnagrams(Dictionary,
+                                     Allocator,
+                                     (PCBYTE)Zhongwen,
+                                     &LinkedWordList)
+            );
+
+            Assert::IsTrue(LinkedWordList != NULL);
+            Assert::IsTrue(LinkedWordList->NumberOfEntries == 1);
+
+            ListEntry = RemoveHeadList(&LinkedWordList->ListHead);
+            LinkedWordEntry = CONTAINING_RECORD(ListEntry,
+                                                LINKED_WORD_ENTRY,
+                                                ListEntry);
+            WordEntry = &LinkedWordEntry->WordEntry;
+
+            Assert::AreEqual(Wenzhong, (PCSZ)WordEntry->String.Buffer);
+
+            Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(
+                    &Dictionary,
+                    &IsProcessTerminating
+                )
+            );
+        }
+
+        TEST_METHOD(DictionaryRecording1)
+        {
+            ULONG Length;
+            BOOLEAN Exists;
+            LONGLONG EntryCount;
+            ULONGLONG NumberOfRecords;
+            WORD_STATS Stats;
+            PDICTIONARY Dictionary;
+            PDICTIONARY ReplayDictionary;
+            BOOLEAN IsProcessTerminating;
+            PLINKED_WORD_LIST LinkedWordList;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            DICTIONARY_REPLAY_FLAGS ReplayFlags;
+            DICTIONARY_REPLAY_STATS ReplayStats;
+            WCHAR Path[MAX_PATH];
+            PCBYTE Elbow = (PCBYTE)"elbow";
+            PCBYTE Below = (PCBYTE)"below";
+
+            CreateFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Length = GetTempPathW(MAX_PATH, Path);
+            Assert::IsTrue(Length > 0 && Length < MAX_PATH - 32);
+            CopyMemory(&Path[Length],
+                       L"DictionaryRecording1.bin",
+                       sizeof(L"DictionaryRecording1.bin"));
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            //
+            // Verify a recording can't be stopped before it's started, nor
+            // started twice.
+            //
+
+            Assert::IsFalse(
+                Api->StopDictionaryRecording(Dictionary, &NumberOfRecords)
+            );
+
+            Assert::IsTrue(
+                Api->StartDictionaryRecording(Dictionary, Path, 0)
+            );
+
+            Assert::IsFalse(
+                Api->StartDictionaryRecording(Dictionary, Path, 0)
+            );
+
+            //
+            // Record 3 adds, 2 finds, 1 anagram lookup and 1 removal.
+            //
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Below, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+
+            Assert::IsTrue(Api->FindWord(Dictionary, Elbow, &Exists));
+            Assert::IsTrue(Exists);
+
+            Assert::IsTrue(
+                Api->GetWordAnagrams(Dictionary,
+                                     Allocator,
+                                     Below,
+                                     &LinkedWordList)
+            );
+
+            if (LinkedWordList) {
+                Allocator->FreePointer(Allocator, (PPVOID)&LinkedWordList);
+            }
+
+            Assert::IsTrue(Api->RemoveWord(Dictionary, Below, &EntryCount));
+
+            Assert::IsTrue(Api->FindWord(Dictionary, Below, &Exists));
+            Assert::IsFalse(Exists);
+
+            Assert::IsTrue(
+                Api->StopDictionaryRecording(Dictionary, &NumberOfRecords)
+            );
+            Assert::IsTrue(NumberOfRecords == 7);
+
+            //
+            // Calls made after the recording stopped aren't recorded.
+            //
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Below, &EntryCount));
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(&Dictionary, &IsProcessTerminating)
+            );
+
+            //
+            // Replay the recording single-threaded and with the original
+            // thread interleaving, and verify both produce the same state as
+            // the recorded calls.
+            //
+
+            for (ReplayFlags.AsULong = 0;
+                 ReplayFlags.AsULong <= 1;
+                 ReplayFlags.AsULong++) {
+
+                Assert::IsTrue(
+                    Api->CreateDictionary(Rtl,
+                                          Allocator,
+                                          CreateFlags,
+                                          &ReplayDictionary)
+                );
+
+                Assert::IsTrue(
+                    Api->ReplayDictionaryRecording(Api,
+                                                   ReplayDictionary,
+                                                   Allocator,
+                                                   Path,
+                                                   ReplayFlags,
+                                                   &ReplayStats)
+                );
+
+                Assert::IsTrue(ReplayStats.NumberOfRecords == 7);
+                Assert::IsTrue(ReplayStats.NumberOfAddWords == 3);
+                Assert::IsTrue(ReplayStats.NumberOfRemoveWords == 1);
+                Assert::IsTrue(ReplayStats.NumberOfFindWords == 2);
+                Assert::IsTrue(ReplayStats.NumberOfGetWordAnagrams == 1);
+                Assert::IsTrue(ReplayStats.NumberOfFailedCalls == 0);
+                Assert::IsTrue(ReplayStats.NumberOfDroppedRecords == 0);
+                Assert::IsTrue(ReplayStats.NumberOfThreads == 1);
+
+                Assert::IsTrue(
+                    Api->GetWordStats(ReplayDictionary, Elbow, &Stats)
+                );
+                Assert::IsTrue(Stats.EntryCount == 2);
+                Assert::IsTrue(Stats.MaximumEntryCount == 2);
+
+                Assert::IsTrue(
+                    Api->FindWord(ReplayDictionary, Below, &Exists)
+                );
+                Assert::IsFalse(Exists);
+
+                Assert::IsTrue(
+                    Api->DestroyDictionary(&ReplayDictionary,
+                                           &IsProcessTerminating)
+                );
+            }
+
+            Assert::IsTrue(DeleteFileW(Path) != FALSE);
+        }
+
+        TEST_METHOD(DictionaryLog1)
+        {
+            ULONG Index;
+            ULONG Length;
+            ULONG BytesWritten;
+            BOOLEAN Exists;
+            HANDLE FileHandle;
+            LONGLONG EntryCount;
+            ULONGLONG NumberOfRecords;
+            WORD_STATS Stats;
+            PDICTIONARY Dictionary;
+            PDICTIONARY RecoveredDictionary;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            DICTIONARY_LOG_FLAGS LogFlags;
+            DICTIONARY_LOG_STATS LogStats;
+            WCHAR LogPath[MAX_PATH];
+            WCHAR SnapshotPath[MAX_PATH];
+            BYTE Garbage[13];
+            PCBYTE Elbow = (PCBYTE)"elbow";
+            PCBYTE Below = (PCBYTE)"below";
+            PCBYTE Cat = (PCBYTE)"cat";
+
+            CreateFlags.AsULong = 0;
+            LogFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Length = GetTempPathW(MAX_PATH, LogPath);
+            Assert::IsTrue(Length > 0 && Length < MAX_PATH - 32);
+            CopyMemory(SnapshotPath, LogPath, Length * sizeof(WCHAR));
+            CopyMemory(&LogPath[Length],
+                       L"DictionaryLog1.log",
+                       sizeof(L"DictionaryLog1.log"));
+            CopyMemory(&SnapshotPath[Length],
+                       L"DictionaryLog1.snp",
+                       sizeof(L"DictionaryLog1.snp"));
+
+            DeleteFileW(LogPath);
+            DeleteFileW(SnapshotPath);
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            //
+            // Verify a log can't be closed before it's opened, nor opened
+            // twice.
+            //
+
+            Assert::IsFalse(Api->CloseDictionaryLog(Dictionary, &LogStats));
+            Assert::IsTrue(
+                Api->OpenDictionaryLog(Dictionary, LogPath, LogFlags)
+            );
+            Assert::IsFalse(
+                Api->OpenDictionaryLog(Dictionary, LogPath, LogFlags)
+            );
+
+            //
+            // Log 3 additions, checkpoint, then log 1 addition and 1 removal.
+            //
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(Api->AddWord(Dictionary, Below, &EntryCount));
+
+            Assert::IsTrue(
+                Api->CheckpointDictionary(Dictionary, Allocator, SnapshotPath)
+            );
+
+            Assert::IsTrue(Api->AddWord(Dictionary, Cat, &EntryCount));
+            Assert::IsTrue(Api->RemoveWord(Dictionary, Elbow, &EntryCount));
+            Assert::IsTrue(EntryCount == 1);
+
+            //
+            // Lookups and removals of missing words aren't logged.
+            //
+
+            Assert::IsTrue(Api->FindWord(Dictionary, Cat, &Exists));
+            Assert::IsTrue(Exists);
+            Assert::IsTrue(
+                Api->RemoveWord(Dictionary, (PCBYTE)"dog", &EntryCount)
+            );
+
+            Assert::IsTrue(Api->CloseDictionaryLog(Dictionary, &LogStats));
+            Assert::IsTrue(LogStats.NumberOfRecords == 5);
+            Assert::IsTrue(LogStats.NumberOfFlushes >= 1);
+            Assert::IsTrue(LogStats.NumberOfFlushes <= 5);
+            Assert::IsTrue(LogStats.NumberOfBytesWritten == 5 * 40);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(&Dictionary, &IsProcessTerminating)
+            );
+
+            //
+            // Recover from the snapshot and log (only the 2 records following
+            // the checkpoint are replayed), and from the log alone (all 5
+            // records are replayed).  Both should produce the same state.
+            //
+
+            for (Index = 0; Index < 2; Index++) {
+
+                Assert::IsTrue(
+                    Api->CreateDictionary(Rtl,
+                                          Allocator,
+                                          CreateFlags,
+                                          &RecoveredDictionary)
+                );
+
+                Assert::IsTrue(
+                    Api->RecoverDictionary(RecoveredDictionary,
+                                           Index == 0 ? SnapshotPath : NULL,
+                                           LogPath,
+                                           &NumberOfRecords)
+                );
+
+                Assert::IsTrue(NumberOfRecords == (Index == 0 ? 2 : 5));
+
+                Assert::IsTrue(
+                    Api->GetWordStats(RecoveredDictionary, Elbow, &Stats)
+                );
+                Assert::IsTrue(Stats.EntryCount == 1);
+
+                Assert::IsTrue(
+                    Api->GetWordStats(RecoveredDictionary, Below, &Stats)
+                );
+                Assert::IsTrue(Stats.EntryCount == 1);
+
+                Assert::IsTrue(
+                    Api->GetWordStats(RecoveredDictionary, Cat, &Stats)
+                );
+                Assert::IsTrue(Stats.EntryCount == 1);
+
+                Assert::IsTrue(
+                    Api->DestroyDictionary(&RecoveredDictionary,
+                                           &IsProcessTerminating)
+                );
+            }
+
+            //
+            // Simulate a torn write by appending garbage to the log.  Reopen
+            // the log (which discards the garbage) and append another record,
+            // then verify recovery sees all 6 records.
+            //
+
+            FileHandle = CreateFileW(LogPath,
+                                     FILE_APPEND_DATA,
+                                     0,
+                                     NULL,
+                                     OPEN_EXISTING,
+                                     FILE_ATTRIBUTE_NORMAL,
+                                     NULL);
+            Assert::IsTrue(FileHandle != INVALID_HANDLE_VALUE);
+            FillMemory(Garbage, sizeof(Garbage), 0xff);
+            Assert::IsTrue(
+                WriteFile(FileHandle,
+                          Garbage,
+                          sizeof(Garbage),
+                          &BytesWritten,
+                          NULL) != FALSE
+            );
+            CloseHandle(FileHandle);
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            Assert::IsTrue(
+                Api->RecoverDictionary(Dictionary,
+                                       NULL,
+                                       LogPath,
+                                       &NumberOfRecords)
+            );
+            Assert::IsTrue(NumberOfRecords == 5);
+
+            Assert::IsTrue(
+                Api->OpenDictionaryLog(Dictionary, LogPath, LogFlags)
+            );
+            Assert::IsTrue(Api->AddWord(Dictionary, Cat, &EntryCount));
+            Assert::IsTrue(EntryCount == 2);
+            Assert::IsTrue(Api->CloseDictionaryLog(Dictionary, &LogStats));
+            Assert::IsTrue(LogStats.NumberOfRecords == 1);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(&Dictionary, &IsProcessTerminating)
+            );
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &RecoveredDictionary)
+            );
+
+            Assert::IsTrue(
+                Api->RecoverDictionary(RecoveredDictionary,
+                                       NULL,
+                                       LogPath,
+                                       &NumberOfRecords)
+            );
+            Assert::IsTrue(NumberOfRecords == 6);
+
+            Assert::IsTrue(
+                Api->GetWordStats(RecoveredDictionary, Cat, &Stats)
+            );
+            Assert::IsTrue(Stats.EntryCount == 2);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(&RecoveredDictionary,
+                                       &IsProcessTerminating)
+            );
+
+            Assert::IsTrue(DeleteFileW(LogPath) != FALSE);
+            Assert::IsTrue(DeleteFileW(SnapshotPath) != FALSE);
+        }
+
+        TEST_METHOD(DictionaryLog2)
+        {
+            ULONG Index;
+            ULONG Length;
+            ULONGLONG NumberOfWords;
+            ULONGLONG NumberOfRecords;
+            WORD_STATS Stats;
+            PDICTIONARY Dictionary;
+            PDICTIONARY RecoveredDictionary;
+            PWORD_COUNTER WordCounter;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            DICTIONARY_TOKENIZER_FLAGS TokenizerFlags;
+            DICTIONARY_LOG_FLAGS LogFlags;
+            DICTIONARY_LOG_STATS LogStats;
+            WCHAR LogPath[MAX_PATH];
+            CHAR Text[] = "the cat sat; the cat ran";
+            PCBYTE Elbow = (PCBYTE)"elbow";
+
+            CreateFlags.AsULong = 0;
+            TokenizerFlags.AsULong = 0;
+            LogFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Length = GetTempPathW(MAX_PATH, LogPath);
+            Assert::IsTrue(Length > 0 && Length < MAX_PATH - 32);
+            CopyMemory(&LogPath[Length],
+                       L"DictionaryLog2.log",
+                       sizeof(L"DictionaryLog2.log"));
+
+            DeleteFileW(LogPath);
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            Assert::IsTrue(
+                Api->OpenDictionaryLog(Dictionary, LogPath, LogFlags)
+            );
+
+            //
+            // Add 6 words from text (one record each), and flush a word
+            // counter holding 5 occurrences of a single word (one record
+            // carrying the count).
+            //
+
+            Assert::IsTrue(
+                Api->AddWordsFromText(Dictionary,
+                                      (PCBYTE)Text,
+                                      sizeof(Text) - 1,
+                                      TokenizerFlags,
+                                      &NumberOfWords)
+            );
+            Assert::IsTrue(NumberOfWords == 6);
+
+            Assert::IsTrue(
+                Api->CreateWordCounter(Dictionary, Allocator, 16, &WordCounter)
+            );
+
+            for (Index = 0; Index < 5; Index++) {
+                Assert::IsTrue(Api->CountWord(WordCounter, Elbow));
+            }
+
+            Assert::IsTrue(Api->FlushWordCounter(WordCounter));
+            Assert::IsTrue(Api->DestroyWordCounter(&WordCounter));
+
+            Assert::IsTrue(Api->CloseDictionaryLog(Dictionary, &LogStats));
+            Assert::IsTrue(LogStats.NumberOfRecords == 7);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(&Dictionary, &IsProcessTerminating)
+            );
+
+            //
+            // Recover from the log and verify every addition was replayed.
+            //
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &RecoveredDictionary)
+            );
+
+            Assert::IsTrue(
+                Api->RecoverDictionary(RecoveredDictionary,
+                                       NULL,
+                                       LogPath,
+                                       &NumberOfRecords)
+            );
+            Assert::IsTrue(NumberOfRecords == 7);
+
+            Assert::IsTrue(
+                Api->GetWordStats(RecoveredDictionary, (PCBYTE)"the", &Stats)
+            );
+            Assert::IsTrue(Stats.EntryCount == 2);
+
+            Assert::IsTrue(
+                Api->GetWordStats(RecoveredDictionary, (PCBYTE)"cat", &Stats)
+            );
+            Assert::IsTrue(Stats.EntryCount == 2);
+
+            Assert::IsTrue(
+                Api->GetWordStats(RecoveredDictionary, (PCBYTE)"sat", &Stats)
+            );
+            Assert::IsTrue(Stats.EntryCount == 1);
+
+            Assert::IsTrue(
+                Api->GetWordStats(RecoveredDictionary, (PCBYTE)"ran", &Stats)
+            );
+            Assert::IsTrue(Stats.EntryCount == 1);
+
+            Assert::IsTrue(
+                Api->GetWordStats(RecoveredDictionary, Elbow, &Stats)
+            );
+            Assert::IsTrue(Stats.EntryCount == 5);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(&RecoveredDictionary,
+                                       &IsProcessTerminating)
+            );
+
+            Assert::IsTrue(DeleteFileW(LogPath) != FALSE);
+        }
+
+        TEST_METHOD(DictionaryLog3)
+        {
+            ULONG Index;
+            ULONG Count;
+            ULONG Length;
+            BOOLEAN Exists;
+            BOOLEAN Recovered;
+            LONGLONG EntryCount;
+            ULONGLONG NumberOfRecords;
+            PDICTIONARY Dictionary;
+            PDICTIONARY RecoveredDictionary;
+            BOOLEAN IsProcessTerminating;
+            DICTIONARY_MEMORY_USAGE Usage;
+            DICTIONARY_MEMORY_USAGE RecoveredUsage;
+            DICTIONARY_CREATE_FLAGS CreateFlags;
+            DICTIONARY_LOG_FLAGS LogFlags;
+            DICTIONARY_LOG_STATS LogStats;
+            WCHAR LogPath[MAX_PATH];
+            WCHAR SnapshotPath[MAX_PATH];
+            BYTE ColdWord[] = "coldaa";
+            BOOLEAN ColdWordExists[64];
+            PCBYTE HotWords[] = {
+                (PCBYTE)"cat",
+                (PCBYTE)"dog",
+                (PCBYTE)"horse",
+            };
+
+            CreateFlags.AsULong = 0;
+            CreateFlags.EnableEviction = TRUE;
+            LogFlags.AsULong = 0;
+            IsProcessTerminating = TRUE;
+
+            Length = GetTempPathW(MAX_PATH, LogPath);
+            Assert::IsTrue(Length > 0 && Length < MAX_PATH - 32);
+            CopyMemory(SnapshotPath, LogPath, Length * sizeof(WCHAR));
+            CopyMemory(&LogPath[Length],
+                       L"DictionaryLog3.log",
+                       sizeof(L"DictionaryLog3.log"));
+            CopyMemory(&SnapshotPath[Length],
+                       L"DictionaryLog3.snp",
+                       sizeof(L"DictionaryLog3.snp"));
+
+            DeleteFileW(LogPath);
+            DeleteFileW(SnapshotPath);
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl, Allocator, CreateFlags, &Dictionary)
+            );
+
+            Assert::IsTrue(Api->SetDictionaryBudget(Dictionary, 4, 0));
+
+            Assert::IsTrue(
+                Api->OpenDictionaryLog(Dictionary, LogPath, LogFlags)
+            );
+
+            //
+            // Stream one-off words through the budgeted dictionary whilst
+            // referencing the hot words, checkpointing half way through.
+            //
+
+            for (Index = 0; Index < ARRAYSIZE(ColdWordExists); Index++) {
+
+                if (Index == ARRAYSIZE(ColdWordExists) / 2) {
+                    Assert::IsTrue(
+                        Api->CheckpointDictionary(Dictionary,
+                                                  Allocator,
+                                                  SnapshotPath)
+                    );
+                }
+
+                ColdWord[4] = (BYTE)('a' + (Index / 26));
+                ColdWord[5] = (BYTE)('a' + (Index % 26));
+
+                Assert::IsTrue(Api->AddWord(Dictionary,
+                                            ColdWord,
+                                            &EntryCount));
+
+                for (Count = 0; Count < ARRAYSIZE(HotWords); Count++) {
+                    Assert::IsTrue(Api->AddWord(Dictionary,
+                                                HotWords[Count],
+                                                &EntryCount));
+                }
+            }
+
+            Assert::IsTrue(Api->CloseDictionaryLog(Dictionary, &LogStats));
+
+            //
+            // Capture the original word set.
+            //
+
+            for (Index = 0; Index < ARRAYSIZE(ColdWordExists); Index++) {
+                ColdWord[4] = (BYTE)('a' + (Index / 26));
+                ColdWord[5] = (BYTE)('a' + (Index % 26));
+                Assert::IsTrue(
+                    Api->FindWord(Dictionary,
+                                  ColdWord,
+                                  &ColdWordExists[Index])
+                );
+            }
+
+            Assert::IsTrue(Api->GetDictionaryMemoryUsage(Dictionary, &Usage));
+            Assert::IsTrue(Usage.NumberOfWords == 4);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(&Dictionary, &IsProcessTerminating)
+            );
+
+            //
+            // Recover into a dictionary with the same budget.  Replaying the
+            // additions must not evict words of its own accord; only the
+            // logged evictions should be applied.
+            //
+
+            Assert::IsTrue(
+                Api->CreateDictionary(Rtl,
+                                      Allocator,
+                                      CreateFlags,
+                                      &RecoveredDictionary)
+            );
+
+            Assert::IsTrue(
+                Api->SetDictionaryBudget(RecoveredDictionary, 4, 0)
+            );
+
+            Recovered = Api->RecoverDictionary(RecoveredDictionary,
+                                               SnapshotPath,
+                                               LogPath,
+                                               &NumberOfRecords);
+            Assert::IsTrue(Recovered);
+            Assert::IsTrue(NumberOfRecords > 0);
+            Assert::IsTrue(NumberOfRecords < LogStats.NumberOfRecords);
+
+            Assert::IsTrue(
+                Api->GetDictionaryMemoryUsage(RecoveredDictionary,
+                                              &RecoveredUsage)
+            );
+            Assert::IsTrue(RecoveredUsage.NumberOfWords == Usage.NumberOfWords);
+
+            for (Index = 0; Index < ARRAYSIZE(HotWords); Index++) {
+                Assert::IsTrue(Api->FindWord(RecoveredDictionary,
+                                             HotWords[Index],
+                                             &Exists));
+                Assert::IsTrue(Exists);
+            }
+
+            for (Index = 0; Index < ARRAYSIZE(ColdWordExists); Index++) {
+                ColdWord[4] = (BYTE)('a' + (Index / 26));
+                ColdWord[5] = (BYTE)('a' + (Index % 26));
+                Assert::IsTrue(
+                    Api->FindWord(RecoveredDictionary, ColdWord, &Exists)
+                );
+                Assert::IsTrue(Exists == ColdWordExists[Index]);
+            }
+
+            //
+            // Eviction is enabled again once recovery is complete.
+            //
+
+            Assert::IsTrue(
+                Api->SetDictionaryBudget(RecoveredDictionary, 3, 0)
+            );
+            Assert::IsTrue(
+                Api->GetDictionaryMemoryUsage(RecoveredDictionary,
+                                              &RecoveredUsage)
+            );
+            Assert::IsTrue(RecoveredUsage.NumberOfWords == 3);
+
+            Assert::IsTrue(
+                Api->DestroyDictionary(&RecoveredDictionary,
+                                       &IsProcessTerminating)
+            );
+
+            Assert::IsTrue(DeleteFileW(LogPath) != FALSE);
+            Assert::IsTrue(DeleteFileW(SnapshotPath) != FALSE);
+        }
 
     };
 }
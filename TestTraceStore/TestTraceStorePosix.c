@@ -0,0 +1,651 @@
+/*++
+
+Copyright (c) 2016 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    TestTraceStorePosix.c
+
+Abstract:
+
+    This module implements tests for the POSIX trace store platform layer
+    (TraceStorePosix.c).  It exercises file sizing and hole punching, file
+    mapping sections and views (including preferred base addresses), the
+    work pool, events and the interlocked singly-linked list routines
+    provided by TraceStorePlatform.h.
+
+    The tests are built and run by the check target of TraceStore/Makefile.
+    The program exits with a non-zero status if any test fails.
+
+--*/
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../TraceStore/TraceStorePlatform.h"
+
+//
+// The platform header only supplies the base types the pipeline needs.
+//
+
+typedef BYTE *PBYTE;
+
+#define TEST_FILE_SIZE (1 << 20)
+#define TEST_VIEW_OFFSET (1 << 16)
+#define TEST_VIEW_SIZE (1 << 16)
+
+#define NUMBER_OF_WORK_SUBMISSIONS 10000
+#define NUMBER_OF_SLIST_THREADS 4
+#define NUMBER_OF_SLIST_ENTRIES_PER_THREAD 10000
+
+#define FileDescriptorToHandle(FileDescriptor) \
+    ((HANDLE)(LONG_PTR)(FileDescriptor))
+
+#define CHECK(Condition)                                                \
+    do {                                                                \
+        if (!(Condition)) {                                             \
+            fprintf(stderr,                                             \
+                    "%s:%d: check failed: %s (errno %d)\n",             \
+                    __FILE__,                                           \
+                    __LINE__,                                           \
+                    #Condition,                                         \
+                    errno);                                             \
+            return FALSE;                                               \
+        }                                                               \
+    } while (0)
+
+typedef BOOLEAN (TEST_ROUTINE)(VOID);
+typedef TEST_ROUTINE *PTEST_ROUTINE;
+
+typedef struct _TEST {
+    const char *Name;
+    PTEST_ROUTINE Routine;
+} TEST, *PTEST;
+
+//
+// Context shared with work item callbacks.
+//
+
+typedef struct _WORK_CONTEXT {
+    volatile ULONG NumberOfCallbacks;
+    HANDLE Event;
+} WORK_CONTEXT, *PWORK_CONTEXT;
+
+//
+// An SLIST entry tagged with the thread that pushed it.
+//
+
+typedef struct DECLSPEC_ALIGN(16) _TEST_SLIST_ENTRY {
+    SLIST_ENTRY ListEntry;
+    ULONG ThreadIndex;
+    ULONG Padding;
+} TEST_SLIST_ENTRY, *PTEST_SLIST_ENTRY;
+
+typedef struct _SLIST_THREAD_CONTEXT {
+    PSLIST_HEADER ListHead;
+    PTEST_SLIST_ENTRY Entries;
+    ULONG ThreadIndex;
+    ULONG NumberOfPops;
+} SLIST_THREAD_CONTEXT, *PSLIST_THREAD_CONTEXT;
+
+////////////////////////////////////////////////////////////////////////////////
+// Helpers
+////////////////////////////////////////////////////////////////////////////////
+
+static
+int
+CreateTestFile(
+    VOID
+    )
+/*++
+
+Routine Description:
+
+    Creates an empty temporary file in TMPDIR (or /tmp).  The file is unlinked
+    immediately; it's deleted when the returned descriptor is closed.
+
+Return Value:
+
+    A file descriptor on success, -1 on failure.
+
+--*/
+{
+    int FileDescriptor;
+    const char *Directory;
+    char Path[4096];
+
+    Directory = getenv("TMPDIR");
+
+    if (!Directory || !*Directory) {
+        Directory = "/tmp";
+    }
+
+    snprintf(Path, sizeof(Path), "%s/TestTraceStorePosix.XXXXXX", Directory);
+
+    FileDescriptor = mkstemp(Path);
+
+    if (FileDescriptor != -1) {
+        unlink(Path);
+    }
+
+    return FileDescriptor;
+}
+
+static
+VOID
+CALLBACK
+CountingWorkCallback(
+    PTP_CALLBACK_INSTANCE Instance,
+    PVOID Context,
+    PTP_WORK Work
+    )
+{
+    PWORK_CONTEXT WorkContext;
+
+    (VOID)Instance;
+    (VOID)Work;
+
+    WorkContext = (PWORK_CONTEXT)Context;
+    __atomic_add_fetch(&WorkContext->NumberOfCallbacks, 1, __ATOMIC_RELAXED);
+}
+
+static
+VOID
+CALLBACK
+SignalingWorkCallback(
+    PTP_CALLBACK_INSTANCE Instance,
+    PVOID Context,
+    PTP_WORK Work
+    )
+{
+    PWORK_CONTEXT WorkContext;
+
+    (VOID)Instance;
+    (VOID)Work;
+
+    WorkContext = (PWORK_CONTEXT)Context;
+    usleep(10000);
+    TraceStoreSetEvent(WorkContext->Event);
+}
+
+static
+PVOID
+SListThreadProc(
+    PVOID Parameter
+    )
+/*++
+
+Routine Description:
+
+    Pushes each of the thread's entries onto the shared list, popping an
+    entry after every second push, then pops until the list is empty.  The
+    number of entries popped is recorded in the context.
+
+--*/
+{
+    ULONG Index;
+    PSLIST_THREAD_CONTEXT Context;
+
+    Context = (PSLIST_THREAD_CONTEXT)Parameter;
+
+    for (Index = 0; Index < NUMBER_OF_SLIST_ENTRIES_PER_THREAD; Index++) {
+
+        Context->Entries[Index].ThreadIndex = Context->ThreadIndex;
+        InterlockedPushEntrySList(Context->ListHead,
+                                  &Context->Entries[Index].ListEntry);
+
+        if ((Index & 1) && InterlockedPopEntrySList(Context->ListHead)) {
+            Context->NumberOfPops++;
+        }
+    }
+
+    while (InterlockedPopEntrySList(Context->ListHead)) {
+        Context->NumberOfPops++;
+    }
+
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Tests
+////////////////////////////////////////////////////////////////////////////////
+
+static
+BOOLEAN
+TestFileSize(
+    VOID
+    )
+{
+    int FileDescriptor;
+    HANDLE FileHandle;
+    LARGE_INTEGER EndOfFile;
+    LARGE_INTEGER Distance;
+    LARGE_INTEGER FilePointer;
+
+    FileDescriptor = CreateTestFile();
+    CHECK(FileDescriptor != -1);
+    FileHandle = FileDescriptorToHandle(FileDescriptor);
+
+    CHECK(TraceStoreGetFileSize(FileHandle, &EndOfFile));
+    CHECK(EndOfFile.QuadPart == 0);
+
+    //
+    // Extend the file via the file pointer, then truncate it relative to the
+    // new end.
+    //
+
+    Distance.QuadPart = TEST_FILE_SIZE;
+    CHECK(TraceStoreSetFilePointer(FileHandle,
+                                   Distance,
+                                   &FilePointer,
+                                   FILE_BEGIN));
+    CHECK(FilePointer.QuadPart == TEST_FILE_SIZE);
+    CHECK(TraceStoreSetEndOfFile(FileHandle));
+    CHECK(TraceStoreGetFileSize(FileHandle, &EndOfFile));
+    CHECK(EndOfFile.QuadPart == TEST_FILE_SIZE);
+
+    Distance.QuadPart = -TEST_VIEW_SIZE;
+    CHECK(TraceStoreSetFilePointer(FileHandle, Distance, NULL, FILE_END));
+    CHECK(TraceStoreSetEndOfFile(FileHandle));
+    CHECK(TraceStoreGetFileSize(FileHandle, &EndOfFile));
+    CHECK(EndOfFile.QuadPart == TEST_FILE_SIZE - TEST_VIEW_SIZE);
+
+    //
+    // An invalid move method fails.
+    //
+
+    Distance.QuadPart = 0;
+    CHECK(!TraceStoreSetFilePointer(FileHandle, Distance, NULL, 42));
+
+    close(FileDescriptor);
+    return TRUE;
+}
+
+static
+BOOLEAN
+TestSectionsAndViews(
+    VOID
+    )
+{
+    int FileDescriptor;
+    ULONG Index;
+    PBYTE Bytes;
+    PBYTE ReadBytes;
+    PBYTE CopyBytes;
+    PVOID Taken;
+    HANDLE FileHandle;
+    HANDLE Section;
+    HANDLE ReadSection;
+    LARGE_INTEGER Offset;
+    LARGE_INTEGER Length;
+    LARGE_INTEGER EndOfFile;
+    LARGE_INTEGER MaximumSize;
+
+    FileDescriptor = CreateTestFile();
+    CHECK(FileDescriptor != -1);
+    FileHandle = FileDescriptorToHandle(FileDescriptor);
+
+    //
+    // A read-only section can't extend the file; a writable one does.
+    //
+
+    MaximumSize.QuadPart = TEST_FILE_SIZE;
+    CHECK(!TraceStoreCreateSection(FileHandle, PAGE_READONLY, MaximumSize, 0));
+
+    Section = TraceStoreCreateSection(FileHandle,
+                                      PAGE_READWRITE,
+                                      MaximumSize,
+                                      0);
+    CHECK(Section != NULL);
+    CHECK(TraceStoreGetFileSize(FileHandle, &EndOfFile));
+    CHECK(EndOfFile.QuadPart == TEST_FILE_SIZE);
+
+    //
+    // Views can't extend past the section.
+    //
+
+    Offset.QuadPart = TEST_FILE_SIZE - TEST_VIEW_SIZE;
+    CHECK(!TraceStoreMapView(Section,
+                             FILE_MAP_WRITE,
+                             Offset,
+                             TEST_VIEW_SIZE * 2,
+                             NULL,
+                             0));
+
+    //
+    // Fill the file through a writable view.
+    //
+
+    Offset.QuadPart = 0;
+    Bytes = (PBYTE)TraceStoreMapView(Section,
+                                     FILE_MAP_WRITE,
+                                     Offset,
+                                     TEST_FILE_SIZE,
+                                     NULL,
+                                     0);
+    CHECK(Bytes != NULL);
+
+    TraceStoreAdviseView(Bytes, TEST_FILE_SIZE, TraceStoreViewAdviceSequential);
+
+    for (Index = 0; Index < TEST_FILE_SIZE; Index++) {
+        Bytes[Index] = (BYTE)(Index * 7);
+    }
+
+    CHECK(TraceStoreFlushView(Bytes, TEST_FILE_SIZE));
+
+    //
+    // A view at a preferred address that's already taken fails rather than
+    // being placed elsewhere.
+    //
+
+    Offset.QuadPart = TEST_VIEW_OFFSET;
+    Taken = TraceStoreMapView(Section,
+                              FILE_MAP_READ,
+                              Offset,
+                              TEST_VIEW_SIZE,
+                              Bytes,
+                              0);
+    CHECK(Taken == NULL);
+
+    CHECK(TraceStoreUnmapView(Bytes, TEST_FILE_SIZE));
+
+    //
+    // The section outlives the file handle it was created from.  A read-only
+    // section with a maximum size of zero covers the whole file, and a view
+    // of it at an offset sees the data written above.
+    //
+
+    MaximumSize.QuadPart = 0;
+    ReadSection = TraceStoreCreateSection(FileHandle,
+                                          PAGE_READONLY,
+                                          MaximumSize,
+                                          0);
+    CHECK(ReadSection != NULL);
+
+    ReadBytes = (PBYTE)TraceStoreMapView(ReadSection,
+                                         FILE_MAP_READ,
+                                         Offset,
+                                         TEST_VIEW_SIZE,
+                                         NULL,
+                                         0);
+    CHECK(ReadBytes != NULL);
+
+    TraceStoreAdviseView(ReadBytes,
+                         TEST_VIEW_SIZE,
+                         TraceStoreViewAdviceWillNeed);
+
+    for (Index = 0; Index < TEST_VIEW_SIZE; Index++) {
+        CHECK(ReadBytes[Index] == (BYTE)((TEST_VIEW_OFFSET + Index) * 7));
+    }
+
+    //
+    // The preferred address is honored once it's free.
+    //
+
+    CHECK(TraceStoreUnmapView(ReadBytes, TEST_VIEW_SIZE));
+    ReadBytes = (PBYTE)TraceStoreMapView(ReadSection,
+                                         FILE_MAP_READ,
+                                         Offset,
+                                         TEST_VIEW_SIZE,
+                                         ReadBytes,
+                                         0);
+    CHECK(ReadBytes != NULL);
+    CHECK(ReadBytes[0] == (BYTE)(TEST_VIEW_OFFSET * 7));
+
+    //
+    // Copy-on-write views don't modify the file.
+    //
+
+    CopyBytes = (PBYTE)TraceStoreMapView(Section,
+                                         FILE_MAP_COPY,
+                                         Offset,
+                                         TEST_VIEW_SIZE,
+                                         NULL,
+                                         0);
+    CHECK(CopyBytes != NULL);
+    CopyBytes[0] = (BYTE)~CopyBytes[0];
+    CHECK(ReadBytes[0] == (BYTE)(TEST_VIEW_OFFSET * 7));
+    CHECK(TraceStoreUnmapView(CopyBytes, TEST_VIEW_SIZE));
+
+    //
+    // A deallocated range reads as zeros, and the file keeps its size.  Not
+    // all file systems support punching holes, in which case this is skipped.
+    //
+
+    Length.QuadPart = TEST_VIEW_SIZE;
+
+    if (TraceStoreDeallocateFileRange(FileHandle, Offset, Length)) {
+        for (Index = 0; Index < TEST_VIEW_SIZE; Index++) {
+            CHECK(ReadBytes[Index] == 0);
+        }
+        CHECK(TraceStoreGetFileSize(FileHandle, &EndOfFile));
+        CHECK(EndOfFile.QuadPart == TEST_FILE_SIZE);
+    } else {
+        CHECK(errno == EOPNOTSUPP);
+    }
+
+    TraceStoreAdviseView(ReadBytes,
+                         TEST_VIEW_SIZE,
+                         TraceStoreViewAdviceDontNeed);
+
+    close(FileDescriptor);
+
+    CHECK(TraceStoreUnmapView(ReadBytes, TEST_VIEW_SIZE));
+    CHECK(TraceStoreCloseSection(ReadSection));
+    CHECK(TraceStoreCloseSection(Section));
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+TestWork(
+    VOID
+    )
+{
+    ULONG Index;
+    PTP_WORK Work;
+    WORK_CONTEXT Context;
+
+    memset(&Context, 0, sizeof(Context));
+
+    Work = TraceStoreCreateWork(CountingWorkCallback, &Context, NULL);
+    CHECK(Work != NULL);
+
+    //
+    // Each submission runs the callback exactly once.
+    //
+
+    for (Index = 0; Index < NUMBER_OF_WORK_SUBMISSIONS; Index++) {
+        TraceStoreSubmitWork(Work);
+    }
+
+    TraceStoreWaitForWork(Work);
+    CHECK(Context.NumberOfCallbacks == NUMBER_OF_WORK_SUBMISSIONS);
+
+    //
+    // Waiting with nothing outstanding returns immediately, and the work
+    // item can be reused.
+    //
+
+    TraceStoreWaitForWork(Work);
+    TraceStoreSubmitWork(Work);
+    TraceStoreCloseWork(Work);
+    CHECK(Context.NumberOfCallbacks == NUMBER_OF_WORK_SUBMISSIONS + 1);
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+TestEvents(
+    VOID
+    )
+{
+    HANDLE Event;
+    PTP_WORK Work;
+    WORK_CONTEXT Context;
+
+    //
+    // Manual-reset events stay signaled.
+    //
+
+    Event = TraceStoreCreateEvent(TRUE, FALSE);
+    CHECK(Event != NULL);
+    CHECK(TraceStoreWaitForEvent(Event, 0) == WAIT_TIMEOUT);
+    CHECK(TraceStoreWaitForEvent(Event, 10) == WAIT_TIMEOUT);
+    CHECK(TraceStoreSetEvent(Event));
+    CHECK(TraceStoreWaitForEvent(Event, 0) == WAIT_OBJECT_0);
+    CHECK(TraceStoreWaitForEvent(Event, INFINITE) == WAIT_OBJECT_0);
+    CHECK(TraceStoreCloseEvent(Event));
+
+    //
+    // Auto-reset events are consumed by a single wait.
+    //
+
+    Event = TraceStoreCreateEvent(FALSE, TRUE);
+    CHECK(Event != NULL);
+    CHECK(TraceStoreWaitForEvent(Event, 0) == WAIT_OBJECT_0);
+    CHECK(TraceStoreWaitForEvent(Event, 0) == WAIT_TIMEOUT);
+    CHECK(TraceStoreSetEvent(Event));
+    CHECK(TraceStoreSetEvent(Event));
+    CHECK(TraceStoreWaitForEvent(Event, INFINITE) == WAIT_OBJECT_0);
+    CHECK(TraceStoreWaitForEvent(Event, 0) == WAIT_TIMEOUT);
+
+    //
+    // A waiter blocked on the event is woken by another thread.
+    //
+
+    memset(&Context, 0, sizeof(Context));
+    Context.Event = Event;
+
+    Work = TraceStoreCreateWork(SignalingWorkCallback, &Context, NULL);
+    CHECK(Work != NULL);
+
+    TraceStoreSubmitWork(Work);
+    CHECK(TraceStoreWaitForEvent(Event, INFINITE) == WAIT_OBJECT_0);
+
+    TraceStoreSubmitWork(Work);
+    CHECK(TraceStoreWaitForEvent(Event, 10000) == WAIT_OBJECT_0);
+
+    TraceStoreCloseWork(Work);
+    CHECK(TraceStoreCloseEvent(Event));
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+TestSList(
+    VOID
+    )
+{
+    ULONG Index;
+    ULONG NumberOfPops;
+    SLIST_HEADER ListHead;
+    PSLIST_ENTRY ListEntry;
+    TEST_SLIST_ENTRY Entries[3];
+    PTEST_SLIST_ENTRY ThreadEntries;
+    pthread_t Threads[NUMBER_OF_SLIST_THREADS];
+    SLIST_THREAD_CONTEXT Contexts[NUMBER_OF_SLIST_THREADS];
+
+    //
+    // Single-threaded push, pop and flush are LIFO.
+    //
+
+    InitializeSListHead(&ListHead);
+    CHECK(InterlockedPopEntrySList(&ListHead) == NULL);
+
+    for (Index = 0; Index < 3; Index++) {
+        InterlockedPushEntrySList(&ListHead, &Entries[Index].ListEntry);
+    }
+
+    CHECK(InterlockedPopEntrySList(&ListHead) == &Entries[2].ListEntry);
+
+    ListEntry = InterlockedFlushSList(&ListHead);
+    CHECK(ListEntry == &Entries[1].ListEntry);
+    CHECK(ListEntry->Next == &Entries[0].ListEntry);
+    CHECK(InterlockedPopEntrySList(&ListHead) == NULL);
+
+    //
+    // Concurrent pushes and pops neither lose nor duplicate entries.
+    //
+
+    ThreadEntries = (PTEST_SLIST_ENTRY)(
+        aligned_alloc(16,
+                      sizeof(TEST_SLIST_ENTRY) *
+                      NUMBER_OF_SLIST_THREADS *
+                      NUMBER_OF_SLIST_ENTRIES_PER_THREAD)
+    );
+    CHECK(ThreadEntries != NULL);
+
+    for (Index = 0; Index < NUMBER_OF_SLIST_THREADS; Index++) {
+        Contexts[Index].ListHead = &ListHead;
+        Contexts[Index].Entries = (
+            ThreadEntries + (Index * NUMBER_OF_SLIST_ENTRIES_PER_THREAD)
+        );
+        Contexts[Index].ThreadIndex = Index;
+        Contexts[Index].NumberOfPops = 0;
+        CHECK(pthread_create(&Threads[Index],
+                             NULL,
+                             SListThreadProc,
+                             &Contexts[Index]) == 0);
+    }
+
+    NumberOfPops = 0;
+
+    for (Index = 0; Index < NUMBER_OF_SLIST_THREADS; Index++) {
+        CHECK(pthread_join(Threads[Index], NULL) == 0);
+        NumberOfPops += Contexts[Index].NumberOfPops;
+    }
+
+    free(ThreadEntries);
+
+    CHECK(NumberOfPops == (NUMBER_OF_SLIST_THREADS *
+                           NUMBER_OF_SLIST_ENTRIES_PER_THREAD));
+    CHECK(InterlockedPopEntrySList(&ListHead) == NULL);
+
+    return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Main
+////////////////////////////////////////////////////////////////////////////////
+
+static const TEST Tests[] = {
+    { "FileSize", TestFileSize },
+    { "SectionsAndViews", TestSectionsAndViews },
+    { "Work", TestWork },
+    { "Events", TestEvents },
+    { "SList", TestSList },
+};
+
+int
+main(
+    VOID
+    )
+{
+    ULONG Index;
+    ULONG NumberOfFailures;
+
+    NumberOfFailures = 0;
+
+    for (Index = 0; Index < sizeof(Tests) / sizeof(Tests[0]); Index++) {
+        if (Tests[Index].Routine()) {
+            printf("PASS: %s\n", Tests[Index].Name);
+        } else {
+            printf("FAIL: %s\n", Tests[Index].Name);
+            NumberOfFailures++;
+        }
+    }
+
+    return (NumberOfFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
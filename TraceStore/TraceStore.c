@@ -763,8 +763,8 @@ Return Value:
 
     //
     // We use the following two bools to make it clearer what event
-    // type is being created in each CreateEvent() statement.  The
-    // values map to the `BOOL bManualReset` parameter of said routine.
+    // type is being created in each TraceStoreCreateEvent() statement.  The
+    // values map to the `BOOL ManualReset` parameter of said routine.
     //
 
     BOOL AutoReset = FALSE;
@@ -778,11 +778,9 @@ Return Value:
     //
 
     TraceStore->AllMemoryMapsAreFreeEvent = (
-        CreateEvent(
-            NULL,
+        TraceStoreCreateEvent(
             AutoReset,
-            FALSE,
-            NULL
+            FALSE
         )
     );
 
@@ -810,11 +808,9 @@ Return Value:
         //
 
         TraceStore->NextMemoryMapAvailableEvent = (
-            CreateEvent(
-                NULL,
+            TraceStoreCreateEvent(
                 AutoReset,
-                FALSE,
-                NULL
+                FALSE
             )
         );
 
@@ -825,11 +821,9 @@ Return Value:
     } else {
 
         TraceStore->ReadonlyMappingCompleteEvent = (
-            CreateEvent(
-                NULL,
+            TraceStoreCreateEvent(
                 AutoReset,
-                FALSE,
-                NULL
+                FALSE
             )
         );
 
@@ -892,7 +886,7 @@ Return Value:
     // The close memory map threadpool work item always gets created.
     //
 
-    TraceStore->CloseMemoryMapWork = CreateThreadpoolWork(
+    TraceStore->CloseMemoryMapWork = TraceStoreCreateWork(
         &CloseTraceStoreMemoryMapCallback,
         TraceStore,
         CallbackEnv
@@ -906,7 +900,7 @@ Return Value:
 
         if (HasMultipleRecords(Traits)) {
 
-            TraceStore->PrepareNextMemoryMapWork = CreateThreadpoolWork(
+            TraceStore->PrepareNextMemoryMapWork = TraceStoreCreateWork(
                 &PrepareNextTraceStoreMemoryMapCallback,
                 TraceStore,
                 CallbackEnv
@@ -916,7 +910,7 @@ Return Value:
                 return FALSE;
             }
 
-            TraceStore->PrefaultFuturePageWork = CreateThreadpoolWork(
+            TraceStore->PrefaultFuturePageWork = TraceStoreCreateWork(
                 &PrefaultFutureTraceStorePageCallback,
                 TraceStore,
                 CallbackEnv
@@ -930,7 +924,7 @@ Return Value:
     } else {
 
         TraceStore->PrepareReadonlyNonStreamingMemoryMapWork = (
-            CreateThreadpoolWork(
+            TraceStoreCreateWork(
                 &PrepareReadonlyTraceStoreMemoryMapCallback,
                 TraceStore,
                 CallbackEnv
@@ -1017,7 +1011,7 @@ Return Value:
     BOOL Success;
     LARGE_INTEGER EndOfFile;
     LARGE_INTEGER TotalAllocationSize;
-    FILE_STANDARD_INFO FileInfo;
+    LARGE_INTEGER CurrentEndOfFile;
 
     //
     // Validate arguments.
@@ -1052,12 +1046,7 @@ Return Value:
     // Get the file's current end of file info.
     //
 
-    Success = GetFileInformationByHandleEx(
-        TraceStore->FileHandle,
-        (FILE_INFO_BY_HANDLE_CLASS)FileStandardInfo,
-        &FileInfo,
-        sizeof(FileInfo)
-    );
+    Success = TraceStoreGetFileSize(TraceStore->FileHandle, &CurrentEndOfFile);
 
     if (!Success) {
         TraceStore->LastError = GetLastError();
@@ -1069,7 +1058,7 @@ Return Value:
     // Compare the current end of file with what we want to set it to.
     //
 
-    if (FileInfo.EndOfFile.QuadPart == EndOfFile.QuadPart) {
+    if (CurrentEndOfFile.QuadPart == EndOfFile.QuadPart) {
 
         //
         // Both values already match (unlikely) -- there's nothing more to do.
@@ -1082,10 +1071,10 @@ Return Value:
     // Adjust the file pointer to the desired position.
     //
 
-    Success = SetFilePointerEx(TraceStore->FileHandle,
-                               EndOfFile,
-                               NULL,
-                               FILE_BEGIN);
+    Success = TraceStoreSetFilePointer(TraceStore->FileHandle,
+                                       EndOfFile,
+                                       NULL,
+                                       FILE_BEGIN);
 
     if (!Success) {
         TraceStore->LastError = GetLastError();
@@ -1097,7 +1086,7 @@ Return Value:
     // And set the end of file.
     //
 
-    Success = SetEndOfFile(TraceStore->FileHandle);
+    Success = TraceStoreSetEndOfFile(TraceStore->FileHandle);
 
     if (!Success) {
         TraceStore->LastError = GetLastError();
@@ -1163,18 +1152,14 @@ Return Value:
     }
 
     if (TraceStore->PrepareNextMemoryMapWork) {
-        WaitForThreadpoolWorkCallbacks(
-            TraceStore->PrepareNextMemoryMapWork,
-            FALSE
-        );
-        CloseThreadpoolWork(TraceStore->PrepareNextMemoryMapWork);
+        TraceStoreWaitForWork(TraceStore->PrepareNextMemoryMapWork);
+        TraceStoreCloseWork(TraceStore->PrepareNextMemoryMapWork);
         TraceStore->PrepareNextMemoryMapWork = NULL;
     }
 
     if (TraceStore->PrefaultFuturePageWork) {
-        WaitForThreadpoolWorkCallbacks(TraceStore->PrefaultFuturePageWork,
-                                       FALSE);
-        CloseThreadpoolWork(TraceStore->PrefaultFuturePageWork);
+        TraceStoreWaitForWork(TraceStore->PrefaultFuturePageWork);
+        TraceStoreCloseWork(TraceStore->PrefaultFuturePageWork);
         TraceStore->PrefaultFuturePageWork = NULL;
     }
 
@@ -1202,8 +1187,8 @@ Return Value:
         SubmitCloseMemoryMapThreadpoolWork(TraceStore, &MemoryMap);
     }
 
-    WaitForThreadpoolWorkCallbacks(TraceStore->CloseMemoryMapWork, FALSE);
-    CloseThreadpoolWork(TraceStore->CloseMemoryMapWork);
+    TraceStoreWaitForWork(TraceStore->CloseMemoryMapWork);
+    TraceStoreCloseWork(TraceStore->CloseMemoryMapWork);
     TraceStore->CloseMemoryMapWork = NULL;
 
     //
@@ -1211,7 +1196,8 @@ Return Value:
     // free' event will be set, so we wait on this here.
     //
 
-    WaitResult = WaitForSingleObject(TraceStore->AllMemoryMapsAreFreeEvent, 0);
+    WaitResult = TraceStoreWaitForEvent(TraceStore->AllMemoryMapsAreFreeEvent,
+                                        0);
     if (WaitResult != WAIT_OBJECT_0) {
         __debugbreak();
     }
@@ -1237,7 +1223,7 @@ Return Value:
     }
 
     if (TraceStore->NextMemoryMapAvailableEvent) {
-        if (!CloseHandle(TraceStore->NextMemoryMapAvailableEvent)) {
+        if (!TraceStoreCloseEvent(TraceStore->NextMemoryMapAvailableEvent)) {
             TraceStore->LastError = GetLastError();
             __debugbreak();
         } else {
@@ -1246,7 +1232,7 @@ Return Value:
     }
 
     if (TraceStore->AllMemoryMapsAreFreeEvent) {
-        if (!CloseHandle(TraceStore->AllMemoryMapsAreFreeEvent)) {
+        if (!TraceStoreCloseEvent(TraceStore->AllMemoryMapsAreFreeEvent)) {
             TraceStore->LastError = GetLastError();
             __debugbreak();
         } else {
@@ -1380,17 +1366,32 @@ Return Value:
     // important because closing the trace store will retire any active memory
     // maps, which will update the underlying MemoryMap->pAddress structures,
     // which will be backed by the AddressStore, which we can only access as
-    // long as we haven't closed it.
+    // long as we haven't closed it.  Likewise, any per-thread allocation
+    // chunks are retired first, as this updates the :Allocation records.
+    // Per-thread shards are independent trace stores and are closed first.
     //
 
+    CloseTraceStoreShards(TraceStore);
+
+    RetireTraceStoreAllocationChunks(TraceStore, TRUE);
+
     CloseStore(TraceStore);
 
+    //
+    // All memory maps have been closed (and thus compressed) at this point,
+    // so the block compression state can be closed.
+    //
+
+    CloseTraceStoreBlockCompression(TraceStore);
+
     //
     // Close the metadata stores.
     //
 
     CLOSE_METADATA_STORES();
 
+    DestroyTraceStoreAllocationChunks(TraceStore);
+
 }
 
 _Use_decl_annotations_
@@ -1448,9 +1449,15 @@ Return Value:
     // important because closing the trace store will retire any active memory
     // maps, which will update the underlying MemoryMap->pAddress structures,
     // which will be backed by the AddressStore, which we can only access as
-    // long as we haven't closed it.
+    // long as we haven't closed it.  Likewise, any per-thread allocation
+    // chunks are retired first, as this updates the :Allocation records.
+    // Per-thread shards are independent trace stores and are run down first.
     //
 
+    RundownTraceStoreShards(TraceStore);
+
+    RetireTraceStoreAllocationChunks(TraceStore, FALSE);
+
     RundownStore(TraceStore);
 
     //
@@ -601,7 +601,10 @@ typedef struct _Struct_size_bytes_(sizeof(ULONG)) _TRACE_STORE_TRAITS {
     //
     // When set, indicates that multiple threads will be allocating from the
     // trace store concurrently, and thus, the trace store should serialize
-    // access.  This is done via a critical section.
+    // access.  This is done via a critical section.  If the record size is
+    // fixed, each thread reserves a chunk of records under the critical
+    // section and then allocates from it without synchronization; see
+    // TRACE_STORE_ALLOCATION_CHUNKS.
     //
     // Invariants:
     //
@@ -702,11 +705,53 @@ typedef struct _Struct_size_bytes_(sizeof(ULONG)) _TRACE_STORE_TRAITS {
 
     ULONG Compress:1;
 
+    //
+    // When set, indicates that each thread allocating from the trace store
+    // should be given its own physical trace store (a shard), backed by its
+    // own file, such that allocations never need to be synchronized between
+    // threads.  The logical trace store's file remains empty; readers use a
+    // TRACE_STORE_SHARD_READER to consume the records of all shards as a
+    // single stream, ordered by allocation timestamp.  See TRACE_STORE_SHARDS
+    // for more information.
+    //
+    // Invariants:
+    //
+    //  - If PerThreadShards == TRUE:
+    //      Assert MultipleRecords == TRUE
+    //      Assert ConcurrentAllocations == FALSE
+    //      Assert LinkedStore == FALSE
+    //      Assert Periodic == FALSE
+    //      Assert TraceStore->IsMetadata == FALSE
+    //
+
+    ULONG PerThreadShards:1;
+
+    //
+    // When set, indicates that each memory map of the trace store should be
+    // compressed into fixed-size blocks when it is retired.  Compression is
+    // performed by the threadpool work item that closes the memory map, so
+    // the allocation path never waits on it.  The compressed blocks and a
+    // seekable block index are written to alternate data streams of the
+    // trace store's file, and the uncompressed range is deallocated from the
+    // file.  Readonly trace stores transparently decompress the blocks into
+    // their memory maps as they're prepared; such stores don't get a flat
+    // memory map.  See TRACE_STORE_BLOCK_COMPRESSION for more info.
+    //
+    // Invariants:
+    //
+    //  - If BlockCompression == TRUE:
+    //      Assert MultipleRecords == TRUE
+    //      Assert PerThreadShards == FALSE
+    //      Assert TraceStore->IsMetadata == FALSE
+    //
+
+    ULONG BlockCompression:1;
+
     //
     // Mark the remaining bits as unused.
     //
 
-    ULONG Unused:16;
+    ULONG Unused:14;
 
 } TRACE_STORE_TRAITS, *PTRACE_STORE_TRAITS;
 typedef const TRACE_STORE_TRAITS CTRACE_STORE_TRAITS, *PCTRACE_STORE_TRAITS;
@@ -743,7 +788,10 @@ typedef enum _Enum_is_bitflag_ _TRACE_STORE_TRAIT_ID {
     PeriodicTrait                       =  1 << 12,
     ConcurrentDataStructureTrait        =  1 << 13,
     NoAllocationAlignmentTrait          =  1 << 14,
-    InvalidTrait                        = (1 << 14) + 1
+    CompressTrait                       =  1 << 15,
+    PerThreadShardsTrait                =  1 << 16,
+    BlockCompressionTrait               =  1 << 17,
+    InvalidTrait                        = (1 << 17) + 1
 } TRACE_STORE_TRAIT_ID, *PTRACE_STORE_TRAIT_ID;
 
 //
@@ -796,6 +844,8 @@ typedef enum _Enum_is_bitflag_ _TRACE_STORE_TRAIT_ID {
 #define NoAllocationAlignment(Traits) ((Traits).NoAllocationAlignment)
 #define IsCompressed(Traits) ((Traits).Compress)
 #define WantsCompression(Traits) ((Traits).Compress)
+#define HasPerThreadShards(Traits) ((Traits).PerThreadShards)
+#define WantsBlockCompression(Traits) ((Traits).BlockCompression)
 
 //
 // TRACE_STORE_INFO is intended for storage of single-instance structs of
@@ -3081,6 +3131,454 @@ typedef volatile PTRACE_STORE_MEMORY_MAP VPTRACE_STORE_MEMORY_MAP;
 
 C_ASSERT(sizeof(TRACE_STORE_MEMORY_MAP) == 64);
 
+//
+// Trace stores with the concurrent allocations trait and a fixed record size
+// satisfy most allocations from a per-thread allocation chunk instead of
+// entering the allocation critical section for every record.  A chunk is
+// carved out of the store's active memory map under the critical section,
+// along with a matching slice of :AllocationTimestamp slots and two :Allocation
+// records: one describing the chunk's records, and a dummy allocation record
+// that will describe whatever is left unused when the chunk is retired.  Once
+// reserved, allocating from a chunk is a pointer bump by the owning thread.
+//
+// Every record slot of a chunk, used or not, occupies space in the trace store
+// and has an :AllocationTimestamp slot, so the NumberOfAllocations totals of
+// both stores count slots, and slot N of the trace store continues to
+// correspond to timestamp N.  The NumberOfRecords and RecordSize totals only
+// count the records actually used.  When a chunk is retired, its unused
+// timestamp slots are filled with the timestamp of the chunk's last record.
+// As chunks of different threads are filled concurrently, timestamps aren't
+// monotonic by position in stores that use chunks; such stores don't support
+// intervals.
+//
+
+typedef struct _TRACE_STORE_ALLOCATION_CHUNK {
+
+    //
+    // Thread ID of the thread that owns this chunk, or 0 if the slot hasn't
+    // been claimed yet.
+    //
+
+    volatile ULONG OwningThreadId;                          // 4    0   4
+
+    //
+    // The value of TRACE_STORE_ALLOCATION_CHUNKS.Generation when this chunk
+    // was reserved.  The chunk can only be allocated from while they match.
+    //
+
+    ULONG Generation;                                       // 4    4   8
+
+    //
+    // The record size the chunk was reserved for, and the bounds of the
+    // chunk's remaining space.
+    //
+
+    ULONG_PTR RecordSize;                                   // 8    8   16
+    PCHAR NextAddress;                                      // 8    16  24
+    PCHAR EndAddress;                                       // 8    24  32
+
+    //
+    // Points to the next :AllocationTimestamp slot, or NULL if allocation
+    // timestamps aren't being captured for the trace store.
+    //
+
+    PLARGE_INTEGER NextTimestamp;                           // 8    32  40
+
+    //
+    // The :Allocation record describing this chunk's records, and the dummy
+    // allocation record that immediately follows it.
+    //
+
+    PTRACE_STORE_ALLOCATION Allocation;                     // 8    40  48
+    PTRACE_STORE_ALLOCATION DummyAllocation;                // 8    48  56
+
+    //
+    // Points to the chunk's first :AllocationTimestamp slot, or NULL if
+    // allocation timestamps aren't being captured for the trace store.
+    //
+
+    PLARGE_INTEGER FirstTimestamp;                          // 8    56  64
+
+} TRACE_STORE_ALLOCATION_CHUNK, *PTRACE_STORE_ALLOCATION_CHUNK;
+C_ASSERT(sizeof(TRACE_STORE_ALLOCATION_CHUNK) == 64);
+
+#define MAX_TRACE_STORE_ALLOCATION_CHUNKS 63
+
+typedef struct _Struct_size_bytes_(SizeOfStruct)
+_TRACE_STORE_ALLOCATION_CHUNKS {
+
+    //
+    // Structure size, in bytes.
+    //
+
+    _Field_range_(==, sizeof(struct _TRACE_STORE_ALLOCATION_CHUNKS))
+        ULONG SizeOfStruct;
+
+    //
+    // Number of elements in the Chunks array below.
+    //
+
+    ULONG NumberOfChunks;
+
+    //
+    // Incremented (whilst holding the allocation critical section) each time
+    // the trace store, its :Allocation store or its :AllocationTimestamp store
+    // activates a new memory map.  Chunks reserved in an older generation may
+    // point into memory maps that are about to be retired, so they aren't
+    // allocated from.  The memory map pointers below are the active maps as of
+    // the last check.
+    //
+
+    volatile ULONG Generation;
+
+    //
+    // Size of each chunk, in bytes.
+    //
+
+    ULONG ChunkSize;
+
+    PTRACE_STORE_MEMORY_MAP MemoryMap;
+    PTRACE_STORE_MEMORY_MAP AllocationMemoryMap;
+    PTRACE_STORE_MEMORY_MAP AllocationTimestampMemoryMap;
+
+    //
+    // Pad out to 64 bytes such that each chunk gets its own cache line.
+    //
+
+    ULONGLONG Padding[3];
+
+    TRACE_STORE_ALLOCATION_CHUNK Chunks[MAX_TRACE_STORE_ALLOCATION_CHUNKS];
+
+} TRACE_STORE_ALLOCATION_CHUNKS, *PTRACE_STORE_ALLOCATION_CHUNKS;
+C_ASSERT(FIELD_OFFSET(TRACE_STORE_ALLOCATION_CHUNKS, Chunks) == 64);
+C_ASSERT(sizeof(TRACE_STORE_ALLOCATION_CHUNKS) == 4096);
+
+//
+// Trace stores with the PerThreadShards trait give each allocating thread its
+// own physical trace store (a shard), complete with its own metadata stores,
+// which is written to without any synchronization.  Shard N of the trace
+// store backed by "<Name>.dat" lives in "<Name>.Shard<N>.dat".  Shards are
+// created lazily, the first time a thread allocates from the logical store,
+// and are bound synchronously on that thread.
+//
+
+#define MAX_TRACE_STORE_SHARDS 64
+
+typedef struct _TRACE_STORE_SHARD {
+
+    //
+    // Thread ID of the thread that owns this slot, or 0 if unowned.
+    //
+
+    volatile ULONG OwningThreadId;
+
+    //
+    // Index of the shard, which is used to derive the shard's file name.
+    //
+
+    USHORT ShardIndex;
+
+    //
+    // Set if the shard could not be created, in which case allocations from
+    // the owning thread will fail.
+    //
+
+    BOOLEAN Failed;
+
+    BYTE Padding1;
+
+    //
+    // Pointer to the shard's trace store, or NULL if it hasn't been created
+    // yet.  The shard's metadata stores immediately follow the trace store in
+    // memory, in the same order as the InitializeTraceStore() parameters.
+    //
+
+    PTRACE_STORE TraceStore;
+
+} TRACE_STORE_SHARD, *PTRACE_STORE_SHARD;
+C_ASSERT(sizeof(TRACE_STORE_SHARD) == 16);
+
+typedef struct _Struct_size_bytes_(SizeOfStruct) _TRACE_STORE_SHARDS {
+
+    //
+    // Structure size, in bytes.
+    //
+
+    _Field_range_(==, sizeof(struct _TRACE_STORE_SHARDS))
+        ULONG SizeOfStruct;
+
+    //
+    // Number of elements in the Shards array below.
+    //
+
+    ULONG NumberOfSlots;
+
+    //
+    // Number of shards created so far.  This is used to hand out shard indexes
+    // and thus never decreases.
+    //
+
+    volatile LONG NumberOfShards;
+
+    ULONG Padding1;
+
+    TRACE_STORE_SHARD Shards[MAX_TRACE_STORE_SHARDS];
+
+    //
+    // Fully-qualified path of the logical trace store's file, from which the
+    // shard file names are derived.
+    //
+
+    WCHAR Path[_OUR_MAX_PATH];
+
+} TRACE_STORE_SHARDS, *PTRACE_STORE_SHARDS;
+C_ASSERT(FIELD_OFFSET(TRACE_STORE_SHARDS, Shards) == 16);
+
+//
+// A TRACE_STORE_SHARD_READER is used on the readonly side to consume all the
+// shards of a trace store with the PerThreadShards trait as a single stream of
+// allocations, ordered by allocation timestamp.  This is done via a k-way
+// merge: each shard has a cursor over its data, :Allocation and
+// :AllocationTimestamp files, and a binary min-heap of cursors keyed by their
+// current timestamp yields the next allocation.  The size of each allocation
+// and any padding between allocations are derived from the shard's
+// :Allocation records.
+//
+
+typedef struct _TRACE_STORE_SHARD_CURSOR {
+
+    //
+    // Index of the shard this cursor reads from.
+    //
+
+    USHORT ShardIndex;
+
+    //
+    // Indicates whether the shard's allocations were coalesced.  If so, each
+    // record of an :Allocation record is treated as a separate allocation;
+    // otherwise, each :Allocation record describes a single allocation.
+    //
+
+    BOOLEAN CoalescedAllocations;
+
+    BYTE Padding1;
+    ULONG Padding2;
+
+    //
+    // Size of the next allocation, in bytes, and the number of allocations
+    // remaining in the current :Allocation record, including the next one.
+    //
+
+    ULONGLONG AllocationSize;
+    ULONGLONG AllocationsRemaining;
+
+    //
+    // Pointers to the next allocation and its timestamp, the end of the
+    // timestamp array, the current :Allocation record and the end of the
+    // :Allocation record array.
+    //
+
+    PCHAR NextAddress;
+    PLARGE_INTEGER NextTimestamp;
+    PLARGE_INTEGER EndTimestamp;
+    PTRACE_STORE_ALLOCATION NextAllocation;
+    PTRACE_STORE_ALLOCATION EndAllocation;
+
+    //
+    // Timestamp of the next allocation.  If an allocation's timestamp wasn't
+    // recorded (i.e. is 0), the previous allocation's timestamp is used.
+    //
+
+    LARGE_INTEGER Timestamp;
+
+    //
+    // File handles, mapping handles and views of the shard's data file,
+    // :Allocation stream and :AllocationTimestamp stream.
+    //
+
+    HANDLE DataFileHandle;
+    HANDLE DataMappingHandle;
+    PVOID DataBaseAddress;
+    LARGE_INTEGER DataSize;
+
+    HANDLE AllocationRecordsFileHandle;
+    HANDLE AllocationRecordsMappingHandle;
+    PVOID AllocationRecordsBaseAddress;
+    LARGE_INTEGER AllocationRecordsSize;
+
+    HANDLE TimestampFileHandle;
+    HANDLE TimestampMappingHandle;
+    PVOID TimestampBaseAddress;
+    LARGE_INTEGER TimestampSize;
+
+} TRACE_STORE_SHARD_CURSOR, *PTRACE_STORE_SHARD_CURSOR;
+
+typedef struct _Struct_size_bytes_(SizeOfStruct) _TRACE_STORE_SHARD_READER {
+
+    //
+    // Structure size, in bytes.
+    //
+
+    _Field_range_(==, sizeof(struct _TRACE_STORE_SHARD_READER))
+        ULONG SizeOfStruct;
+
+    //
+    // Number of shards opened, which is the number of valid elements in the
+    // Cursors array.
+    //
+
+    ULONG NumberOfShards;
+
+    //
+    // Number of cursors in the heap; that is, the number of shards that still
+    // have allocations remaining.
+    //
+
+    ULONG HeapSize;
+
+    ULONG Padding1;
+
+    //
+    // Total number of allocations across all shards, and the number of them
+    // that have been read so far.
+    //
+
+    ULONGLONG NumberOfAllocations;
+    ULONGLONG AllocationsRead;
+
+    PALLOCATOR Allocator;
+    PTRACE_STORE TraceStore;
+
+    //
+    // Binary min-heap of indexes into the Cursors array.
+    //
+
+    ULONG Heap[MAX_TRACE_STORE_SHARDS];
+
+    TRACE_STORE_SHARD_CURSOR Cursors[MAX_TRACE_STORE_SHARDS];
+
+} TRACE_STORE_SHARD_READER, *PTRACE_STORE_SHARD_READER;
+typedef TRACE_STORE_SHARD_READER **PPTRACE_STORE_SHARD_READER;
+
+//
+// Trace stores with the BlockCompression trait compress each memory map into
+// blocks of TRACE_STORE_COMPRESSED_BLOCK_SIZE bytes when the map is closed.
+// The blocks are appended to the :CompressedBlocks stream of the trace store's
+// file, and a TRACE_STORE_BLOCK entry describing each one is appended to the
+// :BlockIndex stream.  Once both streams have been flushed, the uncompressed
+// range is deallocated from the data file (leaving a sparse hole).  Ranges of
+// the data file that don't have a block (e.g. maps that were run down during
+// process exit) are left as is, and are read directly from the file.
+//
+
+#define TRACE_STORE_COMPRESSED_BLOCK_SIZE (1 << 16)
+
+typedef union _TRACE_STORE_BLOCK_FLAGS {
+    struct {
+
+        //
+        // When set, indicates the block did not compress and was written to
+        // the :CompressedBlocks stream verbatim.
+        //
+
+        ULONG Stored:1;
+
+        ULONG Unused:31;
+    };
+    LONG AsLong;
+    ULONG AsULong;
+} TRACE_STORE_BLOCK_FLAGS, *PTRACE_STORE_BLOCK_FLAGS;
+C_ASSERT(sizeof(TRACE_STORE_BLOCK_FLAGS) == sizeof(ULONG));
+
+typedef struct _TRACE_STORE_BLOCK {
+
+    //
+    // Offset of the block's uncompressed data in the trace store's file.
+    //
+
+    LARGE_INTEGER FileOffset;
+
+    //
+    // Offset of the block's compressed data in the :CompressedBlocks stream.
+    //
+
+    LARGE_INTEGER CompressedOffset;
+
+    ULONG UncompressedSize;
+    ULONG CompressedSize;
+
+    TRACE_STORE_BLOCK_FLAGS Flags;
+
+    ULONG Padding1;
+
+} TRACE_STORE_BLOCK, *PTRACE_STORE_BLOCK;
+C_ASSERT(sizeof(TRACE_STORE_BLOCK) == 32);
+
+typedef struct _Struct_size_bytes_(SizeOfStruct)
+_TRACE_STORE_BLOCK_COMPRESSION {
+
+    //
+    // Structure size, in bytes.
+    //
+
+    _Field_range_(==, sizeof(struct _TRACE_STORE_BLOCK_COMPRESSION))
+        ULONG SizeOfStruct;
+
+    //
+    // Size of an uncompressed block, in bytes.
+    //
+
+    ULONG BlockSize;
+
+    //
+    // Handles to the :CompressedBlocks and :BlockIndex streams.
+    //
+
+    HANDLE BlocksFileHandle;
+    HANDLE IndexFileHandle;
+
+    //
+    // Writer side.  Memory maps are closed by threadpool work items, which
+    // may run concurrently; the lock serializes appends to the streams and
+    // updates to the counters below.  DataFileHandle is a synchronous handle
+    // to the trace store's file, used to deallocate compressed ranges.
+    //
+
+    SRWLOCK Lock;
+    HANDLE DataFileHandle;
+    LARGE_INTEGER BlocksEndOfFile;
+
+    ULONGLONG NumberOfBlocks;
+    ULONGLONG NumberOfStoredBlocks;
+    ULONGLONG UncompressedBytes;
+    ULONGLONG CompressedBytes;
+
+    //
+    // Number of memory maps that could not be compressed.  Their data remains
+    // in the trace store's file.
+    //
+
+    ULONG NumberOfFailedMemoryMaps;
+
+    ULONG Padding1;
+
+    //
+    // Readonly side.  The :CompressedBlocks stream is mapped in its entirety,
+    // and the :BlockIndex stream is loaded into the Blocks array and sorted by
+    // file offset.
+    //
+
+    HANDLE BlocksMappingHandle;
+    PVOID BlocksBaseAddress;
+    LARGE_INTEGER BlocksSize;
+
+    ULONGLONG NumberOfIndexEntries;
+    PTRACE_STORE_BLOCK Blocks;
+
+    PALLOCATOR Allocator;
+
+} TRACE_STORE_BLOCK_COMPRESSION, *PTRACE_STORE_BLOCK_COMPRESSION;
+
 //
 // Define the normal trace store allocation function pointer interfaces.
 //
@@ -3468,10 +3966,11 @@ typedef struct _TRACE_STORE {
 
     //
     // FlatMappingHandle will only have a value if we're readonly and not a
-    // metadata trace store or single record store.  The flag HasFlatMapping
-    // will also be set during initial readonly preparation (in the bind step);
-    // this flag is subsequently checked when all trace stores have completed
-    // loading, and, if set, the actual memory mapping is done at this point.
+    // metadata trace store, single record store or store with compressed
+    // blocks.  The flag HasFlatMapping will also be set during initial
+    // readonly preparation (in the bind step); this flag is subsequently
+    // checked when all trace stores have completed loading, and, if set, the
+    // actual memory mapping is done at this point.
     // It is done like this in order to ensure the flat memory maps (which are
     // a convenience only) don't clobber address ranges that need to be mapped
     // by trace store's being prepared concurrently.
@@ -3539,7 +4038,8 @@ typedef struct _TRACE_STORE {
     // provided; if the trace store hasn't indicated concurrent allocations in
     // its traits, Impl1 will be the final allocator method.  Otherwise, Impl1
     // will be an intermediate function that serializes allocations through a
-    // critical section, and Impl2 will be the final allocator method.
+    // critical section (or satisfies them from a per-thread allocation chunk),
+    // and Impl2 will be the final allocator method.
     //
     // Thus, the public AllocateRecordsWithTimestamp function pointer above
     // will either point to SuspendedAllocateRecordsWithTimestamp or the Impl1
@@ -3707,11 +4207,32 @@ typedef struct _TRACE_STORE {
 
     struct _TRACE_STORE_CUDA *Cuda;
 
+    //
+    // Per-thread allocation chunks, if the trace store has concurrent
+    // allocations and a fixed record size.
+    //
+
+    PTRACE_STORE_ALLOCATION_CHUNKS AllocationChunks;
+
+    //
+    // Per-thread shards, if the trace store has the PerThreadShards trait.
+    // This is set on the logical trace store only; shards have it cleared.
+    //
+
+    PTRACE_STORE_SHARDS Shards;
+
+    //
+    // Block compression state, if the trace store has the BlockCompression
+    // trait (or, for readonly stores, if a :BlockIndex stream was found).
+    //
+
+    PTRACE_STORE_BLOCK_COMPRESSION BlockCompression;
+
     //
     // Final padding.
     //
 
-    ULONGLONG Padding3[20];
+    ULONGLONG Padding3[17];
 
 } TRACE_STORE, *PTRACE_STORE, **PPTRACE_STORE;
 C_ASSERT(sizeof(TRACE_STORE) == 2048);
@@ -3945,6 +4466,41 @@ typedef UPDATE_TRACER_CONFIG_WITH_TRACE_STORE_INFO \
 TRACE_STORE_API UPDATE_TRACER_CONFIG_WITH_TRACE_STORE_INFO \
                 UpdateTracerConfigWithTraceStoreInfo;
 
+//
+// TraceStoreShards-related functions.
+//
+
+typedef
+_Success_(return != 0)
+_Check_return_
+BOOL
+(OPEN_TRACE_STORE_SHARD_READER)(
+    _In_ PTRACE_STORE TraceStore,
+    _Outptr_result_nullonfailure_ PPTRACE_STORE_SHARD_READER ReaderPointer
+    );
+typedef OPEN_TRACE_STORE_SHARD_READER *POPEN_TRACE_STORE_SHARD_READER;
+TRACE_STORE_API OPEN_TRACE_STORE_SHARD_READER OpenTraceStoreShardReader;
+
+typedef
+_Success_(return != 0)
+BOOL
+(READ_TRACE_STORE_SHARD_READER)(
+    _In_ PTRACE_STORE_SHARD_READER Reader,
+    _Out_ PVOID *AddressPointer,
+    _Out_opt_ PLARGE_INTEGER TimestampPointer,
+    _Out_opt_ PUSHORT ShardIndexPointer
+    );
+typedef READ_TRACE_STORE_SHARD_READER *PREAD_TRACE_STORE_SHARD_READER;
+TRACE_STORE_API READ_TRACE_STORE_SHARD_READER ReadTraceStoreShardReader;
+
+typedef
+VOID
+(CLOSE_TRACE_STORE_SHARD_READER)(
+    _Inout_ PPTRACE_STORE_SHARD_READER ReaderPointer
+    );
+typedef CLOSE_TRACE_STORE_SHARD_READER *PCLOSE_TRACE_STORE_SHARD_READER;
+TRACE_STORE_API CLOSE_TRACE_STORE_SHARD_READER CloseTraceStoreShardReader;
+
 //
 // TraceStoreContext-related functions.
 //
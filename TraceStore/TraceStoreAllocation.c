@@ -181,8 +181,13 @@ Routine Description:
         __debugbreak();
     }
 
+    //
+    // N.B. String tables may be allocated more than one at a time when they
+    //      are reserved as part of a per-thread allocation chunk.
+    //
+
     if (TraceStore->TraceStoreIndex == TraceStoreStringTableIndex) {
-        if (!(RecordSize == 512 && NumberOfRecords == 1)) {
+        if (RecordSize != 512) {
             __debugbreak();
         }
     }
@@ -1034,10 +1039,15 @@ ConcurrentTraceStoreAllocateRecordsWithTimestamp(
 Routine Description:
 
     This routine serializes trace store allocations in a multithreaded
-    environment by acquiring the trace store's critical section before
-    dispatching the allocation request.  It is enabled automatically if
-    the trace store was configured with the concurrent allocations trait
-    set.
+    environment.  It is enabled automatically if the trace store was
+    configured with the concurrent allocations trait set.
+
+    If the trace store has per-thread allocation chunks, the allocation is
+    first attempted against the calling thread's chunk, which requires no
+    synchronization.  Otherwise, or if the chunk can't satisfy the request,
+    the trace store's critical section is acquired and the request is
+    dispatched to LockedTraceStoreAllocateRecordsWithTimestamp(), which will
+    replace the chunk if applicable.
 
 Arguments:
 
@@ -1066,15 +1076,37 @@ Return Value:
 --*/
 {
     PVOID Address;
-    PALLOCATE_RECORDS_WITH_TIMESTAMP AllocateWithTimestamp;
+    PTRACE_STORE_ALLOCATION_CHUNK Chunk = NULL;
+    PTRACE_STORE_ALLOCATION_CHUNKS Chunks;
+
+    //
+    // Try the calling thread's allocation chunk first, if applicable.
+    //
+
+    Chunks = TraceStore->AllocationChunks;
+    if (Chunks) {
+        Chunk = GetTraceStoreAllocationChunk(Chunks);
+        if (Chunk) {
+            Address = AllocateRecordsFromTraceStoreAllocationChunk(
+                Chunks,
+                Chunk,
+                NumberOfRecords,
+                RecordSize,
+                TimestampPointer
+            );
+            if (Address) {
+                return Address;
+            }
+        }
+    }
 
-    AllocateWithTimestamp = TraceStore->AllocateRecordsWithTimestampImpl2;
     EnterCriticalSection(&TraceStore->Sync->AllocationCriticalSection);
-    Address = AllocateWithTimestamp(TraceContext,
-                                    TraceStore,
-                                    NumberOfRecords,
-                                    RecordSize,
-                                    TimestampPointer);
+    Address = LockedTraceStoreAllocateRecordsWithTimestamp(TraceContext,
+                                                           TraceStore,
+                                                           Chunk,
+                                                           NumberOfRecords,
+                                                           RecordSize,
+                                                           TimestampPointer);
     LeaveCriticalSection(&TraceStore->Sync->AllocationCriticalSection);
     return Address;
 }
@@ -1095,7 +1127,8 @@ Routine Description:
     This routine attempts to acquire the trace store's critical section lock
     before dispatching the allocation request.  If the lock is contended, or
     allocations have been suspended, this routine returns immediately with a
-    NULL pointer.
+    NULL pointer.  Allocations that can be satisfied by the calling thread's
+    allocation chunk (if applicable) never need the lock.
 
     N.B. There is no way to distinguish between a contended lock, suspended
          allocations and a failed allocation attempt due to some underlying
@@ -1134,8 +1167,9 @@ Return Value:
     PVOID Address = NULL;
     HANDLE Event;
     ULONG WaitResult;
-    PALLOCATE_RECORDS_WITH_TIMESTAMP AllocateWithTimestamp;
     PCRITICAL_SECTION CriticalSection;
+    PTRACE_STORE_ALLOCATION_CHUNK Chunk = NULL;
+    PTRACE_STORE_ALLOCATION_CHUNKS Chunks;
 
     //
     // Immediately increment the active allocator count before we see if the
@@ -1161,7 +1195,29 @@ Return Value:
     }
 
     //
-    // Allocations aren't suspended.  Attempt to acquire the critical section.
+    // Allocations aren't suspended.  Try the calling thread's allocation chunk
+    // first, if applicable.
+    //
+
+    Chunks = TraceStore->AllocationChunks;
+    if (Chunks) {
+        Chunk = GetTraceStoreAllocationChunk(Chunks);
+        if (Chunk) {
+            Address = AllocateRecordsFromTraceStoreAllocationChunk(
+                Chunks,
+                Chunk,
+                NumberOfRecords,
+                RecordSize,
+                TimestampPointer
+            );
+            if (Address) {
+                goto End;
+            }
+        }
+    }
+
+    //
+    // Attempt to acquire the critical section.
     //
 
     CriticalSection = &TraceStore->Sync->AllocationCriticalSection;
@@ -1173,12 +1229,12 @@ Return Value:
     // Continue with allocation.  We now own the critical section.
     //
 
-    AllocateWithTimestamp = TraceStore->AllocateRecordsWithTimestampImpl2;
-    Address = AllocateWithTimestamp(TraceContext,
-                                    TraceStore,
-                                    NumberOfRecords,
-                                    RecordSize,
-                                    TimestampPointer);
+    Address = LockedTraceStoreAllocateRecordsWithTimestamp(TraceContext,
+                                                           TraceStore,
+                                                           Chunk,
+                                                           NumberOfRecords,
+                                                           RecordSize,
+                                                           TimestampPointer);
 
     //
     // Leave the critical section and decrement the active allocator count, then
@@ -1371,12 +1427,15 @@ Return Value:
         //
         //  A) The trace store has explicitly disabled coalesced allocations, or
         //  B) This is the first allocation (number of records will be 0), or
-        //  C) The previous record size doesn't match the current record size.
+        //  C) The previous record is a dummy allocation (which will be the
+        //     case after a per-thread allocation chunk has been reserved), or
+        //  D) The previous record size doesn't match the current record size.
         //
 
         RecordNewRecord = (
             !WantsCoalescedAllocations(Traits) || (
                 Allocation->NumberOfRecords.QuadPart == 0 ||
+                IsDummyAllocation(Allocation) ||
                 Allocation->RecordSize.QuadPart != RecordSize
             )
         );
@@ -1439,4 +1498,626 @@ Return Value:
 }
 
 
+_Use_decl_annotations_
+PVOID
+LockedTraceStoreAllocateRecordsWithTimestamp(
+    PTRACE_CONTEXT  TraceContext,
+    PTRACE_STORE    TraceStore,
+    PTRACE_STORE_ALLOCATION_CHUNK Chunk,
+    ULONG_PTR       NumberOfRecords,
+    ULONG_PTR       RecordSize,
+    PLARGE_INTEGER  TimestampPointer
+    )
+/*++
+
+Routine Description:
+
+    This routine services a concurrent trace store allocation whilst the
+    trace store's allocation critical section is held.  If the calling
+    thread has an allocation chunk and the request is small relative to the
+    chunk size, the thread's current chunk is retired, a new one is reserved,
+    and the allocation is satisfied from it.  Otherwise, the request is
+    dispatched to the underlying allocator directly.
+
+Arguments:
+
+    TraceContext - Supplies a pointer to a TRACE_CONTEXT structure.
+
+    TraceStore - Supplies a pointer to a TRACE_STORE structure that the memory
+        is to be allocated from.
+
+    Chunk - Optionally supplies a pointer to the calling thread's allocation
+        chunk.
+
+    NumberOfRecords - Supplies the number of records to allocate.
+
+    RecordSize - Supplies the size of the record to allocate.
+
+    TimestampPointer - Optionally supplies a pointer to a timestamp value to
+        associate with the allocation.
+
+Return Value:
+
+    A pointer to the base memory address satisfying the total requested size
+    if the memory could be obtained successfully, NULL otherwise.
+
+--*/
+{
+    BOOL UseChunk;
+    PVOID Address;
+    PTRACE_STORE_ALLOCATION_CHUNKS Chunks;
+    PALLOCATE_RECORDS_WITH_TIMESTAMP AllocateWithTimestamp;
+
+    Chunks = TraceStore->AllocationChunks;
+
+    //
+    // Requests larger than half a chunk are sent straight to the underlying
+    // allocator; replacing the chunk for them would waste most of it.
+    //
+
+    UseChunk = (
+        Chunk != NULL &&
+        NumberOfRecords <= Chunks->ChunkSize &&
+        (NumberOfRecords * RecordSize) <= (Chunks->ChunkSize >> 1)
+    );
+
+    if (UseChunk) {
+
+        RetireTraceStoreAllocationChunk(TraceStore, Chunks, Chunk);
+
+        if (ReserveTraceStoreAllocationChunk(TraceContext,
+                                             TraceStore,
+                                             Chunks,
+                                             Chunk,
+                                             RecordSize)) {
+
+            Address = AllocateRecordsFromTraceStoreAllocationChunk(
+                Chunks,
+                Chunk,
+                NumberOfRecords,
+                RecordSize,
+                TimestampPointer
+            );
+
+            if (Address) {
+                return Address;
+            }
+        }
+    }
+
+    AllocateWithTimestamp = TraceStore->AllocateRecordsWithTimestampImpl2;
+    Address = AllocateWithTimestamp(TraceContext,
+                                    TraceStore,
+                                    NumberOfRecords,
+                                    RecordSize,
+                                    TimestampPointer);
+
+    if (Chunks) {
+        UpdateTraceStoreAllocationChunksGeneration(TraceStore, Chunks);
+    }
+
+    return Address;
+}
+
+_Use_decl_annotations_
+BOOL
+CreateTraceStoreAllocationChunks(
+    PTRACE_STORE TraceStore,
+    ULONG ChunkSize
+    )
+/*++
+
+Routine Description:
+
+    This routine creates the per-thread allocation chunks for a trace store if
+    its traits permit them.  Chunks are only used for trace stores that have
+    concurrent allocations, a fixed record size, and are neither linked nor
+    page aligned.  It is called by the :Synchronization metadata store's bind
+    complete routine once the allocation critical section has been
+    initialized.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to a TRACE_STORE structure.
+
+    ChunkSize - Supplies the size of each chunk, in bytes.  If 0, chunks are
+        not created.
+
+Return Value:
+
+    TRUE on success (including when chunks aren't applicable to the trace
+    store), FALSE if the chunks could not be allocated.
+
+--*/
+{
+    TRACE_STORE_TRAITS Traits;
+    PTRACE_STORE_ALLOCATION_CHUNKS Chunks;
+
+    Traits = *TraceStore->pTraits;
+
+    if (TraceStore->IsReadonly ||
+        TraceStore->IsMetadata ||
+        ChunkSize == 0 ||
+        !HasConcurrentAllocations(Traits) ||
+        !IsFixedRecordSize(Traits) ||
+        IsLinkedStore(Traits) ||
+        WantsPageAlignment(Traits)) {
+        return TRUE;
+    }
+
+    Chunks = (PTRACE_STORE_ALLOCATION_CHUNKS)(
+        VirtualAlloc(NULL,
+                     sizeof(*Chunks),
+                     MEM_COMMIT | MEM_RESERVE,
+                     PAGE_READWRITE)
+    );
+
+    if (!Chunks) {
+        TraceStore->LastError = GetLastError();
+        return FALSE;
+    }
+
+    Chunks->SizeOfStruct = sizeof(*Chunks);
+    Chunks->NumberOfChunks = MAX_TRACE_STORE_ALLOCATION_CHUNKS;
+    Chunks->ChunkSize = ChunkSize;
+
+    TraceStore->AllocationChunks = Chunks;
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+VOID
+DestroyTraceStoreAllocationChunks(
+    PTRACE_STORE TraceStore
+    )
+/*++
+
+Routine Description:
+
+    This routine frees a trace store's per-thread allocation chunks, if any.
+    RetireTraceStoreAllocationChunks() should be called first.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to a TRACE_STORE structure.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    PTRACE_STORE_ALLOCATION_CHUNKS Chunks;
+
+    Chunks = TraceStore->AllocationChunks;
+    if (!Chunks) {
+        return;
+    }
+
+    TraceStore->AllocationChunks = NULL;
+    VirtualFree(Chunks, 0, MEM_RELEASE);
+}
+
+_Use_decl_annotations_
+VOID
+UpdateTraceStoreAllocationChunksGeneration(
+    PTRACE_STORE TraceStore,
+    PTRACE_STORE_ALLOCATION_CHUNKS Chunks
+    )
+/*++
+
+Routine Description:
+
+    This routine checks whether the trace store, its :Allocation store or its
+    :AllocationTimestamp store has activated a new memory map since the last
+    check, and if so, advances the chunk generation by the number of stores
+    that have.  Each store's previous memory map isn't retired until the store
+    consumes another one, so a chunk whose generation trails the current one
+    by at most one is still safe to fix up when retired (although it is no
+    longer allocated from).
+
+    N.B. This must be called after every allocation performed whilst holding
+         the allocation critical section.  A single allocation never consumes
+         more than one memory map per store as chunks are capped to a quarter
+         of the mapping size.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to a TRACE_STORE structure.
+
+    Chunks - Supplies a pointer to the trace store's allocation chunks.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ULONG Delta = 0;
+    PTRACE_STORE_MEMORY_MAP MemoryMap;
+
+    MemoryMap = TraceStore->MemoryMap;
+    if (Chunks->MemoryMap != MemoryMap) {
+        Chunks->MemoryMap = MemoryMap;
+        Delta++;
+    }
+
+    MemoryMap = TraceStore->AllocationStore->MemoryMap;
+    if (Chunks->AllocationMemoryMap != MemoryMap) {
+        Chunks->AllocationMemoryMap = MemoryMap;
+        Delta++;
+    }
+
+    MemoryMap = TraceStore->AllocationTimestampStore->MemoryMap;
+    if (Chunks->AllocationTimestampMemoryMap != MemoryMap) {
+        Chunks->AllocationTimestampMemoryMap = MemoryMap;
+        Delta++;
+    }
+
+    if (Delta) {
+        Chunks->Generation += Delta;
+    }
+}
+
+_Use_decl_annotations_
+BOOL
+ReserveTraceStoreAllocationChunk(
+    PTRACE_CONTEXT TraceContext,
+    PTRACE_STORE TraceStore,
+    PTRACE_STORE_ALLOCATION_CHUNKS Chunks,
+    PTRACE_STORE_ALLOCATION_CHUNK Chunk,
+    ULONG_PTR RecordSize
+    )
+/*++
+
+Routine Description:
+
+    This routine reserves a new allocation chunk for the calling thread.  The
+    chunk's records are allocated from the trace store via the underlying
+    allocator in a single request, which writes (or coalesces into) the
+    :Allocation record describing them.  A matching slice of timestamp slots
+    is then allocated from the :AllocationTimestamp store, followed by a dummy
+    :Allocation record that will account for any records left unused when
+    the chunk is retired.
+
+    Each record slot in the chunk is counted as an allocation in the totals of
+    both the trace store and the :AllocationTimestamp store, such that record
+    N of the trace store continues to correspond to timestamp N.  These counts
+    are left as is when the chunk is retired, as unused slots still occupy
+    space in both stores.
+
+    N.B. The :AllocationTimestampDelta store is not updated for records
+         allocated from chunks.
+
+Arguments:
+
+    TraceContext - Supplies a pointer to a TRACE_CONTEXT structure.
+
+    TraceStore - Supplies a pointer to a TRACE_STORE structure.
+
+    Chunks - Supplies a pointer to the trace store's allocation chunks.
+
+    Chunk - Supplies a pointer to the calling thread's chunk.  It must have
+        been retired.
+
+    RecordSize - Supplies the size of each record in the chunk.
+
+Return Value:
+
+    TRUE if the chunk was reserved, FALSE otherwise.
+
+--*/
+{
+    BOOL Success = FALSE;
+    BOOL CaptureTimestamps;
+    PVOID Address;
+    ULONG_PTR NumberOfRecords;
+    ULONG_PTR MaximumSize;
+    ULONG_PTR MaximumRecords;
+    LARGE_INTEGER ZeroTimestamp;
+    PLARGE_INTEGER Timestamps = NULL;
+    PTRACE_STORE AllocationStore;
+    PTRACE_STORE AllocationTimestampStore;
+    PTRACE_STORE_ALLOCATION Allocation;
+    PTRACE_STORE_ALLOCATION DummyAllocation;
+    PTRACE_STORE_MEMORY_MAP MemoryMap;
+    PALLOCATE_RECORDS_WITH_TIMESTAMP AllocateWithTimestamp;
+
+    AllocationStore = TraceStore->AllocationStore;
+    AllocationTimestampStore = TraceStore->AllocationTimestampStore;
+    CaptureTimestamps = !TraceStore->NoAllocationTimestamps;
+
+    if (!TraceStore->MemoryMap ||
+        (CaptureTimestamps && !AllocationTimestampStore->MemoryMap)) {
+        return FALSE;
+    }
+
+    //
+    // Cap the chunk to a quarter of the mapping size of both the trace store
+    // and the :AllocationTimestamp store.
+    //
+
+    MaximumSize = (ULONG_PTR)TraceStore->MemoryMap->MappingSize.QuadPart >> 2;
+    if (MaximumSize > Chunks->ChunkSize) {
+        MaximumSize = Chunks->ChunkSize;
+    }
+
+    NumberOfRecords = MaximumSize / RecordSize;
+
+    if (CaptureTimestamps) {
+        MemoryMap = AllocationTimestampStore->MemoryMap;
+        MaximumRecords = (
+            ((ULONG_PTR)MemoryMap->MappingSize.QuadPart >> 2) /
+            sizeof(LARGE_INTEGER)
+        );
+        if (NumberOfRecords > MaximumRecords) {
+            NumberOfRecords = MaximumRecords;
+        }
+    }
+
+    if (NumberOfRecords < 2) {
+        return FALSE;
+    }
+
+    //
+    // Allocate the chunk's records.  Passing a zero timestamp suppresses the
+    // single timestamp the allocator would otherwise record; the slots are
+    // allocated separately below.
+    //
+
+    ZeroTimestamp.QuadPart = 0;
+    AllocateWithTimestamp = TraceStore->AllocateRecordsWithTimestampImpl2;
+    Address = AllocateWithTimestamp(TraceContext,
+                                    TraceStore,
+                                    NumberOfRecords,
+                                    RecordSize,
+                                    &ZeroTimestamp);
+
+    if (!Address) {
+        goto End;
+    }
+
+    Allocation = TraceStore->Allocation;
+    TraceStore->Totals->NumberOfAllocations.QuadPart += NumberOfRecords - 1;
+
+    //
+    // Allocate the timestamp slots.
+    //
+
+    if (CaptureTimestamps) {
+        Timestamps = (PLARGE_INTEGER)(
+            AllocationTimestampStore->AllocateRecords(
+                TraceContext,
+                AllocationTimestampStore,
+                NumberOfRecords,
+                sizeof(LARGE_INTEGER)
+            )
+        );
+
+        if (Timestamps) {
+            AllocationTimestampStore->Totals->NumberOfAllocations.QuadPart += (
+                NumberOfRecords - 1
+            );
+        }
+    }
+
+    //
+    // Allocate the dummy allocation record and make it the trace store's
+    // current allocation record; this prevents subsequent allocations from
+    // being coalesced into the chunk's record.  If this fails, the chunk can
+    // still be used, but unused records can't be accounted for on retirement.
+    //
+
+    DummyAllocation = (PTRACE_STORE_ALLOCATION)(
+        AllocationStore->AllocateRecordsWithTimestamp(
+            TraceContext,
+            AllocationStore,
+            1,
+            sizeof(*DummyAllocation),
+            NULL
+        )
+    );
+
+    if (DummyAllocation) {
+        DummyAllocation->RecordSize.QuadPart = 0;
+        DummyAllocation->NumberOfRecords.SignedQuadPart = -1;
+        TraceStore->Allocation = DummyAllocation;
+    } else {
+        Allocation = NULL;
+    }
+
+    //
+    // Initialize the chunk.  The generation is captured after all of the
+    // allocations above have been performed.
+    //
+
+    UpdateTraceStoreAllocationChunksGeneration(TraceStore, Chunks);
+
+    Chunk->Generation = Chunks->Generation;
+    Chunk->RecordSize = RecordSize;
+    Chunk->NextAddress = (PCHAR)Address;
+    Chunk->EndAddress = Chunk->NextAddress + (NumberOfRecords * RecordSize);
+    Chunk->NextTimestamp = Timestamps;
+    Chunk->FirstTimestamp = Timestamps;
+    Chunk->Allocation = Allocation;
+    Chunk->DummyAllocation = DummyAllocation;
+
+    Success = TRUE;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    if (!Success) {
+        UpdateTraceStoreAllocationChunksGeneration(TraceStore, Chunks);
+    }
+
+    return Success;
+}
+
+_Use_decl_annotations_
+VOID
+RetireTraceStoreAllocationChunk(
+    PTRACE_STORE TraceStore,
+    PTRACE_STORE_ALLOCATION_CHUNKS Chunks,
+    PTRACE_STORE_ALLOCATION_CHUNK Chunk
+    )
+/*++
+
+Routine Description:
+
+    This routine retires an allocation chunk.  Any records that weren't
+    allocated are removed from the chunk's :Allocation record and the trace
+    store's totals, and described by the chunk's dummy allocation record
+    instead, allowing readers to reconstruct record positions.  The unused
+    :AllocationTimestamp slots are filled with the timestamp of the chunk's
+    last allocation (or the current time if nothing was allocated), so that
+    every slot counted by the NumberOfAllocations totals has a timestamp.
+
+    If the trace store or its metadata stores have activated more than one
+    memory map since the chunk was reserved, the :Allocation records and the
+    timestamp slots may no longer be mapped, so they're left as is; the unused
+    records will appear as zeroed records with zeroed timestamps to readers.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to a TRACE_STORE structure.
+
+    Chunks - Supplies a pointer to the trace store's allocation chunks.
+
+    Chunk - Supplies a pointer to the chunk to retire.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ULONG_PTR Index;
+    ULONG_PTR UnusedBytes;
+    ULONG_PTR UnusedRecords;
+    LARGE_INTEGER Timestamp;
+
+    if (!Chunk->RecordSize) {
+        return;
+    }
+
+    UnusedBytes = (ULONG_PTR)(Chunk->EndAddress - Chunk->NextAddress);
+
+    if (UnusedBytes == 0 ||
+        (Chunks->Generation - Chunk->Generation) > 1) {
+        goto End;
+    }
+
+    UnusedRecords = UnusedBytes / Chunk->RecordSize;
+
+    //
+    // Backfill the unused timestamp slots.
+    //
+
+    if (Chunk->NextTimestamp) {
+        TRY_MAPPED_MEMORY_OP {
+            if (Chunk->NextTimestamp > Chunk->FirstTimestamp) {
+                Timestamp.QuadPart = Chunk->NextTimestamp[-1].QuadPart;
+            } else {
+                QueryPerformanceCounter(&Timestamp);
+            }
+            for (Index = 0; Index < UnusedRecords; Index++) {
+                Chunk->NextTimestamp[Index].QuadPart = Timestamp.QuadPart;
+            }
+        } CATCH_STATUS_IN_PAGE_ERROR {
+            NOTHING;
+        }
+    }
+
+    if (!Chunk->Allocation) {
+        goto End;
+    }
+
+    TRY_MAPPED_MEMORY_OP {
+        Chunk->Allocation->NumberOfRecords.QuadPart -= UnusedRecords;
+        Chunk->DummyAllocation->RecordSize.QuadPart = UnusedBytes;
+    } CATCH_STATUS_IN_PAGE_ERROR {
+        goto End;
+    }
+
+    TraceStore->Totals->NumberOfRecords.QuadPart -= UnusedRecords;
+    TraceStore->Totals->RecordSize.QuadPart -= UnusedBytes;
+    TraceStore->Stats->WastedBytes += UnusedBytes;
+    TraceStore->Stats->PaddedAllocations += 1;
+
+    //
+    // Intentional follow-on to End.
+    //
+
+End:
+
+    Chunk->RecordSize = 0;
+    Chunk->NextAddress = NULL;
+    Chunk->EndAddress = NULL;
+    Chunk->NextTimestamp = NULL;
+    Chunk->FirstTimestamp = NULL;
+    Chunk->Allocation = NULL;
+    Chunk->DummyAllocation = NULL;
+}
+
+_Use_decl_annotations_
+VOID
+RetireTraceStoreAllocationChunks(
+    PTRACE_STORE TraceStore,
+    BOOL Wait
+    )
+/*++
+
+Routine Description:
+
+    This routine retires all allocation chunks of a trace store.  It is called
+    when the trace store is being closed or run down, prior to the metadata
+    stores being closed.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to a TRACE_STORE structure.
+
+    Wait - Supplies a boolean indicating whether or not to wait for the
+        allocation critical section.  If FALSE and the critical section is
+        owned by another thread, the chunks are left as is.  This should be
+        FALSE during rundown, as the owning thread may have been terminated.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ULONG Index;
+    PCRITICAL_SECTION CriticalSection;
+    PTRACE_STORE_ALLOCATION_CHUNKS Chunks;
+
+    Chunks = TraceStore->AllocationChunks;
+    if (!Chunks) {
+        return;
+    }
+
+    CriticalSection = &TraceStore->Sync->AllocationCriticalSection;
+
+    if (Wait) {
+        EnterCriticalSection(CriticalSection);
+    } else if (!TryEnterCriticalSection(CriticalSection)) {
+        return;
+    }
+
+    for (Index = 0; Index < MAX_TRACE_STORE_ALLOCATION_CHUNKS; Index++) {
+        RetireTraceStoreAllocationChunk(TraceStore,
+                                        Chunks,
+                                        &Chunks->Chunks[Index]);
+    }
+
+    LeaveCriticalSection(CriticalSection);
+}
+
+
 // vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
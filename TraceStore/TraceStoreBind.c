@@ -496,6 +496,7 @@ Return Value:
 
 --*/
 {
+    BOOL HasBlocks;
     TRACE_STORE_TRAITS Traits;
 
     //
@@ -513,15 +514,25 @@ Return Value:
 
     Traits = *TraceStore->Traits;
 
+    //
+    // Load the block index if the trace store was block compressed.
+    //
+
+    if (!LoadTraceStoreBlockIndex(TraceStore)) {
+        return FALSE;
+    }
+
+    HasBlocks = TraceStoreHasBlocks(TraceStore);
+
     //
     // Default to readonly mapping, unless we're non-streaming and we have
-    // relocations.
+    // relocations, or we have blocks to decompress into the mapping.
     //
 
     TraceStore->CreateFileMappingProtectionFlags = PAGE_READONLY;
     TraceStore->MapViewOfFileDesiredAccess = FILE_MAP_READ;
 
-    if (!IsStreamingRead(Traits) && TraceStore->HasRelocations) {
+    if ((!IsStreamingRead(Traits) && TraceStore->HasRelocations) || HasBlocks) {
         TraceStore->CreateFileMappingProtectionFlags = PAGE_WRITECOPY;
         TraceStore->MapViewOfFileDesiredAccess = FILE_MAP_COPY;
     }
@@ -782,6 +793,18 @@ Return Value:
         goto PrepareMaps;
     }
 
+    //
+    // Trace stores with compressed blocks don't get a flat mapping either.
+    // Its view would be copy-on-write, so every block in the file would have
+    // to be decompressed into private memory up-front, duplicating the work
+    // done lazily as each memory map is prepared.  (As intervals are derived
+    // from the flat mapping, such stores don't support intervals.)
+    //
+
+    if (TraceStoreHasBlocks(TraceStore)) {
+        goto PrepareMaps;
+    }
+
     //
     // Create another mapping that covers the entire range of the file, using
     // the FlatMemoryMap and FlatAddress structures.  This will be submitted
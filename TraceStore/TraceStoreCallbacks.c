@@ -511,7 +511,7 @@ Return Value:
     Success = PrepareNextTraceStoreMemoryMap(TraceStore, MemoryMap);
     if (Success) {
         PushTraceStoreMemoryMap(&TraceStore->NextMemoryMaps, MemoryMap);
-        SetEvent(TraceStore->NextMemoryMapAvailableEvent);
+        TraceStoreSetEvent(TraceStore->NextMemoryMapAvailableEvent);
     } else {
         __debugbreak();
         UnmapTraceStoreMemoryMap(MemoryMap);
@@ -0,0 +1,1408 @@
+/*++
+
+Copyright (c) 2016 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    TraceStoreCompression.c
+
+Abstract:
+
+    This module implements block compression for trace stores with the
+    BlockCompression trait.  When a memory map of such a trace store is closed,
+    its contents are compressed into fixed-size blocks, which are appended to
+    the :CompressedBlocks stream, and a TRACE_STORE_BLOCK entry for each block
+    is appended to the :BlockIndex stream.  The uncompressed range is then
+    deallocated from the trace store's file.  Memory maps are closed by
+    threadpool work items, so compression never stalls the allocation path.
+
+    Readonly trace stores load and sort the block index at bind time, and
+    decompress the relevant blocks into each memory map as it is prepared.
+    Readonly memory maps are prepared in parallel by the threadpool, and so,
+    therefore, is decompression.
+
+    The codec is a byte-oriented LZ77 variant in the style of LZ4: sequences
+    of literals followed by a match, encoded as a token byte whose high and
+    low nibbles hold the literal length and match length, respectively, with
+    longer lengths continued in subsequent bytes, and matches referenced by a
+    16-bit offset.  It favors speed over ratio, which suits the highly
+    repetitive record layouts typical of trace stores.
+
+--*/
+
+#include "stdafx.h"
+
+//
+// Codec constants.  Matches are at least TRACE_STORE_LZ_MIN_MATCH bytes
+// long, and the last TRACE_STORE_LZ_LAST_LITERALS bytes of a block are always
+// encoded as literals, which allows the decoder to detect the final sequence
+// by the input being exhausted after its literals.
+//
+
+#define TRACE_STORE_LZ_MIN_MATCH 4
+#define TRACE_STORE_LZ_LAST_LITERALS 5
+#define TRACE_STORE_LZ_MATCH_LIMIT 12
+#define TRACE_STORE_LZ_MAX_OFFSET 0xffff
+#define TRACE_STORE_LZ_LENGTH_MASK 0xf
+#define TRACE_STORE_LZ_HASH_BITS 12
+#define TRACE_STORE_LZ_HASH_SIZE (1 << TRACE_STORE_LZ_HASH_BITS)
+
+FORCEINLINE
+ULONG
+ReadTraceStoreBlockUlong(
+    _In_ PCBYTE Address
+    )
+{
+    return (
+        ((ULONG)Address[0])       |
+        ((ULONG)Address[1] << 8)  |
+        ((ULONG)Address[2] << 16) |
+        ((ULONG)Address[3] << 24)
+    );
+}
+
+FORCEINLINE
+ULONG
+HashTraceStoreBlockUlong(
+    _In_ ULONG Value
+    )
+{
+    return (Value * 2654435761U) >> (32 - TRACE_STORE_LZ_HASH_BITS);
+}
+
+FORCEINLINE
+ULONG
+GetTraceStoreBlockExtraLengthBytes(
+    _In_ ULONG Length
+    )
+{
+    if (Length < TRACE_STORE_LZ_LENGTH_MASK) {
+        return 0;
+    }
+
+    return ((Length - TRACE_STORE_LZ_LENGTH_MASK) / 255) + 1;
+}
+
+FORCEINLINE
+PBYTE
+WriteTraceStoreBlockLength(
+    _In_ PBYTE Output,
+    _In_ ULONG Length
+    )
+{
+    Length -= TRACE_STORE_LZ_LENGTH_MASK;
+
+    while (Length >= 255) {
+        *Output++ = 255;
+        Length -= 255;
+    }
+
+    *Output++ = (BYTE)Length;
+
+    return Output;
+}
+
+FORCEINLINE
+_Success_(return != 0)
+PBYTE
+WriteTraceStoreBlockSequence(
+    _In_ PBYTE Output,
+    _In_ PBYTE OutputEnd,
+    _In_ PCBYTE Literals,
+    _In_ ULONG LiteralLength,
+    _In_ ULONG Offset,
+    _In_ ULONG MatchLength
+    )
+/*++
+
+Routine Description:
+
+    Writes a sequence of literals, optionally followed by a match, to the
+    output buffer.  A MatchLength of 0 indicates the final sequence, which
+    has no match.
+
+Return Value:
+
+    A pointer to the byte following the sequence, or NULL if the output buffer
+    is too small.
+
+--*/
+{
+    BYTE Token;
+    ULONG Length;
+    ULONG_PTR Required;
+
+    Required = 1 + LiteralLength;
+    Required += GetTraceStoreBlockExtraLengthBytes(LiteralLength);
+
+    if (MatchLength) {
+        Length = MatchLength - TRACE_STORE_LZ_MIN_MATCH;
+        Required += 2 + GetTraceStoreBlockExtraLengthBytes(Length);
+    } else {
+        Length = 0;
+    }
+
+    if (Required > (ULONG_PTR)(OutputEnd - Output)) {
+        return NULL;
+    }
+
+    Token = (BYTE)(min(LiteralLength, TRACE_STORE_LZ_LENGTH_MASK) << 4);
+    Token |= (BYTE)min(Length, TRACE_STORE_LZ_LENGTH_MASK);
+
+    *Output++ = Token;
+
+    if (LiteralLength >= TRACE_STORE_LZ_LENGTH_MASK) {
+        Output = WriteTraceStoreBlockLength(Output, LiteralLength);
+    }
+
+    CopyMemory(Output, Literals, LiteralLength);
+    Output += LiteralLength;
+
+    if (!MatchLength) {
+        return Output;
+    }
+
+    *Output++ = (BYTE)Offset;
+    *Output++ = (BYTE)(Offset >> 8);
+
+    if (Length >= TRACE_STORE_LZ_LENGTH_MASK) {
+        Output = WriteTraceStoreBlockLength(Output, Length);
+    }
+
+    return Output;
+}
+
+_Use_decl_annotations_
+ULONG
+CompressTraceStoreBlock(
+    PCBYTE Source,
+    ULONG SourceSize,
+    PBYTE Dest,
+    ULONG DestSize
+    )
+/*++
+
+Routine Description:
+
+    This routine compresses a block of data.  Candidate matches are found via
+    a hash table of the positions of previously seen 4-byte sequences; there
+    is no chaining, so only the most recent position for each hash is tried.
+
+Arguments:
+
+    Source - Supplies a pointer to the data to compress.
+
+    SourceSize - Supplies the size of the data, in bytes.  This must not
+        exceed TRACE_STORE_COMPRESSED_BLOCK_SIZE.
+
+    Dest - Supplies a pointer to the buffer that receives the compressed data.
+
+    DestSize - Supplies the size of the Dest buffer, in bytes.
+
+Return Value:
+
+    The size of the compressed data, in bytes, or 0 if it would not fit in the
+    Dest buffer (i.e. the block is incompressible).
+
+--*/
+{
+    ULONG Hash;
+    ULONG Offset;
+    ULONG Sequence;
+    ULONG MatchLength;
+    PCBYTE End;
+    PCBYTE Input;
+    PCBYTE Match;
+    PCBYTE Anchor;
+    PCBYTE MatchEnd;
+    PCBYTE MatchLimit;
+    PBYTE Output;
+    PBYTE OutputEnd;
+    ULONG HashTable[TRACE_STORE_LZ_HASH_SIZE];
+
+    Input = Anchor = Source;
+    End = Source + SourceSize;
+    Output = Dest;
+    OutputEnd = Dest + DestSize;
+
+    if (SourceSize > TRACE_STORE_LZ_MATCH_LIMIT) {
+
+        ZeroMemory(HashTable, sizeof(HashTable));
+
+        MatchLimit = End - TRACE_STORE_LZ_MATCH_LIMIT;
+        MatchEnd = End - TRACE_STORE_LZ_LAST_LITERALS;
+
+        while (Input < MatchLimit) {
+
+            Sequence = ReadTraceStoreBlockUlong(Input);
+            Hash = HashTraceStoreBlockUlong(Sequence);
+            Match = Source + HashTable[Hash];
+            HashTable[Hash] = (ULONG)(Input - Source);
+
+            if (Match >= Input ||
+                (ULONG_PTR)(Input - Match) > TRACE_STORE_LZ_MAX_OFFSET ||
+                ReadTraceStoreBlockUlong(Match) != Sequence) {
+                Input++;
+                continue;
+            }
+
+            MatchLength = TRACE_STORE_LZ_MIN_MATCH;
+            while (Input + MatchLength < MatchEnd &&
+                   Match[MatchLength] == Input[MatchLength]) {
+                MatchLength++;
+            }
+
+            Offset = (ULONG)(Input - Match);
+
+            Output = WriteTraceStoreBlockSequence(Output,
+                                                  OutputEnd,
+                                                  Anchor,
+                                                  (ULONG)(Input - Anchor),
+                                                  Offset,
+                                                  MatchLength);
+            if (!Output) {
+                return 0;
+            }
+
+            Input += MatchLength;
+            Anchor = Input;
+        }
+    }
+
+    //
+    // Write the final sequence of literals.
+    //
+
+    Output = WriteTraceStoreBlockSequence(Output,
+                                          OutputEnd,
+                                          Anchor,
+                                          (ULONG)(End - Anchor),
+                                          0,
+                                          0);
+    if (!Output) {
+        return 0;
+    }
+
+    return (ULONG)(Output - Dest);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOL
+ReadTraceStoreBlockLength(
+    _Inout_ PCBYTE *InputPointer,
+    _In_ PCBYTE InputEnd,
+    _Inout_ PULONG LengthPointer
+    )
+{
+    BYTE Byte;
+    PCBYTE Input;
+    ULONG Length;
+
+    Input = *InputPointer;
+    Length = *LengthPointer;
+
+    do {
+        if (Input >= InputEnd) {
+            return FALSE;
+        }
+        Byte = *Input++;
+        Length += Byte;
+    } while (Byte == 255);
+
+    *InputPointer = Input;
+    *LengthPointer = Length;
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOL
+DecompressTraceStoreBlock(
+    PCBYTE Source,
+    ULONG SourceSize,
+    PBYTE Dest,
+    ULONG DestSize
+    )
+/*++
+
+Routine Description:
+
+    This routine decompresses a block of data produced by
+    CompressTraceStoreBlock().  All lengths and offsets are validated against
+    the input and output buffers, so a corrupt block results in failure rather
+    than an out-of-bounds access.
+
+Arguments:
+
+    Source - Supplies a pointer to the compressed data.
+
+    SourceSize - Supplies the size of the compressed data, in bytes.
+
+    Dest - Supplies a pointer to the buffer that receives the decompressed
+        data.
+
+    DestSize - Supplies the expected size of the decompressed data, in bytes.
+
+Return Value:
+
+    TRUE if the block decompressed to exactly DestSize bytes, FALSE otherwise.
+
+--*/
+{
+    BYTE Token;
+    ULONG Offset;
+    ULONG LiteralLength;
+    ULONG MatchLength;
+    PCBYTE Input;
+    PCBYTE InputEnd;
+    PCBYTE Match;
+    PBYTE Output;
+    PBYTE OutputEnd;
+
+    Input = Source;
+    InputEnd = Source + SourceSize;
+    Output = Dest;
+    OutputEnd = Dest + DestSize;
+
+    while (Input < InputEnd) {
+
+        Token = *Input++;
+
+        LiteralLength = Token >> 4;
+        if (LiteralLength == TRACE_STORE_LZ_LENGTH_MASK) {
+            if (!ReadTraceStoreBlockLength(&Input, InputEnd, &LiteralLength)) {
+                return FALSE;
+            }
+        }
+
+        if (LiteralLength > (ULONG_PTR)(InputEnd - Input) ||
+            LiteralLength > (ULONG_PTR)(OutputEnd - Output)) {
+            return FALSE;
+        }
+
+        CopyMemory(Output, Input, LiteralLength);
+        Input += LiteralLength;
+        Output += LiteralLength;
+
+        //
+        // The final sequence has no match.
+        //
+
+        if (Input == InputEnd) {
+            break;
+        }
+
+        if ((ULONG_PTR)(InputEnd - Input) < 2) {
+            return FALSE;
+        }
+
+        Offset = ((ULONG)Input[0]) | ((ULONG)Input[1] << 8);
+        Input += 2;
+
+        if (Offset == 0 || Offset > (ULONG_PTR)(Output - Dest)) {
+            return FALSE;
+        }
+
+        MatchLength = Token & TRACE_STORE_LZ_LENGTH_MASK;
+        if (MatchLength == TRACE_STORE_LZ_LENGTH_MASK) {
+            if (!ReadTraceStoreBlockLength(&Input, InputEnd, &MatchLength)) {
+                return FALSE;
+            }
+        }
+        MatchLength += TRACE_STORE_LZ_MIN_MATCH;
+
+        if (MatchLength > (ULONG_PTR)(OutputEnd - Output)) {
+            return FALSE;
+        }
+
+        //
+        // Matches may overlap the output (e.g. runs), so copy byte by byte.
+        //
+
+        Match = Output - Offset;
+        while (MatchLength--) {
+            *Output++ = *Match++;
+        }
+    }
+
+    return (Output == OutputEnd);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+HANDLE
+OpenTraceStoreBlockStream(
+    _In_ PCWSTR Path,
+    _In_ PCWSTR Suffix,
+    _In_ ULONG DesiredAccess,
+    _In_ ULONG CreationDisposition
+    )
+{
+    HRESULT Result;
+    WCHAR StreamPath[_OUR_MAX_PATH];
+
+    Result = StringCchCopyW(&StreamPath[0], _OUR_MAX_PATH, Path);
+    if (FAILED(Result)) {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    Result = StringCchCatW(&StreamPath[0], _OUR_MAX_PATH, Suffix);
+    if (FAILED(Result)) {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    return CreateFileW(
+        &StreamPath[0],
+        DesiredAccess,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL,
+        CreationDisposition,
+        FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL
+    );
+}
+
+_Use_decl_annotations_
+BOOL
+CreateTraceStoreBlockCompression(
+    PTRACE_STORE TraceStore,
+    PCWSTR Path
+    )
+/*++
+
+Routine Description:
+
+    This routine creates the block compression state for a trace store.  It is
+    called by InitializeTraceStores() once the trace store has been initialized.
+
+    For trace stores that are not readonly, the :CompressedBlocks and
+    :BlockIndex streams are created, replacing any existing ones.  For readonly
+    trace stores, the traits aren't known until bind time, so the :BlockIndex
+    stream is probed for instead; if it doesn't exist or is empty, the trace
+    store wasn't block compressed and no state is created.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to a TRACE_STORE structure.
+
+    Path - Supplies a pointer to the fully-qualified path of the trace store's
+        file.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    ULONG LastError;
+    PALLOCATOR Allocator;
+    HANDLE IndexFileHandle;
+    LARGE_INTEGER IndexSize;
+    PTRACE_STORE_BLOCK_COMPRESSION Compression;
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(TraceStore)) {
+        return FALSE;
+    }
+
+    if (!ARGUMENT_PRESENT(Path)) {
+        return FALSE;
+    }
+
+    if (TraceStore->BlockCompression) {
+        __debugbreak();
+        return FALSE;
+    }
+
+    IndexFileHandle = NULL;
+
+    if (TraceStore->IsReadonly) {
+
+        IndexFileHandle = OpenTraceStoreBlockStream(Path,
+                                                    TraceStoreBlockIndexSuffix,
+                                                    GENERIC_READ,
+                                                    OPEN_EXISTING);
+
+        if (IndexFileHandle == INVALID_HANDLE_VALUE) {
+            LastError = GetLastError();
+            if (LastError == ERROR_FILE_NOT_FOUND) {
+                return TRUE;
+            }
+            TraceStore->LastError = LastError;
+            return FALSE;
+        }
+
+        if (!TraceStoreGetFileSize(IndexFileHandle, &IndexSize)) {
+            TraceStore->LastError = GetLastError();
+            CloseHandle(IndexFileHandle);
+            return FALSE;
+        }
+
+        if (IndexSize.QuadPart == 0) {
+            CloseHandle(IndexFileHandle);
+            return TRUE;
+        }
+    }
+
+    Allocator = TraceStore->pAllocator;
+
+    Compression = (PTRACE_STORE_BLOCK_COMPRESSION)(
+        Allocator->Calloc(
+            Allocator->Context,
+            1,
+            sizeof(*Compression)
+        )
+    );
+
+    if (!Compression) {
+        if (IndexFileHandle) {
+            CloseHandle(IndexFileHandle);
+        }
+        return FALSE;
+    }
+
+    Compression->SizeOfStruct = sizeof(*Compression);
+    Compression->BlockSize = TRACE_STORE_COMPRESSED_BLOCK_SIZE;
+    Compression->Allocator = Allocator;
+    InitializeSRWLock(&Compression->Lock);
+
+    //
+    // Wire the structure up to the trace store now, such that the error path
+    // can use CloseTraceStoreBlockCompression() to clean up.
+    //
+
+    TraceStore->BlockCompression = Compression;
+
+    if (TraceStore->IsReadonly) {
+
+        Compression->IndexFileHandle = IndexFileHandle;
+
+        Compression->BlocksFileHandle = (
+            OpenTraceStoreBlockStream(Path,
+                                      TraceStoreCompressedBlocksSuffix,
+                                      GENERIC_READ,
+                                      OPEN_EXISTING)
+        );
+
+        if (Compression->BlocksFileHandle == INVALID_HANDLE_VALUE) {
+            Compression->BlocksFileHandle = NULL;
+            goto Error;
+        }
+
+        return TRUE;
+    }
+
+    Compression->BlocksFileHandle = (
+        OpenTraceStoreBlockStream(Path,
+                                  TraceStoreCompressedBlocksSuffix,
+                                  GENERIC_READ | GENERIC_WRITE,
+                                  CREATE_ALWAYS)
+    );
+
+    if (Compression->BlocksFileHandle == INVALID_HANDLE_VALUE) {
+        Compression->BlocksFileHandle = NULL;
+        goto Error;
+    }
+
+    Compression->IndexFileHandle = (
+        OpenTraceStoreBlockStream(Path,
+                                  TraceStoreBlockIndexSuffix,
+                                  GENERIC_READ | GENERIC_WRITE,
+                                  CREATE_ALWAYS)
+    );
+
+    if (Compression->IndexFileHandle == INVALID_HANDLE_VALUE) {
+        Compression->IndexFileHandle = NULL;
+        goto Error;
+    }
+
+    //
+    // The trace store's own handle may have been opened for overlapped I/O,
+    // which can't be used with synchronous file system controls, so open a
+    // separate handle for deallocating compressed ranges.
+    //
+
+    Compression->DataFileHandle = CreateFileW(
+        Path,
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+
+    if (Compression->DataFileHandle == INVALID_HANDLE_VALUE) {
+        Compression->DataFileHandle = NULL;
+        goto Error;
+    }
+
+    return TRUE;
+
+Error:
+
+    TraceStore->LastError = GetLastError();
+    CloseTraceStoreBlockCompression(TraceStore);
+
+    return FALSE;
+}
+
+_Use_decl_annotations_
+VOID
+CloseTraceStoreBlockCompression(
+    PTRACE_STORE TraceStore
+    )
+/*++
+
+Routine Description:
+
+    This routine closes the block compression state of a trace store, if any.
+    It is called by CloseTraceStore() after the trace store's memory maps have
+    been closed (and thus compressed).
+
+Arguments:
+
+    TraceStore - Supplies a pointer to a TRACE_STORE structure.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    PALLOCATOR Allocator;
+    PTRACE_STORE_BLOCK_COMPRESSION Compression;
+
+    Compression = TraceStore->BlockCompression;
+    if (!Compression) {
+        return;
+    }
+
+    if (Compression->BlocksBaseAddress) {
+        TraceStoreUnmapView(Compression->BlocksBaseAddress,
+                            (SIZE_T)Compression->BlocksSize.QuadPart);
+        Compression->BlocksBaseAddress = NULL;
+    }
+
+    if (Compression->BlocksMappingHandle) {
+        TraceStoreCloseSection(Compression->BlocksMappingHandle);
+        Compression->BlocksMappingHandle = NULL;
+    }
+
+    if (Compression->BlocksFileHandle) {
+        CloseHandle(Compression->BlocksFileHandle);
+        Compression->BlocksFileHandle = NULL;
+    }
+
+    if (Compression->IndexFileHandle) {
+        CloseHandle(Compression->IndexFileHandle);
+        Compression->IndexFileHandle = NULL;
+    }
+
+    if (Compression->DataFileHandle) {
+        CloseHandle(Compression->DataFileHandle);
+        Compression->DataFileHandle = NULL;
+    }
+
+    Allocator = Compression->Allocator;
+
+    if (Compression->Blocks) {
+        Allocator->Free(Allocator->Context, Compression->Blocks);
+        Compression->Blocks = NULL;
+    }
+
+    Allocator->Free(Allocator->Context, Compression);
+    TraceStore->BlockCompression = NULL;
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOL
+WriteTraceStoreBlockStream(
+    _In_ HANDLE FileHandle,
+    _In_reads_bytes_(Size) PVOID Buffer,
+    _In_ ULONG Size
+    )
+{
+    ULONG BytesWritten;
+
+    if (!WriteFile(FileHandle, Buffer, Size, &BytesWritten, NULL)) {
+        return FALSE;
+    }
+
+    return (BytesWritten == Size);
+}
+
+_Use_decl_annotations_
+BOOL
+CompressTraceStoreMemoryMap(
+    PTRACE_STORE TraceStore,
+    PTRACE_STORE_MEMORY_MAP MemoryMap,
+    PLARGE_INTEGER CompressedLength
+    )
+/*++
+
+Routine Description:
+
+    This routine compresses the used portion of a trace store memory map into
+    blocks, appends them to the :CompressedBlocks stream, appends their index
+    entries to the :BlockIndex stream, then flushes both streams.  It is called
+    by CloseTraceStoreMemoryMap() prior to unmapping, which is invoked from the
+    threadpool; concurrent calls for the same trace store are permitted.
+
+    Once the memory map has been unmapped, the caller should pass the length
+    returned via CompressedLength to DeallocateCompressedTraceStoreRange().
+    (The range can't be deallocated whilst it's still mapped.)
+
+    Memory maps that are run down during process exit are not compressed.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to a TRACE_STORE structure that is not
+        readonly and has block compression state.
+
+    MemoryMap - Supplies a pointer to the TRACE_STORE_MEMORY_MAP structure to
+        compress.
+
+    CompressedLength - Supplies a pointer to a variable that receives the
+        number of bytes of the trace store's file, starting at the memory
+        map's file offset, that were compressed.  This will be 0 if there was
+        nothing to compress or an error occurred.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    BOOL Success;
+    BOOL Stored;
+    ULONG Index;
+    ULONG BlockSize;
+    ULONG NumberOfBlocks;
+    ULONG UncompressedSize;
+    ULONG CompressedSize;
+    ULONGLONG Length;
+    ULONGLONG EndOfFile;
+    ULONGLONG CompressedBytes;
+    ULONGLONG NumberOfStoredBlocks;
+    PBYTE Buffer;
+    PBYTE Source;
+    PVOID Data;
+    PALLOCATOR Allocator;
+    PTRACE_STORE_BLOCK Block;
+    PTRACE_STORE_BLOCK Blocks;
+    PTRACE_STORE_BLOCK_COMPRESSION Compression;
+
+    CompressedLength->QuadPart = 0;
+
+    Compression = TraceStore->BlockCompression;
+
+    if (!Compression || TraceStore->IsReadonly) {
+        __debugbreak();
+        return FALSE;
+    }
+
+    if (!MemoryMap->BaseAddress || !TraceStore->Eof) {
+        return TRUE;
+    }
+
+    //
+    // Only compress the portion of the map that has been allocated from.
+    //
+
+    EndOfFile = (ULONGLONG)TraceStore->Eof->EndOfFile.QuadPart;
+
+    if (EndOfFile <= (ULONGLONG)MemoryMap->FileOffset.QuadPart) {
+        return TRUE;
+    }
+
+    Length = EndOfFile - MemoryMap->FileOffset.QuadPart;
+    Length = min(Length, (ULONGLONG)MemoryMap->MappingSize.QuadPart);
+
+    BlockSize = Compression->BlockSize;
+    NumberOfBlocks = (ULONG)((Length + BlockSize - 1) / BlockSize);
+
+    Buffer = NULL;
+    Blocks = NULL;
+    Success = FALSE;
+    CompressedBytes = 0;
+    NumberOfStoredBlocks = 0;
+    Allocator = Compression->Allocator;
+
+    Buffer = (PBYTE)Allocator->Malloc(Allocator->Context, BlockSize);
+    if (!Buffer) {
+        goto End;
+    }
+
+    Blocks = (PTRACE_STORE_BLOCK)(
+        Allocator->Calloc(
+            Allocator->Context,
+            NumberOfBlocks,
+            sizeof(*Blocks)
+        )
+    );
+
+    if (!Blocks) {
+        goto End;
+    }
+
+    for (Index = 0; Index < NumberOfBlocks; Index++) {
+
+        Block = &Blocks[Index];
+        Source = (PBYTE)(
+            RtlOffsetToPointer(
+                MemoryMap->BaseAddress,
+                (ULONG_PTR)Index * BlockSize
+            )
+        );
+
+        UncompressedSize = (ULONG)(
+            min(BlockSize, Length - ((ULONGLONG)Index * BlockSize))
+        );
+
+        TRY_MAPPED_MEMORY_OP {
+            CompressedSize = CompressTraceStoreBlock(Source,
+                                                     UncompressedSize,
+                                                     Buffer,
+                                                     UncompressedSize);
+        } CATCH_STATUS_IN_PAGE_ERROR {
+            Success = FALSE;
+            goto End;
+        }
+
+        //
+        // If the block didn't compress, store it verbatim.
+        //
+
+        Stored = (CompressedSize == 0 || CompressedSize >= UncompressedSize);
+
+        if (Stored) {
+            Data = Source;
+            CompressedSize = UncompressedSize;
+            NumberOfStoredBlocks++;
+        } else {
+            Data = Buffer;
+        }
+
+        Block->FileOffset.QuadPart = (
+            MemoryMap->FileOffset.QuadPart +
+            ((LONGLONG)Index * BlockSize)
+        );
+        Block->UncompressedSize = UncompressedSize;
+        Block->CompressedSize = CompressedSize;
+        Block->Flags.Stored = Stored;
+
+        AcquireSRWLockExclusive(&Compression->Lock);
+
+        Block->CompressedOffset.QuadPart = (
+            Compression->BlocksEndOfFile.QuadPart
+        );
+
+        Success = WriteTraceStoreBlockStream(Compression->BlocksFileHandle,
+                                             Data,
+                                             CompressedSize);
+
+        if (Success) {
+            Compression->BlocksEndOfFile.QuadPart += CompressedSize;
+        }
+
+        ReleaseSRWLockExclusive(&Compression->Lock);
+
+        if (!Success) {
+            goto End;
+        }
+
+        CompressedBytes += CompressedSize;
+    }
+
+    //
+    // Append the index entries for all of the blocks in a single write, and
+    // update the counters whilst we've got the lock.
+    //
+
+    AcquireSRWLockExclusive(&Compression->Lock);
+
+    Success = WriteTraceStoreBlockStream(Compression->IndexFileHandle,
+                                         Blocks,
+                                         NumberOfBlocks * sizeof(*Blocks));
+
+    if (Success) {
+        Compression->NumberOfBlocks += NumberOfBlocks;
+        Compression->NumberOfStoredBlocks += NumberOfStoredBlocks;
+        Compression->UncompressedBytes += Length;
+        Compression->CompressedBytes += CompressedBytes;
+    }
+
+    ReleaseSRWLockExclusive(&Compression->Lock);
+
+    if (!Success) {
+        goto End;
+    }
+
+    //
+    // Make sure the blocks and their index entries are durable before the
+    // caller deallocates the only other copy of the data.
+    //
+
+    Success = (
+        FlushFileBuffers(Compression->BlocksFileHandle) &&
+        FlushFileBuffers(Compression->IndexFileHandle)
+    );
+
+    if (!Success) {
+        goto End;
+    }
+
+    CompressedLength->QuadPart = Length;
+
+End:
+
+    if (!Success) {
+        TraceStore->LastError = GetLastError();
+        InterlockedIncrement(
+            (volatile LONG *)&Compression->NumberOfFailedMemoryMaps
+        );
+    }
+
+    if (Buffer) {
+        Allocator->Free(Allocator->Context, Buffer);
+    }
+
+    if (Blocks) {
+        Allocator->Free(Allocator->Context, Blocks);
+    }
+
+    return Success;
+}
+
+_Use_decl_annotations_
+VOID
+DeallocateCompressedTraceStoreRange(
+    PTRACE_STORE TraceStore,
+    LARGE_INTEGER FileOffset,
+    LARGE_INTEGER Length
+    )
+/*++
+
+Routine Description:
+
+    This routine deallocates a range of a trace store's file that has been
+    compressed by CompressTraceStoreMemoryMap(), leaving a sparse hole.  The
+    range must not be mapped.  Failure is not fatal; the data simply remains
+    in the file, and readers will overwrite it with the decompressed blocks.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to a TRACE_STORE structure that is not
+        readonly and has block compression state.
+
+    FileOffset - Supplies the offset of the range to deallocate.
+
+    Length - Supplies the length of the range to deallocate, in bytes.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    PTRACE_STORE_BLOCK_COMPRESSION Compression;
+
+    Compression = TraceStore->BlockCompression;
+
+    if (!Compression || !Length.QuadPart) {
+        return;
+    }
+
+    if (!TraceStoreDeallocateFileRange(Compression->DataFileHandle,
+                                       FileOffset,
+                                       Length)) {
+        TraceStore->LastError = GetLastError();
+    }
+}
+
+_Use_decl_annotations_
+BOOL
+LoadTraceStoreBlockIndex(
+    PTRACE_STORE TraceStore
+    )
+/*++
+
+Routine Description:
+
+    This routine loads the block index of a readonly trace store and maps its
+    :CompressedBlocks stream.  It is called by BindTraceStoreReadonly(), and
+    is a no-op if the trace store has no block compression state.
+
+    Index entries that reference data beyond the end of the :CompressedBlocks
+    stream are discarded; this can only happen if the writer terminated before
+    flushing the streams, in which case the corresponding range of the trace
+    store's file was never deallocated.  The remaining entries are sorted by
+    file offset.  Entries are appended in approximately file offset order (as
+    memory maps are closed in order, give or take the threadpool), so an
+    insertion sort is used.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to a readonly TRACE_STORE structure.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    BOOL Success;
+    ULONG BytesRead;
+    ULONG IndexBytes;
+    ULONGLONG Index;
+    ULONGLONG Count;
+    ULONGLONG Inner;
+    ULONGLONG CompressedEnd;
+    PALLOCATOR Allocator;
+    LARGE_INTEGER IndexSize;
+    LARGE_INTEGER FileOffset;
+    TRACE_STORE_BLOCK Block;
+    PTRACE_STORE_BLOCK Blocks;
+    PTRACE_STORE_BLOCK_COMPRESSION Compression;
+
+    Compression = TraceStore->BlockCompression;
+
+    if (!Compression) {
+        return TRUE;
+    }
+
+    if (!TraceStore->IsReadonly) {
+        __debugbreak();
+        return FALSE;
+    }
+
+    if (Compression->Blocks) {
+        return TRUE;
+    }
+
+    if (!TraceStoreGetFileSize(Compression->IndexFileHandle, &IndexSize)) {
+        goto Error;
+    }
+
+    //
+    // Ignore a trailing partial entry.
+    //
+
+    Count = IndexSize.QuadPart / sizeof(TRACE_STORE_BLOCK);
+
+    if (Count == 0) {
+        return TRUE;
+    }
+
+    if (Count * sizeof(TRACE_STORE_BLOCK) > MAXULONG) {
+        return FALSE;
+    }
+
+    IndexBytes = (ULONG)(Count * sizeof(TRACE_STORE_BLOCK));
+
+    Allocator = Compression->Allocator;
+    Blocks = (PTRACE_STORE_BLOCK)(
+        Allocator->Malloc(Allocator->Context, IndexBytes)
+    );
+
+    if (!Blocks) {
+        return FALSE;
+    }
+
+    Compression->Blocks = Blocks;
+
+    Success = ReadFile(Compression->IndexFileHandle,
+                       Blocks,
+                       IndexBytes,
+                       &BytesRead,
+                       NULL);
+
+    if (!Success || BytesRead != IndexBytes) {
+        goto Error;
+    }
+
+    //
+    // Map the :CompressedBlocks stream.
+    //
+
+    if (!TraceStoreGetFileSize(Compression->BlocksFileHandle,
+                               &Compression->BlocksSize)) {
+        goto Error;
+    }
+
+    if (Compression->BlocksSize.QuadPart) {
+
+        Compression->BlocksMappingHandle = (
+            TraceStoreCreateSection(Compression->BlocksFileHandle,
+                                    PAGE_READONLY,
+                                    Compression->BlocksSize,
+                                    TraceStore->NumaNode)
+        );
+
+        if (!Compression->BlocksMappingHandle ||
+            Compression->BlocksMappingHandle == INVALID_HANDLE_VALUE) {
+            Compression->BlocksMappingHandle = NULL;
+            goto Error;
+        }
+
+        FileOffset.QuadPart = 0;
+        Compression->BlocksBaseAddress = (
+            TraceStoreMapView(Compression->BlocksMappingHandle,
+                              FILE_MAP_READ,
+                              FileOffset,
+                              (SIZE_T)Compression->BlocksSize.QuadPart,
+                              NULL,
+                              TraceStore->NumaNode)
+        );
+
+        if (!Compression->BlocksBaseAddress) {
+            goto Error;
+        }
+    }
+
+    //
+    // Discard invalid entries, then sort the remainder by file offset.
+    //
+
+    for (Index = 0, Inner = 0; Index < Count; Index++) {
+
+        Block = Blocks[Index];
+        CompressedEnd = (
+            (ULONGLONG)Block.CompressedOffset.QuadPart +
+            Block.CompressedSize
+        );
+
+        if (Block.FileOffset.QuadPart < 0 ||
+            Block.CompressedOffset.QuadPart < 0 ||
+            Block.UncompressedSize == 0 ||
+            Block.UncompressedSize > Compression->BlockSize ||
+            Block.CompressedSize == 0 ||
+            CompressedEnd > (ULONGLONG)Compression->BlocksSize.QuadPart ||
+            (Block.Flags.Stored &&
+             Block.CompressedSize != Block.UncompressedSize)) {
+            continue;
+        }
+
+        Blocks[Inner++] = Block;
+    }
+
+    Count = Inner;
+
+    for (Index = 1; Index < Count; Index++) {
+        Block = Blocks[Index];
+        Inner = Index;
+        while (Inner > 0) {
+            if (Blocks[Inner-1].FileOffset.QuadPart <=
+                Block.FileOffset.QuadPart) {
+                break;
+            }
+            Blocks[Inner] = Blocks[Inner-1];
+            Inner--;
+        }
+        Blocks[Inner] = Block;
+    }
+
+    Compression->NumberOfIndexEntries = Count;
+
+    return TRUE;
+
+Error:
+
+    TraceStore->LastError = GetLastError();
+    return FALSE;
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOL
+ExpandTraceStoreBlock(
+    _In_ PTRACE_STORE_BLOCK_COMPRESSION Compression,
+    _In_ PTRACE_STORE_BLOCK Block,
+    _Out_writes_bytes_all_(Block->UncompressedSize) PBYTE Dest
+    )
+{
+    BOOL Success;
+    PCBYTE Source;
+
+    Source = (PCBYTE)(
+        RtlOffsetToPointer(
+            Compression->BlocksBaseAddress,
+            Block->CompressedOffset.QuadPart
+        )
+    );
+
+    TRY_MAPPED_MEMORY_OP {
+        if (Block->Flags.Stored) {
+            CopyMemory(Dest, Source, Block->UncompressedSize);
+            Success = TRUE;
+        } else {
+            Success = DecompressTraceStoreBlock(Source,
+                                                Block->CompressedSize,
+                                                Dest,
+                                                Block->UncompressedSize);
+        }
+    } CATCH_STATUS_IN_PAGE_ERROR {
+        Success = FALSE;
+    }
+
+    return Success;
+}
+
+_Use_decl_annotations_
+BOOL
+DecompressTraceStoreBlocks(
+    PTRACE_STORE TraceStore,
+    PVOID BaseAddress,
+    LARGE_INTEGER FileOffset,
+    LARGE_INTEGER Size
+    )
+/*++
+
+Routine Description:
+
+    This routine decompresses all blocks of a readonly trace store that
+    overlap the given range of the trace store's file into a view of that
+    range.  The view must be writable; BindTraceStoreReadonly() maps trace
+    stores with blocks copy-on-write, so decompressed pages are private to
+    the process and the file is never modified.
+
+    This routine is called by PrepareReadonlyTraceStoreMemoryMap() as each
+    memory map is prepared.  Trace stores with blocks don't have a flat memory
+    map, so each block is only decompressed by the memory map(s) it overlaps.
+    It is a no-op if the trace store has no blocks.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to a readonly TRACE_STORE structure.
+
+    BaseAddress - Supplies the base address of the view.
+
+    FileOffset - Supplies the offset of the view within the trace store's
+        file.
+
+    Size - Supplies the size of the view, in bytes.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    BOOL Success;
+    ULONGLONG Low;
+    ULONGLONG Mid;
+    ULONGLONG High;
+    ULONGLONG Index;
+    LONGLONG Start;
+    LONGLONG End;
+    LONGLONG BlockStart;
+    LONGLONG BlockEnd;
+    LONGLONG CopyStart;
+    LONGLONG CopyEnd;
+    PBYTE Buffer;
+    PALLOCATOR Allocator;
+    PTRACE_STORE_BLOCK Block;
+    PTRACE_STORE_BLOCK Blocks;
+    PTRACE_STORE_BLOCK_COMPRESSION Compression;
+
+    Compression = TraceStore->BlockCompression;
+
+    if (!Compression || !Compression->NumberOfIndexEntries) {
+        return TRUE;
+    }
+
+    Blocks = Compression->Blocks;
+    Start = FileOffset.QuadPart;
+    End = Start + Size.QuadPart;
+
+    //
+    // Find the first block that ends after the start of the range.
+    //
+
+    Low = 0;
+    High = Compression->NumberOfIndexEntries;
+
+    while (Low < High) {
+        Mid = Low + ((High - Low) >> 1);
+        Block = &Blocks[Mid];
+        BlockEnd = Block->FileOffset.QuadPart + Block->UncompressedSize;
+        if (BlockEnd <= Start) {
+            Low = Mid + 1;
+        } else {
+            High = Mid;
+        }
+    }
+
+    Buffer = NULL;
+    Success = TRUE;
+    Allocator = Compression->Allocator;
+
+    for (Index = Low; Index < Compression->NumberOfIndexEntries; Index++) {
+
+        Block = &Blocks[Index];
+        BlockStart = Block->FileOffset.QuadPart;
+        BlockEnd = BlockStart + Block->UncompressedSize;
+
+        if (BlockStart >= End) {
+            break;
+        }
+
+        //
+        // Fast path: the block lies entirely within the view, so decompress
+        // it in place.
+        //
+
+        if (BlockStart >= Start && BlockEnd <= End) {
+            Success = ExpandTraceStoreBlock(
+                Compression,
+                Block,
+                (PBYTE)RtlOffsetToPointer(BaseAddress, BlockStart - Start)
+            );
+            if (!Success) {
+                break;
+            }
+            continue;
+        }
+
+        //
+        // The block straddles the view boundary; decompress it into a scratch
+        // buffer and copy the overlapping portion.
+        //
+
+        if (!Buffer) {
+            Buffer = (PBYTE)(
+                Allocator->Malloc(Allocator->Context, Compression->BlockSize)
+            );
+            if (!Buffer) {
+                Success = FALSE;
+                break;
+            }
+        }
+
+        Success = ExpandTraceStoreBlock(Compression, Block, Buffer);
+        if (!Success) {
+            break;
+        }
+
+        CopyStart = max(BlockStart, Start);
+        CopyEnd = min(BlockEnd, End);
+
+        CopyMemory(RtlOffsetToPointer(BaseAddress, CopyStart - Start),
+                   Buffer + (CopyStart - BlockStart),
+                   (SIZE_T)(CopyEnd - CopyStart));
+    }
+
+    if (Buffer) {
+        Allocator->Free(Allocator->Context, Buffer);
+    }
+
+    return Success;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
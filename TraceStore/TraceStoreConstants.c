@@ -934,6 +934,23 @@ CONST DWORD TraceStoreInfoSuffixLength = (
     sizeof(WCHAR)
 );
 
+//
+// The following suffixes are not metadata stores; they name the alternate
+// data streams used by trace stores with the BlockCompression trait.
+//
+
+CONST WCHAR TraceStoreCompressedBlocksSuffix[] = L":CompressedBlocks";
+CONST DWORD TraceStoreCompressedBlocksSuffixLength = (
+    sizeof(TraceStoreCompressedBlocksSuffix) /
+    sizeof(WCHAR)
+);
+
+CONST WCHAR TraceStoreBlockIndexSuffix[] = L":BlockIndex";
+CONST DWORD TraceStoreBlockIndexSuffixLength = (
+    sizeof(TraceStoreBlockIndexSuffix) /
+    sizeof(WCHAR)
+);
+
 CONST USHORT LongestTraceStoreSuffixLength = (
     sizeof(TraceStoreAllocationTimestampDeltaSuffixLength) /
     sizeof(WCHAR)
@@ -1177,6 +1194,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1201,6 +1220,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1225,6 +1246,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1249,6 +1272,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1273,6 +1298,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1297,6 +1324,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1321,6 +1350,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1345,6 +1376,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1369,6 +1402,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1393,6 +1428,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1417,6 +1454,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1441,6 +1480,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1465,6 +1506,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1489,6 +1532,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1513,6 +1558,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         1,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1537,6 +1584,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1561,6 +1610,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1585,6 +1636,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1609,6 +1662,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1633,6 +1688,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1657,6 +1714,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1681,6 +1740,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1705,6 +1766,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1729,6 +1792,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1753,6 +1818,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1777,6 +1844,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1801,6 +1870,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1825,6 +1896,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1849,6 +1922,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1873,6 +1948,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1897,6 +1974,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1921,6 +2000,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1945,6 +2026,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1969,6 +2052,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         1,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -1993,6 +2078,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2018,6 +2105,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2042,6 +2131,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2066,6 +2157,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2090,6 +2183,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2114,6 +2209,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2138,6 +2235,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2162,6 +2261,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         1,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2186,6 +2287,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         1,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2210,6 +2313,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2234,6 +2339,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         1,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2258,6 +2365,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2282,6 +2391,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2306,6 +2417,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         1,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2330,6 +2443,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2354,6 +2469,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         1,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2378,6 +2495,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2402,6 +2521,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2426,6 +2547,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2450,6 +2573,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         1,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2474,6 +2599,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2498,6 +2625,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2522,6 +2651,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2546,6 +2677,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         1,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2570,6 +2703,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 
@@ -2594,6 +2729,8 @@ CONST TRACE_STORE_TRAITS TraceStoreTraits[] = {
         0,  // ConcurrentDataStructure
         0,  // NoAllocationAlignment
         0,  // Compress
+        0,  // PerThreadShards
+        0,  // BlockCompression
         0   // Unused
     },
 };
@@ -2727,6 +2864,8 @@ CONST TRACE_STORE_TRAITS MetadataInfoStoreTraits = {
     0,  // ConcurrentDataStructure
     0,  // NoAllocationAlignment
     0,  // Compress
+    0,  // PerThreadShards
+    0,  // BlockCompression
     0   // Unused
 };
 
@@ -2747,6 +2886,8 @@ CONST TRACE_STORE_TRAITS AllocationStoreTraits = {
     0,  // ConcurrentDataStructure
     0,  // NoAllocationAlignment
     1,  // Compress
+    0,  // PerThreadShards
+    0,  // BlockCompression
     0   // Unused
 };
 
@@ -2767,6 +2908,8 @@ CONST TRACE_STORE_TRAITS RelocationStoreTraits = {
     0,  // ConcurrentDataStructure
     0,  // NoAllocationAlignment
     0,  // Compress
+    0,  // PerThreadShards
+    0,  // BlockCompression
     0   // Unused
 };
 
@@ -2787,6 +2930,8 @@ CONST TRACE_STORE_TRAITS AddressStoreTraits = {
     0,  // ConcurrentDataStructure
     0,  // NoAllocationAlignment
     0,  // Compress
+    0,  // PerThreadShards
+    0,  // BlockCompression
     0   // Unused
 };
 
@@ -2807,6 +2952,8 @@ CONST TRACE_STORE_TRAITS AddressRangeStoreTraits = {
     0,  // ConcurrentDataStructure
     0,  // NoAllocationAlignment
     1,  // Compress
+    0,  // PerThreadShards
+    0,  // BlockCompression
     0   // Unused
 };
 
@@ -2827,6 +2974,8 @@ CONST TRACE_STORE_TRAITS AllocationTimestampStoreTraits = {
     0,  // ConcurrentDataStructure
     0,  // NoAllocationAlignment
     0,  // Compress
+    0,  // PerThreadShards
+    0,  // BlockCompression
     0   // Unused
 };
 
@@ -2847,6 +2996,8 @@ CONST TRACE_STORE_TRAITS AllocationTimestampDeltaStoreTraits = {
     0,  // ConcurrentDataStructure
     0,  // NoAllocationAlignment
     0,  // Compress
+    0,  // PerThreadShards
+    0,  // BlockCompression
     0   // Unused
 };
 
@@ -2867,6 +3018,8 @@ CONST TRACE_STORE_TRAITS SynchronizationStoreTraits = {
     0,  // ConcurrentDataStructure
     0,  // NoAllocationAlignment
     0,  // Compress
+    0,  // PerThreadShards
+    0,  // BlockCompression
     0   // Unused
 };
 
@@ -2887,6 +3040,8 @@ CONST TRACE_STORE_TRAITS InfoStoreTraits = {
     0,  // ConcurrentDataStructure
     0,  // NoAllocationAlignment
     0,  // Compress
+    0,  // PerThreadShards
+    0,  // BlockCompression
     0   // Unused
 };
 
@@ -49,6 +49,12 @@ TRACE_STORE_DATA CONST DWORD TraceStoreSynchronizationSuffixLength;
 TRACE_STORE_DATA CONST WCHAR TraceStoreInfoSuffix[];
 TRACE_STORE_DATA CONST DWORD TraceStoreInfoSuffixLength;
 
+TRACE_STORE_DATA CONST WCHAR TraceStoreCompressedBlocksSuffix[];
+TRACE_STORE_DATA CONST DWORD TraceStoreCompressedBlocksSuffixLength;
+
+TRACE_STORE_DATA CONST WCHAR TraceStoreBlockIndexSuffix[];
+TRACE_STORE_DATA CONST DWORD TraceStoreBlockIndexSuffixLength;
+
 TRACE_STORE_DATA CONST LPCWSTR TraceStoreMetadataSuffixes[];
 
 TRACE_STORE_DATA CONST USHORT LongestTraceStoreSuffixLength;
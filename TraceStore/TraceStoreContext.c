@@ -849,6 +849,18 @@ InitializeAllocators:
             );
         }
 
+        //
+        // If the trace store is sharded per-thread, allocations are forwarded
+        // to the calling thread's shard, which has its own allocators.
+        //
+
+        if (HasPerThreadShards(Traits)) {
+            TraceStore->AllocateRecordsWithTimestampImpl1 = (
+                ShardedTraceStoreAllocateRecordsWithTimestamp
+            );
+            continue;
+        }
+
         //
         // If the trace store has the concurrent allocations trait set, we need
         // to set the Try* version of the allocators.
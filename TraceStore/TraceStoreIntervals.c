@@ -66,10 +66,17 @@ Return Value:
 
     Traits = *TraceStore->pTraits;
 
+    //
+    // Stores with concurrent allocations are excluded as the allocation chunks
+    // of different threads are filled in parallel, so their timestamps aren't
+    // monotonic by record position.
+    //
+
     Exclude = (
         !IsFixedRecordSize(Traits)          ||
         !IsRecordSizeAlwaysPowerOf2(Traits) ||
-        IsLinkedStore(Traits)
+        IsLinkedStore(Traits)               ||
+        HasConcurrentAllocations(Traits)
     );
 
     if (Exclude) {
@@ -139,6 +146,12 @@ Return Value:
 
     StartTicks = *Intervals->FirstAllocationTimestamp;
     EndTicks = *Intervals->LastAllocationTimestamp;
+
+    if (EndTicks < StartTicks) {
+        Success = FALSE;
+        goto End;
+    }
+
     ElapsedTicks = EndTicks - StartTicks;
 
     NumberOfIntervals = (
@@ -470,7 +470,7 @@ Return Value:
     TRACE_STORE_ADDRESS Address;
     TRACE_STORE_ADDRESS_RANGE AddressRange;
     PTRACE_STORE_ADDRESS AddressPointer;
-    FILE_STANDARD_INFO FileInfo;
+    LARGE_INTEGER EndOfFile;
     LARGE_INTEGER CurrentFileOffset;
     LARGE_INTEGER NewFileOffset;
     LARGE_INTEGER DistanceToMove;
@@ -512,7 +512,7 @@ Return Value:
     // Get the size of the file from the memory map.
     //
 
-    if (!GetTraceStoreMemoryMapFileInfo(MemoryMap, &FileInfo)) {
+    if (!TraceStoreGetFileSize(MemoryMap->FileHandle, &EndOfFile)) {
         TraceStore->LastError = GetLastError();
         __debugbreak();
         return FALSE;
@@ -524,10 +524,10 @@ Return Value:
 
     DistanceToMove.QuadPart = 0;
 
-    Success = SetFilePointerEx(MemoryMap->FileHandle,
-                               DistanceToMove,
-                               &CurrentFileOffset,
-                               FILE_CURRENT);
+    Success = TraceStoreSetFilePointer(MemoryMap->FileHandle,
+                                       DistanceToMove,
+                                       &CurrentFileOffset,
+                                       FILE_CURRENT);
     if (!Success) {
         TraceStore->LastError = GetLastError();
         __debugbreak();
@@ -558,10 +558,10 @@ Return Value:
     // Adjust the file pointer from the current position.
     //
 
-    Success = SetFilePointerEx(MemoryMap->FileHandle,
-                               DistanceToMove,
-                               &NewFileOffset,
-                               FILE_BEGIN);
+    Success = TraceStoreSetFilePointer(MemoryMap->FileHandle,
+                                       DistanceToMove,
+                                       &NewFileOffset,
+                                       FILE_BEGIN);
     if (!Success) {
         TraceStore->LastError = GetLastError();
         __debugbreak();
@@ -580,8 +580,8 @@ Return Value:
     // N.B. This will be a synchronous (blocking) I/O call.
     //
 
-    if (FileInfo.EndOfFile.QuadPart < NewFileOffset.QuadPart) {
-        if (!SetEndOfFile(MemoryMap->FileHandle)) {
+    if (EndOfFile.QuadPart < NewFileOffset.QuadPart) {
+        if (!TraceStoreSetEndOfFile(MemoryMap->FileHandle)) {
             TraceStore->LastError = GetLastError();
             __debugbreak();
             return FALSE;
@@ -594,13 +594,10 @@ Return Value:
 
 CreateSection:
 
-    MemoryMap->MappingHandle = CreateFileMappingNuma(
+    MemoryMap->MappingHandle = TraceStoreCreateSection(
         MemoryMap->FileHandle,
-        NULL,
         TraceStore->CreateFileMappingProtectionFlags,
-        NewFileOffset.HighPart,
-        NewFileOffset.LowPart,
-        NULL,
+        NewFileOffset,
         TraceStore->NumaNode
     );
 
@@ -620,7 +617,7 @@ CreateSection:
     // non-NULL, it is the address we need to map the view at in order to
     // avoid relocations.
     //
-    // In both cases, our first call to MapViewOfFileExNuma() attempts to
+    // In both cases, our first call to TraceStoreMapView() attempts to
     // honor this preferred base address.
     //
 
@@ -642,12 +639,11 @@ CreateSection:
 
 TryMapMemory:
 
-    MemoryMap->BaseAddress = MapViewOfFileExNuma(
+    MemoryMap->BaseAddress = TraceStoreMapView(
         MemoryMap->MappingHandle,
         TraceStore->MapViewOfFileDesiredAccess,
-        MemoryMap->FileOffset.HighPart,
-        MemoryMap->FileOffset.LowPart,
-        MemoryMap->MappingSize.QuadPart,
+        MemoryMap->FileOffset,
+        (SIZE_T)MemoryMap->MappingSize.QuadPart,
         PreferredBaseAddress,
         TraceStore->NumaNode
     );
@@ -810,6 +806,17 @@ Finalize:
 
     MemoryMap->NextAddress = MemoryMap->BaseAddress;
 
+    //
+    // Streaming writers fill the map front-to-back and never revisit it, so
+    // let the platform know.
+    //
+
+    if (IsStreamingWrite(*TraceStore->pTraits)) {
+        TraceStoreAdviseView(MemoryMap->BaseAddress,
+                             (SIZE_T)MemoryMap->MappingSize.QuadPart,
+                             TraceStoreViewAdviceSequential);
+    }
+
     if (!TraceStore->NoPrefaulting) {
 
         //
@@ -909,7 +916,7 @@ Return Value:
     //
     // If we're configured to ignore preferred base addresses, capture the
     // original preferred base address now, and clear the preferred base
-    // address pointer we pass to MapViewOfFileExNuma().  Otherwise, use
+    // address pointer we pass to TraceStoreMapView().  Otherwise, use
     // the preferred base address stored in the memory map.
     //
 
@@ -945,12 +952,11 @@ Return Value:
 
 TryMapMemory:
 
-    MemoryMap->BaseAddress = MapViewOfFileExNuma(
+    MemoryMap->BaseAddress = TraceStoreMapView(
         MemoryMap->MappingHandle,
         TraceStore->MapViewOfFileDesiredAccess,
-        MemoryMap->FileOffset.HighPart,
-        MemoryMap->FileOffset.LowPart,
-        MemoryMap->MappingSize.QuadPart,
+        MemoryMap->FileOffset,
+        (SIZE_T)MemoryMap->MappingSize.QuadPart,
         PreferredBaseAddress,
         TraceStore->NumaNode
     );
@@ -1012,6 +1018,32 @@ TryMapMemory:
         }
     }
 
+    //
+    // Decompress any blocks that overlap the map.  The view is copy-on-write
+    // if the trace store has blocks; see BindTraceStoreReadonly().
+    //
+
+    if (TraceStore->BlockCompression) {
+        Success = DecompressTraceStoreBlocks(TraceStore,
+                                             MemoryMap->BaseAddress,
+                                             MemoryMap->FileOffset,
+                                             MemoryMap->MappingSize);
+        if (!Success) {
+            return FALSE;
+        }
+    }
+
+    //
+    // Streaming readers consume the map front-to-back; ask the platform to
+    // start reading it in now.
+    //
+
+    if (IsStreamingRead(*TraceStore->pTraits)) {
+        TraceStoreAdviseView(MemoryMap->BaseAddress,
+                             (SIZE_T)MemoryMap->MappingSize.QuadPart,
+                             TraceStoreViewAdviceWillNeed);
+    }
+
     //
     // Record all of the mapping information in our address record.
     //
@@ -1141,9 +1173,33 @@ Return Value:
 
 --*/
 {
+    BOOL Compress;
+    LARGE_INTEGER FileOffset;
+    LARGE_INTEGER CompressedLength;
+
+    //
+    // If the trace store is block compressed, compress the map before it is
+    // unmapped, and deallocate the compressed range from the file afterward.
+    // Failure to compress isn't fatal; the data simply stays in the file.
+    //
+
+    Compress = (TraceStore->BlockCompression && !TraceStore->IsReadonly);
+
+    if (Compress) {
+        FileOffset.QuadPart = MemoryMap->FileOffset.QuadPart;
+        CompressTraceStoreMemoryMap(TraceStore, MemoryMap, &CompressedLength);
+    }
+
     if (!UnmapTraceStoreMemoryMap(MemoryMap)) {
         __debugbreak();
     }
+
+    if (Compress && CompressedLength.QuadPart) {
+        DeallocateCompressedTraceStoreRange(TraceStore,
+                                            FileOffset,
+                                            CompressedLength);
+    }
+
     FinalizeTraceStoreAddressTimes(TraceStore, MemoryMap->pAddress);
     ReturnFreeTraceStoreMemoryMap(TraceStore, MemoryMap);
     return TRUE;
@@ -1203,12 +1259,14 @@ Return Value:
         // Flush the view, unmap it, then clear the base address pointer.
         //
 
-        if (!FlushViewOfFile(MemoryMap->BaseAddress, 0)) {
+        if (!TraceStoreFlushView(MemoryMap->BaseAddress,
+                                 (SIZE_T)MemoryMap->MappingSize.QuadPart)) {
             TraceStore->LastError = GetLastError();
             //__debugbreak();
         }
 
-        if (!UnmapViewOfFile(MemoryMap->BaseAddress)) {
+        if (!TraceStoreUnmapView(MemoryMap->BaseAddress,
+                                 (SIZE_T)MemoryMap->MappingSize.QuadPart)) {
             TraceStore->LastError = GetLastError();
             //__debugbreak();
         }
@@ -1222,7 +1280,7 @@ Return Value:
         // Close the memory mapping handle and clear the pointer.
         //
 
-        if (!CloseHandle(MemoryMap->MappingHandle)) {
+        if (!TraceStoreCloseSection(MemoryMap->MappingHandle)) {
             TraceStore->LastError = GetLastError();
             //__debugbreak();
         }
@@ -1257,7 +1315,8 @@ Return Value:
     DWORD LastError;
 
     if (MemoryMap->BaseAddress) {
-        if (!UnmapViewOfFile(MemoryMap->BaseAddress)) {
+        if (!TraceStoreUnmapView(MemoryMap->BaseAddress,
+                                 (SIZE_T)MemoryMap->MappingSize.QuadPart)) {
             LastError = GetLastError();
             __debugbreak();
         }
@@ -1265,7 +1324,7 @@ Return Value:
     }
 
     if (MemoryMap->MappingHandle) {
-        if (!CloseHandle(MemoryMap->MappingHandle)) {
+        if (!TraceStoreCloseSection(MemoryMap->MappingHandle)) {
             LastError = GetLastError();
             __debugbreak();
         }
@@ -1333,7 +1392,7 @@ Return Value:
 
     if (TRUE) {
         PushTraceStoreMemoryMap(&TraceStore->CloseMemoryMaps, MemoryMap);
-        SubmitThreadpoolWork(TraceStore->CloseMemoryMapWork);
+        TraceStoreSubmitWork(TraceStore->CloseMemoryMapWork);
     } else {
         CloseTraceStoreMemoryMap(TraceStore, MemoryMap);
     }
@@ -1540,7 +1599,7 @@ Return Value:
 
 CloseOldMemoryMap:
     PushTraceStoreMemoryMap(&TraceStore->CloseMemoryMaps, PrevPrevMemoryMap);
-    SubmitThreadpoolWork(TraceStore->CloseMemoryMapWork);
+    TraceStoreSubmitWork(TraceStore->CloseMemoryMapWork);
 
 StartPreparation:
 
@@ -1607,7 +1666,7 @@ PopNextMap:
 
             Stats->BlockedAllocations++;
             Event = TraceStore->NextMemoryMapAvailableEvent;
-            WaitResult = WaitForSingleObject(Event, INFINITE);
+            WaitResult = TraceStoreWaitForEvent(Event, INFINITE);
             if (WaitResult == WAIT_OBJECT_0) {
                 goto PopNextMap;
             }
@@ -1841,7 +1900,7 @@ SubmitPreparedMemoryMap:
     }
 
     PushTraceStoreMemoryMap(&TraceStore->PrepareMemoryMaps, PrepareMemoryMap);
-    SubmitThreadpoolWork(TraceStore->PrepareNextMemoryMapWork);
+    TraceStoreSubmitWork(TraceStore->PrepareNextMemoryMapWork);
 
     Success = TRUE;
     goto End;
@@ -616,6 +616,10 @@ Return Value:
 
         if (Success) {
             Sync->Flags.AllocationCriticalSection = TRUE;
+            Success = CreateTraceStoreAllocationChunks(
+                TraceStore,
+                RuntimeParameters->ConcurrentAllocationsChunkSizeInBytes
+            );
         }
     }
 
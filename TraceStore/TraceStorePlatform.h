@@ -0,0 +1,574 @@
+/*++
+
+Copyright (c) 2016 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    TraceStorePlatform.h
+
+Abstract:
+
+    This module defines the platform layer used by the trace store memory map
+    pipeline; that is, the machinery behind PrepareNextTraceStoreMemoryMap(),
+    ConsumeNextTraceStoreMemoryMap() and CloseTraceStoreMemoryMap() that keeps
+    the next memory map for a trace store prepared in the background whilst
+    the current one is being consumed.
+
+    The layer covers file sizing, file mapping sections and views, view usage
+    advice, threadpool work and events.  On Windows, each routine is an inline
+    wrapper around the Win32 API the pipeline has always used.  Elsewhere,
+    the routines are implemented by TraceStorePosix.c in terms of open(),
+    ftruncate(), mmap(), msync() and madvise(), a pthread-based work pool, and
+    futex-based events.  File handles are file descriptors stored in a HANDLE,
+    and section, work and event handles are pointers to structures private to
+    that module.
+
+    For the POSIX build, this header also provides the subset of Windows base
+    types, SAL annotations and interlocked singly-linked list routines that
+    the pipeline depends on.
+
+--*/
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _WIN32
+
+////////////////////////////////////////////////////////////////////////////////
+// POSIX Base Types
+////////////////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define VOID void
+#define CONST const
+#define TRUE 1
+#define FALSE 0
+#define CALLBACK
+#define FORCEINLINE static inline __attribute__((always_inline))
+#define DECLSPEC_ALIGN(x) __attribute__((aligned(x)))
+
+typedef int BOOL;
+typedef unsigned char BYTE, UCHAR, BOOLEAN;
+typedef unsigned short USHORT;
+typedef int32_t LONG;
+typedef uint32_t ULONG, DWORD;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef uintptr_t ULONG_PTR, SIZE_T;
+typedef void *PVOID, *HANDLE;
+typedef PVOID *PPVOID;
+typedef ULONG *PULONG;
+typedef LONG *PLONG;
+
+typedef union _LARGE_INTEGER {
+    struct {
+        ULONG LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef intptr_t LONG_PTR;
+
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+
+#define INFINITE 0xffffffff
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+#define WAIT_FAILED 0xffffffff
+
+#define FILE_BEGIN 0
+#define FILE_CURRENT 1
+#define FILE_END 2
+
+#define PAGE_READONLY 0x02
+#define PAGE_READWRITE 0x04
+#define PAGE_WRITECOPY 0x08
+
+#define FILE_MAP_COPY 0x0001
+#define FILE_MAP_WRITE 0x0002
+#define FILE_MAP_READ 0x0004
+
+#define GetLastError() ((DWORD)errno)
+
+#ifndef _In_
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Out_opt_
+#define _Inout_
+#define _Inout_opt_
+#define _Check_return_
+#define _Success_(x)
+#define _Use_decl_annotations_
+#endif
+
+//
+// Interlocked singly-linked lists.  The header pairs the list head with a
+// sequence number that is incremented on every push, and both are swapped
+// with a single 16-byte compare-exchange, which avoids the ABA problem in
+// the same manner as the Windows implementation.
+//
+
+typedef struct DECLSPEC_ALIGN(16) _SLIST_ENTRY {
+    struct _SLIST_ENTRY *Next;
+} SLIST_ENTRY, *PSLIST_ENTRY;
+
+typedef union DECLSPEC_ALIGN(16) _SLIST_HEADER {
+    struct {
+        PSLIST_ENTRY Next;
+        ULONGLONG Sequence;
+    };
+    unsigned __int128 AsInt128;
+} SLIST_HEADER, *PSLIST_HEADER;
+
+FORCEINLINE
+VOID
+InitializeSListHead(
+    _Out_ PSLIST_HEADER ListHead
+    )
+{
+    ListHead->Next = NULL;
+    ListHead->Sequence = 0;
+}
+
+FORCEINLINE
+PSLIST_ENTRY
+InterlockedPushEntrySList(
+    _Inout_ PSLIST_HEADER ListHead,
+    _Inout_ PSLIST_ENTRY ListEntry
+    )
+{
+    SLIST_HEADER Old;
+    SLIST_HEADER New;
+
+    Old.AsInt128 = __atomic_load_n(&ListHead->AsInt128, __ATOMIC_RELAXED);
+
+    do {
+        ListEntry->Next = Old.Next;
+        New.Next = ListEntry;
+        New.Sequence = Old.Sequence + 1;
+    } while (!__atomic_compare_exchange_n(&ListHead->AsInt128,
+                                          &Old.AsInt128,
+                                          New.AsInt128,
+                                          FALSE,
+                                          __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+
+    return Old.Next;
+}
+
+FORCEINLINE
+PSLIST_ENTRY
+InterlockedPopEntrySList(
+    _Inout_ PSLIST_HEADER ListHead
+    )
+{
+    SLIST_HEADER Old;
+    SLIST_HEADER New;
+
+    Old.AsInt128 = __atomic_load_n(&ListHead->AsInt128, __ATOMIC_ACQUIRE);
+
+    do {
+        if (!Old.Next) {
+            return NULL;
+        }
+        New.Next = Old.Next->Next;
+        New.Sequence = Old.Sequence;
+    } while (!__atomic_compare_exchange_n(&ListHead->AsInt128,
+                                          &Old.AsInt128,
+                                          New.AsInt128,
+                                          FALSE,
+                                          __ATOMIC_ACQUIRE,
+                                          __ATOMIC_ACQUIRE));
+
+    return Old.Next;
+}
+
+FORCEINLINE
+PSLIST_ENTRY
+InterlockedFlushSList(
+    _Inout_ PSLIST_HEADER ListHead
+    )
+{
+    SLIST_HEADER Old;
+    SLIST_HEADER New;
+
+    Old.AsInt128 = __atomic_load_n(&ListHead->AsInt128, __ATOMIC_ACQUIRE);
+
+    do {
+        New.Next = NULL;
+        New.Sequence = Old.Sequence;
+    } while (!__atomic_compare_exchange_n(&ListHead->AsInt128,
+                                          &Old.AsInt128,
+                                          New.AsInt128,
+                                          FALSE,
+                                          __ATOMIC_ACQUIRE,
+                                          __ATOMIC_ACQUIRE));
+
+    return Old.Next;
+}
+
+//
+// Threadpool work.  The callback signature matches the Windows one, such
+// that the existing trace store callbacks can be used unmodified; Instance
+// is always NULL.
+//
+
+typedef struct _TP_CALLBACK_INSTANCE *PTP_CALLBACK_INSTANCE;
+typedef struct _TP_CALLBACK_ENVIRON *PTP_CALLBACK_ENVIRON;
+typedef struct _TP_WORK TP_WORK, *PTP_WORK;
+
+typedef
+VOID
+(CALLBACK TP_WORK_CALLBACK)(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _Inout_ PTP_WORK Work
+    );
+typedef TP_WORK_CALLBACK *PTP_WORK_CALLBACK;
+
+#endif // _WIN32
+
+////////////////////////////////////////////////////////////////////////////////
+// Platform Layer
+////////////////////////////////////////////////////////////////////////////////
+
+//
+// Advice regarding how a mapped view will be accessed.  This is passed to
+// madvise() on POSIX platforms, and is currently ignored on Windows.
+//
+
+typedef enum _TRACE_STORE_VIEW_ADVICE {
+    TraceStoreViewAdviceNormal = 0,
+    TraceStoreViewAdviceSequential,
+    TraceStoreViewAdviceWillNeed,
+    TraceStoreViewAdviceDontNeed,
+    TraceStoreViewAdviceInvalid
+} TRACE_STORE_VIEW_ADVICE;
+
+#ifdef _WIN32
+
+FORCEINLINE
+_Success_(return != 0)
+BOOL
+TraceStoreGetFileSize(
+    _In_ HANDLE FileHandle,
+    _Out_ PLARGE_INTEGER EndOfFile
+    )
+{
+    return GetFileSizeEx(FileHandle, EndOfFile);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOL
+TraceStoreSetFilePointer(
+    _In_ HANDLE FileHandle,
+    _In_ LARGE_INTEGER DistanceToMove,
+    _Out_opt_ PLARGE_INTEGER NewFilePointer,
+    _In_ ULONG MoveMethod
+    )
+{
+    return SetFilePointerEx(FileHandle,
+                            DistanceToMove,
+                            NewFilePointer,
+                            MoveMethod);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOL
+TraceStoreSetEndOfFile(
+    _In_ HANDLE FileHandle
+    )
+{
+    return SetEndOfFile(FileHandle);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOL
+TraceStoreDeallocateFileRange(
+    _In_ HANDLE FileHandle,
+    _In_ LARGE_INTEGER FileOffset,
+    _In_ LARGE_INTEGER Length
+    )
+{
+    BOOL Success;
+    DWORD BytesReturned;
+    FILE_SET_SPARSE_BUFFER Sparse;
+    FILE_ZERO_DATA_INFORMATION ZeroData;
+
+    //
+    // Zeroing a range only releases its clusters if the file is sparse, so
+    // make sure it is first.  (This is a no-op if it already is.)
+    //
+
+    Sparse.SetSparse = TRUE;
+
+    Success = DeviceIoControl(FileHandle,
+                              FSCTL_SET_SPARSE,
+                              &Sparse,
+                              sizeof(Sparse),
+                              NULL,
+                              0,
+                              &BytesReturned,
+                              NULL);
+
+    if (!Success) {
+        return FALSE;
+    }
+
+    ZeroData.FileOffset.QuadPart = FileOffset.QuadPart;
+    ZeroData.BeyondFinalZero.QuadPart = FileOffset.QuadPart + Length.QuadPart;
+
+    return DeviceIoControl(FileHandle,
+                           FSCTL_SET_ZERO_DATA,
+                           &ZeroData,
+                           sizeof(ZeroData),
+                           NULL,
+                           0,
+                           &BytesReturned,
+                           NULL);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+HANDLE
+TraceStoreCreateSection(
+    _In_ HANDLE FileHandle,
+    _In_ ULONG Protection,
+    _In_ LARGE_INTEGER MaximumSize,
+    _In_ ULONG NumaNode
+    )
+{
+    return CreateFileMappingNuma(FileHandle,
+                                 NULL,
+                                 Protection,
+                                 MaximumSize.HighPart,
+                                 MaximumSize.LowPart,
+                                 NULL,
+                                 NumaNode);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+PVOID
+TraceStoreMapView(
+    _In_ HANDLE SectionHandle,
+    _In_ ULONG DesiredAccess,
+    _In_ LARGE_INTEGER FileOffset,
+    _In_ SIZE_T Size,
+    _In_opt_ PVOID PreferredBaseAddress,
+    _In_ ULONG NumaNode
+    )
+{
+    return MapViewOfFileExNuma(SectionHandle,
+                               DesiredAccess,
+                               FileOffset.HighPart,
+                               FileOffset.LowPart,
+                               Size,
+                               PreferredBaseAddress,
+                               NumaNode);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOL
+TraceStoreFlushView(
+    _In_ PVOID BaseAddress,
+    _In_ SIZE_T Size
+    )
+{
+    UNREFERENCED_PARAMETER(Size);
+    return FlushViewOfFile(BaseAddress, 0);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOL
+TraceStoreUnmapView(
+    _In_ PVOID BaseAddress,
+    _In_ SIZE_T Size
+    )
+{
+    UNREFERENCED_PARAMETER(Size);
+    return UnmapViewOfFile(BaseAddress);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOL
+TraceStoreCloseSection(
+    _In_ HANDLE SectionHandle
+    )
+{
+    return CloseHandle(SectionHandle);
+}
+
+FORCEINLINE
+VOID
+TraceStoreAdviseView(
+    _In_ PVOID BaseAddress,
+    _In_ SIZE_T Size,
+    _In_ TRACE_STORE_VIEW_ADVICE Advice
+    )
+{
+    UNREFERENCED_PARAMETER(BaseAddress);
+    UNREFERENCED_PARAMETER(Size);
+    UNREFERENCED_PARAMETER(Advice);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+PTP_WORK
+TraceStoreCreateWork(
+    _In_ PTP_WORK_CALLBACK Callback,
+    _In_opt_ PVOID Context,
+    _In_opt_ PTP_CALLBACK_ENVIRON CallbackEnv
+    )
+{
+    return CreateThreadpoolWork(Callback, Context, CallbackEnv);
+}
+
+FORCEINLINE
+VOID
+TraceStoreSubmitWork(
+    _In_ PTP_WORK Work
+    )
+{
+    SubmitThreadpoolWork(Work);
+}
+
+FORCEINLINE
+VOID
+TraceStoreWaitForWork(
+    _In_ PTP_WORK Work
+    )
+{
+    WaitForThreadpoolWorkCallbacks(Work, FALSE);
+}
+
+FORCEINLINE
+VOID
+TraceStoreCloseWork(
+    _In_ PTP_WORK Work
+    )
+{
+    CloseThreadpoolWork(Work);
+}
+
+FORCEINLINE
+_Success_(return != 0)
+HANDLE
+TraceStoreCreateEvent(
+    _In_ BOOL ManualReset,
+    _In_ BOOL InitialState
+    )
+{
+    return CreateEvent(NULL, ManualReset, InitialState, NULL);
+}
+
+FORCEINLINE
+BOOL
+TraceStoreSetEvent(
+    _In_ HANDLE Event
+    )
+{
+    return SetEvent(Event);
+}
+
+FORCEINLINE
+ULONG
+TraceStoreWaitForEvent(
+    _In_ HANDLE Event,
+    _In_ ULONG Milliseconds
+    )
+{
+    return WaitForSingleObject(Event, Milliseconds);
+}
+
+FORCEINLINE
+BOOL
+TraceStoreCloseEvent(
+    _In_ HANDLE Event
+    )
+{
+    return CloseHandle(Event);
+}
+
+#else
+
+//
+// Implemented by TraceStorePosix.c.  Semantics match the Win32 routines
+// wrapped above; errors are reported via errno (i.e. GetLastError()).
+//
+
+BOOL TraceStoreGetFileSize(_In_ HANDLE FileHandle,
+                           _Out_ PLARGE_INTEGER EndOfFile);
+
+BOOL TraceStoreSetFilePointer(_In_ HANDLE FileHandle,
+                              _In_ LARGE_INTEGER DistanceToMove,
+                              _Out_opt_ PLARGE_INTEGER NewFilePointer,
+                              _In_ ULONG MoveMethod);
+
+BOOL TraceStoreSetEndOfFile(_In_ HANDLE FileHandle);
+
+BOOL TraceStoreDeallocateFileRange(_In_ HANDLE FileHandle,
+                                   _In_ LARGE_INTEGER FileOffset,
+                                   _In_ LARGE_INTEGER Length);
+
+HANDLE TraceStoreCreateSection(_In_ HANDLE FileHandle,
+                               _In_ ULONG Protection,
+                               _In_ LARGE_INTEGER MaximumSize,
+                               _In_ ULONG NumaNode);
+
+PVOID TraceStoreMapView(_In_ HANDLE SectionHandle,
+                        _In_ ULONG DesiredAccess,
+                        _In_ LARGE_INTEGER FileOffset,
+                        _In_ SIZE_T Size,
+                        _In_opt_ PVOID PreferredBaseAddress,
+                        _In_ ULONG NumaNode);
+
+BOOL TraceStoreFlushView(_In_ PVOID BaseAddress, _In_ SIZE_T Size);
+
+BOOL TraceStoreUnmapView(_In_ PVOID BaseAddress, _In_ SIZE_T Size);
+
+BOOL TraceStoreCloseSection(_In_ HANDLE SectionHandle);
+
+VOID TraceStoreAdviseView(_In_ PVOID BaseAddress,
+                          _In_ SIZE_T Size,
+                          _In_ TRACE_STORE_VIEW_ADVICE Advice);
+
+PTP_WORK TraceStoreCreateWork(_In_ PTP_WORK_CALLBACK Callback,
+                              _In_opt_ PVOID Context,
+                              _In_opt_ PTP_CALLBACK_ENVIRON CallbackEnv);
+
+VOID TraceStoreSubmitWork(_In_ PTP_WORK Work);
+
+VOID TraceStoreWaitForWork(_In_ PTP_WORK Work);
+
+VOID TraceStoreCloseWork(_In_ PTP_WORK Work);
+
+HANDLE TraceStoreCreateEvent(_In_ BOOL ManualReset, _In_ BOOL InitialState);
+
+BOOL TraceStoreSetEvent(_In_ HANDLE Event);
+
+ULONG TraceStoreWaitForEvent(_In_ HANDLE Event, _In_ ULONG Milliseconds);
+
+BOOL TraceStoreCloseEvent(_In_ HANDLE Event);
+
+#endif // _WIN32
+
+#ifdef __cplusplus
+}; // extern "C"
+#endif
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
@@ -0,0 +1,855 @@
+/*++
+
+Copyright (c) 2016 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    TraceStorePosix.c
+
+Abstract:
+
+    This module implements the trace store platform layer (see
+    TraceStorePlatform.h) for POSIX platforms.  File mapping sections and
+    views are implemented with ftruncate(), mmap(), msync() and madvise(),
+    and file ranges are deallocated with fallocate().  Threadpool work is
+    serviced by a process-wide pool of pthreads, and events are implemented
+    with futexes.
+
+    This module is only built on POSIX platforms; the Windows build uses the
+    inline Win32 wrappers in TraceStorePlatform.h.
+
+--*/
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "TraceStorePlatform.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+#define HandleToFileDescriptor(Handle) ((int)(LONG_PTR)(Handle))
+
+//
+// The maximum number of threads in the work pool.
+//
+
+#define MAXIMUM_NUMBER_OF_WORK_POOL_THREADS 64
+
+////////////////////////////////////////////////////////////////////////////////
+// Structures
+////////////////////////////////////////////////////////////////////////////////
+
+//
+// A section captures the file and protection that views will be mapped
+// with.  The file descriptor is duplicated, such that the section remains
+// valid if the file handle is closed first (as is the case on Windows).
+//
+
+typedef struct _TRACE_STORE_SECTION {
+    int FileDescriptor;
+    ULONG Protection;
+    LONGLONG MaximumSize;
+} TRACE_STORE_SECTION, *PTRACE_STORE_SECTION;
+
+//
+// A work item.  NumberOfPendingCallbacks is incremented by each submission
+// and decremented when a pool thread picks up the corresponding callback; a
+// work item is on the pool's queue whenever it is non-zero.  Both counts are
+// protected by the pool lock.
+//
+
+struct _TP_WORK {
+    struct _TP_WORK *Next;
+    PTP_WORK_CALLBACK Callback;
+    PVOID Context;
+    ULONG NumberOfPendingCallbacks;
+    ULONG NumberOfRunningCallbacks;
+    pthread_cond_t CallbacksComplete;
+};
+
+typedef struct _TRACE_STORE_WORK_POOL {
+    pthread_mutex_t Lock;
+    pthread_cond_t WorkAvailable;
+    PTP_WORK Head;
+    PTP_WORK Tail;
+    ULONG NumberOfThreads;
+} TRACE_STORE_WORK_POOL, *PTRACE_STORE_WORK_POOL;
+
+//
+// An event.  State is 1 when signaled, 0 otherwise.  Waiters sleep on the
+// state word with FUTEX_WAIT; auto-reset events are consumed by the waiter
+// that successfully swaps the state from 1 to 0.
+//
+
+typedef struct _TRACE_STORE_EVENT {
+    volatile int32_t State;
+    BOOL ManualReset;
+} TRACE_STORE_EVENT, *PTRACE_STORE_EVENT;
+
+static TRACE_STORE_WORK_POOL WorkPool = {
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    NULL,
+    NULL,
+    0
+};
+
+static pthread_once_t WorkPoolOnce = PTHREAD_ONCE_INIT;
+
+////////////////////////////////////////////////////////////////////////////////
+// Files
+////////////////////////////////////////////////////////////////////////////////
+
+_Use_decl_annotations_
+BOOL
+TraceStoreGetFileSize(
+    HANDLE FileHandle,
+    PLARGE_INTEGER EndOfFile
+    )
+{
+    struct stat Stat;
+
+    if (fstat(HandleToFileDescriptor(FileHandle), &Stat) != 0) {
+        return FALSE;
+    }
+
+    EndOfFile->QuadPart = (LONGLONG)Stat.st_size;
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOL
+TraceStoreSetFilePointer(
+    HANDLE FileHandle,
+    LARGE_INTEGER DistanceToMove,
+    PLARGE_INTEGER NewFilePointer,
+    ULONG MoveMethod
+    )
+{
+    int Whence;
+    off_t Offset;
+
+    switch (MoveMethod) {
+        case FILE_BEGIN:
+            Whence = SEEK_SET;
+            break;
+        case FILE_CURRENT:
+            Whence = SEEK_CUR;
+            break;
+        case FILE_END:
+            Whence = SEEK_END;
+            break;
+        default:
+            errno = EINVAL;
+            return FALSE;
+    }
+
+    Offset = lseek(HandleToFileDescriptor(FileHandle),
+                   (off_t)DistanceToMove.QuadPart,
+                   Whence);
+
+    if (Offset == (off_t)-1) {
+        return FALSE;
+    }
+
+    if (NewFilePointer) {
+        NewFilePointer->QuadPart = (LONGLONG)Offset;
+    }
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOL
+TraceStoreSetEndOfFile(
+    HANDLE FileHandle
+    )
+/*++
+
+Routine Description:
+
+    Sets the end of a file to its current file pointer, extending or
+    truncating it as necessary.
+
+--*/
+{
+    int FileDescriptor;
+    off_t Offset;
+
+    FileDescriptor = HandleToFileDescriptor(FileHandle);
+    Offset = lseek(FileDescriptor, 0, SEEK_CUR);
+
+    if (Offset == (off_t)-1) {
+        return FALSE;
+    }
+
+    return (ftruncate(FileDescriptor, Offset) == 0);
+}
+
+_Use_decl_annotations_
+BOOL
+TraceStoreDeallocateFileRange(
+    HANDLE FileHandle,
+    LARGE_INTEGER FileOffset,
+    LARGE_INTEGER Length
+    )
+/*++
+
+Routine Description:
+
+    Deallocates the storage backing a range of a file, such that the range
+    subsequently reads as zeros.  The size of the file is not changed.
+
+--*/
+{
+    int Result;
+    int FileDescriptor;
+
+    FileDescriptor = HandleToFileDescriptor(FileHandle);
+
+    Result = fallocate(FileDescriptor,
+                       FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                       (off_t)FileOffset.QuadPart,
+                       (off_t)Length.QuadPart);
+
+    return (Result == 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Sections and Views
+////////////////////////////////////////////////////////////////////////////////
+
+_Use_decl_annotations_
+HANDLE
+TraceStoreCreateSection(
+    HANDLE FileHandle,
+    ULONG Protection,
+    LARGE_INTEGER MaximumSize,
+    ULONG NumaNode
+    )
+/*++
+
+Routine Description:
+
+    Creates a section for a file.  As with CreateFileMapping(), if the section
+    is writable and the maximum size exceeds the size of the file, the file is
+    extended.  A maximum size of zero indicates the current size of the file.
+
+Return Value:
+
+    A section handle on success, NULL on failure.
+
+--*/
+{
+    int FileDescriptor;
+    struct stat Stat;
+    PTRACE_STORE_SECTION Section;
+
+    (VOID)NumaNode;
+
+    FileDescriptor = HandleToFileDescriptor(FileHandle);
+
+    if (fstat(FileDescriptor, &Stat) != 0) {
+        return NULL;
+    }
+
+    if (MaximumSize.QuadPart == 0) {
+        MaximumSize.QuadPart = (LONGLONG)Stat.st_size;
+    } else if (MaximumSize.QuadPart > (LONGLONG)Stat.st_size) {
+
+        if (Protection != PAGE_READWRITE) {
+            errno = EINVAL;
+            return NULL;
+        }
+
+        if (ftruncate(FileDescriptor, (off_t)MaximumSize.QuadPart) != 0) {
+            return NULL;
+        }
+    }
+
+    Section = (PTRACE_STORE_SECTION)calloc(1, sizeof(*Section));
+
+    if (!Section) {
+        return NULL;
+    }
+
+    Section->FileDescriptor = dup(FileDescriptor);
+
+    if (Section->FileDescriptor == -1) {
+        free(Section);
+        return NULL;
+    }
+
+    Section->Protection = Protection;
+    Section->MaximumSize = MaximumSize.QuadPart;
+
+    return (HANDLE)Section;
+}
+
+_Use_decl_annotations_
+PVOID
+TraceStoreMapView(
+    HANDLE SectionHandle,
+    ULONG DesiredAccess,
+    LARGE_INTEGER FileOffset,
+    SIZE_T Size,
+    PVOID PreferredBaseAddress,
+    ULONG NumaNode
+    )
+/*++
+
+Routine Description:
+
+    Maps a view of a section.  If a preferred base address is supplied and
+    the view can't be mapped there, the routine fails (rather than mapping it
+    elsewhere), matching MapViewOfFileEx(); the caller is expected to retry
+    without a preferred address.  The view's pages are preferentially placed
+    on the given NUMA node, where possible.
+
+Return Value:
+
+    The base address of the view on success, NULL on failure.
+
+--*/
+{
+    int Flags;
+    int Protection;
+    PVOID BaseAddress;
+    ULONGLONG NodeMask;
+    PTRACE_STORE_SECTION Section;
+
+    Section = (PTRACE_STORE_SECTION)SectionHandle;
+
+    if (FileOffset.QuadPart + (LONGLONG)Size > Section->MaximumSize) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (DesiredAccess & FILE_MAP_COPY) {
+        Protection = PROT_READ | PROT_WRITE;
+        Flags = MAP_PRIVATE;
+    } else if (DesiredAccess & FILE_MAP_WRITE) {
+        Protection = PROT_READ | PROT_WRITE;
+        Flags = MAP_SHARED;
+    } else {
+        Protection = PROT_READ;
+        Flags = MAP_SHARED;
+    }
+
+    if (PreferredBaseAddress) {
+        Flags |= MAP_FIXED_NOREPLACE;
+    }
+
+    BaseAddress = mmap(PreferredBaseAddress,
+                       Size,
+                       Protection,
+                       Flags,
+                       Section->FileDescriptor,
+                       (off_t)FileOffset.QuadPart);
+
+    if (BaseAddress == MAP_FAILED) {
+        return NULL;
+    }
+
+    //
+    // Kernels prior to 4.17 ignore MAP_FIXED_NOREPLACE and treat the address
+    // as a hint, so verify we got what we asked for.
+    //
+
+    if (PreferredBaseAddress && BaseAddress != PreferredBaseAddress) {
+        munmap(BaseAddress, Size);
+        errno = EEXIST;
+        return NULL;
+    }
+
+    //
+    // Prefer the requested NUMA node for the view's pages.  This is advisory;
+    // failure (e.g. an invalid node, or no NUMA support) is ignored.
+    //
+
+    if (NumaNode < (sizeof(NodeMask) << 3)) {
+        NodeMask = 1ULL << NumaNode;
+        syscall(SYS_mbind,
+                BaseAddress,
+                Size,
+                MPOL_PREFERRED,
+                &NodeMask,
+                (sizeof(NodeMask) << 3),
+                0);
+    }
+
+    return BaseAddress;
+}
+
+_Use_decl_annotations_
+BOOL
+TraceStoreFlushView(
+    PVOID BaseAddress,
+    SIZE_T Size
+    )
+/*++
+
+Routine Description:
+
+    Initiates write-back of a view's dirty pages.  As with FlushViewOfFile(),
+    this doesn't guarantee the pages have reached the disk.
+
+--*/
+{
+    return (msync(BaseAddress, Size, MS_ASYNC) == 0);
+}
+
+_Use_decl_annotations_
+BOOL
+TraceStoreUnmapView(
+    PVOID BaseAddress,
+    SIZE_T Size
+    )
+{
+    return (munmap(BaseAddress, Size) == 0);
+}
+
+_Use_decl_annotations_
+BOOL
+TraceStoreCloseSection(
+    HANDLE SectionHandle
+    )
+{
+    BOOL Success;
+    PTRACE_STORE_SECTION Section;
+
+    Section = (PTRACE_STORE_SECTION)SectionHandle;
+    Success = (close(Section->FileDescriptor) == 0);
+    free(Section);
+
+    return Success;
+}
+
+_Use_decl_annotations_
+VOID
+TraceStoreAdviseView(
+    PVOID BaseAddress,
+    SIZE_T Size,
+    TRACE_STORE_VIEW_ADVICE Advice
+    )
+{
+    int Flag;
+
+    switch (Advice) {
+        case TraceStoreViewAdviceSequential:
+            Flag = MADV_SEQUENTIAL;
+            break;
+        case TraceStoreViewAdviceWillNeed:
+            Flag = MADV_WILLNEED;
+            break;
+        case TraceStoreViewAdviceDontNeed:
+            Flag = MADV_DONTNEED;
+            break;
+        default:
+            Flag = MADV_NORMAL;
+            break;
+    }
+
+    madvise(BaseAddress, Size, Flag);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Work
+////////////////////////////////////////////////////////////////////////////////
+
+static
+VOID
+EnqueueWork(
+    _In_ PTP_WORK Work
+    )
+{
+    Work->Next = NULL;
+
+    if (WorkPool.Tail) {
+        WorkPool.Tail->Next = Work;
+    } else {
+        WorkPool.Head = Work;
+    }
+
+    WorkPool.Tail = Work;
+}
+
+static
+PTP_WORK
+DequeueWork(
+    VOID
+    )
+{
+    PTP_WORK Work;
+
+    Work = WorkPool.Head;
+    WorkPool.Head = Work->Next;
+
+    if (!WorkPool.Head) {
+        WorkPool.Tail = NULL;
+    }
+
+    return Work;
+}
+
+static
+PVOID
+WorkPoolThreadProc(
+    _In_ PVOID Parameter
+    )
+/*++
+
+Routine Description:
+
+    Runs work item callbacks until the process exits.  A work item with more
+    than one pending callback is requeued before its callback runs, such that
+    other threads can run the remaining callbacks concurrently, as is the
+    case with the Windows threadpool.
+
+--*/
+{
+    PTP_WORK Work;
+
+    (VOID)Parameter;
+
+    pthread_mutex_lock(&WorkPool.Lock);
+
+    while (TRUE) {
+
+        while (!WorkPool.Head) {
+            pthread_cond_wait(&WorkPool.WorkAvailable, &WorkPool.Lock);
+        }
+
+        Work = DequeueWork();
+        Work->NumberOfRunningCallbacks++;
+
+        if (--Work->NumberOfPendingCallbacks != 0) {
+            EnqueueWork(Work);
+            pthread_cond_signal(&WorkPool.WorkAvailable);
+        }
+
+        pthread_mutex_unlock(&WorkPool.Lock);
+
+        Work->Callback(NULL, Work->Context, Work);
+
+        pthread_mutex_lock(&WorkPool.Lock);
+
+        if (--Work->NumberOfRunningCallbacks == 0 &&
+            Work->NumberOfPendingCallbacks == 0) {
+            pthread_cond_broadcast(&Work->CallbacksComplete);
+        }
+    }
+
+    return NULL;
+}
+
+static
+VOID
+StartWorkPool(
+    VOID
+    )
+{
+    long NumberOfProcessors;
+    ULONG Index;
+    ULONG NumberOfThreads;
+    pthread_t Thread;
+
+    NumberOfProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (NumberOfProcessors < 2) {
+        NumberOfThreads = 2;
+    } else if (NumberOfProcessors > MAXIMUM_NUMBER_OF_WORK_POOL_THREADS) {
+        NumberOfThreads = MAXIMUM_NUMBER_OF_WORK_POOL_THREADS;
+    } else {
+        NumberOfThreads = (ULONG)NumberOfProcessors;
+    }
+
+    for (Index = 0; Index < NumberOfThreads; Index++) {
+        if (pthread_create(&Thread, NULL, WorkPoolThreadProc, NULL) != 0) {
+            break;
+        }
+        pthread_detach(Thread);
+    }
+
+    WorkPool.NumberOfThreads = Index;
+}
+
+_Use_decl_annotations_
+PTP_WORK
+TraceStoreCreateWork(
+    PTP_WORK_CALLBACK Callback,
+    PVOID Context,
+    PTP_CALLBACK_ENVIRON CallbackEnv
+    )
+/*++
+
+Routine Description:
+
+    Creates a work item.  The callback environment is ignored; all work items
+    are serviced by a single process-wide pool, started on first use.
+
+Return Value:
+
+    A work item on success, NULL on failure.
+
+--*/
+{
+    PTP_WORK Work;
+
+    (VOID)CallbackEnv;
+
+    pthread_once(&WorkPoolOnce, StartWorkPool);
+
+    if (WorkPool.NumberOfThreads == 0) {
+        errno = EAGAIN;
+        return NULL;
+    }
+
+    Work = (PTP_WORK)calloc(1, sizeof(*Work));
+
+    if (!Work) {
+        return NULL;
+    }
+
+    Work->Callback = Callback;
+    Work->Context = Context;
+
+    if (pthread_cond_init(&Work->CallbacksComplete, NULL) != 0) {
+        free(Work);
+        return NULL;
+    }
+
+    return Work;
+}
+
+_Use_decl_annotations_
+VOID
+TraceStoreSubmitWork(
+    PTP_WORK Work
+    )
+/*++
+
+Routine Description:
+
+    Submits a work item.  Each submission results in exactly one invocation of
+    the work item's callback.
+
+--*/
+{
+    pthread_mutex_lock(&WorkPool.Lock);
+
+    if (Work->NumberOfPendingCallbacks++ == 0) {
+        EnqueueWork(Work);
+    }
+
+    pthread_cond_signal(&WorkPool.WorkAvailable);
+    pthread_mutex_unlock(&WorkPool.Lock);
+}
+
+_Use_decl_annotations_
+VOID
+TraceStoreWaitForWork(
+    PTP_WORK Work
+    )
+/*++
+
+Routine Description:
+
+    Waits for all submitted callbacks of a work item to complete.
+
+--*/
+{
+    pthread_mutex_lock(&WorkPool.Lock);
+
+    while (Work->NumberOfPendingCallbacks || Work->NumberOfRunningCallbacks) {
+        pthread_cond_wait(&Work->CallbacksComplete, &WorkPool.Lock);
+    }
+
+    pthread_mutex_unlock(&WorkPool.Lock);
+}
+
+_Use_decl_annotations_
+VOID
+TraceStoreCloseWork(
+    PTP_WORK Work
+    )
+/*++
+
+Routine Description:
+
+    Releases a work item once any outstanding callbacks have completed.
+
+--*/
+{
+    TraceStoreWaitForWork(Work);
+    pthread_cond_destroy(&Work->CallbacksComplete);
+    free(Work);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Events
+////////////////////////////////////////////////////////////////////////////////
+
+static
+long
+Futex(
+    _In_ volatile int32_t *Address,
+    _In_ int Operation,
+    _In_ int32_t Value,
+    _In_opt_ const struct timespec *Timeout
+    )
+{
+    return syscall(SYS_futex, Address, Operation, Value, Timeout, NULL, 0);
+}
+
+_Use_decl_annotations_
+HANDLE
+TraceStoreCreateEvent(
+    BOOL ManualReset,
+    BOOL InitialState
+    )
+{
+    PTRACE_STORE_EVENT Event;
+
+    Event = (PTRACE_STORE_EVENT)calloc(1, sizeof(*Event));
+
+    if (!Event) {
+        return NULL;
+    }
+
+    Event->State = (InitialState ? 1 : 0);
+    Event->ManualReset = ManualReset;
+
+    return (HANDLE)Event;
+}
+
+_Use_decl_annotations_
+BOOL
+TraceStoreSetEvent(
+    HANDLE EventHandle
+    )
+{
+    PTRACE_STORE_EVENT Event;
+
+    Event = (PTRACE_STORE_EVENT)EventHandle;
+
+    if (__atomic_exchange_n(&Event->State, 1, __ATOMIC_RELEASE) == 0) {
+        Futex(&Event->State,
+              FUTEX_WAKE_PRIVATE,
+              Event->ManualReset ? INT_MAX : 1,
+              NULL);
+    }
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+ULONG
+TraceStoreWaitForEvent(
+    HANDLE EventHandle,
+    ULONG Milliseconds
+    )
+/*++
+
+Routine Description:
+
+    Waits for an event to be signaled, resetting it if it is an auto-reset
+    event.
+
+Return Value:
+
+    WAIT_OBJECT_0 if the event was signaled, WAIT_TIMEOUT if the timeout
+    elapsed first, WAIT_FAILED on error.
+
+--*/
+{
+    int32_t Expected;
+    LONGLONG Remaining;
+    PTRACE_STORE_EVENT Event;
+    struct timespec Now;
+    struct timespec Deadline;
+    struct timespec Timeout;
+
+    Event = (PTRACE_STORE_EVENT)EventHandle;
+
+    if (Milliseconds != INFINITE) {
+        clock_gettime(CLOCK_MONOTONIC, &Deadline);
+        Deadline.tv_sec += Milliseconds / 1000;
+        Deadline.tv_nsec += (long)(Milliseconds % 1000) * 1000000;
+        if (Deadline.tv_nsec >= 1000000000) {
+            Deadline.tv_sec++;
+            Deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    while (TRUE) {
+
+        if (Event->ManualReset) {
+            if (__atomic_load_n(&Event->State, __ATOMIC_ACQUIRE)) {
+                return WAIT_OBJECT_0;
+            }
+        } else {
+            Expected = 1;
+            if (__atomic_compare_exchange_n(&Event->State,
+                                            &Expected,
+                                            0,
+                                            FALSE,
+                                            __ATOMIC_ACQUIRE,
+                                            __ATOMIC_RELAXED)) {
+                return WAIT_OBJECT_0;
+            }
+        }
+
+        if (Milliseconds == INFINITE) {
+            Futex(&Event->State, FUTEX_WAIT_PRIVATE, 0, NULL);
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &Now);
+
+        Remaining = (
+            ((LONGLONG)(Deadline.tv_sec - Now.tv_sec) * 1000000000) +
+            (Deadline.tv_nsec - Now.tv_nsec)
+        );
+
+        if (Remaining <= 0) {
+            return WAIT_TIMEOUT;
+        }
+
+        Timeout.tv_sec = (time_t)(Remaining / 1000000000);
+        Timeout.tv_nsec = (long)(Remaining % 1000000000);
+
+        if (Futex(&Event->State, FUTEX_WAIT_PRIVATE, 0, &Timeout) != 0 &&
+            errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+            return WAIT_FAILED;
+        }
+    }
+}
+
+_Use_decl_annotations_
+BOOL
+TraceStoreCloseEvent(
+    HANDLE EventHandle
+    )
+{
+    free(EventHandle);
+    return TRUE;
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
@@ -852,7 +852,7 @@ ReturnFreeTraceStoreMemoryMap(
 
 DecrementActiveMaps:
     if (!InterlockedDecrement(&TraceStore->NumberOfActiveMemoryMaps)) {
-        SetEvent(TraceStore->AllMemoryMapsAreFreeEvent);
+        TraceStoreSetEvent(TraceStore->AllMemoryMapsAreFreeEvent);
     }
 }
 
@@ -1370,6 +1370,462 @@ RecordTraceStoreAllocationTimestamp(
     return TRUE;
 }
 
+//
+// Per-thread allocation chunk functions.
+//
+
+typedef
+_Success_(return != 0)
+BOOL
+(CREATE_TRACE_STORE_ALLOCATION_CHUNKS)(
+    _In_ PTRACE_STORE TraceStore,
+    _In_ ULONG ChunkSize
+    );
+typedef CREATE_TRACE_STORE_ALLOCATION_CHUNKS
+      *PCREATE_TRACE_STORE_ALLOCATION_CHUNKS;
+CREATE_TRACE_STORE_ALLOCATION_CHUNKS CreateTraceStoreAllocationChunks;
+
+typedef
+VOID
+(DESTROY_TRACE_STORE_ALLOCATION_CHUNKS)(
+    _In_ PTRACE_STORE TraceStore
+    );
+typedef DESTROY_TRACE_STORE_ALLOCATION_CHUNKS
+      *PDESTROY_TRACE_STORE_ALLOCATION_CHUNKS;
+DESTROY_TRACE_STORE_ALLOCATION_CHUNKS DestroyTraceStoreAllocationChunks;
+
+typedef
+_Requires_lock_held_(TraceStore->Sync->AllocationCriticalSection)
+VOID
+(UPDATE_TRACE_STORE_ALLOCATION_CHUNKS_GENERATION)(
+    _In_ PTRACE_STORE TraceStore,
+    _In_ PTRACE_STORE_ALLOCATION_CHUNKS Chunks
+    );
+typedef UPDATE_TRACE_STORE_ALLOCATION_CHUNKS_GENERATION
+      *PUPDATE_TRACE_STORE_ALLOCATION_CHUNKS_GENERATION;
+UPDATE_TRACE_STORE_ALLOCATION_CHUNKS_GENERATION
+    UpdateTraceStoreAllocationChunksGeneration;
+
+typedef
+_Success_(return != 0)
+_Requires_lock_held_(TraceStore->Sync->AllocationCriticalSection)
+BOOL
+(RESERVE_TRACE_STORE_ALLOCATION_CHUNK)(
+    _In_ PTRACE_CONTEXT TraceContext,
+    _In_ PTRACE_STORE TraceStore,
+    _In_ PTRACE_STORE_ALLOCATION_CHUNKS Chunks,
+    _In_ PTRACE_STORE_ALLOCATION_CHUNK Chunk,
+    _In_ ULONG_PTR RecordSize
+    );
+typedef RESERVE_TRACE_STORE_ALLOCATION_CHUNK
+      *PRESERVE_TRACE_STORE_ALLOCATION_CHUNK;
+RESERVE_TRACE_STORE_ALLOCATION_CHUNK ReserveTraceStoreAllocationChunk;
+
+typedef
+_Requires_lock_held_(TraceStore->Sync->AllocationCriticalSection)
+VOID
+(RETIRE_TRACE_STORE_ALLOCATION_CHUNK)(
+    _In_ PTRACE_STORE TraceStore,
+    _In_ PTRACE_STORE_ALLOCATION_CHUNKS Chunks,
+    _In_ PTRACE_STORE_ALLOCATION_CHUNK Chunk
+    );
+typedef RETIRE_TRACE_STORE_ALLOCATION_CHUNK
+      *PRETIRE_TRACE_STORE_ALLOCATION_CHUNK;
+RETIRE_TRACE_STORE_ALLOCATION_CHUNK RetireTraceStoreAllocationChunk;
+
+typedef
+VOID
+(RETIRE_TRACE_STORE_ALLOCATION_CHUNKS)(
+    _In_ PTRACE_STORE TraceStore,
+    _In_ BOOL Wait
+    );
+typedef RETIRE_TRACE_STORE_ALLOCATION_CHUNKS
+      *PRETIRE_TRACE_STORE_ALLOCATION_CHUNKS;
+RETIRE_TRACE_STORE_ALLOCATION_CHUNKS RetireTraceStoreAllocationChunks;
+
+typedef
+_Check_return_
+_Requires_lock_held_(TraceStore->Sync->AllocationCriticalSection)
+PVOID
+(LOCKED_TRACE_STORE_ALLOCATE_RECORDS_WITH_TIMESTAMP)(
+    _In_     PTRACE_CONTEXT  TraceContext,
+    _In_     PTRACE_STORE    TraceStore,
+    _In_opt_ PTRACE_STORE_ALLOCATION_CHUNK Chunk,
+    _In_     ULONG_PTR       NumberOfRecords,
+    _In_     ULONG_PTR       RecordSize,
+    _In_opt_ PLARGE_INTEGER  TimestampPointer
+    );
+typedef LOCKED_TRACE_STORE_ALLOCATE_RECORDS_WITH_TIMESTAMP
+      *PLOCKED_TRACE_STORE_ALLOCATE_RECORDS_WITH_TIMESTAMP;
+LOCKED_TRACE_STORE_ALLOCATE_RECORDS_WITH_TIMESTAMP
+    LockedTraceStoreAllocateRecordsWithTimestamp;
+
+FORCEINLINE
+PTRACE_STORE_ALLOCATION_CHUNK
+GetTraceStoreAllocationChunk(
+    _In_ PTRACE_STORE_ALLOCATION_CHUNKS Chunks
+    )
+/*++
+
+Routine Description:
+
+    This routine returns the calling thread's allocation chunk, claiming a
+    free slot for the thread if it doesn't own one yet.  Slots are indexed by
+    thread ID and probed linearly.  Slots are never released; if a thread
+    exits, the next thread that is assigned the same thread ID will inherit
+    the slot.
+
+Arguments:
+
+    Chunks - Supplies a pointer to the trace store's allocation chunks.
+
+Return Value:
+
+    A pointer to the calling thread's chunk, or NULL if all slots are owned
+    by other threads.
+
+--*/
+{
+    ULONG Index;
+    ULONG Count;
+    ULONG Owner;
+    ULONG ThreadId;
+    PTRACE_STORE_ALLOCATION_CHUNK Chunk;
+
+    ThreadId = GetCurrentThreadId();
+    Index = (ThreadId >> 2) % MAX_TRACE_STORE_ALLOCATION_CHUNKS;
+
+    for (Count = 0; Count < MAX_TRACE_STORE_ALLOCATION_CHUNKS; Count++) {
+
+        Chunk = &Chunks->Chunks[Index];
+        Owner = Chunk->OwningThreadId;
+
+        if (Owner == ThreadId) {
+            return Chunk;
+        }
+
+        if (Owner == 0) {
+            Owner = (ULONG)(
+                InterlockedCompareExchange(
+                    (volatile LONG *)&Chunk->OwningThreadId,
+                    (LONG)ThreadId,
+                    0
+                )
+            );
+            if (Owner == 0) {
+                return Chunk;
+            }
+        }
+
+        if (++Index == MAX_TRACE_STORE_ALLOCATION_CHUNKS) {
+            Index = 0;
+        }
+    }
+
+    return NULL;
+}
+
+FORCEINLINE
+_Check_return_
+PVOID
+AllocateRecordsFromTraceStoreAllocationChunk(
+    _In_     PTRACE_STORE_ALLOCATION_CHUNKS Chunks,
+    _In_     PTRACE_STORE_ALLOCATION_CHUNK Chunk,
+    _In_     ULONG_PTR NumberOfRecords,
+    _In_     ULONG_PTR RecordSize,
+    _In_opt_ PLARGE_INTEGER TimestampPointer
+    )
+/*++
+
+Routine Description:
+
+    This routine attempts to satisfy an allocation from the calling thread's
+    allocation chunk.  No synchronization is performed; the chunk must be
+    owned by the calling thread.  If the chunk was reserved for a different
+    record size, belongs to a previous generation, or has insufficient space
+    remaining, NULL is returned and the caller should fall back to the
+    locked allocation path.
+
+    If allocation timestamps are being captured, the timestamp is written to
+    the chunk's :AllocationTimestamp slot for each record allocated.
+
+Arguments:
+
+    Chunks - Supplies a pointer to the trace store's allocation chunks.
+
+    Chunk - Supplies a pointer to the calling thread's chunk.
+
+    NumberOfRecords - Supplies the number of records to allocate.
+
+    RecordSize - Supplies the size of the record to allocate.
+
+    TimestampPointer - Optionally supplies a pointer to a timestamp to use for
+        the allocation.  If NULL, the performance counter is queried.
+
+Return Value:
+
+    The address of the allocated records, or NULL if the chunk couldn't
+    satisfy the request.
+
+--*/
+{
+    ULONG_PTR Index;
+    PCHAR Address;
+    PCHAR NextAddress;
+    LARGE_INTEGER Timestamp;
+
+    if (Chunk->RecordSize != RecordSize ||
+        Chunk->Generation != Chunks->Generation ||
+        NumberOfRecords > Chunks->ChunkSize) {
+        return NULL;
+    }
+
+    Address = Chunk->NextAddress;
+    NextAddress = Address + (NumberOfRecords * RecordSize);
+
+    if (NextAddress > Chunk->EndAddress) {
+        return NULL;
+    }
+
+    if (Chunk->NextTimestamp) {
+
+        if (ARGUMENT_PRESENT(TimestampPointer)) {
+            Timestamp.QuadPart = TimestampPointer->QuadPart;
+        } else {
+            QueryPerformanceCounter(&Timestamp);
+        }
+
+        TRY_MAPPED_MEMORY_OP {
+            for (Index = 0; Index < NumberOfRecords; Index++) {
+                Chunk->NextTimestamp[Index].QuadPart = Timestamp.QuadPart;
+            }
+        } CATCH_STATUS_IN_PAGE_ERROR {
+            return NULL;
+        }
+
+        Chunk->NextTimestamp += NumberOfRecords;
+    }
+
+    Chunk->NextAddress = NextAddress;
+
+    return Address;
+}
+
+//
+// TraceStoreShards-related functions.
+//
+
+typedef
+_Success_(return != 0)
+BOOL
+(CREATE_TRACE_STORE_SHARDS)(
+    _In_ PTRACE_STORE TraceStore,
+    _In_ PCWSTR Path
+    );
+typedef CREATE_TRACE_STORE_SHARDS *PCREATE_TRACE_STORE_SHARDS;
+CREATE_TRACE_STORE_SHARDS CreateTraceStoreShards;
+
+typedef
+_Success_(return != 0)
+BOOL
+(CREATE_TRACE_STORE_SHARD)(
+    _In_ PTRACE_CONTEXT TraceContext,
+    _In_ PTRACE_STORE TraceStore,
+    _In_ PTRACE_STORE_SHARD Shard
+    );
+typedef CREATE_TRACE_STORE_SHARD *PCREATE_TRACE_STORE_SHARD;
+CREATE_TRACE_STORE_SHARD CreateTraceStoreShard;
+
+typedef
+_Success_(return != 0)
+BOOL
+(GET_TRACE_STORE_SHARD_PATH)(
+    _In_ PTRACE_STORE_SHARDS Shards,
+    _In_ USHORT ShardIndex,
+    _In_opt_ PCWSTR Suffix,
+    _Out_writes_(_OUR_MAX_PATH) PWSTR Path
+    );
+typedef GET_TRACE_STORE_SHARD_PATH *PGET_TRACE_STORE_SHARD_PATH;
+GET_TRACE_STORE_SHARD_PATH GetTraceStoreShardPath;
+
+typedef
+VOID
+(CLOSE_TRACE_STORE_SHARDS)(
+    _In_ PTRACE_STORE TraceStore
+    );
+typedef CLOSE_TRACE_STORE_SHARDS *PCLOSE_TRACE_STORE_SHARDS;
+CLOSE_TRACE_STORE_SHARDS CloseTraceStoreShards;
+
+typedef
+VOID
+(RUNDOWN_TRACE_STORE_SHARDS)(
+    _In_ PTRACE_STORE TraceStore
+    );
+typedef RUNDOWN_TRACE_STORE_SHARDS *PRUNDOWN_TRACE_STORE_SHARDS;
+RUNDOWN_TRACE_STORE_SHARDS RundownTraceStoreShards;
+
+ALLOCATE_RECORDS_WITH_TIMESTAMP ShardedTraceStoreAllocateRecordsWithTimestamp;
+
+FORCEINLINE
+PTRACE_STORE_SHARD
+GetTraceStoreShard(
+    _In_ PTRACE_STORE_SHARDS Shards
+    )
+/*++
+
+Routine Description:
+
+    This routine returns the calling thread's shard slot, claiming a free slot
+    for the thread if it doesn't own one yet.  Slots are indexed by thread ID
+    and probed linearly, as with GetTraceStoreAllocationChunk().  Slots are
+    never released; if a thread exits, the next thread that is assigned the
+    same thread ID will inherit the slot (and thus the shard).
+
+Arguments:
+
+    Shards - Supplies a pointer to the trace store's shards.
+
+Return Value:
+
+    A pointer to the calling thread's shard slot, or NULL if all slots are
+    owned by other threads.
+
+--*/
+{
+    ULONG Index;
+    ULONG Count;
+    ULONG Owner;
+    ULONG ThreadId;
+    PTRACE_STORE_SHARD Shard;
+
+    ThreadId = GetCurrentThreadId();
+    Index = (ThreadId >> 2) % MAX_TRACE_STORE_SHARDS;
+
+    for (Count = 0; Count < MAX_TRACE_STORE_SHARDS; Count++) {
+
+        Shard = &Shards->Shards[Index];
+        Owner = Shard->OwningThreadId;
+
+        if (Owner == ThreadId) {
+            return Shard;
+        }
+
+        if (Owner == 0) {
+            Owner = (ULONG)(
+                InterlockedCompareExchange(
+                    (volatile LONG *)&Shard->OwningThreadId,
+                    (LONG)ThreadId,
+                    0
+                )
+            );
+            if (Owner == 0) {
+                return Shard;
+            }
+        }
+
+        if (++Index == MAX_TRACE_STORE_SHARDS) {
+            Index = 0;
+        }
+    }
+
+    return NULL;
+}
+
+//
+// TraceStoreCompression-related functions.
+//
+
+typedef
+_Success_(return != 0)
+ULONG
+(COMPRESS_TRACE_STORE_BLOCK)(
+    _In_reads_bytes_(SourceSize) PCBYTE Source,
+    _In_ ULONG SourceSize,
+    _Out_writes_bytes_to_(DestSize, return) PBYTE Dest,
+    _In_ ULONG DestSize
+    );
+typedef COMPRESS_TRACE_STORE_BLOCK *PCOMPRESS_TRACE_STORE_BLOCK;
+COMPRESS_TRACE_STORE_BLOCK CompressTraceStoreBlock;
+
+typedef
+_Success_(return != 0)
+BOOL
+(DECOMPRESS_TRACE_STORE_BLOCK)(
+    _In_reads_bytes_(SourceSize) PCBYTE Source,
+    _In_ ULONG SourceSize,
+    _Out_writes_bytes_all_(DestSize) PBYTE Dest,
+    _In_ ULONG DestSize
+    );
+typedef DECOMPRESS_TRACE_STORE_BLOCK *PDECOMPRESS_TRACE_STORE_BLOCK;
+DECOMPRESS_TRACE_STORE_BLOCK DecompressTraceStoreBlock;
+
+typedef
+_Success_(return != 0)
+BOOL
+(CREATE_TRACE_STORE_BLOCK_COMPRESSION)(
+    _In_ PTRACE_STORE TraceStore,
+    _In_ PCWSTR Path
+    );
+typedef CREATE_TRACE_STORE_BLOCK_COMPRESSION
+      *PCREATE_TRACE_STORE_BLOCK_COMPRESSION;
+CREATE_TRACE_STORE_BLOCK_COMPRESSION CreateTraceStoreBlockCompression;
+
+typedef
+VOID
+(CLOSE_TRACE_STORE_BLOCK_COMPRESSION)(
+    _In_ PTRACE_STORE TraceStore
+    );
+typedef CLOSE_TRACE_STORE_BLOCK_COMPRESSION
+      *PCLOSE_TRACE_STORE_BLOCK_COMPRESSION;
+CLOSE_TRACE_STORE_BLOCK_COMPRESSION CloseTraceStoreBlockCompression;
+
+typedef
+_Success_(return != 0)
+BOOL
+(LOAD_TRACE_STORE_BLOCK_INDEX)(
+    _In_ PTRACE_STORE TraceStore
+    );
+typedef LOAD_TRACE_STORE_BLOCK_INDEX *PLOAD_TRACE_STORE_BLOCK_INDEX;
+LOAD_TRACE_STORE_BLOCK_INDEX LoadTraceStoreBlockIndex;
+
+typedef
+_Success_(return != 0)
+BOOL
+(COMPRESS_TRACE_STORE_MEMORY_MAP)(
+    _In_ PTRACE_STORE TraceStore,
+    _In_ PTRACE_STORE_MEMORY_MAP MemoryMap,
+    _Out_ PLARGE_INTEGER CompressedLength
+    );
+typedef COMPRESS_TRACE_STORE_MEMORY_MAP *PCOMPRESS_TRACE_STORE_MEMORY_MAP;
+COMPRESS_TRACE_STORE_MEMORY_MAP CompressTraceStoreMemoryMap;
+
+typedef
+VOID
+(DEALLOCATE_COMPRESSED_TRACE_STORE_RANGE)(
+    _In_ PTRACE_STORE TraceStore,
+    _In_ LARGE_INTEGER FileOffset,
+    _In_ LARGE_INTEGER Length
+    );
+typedef DEALLOCATE_COMPRESSED_TRACE_STORE_RANGE
+      *PDEALLOCATE_COMPRESSED_TRACE_STORE_RANGE;
+DEALLOCATE_COMPRESSED_TRACE_STORE_RANGE DeallocateCompressedTraceStoreRange;
+
+typedef
+_Success_(return != 0)
+BOOL
+(DECOMPRESS_TRACE_STORE_BLOCKS)(
+    _In_ PTRACE_STORE TraceStore,
+    _In_ PVOID BaseAddress,
+    _In_ LARGE_INTEGER FileOffset,
+    _In_ LARGE_INTEGER Size
+    );
+typedef DECOMPRESS_TRACE_STORE_BLOCKS *PDECOMPRESS_TRACE_STORE_BLOCKS;
+DECOMPRESS_TRACE_STORE_BLOCKS DecompressTraceStoreBlocks;
+
+#define TraceStoreHasBlocks(TraceStore)                   \
+    ((TraceStore)->BlockCompression &&                    \
+     (TraceStore)->BlockCompression->NumberOfIndexEntries)
+
 FORCEINLINE
 VOID
 SuspendTraceStoreAllocations(
@@ -0,0 +1,1215 @@
+/*++
+
+Copyright (c) 2016 Trent Nelson <trent@trent.me>
+
+Module Name:
+
+    TraceStoreShards.c
+
+Abstract:
+
+    This module implements per-thread trace store shards.  A trace store with
+    the PerThreadShards trait is a logical store made up of one physical trace
+    store per allocating thread, each backed by its own file and metadata
+    streams.  Because a shard is only ever allocated from by its owning
+    thread, allocations require no synchronization.
+
+    On the readonly side, a shard reader opens the data file and the
+    :AllocationTimestamp stream of every shard and performs a k-way merge
+    over them, yielding each allocation of the logical store in timestamp
+    order.
+
+--*/
+
+#include "stdafx.h"
+
+_Use_decl_annotations_
+BOOL
+CreateTraceStoreShards(
+    PTRACE_STORE TraceStore,
+    PCWSTR Path
+    )
+/*++
+
+Routine Description:
+
+    This routine creates the TRACE_STORE_SHARDS structure for a trace store
+    with the PerThreadShards trait.  It is called by InitializeTraceStores()
+    once the logical trace store has been initialized, for both tracing and
+    readonly sessions.  Shards themselves are created on demand.
+
+    Trace stores that are the target of field relocations can't be sharded,
+    as a relocated address could refer to any of the shards.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to a TRACE_STORE structure.
+
+    Path - Supplies a pointer to a NULL-terminated wide character array of the
+        fully-qualified trace store path.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    HRESULT Result;
+    PTRACE_STORE_SHARDS Shards;
+
+    if (TraceStore->IsRelocationTarget) {
+        return FALSE;
+    }
+
+    Shards = (PTRACE_STORE_SHARDS)(
+        VirtualAlloc(NULL,
+                     sizeof(*Shards),
+                     MEM_COMMIT | MEM_RESERVE,
+                     PAGE_READWRITE)
+    );
+
+    if (!Shards) {
+        TraceStore->LastError = GetLastError();
+        return FALSE;
+    }
+
+    Shards->SizeOfStruct = sizeof(*Shards);
+    Shards->NumberOfSlots = MAX_TRACE_STORE_SHARDS;
+
+    Result = StringCchCopyW(&Shards->Path[0], _OUR_MAX_PATH, Path);
+    if (FAILED(Result)) {
+        VirtualFree(Shards, 0, MEM_RELEASE);
+        return FALSE;
+    }
+
+    TraceStore->Shards = Shards;
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+BOOL
+GetTraceStoreShardPath(
+    PTRACE_STORE_SHARDS Shards,
+    USHORT ShardIndex,
+    PCWSTR Suffix,
+    PWSTR Path
+    )
+/*++
+
+Routine Description:
+
+    This routine constructs the path of a shard's data file, or one of its
+    metadata streams.  The shard index is inserted before the extension of
+    the logical trace store's file name; e.g. shard 3 of "TraceEvent.dat" is
+    "TraceEvent.Shard3.dat".
+
+Arguments:
+
+    Shards - Supplies a pointer to the trace store's shards.
+
+    ShardIndex - Supplies the index of the shard.
+
+    Suffix - Optionally supplies a metadata store suffix (e.g. ":Allocation")
+        to append to the path.
+
+    Path - Supplies a pointer to a buffer of _OUR_MAX_PATH characters that
+        receives the NULL-terminated path.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    HRESULT Result;
+    PCWSTR Dot;
+    PCWSTR Slash;
+    PCWSTR Extension;
+    LONG_PTR StemLength;
+
+    Dot = wcsrchr(Shards->Path, L'.');
+    Slash = wcsrchr(Shards->Path, L'\\');
+
+    if (!Dot || (Slash && Dot < Slash)) {
+        Extension = L"";
+        StemLength = (LONG_PTR)wcslen(Shards->Path);
+    } else {
+        Extension = Dot;
+        StemLength = (LONG_PTR)(Dot - Shards->Path);
+    }
+
+    Result = StringCchPrintfW(Path,
+                              _OUR_MAX_PATH,
+                              L"%.*s.Shard%hu%s%s",
+                              (int)StemLength,
+                              Shards->Path,
+                              ShardIndex,
+                              Extension,
+                              Suffix ? Suffix : L"");
+
+    return SUCCEEDED(Result);
+}
+
+_Use_decl_annotations_
+BOOL
+CreateTraceStoreShard(
+    PTRACE_CONTEXT TraceContext,
+    PTRACE_STORE TraceStore,
+    PTRACE_STORE_SHARD Shard
+    )
+/*++
+
+Routine Description:
+
+    This routine creates and binds a shard for the calling thread.  The
+    shard's trace store and metadata stores are allocated as a single block,
+    initialized from the logical trace store via InitializeTraceStore(), then
+    bound synchronously in the same order the threadpool bind callbacks use:
+    :MetadataInfo first, then the remaining metadata stores, then the trace
+    store itself.  Binding the trace store resumes its allocations.
+
+Arguments:
+
+    TraceContext - Supplies a pointer to the TRACE_CONTEXT structure to which
+        the logical trace store is bound.
+
+    TraceStore - Supplies a pointer to the logical TRACE_STORE structure.
+
+    Shard - Supplies a pointer to the calling thread's shard slot.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    BOOL Success;
+    BOOL Initialized = FALSE;
+    LONG ShardIndex;
+    USHORT Index;
+    SIZE_T AllocationSize;
+    HANDLE ResumeAllocationsEvent = NULL;
+    HANDLE BindCompleteEvent = NULL;
+    HANDLE IntervalsLoadedEvent = NULL;
+    PTRACE_STORE Stores;
+    PTRACE_STORE ShardStore;
+    PTRACE_STORE_RELOC Reloc;
+    PTRACE_STORE_SHARDS Shards;
+    TRACE_STORE_TRAITS Traits;
+    TRACE_STORE_RELOC EmptyReloc;
+    WCHAR Path[_OUR_MAX_PATH];
+
+    Shards = TraceStore->Shards;
+    Traits = *TraceStore->pTraits;
+
+    ShardIndex = InterlockedIncrement(&Shards->NumberOfShards) - 1;
+    if (ShardIndex >= MAX_TRACE_STORE_SHARDS) {
+        return FALSE;
+    }
+
+    Shard->ShardIndex = (USHORT)ShardIndex;
+
+    if (!GetTraceStoreShardPath(Shards, Shard->ShardIndex, NULL, Path)) {
+        return FALSE;
+    }
+
+    AllocationSize = sizeof(TRACE_STORE) * (1 + NumberOfMetadataStores);
+
+    Stores = (PTRACE_STORE)(
+        VirtualAlloc(NULL,
+                     AllocationSize,
+                     MEM_COMMIT | MEM_RESERVE,
+                     PAGE_READWRITE)
+    );
+
+    if (!Stores) {
+        TraceStore->LastError = GetLastError();
+        return FALSE;
+    }
+
+    ResumeAllocationsEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    BindCompleteEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    IntervalsLoadedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    if (!ResumeAllocationsEvent ||
+        !BindCompleteEvent ||
+        !IntervalsLoadedEvent) {
+        goto Error;
+    }
+
+    //
+    // Mirror the per-store initialization performed by InitializeTraceStores()
+    // and InitializeTraceContext() for the logical trace store.
+    //
+
+    ShardStore = Stores;
+    ShardStore->TraceStore = ShardStore;
+    ShardStore->IsReadonly = FALSE;
+    ShardStore->SequenceId = TraceStore->SequenceId;
+    ShardStore->TraceStoreId = TraceStore->TraceStoreId;
+    ShardStore->TraceStoreIndex = TraceStore->TraceStoreIndex;
+    ShardStore->CreateFileDesiredAccess = TraceStore->CreateFileDesiredAccess;
+    ShardStore->CreateFileCreationDisposition = (
+        TraceStore->CreateFileCreationDisposition
+    );
+    ShardStore->CreateFileMappingProtectionFlags = (
+        TraceStore->CreateFileMappingProtectionFlags
+    );
+    ShardStore->CreateFileFlagsAndAttributes = (
+        TraceStore->CreateFileFlagsAndAttributes
+    );
+    ShardStore->MapViewOfFileDesiredAccess = (
+        TraceStore->MapViewOfFileDesiredAccess
+    );
+    ShardStore->pAllocator = TraceStore->pAllocator;
+    ShardStore->BindComplete = TraceStoreBindComplete;
+    ShardStore->TracerConfig = TraceStore->TracerConfig;
+    ShardStore->IntervalFramesPerSecond = TraceStore->IntervalFramesPerSecond;
+    ShardStore->NoAllocationTimestamps = TraceStore->NoAllocationTimestamps;
+    ShardStore->NumaNode = TraceStore->NumaNode;
+
+    InitializeListHead(&ShardStore->MetadataListHead);
+    InitializeListHead(&ShardStore->StoresListEntry);
+
+    if (TraceStore->HasRelocations) {
+        Reloc = TraceStore->pReloc;
+    } else {
+        SecureZeroMemory(&EmptyReloc, sizeof(EmptyReloc));
+        Reloc = &EmptyReloc;
+    }
+
+    Success = InitializeTraceStore(TraceStore->Rtl,
+                                   Path,
+                                   ShardStore,
+                                   &Stores[1],
+                                   &Stores[2],
+                                   &Stores[3],
+                                   &Stores[4],
+                                   &Stores[5],
+                                   &Stores[6],
+                                   &Stores[7],
+                                   &Stores[8],
+                                   &Stores[9],
+                                   TraceStore->InitialSize,
+                                   TraceStore->MappingSize,
+                                   &TraceStore->TraceFlags,
+                                   Reloc,
+                                   TraceStore->pTraits);
+
+    if (!Success) {
+        goto Error;
+    }
+
+    Initialized = TRUE;
+
+    ShardStore->TraceContext = TraceContext;
+    ShardStore->ResumeAllocationsEvent = ResumeAllocationsEvent;
+    ShardStore->BindCompleteEvent = BindCompleteEvent;
+    ShardStore->Intervals.LoadingCompleteEvent = IntervalsLoadedEvent;
+
+    ShardStore->AllocateRecords = TraceStoreAllocateRecords;
+    ShardStore->AllocateRecordsWithTimestamp = (
+        SuspendedTraceStoreAllocateRecordsWithTimestamp
+    );
+    ShardStore->SuspendedAllocateRecordsWithTimestamp = (
+        SuspendedTraceStoreAllocateRecordsWithTimestamp
+    );
+
+    if (WantsPageAlignment(Traits)) {
+        ShardStore->AllocateRecordsWithTimestampImpl1 = (
+            TraceStoreAllocatePageAlignedRecordsWithTimestampImpl
+        );
+    } else {
+        ShardStore->AllocateRecordsWithTimestampImpl1 = (
+            TraceStoreAllocateRecordsWithTimestampImpl
+        );
+    }
+
+    //
+    // Bind :MetadataInfo, then the remaining metadata stores, then the shard.
+    //
+
+    for (Index = 1; Index <= NumberOfMetadataStores; Index++) {
+        if (!BindStore(TraceContext, &Stores[Index])) {
+            goto Error;
+        }
+    }
+
+    if (!BindStore(TraceContext, ShardStore)) {
+        goto Error;
+    }
+
+    InterlockedExchangePointer((volatile PVOID *)&Shard->TraceStore,
+                               ShardStore);
+
+    return TRUE;
+
+Error:
+
+    //
+    // InitializeTraceStore() closes the store itself if it fails, so we only
+    // need to close it if it was initialized successfully.
+    //
+
+    if (Initialized) {
+        CloseTraceStore(Stores);
+    }
+
+    if (ResumeAllocationsEvent) {
+        CloseHandle(ResumeAllocationsEvent);
+    }
+
+    if (BindCompleteEvent) {
+        CloseHandle(BindCompleteEvent);
+    }
+
+    if (IntervalsLoadedEvent) {
+        CloseHandle(IntervalsLoadedEvent);
+    }
+
+    VirtualFree(Stores, 0, MEM_RELEASE);
+
+    return FALSE;
+}
+
+_Use_decl_annotations_
+PVOID
+ShardedTraceStoreAllocateRecordsWithTimestamp(
+    PTRACE_CONTEXT  TraceContext,
+    PTRACE_STORE    TraceStore,
+    ULONG_PTR       NumberOfRecords,
+    ULONG_PTR       RecordSize,
+    PLARGE_INTEGER  TimestampPointer
+    )
+/*++
+
+Routine Description:
+
+    This routine is the allocator for trace stores with the PerThreadShards
+    trait.  It forwards the allocation to the calling thread's shard, creating
+    the shard first if this is the thread's first allocation.  No
+    synchronization is required as the shard is only ever allocated from by
+    the calling thread.
+
+Arguments:
+
+    TraceContext - Supplies a pointer to a TRACE_CONTEXT structure.
+
+    TraceStore - Supplies a pointer to the logical TRACE_STORE structure that
+        the memory is to be allocated from.
+
+    NumberOfRecords - Supplies the number of records to allocate.
+
+    RecordSize - Supplies the size of the record to allocate.
+
+    TimestampPointer - Optionally supplies a pointer to a timestamp value to
+        associate with the allocation.
+
+Return Value:
+
+    A pointer to the base memory address satisfying the total requested size
+    if the memory could be obtained successfully, NULL otherwise.
+
+--*/
+{
+    PTRACE_STORE ShardStore;
+    PTRACE_STORE_SHARD Shard;
+
+    Shard = GetTraceStoreShard(TraceStore->Shards);
+    if (!Shard || Shard->Failed) {
+        return NULL;
+    }
+
+    ShardStore = Shard->TraceStore;
+
+    if (!ShardStore) {
+        if (!CreateTraceStoreShard(TraceContext, TraceStore, Shard)) {
+            Shard->Failed = TRUE;
+            return NULL;
+        }
+        ShardStore = Shard->TraceStore;
+    }
+
+    return ShardStore->AllocateRecordsWithTimestamp(TraceContext,
+                                                    ShardStore,
+                                                    NumberOfRecords,
+                                                    RecordSize,
+                                                    TimestampPointer);
+}
+
+_Use_decl_annotations_
+VOID
+CloseTraceStoreShards(
+    PTRACE_STORE TraceStore
+    )
+/*++
+
+Routine Description:
+
+    This routine closes all shards of a trace store, then frees the trace
+    store's TRACE_STORE_SHARDS structure.  It is called by CloseTraceStore()
+    before the logical trace store is closed.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to the logical TRACE_STORE structure.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ULONG Index;
+    PTRACE_STORE ShardStore;
+    PTRACE_STORE_SHARD Shard;
+    PTRACE_STORE_SHARDS Shards;
+
+    Shards = TraceStore->Shards;
+    if (!Shards) {
+        return;
+    }
+
+    TraceStore->Shards = NULL;
+
+    for (Index = 0; Index < Shards->NumberOfSlots; Index++) {
+        Shard = &Shards->Shards[Index];
+        ShardStore = Shard->TraceStore;
+        if (!ShardStore) {
+            continue;
+        }
+
+        CloseTraceStore(ShardStore);
+
+        CloseHandle(ShardStore->ResumeAllocationsEvent);
+        CloseHandle(ShardStore->BindCompleteEvent);
+        CloseHandle(ShardStore->Intervals.LoadingCompleteEvent);
+
+        Shard->TraceStore = NULL;
+        VirtualFree(ShardStore, 0, MEM_RELEASE);
+    }
+
+    VirtualFree(Shards, 0, MEM_RELEASE);
+}
+
+_Use_decl_annotations_
+VOID
+RundownTraceStoreShards(
+    PTRACE_STORE TraceStore
+    )
+/*++
+
+Routine Description:
+
+    This routine runs down all shards of a trace store.  It is called by
+    RundownTraceStore() before the logical trace store is run down.  No memory
+    is freed.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to the logical TRACE_STORE structure.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ULONG Index;
+    PTRACE_STORE ShardStore;
+    PTRACE_STORE_SHARDS Shards;
+
+    Shards = TraceStore->Shards;
+    if (!Shards) {
+        return;
+    }
+
+    for (Index = 0; Index < Shards->NumberOfSlots; Index++) {
+        ShardStore = Shards->Shards[Index].TraceStore;
+        if (ShardStore) {
+            RundownTraceStore(ShardStore);
+        }
+    }
+}
+
+//
+// Readonly shard reader.
+//
+
+FORCEINLINE
+BOOL
+IsTraceStoreShardCursorLess(
+    _In_ PTRACE_STORE_SHARD_READER Reader,
+    _In_ ULONG Left,
+    _In_ ULONG Right
+    )
+{
+    PTRACE_STORE_SHARD_CURSOR LeftCursor;
+    PTRACE_STORE_SHARD_CURSOR RightCursor;
+
+    LeftCursor = &Reader->Cursors[Reader->Heap[Left]];
+    RightCursor = &Reader->Cursors[Reader->Heap[Right]];
+
+    if (LeftCursor->Timestamp.QuadPart != RightCursor->Timestamp.QuadPart) {
+        return LeftCursor->Timestamp.QuadPart < RightCursor->Timestamp.QuadPart;
+    }
+
+    //
+    // Break ties on shard index such that the merge is deterministic.
+    //
+
+    return LeftCursor->ShardIndex < RightCursor->ShardIndex;
+}
+
+FORCEINLINE
+VOID
+SiftDownTraceStoreShardReaderHeap(
+    _In_ PTRACE_STORE_SHARD_READER Reader,
+    _In_ ULONG Index
+    )
+{
+    ULONG Left;
+    ULONG Right;
+    ULONG Smallest;
+    ULONG Temp;
+
+    for (;;) {
+        Left = (Index << 1) + 1;
+        Right = Left + 1;
+        Smallest = Index;
+
+        if (Left < Reader->HeapSize &&
+            IsTraceStoreShardCursorLess(Reader, Left, Smallest)) {
+            Smallest = Left;
+        }
+
+        if (Right < Reader->HeapSize &&
+            IsTraceStoreShardCursorLess(Reader, Right, Smallest)) {
+            Smallest = Right;
+        }
+
+        if (Smallest == Index) {
+            break;
+        }
+
+        Temp = Reader->Heap[Index];
+        Reader->Heap[Index] = Reader->Heap[Smallest];
+        Reader->Heap[Smallest] = Temp;
+        Index = Smallest;
+    }
+}
+
+FORCEINLINE
+VOID
+CloseTraceStoreShardCursor(
+    _In_ PTRACE_STORE_SHARD_CURSOR Cursor
+    )
+{
+    if (Cursor->TimestampBaseAddress) {
+        TraceStoreUnmapView(Cursor->TimestampBaseAddress,
+                            (SIZE_T)Cursor->TimestampSize.QuadPart);
+        Cursor->TimestampBaseAddress = NULL;
+    }
+
+    if (Cursor->TimestampMappingHandle) {
+        TraceStoreCloseSection(Cursor->TimestampMappingHandle);
+        Cursor->TimestampMappingHandle = NULL;
+    }
+
+    if (Cursor->TimestampFileHandle) {
+        CloseHandle(Cursor->TimestampFileHandle);
+        Cursor->TimestampFileHandle = NULL;
+    }
+
+    if (Cursor->AllocationRecordsBaseAddress) {
+        TraceStoreUnmapView(Cursor->AllocationRecordsBaseAddress,
+                            (SIZE_T)Cursor->AllocationRecordsSize.QuadPart);
+        Cursor->AllocationRecordsBaseAddress = NULL;
+    }
+
+    if (Cursor->AllocationRecordsMappingHandle) {
+        TraceStoreCloseSection(Cursor->AllocationRecordsMappingHandle);
+        Cursor->AllocationRecordsMappingHandle = NULL;
+    }
+
+    if (Cursor->AllocationRecordsFileHandle) {
+        CloseHandle(Cursor->AllocationRecordsFileHandle);
+        Cursor->AllocationRecordsFileHandle = NULL;
+    }
+
+    if (Cursor->DataBaseAddress) {
+        TraceStoreUnmapView(Cursor->DataBaseAddress,
+                            (SIZE_T)Cursor->DataSize.QuadPart);
+        Cursor->DataBaseAddress = NULL;
+    }
+
+    if (Cursor->DataMappingHandle) {
+        TraceStoreCloseSection(Cursor->DataMappingHandle);
+        Cursor->DataMappingHandle = NULL;
+    }
+
+    if (Cursor->DataFileHandle) {
+        CloseHandle(Cursor->DataFileHandle);
+        Cursor->DataFileHandle = NULL;
+    }
+}
+
+FORCEINLINE
+_Success_(return != 0)
+BOOL
+MapTraceStoreShardFile(
+    _In_ PCWSTR Path,
+    _In_ ULONG NumaNode,
+    _Out_ PHANDLE FileHandlePointer,
+    _Out_ PHANDLE MappingHandlePointer,
+    _Out_ PPVOID BaseAddressPointer,
+    _Out_ PLARGE_INTEGER SizePointer
+    )
+{
+    HANDLE FileHandle;
+    HANDLE MappingHandle;
+    PVOID BaseAddress;
+    LARGE_INTEGER Size;
+    LARGE_INTEGER FileOffset;
+
+    *FileHandlePointer = NULL;
+    *MappingHandlePointer = NULL;
+    *BaseAddressPointer = NULL;
+    SizePointer->QuadPart = 0;
+
+    FileHandle = CreateFileW(
+        Path,
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL
+    );
+
+    if (FileHandle == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    *FileHandlePointer = FileHandle;
+
+    if (!TraceStoreGetFileSize(FileHandle, &Size)) {
+        return FALSE;
+    }
+
+    if (Size.QuadPart == 0) {
+        return TRUE;
+    }
+
+    MappingHandle = TraceStoreCreateSection(FileHandle,
+                                            PAGE_READONLY,
+                                            Size,
+                                            NumaNode);
+
+    if (!MappingHandle || MappingHandle == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    *MappingHandlePointer = MappingHandle;
+
+    FileOffset.QuadPart = 0;
+    BaseAddress = TraceStoreMapView(MappingHandle,
+                                    FILE_MAP_READ,
+                                    FileOffset,
+                                    (SIZE_T)Size.QuadPart,
+                                    NULL,
+                                    NumaNode);
+
+    if (!BaseAddress) {
+        return FALSE;
+    }
+
+    TraceStoreAdviseView(BaseAddress,
+                         (SIZE_T)Size.QuadPart,
+                         TraceStoreViewAdviceSequential);
+
+    *BaseAddressPointer = BaseAddress;
+    SizePointer->QuadPart = Size.QuadPart;
+
+    return TRUE;
+}
+
+FORCEINLINE
+BOOL
+PrepareTraceStoreShardCursorAllocation(
+    _In_ PTRACE_STORE_SHARD_CURSOR Cursor
+    )
+{
+    PTRACE_STORE_ALLOCATION Allocation;
+
+    //
+    // Skip over dummy allocation records, advancing past the padding they
+    // describe, and empty records, until a record with allocations remaining
+    // is found.
+    //
+
+    while (Cursor->NextAllocation < Cursor->EndAllocation) {
+
+        Allocation = Cursor->NextAllocation;
+
+        if (IsDummyAllocation(Allocation)) {
+            Cursor->NextAddress += Allocation->RecordSize.QuadPart;
+            Cursor->NextAllocation++;
+            continue;
+        }
+
+        if (Allocation->NumberOfRecords.QuadPart == 0) {
+            Cursor->NextAllocation++;
+            continue;
+        }
+
+        if (Cursor->CoalescedAllocations) {
+            Cursor->AllocationSize = Allocation->RecordSize.QuadPart;
+            Cursor->AllocationsRemaining = (
+                Allocation->NumberOfRecords.QuadPart
+            );
+        } else {
+            Cursor->AllocationSize = (
+                Allocation->RecordSize.QuadPart *
+                Allocation->NumberOfRecords.QuadPart
+            );
+            Cursor->AllocationsRemaining = 1;
+        }
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+_Use_decl_annotations_
+BOOL
+OpenTraceStoreShardReader(
+    PTRACE_STORE TraceStore,
+    PPTRACE_STORE_SHARD_READER ReaderPointer
+    )
+/*++
+
+Routine Description:
+
+    This routine opens a reader over all shards of a trace store with the
+    PerThreadShards trait.  Each shard's data file, :Allocation stream and
+    :AllocationTimestamp stream are mapped in their entirety, and a cursor is
+    initialized at the first allocation of each non-empty shard.
+
+    The position and size of each allocation are derived by walking the
+    shard's :Allocation records, skipping the padding described by dummy
+    allocation records.  If the trace store coalesces allocations, each
+    record counted by an :Allocation record is assumed to have been allocated
+    separately, as the number of records per allocation isn't preserved.
+    The number of allocations derived this way must match the number of
+    timestamps written for the shard, otherwise this routine fails rather
+    than return misaligned allocations.  Shards with timestamps disabled can't
+    be merged and will also cause this routine to fail.
+
+Arguments:
+
+    TraceStore - Supplies a pointer to a readonly TRACE_STORE structure with
+        the PerThreadShards trait.
+
+    ReaderPointer - Supplies the address of a variable that receives a pointer
+        to the reader on success.  CloseTraceStoreShardReader() should be
+        called once the reader is no longer needed.
+
+Return Value:
+
+    TRUE on success, FALSE on failure.
+
+--*/
+{
+    BOOL Success;
+    BOOLEAN CoalescedAllocations;
+    USHORT ShardIndex;
+    ULONG Index;
+    ULONGLONG NumberOfTimestamps;
+    ULONGLONG NumberOfAllocations;
+    ULONGLONG NumberOfAllocationRecords;
+    ULONGLONG RecordIndex;
+    ULONGLONG NumberOfBytes;
+    PALLOCATOR Allocator;
+    PLARGE_INTEGER FirstTimestamp;
+    PTRACE_STORE_ALLOCATION Allocation;
+    PTRACE_STORE_ALLOCATION FirstAllocation;
+    PTRACE_STORE_SHARDS Shards;
+    PTRACE_STORE_SHARD_READER Reader;
+    PTRACE_STORE_SHARD_CURSOR Cursor;
+    WCHAR Path[_OUR_MAX_PATH];
+
+    //
+    // Validate arguments.
+    //
+
+    if (!ARGUMENT_PRESENT(ReaderPointer)) {
+        return FALSE;
+    }
+
+    *ReaderPointer = NULL;
+
+    if (!ARGUMENT_PRESENT(TraceStore)) {
+        return FALSE;
+    }
+
+    Shards = TraceStore->Shards;
+    if (!TraceStore->IsReadonly || !Shards) {
+        return FALSE;
+    }
+
+    Allocator = TraceStore->pAllocator;
+
+    Reader = (PTRACE_STORE_SHARD_READER)(
+        Allocator->Calloc(Allocator->Context, 1, sizeof(*Reader))
+    );
+
+    if (!Reader) {
+        return FALSE;
+    }
+
+    Reader->SizeOfStruct = sizeof(*Reader);
+    Reader->Allocator = Allocator;
+    Reader->TraceStore = TraceStore;
+
+    CoalescedAllocations = (BOOLEAN)(
+        WantsCoalescedAllocations(*TraceStore->pTraits)
+    );
+
+    //
+    // Shard indexes are handed out sequentially, but a shard may be missing if
+    // it failed to be created, so probe every possible index.
+    //
+
+    for (ShardIndex = 0; ShardIndex < MAX_TRACE_STORE_SHARDS; ShardIndex++) {
+
+        Cursor = &Reader->Cursors[Reader->NumberOfShards];
+        Cursor->ShardIndex = ShardIndex;
+
+        if (!GetTraceStoreShardPath(Shards, ShardIndex, NULL, Path)) {
+            goto Error;
+        }
+
+        Success = MapTraceStoreShardFile(Path,
+                                         TraceStore->NumaNode,
+                                         &Cursor->DataFileHandle,
+                                         &Cursor->DataMappingHandle,
+                                         &Cursor->DataBaseAddress,
+                                         &Cursor->DataSize);
+
+        if (!Success) {
+            if (!Cursor->DataFileHandle &&
+                GetLastError() == ERROR_FILE_NOT_FOUND) {
+
+                //
+                // The shard doesn't exist.
+                //
+
+                continue;
+            }
+            CloseTraceStoreShardCursor(Cursor);
+            goto Error;
+        }
+
+        if (Cursor->DataSize.QuadPart == 0) {
+            CloseTraceStoreShardCursor(Cursor);
+            continue;
+        }
+
+        if (!GetTraceStoreShardPath(Shards,
+                                    ShardIndex,
+                                    TraceStoreAllocationSuffix,
+                                    Path)) {
+            CloseTraceStoreShardCursor(Cursor);
+            goto Error;
+        }
+
+        Success = MapTraceStoreShardFile(
+            Path,
+            TraceStore->NumaNode,
+            &Cursor->AllocationRecordsFileHandle,
+            &Cursor->AllocationRecordsMappingHandle,
+            &Cursor->AllocationRecordsBaseAddress,
+            &Cursor->AllocationRecordsSize
+        );
+
+        if (!Success || Cursor->AllocationRecordsSize.QuadPart == 0) {
+            CloseTraceStoreShardCursor(Cursor);
+            goto Error;
+        }
+
+        if (!GetTraceStoreShardPath(Shards,
+                                    ShardIndex,
+                                    TraceStoreAllocationTimestampSuffix,
+                                    Path)) {
+            CloseTraceStoreShardCursor(Cursor);
+            goto Error;
+        }
+
+        Success = MapTraceStoreShardFile(Path,
+                                         TraceStore->NumaNode,
+                                         &Cursor->TimestampFileHandle,
+                                         &Cursor->TimestampMappingHandle,
+                                         &Cursor->TimestampBaseAddress,
+                                         &Cursor->TimestampSize);
+
+        if (!Success || Cursor->TimestampSize.QuadPart == 0) {
+            CloseTraceStoreShardCursor(Cursor);
+            goto Error;
+        }
+
+        //
+        // Metadata streams may not have been truncated, so ignore any trailing
+        // zeroed :Allocation records and timestamp slots.
+        //
+
+        FirstAllocation = (PTRACE_STORE_ALLOCATION)(
+            Cursor->AllocationRecordsBaseAddress
+        );
+        NumberOfAllocationRecords = (
+            Cursor->AllocationRecordsSize.QuadPart /
+            sizeof(TRACE_STORE_ALLOCATION)
+        );
+
+        while (NumberOfAllocationRecords > 0) {
+            Allocation = &FirstAllocation[NumberOfAllocationRecords-1];
+            if (Allocation->NumberOfRecords.SignedQuadPart != 0 ||
+                Allocation->RecordSize.QuadPart != 0) {
+                break;
+            }
+            NumberOfAllocationRecords--;
+        }
+
+        FirstTimestamp = (PLARGE_INTEGER)Cursor->TimestampBaseAddress;
+        NumberOfTimestamps = (
+            Cursor->TimestampSize.QuadPart / sizeof(LARGE_INTEGER)
+        );
+
+        while (NumberOfTimestamps > 0 &&
+               FirstTimestamp[NumberOfTimestamps-1].QuadPart == 0) {
+            NumberOfTimestamps--;
+        }
+
+        //
+        // Walk the :Allocation records, counting the allocations and bytes
+        // they describe, and verify they're consistent with the timestamps
+        // and the data file.
+        //
+
+        NumberOfAllocations = 0;
+        NumberOfBytes = 0;
+
+        for (RecordIndex = 0;
+             RecordIndex < NumberOfAllocationRecords;
+             RecordIndex++) {
+
+            Allocation = &FirstAllocation[RecordIndex];
+
+            if (IsDummyAllocation(Allocation)) {
+                NumberOfBytes += Allocation->RecordSize.QuadPart;
+                continue;
+            }
+
+            if (Allocation->NumberOfRecords.QuadPart == 0) {
+                continue;
+            }
+
+            if (Allocation->RecordSize.SignedQuadPart <= 0) {
+                break;
+            }
+
+            NumberOfBytes += (
+                Allocation->RecordSize.QuadPart *
+                Allocation->NumberOfRecords.QuadPart
+            );
+
+            if (CoalescedAllocations) {
+                NumberOfAllocations += Allocation->NumberOfRecords.QuadPart;
+            } else {
+                NumberOfAllocations++;
+            }
+        }
+
+        if (RecordIndex != NumberOfAllocationRecords ||
+            NumberOfAllocations == 0 ||
+            NumberOfAllocations != NumberOfTimestamps ||
+            NumberOfBytes > (ULONGLONG)Cursor->DataSize.QuadPart) {
+            CloseTraceStoreShardCursor(Cursor);
+            goto Error;
+        }
+
+        Cursor->CoalescedAllocations = CoalescedAllocations;
+        Cursor->NextAddress = (PCHAR)Cursor->DataBaseAddress;
+        Cursor->NextAllocation = FirstAllocation;
+        Cursor->EndAllocation = FirstAllocation + NumberOfAllocationRecords;
+
+        if (!PrepareTraceStoreShardCursorAllocation(Cursor)) {
+            CloseTraceStoreShardCursor(Cursor);
+            goto Error;
+        }
+
+        Cursor->NextTimestamp = FirstTimestamp;
+        Cursor->EndTimestamp = FirstTimestamp + NumberOfTimestamps;
+        Cursor->Timestamp.QuadPart = FirstTimestamp->QuadPart;
+
+        Reader->NumberOfAllocations += NumberOfTimestamps;
+        Reader->NumberOfShards++;
+    }
+
+    //
+    // Build the heap.
+    //
+
+    Reader->HeapSize = Reader->NumberOfShards;
+    for (Index = 0; Index < Reader->HeapSize; Index++) {
+        Reader->Heap[Index] = Index;
+    }
+
+    Index = Reader->HeapSize >> 1;
+    while (Index-- > 0) {
+        SiftDownTraceStoreShardReaderHeap(Reader, Index);
+    }
+
+    *ReaderPointer = Reader;
+
+    return TRUE;
+
+Error:
+
+    CloseTraceStoreShardReader(&Reader);
+
+    return FALSE;
+}
+
+_Use_decl_annotations_
+BOOL
+ReadTraceStoreShardReader(
+    PTRACE_STORE_SHARD_READER Reader,
+    PVOID *AddressPointer,
+    PLARGE_INTEGER TimestampPointer,
+    PUSHORT ShardIndexPointer
+    )
+/*++
+
+Routine Description:
+
+    This routine returns the next allocation across all shards, in timestamp
+    order.  Allocations with equal timestamps are returned in shard index
+    order.
+
+Arguments:
+
+    Reader - Supplies a pointer to a TRACE_STORE_SHARD_READER structure.
+
+    AddressPointer - Supplies the address of a variable that receives the
+        address of the allocation.  This points into a readonly view of the
+        shard's data file that remains valid until the reader is closed.
+
+    TimestampPointer - Optionally supplies a pointer to a variable that
+        receives the allocation's timestamp.
+
+    ShardIndexPointer - Optionally supplies a pointer to a variable that
+        receives the index of the shard the allocation came from.
+
+Return Value:
+
+    TRUE if an allocation was returned, FALSE if all allocations have been
+    read.
+
+--*/
+{
+    PTRACE_STORE_SHARD_CURSOR Cursor;
+
+    *AddressPointer = NULL;
+
+    if (Reader->HeapSize == 0) {
+        return FALSE;
+    }
+
+    Cursor = &Reader->Cursors[Reader->Heap[0]];
+
+    *AddressPointer = Cursor->NextAddress;
+
+    if (ARGUMENT_PRESENT(TimestampPointer)) {
+        TimestampPointer->QuadPart = Cursor->Timestamp.QuadPart;
+    }
+
+    if (ARGUMENT_PRESENT(ShardIndexPointer)) {
+        *ShardIndexPointer = Cursor->ShardIndex;
+    }
+
+    Reader->AllocationsRead++;
+
+    //
+    // Advance the cursor.  If it's exhausted, replace the root of the heap
+    // with the last element.  Either way, restore the heap property.
+    //
+
+    Cursor->NextAddress += Cursor->AllocationSize;
+    Cursor->NextTimestamp++;
+
+    if (--Cursor->AllocationsRemaining == 0) {
+        Cursor->NextAllocation++;
+        PrepareTraceStoreShardCursorAllocation(Cursor);
+    }
+
+    if (Cursor->NextTimestamp == Cursor->EndTimestamp) {
+        Reader->Heap[0] = Reader->Heap[--Reader->HeapSize];
+    } else if (Cursor->NextTimestamp->QuadPart != 0) {
+        Cursor->Timestamp.QuadPart = Cursor->NextTimestamp->QuadPart;
+    }
+
+    SiftDownTraceStoreShardReaderHeap(Reader, 0);
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+VOID
+CloseTraceStoreShardReader(
+    PPTRACE_STORE_SHARD_READER ReaderPointer
+    )
+/*++
+
+Routine Description:
+
+    This routine closes a reader opened by OpenTraceStoreShardReader(),
+    unmapping all shard views and freeing the reader.
+
+Arguments:
+
+    ReaderPointer - Supplies the address of a variable that contains a pointer
+        to the reader.  The variable is cleared.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ULONG Index;
+    PALLOCATOR Allocator;
+    PTRACE_STORE_SHARD_READER Reader;
+
+    if (!ARGUMENT_PRESENT(ReaderPointer)) {
+        return;
+    }
+
+    Reader = *ReaderPointer;
+    if (!Reader) {
+        return;
+    }
+
+    *ReaderPointer = NULL;
+
+    for (Index = 0; Index < Reader->NumberOfShards; Index++) {
+        CloseTraceStoreShardCursor(&Reader->Cursors[Index]);
+    }
+
+    Allocator = Reader->Allocator;
+    Allocator->Free(Allocator->Context, Reader);
+}
+
+// vim:set ts=8 sw=4 sts=4 tw=80 expandtab                                     :
@@ -140,6 +140,37 @@ Return Value:
         }
     }
 
+    if (Traits.PerThreadShards) {
+        if (!AssertTrue("MultipleRecords", Traits.MultipleRecords)) {
+            return FALSE;
+        }
+        if (!AssertFalse("ConcurrentAllocations",
+                         Traits.ConcurrentAllocations)) {
+            return FALSE;
+        }
+        if (!AssertFalse("LinkedStore", Traits.LinkedStore)) {
+            return FALSE;
+        }
+        if (!AssertFalse("Periodic", Traits.Periodic)) {
+            return FALSE;
+        }
+        if (!AssertFalse("TraceStore->IsMetadata", TraceStore->IsMetadata)) {
+            return FALSE;
+        }
+    }
+
+    if (Traits.BlockCompression) {
+        if (!AssertTrue("MultipleRecords", Traits.MultipleRecords)) {
+            return FALSE;
+        }
+        if (!AssertFalse("PerThreadShards", Traits.PerThreadShards)) {
+            return FALSE;
+        }
+        if (!AssertFalse("TraceStore->IsMetadata", TraceStore->IsMetadata)) {
+            return FALSE;
+        }
+    }
+
     return TRUE;
 }
 
@@ -628,6 +628,28 @@ Return Value:
         if (!Success) {
             return FALSE;
         }
+
+        //
+        // If the trace store is sharded per-thread, create the shards
+        // structure now, whilst we've got the path handy.
+        //
+
+        if (HasPerThreadShards(Traits)) {
+            if (!CreateTraceStoreShards(TraceStore, Path)) {
+                return FALSE;
+            }
+        }
+
+        //
+        // Likewise for block compression.  Readonly traits aren't known until
+        // bind time, so readonly stores always probe for a block index.
+        //
+
+        if (Readonly || WantsBlockCompression(Traits)) {
+            if (!CreateTraceStoreBlockCompression(TraceStore, Path)) {
+                return FALSE;
+            }
+        }
     }
 
     //
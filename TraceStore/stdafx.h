@@ -36,6 +36,7 @@ Abstract:
 #include "../Rtl/atexit.h"
 #include "../TracerConfig/TracerConfig.h"
 #include "../TracerHeap/TracerHeap.h"
+#include "TraceStorePlatform.h"
 #include "TraceStoreIndex.h"
 #include "TraceStore.h"
 #include "TraceStorePrivate.h"
@@ -253,6 +253,11 @@ Return Value:
         240
     );
 
+    READ_REG_DWORD_RUNTIME_PARAM(
+        ConcurrentAllocationsChunkSizeInBytes,
+        65536
+    );
+
     //
     // Prep the TRACER_PATHS structure.
     //
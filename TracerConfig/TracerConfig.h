@@ -678,10 +678,13 @@ typedef struct _TRACER_RUNTIME_PARAMETERS {
     ULONG IntervalFramesPerSecond;
 
     //
-    // Pad out to 32 bytes.
+    // Trace stores with concurrent allocations and a fixed record size hand
+    // out records from per-thread chunks of this many bytes, only entering the
+    // critical section above when a chunk needs to be replaced.  A value of 0
+    // disables per-thread chunks.
     //
 
-    ULONG Unused;
+    ULONG ConcurrentAllocationsChunkSizeInBytes;
 
 } TRACER_RUNTIME_PARAMETERS;
 typedef TRACER_RUNTIME_PARAMETERS *PTRACER_RUNTIME_PARAMETERS;